@@ -0,0 +1,686 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_mock.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_litemesh_ie.h"
+#include "esp_gateway_litemesh_route_table.h"
+#include "esp_gateway_napt_table.h"
+
+/*
+ * Timings of the gateway logic on the host, with the ESP-IDF drivers mocked:
+ *   - netif creation and removal, as done by esp_gateway_create_xxx_netif()
+ *   - IP and MAC allocation with the data-forwarding netifs in place
+ *   - subnet conflict resolution when an uplink gets an address of a data-forwarding subnet
+ *   - LiteMesh vendor IE processing: beacons heard while looking for a parent or from the parent,
+ *     and the IE rebuilt when a station joins the SoftAP
+ *   - LiteMesh vendor IE parsing of both versions, against the copying unpack of the previous firmware
+ *   - the forwarding work of a UDP flow crossing 1 to 6 LiteMesh nodes, translated at every node or routed
+ *     down the mesh and translated at the root only; the air time of the hops is not modelled
+ * The numbers compare builds on the same machine, they are not the timings of an ESP32.
+ */
+
+#define BENCH_LITEMESH_SSID           "Espressif_Router_2G"
+#define BENCH_LITEMESH_MAX_HOPS       (6)
+#define BENCH_LITEMESH_FLOWS          (64)
+
+typedef struct {
+    uint32_t netifs;
+    uint32_t rounds;
+    uint32_t beacons;
+    uint32_t parents;
+    uint32_t packets;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    uint8_t data[2 + 255];
+} bench_ie_t;
+
+static esp_netif_t* s_station = NULL;
+static esp_netif_t* s_uplink = NULL;
+static esp_netif_t** s_netifs = NULL;
+static uint32_t s_netif_num = 0;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_report(const char* name, uint32_t scale, uint64_t ops, uint64_t elapsed_ns, const char* note)
+{
+    printf("%-24s %8u %10llu %12.3f %12.1f   %s\n", name, (unsigned)scale, (unsigned long long)ops,
+           elapsed_ns / 1e6, ops ? (double)elapsed_ns / ops : 0.0, note ? note : "");
+}
+
+/* LiteMesh beacon IE of a node connected to the router BENCH_LITEMESH_SSID */
+static const vendor_ie_data_t* bench_build_litemesh_ie(bench_ie_t* ie, uint8_t version, uint8_t level, uint8_t connected_stations,
+                                                       const uint8_t* router_segments, uint8_t router_num,
+                                                       const uint8_t* inherited_segments, uint8_t inherited_num)
+{
+    vendor_ie_data_t* vnd_ie = (vendor_ie_data_t*)ie->data;
+    esp_gateway_litemesh_info_t info = {
+        .version = version,
+        .max_connection = CONFIG_LITEMESH_MAX_CONNECT_NUMBER,
+        .connected_station_number = connected_stations,
+        .connect_router_status = 1,
+        .level = level,
+        .router_ssid_len = strlen(BENCH_LITEMESH_SSID),
+        .router_number = router_num,
+        .inherited_netif_number = inherited_num,
+    };
+
+    memcpy(info.router_ssid, BENCH_LITEMESH_SSID, info.router_ssid_len);
+    memcpy(info.router_net_segment, router_segments, router_num);
+    memcpy(info.inherited_net_segment, inherited_segments, inherited_num);
+
+    memset(ie, 0, sizeof(*ie));
+    vnd_ie->element_id = WIFI_VENDOR_IE_ELEMENT_ID;
+    vnd_ie->vendor_oui[0] = CONFIG_VENDOR_OUI_0;
+    vnd_ie->vendor_oui[1] = CONFIG_VENDOR_OUI_1;
+    vnd_ie->vendor_oui[2] = CONFIG_VENDOR_OUI_2;
+    esp_litemesh_ie_encode(&info, vnd_ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN);
+
+    return vnd_ie;
+}
+
+/* esp_litemesh_info_unpack() of the previous firmware, which copied the version 1 IE out */
+static void bench_unpack_v1_copy(const vendor_ie_data_t* vendor_ie, esp_gateway_litemesh_info_t* out)
+{
+    uint8_t offset = 5;
+    uint8_t router_ssid_length = vendor_ie->payload[3];
+    uint8_t router_number = vendor_ie->payload[4] >> 4;
+    uint8_t inherited_netif_number = vendor_ie->payload[4] & 0x0F;
+
+    out->version = vendor_ie->payload[0];
+    out->max_connection = vendor_ie->payload[1] >> 4;
+    out->connected_station_number = vendor_ie->payload[1] & 0x0F;
+    out->connect_router_status = vendor_ie->payload[2] >> 7;
+    out->level = vendor_ie->payload[2] & 0x0F;
+    out->router_ssid_len = router_ssid_length;
+    memcpy(out->router_ssid, vendor_ie->payload + offset, router_ssid_length);
+    offset += router_ssid_length;
+
+    out->router_number = router_number;
+    memcpy(out->router_net_segment, vendor_ie->payload + offset, router_number);
+    offset += router_number;
+
+    out->inherited_netif_number = inherited_netif_number;
+    memcpy(out->inherited_net_segment, vendor_ie->payload + offset, inherited_netif_number);
+}
+
+static esp_netif_t* bench_create_uplink(void)
+{
+    /* An uplink the LiteMesh handlers do not watch, its IP events only go to the gateway */
+    static const esp_netif_inherent_config_t base = {
+        .flags = ESP_NETIF_DHCP_CLIENT,
+        .mac = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+        .get_ip_event = IP_EVENT_ETH_GOT_IP,
+        .lost_ip_event = IP_EVENT_ETH_LOST_IP,
+        .if_key = "BENCH_UPLINK",
+        .if_desc = "uplink",
+        .route_prio = 50,
+    };
+    esp_netif_config_t config = { .base = &base };
+    esp_netif_t* netif = esp_gateway_create_netif(&config, NULL, NULL, false);
+
+    esp_gateway_netif_list_add(netif);
+    return netif;
+}
+
+static esp_netif_t* bench_create_data_forwarding_netif(void)
+{
+    static const esp_netif_inherent_config_t base = {
+        .flags = ESP_NETIF_DHCP_SERVER | ESP_NETIF_FLAG_AUTOUP,
+        .if_key = "BENCH_DHCPS",
+        .if_desc = "dhcps",
+        .route_prio = 20,
+    };
+    esp_netif_config_t config = { .base = &base };
+    esp_netif_t* netif = esp_gateway_create_netif(&config, NULL, NULL, true);
+
+    esp_gateway_netif_list_add(netif);
+    return netif;
+}
+
+static void bench_destroy_netifs(void)
+{
+    for (uint32_t loop = 0; loop < s_netif_num; loop++) {
+        esp_gateway_netif_list_remove(s_netifs[loop]);
+        esp_netif_destroy(s_netifs[loop]);
+    }
+    s_netif_num = 0;
+}
+
+static void bench_netif_create(const bench_config_t* config)
+{
+    uint64_t create_ns = 0;
+    uint64_t remove_ns = 0;
+
+    for (uint32_t round = 0; round < config->rounds; round++) {
+        uint64_t start = bench_now_ns();
+        for (uint32_t loop = 0; loop < config->netifs; loop++) {
+            s_netifs[s_netif_num++] = bench_create_data_forwarding_netif();
+        }
+        create_ns += bench_now_ns() - start;
+
+        start = bench_now_ns();
+        bench_destroy_netifs();
+        remove_ns += bench_now_ns() - start;
+    }
+
+    bench_report("netif_create", config->netifs, (uint64_t)config->rounds * config->netifs, create_ns, "create, request ip/mac, add");
+    bench_report("netif_remove", config->netifs, (uint64_t)config->rounds * config->netifs, remove_ns, NULL);
+}
+
+static void bench_address_request(const bench_config_t* config)
+{
+    uint64_t ops = (uint64_t)config->rounds * config->netifs;
+    esp_netif_ip_info_t ip_info;
+    uint8_t mac[6];
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    uint32_t failures = 0;
+    char note[96];
+
+    for (uint32_t loop = 0; loop < config->netifs; loop++) {
+        s_netifs[s_netif_num++] = bench_create_data_forwarding_netif();
+    }
+
+    start = bench_now_ns();
+    for (uint64_t loop = 0; loop < ops; loop++) {
+        failures += (esp_gateway_netif_request_ip(&ip_info) != ESP_OK);
+    }
+    elapsed = bench_now_ns() - start;
+    snprintf(note, sizeof(note), "%u netifs in place, %u failures", (unsigned)config->netifs, (unsigned)failures);
+    bench_report("ip_request", config->netifs, ops, elapsed, note);
+
+    failures = 0;
+    start = bench_now_ns();
+    for (uint64_t loop = 0; loop < ops; loop++) {
+        failures += (esp_gateway_netif_request_mac(mac) != ESP_OK);
+    }
+    elapsed = bench_now_ns() - start;
+    snprintf(note, sizeof(note), "%u netifs in place, %u failures", (unsigned)config->netifs, (unsigned)failures);
+    bench_report("mac_request", config->netifs, ops, elapsed, note);
+}
+
+/* The uplink gets the subnet of a data-forwarding netif each round, which must move away */
+static void bench_conflict_resolution(const bench_config_t* config)
+{
+    esp_mock_netif_stats_t before;
+    esp_mock_netif_stats_t after;
+    uint64_t elapsed = 0;
+    char note[96];
+
+    esp_mock_netif_get_stats(&before);
+    for (uint32_t round = 0; round < config->rounds; round++) {
+        esp_netif_ip_info_t conflict;
+
+        esp_netif_get_ip_info(s_netifs[round % s_netif_num], &conflict);
+        conflict.ip.addr = (conflict.ip.addr & conflict.netmask.addr) | esp_netif_htonl(100);
+
+        uint64_t start = bench_now_ns();
+        esp_mock_netif_got_ip(s_uplink, &conflict);
+        esp_mock_timer_advance(CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS * 1000ULL);
+        elapsed += bench_now_ns() - start;
+    }
+    esp_mock_netif_get_stats(&after);
+
+    snprintf(note, sizeof(note), "%u subnets moved", (unsigned)(after.dhcps_starts - before.dhcps_starts));
+    bench_report("conflict_resolution", config->netifs, config->rounds, elapsed, note);
+}
+
+static void bench_ie_note(char* note, size_t size, const esp_mock_wifi_stats_t* before, const esp_mock_wifi_stats_t* after,
+                          const esp_litemesh_ie_stats_t* ie_before, const esp_litemesh_ie_stats_t* ie_after)
+{
+    snprintf(note, size, "%u IE sets, %u rebuilds, %u skipped, %u coalesced",
+             (unsigned)(after->vendor_ie_sets - before->vendor_ie_sets),
+             (unsigned)(ie_after->rebuilds - ie_before->rebuilds),
+             (unsigned)(ie_after->skipped - ie_before->skipped),
+             (unsigned)(ie_after->coalesced - ie_before->coalesced));
+}
+
+static void bench_litemesh_beacons(const bench_config_t* config)
+{
+    bench_ie_t* ies = calloc(config->parents, sizeof(bench_ie_t));
+    uint8_t (*macs)[6] = calloc(config->parents, sizeof(*macs));
+    esp_mock_wifi_stats_t before;
+    esp_mock_wifi_stats_t after;
+    esp_litemesh_ie_stats_t ie_before;
+    esp_litemesh_ie_stats_t ie_after;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    char note[96];
+
+    if ((ies == NULL) || (macs == NULL)) {
+        printf("litemesh benchmarks skipped, no mem\n");
+        goto exit;
+    }
+
+    /* Parents at various levels of the same mesh, each tracing its own router segment, half of them with the previous firmware */
+    for (uint32_t loop = 0; loop < config->parents; loop++) {
+        uint8_t router_segment = 1 + loop % 250;
+        uint8_t inherited_segments[3] = { 200, 201, 202 };
+
+        macs[loop][0] = 0x24;
+        macs[loop][4] = (uint8_t)(loop >> 8);
+        macs[loop][5] = (uint8_t)loop;
+        bench_build_litemesh_ie(&ies[loop], ESP_LITEMESH_IE_VERSION_1 + loop % 2, 1 + esp_random() % 6,
+                                esp_random() % CONFIG_LITEMESH_MAX_CONNECT_NUMBER, &router_segment, 1, inherited_segments, loop % 4);
+    }
+
+    /* Looking for a parent: every beacon goes through the parent selection */
+    esp_mock_wifi_get_stats(&before);
+    start = bench_now_ns();
+    for (uint32_t loop = 0; loop < config->beacons; loop++) {
+        uint32_t parent = loop % config->parents;
+        esp_mock_wifi_beacon(macs[parent], (const vendor_ie_data_t*)ies[parent].data, -30 - (int)(esp_random() % 60));
+    }
+    elapsed = bench_now_ns() - start;
+    esp_mock_wifi_get_stats(&after);
+    snprintf(note, sizeof(note), "%u parents, %u IE sets", (unsigned)config->parents,
+             (unsigned)(after.vendor_ie_sets - before.vendor_ie_sets));
+    bench_report("litemesh_scan_beacon", config->parents, config->beacons, elapsed, note);
+
+    /* Stations joining and leaving the SoftAP change the IE, the coalescing delay expires every 4 stations */
+    esp_mock_wifi_get_stats(&before);
+    esp_litemesh_get_ie_stats(&ie_before);
+    start = bench_now_ns();
+    for (uint32_t loop = 0; loop < config->rounds; loop++) {
+        uint8_t station[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, (uint8_t)loop };
+        esp_mock_wifi_ap_station(station, true);
+        if ((loop % 4) == 3) {
+            esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+        }
+        esp_mock_wifi_ap_station(station, false);
+    }
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    elapsed = bench_now_ns() - start;
+    esp_mock_wifi_get_stats(&after);
+    esp_litemesh_get_ie_stats(&ie_after);
+    bench_ie_note(note, sizeof(note), &before, &after, &ie_before, &ie_after);
+    bench_report("litemesh_station_event", 1, config->rounds * 2ULL, elapsed, note);
+
+    /* Attached to parent 0: its beacons are inherited from */
+    wifi_ap_record_t ap = { .primary = 6, .rssi = -40 };
+    esp_netif_ip_info_t ip_info = {
+        .ip = { .addr = ESP_IP4TOADDR(192, 168, 1, 10) },
+        .gw = { .addr = ESP_IP4TOADDR(192, 168, 1, 1) },
+        .netmask = { .addr = ESP_IP4TOADDR(255, 255, 255, 0) },
+    };
+    memcpy(ap.bssid, macs[0], sizeof(ap.bssid));
+    esp_mock_wifi_sta_connected(&ap);
+    esp_mock_netif_got_ip(s_station, &ip_info);
+    esp_mock_timer_advance(CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS * 1000ULL);
+    esp_mock_wifi_beacon(macs[0], (const vendor_ie_data_t*)ies[0].data, -40);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+
+    /* Unchanged beacons of the parent */
+    esp_mock_wifi_get_stats(&before);
+    esp_litemesh_get_ie_stats(&ie_before);
+    start = bench_now_ns();
+    for (uint32_t loop = 0; loop < config->beacons; loop++) {
+        esp_mock_wifi_beacon(macs[0], (const vendor_ie_data_t*)ies[0].data, -40);
+    }
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    elapsed = bench_now_ns() - start;
+    esp_mock_wifi_get_stats(&after);
+    esp_litemesh_get_ie_stats(&ie_after);
+    bench_ie_note(note, sizeof(note), &before, &after, &ie_before, &ie_after);
+    bench_report("litemesh_parent_beacon", 1, config->beacons, elapsed, note);
+
+    esp_mock_wifi_sta_disconnected();
+
+exit:
+    free(ies);
+    free(macs);
+}
+
+static void bench_litemesh_ie_parse(const bench_config_t* config)
+{
+    const uint8_t router_segment = 1;
+    const uint8_t inherited_segments[3] = { 200, 201, 202 };
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    volatile uint32_t sink = 0;
+    bench_ie_t ie;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    char note[96];
+
+    for (uint8_t version = ESP_LITEMESH_IE_VERSION_1; version <= ESP_LITEMESH_IE_VERSION_2; version++) {
+        const vendor_ie_data_t* vnd_ie = bench_build_litemesh_ie(&ie, version, 2, 3, &router_segment, 1, inherited_segments, 3);
+
+        start = bench_now_ns();
+        for (uint32_t loop = 0; loop < config->beacons; loop++) {
+            esp_litemesh_ie_parse(vnd_ie, &view);
+            sink += view.level + view.inherited_netif_number;
+        }
+        elapsed = bench_now_ns() - start;
+        snprintf(note, sizeof(note), "%u bytes IE, in place", (unsigned)(2 + vnd_ie->length));
+        bench_report((version == ESP_LITEMESH_IE_VERSION_1) ? "litemesh_ie_parse_v1" : "litemesh_ie_parse_v2", 1, config->beacons, elapsed, note);
+
+        if (version == ESP_LITEMESH_IE_VERSION_1) {
+            start = bench_now_ns();
+            for (uint32_t loop = 0; loop < config->beacons; loop++) {
+                memset(&info, 0, sizeof(info));
+                bench_unpack_v1_copy(vnd_ie, &info);
+                sink += info.level + info.inherited_netif_number;
+            }
+            elapsed = bench_now_ns() - start;
+            snprintf(note, sizeof(note), "%u bytes IE, copied", (unsigned)(2 + vnd_ie->length));
+            bench_report("litemesh_ie_unpack_v1", 1, config->beacons, elapsed, note);
+        }
+    }
+    (void)sink;
+}
+
+/* Header fields a NAPT hop rewrites, network byte order */
+typedef struct {
+    uint32_t src_addr;
+    uint32_t dest_addr;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint16_t ip_chksum;
+    uint16_t udp_chksum;
+} bench_packet_t;
+
+/* Incremental checksum update of RFC 1624, as done by the NAPT engine */
+static void bench_chksum_adjust32(uint16_t* chksum, uint32_t old_val, uint32_t new_val)
+{
+    uint32_t sum = (uint16_t)~*chksum;
+
+    sum += (uint16_t)~(old_val >> 16) + (uint16_t)~old_val;
+    sum += (uint16_t)(new_val >> 16) + (uint16_t)new_val;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *chksum = (uint16_t)~sum;
+}
+
+static void bench_packet_rewrite(bench_packet_t* packet, bool source, uint32_t addr, uint16_t port)
+{
+    uint32_t* old_addr = source ? &packet->src_addr : &packet->dest_addr;
+    uint16_t* old_port = source ? &packet->src_port : &packet->dest_port;
+
+    bench_chksum_adjust32(&packet->ip_chksum, *old_addr, addr);
+    bench_chksum_adjust32(&packet->udp_chksum, *old_addr, addr);
+    bench_chksum_adjust32(&packet->udp_chksum, *old_port, port);
+    *old_addr = addr;
+    *old_port = port;
+}
+
+/* Translate an outgoing packet at a node, false when the table refuses the flow */
+static bool bench_napt_out(esp_gateway_napt_table_t* table, bench_packet_t* packet, uint32_t outside_addr, uint32_t now)
+{
+    esp_gateway_napt_tuple_t tuple = {
+        .src_addr = packet->src_addr,
+        .dest_addr = packet->dest_addr,
+        .src_port = packet->src_port,
+        .dest_port = packet->dest_port,
+        .proto = ESP_GATEWAY_NAPT_PROTO_UDP,
+    };
+    esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_lookup_inside(table, &tuple, now);
+
+    if (mapping == NULL) {
+        mapping = esp_gateway_napt_table_insert(table, &tuple, now);
+    }
+    if (mapping == NULL) {
+        return false;
+    }
+
+    bench_packet_rewrite(packet, true, outside_addr, mapping->mport);
+    return true;
+}
+
+/* Translate the reply back at a node */
+static bool bench_napt_in(esp_gateway_napt_table_t* table, bench_packet_t* packet, uint32_t now)
+{
+    esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_lookup_outside(table, ESP_GATEWAY_NAPT_PROTO_UDP, packet->dest_port,
+                                                                                packet->src_addr, packet->src_port, now);
+
+    if (mapping == NULL) {
+        return false;
+    }
+
+    bench_packet_rewrite(packet, false, mapping->tuple.src_addr, mapping->tuple.src_port);
+    return true;
+}
+
+/*
+ * BENCH_LITEMESH_FLOWS UDP flows from the clients of a node hops deep in the mesh to a remote host, one
+ * packet out and its reply per operation. The node at level n has the SoftAP 192.168.(10 + n).1 and its
+ * station is 192.168.(9 + n).2, the root station is on the router subnet 192.168.1.0/24.
+ */
+static void bench_litemesh_hops(const bench_config_t* config)
+{
+    esp_gateway_napt_table_config_t napt_config = {
+        .capacity = BENCH_LITEMESH_FLOWS,
+        .port_min = 49152,
+        .port_max = 65535,
+        .timeout_ms = {
+            [ESP_GATEWAY_NAPT_PROTO_TCP] = 60000,
+            [ESP_GATEWAY_NAPT_PROTO_UDP] = 60000,
+            [ESP_GATEWAY_NAPT_PROTO_ICMP] = 60000,
+        },
+        .tcp_closing_timeout_ms = 2000,
+        .hash_seed = config->seed,
+    };
+    esp_gateway_napt_table_t* napt[BENCH_LITEMESH_MAX_HOPS] = { NULL };
+    esp_litemesh_route_table_t* routes[BENCH_LITEMESH_MAX_HOPS] = { NULL };
+    uint32_t station[BENCH_LITEMESH_MAX_HOPS];
+    const uint32_t remote = ESP_IP4TOADDR(93, 184, 216, 34);
+    uint32_t failures = 0;
+    char note[96];
+
+    for (uint32_t level = 0; level < BENCH_LITEMESH_MAX_HOPS; level++) {
+        uint8_t child[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, (uint8_t)(level + 1) };
+        uint8_t subtree[BENCH_LITEMESH_MAX_HOPS];
+        uint32_t num = 0;
+
+        station[level] = level ? ESP_IP4TOADDR(192, 168, 10 + level, 2) : ESP_IP4TOADDR(192, 168, 1, 2);
+        napt[level] = esp_gateway_napt_table_create(&napt_config);
+        routes[level] = esp_litemesh_route_table_create(1, 60000);
+        /* The segments of the levels below, through the station of the child */
+        for (uint32_t below = level + 1; below < BENCH_LITEMESH_MAX_HOPS; below++) {
+            subtree[num++] = 11 + below;
+        }
+        if ((napt[level] == NULL) || (routes[level] == NULL)
+            || (esp_litemesh_route_table_update(routes[level], child, ESP_IP4TOADDR(192, 168, 11 + level, 2), subtree, num, 0, NULL) != ESP_OK)) {
+            printf("litemesh_hops: out of memory\n");
+            goto cleanup;
+        }
+    }
+
+    for (uint32_t hops = 1; hops <= BENCH_LITEMESH_MAX_HOPS; hops++) {
+        for (uint32_t routed = 0; routed <= 1; routed++) {
+            esp_gateway_napt_table_stats_t stats;
+            uint32_t mappings = 0;
+            uint64_t start = 0;
+            uint64_t elapsed = 0;
+
+            for (uint32_t level = 0; level < BENCH_LITEMESH_MAX_HOPS; level++) {
+                esp_gateway_napt_table_flush(napt[level]);
+            }
+
+            start = bench_now_ns();
+            for (uint32_t loop = 0; loop < config->packets; loop++) {
+                uint32_t flow = loop % BENCH_LITEMESH_FLOWS;
+                bench_packet_t packet = {
+                    .src_addr = ESP_IP4TOADDR(192, 168, 10 + hops, 2 + flow),
+                    .dest_addr = remote,
+                    .src_port = htons(1024 + flow),
+                    .dest_port = htons(443),
+                };
+                uint32_t next_hop = 0;
+                bool ok = true;
+
+                /* Up from the deepest node: routed mode only translates at the root, the others use the default route */
+                for (int32_t level = hops - 1; (level >= 0) && ok; level--) {
+                    if (!routed || (level == 0)) {
+                        ok = bench_napt_out(napt[level], &packet, station[level], loop);
+                    }
+                }
+
+                /* The reply comes down */
+                packet.dest_addr = packet.src_addr;
+                packet.dest_port = packet.src_port;
+                packet.src_addr = remote;
+                packet.src_port = htons(443);
+                for (uint32_t level = 0; (level < hops) && ok; level++) {
+                    if (!routed || (level == 0)) {
+                        ok = bench_napt_in(napt[level], &packet, loop);
+                    }
+                    if (routed && (level + 1 < hops)) {
+                        esp_ip4_addr_t dest = { .addr = packet.dest_addr };
+                        ok = ok && esp_litemesh_route_table_lookup(routes[level], esp_ip4_addr3_16(&dest), &next_hop);
+                    }
+                }
+                failures += ok ? 0 : 1;
+            }
+            elapsed = bench_now_ns() - start;
+
+            for (uint32_t level = 0; level < hops; level++) {
+                esp_gateway_napt_table_get_stats(napt[level], &stats);
+                mappings += stats.active;
+            }
+            snprintf(note, sizeof(note), "%u NAPT mappings for %u flows", mappings, BENCH_LITEMESH_FLOWS);
+            bench_report(routed ? "litemesh_hops_routed" : "litemesh_hops_napt", hops, config->packets, elapsed, note);
+        }
+    }
+
+    if (failures) {
+        printf("litemesh_hops: %u packets not forwarded\n", failures);
+    }
+
+cleanup:
+    for (uint32_t level = 0; level < BENCH_LITEMESH_MAX_HOPS; level++) {
+        esp_gateway_napt_table_delete(napt[level]);
+        esp_litemesh_route_table_delete(routes[level]);
+    }
+}
+
+static void bench_usage(const char* name)
+{
+    printf("Usage: %s [options]\n"
+           "  -n, --netifs N    data-forwarding netifs, at most %d (default 16)\n"
+           "  -r, --rounds N    rounds of the netif, address and conflict benchmarks (default 200)\n"
+           "  -b, --beacons N   beacons per LiteMesh benchmark (default 10000)\n"
+           "  -p, --parents N   LiteMesh parents heard while scanning (default 8)\n"
+           "  -k, --packets N   packets per LiteMesh hops benchmark (default 100000)\n"
+           "  -s, --seed N      seed of esp_random() (default 1)\n"
+           "  -v, --verbose     log the gateway at the info level\n",
+           name, CONFIG_GATEWAY_NETIF_REGISTRY_SIZE - 3);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = {
+        { "netifs", required_argument, NULL, 'n' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "beacons", required_argument, NULL, 'b' },
+        { "parents", required_argument, NULL, 'p' },
+        { "packets", required_argument, NULL, 'k' },
+        { "seed", required_argument, NULL, 's' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    bench_config_t config = {
+        .netifs = 16,
+        .rounds = 200,
+        .beacons = 10000,
+        .parents = 8,
+        .packets = 100000,
+        .seed = 1,
+    };
+    int opt = 0;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    while ((opt = getopt_long(argc, argv, "n:r:b:p:k:s:vh", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            config.netifs = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            config.rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            config.beacons = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            config.parents = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            config.packets = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            config.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            esp_log_level_set("*", ESP_LOG_INFO);
+            break;
+        default:
+            bench_usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    /* The station, the SoftAP and the uplink take three entries of the registry */
+    if ((config.netifs == 0) || (config.netifs > CONFIG_GATEWAY_NETIF_REGISTRY_SIZE - 3)
+        || (config.rounds == 0) || (config.parents == 0) || (config.packets == 0)) {
+        bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    s_netifs = calloc(config.netifs, sizeof(esp_netif_t*));
+    if (s_netifs == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    esp_mock_random_seed(config.seed);
+    esp_event_loop_create_default();
+    esp_gateway_create_softap_netif(NULL, NULL, true, true);
+    s_station = esp_gateway_create_station_netif(NULL, NULL, false, false);
+    s_uplink = bench_create_uplink();
+
+    printf("%-24s %8s %10s %12s %12s   %s\n", "benchmark", "scale", "ops", "total ms", "ns per op", "");
+    bench_netif_create(&config);
+    bench_address_request(&config);
+    bench_conflict_resolution(&config);
+    bench_destroy_netifs();
+    bench_litemesh_beacons(&config);
+    bench_litemesh_ie_parse(&config);
+    bench_litemesh_hops(&config);
+
+    free(s_netifs);
+    return EXIT_SUCCESS;
+}
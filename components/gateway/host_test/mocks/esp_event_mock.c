@@ -0,0 +1,128 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_event.h"
+
+#define EVENT_MOCK_HANDLER_MAX  (64)
+
+typedef struct {
+    bool used;
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void* arg;
+} event_mock_handler_t;
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+static event_mock_handler_t s_handlers[EVENT_MOCK_HANDLER_MAX];
+static uint32_t s_handler_num = 0;
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void* event_handler_arg,
+                                              esp_event_handler_instance_t* instance)
+{
+    uint32_t loop = 0;
+
+    if (event_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Reuse the slots of the unregistered handlers, the order of the others is kept */
+    for (loop = 0; (loop < s_handler_num) && s_handlers[loop].used; loop++) {
+    }
+
+    if (loop == EVENT_MOCK_HANDLER_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_handlers[loop] = (event_mock_handler_t) {
+        .used = true, .base = event_base, .id = event_id, .handler = event_handler, .arg = event_handler_arg
+    };
+    if (loop == s_handler_num) {
+        s_handler_num++;
+    }
+
+    if (instance) {
+        *instance = &s_handlers[loop];
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void* event_handler_arg)
+{
+    return esp_event_handler_instance_register(event_base, event_id, event_handler, event_handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler)
+{
+    for (uint32_t loop = 0; loop < s_handler_num; loop++) {
+        if (s_handlers[loop].used && (s_handlers[loop].base == event_base)
+            && (s_handlers[loop].id == event_id) && (s_handlers[loop].handler == event_handler)) {
+            s_handlers[loop].used = false;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance)
+{
+    event_mock_handler_t* handler = (event_mock_handler_t*)instance;
+
+    if ((handler == NULL) || !handler->used) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handler->used = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    /* The handlers get a copy of the data, like with the default event loop */
+    uint8_t data[event_data_size ? event_data_size : 1];
+    uint32_t num = s_handler_num;
+
+    if (event_data) {
+        memcpy(data, event_data, event_data_size);
+    }
+
+    for (uint32_t loop = 0; loop < num; loop++) {
+        event_mock_handler_t handler = s_handlers[loop];
+
+        if (!handler.used
+            || ((handler.base != ESP_EVENT_ANY_BASE) && (handler.base != event_base))
+            || ((handler.id != ESP_EVENT_ANY_ID) && (handler.id != event_id))) {
+            continue;
+        }
+
+        handler.handler(handler.arg, event_base, event_id, event_data ? data : NULL);
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,304 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_system.h"
+#include "esp_mock.h"
+
+struct esp_netif_obj {
+    esp_netif_inherent_config_t config;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_MAX];
+    uint8_t mac[6];
+    bool started;
+    bool up;
+    bool dhcps_started;
+    uint32_t dhcps_offer;
+};
+
+static esp_mock_netif_stats_t s_netif_stats;
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t* esp_netif_new(const esp_netif_config_t* esp_netif_config)
+{
+    esp_netif_t* netif = NULL;
+
+    if ((esp_netif_config == NULL) || (esp_netif_config->base == NULL)) {
+        return NULL;
+    }
+
+    netif = calloc(1, sizeof(esp_netif_t));
+    if (netif == NULL) {
+        return NULL;
+    }
+
+    netif->config = *esp_netif_config->base;
+    memcpy(netif->mac, esp_netif_config->base->mac, sizeof(netif->mac));
+    if (esp_netif_config->base->ip_info) {
+        netif->ip_info = *esp_netif_config->base->ip_info;
+    }
+    netif->config.ip_info = NULL;
+    s_netif_stats.netifs++;
+
+    return netif;
+}
+
+void esp_netif_destroy(esp_netif_t* esp_netif)
+{
+    if (esp_netif) {
+        s_netif_stats.netifs--;
+        free(esp_netif);
+    }
+}
+
+void esp_netif_action_start(void* esp_netif, esp_event_base_t base, int32_t event_id, void* data)
+{
+    esp_netif_t* netif = esp_netif;
+
+    netif->started = true;
+    if (netif->config.flags & ESP_NETIF_FLAG_AUTOUP) {
+        netif->up = true;
+    }
+}
+
+void esp_netif_action_stop(void* esp_netif, esp_event_base_t base, int32_t event_id, void* data)
+{
+    esp_netif_t* netif = esp_netif;
+
+    netif->started = false;
+    netif->up = false;
+}
+
+esp_err_t esp_netif_up(esp_netif_t* esp_netif)
+{
+    if (esp_netif == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_netif->up = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_mac(esp_netif_t* esp_netif, uint8_t mac[])
+{
+    if ((esp_netif == NULL) || (mac == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(esp_netif->mac, mac, sizeof(esp_netif->mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_mac(esp_netif_t* esp_netif, uint8_t mac[])
+{
+    if ((esp_netif == NULL) || (mac == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(mac, esp_netif->mac, sizeof(esp_netif->mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info)
+{
+    if ((esp_netif == NULL) || (ip_info == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *ip_info = esp_netif->ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t* esp_netif, const esp_netif_ip_info_t* ip_info)
+{
+    if ((esp_netif == NULL) || (ip_info == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Like esp-netif, the IP of a DHCP server can only be changed while it is stopped */
+    if ((esp_netif->config.flags & ESP_NETIF_DHCP_SERVER) && esp_netif->dhcps_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_netif->ip_info = *ip_info;
+    s_netif_stats.ip_sets++;
+    return ESP_OK;
+}
+
+bool esp_netif_is_netif_up(esp_netif_t* esp_netif)
+{
+    return esp_netif && esp_netif->up;
+}
+
+esp_netif_flags_t esp_netif_get_flags(esp_netif_t* esp_netif)
+{
+    return esp_netif->config.flags;
+}
+
+const char* esp_netif_get_ifkey(esp_netif_t* esp_netif)
+{
+    return esp_netif->config.if_key;
+}
+
+const char* esp_netif_get_desc(esp_netif_t* esp_netif)
+{
+    return esp_netif->config.if_desc;
+}
+
+esp_err_t esp_netif_dhcps_option(esp_netif_t* esp_netif, esp_netif_dhcp_option_mode_t opt_op,
+                                 esp_netif_dhcp_option_id_t opt_id, void* opt_val, uint32_t opt_len)
+{
+    if ((esp_netif == NULL) || !(esp_netif->config.flags & ESP_NETIF_DHCP_SERVER) || (opt_val == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ((opt_id != ESP_NETIF_DOMAIN_NAME_SERVER) || (opt_len != sizeof(esp_netif->dhcps_offer))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (opt_op == ESP_NETIF_OP_SET) {
+        memcpy(&esp_netif->dhcps_offer, opt_val, opt_len);
+    } else if (opt_op == ESP_NETIF_OP_GET) {
+        memcpy(opt_val, &esp_netif->dhcps_offer, opt_len);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t* esp_netif)
+{
+    if ((esp_netif == NULL) || !(esp_netif->config.flags & ESP_NETIF_DHCP_SERVER)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!esp_netif->dhcps_started) {
+        esp_netif->dhcps_started = true;
+        s_netif_stats.dhcps_starts++;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t* esp_netif)
+{
+    if ((esp_netif == NULL) || !(esp_netif->config.flags & ESP_NETIF_DHCP_SERVER)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (esp_netif->dhcps_started) {
+        esp_netif->dhcps_started = false;
+        s_netif_stats.dhcps_stops++;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t* esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns)
+{
+    if ((esp_netif == NULL) || (dns == NULL) || (type >= ESP_NETIF_DNS_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_netif->dns[type] = *dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t* esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns)
+{
+    if ((esp_netif == NULL) || (dns == NULL) || (type >= ESP_NETIF_DNS_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *dns = esp_netif->dns[type];
+    return ESP_OK;
+}
+
+uint32_t esp_ip4addr_aton(const char* addr)
+{
+    return inet_addr(addr);
+}
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void)
+{
+    esp_netif_inherent_config_t base = {
+        .flags = ESP_NETIF_DHCP_CLIENT | ESP_NETIF_FLAG_GARP | ESP_NETIF_FLAG_EVENT_IP_MODIFIED,
+        .get_ip_event = IP_EVENT_STA_GOT_IP,
+        .lost_ip_event = IP_EVENT_STA_LOST_IP,
+        .if_key = "WIFI_STA_DEF",
+        .if_desc = "sta",
+        .route_prio = 100,
+    };
+    esp_netif_config_t config = { .base = &base };
+
+    esp_read_mac(base.mac, ESP_MAC_WIFI_STA);
+    return esp_netif_new(&config);
+}
+
+esp_netif_t* esp_netif_create_default_wifi_ap(void)
+{
+    const esp_netif_ip_info_t ip_info = {
+        .ip = { .addr = ESP_IP4TOADDR(192, 168, 4, 1) },
+        .gw = { .addr = ESP_IP4TOADDR(192, 168, 4, 1) },
+        .netmask = { .addr = ESP_IP4TOADDR(255, 255, 255, 0) },
+    };
+    esp_netif_inherent_config_t base = {
+        .flags = ESP_NETIF_DHCP_SERVER | ESP_NETIF_FLAG_AUTOUP,
+        .ip_info = &ip_info,
+        .if_key = "WIFI_AP_DEF",
+        .if_desc = "ap",
+        .route_prio = 10,
+    };
+    esp_netif_config_t config = { .base = &base };
+
+    esp_read_mac(base.mac, ESP_MAC_WIFI_SOFTAP);
+    return esp_netif_new(&config);
+}
+
+void esp_mock_netif_got_ip(esp_netif_t* netif, const esp_netif_ip_info_t* ip_info)
+{
+    ip_event_got_ip_t event = {
+        .esp_netif = netif,
+        .ip_info = *ip_info,
+        .ip_changed = (netif->ip_info.ip.addr != ip_info->ip.addr),
+    };
+
+    netif->ip_info = *ip_info;
+    s_netif_stats.ip_sets++;
+    esp_event_post(IP_EVENT, netif->config.get_ip_event, &event, sizeof(event), 0);
+}
+
+void esp_mock_netif_lost_ip(esp_netif_t* netif)
+{
+    ip_event_got_ip_t event = {
+        .esp_netif = netif,
+        .ip_info = netif->ip_info,
+    };
+
+    memset(&netif->ip_info, 0, sizeof(netif->ip_info));
+    esp_event_post(IP_EVENT, netif->config.lost_ip_event, &event, sizeof(event), 0);
+}
+
+void esp_mock_netif_get_stats(esp_mock_netif_stats_t* stats)
+{
+    *stats = s_netif_stats;
+}
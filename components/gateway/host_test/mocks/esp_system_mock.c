@@ -0,0 +1,106 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <time.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mock.h"
+#include "lwip/sys.h"
+#include "lwip/lwip_napt.h"
+
+static uint8_t s_base_mac[6] = { 0x7c, 0xdf, 0xa1, 0x00, 0x10, 0x20 };
+static uint32_t s_random_state = 0x2545F491;
+static esp_log_level_t s_log_level = ESP_LOG_WARN;
+static uint32_t s_napt_addr[16];    /* Addresses NAPT was enabled on, the ones a netif moved away from included */
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type)
+{
+    if ((mac == NULL) || (type > ESP_MAC_ETH)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Four universally administered MACs, as with CONFIG_ESP32_UNIVERSAL_MAC_ADDRESSES_FOUR */
+    memcpy(mac, s_base_mac, sizeof(s_base_mac));
+    mac[5] += type;
+    return ESP_OK;
+}
+
+void esp_mock_set_base_mac(const uint8_t mac[6])
+{
+    memcpy(s_base_mac, mac, sizeof(s_base_mac));
+}
+
+uint32_t esp_random(void)
+{
+    /* xorshift32 */
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 17;
+    s_random_state ^= s_random_state << 5;
+    return s_random_state;
+}
+
+void esp_mock_random_seed(uint32_t seed)
+{
+    s_random_state = seed ? seed : 0x2545F491;
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+esp_log_level_t esp_log_level_get(void)
+{
+    return s_log_level;
+}
+
+uint32_t sys_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void ip_napt_enable(uint32_t addr, int enable)
+{
+    uint32_t free_slot = sizeof(s_napt_addr) / sizeof(s_napt_addr[0]);
+
+    for (uint32_t loop = 0; loop < sizeof(s_napt_addr) / sizeof(s_napt_addr[0]); loop++) {
+        if (s_napt_addr[loop] == addr) {
+            if (!enable) {
+                s_napt_addr[loop] = 0;
+            }
+            return;
+        }
+        if (s_napt_addr[loop] == 0) {
+            free_slot = loop;
+        }
+    }
+
+    if (enable && addr && (free_slot < sizeof(s_napt_addr) / sizeof(s_napt_addr[0]))) {
+        s_napt_addr[free_slot] = addr;
+    }
+}
+
+bool esp_mock_napt_is_enabled(uint32_t addr)
+{
+    for (uint32_t loop = 0; loop < sizeof(s_napt_addr) / sizeof(s_napt_addr[0]); loop++) {
+        if (addr && (s_napt_addr[loop] == addr)) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,161 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "esp_mock.h"
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool active;
+    int64_t expiry;
+    uint64_t period;
+    struct esp_timer* next;
+};
+
+static struct esp_timer* s_timers = NULL;
+static int64_t s_advanced_us = 0;
+static bool s_frozen = false;
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    if (s_frozen) {
+        return s_advanced_us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + s_advanced_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+    struct esp_timer* timer = NULL;
+
+    if ((create_args == NULL) || (create_args->callback == NULL) || (out_handle == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    timer->args = *create_args;
+    timer->next = s_timers;
+    s_timers = timer;
+    *out_handle = timer;
+
+    return ESP_OK;
+}
+
+static esp_err_t esp_timer_mock_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = true;
+    timer->expiry = esp_timer_get_time() + timeout_us;
+    timer->period = period;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return esp_timer_mock_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return esp_timer_mock_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if ((timer == NULL) || !timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (struct esp_timer** prev = &s_timers; *prev; prev = &(*prev)->next) {
+        if (*prev == timer) {
+            *prev = timer->next;
+            break;
+        }
+    }
+
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && timer->active;
+}
+
+void esp_mock_timer_freeze(void)
+{
+    s_frozen = true;
+}
+
+void esp_mock_timer_advance(uint64_t us)
+{
+    s_advanced_us += us;
+
+    /* Run the expired timers in the order of their expiry, a callback may start or stop timers */
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        struct esp_timer* first = NULL;
+
+        for (struct esp_timer* timer = s_timers; timer; timer = timer->next) {
+            if (timer->active && (timer->expiry <= now) && ((first == NULL) || (timer->expiry < first->expiry))) {
+                first = timer;
+            }
+        }
+
+        if (first == NULL) {
+            break;
+        }
+
+        if (first->period) {
+            first->expiry += first->period;
+        } else {
+            first->active = false;
+        }
+
+        first->args.callback(first->args.arg);
+    }
+}
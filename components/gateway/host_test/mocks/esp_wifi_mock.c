@@ -0,0 +1,317 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_wifi.h"
+#include "esp_system.h"
+#include "esp_mock.h"
+
+#define WIFI_MOCK_VENDOR_IE_TYPE_NUM    (WIFI_VND_IE_TYPE_ASSOC_RESP + 1)
+#define WIFI_MOCK_VENDOR_IE_ID_NUM      (WIFI_VND_IE_ID_1 + 1)
+#define WIFI_MOCK_VENDOR_IE_MAX_LEN     (2 + 255)
+
+typedef struct {
+    bool enabled;
+    uint8_t data[WIFI_MOCK_VENDOR_IE_MAX_LEN];
+} wifi_mock_vendor_ie_t;
+
+static bool s_initialized = false;
+static wifi_mode_t s_mode = WIFI_MODE_NULL;
+static wifi_config_t s_config[ESP_IF_WIFI_AP + 1];
+static wifi_mock_vendor_ie_t s_vendor_ie[WIFI_MOCK_VENDOR_IE_TYPE_NUM][WIFI_MOCK_VENDOR_IE_ID_NUM];
+static esp_vendor_ie_cb_t s_vendor_ie_cb = NULL;
+static void* s_vendor_ie_ctx = NULL;
+static wifi_ap_record_t* s_scan_records = NULL;
+static uint16_t s_scan_num = 0;
+static bool s_sta_connected = false;
+static wifi_ap_record_t s_sta_ap;
+static esp_mock_wifi_stats_t s_wifi_stats;
+static esp_mock_wifi_hooks_t s_hooks;
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config)
+{
+    s_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    s_initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    if (!s_initialized) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    if (mode >= WIFI_MODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode)
+{
+    if (mode == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *mode = s_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    return s_initialized ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    s_wifi_stats.connects++;
+    if (s_hooks.connect) {
+        s_hooks.connect(s_hooks.arg);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    s_wifi_stats.disconnects++;
+    if (s_hooks.disconnect) {
+        s_hooks.disconnect(s_hooks.arg);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t* config, bool block)
+{
+    s_wifi_stats.scans++;
+    if (s_hooks.scan_start) {
+        s_hooks.scan_start(config, s_hooks.arg);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t* number)
+{
+    if (number == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *number = s_scan_num;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t* number, wifi_ap_record_t* ap_records)
+{
+    if ((number == NULL) || (ap_records == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (*number > s_scan_num) {
+        *number = s_scan_num;
+    }
+    if (*number) {
+        memcpy(ap_records, s_scan_records, *number * sizeof(wifi_ap_record_t));
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info)
+{
+    if (ap_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!s_sta_connected) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+
+    *ap_info = s_sta_ap;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf)
+{
+    if ((interface > WIFI_IF_AP) || (conf == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Only the member of the interface is used, the callers may pass a wifi_sta_config_t */
+    if (interface == WIFI_IF_STA) {
+        s_config[interface].sta = conf->sta;
+    } else {
+        s_config[interface].ap = conf->ap;
+    }
+    s_wifi_stats.config_sets++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* conf)
+{
+    if ((interface > WIFI_IF_AP) || (conf == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (interface == WIFI_IF_STA) {
+        conf->sta = s_config[interface].sta;
+    } else {
+        conf->ap = s_config[interface].ap;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    return esp_read_mac(mac, (ifx == WIFI_IF_STA) ? ESP_MAC_WIFI_STA : ESP_MAC_WIFI_SOFTAP);
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second)
+{
+    if ((primary == NULL) || (second == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *primary = s_sta_connected ? s_sta_ap.primary : (s_config[WIFI_IF_STA].sta.channel ? s_config[WIFI_IF_STA].sta.channel : 1);
+    *second = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_vendor_ie(bool enable, wifi_vendor_ie_type_t type, wifi_vendor_ie_id_t idx, const void* vnd_ie)
+{
+    const vendor_ie_data_t* ie = vnd_ie;
+
+    if ((type >= WIFI_MOCK_VENDOR_IE_TYPE_NUM) || (idx >= WIFI_MOCK_VENDOR_IE_ID_NUM)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (enable) {
+        if ((ie == NULL) || (ie->element_id != WIFI_VENDOR_IE_ELEMENT_ID) || (ie->length < 4)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        /* The driver keeps its own copy, like the real one */
+        memcpy(s_vendor_ie[type][idx].data, ie, 2 + ie->length);
+    }
+
+    s_vendor_ie[type][idx].enabled = enable;
+    s_wifi_stats.vendor_ie_sets++;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_vendor_ie_cb(esp_vendor_ie_cb_t cb, void* ctx)
+{
+    s_vendor_ie_cb = cb;
+    s_vendor_ie_ctx = ctx;
+    return ESP_OK;
+}
+
+void esp_mock_wifi_get_stats(esp_mock_wifi_stats_t* stats)
+{
+    *stats = s_wifi_stats;
+}
+
+void esp_mock_wifi_set_hooks(const esp_mock_wifi_hooks_t* hooks)
+{
+    if (hooks) {
+        s_hooks = *hooks;
+    } else {
+        memset(&s_hooks, 0, sizeof(s_hooks));
+    }
+}
+
+int32_t esp_mock_wifi_probe(uint32_t dest, uint32_t len)
+{
+    return s_hooks.probe ? s_hooks.probe(dest, len, s_hooks.arg) : -1;
+}
+
+const vendor_ie_data_t* esp_mock_wifi_get_vendor_ie(wifi_vendor_ie_type_t type, wifi_vendor_ie_id_t idx)
+{
+    if ((type >= WIFI_MOCK_VENDOR_IE_TYPE_NUM) || (idx >= WIFI_MOCK_VENDOR_IE_ID_NUM) || !s_vendor_ie[type][idx].enabled) {
+        return NULL;
+    }
+
+    return (const vendor_ie_data_t*)s_vendor_ie[type][idx].data;
+}
+
+void esp_mock_wifi_beacon(const uint8_t sa[6], const vendor_ie_data_t* vnd_ie, int rssi)
+{
+    if (s_vendor_ie_cb) {
+        s_vendor_ie_cb(s_vendor_ie_ctx, WIFI_VND_IE_TYPE_BEACON, sa, vnd_ie, rssi);
+    }
+}
+
+void esp_mock_wifi_scan_done(const wifi_ap_record_t* records, uint16_t num)
+{
+    wifi_event_sta_scan_done_t event = { .status = 0, .number = (uint8_t)num };
+
+    free(s_scan_records);
+    s_scan_records = NULL;
+    s_scan_num = 0;
+    if (num) {
+        s_scan_records = malloc(num * sizeof(wifi_ap_record_t));
+        if (s_scan_records) {
+            memcpy(s_scan_records, records, num * sizeof(wifi_ap_record_t));
+            s_scan_num = num;
+        }
+    }
+
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &event, sizeof(event), 0);
+}
+
+void esp_mock_wifi_sta_connected(const wifi_ap_record_t* ap)
+{
+    s_sta_ap = *ap;
+    s_sta_connected = true;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, 0);
+}
+
+void esp_mock_wifi_sta_disconnected(void)
+{
+    wifi_event_sta_disconnected_t event = { 0 };
+
+    if (s_sta_connected) {
+        memcpy(event.ssid, s_sta_ap.ssid, sizeof(event.ssid));
+        event.ssid_len = strnlen((const char*)s_sta_ap.ssid, sizeof(event.ssid));
+        memcpy(event.bssid, s_sta_ap.bssid, sizeof(event.bssid));
+    }
+    event.reason = 8; /* WIFI_REASON_ASSOC_LEAVE */
+    s_sta_connected = false;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), 0);
+}
+
+void esp_mock_wifi_ap_station(const uint8_t mac[6], bool connected)
+{
+    wifi_event_ap_staconnected_t event = { .aid = 1 };
+
+    memcpy(event.mac, mac, sizeof(event.mac));
+    esp_event_post(WIFI_EVENT, connected ? WIFI_EVENT_AP_STACONNECTED : WIFI_EVENT_AP_STADISCONNECTED,
+                   &event, sizeof(event), 0);
+}
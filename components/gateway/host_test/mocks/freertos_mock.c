@@ -0,0 +1,91 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+
+struct event_group {
+    EventBits_t bits;
+};
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, (void* (*)(void*))task_code, parameters) != 0) {
+        return pdFAIL;
+    }
+
+    pthread_detach(thread);
+    if (created_task) {
+        *created_task = (TaskHandle_t)thread;
+    }
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if ((task == NULL) || pthread_equal((pthread_t)task, pthread_self())) {
+        pthread_exit(NULL);
+    }
+
+    pthread_cancel((pthread_t)task);
+}
+
+void vTaskDelay(const TickType_t ticks_to_delay)
+{
+    usleep(ticks_to_delay * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / (portTICK_PERIOD_MS * 1000));
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct event_group));
+}
+
+void vEventGroupDelete(EventGroupHandle_t event_group)
+{
+    free(event_group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, const EventBits_t bits_to_set)
+{
+    event_group->bits |= bits_to_set;
+    return event_group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, const EventBits_t bits_to_clear)
+{
+    EventBits_t bits = event_group->bits;
+
+    event_group->bits &= ~bits_to_clear;
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group)
+{
+    return event_group->bits;
+}
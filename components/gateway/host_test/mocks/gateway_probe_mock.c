@@ -0,0 +1,33 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#include "esp_mock.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_litemesh.h"
+
+#if CONFIG_LITEMESH_PATH_METRICS
+/* The probe hook of the esp_wifi mock plays the link, the answer is reported before the send returns */
+esp_err_t esp_litemesh_probe_send(uint32_t dest, uint32_t len, uint16_t seq)
+{
+    int32_t rtt_us = esp_mock_wifi_probe(dest, len);
+
+    if (rtt_us >= 0) {
+        esp_litemesh_path_probe_done(seq, (uint32_t)rtt_us);
+    }
+
+    return ESP_OK;
+}
+#endif
@@ -0,0 +1,200 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Control of the host mocks, for the tests and the benchmarks. The mocked drivers never act on their own:
+ * the events of the network (IP got, scan done, beacon heard...) are injected by the functions below
+ * and the handlers run before they return.
+ */
+
+/**
+ * @brief Counters of the esp_netif mock
+ *
+ */
+typedef struct {
+    uint32_t netifs;            /*!< Netifs alive */
+    uint32_t ip_sets;           /*!< Calls to esp_netif_set_ip_info() */
+    uint32_t dhcps_starts;      /*!< DHCP servers started */
+    uint32_t dhcps_stops;       /*!< DHCP servers stopped */
+} esp_mock_netif_stats_t;
+
+/**
+ * @brief Counters of the esp_wifi mock
+ *
+ */
+typedef struct {
+    uint32_t vendor_ie_sets;    /*!< Calls to esp_wifi_set_vendor_ie(), enable or disable */
+    uint32_t scans;             /*!< Scans started */
+    uint32_t connects;          /*!< Calls to esp_wifi_connect() */
+    uint32_t disconnects;       /*!< Calls to esp_wifi_disconnect() */
+    uint32_t config_sets;       /*!< Calls to esp_wifi_set_config() */
+} esp_mock_wifi_stats_t;
+
+/**
+ * @brief Counters of the nvs mock
+ *
+ */
+typedef struct {
+    uint32_t writes;            /*!< Values set */
+    uint32_t commits;           /*!< Calls to nvs_commit() */
+} esp_mock_nvs_stats_t;
+
+/**
+ * @brief Calls into the esp_wifi mock that a radio would act on, e.g. for a simulated network.
+ *        They run inside the driver calls, they must not call back into the gateway.
+ *
+ */
+typedef struct {
+    void (*scan_start)(const wifi_scan_config_t* config, void* arg);   /*!< esp_wifi_scan_start(), config may be NULL */
+    void (*connect)(void* arg);                                         /*!< esp_wifi_connect() */
+    void (*disconnect)(void* arg);                                      /*!< esp_wifi_disconnect() */
+    int32_t (*probe)(uint32_t dest, uint32_t len, void* arg);           /*!< An echo request of len bytes to dest, returns the
+                                                                             RTT in microseconds, -1 when it is lost */
+    void* arg;
+} esp_mock_wifi_hooks_t;
+
+/**
+ * @brief  Set the IP of a netif and post its got IP event, like a DHCP client or PPP would.
+ *
+ * @param[in]  netif netif created with get_ip_event set, such as the default Wi-Fi station
+ * @param[in]  ip_info new IP information
+ */
+void esp_mock_netif_got_ip(esp_netif_t* netif, const esp_netif_ip_info_t* ip_info);
+
+/**
+ * @brief  Clear the IP of a netif and post its lost IP event.
+ *
+ * @param[in]  netif netif created with lost_ip_event set
+ */
+void esp_mock_netif_lost_ip(esp_netif_t* netif);
+
+void esp_mock_netif_get_stats(esp_mock_netif_stats_t* stats);
+
+void esp_mock_wifi_get_stats(esp_mock_wifi_stats_t* stats);
+
+/**
+ * @brief  Set the hooks of the esp_wifi mock.
+ *
+ * @param[in]  hooks hooks, copied, NULL to remove them
+ */
+void esp_mock_wifi_set_hooks(const esp_mock_wifi_hooks_t* hooks);
+
+/**
+ * @brief  Send an echo request over the radio, for the lwIP glue mocks.
+ *
+ * @param[in]  dest destination, network byte order
+ * @param[in]  len length of the echo data
+ *
+ * @return RTT in microseconds, -1 when the request or the reply is lost, always without probe hook
+ */
+int32_t esp_mock_wifi_probe(uint32_t dest, uint32_t len);
+
+/**
+ * @brief  Get the vendor IE the driver currently sends.
+ *
+ * @return
+ *     - IE: the IE set last with esp_wifi_set_vendor_ie()
+ *     - NULL: the IE is disabled
+ */
+const vendor_ie_data_t* esp_mock_wifi_get_vendor_ie(wifi_vendor_ie_type_t type, wifi_vendor_ie_id_t idx);
+
+/**
+ * @brief  Hand a vendor IE heard in a beacon to the callback set by esp_wifi_set_vendor_ie_cb().
+ *
+ * @param[in]  sa source address of the beacon
+ * @param[in]  vnd_ie vendor IE
+ * @param[in]  rssi signal strength of the beacon
+ */
+void esp_mock_wifi_beacon(const uint8_t sa[6], const vendor_ie_data_t* vnd_ie, int rssi);
+
+/**
+ * @brief  Complete the scan in progress with these APs and post WIFI_EVENT_SCAN_DONE.
+ *
+ * @param[in]  records APs found, copied
+ * @param[in]  num number of APs
+ */
+void esp_mock_wifi_scan_done(const wifi_ap_record_t* records, uint16_t num);
+
+/**
+ * @brief  Associate the station with an AP, esp_wifi_sta_get_ap_info() reports it from then on.
+ *         WIFI_EVENT_STA_CONNECTED is posted.
+ *
+ * @param[in]  ap the AP
+ */
+void esp_mock_wifi_sta_connected(const wifi_ap_record_t* ap);
+
+/**
+ * @brief  Disassociate the station and post WIFI_EVENT_STA_DISCONNECTED.
+ */
+void esp_mock_wifi_sta_disconnected(void);
+
+/**
+ * @brief  Post WIFI_EVENT_AP_STACONNECTED or WIFI_EVENT_AP_STADISCONNECTED for a station of the SoftAP.
+ *
+ * @param[in]  mac station MAC
+ * @param[in]  connected connected or disconnected
+ */
+void esp_mock_wifi_ap_station(const uint8_t mac[6], bool connected);
+
+/**
+ * @brief  Move the clock of esp_timer forward and run the callbacks of the timers expired meanwhile.
+ *
+ * @param[in]  us time to advance, in microseconds
+ */
+void esp_mock_timer_advance(uint64_t us);
+
+/**
+ * @brief  Stop following the monotonic clock: from then on esp_timer_get_time() starts from 0 and only moves
+ *         in esp_mock_timer_advance(), so that a run only depends on its inputs.
+ */
+void esp_mock_timer_freeze(void);
+
+/**
+ * @brief  Set the base MAC the factory MACs are derived from, the station one is the base MAC.
+ */
+void esp_mock_set_base_mac(const uint8_t mac[6]);
+
+/**
+ * @brief  Restart the sequence of esp_random().
+ */
+void esp_mock_random_seed(uint32_t seed);
+
+/**
+ * @brief  Whether ip_napt_enable() enabled NAPT on the netif of addr, and did not disable it since.
+ */
+bool esp_mock_napt_is_enabled(uint32_t addr);
+
+/**
+ * @brief  Erase the whole nvs mock, like a device with a blank NVS partition.
+ */
+void esp_mock_nvs_erase_all(void);
+
+void esp_mock_nvs_get_stats(esp_mock_nvs_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif_types.h"
+#include "esp_netif_ip_addr.h"
+#include "esp_wifi_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The host netifs only keep their configuration, nothing is sent or received.
+ * A data-forwarding netif is a netif created with ESP_NETIF_DHCP_SERVER in its flags.
+ */
+
+esp_err_t esp_netif_init(void);
+
+esp_netif_t* esp_netif_new(const esp_netif_config_t* esp_netif_config);
+
+void esp_netif_destroy(esp_netif_t* esp_netif);
+
+void esp_netif_action_start(void* esp_netif, esp_event_base_t base, int32_t event_id, void* data);
+
+void esp_netif_action_stop(void* esp_netif, esp_event_base_t base, int32_t event_id, void* data);
+
+esp_err_t esp_netif_set_mac(esp_netif_t* esp_netif, uint8_t mac[]);
+
+esp_err_t esp_netif_get_mac(esp_netif_t* esp_netif, uint8_t mac[]);
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info);
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t* esp_netif, const esp_netif_ip_info_t* ip_info);
+
+bool esp_netif_is_netif_up(esp_netif_t* esp_netif);
+
+esp_netif_flags_t esp_netif_get_flags(esp_netif_t* esp_netif);
+
+const char* esp_netif_get_ifkey(esp_netif_t* esp_netif);
+
+const char* esp_netif_get_desc(esp_netif_t* esp_netif);
+
+esp_err_t esp_netif_dhcps_option(esp_netif_t* esp_netif, esp_netif_dhcp_option_mode_t opt_op,
+                                 esp_netif_dhcp_option_id_t opt_id, void* opt_val, uint32_t opt_len);
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t* esp_netif);
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t* esp_netif);
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t* esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns);
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t* esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns);
+
+uint32_t esp_ip4addr_aton(const char* addr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,87 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int magic;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { .magic = 0x1F2F3F4F }
+
+typedef void (*esp_vendor_ie_cb_t)(void* ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6],
+                                   const vendor_ie_data_t* vnd_ie, int rssi);
+
+/*
+ * The host Wi-Fi driver keeps the configuration and the vendor IEs set by the gateway.
+ * Scans and connections complete only when the test posts the matching events, see esp_mock.h.
+ */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config);
+
+esp_err_t esp_wifi_deinit(void);
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode);
+
+esp_err_t esp_wifi_start(void);
+
+esp_err_t esp_wifi_stop(void);
+
+esp_err_t esp_wifi_connect(void);
+
+esp_err_t esp_wifi_disconnect(void);
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t* config, bool block);
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t* number);
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t* number, wifi_ap_record_t* ap_records);
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info);
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf);
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* conf);
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second);
+
+esp_err_t esp_wifi_set_vendor_ie(bool enable, wifi_vendor_ie_type_t type, wifi_vendor_ie_id_t idx, const void* vnd_ie);
+
+esp_err_t esp_wifi_set_vendor_ie_cb(esp_vendor_ie_cb_t cb, void* ctx);
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void);
+
+esp_netif_t* esp_netif_create_default_wifi_ap(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,189 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+
+#include "nvs.h"
+#include "esp_mock.h"
+
+/* A RAM store of u8 entries, it lasts as long as the process like the flash of a device lasts across reboots */
+#define NVS_MOCK_MAX_ENTRIES    (32)
+#define NVS_MOCK_MAX_HANDLES    (8)
+#define NVS_MOCK_NAME_LEN       (16)    /* Namespaces and keys, with the terminator */
+
+typedef struct {
+    bool used;
+    char name[NVS_MOCK_NAME_LEN];
+    char key[NVS_MOCK_NAME_LEN];
+    uint8_t value;
+} nvs_mock_entry_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    char name[NVS_MOCK_NAME_LEN];
+} nvs_mock_handle_t;
+
+static nvs_mock_entry_t s_entries[NVS_MOCK_MAX_ENTRIES];
+static nvs_mock_handle_t s_handles[NVS_MOCK_MAX_HANDLES];
+static esp_mock_nvs_stats_t s_nvs_stats;
+
+static nvs_mock_handle_t* nvs_mock_handle_get(nvs_handle_t handle)
+{
+    if ((handle == 0) || (handle > NVS_MOCK_MAX_HANDLES) || !s_handles[handle - 1].used) {
+        return NULL;
+    }
+
+    return &s_handles[handle - 1];
+}
+
+static nvs_mock_entry_t* nvs_mock_entry_find(const char* name, const char* key)
+{
+    for (uint32_t loop = 0; loop < NVS_MOCK_MAX_ENTRIES; loop++) {
+        if (s_entries[loop].used && !strcmp(s_entries[loop].name, name) && !strcmp(s_entries[loop].key, key)) {
+            return &s_entries[loop];
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+    if ((name == NULL) || (out_handle == NULL) || (strlen(name) >= NVS_MOCK_NAME_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint32_t loop = 0; loop < NVS_MOCK_MAX_HANDLES; loop++) {
+        if (!s_handles[loop].used) {
+            s_handles[loop].used = true;
+            s_handles[loop].writable = (open_mode == NVS_READWRITE);
+            strcpy(s_handles[loop].name, name);
+            *out_handle = loop + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value)
+{
+    nvs_mock_handle_t* open = nvs_mock_handle_get(handle);
+    nvs_mock_entry_t* entry = NULL;
+
+    if (open == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    if ((key == NULL) || (out_value == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    entry = nvs_mock_entry_find(open->name, key);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *out_value = entry->value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value)
+{
+    nvs_mock_handle_t* open = nvs_mock_handle_get(handle);
+    nvs_mock_entry_t* entry = NULL;
+
+    if (open == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+
+    if ((key == NULL) || (strlen(key) >= NVS_MOCK_NAME_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    entry = nvs_mock_entry_find(open->name, key);
+    for (uint32_t loop = 0; (loop < NVS_MOCK_MAX_ENTRIES) && (entry == NULL); loop++) {
+        if (!s_entries[loop].used) {
+            entry = &s_entries[loop];
+            entry->used = true;
+            strcpy(entry->name, open->name);
+            strcpy(entry->key, key);
+        }
+    }
+
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    entry->value = value;
+    s_nvs_stats.writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    nvs_mock_handle_t* open = nvs_mock_handle_get(handle);
+    nvs_mock_entry_t* entry = NULL;
+
+    if (open == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+
+    entry = key ? nvs_mock_entry_find(open->name, key) : NULL;
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    entry->used = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (nvs_mock_handle_get(handle) == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    s_nvs_stats.commits++;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    nvs_mock_handle_t* open = nvs_mock_handle_get(handle);
+
+    if (open) {
+        open->used = false;
+    }
+}
+
+void esp_mock_nvs_erase_all(void)
+{
+    memset(s_entries, 0, sizeof(s_entries));
+}
+
+void esp_mock_nvs_get_stats(esp_mock_nvs_stats_t* stats)
+{
+    *stats = s_nvs_stats;
+}
@@ -0,0 +1,92 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+/*
+ * Configuration of the Linux host build: a station uplink and a SoftAP with LiteMesh, like the default
+ * project, plus a registry large enough for the benchmarks. Each option can be overridden with -D.
+ */
+
+#define CONFIG_GATEWAY_EXTERNAL_NETIF_STATION 1
+#define CONFIG_GATEWAY_DATA_FORWARDING_NETIF_SOFTAP 1
+#define CONFIG_ESP_GATEWAY_SOFTAP_SSID "ESP_Gateway"
+#define CONFIG_ESP_GATEWAY_SOFTAP_PASSWORD "12345678"
+
+#define CONFIG_LITEMESH_ENABLE 1
+#define CONFIG_VENDOR_OUI_0 71
+#define CONFIG_VENDOR_OUI_1 87
+#define CONFIG_VENDOR_OUI_2 77
+#define CONFIG_LITEMESH_MAX_CONNECT_NUMBER 8
+#define CONFIG_LITEMESH_MAX_ROUTER_NUMBER 3
+#define CONFIG_LITEMESH_MAX_INHERITED_NETIF_NUMBER 10
+#define CONFIG_JOIN_MESH_WITHOUT_CONFIGURED_WIFI_INFO 1
+#ifndef CONFIG_LITEMESH_SCAN_CHANNEL_PIN
+#define CONFIG_LITEMESH_SCAN_CHANNEL_PIN 1
+#endif
+#define CONFIG_LITEMESH_SCAN_PASSIVE 1
+#define CONFIG_LITEMESH_SCAN_CHANNEL_DWELL_MS 300
+#define CONFIG_LITEMESH_IE_COMPACT 1
+#define CONFIG_LITEMESH_IE_V1_HOLD_MS 600000
+
+#ifndef CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS
+#define CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS 50
+#endif
+#define CONFIG_LITEMESH_PARENT_LEVEL_WEIGHT 3
+#define CONFIG_LITEMESH_PARENT_RSSI_WEIGHT 4
+#define CONFIG_LITEMESH_PARENT_LOAD_WEIGHT 2
+#define CONFIG_LITEMESH_PARENT_UPLINK_WEIGHT 1
+#define CONFIG_LITEMESH_PARENT_ROOT_LOAD_WEIGHT 2
+#define CONFIG_LITEMESH_PARENT_PATH_WEIGHT 2
+#define CONFIG_LITEMESH_PARENT_SWITCH_HYSTERESIS 100
+#ifndef CONFIG_LITEMESH_PARENT_MIN_DWELL_MS
+#define CONFIG_LITEMESH_PARENT_MIN_DWELL_MS 30000
+#endif
+#ifndef CONFIG_LITEMESH_PARENT_FAILOVER
+#define CONFIG_LITEMESH_PARENT_FAILOVER 1
+#endif
+#define CONFIG_LITEMESH_PARENT_FAILOVER_MAX_AGE_MS 3000
+#ifndef CONFIG_LITEMESH_ROUTED
+#define CONFIG_LITEMESH_ROUTED 1
+#endif
+#define CONFIG_LITEMESH_ROUTE_MAX_AGE_MS 5000
+#ifndef CONFIG_LITEMESH_MULTI_ROOT
+#define CONFIG_LITEMESH_MULTI_ROOT 1
+#endif
+#define CONFIG_LITEMESH_ROOT_CAPACITY 16
+#define CONFIG_LITEMESH_ROOT_SPLIT_LOAD 75
+#define CONFIG_LITEMESH_ROOT_MIN_RSSI -80
+#define CONFIG_LITEMESH_BCAST_FILTER 1
+#define CONFIG_LITEMESH_PROXY_ARP_SIZE 32
+#define CONFIG_LITEMESH_BCAST_DUP_WINDOW_MS 1000
+#define CONFIG_LITEMESH_BCAST_RATE_LIMIT 50
+#ifndef CONFIG_LITEMESH_PATH_METRICS
+#define CONFIG_LITEMESH_PATH_METRICS 1
+#endif
+#define CONFIG_LITEMESH_PATH_PROBE_INTERVAL_MS 1000
+
+#ifndef CONFIG_GATEWAY_NETIF_REGISTRY_SIZE
+#define CONFIG_GATEWAY_NETIF_REGISTRY_SIZE 64
+#endif
+
+#define CONFIG_GATEWAY_SUBNET_POOL_BASE "192.168.0.0"
+#define CONFIG_GATEWAY_SUBNET_POOL_PREFIX_LEN 16
+#define CONFIG_GATEWAY_SUBNET_PREFIX_LEN 24
+#define CONFIG_GATEWAY_SUBNET_POOL_FIRST_INDEX 4
+
+#ifndef CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS
+#define CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS 200
+#endif
+
+#define CONFIG_GATEWAY_DNS_FALLBACK_SERVER "114.114.114.114"
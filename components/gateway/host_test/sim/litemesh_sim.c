@@ -0,0 +1,1205 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "litemesh_sim_node.h"
+
+/*
+ * Discrete-event simulation of a LiteMesh network. Every node runs the LiteMesh code of the gateway
+ * component unchanged, with the mocks of the host build in place of the Wi-Fi driver: the simulator
+ * hands each node the beacons, scan results, associations and DHCP leases of a radio model, in the
+ * order of a single virtual clock, so a run only depends on its options.
+ *
+ * Radio model:
+ *   - the nodes sit on a grid, the router at its corner, on a single channel
+ *   - log-distance path loss, RSSI = -40 - 30 * log10(distance), with a few dB of noise per frame,
+ *     nothing is heard below SIM_RSSI_FLOOR
+ *   - every node beacons its vendor IE every SIM_BEACON_INTERVAL_MS
+ *   - a scan reports the router when it is in range and the scan covers SIM_CHANNEL, it lasts the time of
+ *     the scan configuration per channel, SIM_FULL_SCAN_MS for the driver default; a node scanning another
+ *     channel alone hears no beacon
+ *   - an association takes SIM_ASSOC_MS and the DHCP lease SIM_DHCP_MS more, it fails after SIM_ASSOC_FAIL_MS
+ *     when the AP is out of range or full
+ *   - the stations of a node which fails notice it after SIM_BEACON_TIMEOUT_MS
+ *   - an echo probe to the parent or the router crosses the link twice at the rate of its RSSI, see
+ *     sim_link_kbps(), with SIM_PROBE_OVERHEAD_US per crossing, up to SIM_PROBE_JITTER_US of queueing, and
+ *     SIM_PROBE_LOSS_PERCENT of the probes lost
+ *
+ * A node is joined when its chain of parents reaches the router. The report gives, per node, the time to
+ * join after boot, the time to heal for the nodes the failure cut off, i.e. until they are back in the mesh,
+ * and the IE rebuilds of the node.
+ *
+ * With nodes built in routed mode, the report also follows the routes from each root down to the SoftAP
+ * subnet of every node of the mesh, and checks that the subnets are all different and that only the roots
+ * translate.
+ *
+ * The report gives the nodes each root serves, itself included, and the roots whose SoftAP subnets collide.
+ * With nodes built in multi-root mode, it also checks that the roots count their trees right and that the
+ * subnets of the roots are all different.
+ *
+ * With nodes built with the path metrics, the report gives the path each level measures to the router, and
+ * checks that every node whose chain of parents has been up for SIM_PATH_SETTLE_MS knows its path.
+ */
+
+#define SIM_ROUTER_SSID             "Espressif_Router_2G"
+#define SIM_CHANNEL                 (6)
+#define SIM_BEACON_INTERVAL_MS      (100)
+#define SIM_SCAN_CHANNELS           (13)
+#define SIM_SCAN_DWELL_MS           (120)       /* Per channel, driver default */
+#define SIM_FULL_SCAN_MS            (SIM_SCAN_CHANNELS * SIM_SCAN_DWELL_MS)
+#define SIM_ASSOC_MS                (100)
+#define SIM_ASSOC_FAIL_MS           (1000)
+#define SIM_DHCP_MS                 (300)
+#define SIM_DISCONNECT_MS           (10)
+#define SIM_BEACON_TIMEOUT_MS       (3000)
+#define SIM_BOOT_SPREAD_MS          (1000)
+#define SIM_RSSI_FLOOR              (-90)
+#define SIM_RSSI_NOISE_DB           (3)
+#define SIM_MAX_STATIONS            CONFIG_LITEMESH_MAX_CONNECT_NUMBER
+#define SIM_MAX_NODES               (250)
+#define SIM_PROBE_OVERHEAD_US       (300)       /* Channel access, ACK and the stacks, per crossing */
+#define SIM_PROBE_JITTER_US         (2000)
+#define SIM_PROBE_LOSS_PERCENT      (2)
+#define SIM_PATH_SETTLE_MS          (15000)
+
+#define SIM_PARENT_NONE             (-1)
+#define SIM_PARENT_ROUTER           (-2)
+
+#define SIM_MS(ms)                  ((int64_t)(ms) * 1000)
+
+typedef enum {
+    SIM_EVENT_BOOT,
+    SIM_EVENT_BEACON,
+    SIM_EVENT_SCAN_DONE,
+    SIM_EVENT_ASSOC,
+    SIM_EVENT_GOT_IP,
+    SIM_EVENT_DISCONNECT,
+    SIM_EVENT_FAIL,
+} sim_event_type_t;
+
+typedef enum {
+    SIM_FAIL_NONE,
+    SIM_FAIL_ROOT,
+    SIM_FAIL_MID,
+} sim_fail_t;
+
+typedef struct {
+    int64_t time;               /* us */
+    uint64_t seq;               /* Events of the same time run in the order they were scheduled */
+    sim_event_type_t type;
+    uint32_t node;
+    uint32_t gen;               /* Link or scan generation the event belongs to */
+} sim_event_t;
+
+typedef struct {
+    const litemesh_sim_node_api_t* api;
+    double x;
+    double y;
+    int64_t boot;
+    uint8_t sta_mac[6];
+    uint8_t softap_mac[6];
+    bool booted;
+    bool alive;
+
+    /* Station side, as the radio sees it */
+    int32_t parent;
+    bool connecting;
+    bool associated;
+    bool has_ip;
+    uint32_t sta_ip;
+    int64_t ip_time;
+    uint32_t link_gen;
+    uint32_t scan_gen;
+    uint8_t scan_channel;       /* Of a single channel scan in progress, 0 otherwise */
+    uint32_t stations;
+
+    /* Results */
+    bool in_mesh;
+    bool joined;
+    bool lost;
+    int64_t join_time;
+    int64_t heal_time;
+    uint32_t associations;
+    uint32_t switches;
+} sim_node_t;
+
+typedef struct {
+    uint32_t nodes;
+    uint32_t seed;
+    uint32_t duration_s;
+    double spacing;
+    sim_fail_t fail;
+    uint32_t fail_at_s;
+    uint32_t max_join_ms;
+    uint32_t max_heal_ms;
+    uint32_t stored_channel;
+    uint32_t max_root_nodes;
+    bool verbose;
+    const char* node_lib;
+} sim_config_t;
+
+static sim_config_t s_config;
+static sim_node_t* s_nodes = NULL;
+static sim_event_t* s_events = NULL;
+static uint32_t s_event_num = 0;
+static uint32_t s_event_max = 0;
+static uint64_t s_event_seq = 0;
+static int64_t s_now = 0;
+static int64_t s_fail_time = -1;
+static int32_t s_failed_node = -1;
+static uint32_t s_random_state = 1;
+static const uint8_t s_router_bssid[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+
+static uint32_t sim_random(void)
+{
+    /* xorshift32, as esp_random() of the mocks */
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 17;
+    s_random_state ^= s_random_state << 5;
+    return s_random_state;
+}
+
+static bool sim_event_before(const sim_event_t* a, const sim_event_t* b)
+{
+    return (a->time < b->time) || ((a->time == b->time) && (a->seq < b->seq));
+}
+
+static void sim_schedule(int64_t time, sim_event_type_t type, uint32_t node, uint32_t gen)
+{
+    sim_event_t event = { .time = time, .seq = s_event_seq++, .type = type, .node = node, .gen = gen };
+    uint32_t child = s_event_num;
+
+    if (s_event_num == s_event_max) {
+        s_event_max = s_event_max ? s_event_max * 2 : 256;
+        s_events = realloc(s_events, s_event_max * sizeof(sim_event_t));
+        if (s_events == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Binary heap ordered by time, then by seq */
+    while (child > 0) {
+        uint32_t parent = (child - 1) / 2;
+
+        if (sim_event_before(&s_events[parent], &event)) {
+            break;
+        }
+        s_events[child] = s_events[parent];
+        child = parent;
+    }
+    s_events[child] = event;
+    s_event_num++;
+}
+
+static sim_event_t sim_next_event(void)
+{
+    sim_event_t first = s_events[0];
+    sim_event_t last = s_events[--s_event_num];
+    uint32_t parent = 0;
+
+    for (;;) {
+        uint32_t child = parent * 2 + 1;
+
+        if (child >= s_event_num) {
+            break;
+        }
+        if ((child + 1 < s_event_num) && sim_event_before(&s_events[child + 1], &s_events[child])) {
+            child++;
+        }
+        if (!sim_event_before(&s_events[child], &last)) {
+            break;
+        }
+        s_events[parent] = s_events[child];
+        parent = child;
+    }
+    s_events[parent] = last;
+
+    return first;
+}
+
+/* Node i at x = column, y = row of a square grid, the router at the corner before the first node */
+static void sim_place(sim_node_t* node, uint32_t index)
+{
+    uint32_t columns = (uint32_t)ceil(sqrt(s_config.nodes));
+
+    node->x = s_config.spacing * (index % columns + 1);
+    node->y = s_config.spacing * (index / columns + 1);
+}
+
+static int sim_rssi(double x0, double y0, double x1, double y1)
+{
+    double distance = hypot(x1 - x0, y1 - y0);
+    int noise = (int)(sim_random() % (2 * SIM_RSSI_NOISE_DB + 1)) - SIM_RSSI_NOISE_DB;
+
+    if (distance < 1.0) {
+        distance = 1.0;
+    }
+
+    return (int)lround(-40.0 - 30.0 * log10(distance)) + noise;
+}
+
+static int sim_router_rssi(const sim_node_t* node)
+{
+    return sim_rssi(0, 0, node->x, node->y);
+}
+
+/* Bring the clock of the node to the simulation time before calling into it */
+static const litemesh_sim_node_api_t* sim_node_enter(sim_node_t* node)
+{
+    node->api->advance_to(s_now - node->boot);
+    return node->api;
+}
+
+static uint32_t sim_node_index(const sim_node_t* node)
+{
+    return (uint32_t)(node - s_nodes);
+}
+
+static int32_t sim_node_find_softap(const uint8_t mac[6])
+{
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        if (s_nodes[loop].booted && !memcmp(s_nodes[loop].softap_mac, mac, 6)) {
+            return loop;
+        }
+    }
+
+    return SIM_PARENT_NONE;
+}
+
+/* Hooks of the Wi-Fi driver of a node, they run inside the node and only schedule events */
+static void sim_hook_scan_start(const wifi_scan_config_t* config, void* arg)
+{
+    sim_node_t* node = arg;
+    uint32_t dwell_ms = SIM_SCAN_DWELL_MS;
+    uint32_t duration_ms = SIM_FULL_SCAN_MS;
+
+    if (config) {
+        dwell_ms = (config->scan_type == WIFI_SCAN_TYPE_PASSIVE) ? config->scan_time.passive : config->scan_time.active.max;
+        dwell_ms = dwell_ms ? dwell_ms : SIM_SCAN_DWELL_MS;
+        duration_ms = config->channel ? dwell_ms : SIM_SCAN_CHANNELS * dwell_ms;
+    }
+    node->scan_channel = config ? config->channel : 0;
+
+    sim_schedule(s_now + SIM_MS(duration_ms), SIM_EVENT_SCAN_DONE, sim_node_index(node), ++node->scan_gen);
+}
+
+static void sim_hook_connect(void* arg)
+{
+    sim_node_t* node = arg;
+
+    if (node->associated || node->connecting) {
+        return;
+    }
+
+    node->connecting = true;
+    sim_schedule(s_now + SIM_MS(SIM_ASSOC_MS), SIM_EVENT_ASSOC, sim_node_index(node), ++node->link_gen);
+}
+
+static void sim_hook_disconnect(void* arg)
+{
+    sim_node_t* node = arg;
+
+    /* The driver only reports a disconnection when there was a link or an attempt */
+    if (!node->associated && !node->connecting) {
+        return;
+    }
+
+    if (node->associated) {
+        node->switches++;
+    }
+    node->connecting = false;
+    sim_schedule(s_now + SIM_MS(SIM_DISCONNECT_MS), SIM_EVENT_DISCONNECT, sim_node_index(node), ++node->link_gen);
+}
+
+/* IP throughput of 802.11n at 20 MHz, by the sensitivity of each MCS, about half of the PHY rate */
+static uint32_t sim_link_kbps(int rssi)
+{
+    static const struct {
+        int rssi;
+        uint32_t kbps;
+    } rates[] = {
+        { -64, 32500 }, { -66, 26000 }, { -70, 19500 }, { -74, 13000 }, { -77, 9750 }, { -79, 6500 }, { -82, 3250 },
+    };
+
+    for (uint32_t loop = 0; loop < sizeof(rates) / sizeof(rates[0]); loop++) {
+        if (rssi >= rates[loop].rssi) {
+            return rates[loop].kbps;
+        }
+    }
+
+    /* DSSS at 1 Mbps */
+    return 500;
+}
+
+static int32_t sim_hook_probe(uint32_t dest, uint32_t len, void* arg)
+{
+    sim_node_t* node = arg;
+    int rssi = 0;
+    uint32_t kbps = 0;
+
+    (void)dest;
+    if (!node->has_ip) {
+        return -1;
+    }
+
+    if (node->parent == SIM_PARENT_ROUTER) {
+        rssi = sim_router_rssi(node);
+    } else if ((node->parent >= 0) && s_nodes[node->parent].alive) {
+        rssi = sim_rssi(node->x, node->y, s_nodes[node->parent].x, s_nodes[node->parent].y);
+    } else {
+        return -1;
+    }
+
+    if ((rssi < SIM_RSSI_FLOOR) || (sim_random() % 100 < SIM_PROBE_LOSS_PERCENT)) {
+        return -1;
+    }
+
+    /* The request and the reply, with their IP and ICMP headers */
+    kbps = sim_link_kbps(rssi);
+    return (int32_t)(2 * (SIM_PROBE_OVERHEAD_US + (len + 28) * 8 * 1000 / kbps) + sim_random() % SIM_PROBE_JITTER_US);
+}
+
+static void sim_node_boot(sim_node_t* node)
+{
+    uint32_t index = sim_node_index(node);
+    uint8_t base_mac[6] = { 0x24, 0x0a, 0xc4, 0x00, (uint8_t)(index >> 6), (uint8_t)(index << 2) };
+    esp_mock_wifi_hooks_t hooks = {
+        .scan_start = sim_hook_scan_start,
+        .connect = sim_hook_connect,
+        .disconnect = sim_hook_disconnect,
+        .probe = sim_hook_probe,
+        .arg = node,
+    };
+
+    node->booted = true;
+    node->alive = true;
+    if (s_config.stored_channel) {
+        node->api->store_channel(s_config.stored_channel);
+    }
+    if (node->api->start(base_mac, SIM_ROUTER_SSID, s_config.seed * 7919 + index + 1, s_config.verbose, &hooks) != ESP_OK) {
+        fprintf(stderr, "Node %u failed to start\n", index);
+        exit(EXIT_FAILURE);
+    }
+    node->api->get_mac(WIFI_IF_STA, node->sta_mac);
+    node->api->get_mac(WIFI_IF_AP, node->softap_mac);
+
+    sim_schedule(s_now + SIM_MS(sim_random() % SIM_BEACON_INTERVAL_MS), SIM_EVENT_BEACON, index, 0);
+}
+
+static void sim_node_beacon(sim_node_t* node)
+{
+    const vendor_ie_data_t* ie = sim_node_enter(node)->get_ie();
+
+    sim_schedule(s_now + SIM_MS(SIM_BEACON_INTERVAL_MS), SIM_EVENT_BEACON, sim_node_index(node), 0);
+    if (ie == NULL) {
+        return;
+    }
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* receiver = &s_nodes[loop];
+        int rssi = 0;
+
+        if ((receiver == node) || !receiver->alive || (receiver->scan_channel && (receiver->scan_channel != SIM_CHANNEL))) {
+            continue;
+        }
+
+        rssi = sim_rssi(node->x, node->y, receiver->x, receiver->y);
+        if (rssi >= SIM_RSSI_FLOOR) {
+            sim_node_enter(receiver)->beacon(node->softap_mac, ie, rssi);
+        }
+    }
+}
+
+static void sim_node_scan_done(sim_node_t* node)
+{
+    wifi_ap_record_t router;
+    int rssi = sim_router_rssi(node);
+    bool covered = (node->scan_channel == 0) || (node->scan_channel == SIM_CHANNEL);
+
+    node->scan_channel = 0;
+
+    memset(&router, 0, sizeof(router));
+    memcpy(router.bssid, s_router_bssid, sizeof(router.bssid));
+    snprintf((char*)router.ssid, sizeof(router.ssid), "%s", SIM_ROUTER_SSID);
+    router.primary = SIM_CHANNEL;
+    router.rssi = rssi;
+
+    sim_node_enter(node)->scan_done(&router, (covered && (rssi >= SIM_RSSI_FLOOR)) ? 1 : 0);
+}
+
+static void sim_node_assoc(sim_node_t* node)
+{
+    wifi_sta_config_t config;
+    wifi_ap_record_t ap;
+    int32_t target = SIM_PARENT_NONE;
+    int rssi = SIM_RSSI_FLOOR - 1;
+
+    node->connecting = false;
+    sim_node_enter(node)->get_sta_config(&config);
+    memset(&ap, 0, sizeof(ap));
+
+    if (config.bssid_set) {
+        target = sim_node_find_softap(config.bssid);
+    } else if (!strncmp((const char*)config.ssid, SIM_ROUTER_SSID, sizeof(config.ssid))) {
+        target = SIM_PARENT_ROUTER;
+    }
+
+    if (target == SIM_PARENT_ROUTER) {
+        rssi = sim_router_rssi(node);
+        memcpy(ap.bssid, s_router_bssid, sizeof(ap.bssid));
+        snprintf((char*)ap.ssid, sizeof(ap.ssid), "%s", SIM_ROUTER_SSID);
+    } else if ((target >= 0) && s_nodes[target].alive && (s_nodes[target].stations < SIM_MAX_STATIONS)) {
+        rssi = sim_rssi(node->x, node->y, s_nodes[target].x, s_nodes[target].y);
+        memcpy(ap.bssid, s_nodes[target].softap_mac, sizeof(ap.bssid));
+        memcpy(ap.ssid, config.ssid, sizeof(config.ssid));
+    }
+
+    if (rssi < SIM_RSSI_FLOOR) {
+        node->connecting = true;
+        sim_schedule(s_now + SIM_MS(SIM_ASSOC_FAIL_MS), SIM_EVENT_DISCONNECT, sim_node_index(node), node->link_gen);
+        return;
+    }
+
+    ap.primary = SIM_CHANNEL;
+    ap.rssi = rssi;
+    node->parent = target;
+    node->associated = true;
+    node->associations++;
+    node->api->sta_connected(&ap);
+    if (target >= 0) {
+        s_nodes[target].stations++;
+        sim_node_enter(&s_nodes[target])->ap_station(node->sta_mac, true);
+    }
+
+    sim_schedule(s_now + SIM_MS(SIM_DHCP_MS), SIM_EVENT_GOT_IP, sim_node_index(node), node->link_gen);
+}
+
+static void sim_node_got_ip(sim_node_t* node)
+{
+    esp_netif_ip_info_t ip_info;
+    uint32_t host = sim_node_index(node) + 2;
+
+    if (node->parent == SIM_PARENT_ROUTER) {
+        ip_info.ip.addr = ESP_IP4TOADDR(192, 168, 1, 0);
+        ip_info.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+        ip_info.gw.addr = ESP_IP4TOADDR(192, 168, 1, 1);
+    } else {
+        sim_node_enter(&s_nodes[node->parent])->get_softap_ip(&ip_info);
+        ip_info.gw.addr = ip_info.ip.addr;
+    }
+    /* Network byte order: the host part is the last byte */
+    ip_info.ip.addr = (ip_info.gw.addr & ip_info.netmask.addr) | (ESP_IP4TOADDR(0, 0, 0, host) & ~ip_info.netmask.addr);
+
+    node->has_ip = true;
+    node->sta_ip = ip_info.ip.addr;
+    node->ip_time = s_now;
+    sim_node_enter(node)->sta_got_ip(&ip_info);
+}
+
+static void sim_node_disconnect(sim_node_t* node)
+{
+    int32_t parent = node->parent;
+
+    node->connecting = false;
+    if (node->associated && (parent >= 0)) {
+        s_nodes[parent].stations--;
+        if (s_nodes[parent].alive) {
+            sim_node_enter(&s_nodes[parent])->ap_station(node->sta_mac, false);
+        }
+    }
+    node->associated = false;
+    node->has_ip = false;
+    node->sta_ip = 0;
+    node->parent = SIM_PARENT_NONE;
+
+    sim_node_enter(node)->sta_disconnected();
+}
+
+/* Number of nodes whose chain of parents goes through node */
+static uint32_t sim_node_descendants(uint32_t index)
+{
+    uint32_t num = 0;
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        int32_t parent = s_nodes[loop].parent;
+
+        for (uint32_t depth = 0; (parent >= 0) && (depth < s_config.nodes); depth++) {
+            if ((uint32_t)parent == index) {
+                num++;
+                break;
+            }
+            parent = s_nodes[parent].parent;
+        }
+    }
+
+    return num;
+}
+
+/* Level of the node in the mesh, 0 when its chain of parents does not reach the router */
+static uint32_t sim_node_level(uint32_t index)
+{
+    const sim_node_t* node = &s_nodes[index];
+
+    for (uint32_t level = 1; level <= s_config.nodes; level++) {
+        if (!node->alive || !node->associated || !node->has_ip) {
+            return 0;
+        }
+        if (node->parent == SIM_PARENT_ROUTER) {
+            return level;
+        }
+        node = &s_nodes[node->parent];
+    }
+
+    /* A loop */
+    return 0;
+}
+
+/* Third byte of the SoftAP subnet of the node */
+static uint8_t sim_node_segment(sim_node_t* node)
+{
+    esp_netif_ip_info_t ip_info;
+
+    sim_node_enter(node)->get_softap_ip(&ip_info);
+    return esp_ip4_addr3_16(&ip_info.ip);
+}
+
+/* The level 1 node the chain of parents of the node goes through */
+static int32_t sim_node_root(int32_t index)
+{
+    for (uint32_t depth = 0; (depth < s_config.nodes) && (s_nodes[index].parent >= 0); depth++) {
+        index = s_nodes[index].parent;
+    }
+
+    return index;
+}
+
+/* Follow the routes from the root of the node down to its SoftAP subnet, false when a hop has no route */
+static bool sim_node_route_check(uint32_t index)
+{
+    esp_netif_ip_info_t target;
+    int32_t hop = 0;
+
+    sim_node_enter(&s_nodes[index])->get_softap_ip(&target);
+    hop = sim_node_root(index);
+
+    for (uint32_t depth = 0; depth < s_config.nodes; depth++) {
+        uint32_t next_hop = 0;
+        int32_t child = SIM_PARENT_NONE;
+
+        if ((uint32_t)hop == index) {
+            return true;
+        }
+
+        /* Another node serving the subnet, the packet stops there */
+        if ((sim_node_segment(&s_nodes[hop]) == esp_ip4_addr3_16(&target.ip))
+            || !sim_node_enter(&s_nodes[hop])->route_lookup(target.ip.addr, &next_hop)) {
+            return false;
+        }
+
+        for (uint32_t loop = 0; (loop < s_config.nodes) && (child == SIM_PARENT_NONE); loop++) {
+            if (s_nodes[loop].alive && s_nodes[loop].has_ip && (s_nodes[loop].parent == hop) && (s_nodes[loop].sta_ip == next_hop)) {
+                child = loop;
+            }
+        }
+        if (child == SIM_PARENT_NONE) {
+            return false;
+        }
+        hop = child;
+    }
+
+    return false;
+}
+
+static void sim_node_fail(void)
+{
+    int32_t victim = -1;
+    uint32_t victim_descendants = 0;
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        uint32_t level = sim_node_level(loop);
+        uint32_t descendants = sim_node_descendants(loop);
+
+        if (((s_config.fail == SIM_FAIL_ROOT) && (level == 1)) || ((s_config.fail == SIM_FAIL_MID) && (level > 1))) {
+            if ((victim < 0) || (descendants > victim_descendants)) {
+                victim = loop;
+                victim_descendants = descendants;
+            }
+        }
+    }
+
+    if (victim < 0) {
+        printf("No node to fail at %.1f s\n", s_now / 1e6);
+        return;
+    }
+
+    printf("Node %d fails at %.1f s, %u nodes below it\n", victim, s_now / 1e6, victim_descendants);
+    s_failed_node = victim;
+    s_fail_time = s_now;
+    s_nodes[victim].alive = false;
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        s_nodes[loop].lost = s_nodes[loop].alive && s_nodes[loop].in_mesh && (sim_node_level(loop) == 0);
+    }
+
+    /* Its stations lose the beacons of the parent */
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* node = &s_nodes[loop];
+
+        if (node->alive && node->associated && (node->parent == victim)) {
+            sim_schedule(s_now + SIM_MS(SIM_BEACON_TIMEOUT_MS), SIM_EVENT_DISCONNECT, loop, node->link_gen);
+        }
+    }
+}
+
+static void sim_update_results(void)
+{
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* node = &s_nodes[loop];
+        bool in_mesh = node->alive && (sim_node_level(loop) > 0);
+
+        if (!node->alive || (in_mesh == node->in_mesh)) {
+            continue;
+        }
+        node->in_mesh = in_mesh;
+
+        if (in_mesh && !node->joined) {
+            node->joined = true;
+            node->join_time = s_now - node->boot;
+        }
+
+        /* Healed when back in the mesh after the failure cut it off */
+        if (in_mesh && node->lost && (node->heal_time < 0)) {
+            node->heal_time = s_now - s_fail_time;
+        }
+    }
+}
+
+static void sim_run(void)
+{
+    int64_t end = SIM_MS(s_config.duration_s * 1000ULL);
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_schedule(SIM_MS(sim_random() % SIM_BOOT_SPREAD_MS), SIM_EVENT_BOOT, loop, 0);
+    }
+    if (s_config.fail != SIM_FAIL_NONE) {
+        sim_schedule(SIM_MS(s_config.fail_at_s * 1000ULL), SIM_EVENT_FAIL, 0, 0);
+    }
+
+    while (s_event_num && (s_events[0].time <= end)) {
+        sim_event_t event = sim_next_event();
+        sim_node_t* node = &s_nodes[event.node];
+
+        s_now = event.time;
+        if ((event.type != SIM_EVENT_BOOT) && (event.type != SIM_EVENT_FAIL) && !node->alive) {
+            continue;
+        }
+
+        switch (event.type) {
+        case SIM_EVENT_BOOT:
+            node->boot = s_now;
+            sim_node_boot(node);
+            break;
+        case SIM_EVENT_BEACON:
+            sim_node_beacon(node);
+            break;
+        case SIM_EVENT_SCAN_DONE:
+            if (event.gen == node->scan_gen) {
+                sim_node_scan_done(node);
+            }
+            break;
+        case SIM_EVENT_ASSOC:
+            if (event.gen == node->link_gen) {
+                sim_node_assoc(node);
+            }
+            break;
+        case SIM_EVENT_GOT_IP:
+            if (event.gen == node->link_gen) {
+                sim_node_got_ip(node);
+            }
+            break;
+        case SIM_EVENT_DISCONNECT:
+            if (event.gen == node->link_gen) {
+                node->link_gen++;
+                sim_node_disconnect(node);
+            }
+            break;
+        case SIM_EVENT_FAIL:
+            sim_node_fail();
+            break;
+        }
+
+        sim_update_results();
+    }
+    s_now = end;
+}
+
+static void sim_load_nodes(void)
+{
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        char path[] = "/tmp/litemesh_sim_node_XXXXXX";
+        char buffer[65536];
+        int in = open(s_config.node_lib, O_RDONLY);
+        int out = mkstemp(path);
+        ssize_t len = 0;
+        void* handle = NULL;
+        litemesh_sim_node_get_api_t get_api = NULL;
+
+        if ((in < 0) || (out < 0)) {
+            fprintf(stderr, "Cannot copy %s to %s\n", s_config.node_lib, path);
+            exit(EXIT_FAILURE);
+        }
+
+        /* The dynamic loader shares a file loaded twice, each node needs a file of its own */
+        while ((len = read(in, buffer, sizeof(buffer))) > 0) {
+            if (write(out, buffer, len) != len) {
+                len = -1;
+                break;
+            }
+        }
+        close(in);
+        close(out);
+
+        handle = (len == 0) ? dlopen(path, RTLD_NOW | RTLD_LOCAL) : NULL;
+        unlink(path);
+        if (handle == NULL) {
+            fprintf(stderr, "Cannot load node %u: %s\n", loop, dlerror());
+            exit(EXIT_FAILURE);
+        }
+
+        get_api = (litemesh_sim_node_get_api_t)dlsym(handle, LITEMESH_SIM_NODE_GET_API);
+        s_nodes[loop].api = get_api ? get_api() : NULL;
+        if ((s_nodes[loop].api == NULL) || (s_nodes[loop].api->version != LITEMESH_SIM_NODE_API_VERSION)) {
+            fprintf(stderr, "%s is not a LiteMesh simulator node\n", s_config.node_lib);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void sim_print_ms(int64_t us)
+{
+    if (us < 0) {
+        printf(" %9s", "-");
+    } else {
+        printf(" %9.1f", us / 1e3);
+    }
+}
+
+/* The nodes below each root, how they spread over the roots and whether the roots count them right */
+static bool sim_report_roots(void)
+{
+    bool pass = true;
+    uint32_t roots = 0;
+    uint32_t root_min = UINT32_MAX;
+    uint32_t root_max = 0;
+    uint32_t collisions = 0;
+    uint32_t counted = 0;
+    uint32_t splits = 0;
+
+    printf("nodes per root:");
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* node = &s_nodes[loop];
+        esp_litemesh_tree_stats_t stats;
+        uint32_t nodes = 0;
+
+        if (node->booted && node->api->get_tree_stats && (sim_node_enter(node)->get_tree_stats(&stats) == ESP_OK)) {
+            splits += stats.splits;
+        }
+        if (sim_node_level(loop) != 1) {
+            continue;
+        }
+
+        /* A failed node keeps its parent in the model, only the nodes in the mesh count */
+        for (uint32_t other = 0; other < s_config.nodes; other++) {
+            nodes += (sim_node_level(other) && (sim_node_root(other) == (int32_t)loop)) ? 1 : 0;
+        }
+        printf(" %u", nodes);
+        roots++;
+        root_min = (nodes < root_min) ? nodes : root_min;
+        root_max = (nodes > root_max) ? nodes : root_max;
+        if (node->api->get_tree_stats && (node->api->get_tree_stats(&stats) == ESP_OK) && (stats.subtree_nodes == nodes)) {
+            counted++;
+        }
+        for (uint32_t other = loop + 1; other < s_config.nodes; other++) {
+            if ((sim_node_level(other) == 1) && (sim_node_segment(&s_nodes[other]) == sim_node_segment(node))) {
+                collisions++;
+            }
+        }
+    }
+
+    printf("\nroots %u, nodes per root min %u max %u, root subnet collisions %u\n", roots, roots ? root_min : 0, root_max, collisions);
+    if (s_config.max_root_nodes && (root_max > s_config.max_root_nodes)) {
+        printf("FAIL: a root serves over %u nodes\n", s_config.max_root_nodes);
+        pass = false;
+    }
+
+    if (s_nodes[0].api->get_tree_stats) {
+        printf("trees counted right %u/%u, roots split off %u\n", counted, roots, splits);
+        if ((counted != roots) || collisions) {
+            printf("FAIL: multi-root mode\n");
+            pass = false;
+        }
+    }
+
+    return pass;
+}
+
+/* Whether the node and its chain of parents have all had their address for SIM_PATH_SETTLE_MS */
+static bool sim_node_path_settled(uint32_t index)
+{
+    for (int32_t loop = (int32_t)index; loop >= 0; loop = s_nodes[loop].parent) {
+        if (!s_nodes[loop].has_ip || (s_now - s_nodes[loop].ip_time < SIM_MS(SIM_PATH_SETTLE_MS))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* The path each level measures to the router, and whether the settled nodes know theirs */
+static bool sim_report_paths(void)
+{
+    uint32_t levels = 0;
+    uint32_t count[SIM_MAX_NODES] = { 0 };
+    uint64_t rtt_sum[SIM_MAX_NODES] = { 0 };
+    uint64_t kbps_sum[SIM_MAX_NODES] = { 0 };
+    uint32_t settled = 0;
+    uint32_t known = 0;
+    uint32_t probes = 0;
+    uint32_t losses = 0;
+
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* node = &s_nodes[loop];
+        esp_litemesh_path_stats_t stats;
+        uint32_t level = sim_node_level(loop);
+
+        if (!node->booted || (sim_node_enter(node)->get_path_stats(&stats) != ESP_OK)) {
+            continue;
+        }
+        probes += stats.probes;
+        losses += stats.losses;
+        if (level == 0) {
+            continue;
+        }
+
+        if (sim_node_path_settled(loop)) {
+            settled++;
+            known += stats.valid ? 1 : 0;
+        }
+        if (stats.valid) {
+            count[level - 1]++;
+            rtt_sum[level - 1] += stats.path_rtt_us;
+            kbps_sum[level - 1] += stats.path_kbps;
+            levels = (level > levels) ? level : levels;
+        }
+    }
+
+    printf("path per level, ms and kbit/s:");
+    for (uint32_t loop = 0; loop < levels; loop++) {
+        if (count[loop]) {
+            printf(" %u: %.1f %llu", loop + 1, rtt_sum[loop] / 1e3 / count[loop], (unsigned long long)(kbps_sum[loop] / count[loop]));
+        }
+    }
+    printf("\npaths known %u/%u settled, probes %u, lost %u\n", known, settled, probes, losses);
+    if (known != settled) {
+        printf("FAIL: path metrics\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool sim_report(void)
+{
+    bool pass = true;
+    uint32_t joined = 0;
+    uint32_t healed = 0;
+    uint32_t lost = 0;
+    uint32_t out = 0;
+    int64_t join_max = 0;
+    int64_t join_sum = 0;
+    int64_t heal_max = 0;
+    int64_t heal_sum = 0;
+    uint32_t rebuild_max = 0;
+    uint64_t rebuild_sum = 0;
+    esp_litemesh_scan_stats_t scans = { 0 };
+
+    printf("\n%4s %7s %7s %5s %7s %9s %9s %8s %6s %8s\n",
+           "node", "x", "y", "level", "parent", "join ms", "heal ms", "rebuilds", "joins", "switches");
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        sim_node_t* node = &s_nodes[loop];
+        esp_litemesh_ie_stats_t stats;
+        uint32_t level = sim_node_level(loop);
+        char parent[8] = "-";
+
+        memset(&stats, 0, sizeof(stats));
+        if (node->booted) {
+            esp_litemesh_scan_stats_t scan_stats;
+
+            node->api->get_ie_stats(&stats);
+            if (node->api->get_scan_stats(&scan_stats) == ESP_OK) {
+                scans.pinned_scans += scan_stats.pinned_scans;
+                scans.pinned_hits += scan_stats.pinned_hits;
+                scans.full_scans += scan_stats.full_scans;
+                scans.channel_scans += scan_stats.channel_scans;
+                scans.scan_time_ms += scan_stats.scan_time_ms;
+            }
+        }
+        if (level && (node->parent == SIM_PARENT_ROUTER)) {
+            snprintf(parent, sizeof(parent), "router");
+        } else if (level) {
+            snprintf(parent, sizeof(parent), "%d", node->parent);
+        }
+
+        printf("%4u %7.1f %7.1f %5u %7s", loop, node->x, node->y, level, node->alive ? parent : "failed");
+        sim_print_ms(node->joined ? node->join_time : -1);
+        sim_print_ms(node->lost ? node->heal_time : -1);
+        printf(" %8u %6u %8u\n", stats.rebuilds, node->associations, node->switches);
+
+        if (node->joined) {
+            joined++;
+            join_sum += node->join_time;
+            join_max = (node->join_time > join_max) ? node->join_time : join_max;
+        }
+        if (node->lost) {
+            lost++;
+            if (level && (node->heal_time >= 0)) {
+                healed++;
+                heal_sum += node->heal_time;
+                heal_max = (node->heal_time > heal_max) ? node->heal_time : heal_max;
+            }
+        }
+        rebuild_sum += stats.rebuilds;
+        rebuild_max = (stats.rebuilds > rebuild_max) ? stats.rebuilds : rebuild_max;
+
+        /* Every node but the failed one ends up in the mesh */
+        if (node->alive && (level == 0)) {
+            out++;
+        }
+    }
+
+    printf("\nnodes %u, joined %u, join ms max %.1f mean %.1f\n", s_config.nodes, joined,
+           join_max / 1e3, joined ? join_sum / 1e3 / joined : 0.0);
+    if (s_fail_time >= 0) {
+        printf("failed node %d, lost %u, healed %u, heal ms max %.1f mean %.1f\n", s_failed_node, lost, healed,
+               heal_max / 1e3, healed ? heal_sum / 1e3 / healed : 0.0);
+    }
+    printf("IE rebuilds max %u mean %.1f\n", rebuild_max, (double)rebuild_sum / s_config.nodes);
+    printf("scans pinned %u (hits %u), full %u, channel %u, scan ms mean %.1f\n", scans.pinned_scans, scans.pinned_hits,
+           scans.full_scans, scans.channel_scans, (double)scans.scan_time_ms / s_config.nodes);
+
+    if (joined != s_config.nodes) {
+        printf("FAIL: %u nodes never joined\n", s_config.nodes - joined);
+        pass = false;
+    }
+    if (s_config.max_join_ms && (join_max > SIM_MS(s_config.max_join_ms))) {
+        printf("FAIL: join time over %u ms\n", s_config.max_join_ms);
+        pass = false;
+    }
+    if (s_config.max_heal_ms && (heal_max > SIM_MS(s_config.max_heal_ms))) {
+        printf("FAIL: heal time over %u ms\n", s_config.max_heal_ms);
+        pass = false;
+    }
+    if (out) {
+        printf("FAIL: %u nodes out of the mesh at the end\n", out);
+        pass = false;
+    }
+    if (healed != lost) {
+        printf("FAIL: %u nodes not healed\n", lost - healed);
+        pass = false;
+    }
+
+    pass &= sim_report_roots();
+    if (s_nodes[0].api->get_path_stats) {
+        pass &= sim_report_paths();
+    }
+
+    if (s_nodes[0].api->route_lookup) {
+        uint32_t in_mesh = 0;
+        uint32_t routed = 0;
+        uint32_t collisions = 0;
+        uint32_t napt_wrong = 0;
+        uint32_t renumbers = 0;
+
+        for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+            sim_node_t* node = &s_nodes[loop];
+            uint32_t level = sim_node_level(loop);
+
+            if (node->booted) {
+                renumbers += sim_node_enter(node)->get_renumbers();
+            }
+            if (level == 0) {
+                continue;
+            }
+
+            in_mesh++;
+            routed += sim_node_route_check(loop) ? 1 : 0;
+            napt_wrong += (sim_node_enter(node)->softap_napt_enabled() != (level == 1)) ? 1 : 0;
+            for (uint32_t other = loop + 1; other < s_config.nodes; other++) {
+                /* The roots do not hear of each other, each mesh below a root is checked on its own */
+                if (sim_node_level(other) && (sim_node_root(other) == sim_node_root(loop))
+                    && (sim_node_segment(&s_nodes[other]) == sim_node_segment(node))) {
+                    collisions++;
+                }
+            }
+        }
+
+        printf("routes ok %u/%u, subnet collisions %u, SoftAP renumbers %u, NAPT misplaced %u\n",
+               routed, in_mesh, collisions, renumbers, napt_wrong);
+        if ((routed != in_mesh) || collisions || napt_wrong) {
+            printf("FAIL: routed mode\n");
+            pass = false;
+        }
+    }
+
+    return pass;
+}
+
+static void sim_usage(const char* name)
+{
+    printf("Usage: %s [options]\n"
+           "  -n, --nodes N           nodes, at most %d (default 24)\n"
+           "  -s, --seed N            seed of the radio model and of the nodes (default 1)\n"
+           "  -t, --time S            simulated seconds (default 120)\n"
+           "  -d, --spacing M         meters between the nodes of the grid (default 15)\n"
+           "  -f, --fail MODE         none, root: the level 1 node with the most descendants,\n"
+           "                          mid: the deeper node with the most descendants (default none)\n"
+           "  -a, --fail-at S         second of the failure (default 60)\n"
+           "  -j, --max-join-ms MS    fail when a node takes longer to join (default no limit)\n"
+           "  -H, --max-heal-ms MS    fail when a node takes longer to heal (default no limit)\n"
+           "  -c, --channel N         channel in the NVS of the nodes at boot, as left by an earlier\n"
+           "                          association, the router is on %d (default none)\n"
+           "  -R, --max-root-nodes N  fail when a root serves more nodes, itself included (default no limit)\n"
+           "  -l, --node-lib PATH     node module (default %s)\n"
+           "  -v, --verbose           log the nodes at the info level\n",
+           name, SIM_MAX_NODES, SIM_CHANNEL, LITEMESH_SIM_NODE_LIB);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = {
+        { "nodes", required_argument, NULL, 'n' },
+        { "seed", required_argument, NULL, 's' },
+        { "time", required_argument, NULL, 't' },
+        { "spacing", required_argument, NULL, 'd' },
+        { "fail", required_argument, NULL, 'f' },
+        { "fail-at", required_argument, NULL, 'a' },
+        { "max-join-ms", required_argument, NULL, 'j' },
+        { "max-heal-ms", required_argument, NULL, 'H' },
+        { "channel", required_argument, NULL, 'c' },
+        { "max-root-nodes", required_argument, NULL, 'R' },
+        { "node-lib", required_argument, NULL, 'l' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt = 0;
+    bool pass = false;
+
+    s_config.nodes = 24;
+    s_config.seed = 1;
+    s_config.duration_s = 120;
+    s_config.spacing = 15;
+    s_config.fail = SIM_FAIL_NONE;
+    s_config.fail_at_s = 60;
+    s_config.node_lib = LITEMESH_SIM_NODE_LIB;
+
+    while ((opt = getopt_long(argc, argv, "n:s:t:d:f:a:j:H:c:R:l:vh", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            s_config.nodes = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            s_config.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            s_config.duration_s = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            s_config.spacing = strtod(optarg, NULL);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "none")) {
+                s_config.fail = SIM_FAIL_NONE;
+            } else if (!strcmp(optarg, "root")) {
+                s_config.fail = SIM_FAIL_ROOT;
+            } else if (!strcmp(optarg, "mid")) {
+                s_config.fail = SIM_FAIL_MID;
+            } else {
+                sim_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a':
+            s_config.fail_at_s = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            s_config.max_join_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'H':
+            s_config.max_heal_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_config.stored_channel = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            s_config.max_root_nodes = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            s_config.node_lib = optarg;
+            break;
+        case 'v':
+            s_config.verbose = true;
+            break;
+        default:
+            sim_usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if ((s_config.nodes == 0) || (s_config.nodes > SIM_MAX_NODES) || (s_config.duration_s == 0) || (s_config.spacing <= 0)
+        || ((s_config.fail != SIM_FAIL_NONE) && (s_config.fail_at_s >= s_config.duration_s))
+        || (s_config.stored_channel > SIM_SCAN_CHANNELS)) {
+        sim_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    s_nodes = calloc(s_config.nodes, sizeof(sim_node_t));
+    if (s_nodes == NULL) {
+        return EXIT_FAILURE;
+    }
+    s_random_state = s_config.seed ? s_config.seed : 1;
+    for (uint32_t loop = 0; loop < s_config.nodes; loop++) {
+        s_nodes[loop].parent = SIM_PARENT_NONE;
+        s_nodes[loop].join_time = -1;
+        s_nodes[loop].heal_time = -1;
+        sim_place(&s_nodes[loop], loop);
+    }
+
+    sim_load_nodes();
+    sim_run();
+    pass = sim_report();
+
+    free(s_events);
+    free(s_nodes);
+    return pass ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,153 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_mock.h"
+#include "nvs.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_litemesh.h"
+
+#include "litemesh_sim_node.h"
+
+static esp_netif_t* s_station = NULL;
+static esp_netif_t* s_softap = NULL;
+
+static esp_err_t sim_node_start(const uint8_t base_mac[6], const char* router_ssid, uint32_t seed, bool verbose,
+                                const esp_mock_wifi_hooks_t* hooks)
+{
+    wifi_config_t config;
+
+    esp_log_level_set("*", verbose ? ESP_LOG_INFO : ESP_LOG_NONE);
+    esp_mock_timer_freeze();
+    esp_mock_random_seed(seed);
+    esp_mock_set_base_mac(base_mac);
+    esp_mock_wifi_set_hooks(hooks);
+    esp_event_loop_create_default();
+
+    /* The router a provisioned node would have in flash */
+    memset(&config, 0, sizeof(config));
+    strlcpy((char*)config.sta.ssid, router_ssid, sizeof(config.sta.ssid));
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+
+    s_softap = esp_gateway_create_softap_netif(NULL, NULL, true, true);
+    s_station = esp_gateway_create_station_netif(NULL, NULL, false, false);
+
+    return (s_softap && s_station) ? ESP_OK : ESP_FAIL;
+}
+
+static void sim_node_advance_to(int64_t now_us)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (now_us > now) {
+        esp_mock_timer_advance(now_us - now);
+    }
+}
+
+static const vendor_ie_data_t* sim_node_get_ie(void)
+{
+    return esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0);
+}
+
+static void sim_node_get_sta_config(wifi_sta_config_t* config)
+{
+    wifi_config_t wifi_config;
+
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+    *config = wifi_config.sta;
+}
+
+static void sim_node_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    esp_wifi_get_mac(ifx, mac);
+}
+
+static void sim_node_sta_got_ip(const esp_netif_ip_info_t* ip_info)
+{
+    esp_mock_netif_got_ip(s_station, ip_info);
+}
+
+static void sim_node_get_softap_ip(esp_netif_ip_info_t* ip_info)
+{
+    esp_netif_get_ip_info(s_softap, ip_info);
+}
+
+#if CONFIG_LITEMESH_ROUTED
+static uint32_t sim_node_get_renumbers(void)
+{
+    esp_litemesh_route_stats_t stats;
+
+    return (esp_litemesh_get_route_stats(&stats) == ESP_OK) ? stats.renumbers : 0;
+}
+#endif
+
+static bool sim_node_softap_napt_enabled(void)
+{
+    esp_netif_ip_info_t ip_info;
+
+    esp_netif_get_ip_info(s_softap, &ip_info);
+    return esp_mock_napt_is_enabled(ip_info.ip.addr);
+}
+
+static void sim_node_store_channel(uint8_t channel)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(ESP_LITEMESH_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_u8(handle, ESP_LITEMESH_NVS_KEY_CHANNEL, channel);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+static const litemesh_sim_node_api_t s_api = {
+    .version = LITEMESH_SIM_NODE_API_VERSION,
+    .start = sim_node_start,
+    .advance_to = sim_node_advance_to,
+    .get_ie = sim_node_get_ie,
+    .beacon = esp_mock_wifi_beacon,
+    .scan_done = esp_mock_wifi_scan_done,
+    .get_sta_config = sim_node_get_sta_config,
+    .get_mac = sim_node_get_mac,
+    .sta_connected = esp_mock_wifi_sta_connected,
+    .sta_disconnected = esp_mock_wifi_sta_disconnected,
+    .ap_station = esp_mock_wifi_ap_station,
+    .sta_got_ip = sim_node_sta_got_ip,
+    .get_softap_ip = sim_node_get_softap_ip,
+    .get_ie_stats = esp_litemesh_get_ie_stats,
+#if CONFIG_LITEMESH_ROUTED
+    .route_lookup = esp_litemesh_route_lookup,
+    .get_renumbers = sim_node_get_renumbers,
+#endif
+    .softap_napt_enabled = sim_node_softap_napt_enabled,
+    .get_scan_stats = esp_litemesh_get_scan_stats,
+    .store_channel = sim_node_store_channel,
+#if CONFIG_LITEMESH_MULTI_ROOT
+    .get_tree_stats = esp_litemesh_get_tree_stats,
+#endif
+#if CONFIG_LITEMESH_PATH_METRICS
+    .get_path_stats = esp_litemesh_get_path_stats,
+#endif
+};
+
+const litemesh_sim_node_api_t* litemesh_sim_node_get_api(void)
+{
+    return &s_api;
+}
@@ -0,0 +1,96 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "esp_wifi_types.h"
+#include "esp_mock.h"
+
+#include "esp_gateway.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One LiteMesh node of the simulator: the gateway component and the mocks, built as a module which the
+ * simulator loads once per node so that every node has its own copy of their static state. The simulator
+ * only reaches a node through the table of litemesh_sim_node_get_api().
+ */
+
+#define LITEMESH_SIM_NODE_API_VERSION   (5)
+#define LITEMESH_SIM_NODE_GET_API       "litemesh_sim_node_get_api"
+
+/**
+ * @brief Calls into a node
+ *
+ */
+typedef struct {
+    uint32_t version;   /*!< LITEMESH_SIM_NODE_API_VERSION */
+
+    /**
+     * @brief Boot the node: the SoftAP and the station of the default project, configured for the router
+     *        router_ssid. The clock of the node starts at 0, the Wi-Fi driver calls go to hooks.
+     */
+    esp_err_t (*start)(const uint8_t base_mac[6], const char* router_ssid, uint32_t seed, bool verbose,
+                       const esp_mock_wifi_hooks_t* hooks);
+    /** @brief Move the clock of the node to now_us and run its timers */
+    void (*advance_to)(int64_t now_us);
+    /** @brief The beacon IE of the node, NULL when disabled */
+    const vendor_ie_data_t* (*get_ie)(void);
+    /** @brief A beacon of another node is heard */
+    void (*beacon)(const uint8_t sa[6], const vendor_ie_data_t* vnd_ie, int rssi);
+    /** @brief The scan started by the node is over */
+    void (*scan_done)(const wifi_ap_record_t* records, uint16_t num);
+    /** @brief The configuration the station connects with */
+    void (*get_sta_config)(wifi_sta_config_t* config);
+    void (*get_mac)(wifi_interface_t ifx, uint8_t mac[6]);
+    void (*sta_connected)(const wifi_ap_record_t* ap);
+    void (*sta_disconnected)(void);
+    /** @brief A station joins or leaves the SoftAP of the node */
+    void (*ap_station)(const uint8_t mac[6], bool connected);
+    /** @brief The DHCP client of the station got an address */
+    void (*sta_got_ip)(const esp_netif_ip_info_t* ip_info);
+    void (*get_softap_ip)(esp_netif_ip_info_t* ip_info);
+    esp_err_t (*get_ie_stats)(esp_litemesh_ie_stats_t* stats);
+    /** @brief The child a destination is routed to, NULL when the node is built without the routed mode */
+    bool (*route_lookup)(uint32_t addr, uint32_t* next_hop);
+    /** @brief Segments of the node moved because they were used elsewhere in the mesh */
+    uint32_t (*get_renumbers)(void);
+    /** @brief Whether the SoftAP of the node translates its clients */
+    bool (*softap_napt_enabled)(void);
+    esp_err_t (*get_scan_stats)(esp_litemesh_scan_stats_t* stats);
+    /** @brief Keep a channel in the NVS of the node, as an earlier association would, call it before start */
+    void (*store_channel)(uint8_t channel);
+    /** @brief The tree of the node, NULL when the node is built without the multi-root mode */
+    esp_err_t (*get_tree_stats)(esp_litemesh_tree_stats_t* stats);
+    /** @brief The path of the node to the router, NULL when the node is built without the path metrics */
+    esp_err_t (*get_path_stats)(esp_litemesh_path_stats_t* stats);
+} litemesh_sim_node_api_t;
+
+typedef const litemesh_sim_node_api_t* (*litemesh_sim_node_get_api_t)(void);
+
+/**
+ * @brief  Get the calls into the node of this copy of the module.
+ */
+const litemesh_sim_node_api_t* litemesh_sim_node_get_api(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,322 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "unity.h"
+#include "test_utils.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_mock.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_litemesh_ie.h"
+
+/* The gateway keeps its netifs for the whole run, they are created once for all the tests */
+static esp_netif_t* s_station = NULL;
+static esp_netif_t* s_softap = NULL;
+
+static void test_gateway_start(void)
+{
+    if (s_station == NULL) {
+        esp_event_loop_create_default();
+        s_softap = esp_gateway_create_softap_netif(NULL, NULL, true, true);
+        s_station = esp_gateway_create_station_netif(NULL, NULL, false, false);
+    }
+
+    TEST_ASSERT_NOT_NULL(s_softap);
+    TEST_ASSERT_NOT_NULL(s_station);
+}
+
+static uint32_t s_scans = 0;
+static wifi_scan_config_t s_scan_config;
+
+static void test_scan_start_hook(const wifi_scan_config_t* config, void* arg)
+{
+    s_scans++;
+    memset(&s_scan_config, 0, sizeof(s_scan_config));
+    if (config) {
+        s_scan_config = *config;
+    }
+}
+
+static void test_litemesh_beacon(const uint8_t sa[6], uint8_t level, int rssi)
+{
+    uint8_t data[2 + 16] = { 0 };
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)data;
+
+    ie->element_id = WIFI_VENDOR_IE_ELEMENT_ID;
+    ie->length = 4 + 6;
+    ie->vendor_oui[0] = CONFIG_VENDOR_OUI_0;
+    ie->vendor_oui[1] = CONFIG_VENDOR_OUI_1;
+    ie->vendor_oui[2] = CONFIG_VENDOR_OUI_2;
+    ie->payload[0] = 1;                                         /* version */
+    ie->payload[1] = CONFIG_LITEMESH_MAX_CONNECT_NUMBER << 4;   /* no station yet */
+    ie->payload[2] = 0x80 | level;                              /* connected to the router */
+    ie->payload[4] = 1 << 4;                                    /* one router segment */
+    ie->payload[5] = 1;                                         /* 192.168.1.0/24 */
+    esp_mock_wifi_beacon(sa, ie, rssi);
+}
+
+TEST_CASE("host: data-forwarding netif leaves the subnet the station got", "[gateway]")
+{
+    esp_netif_ip_info_t softap_ip;
+    esp_netif_ip_info_t station_ip;
+    esp_netif_ip_info_t moved_ip;
+
+    test_gateway_start();
+    esp_netif_get_ip_info(s_softap, &softap_ip);
+    TEST_ASSERT_NOT_EQUAL(0, softap_ip.ip.addr);
+
+    station_ip.ip.addr = (softap_ip.ip.addr & softap_ip.netmask.addr) | esp_netif_htonl(23);
+    station_ip.netmask = softap_ip.netmask;
+    station_ip.gw.addr = (softap_ip.ip.addr & softap_ip.netmask.addr) | esp_netif_htonl(1);
+    esp_mock_netif_got_ip(s_station, &station_ip);
+
+    /* The plan waits for the other events of the burst */
+    esp_netif_get_ip_info(s_softap, &moved_ip);
+    TEST_ASSERT_EQUAL_HEX32(softap_ip.ip.addr, moved_ip.ip.addr);
+
+    esp_mock_timer_advance(CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS * 1000ULL);
+    esp_netif_get_ip_info(s_softap, &moved_ip);
+    TEST_ASSERT_NOT_EQUAL(softap_ip.ip.addr & softap_ip.netmask.addr, moved_ip.ip.addr & moved_ip.netmask.addr);
+    TEST_ASSERT_NOT_EQUAL(station_ip.ip.addr & station_ip.netmask.addr, moved_ip.ip.addr & moved_ip.netmask.addr);
+    TEST_ASSERT_TRUE(esp_gateway_is_data_forwarding_addr(moved_ip.ip.addr));
+    TEST_ASSERT_FALSE(esp_gateway_is_data_forwarding_addr(station_ip.ip.addr));
+
+    esp_mock_wifi_sta_disconnected();
+}
+
+TEST_CASE("host: network segments are the /24 of the address pool", "[gateway]")
+{
+    esp_ip4_addr_t ip = { .addr = ESP_IP4TOADDR(192, 168, 7, 9) };
+    uint8_t net_segment = 0;
+
+    test_gateway_start();
+    TEST_ASSERT_TRUE(esp_gateway_network_segment_from_addr(ip, &net_segment));
+    TEST_ASSERT_EQUAL(7, net_segment);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 7, 0), esp_gateway_network_segment_to_addr(net_segment).addr);
+
+    /* Out of the pool */
+    ip.addr = ESP_IP4TOADDR(192, 169, 7, 9);
+    TEST_ASSERT_FALSE(esp_gateway_network_segment_from_addr(ip, &net_segment));
+    ip.addr = ESP_IP4TOADDR(10, 0, 0, 23);
+    TEST_ASSERT_FALSE(esp_gateway_network_segment_from_addr(ip, &net_segment));
+}
+
+TEST_CASE("host: litemesh publishes the stations of the softap in its vendor IE", "[gateway]")
+{
+    const uint8_t station[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x42 };
+    esp_litemesh_ie_view_t view;
+    uint8_t connected = 0;
+
+    test_gateway_start();
+    TEST_ASSERT_NOT_NULL(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0));
+    TEST_ASSERT_EQUAL(CONFIG_VENDOR_OUI_0, esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0)->vendor_oui[0]);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    /* No neighbour heard yet */
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_VERSION_1, view.version);
+    TEST_ASSERT_TRUE(view.compact);
+    TEST_ASSERT_EQUAL(CONFIG_LITEMESH_MAX_CONNECT_NUMBER, view.max_connection);
+    connected = view.connected_station_number;
+
+    esp_mock_wifi_ap_station(station, true);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(connected + 1, view.connected_station_number);
+
+    esp_mock_wifi_ap_station(station, false);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(connected, view.connected_station_number);
+}
+
+TEST_CASE("host: litemesh merges bursts of IE changes and skips the unchanged IE", "[gateway]")
+{
+    uint8_t stations[3][6] = { { 0x02, 0, 0, 0, 0, 0x51 }, { 0x02, 0, 0, 0, 0, 0x52 }, { 0x02, 0, 0, 0, 0, 0x53 } };
+    esp_litemesh_ie_stats_t before;
+    esp_litemesh_ie_stats_t after;
+    esp_mock_wifi_stats_t wifi_before;
+    esp_mock_wifi_stats_t wifi_after;
+    esp_litemesh_ie_view_t view;
+    uint8_t connected = 0;
+
+    test_gateway_start();
+    esp_mock_wifi_sta_disconnected();
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    connected = view.connected_station_number;
+
+    /* Nothing changed */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_ie_stats(&before));
+    esp_mock_wifi_get_stats(&wifi_before);
+    esp_mock_wifi_sta_disconnected();
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_ie_stats(&after));
+    esp_mock_wifi_get_stats(&wifi_after);
+    TEST_ASSERT_EQUAL(before.skipped + 1, after.skipped);
+    TEST_ASSERT_EQUAL(before.rebuilds, after.rebuilds);
+    TEST_ASSERT_EQUAL(wifi_before.vendor_ie_sets, wifi_after.vendor_ie_sets);
+
+    /* A station joining and leaving before the IE is published */
+    esp_mock_wifi_ap_station(stations[0], true);
+    esp_mock_wifi_ap_station(stations[0], false);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_ie_stats(&after));
+    esp_mock_wifi_get_stats(&wifi_after);
+    TEST_ASSERT_EQUAL(before.coalesced + 1, after.coalesced);
+    TEST_ASSERT_EQUAL(before.rebuilds, after.rebuilds);
+    TEST_ASSERT_EQUAL(wifi_before.vendor_ie_sets, wifi_after.vendor_ie_sets);
+
+    /* Three stations joining together, published once */
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        esp_mock_wifi_ap_station(stations[loop], true);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(connected, view.connected_station_number);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(connected + 3, view.connected_station_number);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_ie_stats(&after));
+    TEST_ASSERT_EQUAL(before.rebuilds + 1, after.rebuilds);
+    TEST_ASSERT_EQUAL(before.coalesced + 3, after.coalesced);
+
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        esp_mock_wifi_ap_station(stations[loop], false);
+    }
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_ie_stats(&after));
+    TEST_ASSERT_EQUAL(before.rebuilds + 2, after.rebuilds);
+}
+
+TEST_CASE("host: litemesh publishes version 2 while all its neighbours parse it", "[gateway]")
+{
+    /* Not connected to the router, so that they are no parent candidates */
+    const uint8_t compact[6] = { 0x24, 0x00, 0x00, 0x00, 0x01, 0x01 };
+    const uint8_t legacy[6] = { 0x24, 0x00, 0x00, 0x00, 0x01, 0x02 };
+    uint8_t data[2 + 16] = { 0 };
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)data;
+    esp_litemesh_ie_view_t view;
+
+    test_gateway_start();
+    ie->element_id = WIFI_VENDOR_IE_ELEMENT_ID;
+    ie->length = 4 + 5;
+    ie->vendor_oui[0] = CONFIG_VENDOR_OUI_0;
+    ie->vendor_oui[1] = CONFIG_VENDOR_OUI_1;
+    ie->vendor_oui[2] = CONFIG_VENDOR_OUI_2;
+    ie->payload[0] = ESP_LITEMESH_IE_VERSION_1;
+    ie->payload[1] = CONFIG_LITEMESH_MAX_CONNECT_NUMBER << 4;
+
+    /* A neighbour publishing version 1 with the compact bit */
+    ie->payload[2] = 0x40 | 1;
+    esp_mock_wifi_beacon(compact, ie, -60);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_VERSION_2, view.version);
+
+    /* A neighbour of the previous firmware */
+    ie->payload[2] = 1;
+    esp_mock_wifi_beacon(legacy, ie, -60);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_VERSION_1, view.version);
+    TEST_ASSERT_TRUE(view.compact);
+
+    /* Version 1 is held for a while after the last beacon of the previous firmware */
+    ie->payload[2] = 0x40 | 1;
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_V1_HOLD_MS / 2 * 1000ULL);
+    esp_mock_wifi_beacon(compact, ie, -60);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_VERSION_1, view.version);
+
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_V1_HOLD_MS / 2 * 1000ULL);
+    esp_mock_wifi_beacon(compact, ie, -60);
+    esp_mock_timer_advance(CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS * 1000ULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(esp_mock_wifi_get_vendor_ie(WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0), &view));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_VERSION_2, view.version);
+}
+
+TEST_CASE("host: litemesh joins the closest parent heard during the scan", "[gateway]")
+{
+    const uint8_t near_parent[6] = { 0x24, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    const uint8_t deep_parent[6] = { 0x24, 0x00, 0x00, 0x00, 0x00, 0x02 };
+    esp_mock_wifi_stats_t stats;
+    wifi_config_t config;
+    uint32_t connects = 0;
+
+    test_gateway_start();
+    esp_mock_wifi_get_stats(&stats);
+    connects = stats.connects;
+
+    /* A stronger signal does not make up for a deeper level */
+    test_litemesh_beacon(near_parent, 1, -60);
+    test_litemesh_beacon(deep_parent, 2, -50);
+
+    for (uint32_t loop = 0; (loop < 3) && (stats.connects == connects); loop++) {
+        esp_mock_wifi_scan_done(NULL, 0);
+        esp_mock_wifi_get_stats(&stats);
+    }
+    TEST_ASSERT_EQUAL(connects + 1, stats.connects);
+
+    esp_wifi_get_config(WIFI_IF_STA, &config);
+    TEST_ASSERT_TRUE(config.sta.bssid_set);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(near_parent, config.sta.bssid, 6);
+}
+
+TEST_CASE("host: litemesh scans the channel of the last association first", "[gateway]")
+{
+    esp_mock_wifi_hooks_t hooks = { .scan_start = test_scan_start_hook };
+    esp_litemesh_scan_stats_t before;
+    esp_litemesh_scan_stats_t after;
+    esp_netif_ip_info_t station_ip;
+    wifi_ap_record_t router;
+
+    test_gateway_start();
+    esp_mock_wifi_set_hooks(&hooks);
+
+    memset(&router, 0, sizeof(router));
+    router.primary = 11;
+    station_ip.ip.addr = ESP_IP4TOADDR(10, 0, 0, 23);
+    station_ip.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    station_ip.gw.addr = ESP_IP4TOADDR(10, 0, 0, 1);
+    esp_mock_wifi_sta_connected(&router);
+    esp_mock_netif_got_ip(s_station, &station_ip);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_scan_stats(&before));
+    TEST_ASSERT_EQUAL(11, before.stored_channel);
+
+    /* No candidate fresh enough to fail over to, the uplink loss starts a scan */
+    esp_mock_timer_advance(20000 * 1000ULL);
+    s_scans = 0;
+    esp_mock_wifi_sta_disconnected();
+    TEST_ASSERT_EQUAL(1, s_scans);
+    TEST_ASSERT_EQUAL(11, s_scan_config.channel);
+    TEST_ASSERT_EQUAL(WIFI_SCAN_TYPE_PASSIVE, s_scan_config.scan_type);
+    TEST_ASSERT_EQUAL(CONFIG_LITEMESH_SCAN_CHANNEL_DWELL_MS, s_scan_config.scan_time.passive);
+
+    /* Nothing on it, all the channels then */
+    esp_mock_wifi_scan_done(NULL, 0);
+    TEST_ASSERT_EQUAL(2, s_scans);
+    TEST_ASSERT_EQUAL(0, s_scan_config.channel);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_get_scan_stats(&after));
+    TEST_ASSERT_EQUAL(before.pinned_scans + 1, after.pinned_scans);
+    TEST_ASSERT_EQUAL(before.pinned_hits, after.pinned_hits);
+    TEST_ASSERT_EQUAL(before.full_scans + 1, after.full_scans);
+
+    /* The second pass, then the router */
+    esp_mock_wifi_scan_done(NULL, 0);
+    esp_mock_wifi_scan_done(NULL, 0);
+    esp_mock_wifi_set_hooks(NULL);
+}
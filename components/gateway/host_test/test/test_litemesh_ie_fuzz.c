@@ -0,0 +1,183 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "test_utils.h"
+#include "esp_system.h"
+#include "esp_mock.h"
+
+#include "esp_gateway_litemesh_ie.h"
+
+/*
+ * The IEs are allocated with their exact size, so AddressSanitizer reports any read past the length of the IE.
+ */
+#ifndef TEST_FUZZ_ITERATIONS
+#define TEST_FUZZ_ITERATIONS    (20000)
+#endif
+
+static vendor_ie_data_t* test_fuzz_ie_alloc(uint8_t length)
+{
+    vendor_ie_data_t* ie = malloc(2 + length);
+
+    TEST_ASSERT_NOT_NULL(ie);
+    ie->element_id = WIFI_VENDOR_IE_ELEMENT_ID;
+    ie->length = length;
+    return ie;
+}
+
+static void test_fuzz_check_view(const vendor_ie_data_t* ie, const esp_litemesh_ie_view_t* view)
+{
+    const uint8_t* begin = ie->payload;
+    const uint8_t* end = ie->payload + ie->length - ESP_LITEMESH_IE_OUI_LEN;
+
+    TEST_ASSERT_LESS_OR_EQUAL(ESP_GATEWAY_SSID_MAX_LEN, view->router_ssid_len);
+    TEST_ASSERT_LESS_OR_EQUAL(15, view->level);
+    TEST_ASSERT_LESS_OR_EQUAL(100, view->uplink_quality);
+    if (view->router_ssid) {
+        TEST_ASSERT_TRUE((view->router_ssid >= begin) && (view->router_ssid + view->router_ssid_len <= end));
+    }
+    if (view->router_number) {
+        TEST_ASSERT_TRUE((view->router_net_segment >= begin) && (view->router_net_segment + view->router_number <= end));
+    }
+    if (view->inherited_netif_number) {
+        TEST_ASSERT_TRUE((view->inherited_net_segment >= begin) && (view->inherited_net_segment + view->inherited_netif_number <= end));
+    }
+}
+
+static void test_fuzz_random_info(esp_gateway_litemesh_info_t* info, uint8_t version)
+{
+    memset(info, 0, sizeof(*info));
+    info->version = version;
+    info->max_connection = esp_random() & 0x0F;
+    info->connected_station_number = esp_random() & 0x0F;
+    info->connect_router_status = esp_random() & 0x01;
+    info->level = esp_random() & 0x0F;
+    info->uplink_quality = esp_random() % 101;
+    info->router_ssid_len = esp_random() % (ESP_GATEWAY_SSID_MAX_LEN + 1);
+    info->router_number = esp_random() % (ESP_LITEMESH_MAX_ROUTER_NUMBER + 1);
+    info->inherited_netif_number = esp_random() % (ESP_LITEMESH_MAX_INHERITED_NETIF_NUMBER + 1);
+    info->self_net_segment_num = esp_random() % (ESP_GATEWAY_EXTERNAL_NETIF_MAX + 1);
+    if (info->inherited_netif_number + info->self_net_segment_num > 0x0F) {
+        info->self_net_segment_num = 0x0F - info->inherited_netif_number;
+    }
+
+    for (uint32_t loop = 0; loop < info->router_ssid_len; loop++) {
+        info->router_ssid[loop] = 0x20 + esp_random() % 0x5F;
+    }
+    for (uint32_t loop = 0; loop < info->router_number; loop++) {
+        info->router_net_segment[loop] = esp_random();
+    }
+    for (uint32_t loop = 0; loop < info->inherited_netif_number; loop++) {
+        info->inherited_net_segment[loop] = esp_random();
+    }
+    for (uint32_t loop = 0; loop < info->self_net_segment_num; loop++) {
+        info->self_net_segment[loop] = esp_random();
+    }
+}
+
+TEST_CASE("host: litemesh IE parser survives random IEs", "[gateway]")
+{
+    esp_litemesh_ie_view_t view;
+    uint32_t parsed = 0;
+
+    esp_mock_random_seed(0x11E5EED);
+    for (uint32_t loop = 0; loop < TEST_FUZZ_ITERATIONS; loop++) {
+        vendor_ie_data_t* ie = test_fuzz_ie_alloc(esp_random() & 0xFF);
+
+        for (uint32_t index = 0; index + ESP_LITEMESH_IE_OUI_LEN < ie->length; index++) {
+            ie->payload[index] = esp_random();
+        }
+        /* Mostly known versions, and short TLVs so that some of them end exactly at the end of the IE */
+        if (ie->length > ESP_LITEMESH_IE_OUI_LEN) {
+            ie->payload[0] = esp_random() % 4;
+        }
+        for (uint32_t index = 3; index + ESP_LITEMESH_IE_OUI_LEN < ie->length; index += 2 + ie->payload[index]) {
+            if (esp_random() & 1) {
+                ie->payload[index] %= 8;
+            }
+        }
+
+        if (esp_litemesh_ie_parse(ie, &view) == ESP_OK) {
+            test_fuzz_check_view(ie, &view);
+            parsed++;
+        }
+        free(ie);
+    }
+
+    /* The fixed layout of version 1 and the TLVs both got through */
+    TEST_ASSERT_GREATER_THAN(TEST_FUZZ_ITERATIONS / 100, parsed);
+}
+
+TEST_CASE("host: litemesh IE parser survives mutated and truncated IEs", "[gateway]")
+{
+    uint8_t buffer[2 + 255];
+    vendor_ie_data_t* valid = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+
+    esp_mock_random_seed(0x5EED);
+    for (uint32_t loop = 0; loop < TEST_FUZZ_ITERATIONS; loop++) {
+        test_fuzz_random_info(&info, ESP_LITEMESH_IE_VERSION_1 + (loop & 1));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, valid, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+
+        /* Truncate, then flip some bytes */
+        uint8_t length = valid->length - (esp_random() % (valid->length + 1));
+        vendor_ie_data_t* ie = test_fuzz_ie_alloc(length);
+        memcpy(ie->payload, valid->payload, (length > ESP_LITEMESH_IE_OUI_LEN) ? (length - ESP_LITEMESH_IE_OUI_LEN) : 0);
+        for (uint32_t flip = esp_random() % 3; (flip > 0) && (length > ESP_LITEMESH_IE_OUI_LEN); flip--) {
+            ie->payload[esp_random() % (length - ESP_LITEMESH_IE_OUI_LEN)] ^= 1 << (esp_random() % 8);
+        }
+
+        if (esp_litemesh_ie_parse(ie, &view) == ESP_OK) {
+            test_fuzz_check_view(ie, &view);
+        }
+        free(ie);
+    }
+}
+
+TEST_CASE("host: litemesh IE round trip of random node information", "[gateway]")
+{
+    uint8_t buffer[2 + 255];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+
+    esp_mock_random_seed(0xC0DEC);
+    for (uint32_t loop = 0; loop < TEST_FUZZ_ITERATIONS; loop++) {
+        test_fuzz_random_info(&info, ESP_LITEMESH_IE_VERSION_1 + (loop & 1));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+
+        TEST_ASSERT_EQUAL(info.version, view.version);
+        TEST_ASSERT_EQUAL(info.max_connection, view.max_connection);
+        TEST_ASSERT_EQUAL(info.connected_station_number, view.connected_station_number);
+        TEST_ASSERT_EQUAL(info.connect_router_status, view.connect_router_status);
+        TEST_ASSERT_EQUAL(info.level, view.level);
+        TEST_ASSERT_TRUE(esp_litemesh_ie_ssid_match(&view, info.router_ssid, info.router_ssid_len));
+        TEST_ASSERT_EQUAL(info.router_number, view.router_number);
+        TEST_ASSERT_EQUAL(info.inherited_netif_number + info.self_net_segment_num, view.inherited_netif_number);
+        TEST_ASSERT_EQUAL((info.version == ESP_LITEMESH_IE_VERSION_1) ? 0 : info.uplink_quality, view.uplink_quality);
+        /* Version 2 leaves the empty lists out */
+        if (view.router_number) {
+            TEST_ASSERT_EQUAL_MEMORY(info.router_net_segment, view.router_net_segment, info.router_number);
+        }
+        if (view.inherited_netif_number) {
+            TEST_ASSERT_EQUAL_MEMORY(info.inherited_net_segment, view.inherited_net_segment, info.inherited_netif_number);
+            TEST_ASSERT_EQUAL_MEMORY(info.self_net_segment, view.inherited_net_segment + info.inherited_netif_number, info.self_net_segment_num);
+        }
+    }
+}
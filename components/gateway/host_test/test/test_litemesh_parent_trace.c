@@ -0,0 +1,150 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_litemesh_parent.h"
+
+/*
+ * Replay of a beacon trace through the parent selector, with the configuration of the firmware.
+ *
+ * The trace is the debug log of the "vendor_ie" tag, other lines are skipped:
+ *   beacon <ms> <bssid> <level> <stations>/<max stations> <uplink quality> <rssi>
+ *   join <ms> <bssid>
+ * A join line is the parent chosen by the node at the end of a scan, the replay checks that it chooses the same.
+ * The replay switches parent as soon as the selector decides to, the node rejoins the same candidate after a scan.
+ */
+#define TEST_TRACE_FILE             GATEWAY_HOST_TEST_DATA_DIR "/litemesh_parent_trace.log"
+#define TEST_TRACE_MAX_DECISIONS    (16)
+
+typedef struct {
+    uint32_t time;
+    bool join;
+    uint8_t bssid[6];
+} test_trace_decision_t;
+
+static uint32_t test_trace_replay(const char* path, test_trace_decision_t* decisions, uint32_t max_decisions)
+{
+    esp_litemesh_parent_selector_config_t config = {
+        .rssi_smoothing = 2,
+        .hysteresis = CONFIG_LITEMESH_PARENT_SWITCH_HYSTERESIS,
+        .min_dwell_ms = CONFIG_LITEMESH_PARENT_MIN_DWELL_MS,
+        .max_age_ms = 10000,
+    };
+    esp_litemesh_parent_selector_t* selector = esp_litemesh_parent_selector_create(&config);
+    FILE* trace = fopen(path, "r");
+    char line[160];
+    uint32_t num = 0;
+    uint32_t beacons = 0;
+    uint8_t level = 0;
+
+    TEST_ASSERT_NOT_NULL(selector);
+    TEST_ASSERT_NOT_NULL_MESSAGE(trace, path);
+    memset(decisions, 0, max_decisions * sizeof(decisions[0]));
+
+    while (fgets(line, sizeof(line), trace)) {
+        esp_litemesh_parent_t beacon;
+        esp_litemesh_parent_t chosen;
+        unsigned int mac[6];
+        unsigned int beacon_level, stations, max_connection, uplink_quality;
+        unsigned int now;
+        int rssi;
+        const char* event = NULL;
+
+        memset(&beacon, 0, sizeof(beacon));
+        if ((event = strstr(line, "beacon ")) != NULL) {
+            TEST_ASSERT_EQUAL_MESSAGE(12, sscanf(event, "beacon %u %x:%x:%x:%x:%x:%x %u %u/%u %u %d", &now, &mac[0], &mac[1], &mac[2],
+                                                 &mac[3], &mac[4], &mac[5], &beacon_level, &stations, &max_connection,
+                                                 &uplink_quality, &rssi), line);
+            for (uint32_t loop = 0; loop < 6; loop++) {
+                beacon.bssid[loop] = mac[loop];
+            }
+            beacon.level = beacon_level;
+            beacon.connected_station_number = stations;
+            beacon.max_connection = max_connection;
+            beacon.uplink_quality = uplink_quality;
+            beacon.rssi = rssi;
+            esp_litemesh_parent_selector_update(selector, &beacon, now);
+            beacons++;
+
+            if (level && esp_litemesh_parent_selector_should_switch(selector, now, level, &chosen)) {
+                TEST_ASSERT_LESS_THAN(max_decisions, num);
+                decisions[num].time = now;
+                decisions[num].join = false;
+                memcpy(decisions[num].bssid, chosen.bssid, 6);
+                num++;
+                esp_litemesh_parent_selector_set_parent(selector, chosen.bssid, now);
+                level = chosen.level + 1;
+            }
+        } else if ((event = strstr(line, "join ")) != NULL) {
+            TEST_ASSERT_EQUAL_MESSAGE(7, sscanf(event, "join %u %x:%x:%x:%x:%x:%x", &now, &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]), line);
+            for (uint32_t loop = 0; loop < 6; loop++) {
+                beacon.bssid[loop] = mac[loop];
+            }
+            TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_best(selector, now, &chosen));
+            TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(beacon.bssid, chosen.bssid, 6, line);
+
+            TEST_ASSERT_LESS_THAN(max_decisions, num);
+            decisions[num].time = now;
+            decisions[num].join = true;
+            memcpy(decisions[num].bssid, chosen.bssid, 6);
+            num++;
+            esp_litemesh_parent_selector_set_parent(selector, chosen.bssid, now);
+            level = chosen.level + 1;
+        }
+    }
+
+    fclose(trace);
+    esp_litemesh_parent_selector_delete(selector);
+    TEST_ASSERT_GREATER_THAN(0, beacons);
+
+    return num;
+}
+
+TEST_CASE("host: litemesh parent decisions replayed from a beacon trace", "[gateway]")
+{
+    /*
+     * 0b is chosen at the first scan. 0a gets better at 20 s but is only joined when the dwell time is over,
+     * the single strong samples of 0a and the swings of 0b meanwhile change nothing. 0b is joined back 7.5 s
+     * after 0a fades, once the smoothed RSSI crossed the hysteresis.
+     */
+    const test_trace_decision_t expected[] = {
+        { 2000, true, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0b } },
+        { 32000, false, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0a } },
+        { 34000, true, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0a } },
+        { 77500, false, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0b } },
+        { 80000, true, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0b } },
+    };
+    test_trace_decision_t decisions[TEST_TRACE_MAX_DECISIONS];
+    test_trace_decision_t again[TEST_TRACE_MAX_DECISIONS];
+    uint32_t num = test_trace_replay(TEST_TRACE_FILE, decisions, TEST_TRACE_MAX_DECISIONS);
+
+    TEST_ASSERT_EQUAL(sizeof(expected) / sizeof(expected[0]), num);
+    for (uint32_t loop = 0; loop < num; loop++) {
+        TEST_ASSERT_EQUAL(expected[loop].time, decisions[loop].time);
+        TEST_ASSERT_EQUAL(expected[loop].join, decisions[loop].join);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[loop].bssid, decisions[loop].bssid, 6);
+        if ((loop > 0) && !decisions[loop].join) {
+            TEST_ASSERT_GREATER_OR_EQUAL(CONFIG_LITEMESH_PARENT_MIN_DWELL_MS, decisions[loop].time - decisions[loop - 1].time);
+        }
+    }
+
+    /* Nothing but the trace drives the decisions */
+    TEST_ASSERT_EQUAL(num, test_trace_replay(TEST_TRACE_FILE, again, TEST_TRACE_MAX_DECISIONS));
+    TEST_ASSERT_EQUAL_MEMORY(decisions, again, num * sizeof(decisions[0]));
+}
@@ -0,0 +1,92 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Subset of Unity for running the component tests of ../test on the host. TEST_CASE() registers the
+ * test at startup, a failed assertion ends the test and the runner goes on with the next one.
+ */
+
+typedef void (*unity_test_func_t)(void);
+
+void unity_host_register(const char* name, const char* desc, unity_test_func_t func, const char* file, int line);
+
+void unity_host_fail(const char* file, int line, const char* fmt, ...) __attribute__((noreturn, format(printf, 3, 4)));
+
+#define UNITY_HOST_CAT_(a, b) a##b
+#define UNITY_HOST_CAT(a, b) UNITY_HOST_CAT_(a, b)
+
+#define TEST_CASE(name_, desc_)                                                                         \
+    static void UNITY_HOST_CAT(unity_test_, __LINE__)(void);                                            \
+    __attribute__((constructor)) static void UNITY_HOST_CAT(unity_register_, __LINE__)(void)            \
+    {                                                                                                   \
+        unity_host_register(name_, desc_, &UNITY_HOST_CAT(unity_test_, __LINE__), __FILE__, __LINE__);  \
+    }                                                                                                   \
+    static void UNITY_HOST_CAT(unity_test_, __LINE__)(void)
+
+#define TEST_FAIL_MESSAGE(msg) unity_host_fail(__FILE__, __LINE__, "%s", msg)
+#define TEST_ASSERT_MESSAGE(cond, msg) do { if (!(cond)) unity_host_fail(__FILE__, __LINE__, "%s", msg); } while (0)
+#define TEST_ASSERT(cond) do { if (!(cond)) unity_host_fail(__FILE__, __LINE__, "Expected %s", #cond); } while (0)
+#define TEST_ASSERT_TRUE(cond) TEST_ASSERT(cond)
+#define TEST_ASSERT_FALSE(cond) TEST_ASSERT(!(cond))
+#define TEST_ASSERT_NULL(ptr) TEST_ASSERT((ptr) == NULL)
+#define TEST_ASSERT_NOT_NULL(ptr) TEST_ASSERT((ptr) != NULL)
+
+#define TEST_ASSERT_EQUAL(expected, actual) do {                                                        \
+        long long unity_e_ = (long long)(expected), unity_a_ = (long long)(actual);                     \
+        if (unity_e_ != unity_a_) {                                                                     \
+            unity_host_fail(__FILE__, __LINE__, "Expected %lld Was %lld", unity_e_, unity_a_);          \
+        }                                                                                               \
+    } while (0)
+
+#define TEST_ASSERT_NOT_EQUAL(expected, actual) do {                                                    \
+        if ((long long)(expected) == (long long)(actual)) {                                             \
+            unity_host_fail(__FILE__, __LINE__, "Expected Not-Equal %s", #actual);                      \
+        }                                                                                               \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_INT(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_UINT8(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_UINT16(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_UINT32(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_HEX8(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_HEX16(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_HEX32(expected, actual) TEST_ASSERT_EQUAL(expected, actual)
+#define TEST_ASSERT_EQUAL_PTR(expected, actual) TEST_ASSERT((const void*)(expected) == (const void*)(actual))
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) TEST_ASSERT(strcmp((expected), (actual)) == 0)
+#define TEST_ASSERT_EQUAL_MEMORY(expected, actual, len) TEST_ASSERT(memcmp((expected), (actual), (len)) == 0)
+#define TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, actual, num) TEST_ASSERT_EQUAL_MEMORY(expected, actual, num)
+#define TEST_ASSERT_NOT_NULL_MESSAGE(ptr, msg) TEST_ASSERT_MESSAGE((ptr) != NULL, msg)
+#define TEST_ASSERT_EQUAL_MESSAGE(expected, actual, msg) TEST_ASSERT_MESSAGE((expected) == (actual), msg)
+#define TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, actual, num, msg) TEST_ASSERT_MESSAGE(memcmp((expected), (actual), (num)) == 0, msg)
+
+#define TEST_ASSERT_GREATER_THAN(threshold, actual) TEST_ASSERT((actual) > (threshold))
+#define TEST_ASSERT_GREATER_OR_EQUAL(threshold, actual) TEST_ASSERT((actual) >= (threshold))
+#define TEST_ASSERT_LESS_THAN(threshold, actual) TEST_ASSERT((actual) < (threshold))
+#define TEST_ASSERT_LESS_OR_EQUAL(threshold, actual) TEST_ASSERT((actual) <= (threshold))
+#define TEST_ASSERT_UINT32_WITHIN(delta, expected, actual) \
+    TEST_ASSERT(((actual) >= (expected) ? (actual) - (expected) : (expected) - (actual)) <= (delta))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "unity.h"
+#include "esp_log.h"
+
+#define UNITY_HOST_MAX_TESTS    (256)
+
+typedef struct {
+    const char* name;
+    const char* desc;
+    unity_test_func_t func;
+    const char* file;
+    int line;
+} unity_host_test_t;
+
+static unity_host_test_t s_tests[UNITY_HOST_MAX_TESTS];
+static int s_test_num = 0;
+static jmp_buf s_test_abort;
+
+void unity_host_register(const char* name, const char* desc, unity_test_func_t func, const char* file, int line)
+{
+    if (s_test_num < UNITY_HOST_MAX_TESTS) {
+        s_tests[s_test_num++] = (unity_host_test_t) {
+            .name = name, .desc = desc, .func = func, .file = file, .line = line
+        };
+    }
+}
+
+void unity_host_fail(const char* file, int line, const char* fmt, ...)
+{
+    va_list args;
+
+    printf("%s:%d:FAIL: ", file, line);
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+    longjmp(s_test_abort, 1);
+}
+
+/* Usage: gateway_host_test [name filter], the tests whose name contains the filter are run */
+int main(int argc, char** argv)
+{
+    const char* filter = (argc > 1) ? argv[1] : NULL;
+    int run = 0;
+    int failures = 0;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    for (int loop = 0; loop < s_test_num; loop++) {
+        if (filter && !strstr(s_tests[loop].name, filter)) {
+            continue;
+        }
+
+        printf("Running %s...\n", s_tests[loop].name);
+        fflush(stdout);
+        run++;
+        if (setjmp(s_test_abort) == 0) {
+            s_tests[loop].func();
+            printf("%s:%d:%s:PASS\n", s_tests[loop].file, s_tests[loop].line, s_tests[loop].name);
+        } else {
+            failures++;
+        }
+    }
+
+    printf("-----------------------\n%d Tests %d Failures 0 Ignored\n%s\n", run, failures, failures ? "FAIL" : "OK");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
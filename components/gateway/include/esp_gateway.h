@@ -134,6 +134,420 @@ esp_err_t esp_gateway_wifi_set_config_into_ram(wifi_interface_t interface, wifi_
 
 #if defined(CONFIG_LITEMESH_ENABLE)
 void esp_litemesh_connect(void);
+
+/**
+* @brief LiteMesh vendor IE statistics
+*
+*/
+typedef struct {
+    uint32_t requests;          /*!< IE updates requested by the Wi-Fi and IP events and the parent beacons */
+    uint32_t skipped;           /*!< Requests which did not change the IE on the air or waiting */
+    uint32_t coalesced;         /*!< Changes merged into an IE update already waiting, or reverted before it */
+    uint32_t rebuilds;          /*!< IEs handed to the Wi-Fi driver */
+    uint64_t update_time_us;    /*!< Time spent encoding and comparing the IE of the requests */
+    uint64_t publish_time_us;   /*!< Time spent in the Wi-Fi driver to replace the IE */
+} esp_litemesh_ie_stats_t;
+
+/**
+* @brief Get the statistics of the LiteMesh vendor IE updates.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_ie_stats(esp_litemesh_ie_stats_t* stats);
+
+#define ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN     (0)     /*!< The node does not advertise its uplink quality */
+#define ESP_LITEMESH_UPLINK_QUALITY_MAX         (100)
+#define ESP_LITEMESH_ROOT_LOAD_UNKNOWN          (0xFF)  /*!< The node does not advertise the load of its root */
+#define ESP_LITEMESH_ROOT_LOAD_MAX              (100)
+
+/**
+* @brief A LiteMesh node heard in the beacons, candidate to be the parent
+*
+*/
+typedef struct {
+    uint8_t bssid[6];                   /*!< SoftAP MAC of the node */
+    uint8_t channel;                    /*!< Channel the node was heard on */
+    uint8_t level;                      /*!< Level of the node, 1 for a node connected to the router */
+    int8_t rssi;                        /*!< Smoothed RSSI of the beacons of the node */
+    uint8_t connected_station_number;   /*!< Stations of the node, without this node when it is the parent */
+    uint8_t max_connection;             /*!< Maximum number of stations of the node */
+    uint8_t uplink_quality;             /*!< Quality of the path of the node to the router, from 1 to ESP_LITEMESH_UPLINK_QUALITY_MAX */
+    uint8_t root_load;                  /*!< Load of the root the node reaches the router through, from 0 to ESP_LITEMESH_ROOT_LOAD_MAX */
+    uint32_t path_rtt_us;               /*!< RTT of the path of the node to the router */
+    uint32_t path_kbps;                 /*!< Throughput of the path of the node to the router, 0 when not advertised */
+} esp_litemesh_parent_t;
+
+/**
+* @brief Weights of the terms of esp_litemesh_parent_default_score()
+*
+*/
+typedef struct {
+    uint8_t level;              /*!< Weight of 100 / level */
+    uint8_t rssi;               /*!< Weight of the RSSI, -90 dBm to -40 dBm mapped to 0 to 100 */
+    uint8_t load;               /*!< Weight of the free stations of the node, in percent */
+    uint8_t uplink;             /*!< Weight of the uplink quality, an unknown quality counts as 50 */
+    uint8_t root_load;          /*!< Weight of the free share of the root, 100 - root load, an unknown load counts as 50 */
+    uint8_t path;               /*!< Weight of the measured path, the mean of 100 - RTT in ms / 2 and kbit/s / 200 up to 100,
+                                     an unknown path counts as 50 */
+} esp_litemesh_parent_weights_t;
+
+/**
+* @brief Score of a candidate parent, the higher the better.
+*
+* @note It is called with the candidates locked, it must be short and must not block.
+*
+* @param[in] parent: candidate parent
+* @param[in] arg: argument given to esp_litemesh_set_parent_score()
+*
+* @return score of parent
+*/
+typedef int32_t (*esp_litemesh_parent_score_t)(const esp_litemesh_parent_t* parent, void* arg);
+
+/**
+* @brief The default score of a candidate parent, the weighted sum of its level, RSSI, load, uplink quality,
+*        root load and measured path.
+*
+* @param[in] parent: candidate parent
+* @param[in] arg: esp_litemesh_parent_weights_t, NULL for the weights of the configuration
+*
+* @return score of parent, from 0 to 100 times the sum of the weights
+*/
+int32_t esp_litemesh_parent_default_score(const esp_litemesh_parent_t* parent, void* arg);
+
+/**
+* @brief Replace the score of the candidate parents. The node joins the candidate with the highest score,
+*        and leaves its parent for a candidate scoring CONFIG_LITEMESH_PARENT_SWITCH_HYSTERESIS more.
+*
+* @param[in] score: score function, NULL for esp_litemesh_parent_default_score()
+* @param[in] arg: argument of score
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_set_parent_score(esp_litemesh_parent_score_t score, void* arg);
+
+/**
+* @brief Scans of a LiteMesh node looking for a parent
+*
+*/
+typedef struct {
+    bool channel_pin;           /*!< Scan the channel of the last association first, all the channels only when nothing is heard on it */
+    bool passive;               /*!< Listen to the beacons in single channel scans instead of sending probe requests */
+    uint32_t channel_dwell_ms;  /*!< Time of a single channel scan */
+    uint32_t full_dwell_ms;     /*!< Time per channel of a scan of all the channels, 0 for the default of the Wi-Fi driver */
+} esp_litemesh_scan_config_t;
+
+/**
+* @brief LiteMesh scan statistics
+*
+*/
+typedef struct {
+    uint32_t pinned_scans;      /*!< Scans of the channel of the last association */
+    uint32_t pinned_hits;       /*!< Of them, the scans which heard the router or a LiteMesh node */
+    uint32_t full_scans;        /*!< Scans of all the channels */
+    uint32_t channel_scans;     /*!< Scans of the channel of the best candidate, after a scan of all the channels */
+    uint32_t scan_time_ms;      /*!< Time spent scanning */
+    uint32_t connect_time_ms;   /*!< From the start of LiteMesh to the first IP, 0 until then */
+    uint32_t rejoin_time_ms;    /*!< From the last loss of the uplink to the IP got back, 0 until then */
+    uint8_t stored_channel;     /*!< Channel of the last association kept in NVS, 0 when none */
+} esp_litemesh_scan_stats_t;
+
+/**
+* @brief Set the scans of the node, they apply from the next scan.
+*
+* @param[in] config: scan configuration
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: config is NULL or channel_dwell_ms is 0
+*/
+esp_err_t esp_litemesh_set_scan_config(const esp_litemesh_scan_config_t* config);
+
+/**
+* @brief Get the scans of the node, initially those of the configuration.
+*
+* @param[out] config: scan configuration
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: config is NULL
+*/
+esp_err_t esp_litemesh_get_scan_config(esp_litemesh_scan_config_t* config);
+
+/**
+* @brief Get the statistics of the LiteMesh scans.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_scan_stats(esp_litemesh_scan_stats_t* stats);
+
+#if defined(CONFIG_LITEMESH_MULTI_ROOT)
+/**
+* @brief LiteMesh tree statistics
+*
+*/
+typedef struct {
+    uint32_t subtree_nodes;     /*!< Nodes of the subtree of this node, this node included */
+    uint32_t children;          /*!< Children whose subtree is counted */
+    uint32_t foreign_segments;  /*!< Segments of the roots of the other trees kept away from, at a root */
+    uint32_t splits;            /*!< Times this node joined the router because the trees heard were loaded */
+    uint8_t root_load;          /*!< Load of the root of the tree, as published, ESP_LITEMESH_ROOT_LOAD_UNKNOWN out of the mesh */
+    bool root;                  /*!< This node is connected to the router */
+} esp_litemesh_tree_stats_t;
+
+/**
+* @brief Set the load of the uplink of the node, e.g. from the traffic to the router. A root publishes the
+*        highest of this load and of the share of CONFIG_LITEMESH_ROOT_CAPACITY its tree takes.
+*
+* @param[in] percent: load, from 0 to ESP_LITEMESH_ROOT_LOAD_MAX
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: percent is over ESP_LITEMESH_ROOT_LOAD_MAX
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_set_uplink_load(uint8_t percent);
+
+/**
+* @brief Get the statistics of the LiteMesh tree of the node.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_tree_stats(esp_litemesh_tree_stats_t* stats);
+#endif
+
+#if defined(CONFIG_LITEMESH_BCAST_FILTER)
+/**
+* @brief LiteMesh SoftAP broadcast filter statistics
+*
+*/
+typedef struct {
+    uint32_t neighbours;        /*!< Stations in the proxy ARP cache */
+    uint32_t arp_requests;      /*!< Broadcast ARP requests received on the SoftAP */
+    uint32_t arp_answered;      /*!< Of them, the ones answered by the node for a known station */
+    uint32_t duplicates;        /*!< Broadcast and multicast frames dropped as repeats */
+    uint32_t rate_limited;      /*!< Broadcast and multicast frames dropped over the rate limit */
+    uint32_t suppressed_bytes;  /*!< Length of the frames answered or dropped */
+    uint64_t airtime_saved_us;  /*!< Estimated airtime of those frames at the broadcast rate */
+} esp_litemesh_bcast_stats_t;
+
+/**
+* @brief Get the statistics of the proxy ARP and broadcast suppression of the SoftAP.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_bcast_stats(esp_litemesh_bcast_stats_t* stats);
+#endif
+
+#if defined(CONFIG_LITEMESH_PATH_METRICS)
+/**
+* @brief LiteMesh path metrics, measured by the node to its gateway and added to the path of its parent
+*
+*/
+typedef struct {
+    uint32_t link_rtt_us;       /*!< Smoothed RTT of the small probes to the gateway, the parent or the router */
+    uint32_t link_kbps;         /*!< Throughput estimated from the probes of two sizes */
+    uint32_t path_rtt_us;       /*!< RTT of the path to the router, as advertised */
+    uint32_t path_kbps;         /*!< Bottleneck throughput of the path to the router, as advertised */
+    uint32_t probes;            /*!< Probes answered */
+    uint32_t losses;            /*!< Probes not answered */
+    bool valid;                 /*!< The path is known, the other fields but the counters are 0 otherwise */
+} esp_litemesh_path_stats_t;
+
+/**
+* @brief Get the path metrics of the node.
+*
+* @param[out] stats: path metrics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_path_stats(esp_litemesh_path_stats_t* stats);
+#endif
+
+#if defined(CONFIG_LITEMESH_ROUTED)
+/**
+* @brief LiteMesh route statistics
+*
+*/
+typedef struct {
+    uint32_t children;          /*!< Children with routes */
+    uint32_t routes;            /*!< Segments of the subtree, routed to the children */
+    uint32_t lookups;           /*!< Route lookups of forwarded packets */
+    uint32_t hits;              /*!< Lookups which found a child */
+    uint32_t conflicts;         /*!< Segments announced by a child while routed to another one */
+    uint32_t expirations;       /*!< Children whose routes expired */
+    uint32_t renumbers;         /*!< Segments of this node found in use elsewhere in the mesh, moved */
+    bool root;                  /*!< This node translates the mesh to the router */
+} esp_litemesh_route_stats_t;
+
+/**
+* @brief Get the statistics of the LiteMesh routes.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: LiteMesh is not started yet
+*/
+esp_err_t esp_litemesh_get_route_stats(esp_litemesh_route_stats_t* stats);
+#endif
+#endif
+
+#if defined(CONFIG_GATEWAY_NAPT_ENGINE)
+/**
+* @brief NAPT engine statistics
+*
+*/
+typedef struct {
+    uint32_t capacity;          /*!< Maximum number of flows */
+    uint32_t active;            /*!< Number of flows in the table */
+    uint32_t lookups;           /*!< Table lookups of forwarded packets */
+    uint32_t hits;              /*!< Lookups which found a flow, hits * 100 / lookups is the hit rate */
+    uint32_t inserts;           /*!< New flows */
+    uint32_t insert_failures;   /*!< New flows refused because no outside port was free */
+    uint32_t evictions;         /*!< Live flows dropped because the table was full */
+    uint32_t expirations;       /*!< Flows dropped after their idle timeout */
+} esp_gateway_napt_stats_t;
+
+/**
+* @brief Get the statistics of the gateway NAPT engine.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: the NAPT engine is not started yet
+*/
+esp_err_t esp_gateway_napt_get_stats(esp_gateway_napt_stats_t* stats);
+#endif
+
+#if defined(CONFIG_GATEWAY_FAST_PATH)
+/**
+* @brief Fast path statistics
+*
+*/
+typedef struct {
+    uint32_t capacity;          /*!< Maximum number of flows in the cache */
+    uint32_t fast_packets;      /*!< TCP and UDP packets forwarded by the fast path */
+    uint32_t slow_packets;      /*!< TCP and UDP packets which went through the stack */
+    uint32_t learns;            /*!< Flows learned */
+    uint32_t replacements;      /*!< Live flows replaced by a new one */
+    uint32_t flushes;           /*!< Invalidations of the whole cache */
+} esp_gateway_fast_path_stats_t;
+
+/**
+* @brief Get the statistics of the gateway fast path.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: the fast path is not started yet
+*/
+esp_err_t esp_gateway_fast_path_get_stats(esp_gateway_fast_path_stats_t* stats);
+#endif
+
+#if defined(CONFIG_GATEWAY_MULTI_WAN)
+/**
+* @brief Multi-WAN statistics of an uplink
+*
+*/
+typedef struct {
+    esp_netif_t* netif;         /*!< External netif of the uplink */
+    uint8_t weight;             /*!< Share of the new flows */
+    bool usable;                /*!< Link up and probes answered */
+    uint32_t rtt_ms;            /*!< Smoothed round trip time of the probes */
+    uint32_t flows;             /*!< New flows assigned to the uplink */
+    uint32_t probes;            /*!< Probes sent */
+    uint32_t probes_lost;       /*!< Probes not answered */
+    uint32_t failovers;         /*!< Times the uplink became unusable */
+    uint32_t too_big;           /*!< Packets larger than the MTU of the uplink, which could not be fragmented */
+} esp_gateway_multi_wan_uplink_stats_t;
+
+/**
+* @brief Set the share of the new flows of an external netif, from 1 to 16. The flows already opened stay on their uplink.
+*
+* @param[in] netif: external netif
+* @param[in] weight: share of the new flows
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: invalid weight
+*      - ESP_ERR_NOT_FOUND: the netif is not an uplink
+*/
+esp_err_t esp_gateway_multi_wan_set_weight(esp_netif_t* netif, uint8_t weight);
+
+/**
+* @brief Get the multi-WAN statistics of the uplinks.
+*
+* @param[out] stats: statistics of each uplink
+* @param[inout] num: size of stats, and the number of uplinks on return
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats or num is NULL
+*      - ESP_ERR_INVALID_STATE: no uplink was added yet
+*/
+esp_err_t esp_gateway_multi_wan_get_stats(esp_gateway_multi_wan_uplink_stats_t* stats, uint32_t* num);
+#endif
+
+#if defined(CONFIG_GATEWAY_DNS_PROXY)
+/**
+* @brief DNS proxy statistics, the hit rate is (hits + negative_hits) / queries
+*
+*/
+typedef struct {
+    uint32_t queries;           /*!< Client queries */
+    uint32_t hits;              /*!< Queries answered with a cached answer */
+    uint32_t negative_hits;     /*!< Queries answered with a cached name error or empty answer */
+    uint32_t coalesced;         /*!< Queries joined to an identical query already sent upstream */
+    uint32_t evictions;         /*!< Live answers dropped to make room */
+    uint32_t upstream_queries;  /*!< Queries sent to the upstream servers, retries included */
+    uint32_t upstream_answers;  /*!< Upstream answers forwarded to the clients */
+    uint32_t upstream_timeouts; /*!< Queries given up after the last attempt */
+    uint32_t failures;          /*!< Server failures sent to the clients */
+    uint32_t latency_avg_ms;    /*!< Average time from the client query to the upstream answer */
+    uint32_t latency_max_ms;    /*!< Maximum time from the client query to the upstream answer */
+} esp_gateway_dns_proxy_stats_t;
+
+/**
+* @brief Get the statistics of the gateway DNS proxy.
+*
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK
+*      - ESP_ERR_INVALID_ARG: stats is NULL
+*      - ESP_ERR_INVALID_STATE: the DNS proxy is not started yet
+*/
+esp_err_t esp_gateway_dns_proxy_get_stats(esp_gateway_dns_proxy_stats_t* stats);
 #endif
 
 /**
@@ -0,0 +1,254 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_DNS_HEADER_LEN          (12)
+#define ESP_GATEWAY_DNS_MAX_MSG_LEN         (512)   /*!< Largest message forwarded over UDP */
+#define ESP_GATEWAY_DNS_MAX_NAME_LEN        (255)
+#define ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS (4)     /*!< Clients waiting for the same upstream answer */
+
+#define ESP_GATEWAY_DNS_RCODE_NOERROR       (0)
+#define ESP_GATEWAY_DNS_RCODE_SERVFAIL      (2)
+#define ESP_GATEWAY_DNS_RCODE_NXDOMAIN      (3)
+
+/**
+ * @brief DNS cache configuration
+ *
+ */
+typedef struct {
+    uint32_t capacity;              /*!< Maximum number of cached answers */
+    uint32_t pending_capacity;      /*!< Maximum number of questions waiting for the upstream server */
+    uint32_t min_ttl_s;             /*!< Answers are kept at least this long */
+    uint32_t max_ttl_s;             /*!< Answers are kept at most this long */
+    uint32_t negative_ttl_s;        /*!< Maximum time a name error or an empty answer is kept */
+    uint32_t seed;                  /*!< Seed of the upstream query IDs, use a random value */
+} esp_gateway_dns_cache_config_t;
+
+/**
+ * @brief Question of a DNS message
+ *
+ */
+typedef struct {
+    uint16_t id;                                    /*!< ID of the message */
+    uint16_t qtype;
+    uint16_t qclass;
+    uint16_t end;                                   /*!< Offset of the end of the question section */
+    uint8_t name_len;                               /*!< Length of name */
+    uint8_t name[ESP_GATEWAY_DNS_MAX_NAME_LEN];     /*!< Lower case name, in wire format */
+} esp_gateway_dns_question_t;
+
+/**
+ * @brief Client waiting for an answer. Address and port are in network byte order.
+ *
+ */
+typedef struct {
+    uint32_t addr;
+    uint16_t port;
+    uint16_t id;            /*!< ID of the client query */
+} esp_gateway_dns_client_t;
+
+/**
+ * @brief Question sent to the upstream server
+ *
+ */
+typedef struct {
+    esp_gateway_dns_question_t question;
+    uint16_t upstream_id;                                               /*!< ID of the upstream query */
+    uint8_t attempts;                                                   /*!< Number of times the question was sent */
+    uint8_t client_num;
+    uint32_t start_ms;                                                  /*!< Time of the first client query */
+    uint32_t sent_ms;                                                   /*!< Time of the last upstream query */
+    uint32_t server;                                                    /*!< Address of the last upstream server, set by the caller */
+    esp_gateway_dns_client_t clients[ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS];
+} esp_gateway_dns_pending_t;
+
+/**
+ * @brief DNS cache statistics
+ *
+ */
+typedef struct {
+    uint32_t lookups;           /*!< Client queries looked up */
+    uint32_t hits;              /*!< Queries answered with a cached answer */
+    uint32_t negative_hits;     /*!< Queries answered with a cached name error or empty answer */
+    uint32_t inserts;           /*!< Answers cached */
+    uint32_t evictions;         /*!< Live answers dropped to make room */
+    uint32_t coalesced;         /*!< Queries joined to an identical question already sent upstream */
+} esp_gateway_dns_cache_stats_t;
+
+typedef struct esp_gateway_dns_cache esp_gateway_dns_cache_t;
+
+/**
+ * @brief  Create a DNS cache.
+ *
+ * @note The cache is not locked, it is meant to be used by the DNS proxy task only.
+ *
+ * @param[in]  config cache configuration
+ *
+ * @return
+ *     - instance: create cache successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_gateway_dns_cache_t* esp_gateway_dns_cache_create(const esp_gateway_dns_cache_config_t* config);
+
+/**
+ * @brief  Delete a DNS cache.
+ *
+ * @param[in]  cache cache instance
+ */
+void esp_gateway_dns_cache_delete(esp_gateway_dns_cache_t* cache);
+
+/**
+ * @brief  Parse the question of a standard query or of its response.
+ *
+ * @param[in]   msg DNS message
+ * @param[in]   len length of the message
+ * @param[in]   response whether the message must be a response
+ * @param[out]  question question of the message
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_SIZE: truncated message
+ *     - ESP_ERR_NOT_SUPPORTED: not a standard query with one question
+ */
+esp_err_t esp_gateway_dns_question_parse(const uint8_t* msg, uint32_t len, bool response, esp_gateway_dns_question_t* question);
+
+/**
+ * @brief  Answer a query from the cache.
+ *
+ * @param[in]   cache cache instance
+ * @param[in]   query client query
+ * @param[in]   question question of the query
+ * @param[in]   now current time in milliseconds
+ * @param[out]  response answer, with the ID and the question of the query and the TTLs decreased by the time spent in the cache
+ * @param[in]   size size of the response buffer
+ * @param[out]  len length of the answer
+ *
+ * @return
+ *     - ESP_OK: answered from the cache
+ *     - ESP_ERR_NOT_FOUND: not cached or expired
+ */
+esp_err_t esp_gateway_dns_cache_lookup(esp_gateway_dns_cache_t* cache, const uint8_t* query, const esp_gateway_dns_question_t* question,
+                                       uint32_t now, uint8_t* response, uint32_t size, uint32_t* len);
+
+/**
+ * @brief  Cache an upstream answer, for the smallest TTL of its records.
+ *         Name errors and empty answers are kept for the SOA minimum TTL, bounded by negative_ttl_s.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  question question of the response
+ * @param[in]  response upstream response
+ * @param[in]  len length of the response
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_SUPPORTED: the answer can not be cached, e.g. server failure or truncated answer
+ *     - ESP_ERR_INVALID_SIZE: malformed response
+ *     - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_gateway_dns_cache_insert(esp_gateway_dns_cache_t* cache, const esp_gateway_dns_question_t* question,
+                                       const uint8_t* response, uint32_t len, uint32_t now);
+
+/**
+ * @brief  Register a client waiting for the answer of a question, identical questions share a single upstream query.
+ *
+ * @param[in]   cache cache instance
+ * @param[in]   question question of the client
+ * @param[in]   client client waiting for the answer
+ * @param[in]   now current time in milliseconds
+ * @param[out]  created set when the question is new and has to be sent upstream
+ *
+ * @return
+ *     - pending: the question waiting for the upstream answer
+ *     - NULL: too many questions or clients waiting
+ */
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_get(esp_gateway_dns_cache_t* cache, const esp_gateway_dns_question_t* question,
+                                                             const esp_gateway_dns_client_t* client, uint32_t now, bool* created);
+
+/**
+ * @brief  Find the question of an upstream response.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  upstream_id ID of the upstream response
+ *
+ * @return
+ *     - pending: the question
+ *     - NULL: unknown ID
+ */
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_find(esp_gateway_dns_cache_t* cache, uint16_t upstream_id);
+
+/**
+ * @brief  Find a question the upstream server did not answer in time.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  now current time in milliseconds
+ * @param[in]  timeout_ms time to wait for an upstream answer
+ * @param[out] next_ms time until the next timeout, unchanged if no question is waiting
+ *
+ * @return
+ *     - pending: a question which timed out
+ *     - NULL: none
+ */
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_timeout(esp_gateway_dns_cache_t* cache, uint32_t now, uint32_t timeout_ms, uint32_t* next_ms);
+
+/**
+ * @brief  Prepare a question to be sent again, with a new upstream ID.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  pending question to send again
+ * @param[in]  now current time in milliseconds
+ */
+void esp_gateway_dns_cache_pending_retry(esp_gateway_dns_cache_t* cache, esp_gateway_dns_pending_t* pending, uint32_t now);
+
+/**
+ * @brief  Forget a question once its clients are answered.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  pending question
+ */
+void esp_gateway_dns_cache_pending_remove(esp_gateway_dns_cache_t* cache, esp_gateway_dns_pending_t* pending);
+
+/**
+ * @brief  Build an answer without records, e.g. a server failure.
+ *
+ * @param[in]   query client query
+ * @param[in]   question question of the query
+ * @param[in]   rcode response code
+ * @param[out]  response answer, at least question->end bytes
+ *
+ * @return length of the answer
+ */
+uint32_t esp_gateway_dns_build_error(const uint8_t* query, const esp_gateway_dns_question_t* question, uint8_t rcode, uint8_t* response);
+
+/**
+ * @brief  Get the statistics of the cache.
+ *
+ * @param[in]   cache cache instance
+ * @param[out]  stats statistics
+ */
+void esp_gateway_dns_cache_get_stats(esp_gateway_dns_cache_t* cache, esp_gateway_dns_cache_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,78 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief DNS proxy configuration. Addresses and ports are in network byte order.
+ *
+ */
+typedef struct {
+    uint32_t listen_addr;       /*!< Address the proxy listens on, 0 for all the netifs */
+    uint16_t listen_port;       /*!< Port the proxy listens on */
+    uint32_t upstream_addr;     /*!< Upstream server, 0 to use the DNS servers of the external netifs */
+    uint16_t upstream_port;     /*!< Port of the upstream server */
+    bool any_client;            /*!< Answer the clients outside the data-forwarding subnets as well */
+} esp_gateway_dns_proxy_config_t;
+
+/**
+ * @brief  Default DNS proxy configuration, listening on port 53 of all the netifs for the data-forwarding clients.
+ *
+ * @param[out]  config DNS proxy configuration
+ */
+void esp_gateway_dns_proxy_default_config(esp_gateway_dns_proxy_config_t* config);
+
+/**
+ * @brief  Start the DNS proxy task.
+ *
+ * @param[in]  config DNS proxy configuration, NULL for the default one
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: the proxy is already started
+ *     - ESP_ERR_NO_MEM: Out of memory
+ *     - ESP_FAIL: the sockets can not be opened
+ */
+esp_err_t esp_gateway_dns_proxy_start(const esp_gateway_dns_proxy_config_t* config);
+
+/**
+ * @brief  Stop the DNS proxy task and drop its cache.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: the proxy is not started
+ */
+esp_err_t esp_gateway_dns_proxy_stop(void);
+
+/**
+ * @brief  Whether the DNS proxy is started.
+ *
+ * @return
+ *     - true: started
+ *     - false: not started
+ */
+bool esp_gateway_dns_proxy_is_started(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,172 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "esp_gateway_napt_table.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of flows a flow cache can hold
+ *
+ */
+#define ESP_GATEWAY_FLOW_CACHE_MAX_CAPACITY     (4096)
+
+/**
+ * @brief Flow seen by an ingress netif. Addresses and ports are in network byte order.
+ *
+ */
+typedef struct {
+    const void* inp;        /*!< Ingress netif */
+    uint32_t src_addr;
+    uint32_t dest_addr;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint8_t proto;          /*!< IP protocol, TCP or UDP */
+} esp_gateway_flow_key_t;
+
+/**
+ * @brief Forwarding decision of a flow
+ *
+ */
+typedef struct {
+    esp_gateway_flow_key_t key;
+    void* outp;                             /*!< Egress netif */
+    uint32_t src_addr;                      /*!< Source address after translation */
+    uint32_t dest_addr;                     /*!< Destination address after translation */
+    uint16_t src_port;                      /*!< Source port after translation */
+    uint16_t dest_port;                     /*!< Destination port after translation */
+    uint16_t ip_delta;                      /*!< One's complement difference of the IP header */
+    uint16_t l4_delta;                      /*!< One's complement difference of the TCP/UDP pseudo header and ports */
+    esp_gateway_napt_mapping_t* mapping;    /*!< NAPT mapping to refresh, NULL if the flow is not translated */
+    uint32_t mapping_generation;            /*!< Generation of the NAPT mapping */
+    uint32_t generation;                    /*!< Generation of the cache the flow was learned in */
+} esp_gateway_flow_entry_t;
+
+/**
+ * @brief Flow cache statistics
+ *
+ */
+typedef struct {
+    uint32_t capacity;          /*!< Maximum number of flows */
+    uint32_t hits;              /*!< Lookups which found a flow */
+    uint32_t misses;            /*!< Lookups which found no flow */
+    uint32_t learns;            /*!< Flows learned */
+    uint32_t replacements;      /*!< Live flows replaced by a new one */
+    uint32_t flushes;           /*!< Invalidations of the whole cache */
+} esp_gateway_flow_cache_stats_t;
+
+typedef struct esp_gateway_flow_cache esp_gateway_flow_cache_t;
+
+/**
+ * @brief  Create a flow cache.
+ *
+ * @note Only esp_gateway_flow_cache_flush() may be called from another task than the one using the cache.
+ *
+ * @param[in]  capacity maximum number of flows, rounded up to a power of 2
+ * @param[in]  hash_seed seed of the hash, use a random value
+ *
+ * @return
+ *     - instance: create flow cache successfully
+ *     - NULL: invalid capacity or out of memory
+ */
+esp_gateway_flow_cache_t* esp_gateway_flow_cache_create(uint32_t capacity, uint32_t hash_seed);
+
+/**
+ * @brief  Delete a flow cache.
+ *
+ * @param[in]  cache cache instance
+ */
+void esp_gateway_flow_cache_delete(esp_gateway_flow_cache_t* cache);
+
+/**
+ * @brief  Get the flow of an IPv4 packet.
+ *
+ * @param[in]   iphdr IPv4 header
+ * @param[in]   len contiguous bytes from iphdr
+ * @param[in]   inp ingress netif
+ * @param[out]  key flow of the packet
+ * @param[out]  slow_path set when the packet must go through the stack, e.g. TCP SYN, FIN or RST, or TTL expiring
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_SUPPORTED: not an unfragmented TCP or UDP packet
+ *     - ESP_ERR_INVALID_SIZE: the headers are not contiguous
+ */
+esp_err_t esp_gateway_flow_key_parse(const uint8_t* iphdr, uint32_t len, const void* inp, esp_gateway_flow_key_t* key, bool* slow_path);
+
+/**
+ * @brief  Look up a flow.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  key flow of the packet
+ *
+ * @return
+ *     - entry: the flow was learned since the last flush
+ *     - NULL: unknown flow
+ */
+esp_gateway_flow_entry_t* esp_gateway_flow_cache_lookup(esp_gateway_flow_cache_t* cache, const esp_gateway_flow_key_t* key);
+
+/**
+ * @brief  Learn a flow from the first packet forwarded by the stack.
+ *
+ * @param[in]  cache cache instance
+ * @param[in]  key flow of the packet when it was received
+ * @param[in]  iphdr IPv4 header of the same packet when it is sent, after translation
+ * @param[in]  len contiguous bytes from iphdr
+ * @param[in]  outp egress netif
+ * @param[in]  mapping NAPT mapping of the flow, NULL if it is not translated
+ *
+ * @return
+ *     - entry: the flow is learned
+ *     - NULL: the sent packet is not a TCP or UDP packet of the same flow
+ */
+esp_gateway_flow_entry_t* esp_gateway_flow_cache_learn(esp_gateway_flow_cache_t* cache, const esp_gateway_flow_key_t* key,
+                                                       const uint8_t* iphdr, uint32_t len, void* outp,
+                                                       esp_gateway_napt_mapping_t* mapping);
+
+/**
+ * @brief  Translate a packet of the flow in place and decrease its TTL.
+ *
+ * @param[in]  entry flow of the packet
+ * @param[in]  iphdr IPv4 header, with the TCP or UDP header contiguous
+ */
+void esp_gateway_flow_cache_rewrite(const esp_gateway_flow_entry_t* entry, uint8_t* iphdr);
+
+/**
+ * @brief  Forget all the flows, e.g. when a netif goes up or down or its subnet changes.
+ *
+ * @param[in]  cache cache instance
+ */
+void esp_gateway_flow_cache_flush(esp_gateway_flow_cache_t* cache);
+
+/**
+ * @brief  Get the statistics of the cache.
+ *
+ * @param[in]   cache cache instance
+ * @param[out]  stats statistics
+ */
+void esp_gateway_flow_cache_get_stats(esp_gateway_flow_cache_t* cache, esp_gateway_flow_cache_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
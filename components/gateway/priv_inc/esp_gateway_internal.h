@@ -20,8 +20,13 @@
 #include "lwip/opt.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
 #include "lwip/lwip_napt.h"
 
+#include "esp_gateway_mac_alloc.h"
+#include "esp_gateway_napt_table.h"
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -91,19 +96,39 @@ esp_err_t esp_gateway_netif_list_remove(esp_netif_t* netif);
 esp_err_t esp_gateway_netif_request_ip(esp_netif_ip_info_t* ip_info);
 
 /**
- * @brief  Request to allocate an mac that does not conflict with the existing netif ip network segment.
+ * @brief  Request to allocate an mac that does not conflict with the mac of the existing netifs.
+ *
+ * @note The netifs are numbered in the order they request a mac, so the same creation order gives the same macs.
  *
  * @param[out]  mac netif mac
  *
  * @return
  *     - ESP_OK: request mac successfully
+ *     - others: no free mac
  */
 esp_err_t esp_gateway_netif_request_mac(uint8_t* mac);
 
+/**
+ * @brief  Request to allocate the mac of a netif derived from the station mac by its role and index.
+ *         The same netif gets the same mac across reboots unless it is used by another netif.
+ *
+ * @param[in]   role netif role, such as ESP_GATEWAY_MAC_ROLE_USB
+ * @param[in]   index netif index within the role
+ * @param[out]  mac netif mac
+ *
+ * @return
+ *     - ESP_OK: request mac successfully
+ *     - others: no free mac
+ */
+esp_err_t esp_gateway_netif_request_role_mac(esp_gateway_mac_role_t role, uint32_t index, uint8_t* mac);
+
 /**
  * @brief  Check whether the other data-forwarding netif IP network segment conflicts with this one.
  *         If yes, it will update the data-forwarding netif to a new IP network segment, otherwise, do nothing.
  *
+ * @note All the data-forwarding netifs are planned in one pass, after CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS.
+ *       The IP events of the netifs in the list trigger it as well.
+ *
  * @param[in]  esp_netif the netif information
  *
  * @return
@@ -112,6 +137,29 @@ esp_err_t esp_gateway_netif_request_mac(uint8_t* mac);
 esp_err_t esp_gateway_netif_network_segment_conflict_update(esp_netif_t* esp_netif);
 
 /**
+ * @brief  Get the network segment of an IP address, the index of its /24 in the data-forwarding netif address pool.
+ *
+ * @param[in]  ip IP address
+ * @param[out]  net_segment network segment, the third octet of ip with the default 192.168.0.0/16 pool
+ *
+ * @return
+ *     - true: ip is in one of the first 256 /24 of the pool
+ *     - false: ip has no network segment
+ */
+bool esp_gateway_network_segment_from_addr(esp_ip4_addr_t ip, uint8_t* net_segment);
+
+/**
+ * @brief  Get the network address of the /24 of a network segment.
+ *
+ * @param[in]  net_segment network segment
+ *
+ * @return network address of the /24
+ */
+esp_ip4_addr_t esp_gateway_network_segment_to_addr(uint8_t net_segment);
+
+/**
+ * @brief  Get the network segments of the external netifs which are in the address pool.
+ *
  * @param[in]  net_segment network segment
  * @param[in]  max_num Expect the maximum number of network segments to be obtained,
  *                     and return the actual number.
@@ -121,6 +169,178 @@ esp_err_t esp_gateway_netif_network_segment_conflict_update(esp_netif_t* esp_net
  */
 esp_err_t esp_gateway_get_external_netif_network_segment(uint8_t* net_segment, uint32_t* max_num);
 
+/**
+ * @brief  Get the network segments of the data-forwarding netifs, the ones this node serves by DHCP.
+ *
+ * @param[in]  net_segment network segment
+ * @param[in]  max_num Expect the maximum number of network segments to be obtained,
+ *                     and return the actual number.
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t esp_gateway_get_data_forwarding_netif_network_segment(uint8_t* net_segment, uint32_t* max_num);
+
+/**
+ * @brief  Enable or disable NAPT on all the data-forwarding netifs.
+ *
+ * @note Call it again when the IP of a data-forwarding netif changes.
+ *
+ * @param[in]  enable true to translate the clients of the netifs to the address of the external netif
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t esp_gateway_data_forwarding_netif_napt_enable(bool enable);
+
+/**
+ * @brief  Get the DNS servers learned by the external netifs, by DHCP or PPP.
+ *
+ * @param[out]  servers addresses of the DNS servers, in network byte order
+ * @param[in]   max_num Expect the maximum number of DNS servers to be obtained,
+ *                      and return the actual number.
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t esp_gateway_get_external_netif_dns(uint32_t* servers, uint32_t* max_num);
+
+/**
+ * @brief  Whether an address is in the subnet of a data-forwarding netif.
+ *
+ * @param[in]  addr IPv4 address, in network byte order
+ *
+ * @return
+ *     - true: the address is a data-forwarding client
+ *     - false: otherwise
+ */
+bool esp_gateway_is_data_forwarding_addr(uint32_t addr);
+
+/**
+ * @brief  Set the DNS server offered by the DHCP server of a data-forwarding netif.
+ *         The netif offers itself when the DNS proxy is enabled, else CONFIG_GATEWAY_DNS_FALLBACK_SERVER.
+ *
+ * @note Call it again when the IP of the netif changes.
+ *
+ * @param[in]  netif data-forwarding netif
+ *
+ * @return
+ *     - ESP_OK
+ *     - others: fail to set the DHCP server option
+ */
+esp_err_t esp_gateway_netif_dhcps_offer_dns(esp_netif_t* netif);
+
+/**
+ * @brief  Update the network segments used by the LiteMesh network, namely the segments of the routers,
+ *         of the inherited external netifs and of this node. They are not allocated to data-forwarding netifs.
+ *
+ * @param[in]  net_segment network segments, see esp_gateway_network_segment_from_addr()
+ * @param[in]  num number of network segments
+ *
+ * @return
+ *     - ESP_OK
+ *     - others: the address pool is not available
+ */
+esp_err_t esp_gateway_netif_litemesh_network_segment_update(const uint8_t* net_segment, uint32_t num);
+
+#if CONFIG_GATEWAY_NAPT_ENGINE
+/**
+ * @brief  Create the gateway NAPT table, the lwIP NAPT hooks use it from then on.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_gateway_napt_init(void);
+
+/**
+ * @brief  Refresh a NAPT mapping used by the fast path, must be called from the TCP/IP task.
+ *
+ * @param[in]  mapping NAPT mapping
+ * @param[in]  generation generation of the mapping when the flow was learned
+ *
+ * @return
+ *     - true: the mapping still translates the flow
+ *     - false: the mapping was removed
+ */
+bool esp_gateway_napt_mapping_refresh(esp_gateway_napt_mapping_t* mapping, uint32_t generation);
+#endif
+
+#if CONFIG_GATEWAY_FAST_PATH
+/**
+ * @brief  Create the fast path flow cache.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_gateway_fast_path_init(void);
+
+/**
+ * @brief  Learn the flow of the packet being forwarded by ip4_forward(), called from the NAPT hook.
+ *
+ * @param[in]  p packet, after translation
+ * @param[in]  outp egress netif
+ * @param[in]  mapping NAPT mapping of the flow, NULL if the flow is not translated by the gateway
+ */
+void esp_gateway_fast_path_learn(struct pbuf* p, struct netif* outp, esp_gateway_napt_mapping_t* mapping);
+
+/**
+ * @brief  Forget the mapping ip_napt_recv() found for the packet, once ip4_input() returned.
+ *
+ * @note The packet may have been dropped by ip4_forward(), and its pbuf reused by another one.
+ */
+void esp_gateway_napt_recv_done(void);
+
+/**
+ * @brief  Forget all the flows of the fast path, e.g. when the IP of a netif changes.
+ *
+ */
+void esp_gateway_fast_path_flush(void);
+#endif
+
+#if CONFIG_GATEWAY_MULTI_WAN
+/**
+ * @brief  Balance the new flows over an external netif as well, and start probing it.
+ *
+ * @param[in]  esp_netif external netif
+ *
+ * @return
+ *     - ESP_OK
+ *     - others: too many uplinks or Out of memory
+ */
+esp_err_t esp_gateway_multi_wan_add_uplink(esp_netif_t* esp_netif);
+
+/**
+ * @brief  Stop balancing the new flows over an external netif, its flows move to the other uplinks.
+ *
+ * @param[in]  esp_netif external netif
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t esp_gateway_multi_wan_remove_uplink(esp_netif_t* esp_netif);
+
+/**
+ * @brief  Get the netif a NAPT flow goes out of, called from the NAPT hook. A new mapping is bound to an uplink.
+ *
+ * @param[in]  mapping NAPT mapping of the flow
+ * @param[in]  outp netif routed by lwIP
+ *
+ * @return
+ *     - netif: egress netif of the flow, outp when it is not routed to an uplink or no uplink is usable
+ *     - NULL: the uplink of the flow failed while another one is usable, the flow has to start again
+ */
+struct netif* esp_gateway_multi_wan_egress(esp_gateway_napt_mapping_t* mapping, struct netif* outp);
+
+/**
+ * @brief  Count a packet of a NAPT flow which is larger than the MTU of its uplink and could not be fragmented.
+ *
+ * @param[in]  mapping NAPT mapping of the flow
+ */
+void esp_gateway_multi_wan_too_big(esp_gateway_napt_mapping_t* mapping);
+#endif
+
 esp_err_t esp_gateway_wifi_set_config_into_flash(wifi_interface_t interface, wifi_config_t *conf);
 
 esp_err_t esp_gateway_wifi_set_config_into_ram(wifi_interface_t interface, wifi_config_t *conf);
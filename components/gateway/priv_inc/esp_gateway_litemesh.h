@@ -14,11 +14,17 @@
 
 #pragma once
 
+#include "esp_gateway_litemesh_bcast_filter.h"
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+/* NVS entry of the channel of the last association, see CONFIG_LITEMESH_SCAN_CHANNEL_PIN */
+#define ESP_LITEMESH_NVS_NAMESPACE          "litemesh"
+#define ESP_LITEMESH_NVS_KEY_CHANNEL        "channel"
+
 /**
   * @brief Check if the network segment is used to avoid conflicts.
   * 
@@ -39,6 +45,75 @@ esp_err_t esp_litemesh_init(void);
 
 void esp_litemesh_connect(void);
 
+#if CONFIG_LITEMESH_ROUTED
+/**
+  * @brief Announce the segments of the data-forwarding netifs again, call it when they move.
+  */
+void esp_litemesh_route_refresh(void);
+
+/**
+  * @brief Look up the child a packet to another subnet of the mesh is forwarded to.
+  *
+  * @note Called on the forwarding path, it takes a spinlock and a table read.
+  *
+  * @param[in]  addr destination, network byte order
+  * @param[out]  next_hop station address of the child, network byte order
+  *
+  * @return
+  *     - true : the destination is in the subtree of a child
+  *     - false: not routed, the default route applies
+  */
+bool esp_litemesh_route_lookup(uint32_t addr, uint32_t* next_hop);
+#endif
+
+#if CONFIG_LITEMESH_BCAST_FILTER
+/**
+  * @brief Answer or drop a frame received on the SoftAP, see esp_litemesh_bcast_filter_input().
+  *
+  * @note Called on the receive path, it takes a spinlock and scans the small tables of the filter.
+  *
+  * @param[in]  frame Ethernet frame
+  * @param[in]  len length of the frame
+  * @param[in]  self_mac MAC address of the SoftAP
+  * @param[out]  reply ARP reply, ESP_LITEMESH_BCAST_FILTER_REPLY_LEN bytes
+  *
+  * @return action
+  */
+esp_litemesh_bcast_action_t esp_litemesh_bcast_input(const uint8_t* frame, uint32_t len, const uint8_t self_mac[6], uint8_t* reply);
+#endif
+
+#if CONFIG_LITEMESH_MULTI_ROOT
+/**
+  * @brief Publish the segments of the data-forwarding netifs again, call it when they move.
+  */
+void esp_litemesh_tree_refresh(void);
+#endif
+
+#if CONFIG_LITEMESH_PATH_METRICS
+/**
+  * @brief Send an ICMP echo request probe, implemented by the lwIP glue of the target.
+  *
+  * @note The answer is reported with esp_litemesh_path_probe_done(), possibly before this call returns.
+  *
+  * @param[in]  dest destination, network byte order
+  * @param[in]  len length of the echo data
+  * @param[in]  seq sequence number of the probe
+  *
+  * @return
+  *     - ESP_OK: the probe is sent
+  *     - Other: the probe is not sent
+  */
+esp_err_t esp_litemesh_probe_send(uint32_t dest, uint32_t len, uint16_t seq);
+
+/**
+  * @brief An echo reply to a probe is received.
+  *
+  * @param[in]  seq sequence number of the probe
+  * @param[in]  rtt_us round trip time
+  */
+void esp_litemesh_path_probe_done(uint16_t seq, uint32_t rtt_us);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,153 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Length of the ARP reply built by esp_litemesh_bcast_filter_input()
+ *
+ */
+#define ESP_LITEMESH_BCAST_FILTER_REPLY_LEN     (42)
+
+/**
+ * @brief What to do with a frame received on the SoftAP
+ *
+ */
+typedef enum {
+    ESP_LITEMESH_BCAST_PASS = 0,    /*!< Give the frame to the stack */
+    ESP_LITEMESH_BCAST_DROP,        /*!< Drop the frame, a repeat or over the rate limit */
+    ESP_LITEMESH_BCAST_REPLY,       /*!< Drop the ARP request and send the reply instead */
+} esp_litemesh_bcast_action_t;
+
+/**
+ * @brief Broadcast filter configuration
+ *
+ */
+typedef struct {
+    uint32_t proxy_arp_size;        /*!< Neighbours answered for, 0 to never answer */
+    uint32_t proxy_arp_max_age_ms;  /*!< A neighbour not heard of for this time is not answered for */
+    uint32_t dup_window_ms;         /*!< A frame repeated within this time is dropped, 0 to keep the repeats */
+    uint32_t rate_limit;            /*!< Broadcast and multicast frames per second, 0 for no limit */
+    uint32_t basic_rate_kbps;       /*!< Rate of the broadcasts on the air, for the airtime estimate */
+} esp_litemesh_bcast_filter_config_t;
+
+/**
+ * @brief Broadcast filter statistics
+ *
+ */
+typedef struct {
+    uint32_t neighbours;        /*!< Neighbours in the proxy ARP cache */
+    uint32_t arp_requests;      /*!< Broadcast ARP requests received */
+    uint32_t arp_answered;      /*!< Of them, the ones answered from the cache */
+    uint32_t duplicates;        /*!< Frames dropped as repeats within the window */
+    uint32_t rate_limited;      /*!< Frames dropped over the rate limit */
+    uint32_t suppressed_bytes;  /*!< Length of the frames answered or dropped */
+    uint64_t airtime_saved_us;  /*!< Estimated airtime of those frames as broadcasts */
+} esp_litemesh_bcast_filter_stats_t;
+
+typedef struct esp_litemesh_bcast_filter esp_litemesh_bcast_filter_t;
+
+/**
+ * @brief  Create a broadcast filter.
+ *
+ * @note The filter is not locked, the callers serialize the calls.
+ *
+ * @param[in]  config configuration
+ *
+ * @return
+ *     - instance: create filter successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_litemesh_bcast_filter_t* esp_litemesh_bcast_filter_create(const esp_litemesh_bcast_filter_config_t* config);
+
+/**
+ * @brief  Delete a broadcast filter.
+ *
+ * @param[in]  filter broadcast filter
+ */
+void esp_litemesh_bcast_filter_delete(esp_litemesh_bcast_filter_t* filter);
+
+/**
+ * @brief  Learn the address of a neighbour, the ARP frames received are learned by esp_litemesh_bcast_filter_input().
+ *
+ * @note When the cache is full, the neighbour heard of the longest time ago is replaced.
+ *
+ * @param[in]  filter broadcast filter
+ * @param[in]  ip IPv4 address, network byte order
+ * @param[in]  mac MAC address
+ * @param[in]  now current time in milliseconds
+ */
+void esp_litemesh_bcast_filter_learn(esp_litemesh_bcast_filter_t* filter, uint32_t ip, const uint8_t mac[6], uint32_t now);
+
+/**
+ * @brief  Forget a neighbour, e.g. when its station leaves the SoftAP.
+ *
+ * @param[in]  filter broadcast filter
+ * @param[in]  mac MAC address
+ *
+ * @return true when the neighbour was in the cache
+ */
+bool esp_litemesh_bcast_filter_forget(esp_litemesh_bcast_filter_t* filter, const uint8_t mac[6]);
+
+/**
+ * @brief  Look up the MAC address of a neighbour.
+ *
+ * @param[in]  filter broadcast filter
+ * @param[in]  ip IPv4 address, network byte order
+ * @param[out]  mac MAC address
+ * @param[in]  now current time in milliseconds
+ *
+ * @return true when the neighbour is in the cache and not older than the maximum age
+ */
+bool esp_litemesh_bcast_filter_lookup(esp_litemesh_bcast_filter_t* filter, uint32_t ip, uint8_t mac[6], uint32_t now);
+
+/**
+ * @brief  Filter a frame received on the SoftAP.
+ *
+ * A broadcast ARP request for a known neighbour is answered with its address. ARP and DHCP are never dropped,
+ * the other broadcast and multicast frames are dropped when they repeat within the window or go over the rate
+ * limit. Unicast frames always pass.
+ *
+ * @param[in]  filter broadcast filter
+ * @param[in]  frame Ethernet frame
+ * @param[in]  len length of the frame
+ * @param[in]  self_mac MAC address of the SoftAP, source of the reply
+ * @param[in]  now current time in milliseconds
+ * @param[out]  reply ARP reply, ESP_LITEMESH_BCAST_FILTER_REPLY_LEN bytes, set on ESP_LITEMESH_BCAST_REPLY
+ *
+ * @return action
+ */
+esp_litemesh_bcast_action_t esp_litemesh_bcast_filter_input(esp_litemesh_bcast_filter_t* filter, const uint8_t* frame, uint32_t len,
+                                                            const uint8_t self_mac[6], uint32_t now, uint8_t* reply);
+
+/**
+ * @brief  Get the statistics of a broadcast filter.
+ *
+ * @param[in]  filter broadcast filter
+ * @param[out]  stats statistics
+ */
+void esp_litemesh_bcast_filter_get_stats(esp_litemesh_bcast_filter_t* filter, esp_litemesh_bcast_filter_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
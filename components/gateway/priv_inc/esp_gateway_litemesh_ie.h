@@ -0,0 +1,224 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+#include "esp_gateway_config.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Payload of the LiteMesh vendor IE, after the OUI and the OUI type.
+ *
+ * A segment is the index of a /24 in the data-forwarding netif address pool, the third octet of the address
+ * with the default 192.168.0.0/16 pool. Addresses out of the pool have no segment.
+ *
+ * Version 1, fixed layout:
+ *   version | max connection:4 connected stations:4 | router status:1 compact:1 reserved:2 level:4 | SSID length |
+ *   router segment number:4 inherited segment number:4 | SSID | router segments | inherited segments
+ *
+ * Version 2, a fixed header followed by TLVs (type, length, value):
+ *   version | max connection:4 connected stations:4 | router status:1 compact:1 reserved:2 level:4 | TLV...
+ *
+ * The compact bit tells that the node parses version 2. The previous firmware, which only parses version 1,
+ * leaves it clear, so a node publishes version 1 with the compact bit set until all its neighbours set it.
+ *
+ * A TLV is left out when its field is empty, a node without router has no SSID TLV and a root has no
+ * inherited segment TLV, a node without uplink has no uplink quality TLV. The SSID is only compared by the listeners, it is carried as its length and
+ * a 32 bit digest. Unknown TLVs are skipped, so later versions can add fields.
+ *
+ * The route TLV is only published in routed mode. It starts with the uplink of the node, which tells its parent
+ * that the node is one of its children and how to reach it. Its routes are the segments known to the node, in ascending
+ * order, each with the fourth byte of the station of the child it is routed to, ESP_LITEMESH_IE_ROUTE_SELF for
+ * the segments of the node and ESP_LITEMESH_IE_ROUTE_TAKEN for the ones used elsewhere in the mesh. The parent
+ * of the node routes the segments of the first two kinds to it, the children of the node keep away from the
+ * segments which are not routed to them.
+ *
+ * The tree TLV tells which root the node reaches the router through, and how loaded that root is, so that
+ * the joining nodes spread over the roots. It also carries the number of nodes of the subtree of the node,
+ * which its parent adds up, the BSSID bytes of the parent and the segments of the data-forwarding netifs
+ * of the root, which the roots of the other trees keep away from.
+ *
+ * The path TLV carries the RTT and the bottleneck throughput of the path of the node to the router, measured
+ * link by link: each node adds what it measures to its parent to the path its parent advertises.
+ */
+#define ESP_LITEMESH_IE_VERSION_1               (1)
+#define ESP_LITEMESH_IE_VERSION_2               (2)
+
+#define ESP_LITEMESH_IE_TLV_ROUTER_SSID         (1)     /*!< SSID length (1 byte) + FNV-1a digest of the SSID (4 bytes, big endian) */
+#define ESP_LITEMESH_IE_TLV_ROUTER_SEGMENT      (2)     /*!< Network segments of the routers, one byte each */
+#define ESP_LITEMESH_IE_TLV_INHERITED_SEGMENT   (3)     /*!< Network segments used below the router, one byte each */
+#define ESP_LITEMESH_IE_TLV_UPLINK_QUALITY      (4)     /*!< Quality of the path to the router, from 1 to 100 (1 byte) */
+#define ESP_LITEMESH_IE_TLV_ROUTE               (5)     /*!< Network segment and fourth byte of the station address (2 bytes), last three bytes
+                                                             of the BSSID of the parent (3 bytes), then the routes, 2 bytes each */
+#define ESP_LITEMESH_IE_TLV_TREE                (6)     /*!< Last three bytes of the SoftAP MAC of the root (3 bytes), root load (1 byte),
+                                                             nodes of the subtree (1 byte), last three bytes of the BSSID of the parent
+                                                             (3 bytes), then the data-forwarding segments of the root, 1 byte each */
+#define ESP_LITEMESH_IE_TLV_PATH                (7)     /*!< RTT of the path to the router in 100 us (2 bytes, big endian),
+                                                             bottleneck throughput in 100 kbit/s (2 bytes, big endian) */
+
+#define ESP_LITEMESH_IE_ROUTE_SELF              (0)     /*!< Next hop of a segment of the node itself */
+#define ESP_LITEMESH_IE_ROUTE_TAKEN             (0xFF)  /*!< Next hop of a segment used outside the subtree of the node */
+
+#define ESP_LITEMESH_IE_OUI_LEN                 (4)     /*!< OUI and OUI type, counted by the length of the IE */
+#define ESP_LITEMESH_IE_MAX_PAYLOAD_LEN         (255 - ESP_LITEMESH_IE_OUI_LEN)
+
+#define ESP_LITEMESH_MAX_ROUTER_NUMBER          CONFIG_LITEMESH_MAX_ROUTER_NUMBER
+#define ESP_LITEMESH_MAX_INHERITED_NETIF_NUMBER CONFIG_LITEMESH_MAX_INHERITED_NETIF_NUMBER
+#define ESP_LITEMESH_MAX_ROUTE_NUMBER           (96)    /*!< Routes of a route TLV, the IE has room for the other TLVs */
+#define ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER    (4)     /*!< Segments of the root in a tree TLV */
+#define ESP_LITEMESH_IE_ROOT_LOAD_MAX           (100)
+
+/**
+ * @brief Route of the route TLV
+ *
+ */
+typedef struct {
+    uint8_t net_segment;                    /*!< Network segment of the subnet */
+    uint8_t next_hop;                       /*!< Fourth byte of the station of the child, or ESP_LITEMESH_IE_ROUTE_SELF / TAKEN */
+} esp_litemesh_ie_route_t;
+
+/**
+ * @brief Information of a LiteMesh node, as published in its vendor IE
+ *
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t max_connection:4;
+    uint8_t connected_station_number:4;
+    uint8_t connect_router_status:1;
+    uint8_t compact:1;                      /*!< The node parses version 2 */
+    uint8_t reserved1:2;
+    uint8_t level:4;
+    uint8_t router_mac[ESP_GATEWAY_MAC_MAX_LEN];
+    uint8_t router_ssid_len;
+    uint8_t router_number:4;
+    uint8_t inherited_netif_number:4;
+    uint8_t router_ssid[ESP_GATEWAY_SSID_MAX_LEN];
+    uint8_t router_net_segment[ESP_LITEMESH_MAX_ROUTER_NUMBER];
+    uint8_t inherited_net_segment[ESP_LITEMESH_MAX_INHERITED_NETIF_NUMBER];
+    uint8_t self_net_segment_num:4;
+    uint8_t reserved2:4;
+    uint8_t self_net_segment[ESP_GATEWAY_EXTERNAL_NETIF_MAX];
+    uint8_t uplink_quality;                 /*!< Version 2 only, 0: not advertised */
+    uint8_t uplink_addr[2];                 /*!< Version 2 only, network segment and fourth byte of the station address, 0 when not connected */
+    uint8_t uplink_bssid[3];                /*!< Version 2 only, last three bytes of the BSSID of the parent */
+    uint8_t route_num;                      /*!< Version 2 only, 0: no route TLV */
+    esp_litemesh_ie_route_t route[ESP_LITEMESH_MAX_ROUTE_NUMBER];
+    uint8_t tree_nodes;                     /*!< Version 2 only, nodes of the subtree with this node, 0: no tree TLV */
+    uint8_t root_id[3];                     /*!< Version 2 only, last three bytes of the SoftAP MAC of the root */
+    uint8_t root_load;                      /*!< Version 2 only, load of the root, from 0 to ESP_LITEMESH_IE_ROOT_LOAD_MAX */
+    uint8_t tree_segment_num;               /*!< Version 2 only */
+    uint8_t tree_segment[ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER];
+    uint16_t path_rtt;                      /*!< Version 2 only, RTT of the path to the router in 100 us */
+    uint16_t path_rate;                     /*!< Version 2 only, throughput of the path in 100 kbit/s, 0: no path TLV */
+} esp_gateway_litemesh_info_t;
+
+/**
+ * @brief Vendor IE of a LiteMesh node, parsed in place. The pointers point into the IE.
+ *
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t max_connection;
+    uint8_t connected_station_number;
+    uint8_t connect_router_status;
+    uint8_t compact;                        /*!< The node parses version 2, always set in version 2 */
+    uint8_t level;
+    uint8_t router_ssid_len;                /*!< 0: the node has no router configured */
+    const uint8_t* router_ssid;             /*!< Version 1 only, NULL in version 2 */
+    uint32_t router_ssid_digest;            /*!< Version 2 only */
+    uint8_t router_number;
+    const uint8_t* router_net_segment;
+    uint8_t inherited_netif_number;         /*!< Inherited and self segments of the node */
+    const uint8_t* inherited_net_segment;
+    uint8_t uplink_quality;                 /*!< Version 2 only, 0: not advertised */
+    const uint8_t* uplink_addr;             /*!< Version 2 only, NULL without route TLV */
+    const uint8_t* uplink_bssid;            /*!< Version 2 only, NULL without route and tree TLV */
+    uint8_t route_num;
+    const esp_litemesh_ie_route_t* route;   /*!< Version 2 only, route_num routes */
+    uint8_t tree_nodes;                     /*!< Version 2 only, 0 without tree TLV */
+    const uint8_t* root_id;                 /*!< Version 2 only, NULL without tree TLV */
+    uint8_t root_load;
+    uint8_t tree_segment_num;
+    const uint8_t* tree_segment;
+    uint16_t path_rtt;                      /*!< Version 2 only, in 100 us */
+    uint16_t path_rate;                     /*!< Version 2 only, in 100 kbit/s, 0 without path TLV */
+} esp_litemesh_ie_view_t;
+
+/**
+ * @brief  Digest of a router SSID, as carried by version 2.
+ *
+ * @param[in]  ssid SSID
+ * @param[in]  len length of ssid
+ *
+ * @return 32 bit FNV-1a hash of ssid
+ */
+uint32_t esp_litemesh_ie_ssid_digest(const uint8_t* ssid, uint8_t len);
+
+/**
+ * @brief  Encode the vendor IE of a node. The element ID and the OUI of ie are left untouched.
+ *
+ * @note The inherited and the self segments of info are published together as inherited segments.
+ *
+ * @param[in]  info node information, info->version selects the encoding
+ * @param[out]  ie vendor IE, its payload and length are set
+ * @param[in]  max_payload_len size of the payload of ie
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: NULL pointer
+ *     - ESP_ERR_NOT_SUPPORTED: unknown version
+ *     - ESP_ERR_INVALID_SIZE: the IE does not fit in max_payload_len
+ */
+esp_err_t esp_litemesh_ie_encode(const esp_gateway_litemesh_info_t* info, vendor_ie_data_t* ie, uint32_t max_payload_len);
+
+/**
+ * @brief  Parse a vendor IE in place, without copying. Only the bytes counted by the length of the IE are read.
+ *
+ * @param[in]  ie vendor IE with the LiteMesh OUI
+ * @param[out]  view parsed IE, valid as long as ie is
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: NULL pointer
+ *     - ESP_ERR_NOT_SUPPORTED: unknown version
+ *     - ESP_ERR_INVALID_SIZE: truncated or inconsistent IE
+ */
+esp_err_t esp_litemesh_ie_parse(const vendor_ie_data_t* ie, esp_litemesh_ie_view_t* view);
+
+/**
+ * @brief  Check whether a parsed IE belongs to the mesh of a router.
+ *
+ * @param[in]  view parsed IE
+ * @param[in]  ssid SSID of the router
+ * @param[in]  len length of ssid
+ *
+ * @return
+ *     - true: same SSID length and same SSID, or same digest in version 2
+ *     - false: different SSID
+ */
+bool esp_litemesh_ie_ssid_match(const esp_litemesh_ie_view_t* view, const uint8_t* ssid, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
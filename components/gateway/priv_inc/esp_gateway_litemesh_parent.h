@@ -0,0 +1,182 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "esp_wifi_types.h"
+
+#include "esp_gateway.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES (8)
+
+/**
+ * @brief Parent selector configuration
+ *
+ */
+typedef struct {
+    esp_litemesh_parent_score_t score;  /*!< Score of the candidates, NULL for esp_litemesh_parent_default_score() */
+    void* score_arg;                    /*!< Argument of score */
+    uint8_t rssi_smoothing;             /*!< Weight of a new RSSI sample in the smoothed RSSI, in eighths, from 1 to 8 */
+    int32_t hysteresis;                 /*!< Score a candidate must beat the parent by */
+    uint32_t min_dwell_ms;              /*!< Time with the parent before leaving it for a better candidate */
+    uint32_t max_age_ms;                /*!< Candidates not heard for longer are forgotten */
+} esp_litemesh_parent_selector_config_t;
+
+typedef struct esp_litemesh_parent_selector esp_litemesh_parent_selector_t;
+
+/**
+ * @brief  Create a parent selector.
+ *
+ * @note The selector is not locked, and only reads the clock through the now arguments, so that the
+ *       same beacons always give the same decisions.
+ *
+ * @param[in]  config selector configuration
+ *
+ * @return
+ *     - instance: create selector successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_litemesh_parent_selector_t* esp_litemesh_parent_selector_create(const esp_litemesh_parent_selector_config_t* config);
+
+/**
+ * @brief  Delete a parent selector.
+ *
+ * @param[in]  selector selector instance
+ */
+void esp_litemesh_parent_selector_delete(esp_litemesh_parent_selector_t* selector);
+
+/**
+ * @brief  Replace the score of the candidates.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  score score function, NULL for esp_litemesh_parent_default_score()
+ * @param[in]  arg argument of score
+ */
+void esp_litemesh_parent_selector_set_score(esp_litemesh_parent_selector_t* selector, esp_litemesh_parent_score_t score, void* arg);
+
+/**
+ * @brief  Add the beacon of a candidate. The RSSI of the beacon is smoothed with the previous ones of the
+ *         candidate, the other fields replace the previous ones. When the table is full, the candidate
+ *         heard the longest time ago is replaced, except the parent.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  beacon candidate as heard in the beacon, with the RSSI of the beacon
+ * @param[in]  now current time in milliseconds
+ */
+void esp_litemesh_parent_selector_update(esp_litemesh_parent_selector_t* selector, const esp_litemesh_parent_t* beacon, uint32_t now);
+
+/**
+ * @brief  Forget a candidate, e.g. a node which has no free station any more or lost its router.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  bssid SoftAP MAC of the candidate
+ */
+void esp_litemesh_parent_selector_remove(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6]);
+
+/**
+ * @brief  Get a candidate.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  bssid SoftAP MAC of the candidate
+ * @param[out]  candidate candidate with its smoothed RSSI
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: not a candidate
+ */
+esp_err_t esp_litemesh_parent_selector_get(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6], esp_litemesh_parent_t* candidate);
+
+/**
+ * @brief  Get the candidate with the highest score, to join when the node has no parent.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  now current time in milliseconds
+ * @param[out]  best best candidate
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: no candidate heard within max_age_ms
+ */
+esp_err_t esp_litemesh_parent_selector_best(esp_litemesh_parent_selector_t* selector, uint32_t now, esp_litemesh_parent_t* best);
+
+/**
+ * @brief  Get the candidate to connect to straight away when the parent is lost: the one with the highest
+ *         score among the candidates above max_level heard within max_age_ms.
+ *
+ * @note The parent lost should be removed first, see esp_litemesh_parent_selector_should_switch() for max_level.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  now current time in milliseconds
+ * @param[in]  max_level only the candidates of a lower level are considered
+ * @param[in]  max_age_ms only the candidates heard within this time are considered
+ * @param[out]  best best candidate
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: no such candidate, scan instead
+ */
+esp_err_t esp_litemesh_parent_selector_failover(esp_litemesh_parent_selector_t* selector, uint32_t now, uint8_t max_level,
+                                                uint32_t max_age_ms, esp_litemesh_parent_t* best);
+
+/**
+ * @brief  Get the parent set with esp_litemesh_parent_selector_set_parent().
+ *
+ * @param[in]  selector selector instance
+ * @param[out]  parent parent with its smoothed RSSI
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: no parent
+ */
+esp_err_t esp_litemesh_parent_selector_get_parent(esp_litemesh_parent_selector_t* selector, esp_litemesh_parent_t* parent);
+
+/**
+ * @brief  Set the parent the node is connected to, the dwell time starts.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  bssid SoftAP MAC of the parent, NULL when the node has no parent
+ * @param[in]  now current time in milliseconds
+ */
+void esp_litemesh_parent_selector_set_parent(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6], uint32_t now);
+
+/**
+ * @brief  Check whether the node should leave its parent. It should when the parent has been kept for
+ *         min_dwell_ms and a candidate above max_level scores hysteresis more than the parent.
+ *
+ * @note The level of the descendants of the node is above its own level, max_level is the level of the
+ *       node so that it never chooses one of them.
+ *
+ * @param[in]  selector selector instance
+ * @param[in]  now current time in milliseconds
+ * @param[in]  max_level only the candidates of a lower level are considered
+ * @param[out]  better the candidate to switch to
+ *
+ * @return
+ *     - true: switch to better
+ *     - false: keep the parent, or no parent
+ */
+bool esp_litemesh_parent_selector_should_switch(esp_litemesh_parent_selector_t* selector, uint32_t now, uint8_t max_level, esp_litemesh_parent_t* better);
+
+#ifdef __cplusplus
+}
+#endif
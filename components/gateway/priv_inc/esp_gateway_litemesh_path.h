@@ -0,0 +1,159 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of probes of each size the minimum RTT is taken over
+ *
+ */
+#define ESP_LITEMESH_PATH_MAX_WINDOW    (16)
+
+/**
+ * @brief Highest throughput estimated, a link whose large probes are not slower than the small ones gets it
+ *
+ */
+#define ESP_LITEMESH_PATH_MAX_KBPS      (150000)
+
+/**
+ * @brief Quality of a link or of a path to the router
+ *
+ */
+typedef struct {
+    uint32_t rtt_us;        /*!< Round trip time */
+    uint32_t kbps;          /*!< Bottleneck throughput, 0 when unknown */
+} esp_litemesh_path_metric_t;
+
+/**
+ * @brief Path estimator configuration
+ *
+ */
+typedef struct {
+    uint32_t small_len;     /*!< Length of the small probes */
+    uint32_t large_len;     /*!< Length of the large probes, longer than the small ones */
+    uint32_t window;        /*!< Probes of each size the minimum RTT is taken over, at most ESP_LITEMESH_PATH_MAX_WINDOW */
+} esp_litemesh_path_config_t;
+
+/**
+ * @brief Path estimator statistics
+ *
+ */
+typedef struct {
+    uint32_t samples;       /*!< Probes answered */
+    uint32_t losses;        /*!< Probes not answered */
+} esp_litemesh_path_estimator_stats_t;
+
+typedef struct esp_litemesh_path_estimator esp_litemesh_path_estimator_t;
+
+/**
+ * @brief  Create a path estimator, which estimates a link from the RTT of echo probes of two sizes.
+ *
+ * The RTT of the link is the smoothed RTT of the small probes. Queueing only adds to an RTT, so the throughput
+ * is taken from the difference of the minimum RTT of the large and of the small probes, over the last probes
+ * of each size: the extra bytes cross the link twice, in the request and in the reply.
+ *
+ * @note The estimator is not locked, the callers serialize the calls.
+ *
+ * @param[in]  config configuration
+ *
+ * @return
+ *     - instance: create estimator successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_litemesh_path_estimator_t* esp_litemesh_path_estimator_create(const esp_litemesh_path_config_t* config);
+
+/**
+ * @brief  Delete a path estimator.
+ *
+ * @param[in]  estimator path estimator
+ */
+void esp_litemesh_path_estimator_delete(esp_litemesh_path_estimator_t* estimator);
+
+/**
+ * @brief  Forget the samples, e.g. when the link changes.
+ *
+ * @param[in]  estimator path estimator
+ */
+void esp_litemesh_path_estimator_reset(esp_litemesh_path_estimator_t* estimator);
+
+/**
+ * @brief  Add the RTT of an answered probe.
+ *
+ * @param[in]  estimator path estimator
+ * @param[in]  len length of the probe, the small or the large one
+ * @param[in]  rtt_us round trip time
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: NULL estimator, or len is neither the small nor the large length
+ */
+esp_err_t esp_litemesh_path_estimator_sample(esp_litemesh_path_estimator_t* estimator, uint32_t len, uint32_t rtt_us);
+
+/**
+ * @brief  Count a probe which was not answered.
+ *
+ * @param[in]  estimator path estimator
+ */
+void esp_litemesh_path_estimator_loss(esp_litemesh_path_estimator_t* estimator);
+
+/**
+ * @brief  Get the estimate of the link.
+ *
+ * @param[in]  estimator path estimator
+ * @param[out]  link RTT and throughput of the link
+ *
+ * @return true once probes of both sizes were answered
+ */
+bool esp_litemesh_path_estimator_get(esp_litemesh_path_estimator_t* estimator, esp_litemesh_path_metric_t* link);
+
+/**
+ * @brief  Get the statistics of a path estimator.
+ *
+ * @param[in]  estimator path estimator
+ * @param[out]  stats statistics
+ */
+void esp_litemesh_path_estimator_get_stats(esp_litemesh_path_estimator_t* estimator, esp_litemesh_path_estimator_stats_t* stats);
+
+/**
+ * @brief  Extend the path of the parent with the link to it: the RTTs add up, the throughput is the lowest one.
+ *
+ * @param[in]  parent path of the parent to the router, NULL for a node connected to the router
+ * @param[in]  link link of the node to its parent
+ * @param[out]  path path of the node to the router
+ */
+void esp_litemesh_path_combine(const esp_litemesh_path_metric_t* parent, const esp_litemesh_path_metric_t* link,
+                               esp_litemesh_path_metric_t* path);
+
+/**
+ * @brief  Check whether a path moved far enough from the advertised one to advertise it again.
+ *
+ * @param[in]  advertised path advertised
+ * @param[in]  current path estimated now
+ *
+ * @return true when the RTT or the throughput moved by more than an eighth, or the throughput became known
+ */
+bool esp_litemesh_path_changed(const esp_litemesh_path_metric_t* advertised, const esp_litemesh_path_metric_t* current);
+
+#ifdef __cplusplus
+}
+#endif
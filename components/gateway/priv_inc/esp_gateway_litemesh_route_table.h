@@ -0,0 +1,158 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of next hops a route table can hold, one per child of the node
+ *
+ */
+#define ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS  (16)
+
+/**
+ * @brief Route to a segment below the node
+ *
+ */
+typedef struct {
+    uint8_t net_segment;    /*!< Network segment of the subnet */
+    uint32_t next_hop;      /*!< Station address of the child, network byte order */
+} esp_litemesh_route_t;
+
+/**
+ * @brief Route table statistics
+ *
+ */
+typedef struct {
+    uint32_t next_hops;     /*!< Children with routes */
+    uint32_t routes;        /*!< Segments routed */
+    uint32_t lookups;       /*!< Lookups */
+    uint32_t hits;          /*!< Lookups which found a route */
+    uint32_t conflicts;     /*!< Segments announced by a child while routed to another one */
+    uint32_t expirations;   /*!< Children dropped after the maximum age without announcement */
+} esp_litemesh_route_table_stats_t;
+
+typedef struct esp_litemesh_route_table esp_litemesh_route_table_t;
+
+/**
+ * @brief  Create a route table.
+ *
+ * @note The table is not locked, the callers serialize the calls.
+ *
+ * @param[in]  max_next_hops maximum number of children with routes, at most ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS
+ * @param[in]  max_age_ms the routes of a child which announced nothing for this time are dropped
+ *
+ * @return
+ *     - instance: create table successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_litemesh_route_table_t* esp_litemesh_route_table_create(uint32_t max_next_hops, uint32_t max_age_ms);
+
+/**
+ * @brief  Delete a route table.
+ *
+ * @param[in]  table route table
+ */
+void esp_litemesh_route_table_delete(esp_litemesh_route_table_t* table);
+
+/**
+ * @brief  Replace the segments routed to a child with the ones it announces.
+ *
+ * @note A segment routed to another child stays with it until that child stops announcing it, the first
+ *       announcement wins.
+ *
+ * @param[in]  table route table
+ * @param[in]  id BSSID of the child
+ * @param[in]  next_hop station address of the child, network byte order
+ * @param[in]  segments segments announced by the child
+ * @param[in]  num number of segments
+ * @param[in]  now current time in milliseconds
+ * @param[out]  changed set to true when a route is added, moved or removed, may be NULL
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: NULL pointer or next_hop 0
+ *     - ESP_ERR_NO_MEM: max_next_hops children already have routes
+ */
+esp_err_t esp_litemesh_route_table_update(esp_litemesh_route_table_t* table, const uint8_t id[6], uint32_t next_hop,
+                                          const uint8_t* segments, uint32_t num, uint32_t now, bool* changed);
+
+/**
+ * @brief  Remove the routes of a child, e.g. when it announces another parent.
+ *
+ * @param[in]  table route table
+ * @param[in]  id BSSID of the child
+ *
+ * @return true when routes were removed
+ */
+bool esp_litemesh_route_table_remove(esp_litemesh_route_table_t* table, const uint8_t id[6]);
+
+/**
+ * @brief  Remove the routes of the children which announced nothing for the maximum age.
+ *
+ * @param[in]  table route table
+ * @param[in]  now current time in milliseconds
+ *
+ * @return true when routes were removed
+ */
+bool esp_litemesh_route_table_expire(esp_litemesh_route_table_t* table, uint32_t now);
+
+/**
+ * @brief  Look up the next hop of a segment.
+ *
+ * @param[in]  table route table
+ * @param[in]  net_segment network segment of the destination
+ * @param[out]  next_hop station address of the child, network byte order
+ *
+ * @return true when the segment is routed
+ */
+bool esp_litemesh_route_table_lookup(esp_litemesh_route_table_t* table, uint8_t net_segment, uint32_t* next_hop);
+
+/**
+ * @brief  Get the routes, in ascending order of segment.
+ *
+ * @param[in]  table route table
+ * @param[out]  routes routes
+ * @param[in]  max_num size of routes
+ *
+ * @return number of routes copied
+ */
+uint32_t esp_litemesh_route_table_get_routes(esp_litemesh_route_table_t* table, esp_litemesh_route_t* routes, uint32_t max_num);
+
+/**
+ * @brief  Remove all the routes.
+ *
+ * @param[in]  table route table
+ */
+void esp_litemesh_route_table_flush(esp_litemesh_route_table_t* table);
+
+/**
+ * @brief  Get the statistics of a route table.
+ *
+ * @param[in]  table route table
+ * @param[out]  stats statistics
+ */
+void esp_litemesh_route_table_get_stats(esp_litemesh_route_table_t* table, esp_litemesh_route_table_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Number of candidates tried for one role and index before giving up
+ *
+ */
+#define ESP_GATEWAY_MAC_ALLOC_MAX_ATTEMPTS      (16)
+
+/**
+ * @brief Maximum interface index of a role
+ *
+ */
+#define ESP_GATEWAY_MAC_ALLOC_MAX_INDEX         (0xFFFF)
+
+typedef enum {
+    ESP_GATEWAY_MAC_ROLE_GENERIC = 0,   /*!< Interface created without telling its role */
+    ESP_GATEWAY_MAC_ROLE_SOFTAP,
+    ESP_GATEWAY_MAC_ROLE_ETH,
+    ESP_GATEWAY_MAC_ROLE_USB,
+    ESP_GATEWAY_MAC_ROLE_SPI,
+    ESP_GATEWAY_MAC_ROLE_SDIO,
+    ESP_GATEWAY_MAC_ROLE_MAX,           /*!< The role is encoded on 4 bits, no more than 16 roles */
+} esp_gateway_mac_role_t;
+
+typedef struct esp_gateway_mac_allocator esp_gateway_mac_allocator_t;
+
+/**
+ * @brief  Create a MAC allocator.
+ *
+ * @note The derived addresses are the base MAC with the locally administered bit set,
+ *       and the last three octets XORed with the role, the index and the attempt number.
+ *       So an interface gets the same MAC across reboots as long as nothing else uses it.
+ *
+ * @param[in]  base_mac base MAC, usually the station MAC
+ * @param[in]  capacity maximum number of MAC addresses in use
+ *
+ * @return
+ *     - instance: create allocator successfully
+ *     - NULL: invalid argument or out of memory
+ */
+esp_gateway_mac_allocator_t* esp_gateway_mac_allocator_create(const uint8_t base_mac[6], uint32_t capacity);
+
+/**
+ * @brief  Delete a MAC allocator.
+ *
+ * @param[in]  allocator allocator instance
+ */
+void esp_gateway_mac_allocator_delete(esp_gateway_mac_allocator_t* allocator);
+
+/**
+ * @brief  Mark a MAC address as used once more.
+ *
+ * @param[in]  allocator allocator instance
+ * @param[in]  mac MAC address
+ *
+ * @return
+ *     - ESP_OK: reserve successfully
+ *     - ESP_ERR_NO_MEM: too many MAC addresses in use
+ */
+esp_err_t esp_gateway_mac_allocator_reserve(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6]);
+
+/**
+ * @brief  Release a reference taken by esp_gateway_mac_allocator_reserve().
+ *
+ * @param[in]  allocator allocator instance
+ * @param[in]  mac MAC address
+ *
+ * @return
+ *     - ESP_OK: release successfully
+ *     - ESP_ERR_NOT_FOUND: the MAC address is not in use
+ */
+esp_err_t esp_gateway_mac_allocator_release(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6]);
+
+/**
+ * @brief  Check whether a MAC address is in use.
+ *
+ * @param[in]  allocator allocator instance
+ * @param[in]  mac MAC address
+ *
+ * @return
+ *     - true: be used
+ *     - false: not used
+ */
+bool esp_gateway_mac_allocator_is_used(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6]);
+
+/**
+ * @brief  Derive the MAC address of an interface, skipping the addresses in use.
+ *
+ * @note The address is not reserved, reserve it once it is set to the interface.
+ *
+ * @param[in]   allocator allocator instance
+ * @param[in]   role interface role
+ * @param[in]   index interface index within the role, up to ESP_GATEWAY_MAC_ALLOC_MAX_INDEX
+ * @param[out]  mac derived MAC address
+ *
+ * @return
+ *     - ESP_OK: derive successfully
+ *     - ESP_ERR_INVALID_ARG: invalid role or index
+ *     - ESP_ERR_NOT_FOUND: all the ESP_GATEWAY_MAC_ALLOC_MAX_ATTEMPTS candidates are in use
+ */
+esp_err_t esp_gateway_mac_allocator_derive(esp_gateway_mac_allocator_t* allocator, esp_gateway_mac_role_t role, uint32_t index, uint8_t mac[6]);
+
+#ifdef __cplusplus
+}
+#endif
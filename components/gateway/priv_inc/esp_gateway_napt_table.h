@@ -0,0 +1,257 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of mappings a NAPT table can hold
+ *
+ */
+#define ESP_GATEWAY_NAPT_TABLE_MAX_CAPACITY     (16384)
+
+/**
+ * @brief Maximum number of port mappings a NAPT table keeps apart, IP_PORTMAP_MAX of lwIP
+ *
+ */
+#define ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS     (32)
+
+#define ESP_GATEWAY_NAPT_UPLINK_NONE            (0xFF)  /*!< Mapping not bound to an uplink */
+
+typedef enum {
+    ESP_GATEWAY_NAPT_PROTO_TCP = 0,
+    ESP_GATEWAY_NAPT_PROTO_UDP,
+    ESP_GATEWAY_NAPT_PROTO_ICMP,            /*!< ICMP echo, the identifier is used as the port */
+    ESP_GATEWAY_NAPT_PROTO_MAX,
+} esp_gateway_napt_proto_t;
+
+/**
+ * @brief NAPT table configuration
+ *
+ */
+typedef struct {
+    uint32_t capacity;                                  /*!< Maximum number of mappings */
+    uint16_t port_min;                                  /*!< Lowest outside port, host byte order */
+    uint16_t port_max;                                  /*!< Highest outside port, host byte order */
+    uint32_t timeout_ms[ESP_GATEWAY_NAPT_PROTO_MAX];    /*!< Idle timeout of each protocol */
+    uint32_t tcp_closing_timeout_ms;                    /*!< Idle timeout of a TCP mapping after FIN or RST */
+    uint32_t hash_seed;                                 /*!< Seed of the hash, use a random value */
+} esp_gateway_napt_table_config_t;
+
+/**
+ * @brief Connection seen from the inside host. Addresses and ports are in network byte order.
+ *
+ */
+typedef struct {
+    uint32_t src_addr;      /*!< Inside host address */
+    uint32_t dest_addr;     /*!< Remote address */
+    uint16_t src_port;      /*!< Inside host port, or ICMP echo identifier */
+    uint16_t dest_port;     /*!< Remote port, 0 for ICMP */
+    uint8_t proto;          /*!< esp_gateway_napt_proto_t */
+} esp_gateway_napt_tuple_t;
+
+/**
+ * @brief Translation of a connection
+ *
+ */
+typedef struct {
+    esp_gateway_napt_tuple_t tuple;
+    uint16_t mport;         /*!< Outside port or ICMP echo identifier, network byte order */
+    bool tcp_closing;       /*!< FIN or RST seen, set by the caller */
+    uint8_t uplink;         /*!< Uplink carrying the connection, set by the caller, ESP_GATEWAY_NAPT_UPLINK_NONE after insertion */
+    uint32_t last_used;     /*!< Time of the last lookup, in milliseconds */
+    uint32_t generation;    /*!< Changes each time the mapping is reused, 0 once it is removed */
+} esp_gateway_napt_mapping_t;
+
+/**
+ * @brief NAPT table statistics
+ *
+ */
+typedef struct {
+    uint32_t capacity;          /*!< Maximum number of mappings */
+    uint32_t active;            /*!< Number of mappings in use */
+    uint32_t lookups;           /*!< Lookups in both directions */
+    uint32_t hits;              /*!< Lookups which found a live mapping */
+    uint32_t inserts;           /*!< New mappings */
+    uint32_t insert_failures;   /*!< New mappings refused because no outside port was free */
+    uint32_t evictions;         /*!< Live mappings dropped to make room, least recently used first */
+    uint32_t expirations;       /*!< Mappings dropped after their idle timeout */
+} esp_gateway_napt_table_stats_t;
+
+typedef struct esp_gateway_napt_table esp_gateway_napt_table_t;
+
+/**
+ * @brief  Create a NAPT table.
+ *
+ * @note The table is not locked, all the functions have to be called from the same task (the TCP/IP task).
+ *
+ * @param[in]  config table configuration
+ *
+ * @return
+ *     - instance: create table successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_gateway_napt_table_t* esp_gateway_napt_table_create(const esp_gateway_napt_table_config_t* config);
+
+/**
+ * @brief  Delete a NAPT table.
+ *
+ * @param[in]  table table instance
+ */
+void esp_gateway_napt_table_delete(esp_gateway_napt_table_t* table);
+
+/**
+ * @brief  Look up the mapping of an outgoing packet.
+ *
+ * @param[in]  table table instance
+ * @param[in]  tuple connection seen from the inside host
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - mapping: the live mapping, refreshed
+ *     - NULL: no mapping or it expired
+ */
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_lookup_inside(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple, uint32_t now);
+
+/**
+ * @brief  Look up the mapping of an incoming packet.
+ *
+ * @param[in]  table table instance
+ * @param[in]  proto esp_gateway_napt_proto_t
+ * @param[in]  mport outside port, network byte order
+ * @param[in]  remote_addr source address of the packet, network byte order
+ * @param[in]  remote_port source port of the packet, network byte order, 0 for ICMP
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - mapping: the live mapping, refreshed
+ *     - NULL: no mapping or it expired
+ */
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_lookup_outside(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                                                  uint32_t remote_addr, uint16_t remote_port, uint32_t now);
+
+/**
+ * @brief  Create the mapping of a new connection, evicting the least recently used one when the table is full.
+ *
+ * @param[in]  table table instance
+ * @param[in]  tuple connection seen from the inside host, must not be in the table yet
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - mapping: the new mapping
+ *     - NULL: no outside port is free for this remote endpoint
+ */
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_insert(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple, uint32_t now);
+
+/**
+ * @brief  Refresh a mapping kept by the caller without looking it up again.
+ *
+ * @param[in]  table table instance
+ * @param[in]  mapping mapping returned by the table
+ * @param[in]  generation generation of the mapping when it was returned
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - true: the mapping is refreshed
+ *     - false: the mapping was removed since, and maybe reused by another connection
+ */
+bool esp_gateway_napt_table_touch(esp_gateway_napt_table_t* table, esp_gateway_napt_mapping_t* mapping, uint32_t generation, uint32_t now);
+
+/**
+ * @brief  Remove a mapping.
+ *
+ * @param[in]  table table instance
+ * @param[in]  mapping mapping returned by the table
+ */
+void esp_gateway_napt_table_remove(esp_gateway_napt_table_t* table, esp_gateway_napt_mapping_t* mapping);
+
+/**
+ * @brief  Drop the expired mappings, starting from the least recently used one.
+ *
+ * @param[in]  table table instance
+ * @param[in]  now current time in milliseconds
+ * @param[in]  max_scan maximum number of mappings to check
+ *
+ * @return number of mappings dropped
+ */
+uint32_t esp_gateway_napt_table_expire(esp_gateway_napt_table_t* table, uint32_t now, uint32_t max_scan);
+
+/**
+ * @brief  Drop all the mappings.
+ *
+ * @param[in]  table table instance
+ */
+void esp_gateway_napt_table_flush(esp_gateway_napt_table_t* table);
+
+/**
+ * @brief  Keep a port mapped with ip_portmap_add() apart from the dynamic mappings.
+ *
+ * The table never gives the outside port of a port mapping to a connection, and tells which
+ * outgoing packets are the replies of the mapped host, so that they are left to lwIP.
+ * A port mapping of the same protocol and outside port is replaced.
+ *
+ * @param[in]  table table instance
+ * @param[in]  proto ESP_GATEWAY_NAPT_PROTO_TCP or ESP_GATEWAY_NAPT_PROTO_UDP
+ * @param[in]  mport outside port, network byte order
+ * @param[in]  inside_addr address of the mapped host, network byte order
+ * @param[in]  inside_port port of the mapped host, network byte order
+ *
+ * @return
+ *     - ESP_OK: add port mapping successfully
+ *     - ESP_ERR_INVALID_ARG: invalid protocol or port
+ *     - ESP_ERR_NO_MEM: ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS port mappings are kept already
+ */
+esp_err_t esp_gateway_napt_table_portmap_add(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                             uint32_t inside_addr, uint16_t inside_port);
+
+/**
+ * @brief  Forget a port mapping.
+ *
+ * @param[in]  table table instance
+ * @param[in]  proto esp_gateway_napt_proto_t
+ * @param[in]  mport outside port, network byte order
+ */
+void esp_gateway_napt_table_portmap_remove(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport);
+
+/**
+ * @brief  Check whether an outgoing packet comes from the host and port of a port mapping.
+ *
+ * @param[in]  table table instance
+ * @param[in]  tuple connection seen from the inside host
+ *
+ * @return
+ *     - true: the packet is a reply of a port mapping, it must not get a mapping of its own
+ *     - false: not a port mapping
+ */
+bool esp_gateway_napt_table_portmap_match(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple);
+
+/**
+ * @brief  Get the statistics of the table.
+ *
+ * @param[in]   table table instance
+ * @param[out]  stats statistics
+ */
+void esp_gateway_napt_table_get_stats(esp_gateway_napt_table_t* table, esp_gateway_napt_table_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,147 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif_types.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of netifs a registry can hold
+ *
+ */
+#define ESP_GATEWAY_NETIF_REGISTRY_MAX_CAPACITY     (64)
+
+typedef enum {
+    ESP_GATEWAY_NETIF_ROLE_EXTERNAL = 0,    /*!< Netif used to connect to the external network */
+    ESP_GATEWAY_NETIF_ROLE_DHCPS,           /*!< Data-forwarding netif with DHCP server enabled */
+    ESP_GATEWAY_NETIF_ROLE_MAX,
+} esp_gateway_netif_role_t;
+
+#define ESP_GATEWAY_NETIF_ROLE_BIT(role)    (1UL << (role))
+#define ESP_GATEWAY_NETIF_ROLE_ALL          (ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_MAX) - 1)
+
+/**
+ * @brief Cached information of a netif held by the registry
+ *
+ */
+typedef struct {
+    esp_netif_t* netif;
+    esp_gateway_netif_role_t role;
+    esp_netif_ip_info_t ip_info;
+    uint8_t mac[6];
+} esp_gateway_netif_entry_t;
+
+typedef struct esp_gateway_netif_registry esp_gateway_netif_registry_t;
+
+/**
+ * @brief  Create a netif registry.
+ *
+ * @note Writers are serialized internally. All the read functions are lock-free and
+ *       can be called from event handlers, they retry if a writer updated the registry meanwhile.
+ *
+ * @param[in]  capacity maximum number of netifs, up to ESP_GATEWAY_NETIF_REGISTRY_MAX_CAPACITY
+ *
+ * @return
+ *     - instance: create registry successfully
+ *     - NULL: invalid capacity or out of memory
+ */
+esp_gateway_netif_registry_t* esp_gateway_netif_registry_create(uint32_t capacity);
+
+/**
+ * @brief  Delete a netif registry.
+ *
+ * @param[in]  registry registry instance
+ */
+void esp_gateway_netif_registry_delete(esp_gateway_netif_registry_t* registry);
+
+/**
+ * @brief  Add a netif to the registry.
+ *
+ * @param[in]  registry registry instance
+ * @param[in]  entry netif handle, role and the current IP/MAC information
+ *
+ * @return
+ *     - ESP_OK: add netif successfully
+ *     - ESP_ERR_INVALID_STATE: the netif has been added already
+ *     - ESP_ERR_NO_MEM: the registry is full
+ */
+esp_err_t esp_gateway_netif_registry_add(esp_gateway_netif_registry_t* registry, const esp_gateway_netif_entry_t* entry);
+
+/**
+ * @brief  Remove a netif from the registry.
+ *
+ * @param[in]   registry registry instance
+ * @param[in]   netif netif handle
+ * @param[out]  removed the removed entry, can be NULL
+ *
+ * @return
+ *     - ESP_OK: remove netif successfully
+ *     - ESP_ERR_NOT_FOUND: the netif is not in the registry
+ */
+esp_err_t esp_gateway_netif_registry_remove(esp_gateway_netif_registry_t* registry, esp_netif_t* netif, esp_gateway_netif_entry_t* removed);
+
+/**
+ * @brief  Refresh the cached IP and/or MAC information of a netif.
+ *
+ * @param[in]   registry registry instance
+ * @param[in]   netif netif handle
+ * @param[in]   ip_info new IP information, NULL to keep the cached one
+ * @param[in]   mac new MAC address, NULL to keep the cached one
+ * @param[out]  previous the entry before the update, can be NULL
+ *
+ * @return
+ *     - ESP_OK: refresh successfully
+ *     - ESP_ERR_NOT_FOUND: the netif is not in the registry
+ */
+esp_err_t esp_gateway_netif_registry_update(esp_gateway_netif_registry_t* registry, esp_netif_t* netif,
+                                            const esp_netif_ip_info_t* ip_info, const uint8_t mac[6],
+                                            esp_gateway_netif_entry_t* previous);
+
+/**
+ * @brief  Look up the cached information of a netif.
+ *
+ * @param[in]   registry registry instance
+ * @param[in]   netif netif handle
+ * @param[out]  entry cached information, can be NULL to only check the presence
+ *
+ * @return
+ *     - true: the netif is in the registry
+ *     - false: the netif is not in the registry
+ */
+bool esp_gateway_netif_registry_find(esp_gateway_netif_registry_t* registry, esp_netif_t* netif, esp_gateway_netif_entry_t* entry);
+
+/**
+ * @brief  Copy a consistent snapshot of the netifs having one of the given roles.
+ *
+ * @param[in]   registry registry instance
+ * @param[in]   role_mask bitmask of ESP_GATEWAY_NETIF_ROLE_BIT()
+ * @param[out]  entries output array, in the order the netifs were added
+ * @param[in]   max_num size of the output array
+ *
+ * @return number of entries copied
+ */
+uint32_t esp_gateway_netif_registry_snapshot(esp_gateway_netif_registry_t* registry, uint32_t role_mask,
+                                             esp_gateway_netif_entry_t* entries, uint32_t max_num);
+
+#ifdef __cplusplus
+}
+#endif
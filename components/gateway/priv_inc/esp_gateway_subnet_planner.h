@@ -0,0 +1,63 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif_types.h"
+
+#include "esp_gateway_subnet_pool.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Subnet assignment of one data-forwarding netif
+ *
+ */
+typedef struct {
+    esp_netif_t* netif;
+    esp_netif_ip_info_t current;    /*!< IP information the netif uses now */
+    esp_netif_ip_info_t planned;    /*!< IP information the netif shall use, filled by the planner */
+    bool changed;                   /*!< Whether planned differs from current, filled by the planner */
+} esp_gateway_subnet_plan_item_t;
+
+/**
+ * @brief  Compute a conflict-free subnet assignment for all the data-forwarding netifs in one pass.
+ *
+ * A netif keeps its subnet unless it overlaps one of the occupied networks or a netif earlier in the array,
+ * the others are moved to the lowest free subnets of the pool. Nothing is changed when the pool is exhausted.
+ *
+ * @param[in]      config address pool the subnets are allocated from
+ * @param[in]      occupied networks used by the external netifs and the LiteMesh network
+ * @param[in]      occupied_num number of occupied networks
+ * @param[in,out]  items data-forwarding netifs, in priority order
+ * @param[in]      item_num number of data-forwarding netifs
+ *
+ * @return
+ *     - ESP_OK: every item is filled, check changed to know which ones shall be applied
+ *     - ESP_ERR_NOT_FOUND: the pool is exhausted, every item is left unchanged
+ *     - ESP_ERR_NO_MEM: out of memory
+ */
+esp_err_t esp_gateway_subnet_plan(const esp_gateway_subnet_pool_config_t* config,
+                                  const esp_netif_ip_info_t* occupied, uint32_t occupied_num,
+                                  esp_gateway_subnet_plan_item_t* items, uint32_t item_num);
+
+#ifdef __cplusplus
+}
+#endif
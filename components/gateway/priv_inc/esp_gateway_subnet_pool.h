@@ -0,0 +1,127 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif_types.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Maximum number of subnets a pool can be split into, e.g. 172.16.0.0/12 split into /24
+ *
+ */
+#define ESP_GATEWAY_SUBNET_POOL_MAX_SUBNETS     (4096)
+
+/**
+ * @brief Address pool the data-forwarding netif subnets are allocated from
+ *
+ */
+typedef struct {
+    esp_ip4_addr_t base;        /*!< Network address of the pool, e.g. 192.168.0.0 */
+    uint8_t prefix_len;         /*!< Prefix length of the pool, e.g. 16 */
+    uint8_t subnet_prefix_len;  /*!< Prefix length of each allocated subnet, e.g. 24 */
+    uint16_t first_index;       /*!< Subnets below this index are never allocated, e.g. 4 to start from 192.168.4.0/24 */
+} esp_gateway_subnet_pool_config_t;
+
+typedef struct esp_gateway_subnet_pool esp_gateway_subnet_pool_t;
+
+/**
+ * @brief  Create a subnet pool.
+ *
+ * @param[in]  config pool configuration
+ *
+ * @return
+ *     - instance: create pool successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_gateway_subnet_pool_t* esp_gateway_subnet_pool_create(const esp_gateway_subnet_pool_config_t* config);
+
+/**
+ * @brief  Delete a subnet pool.
+ *
+ * @param[in]  pool pool instance
+ */
+void esp_gateway_subnet_pool_delete(esp_gateway_subnet_pool_t* pool);
+
+/**
+ * @brief  Mark the subnet containing the IP address as used once more.
+ *
+ * @note The subnet stays occupied until it is released as many times as it was referenced.
+ *
+ * @param[in]  pool pool instance
+ * @param[in]  ip IP address
+ *
+ * @return
+ *     - true: the IP address belongs to the pool
+ *     - false: the IP address is outside the pool, nothing to do
+ */
+bool esp_gateway_subnet_pool_ref(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip);
+
+/**
+ * @brief  Release a reference taken by esp_gateway_subnet_pool_ref().
+ *
+ * @param[in]  pool pool instance
+ * @param[in]  ip IP address
+ *
+ * @return
+ *     - true: the IP address belongs to the pool
+ *     - false: the IP address is outside the pool, nothing to do
+ */
+bool esp_gateway_subnet_pool_unref(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip);
+
+/**
+ * @brief  Check whether the subnet containing the IP address is used.
+ *
+ * @param[in]  pool pool instance
+ * @param[in]  ip IP address
+ *
+ * @return
+ *     - true: be used or reserved
+ *     - false: free or outside the pool
+ */
+bool esp_gateway_subnet_pool_is_used(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip);
+
+/**
+ * @brief  Get the lowest free subnet of the pool.
+ *
+ * @note The subnet is not marked as used, it will be once the netif using it is referenced.
+ *
+ * @param[in]   pool pool instance
+ * @param[out]  ip_info first host address of the subnet as IP and gateway, and the subnet mask
+ *
+ * @return
+ *     - ESP_OK: find a free subnet
+ *     - ESP_ERR_NOT_FOUND: the pool is exhausted
+ */
+esp_err_t esp_gateway_subnet_pool_alloc(esp_gateway_subnet_pool_t* pool, esp_netif_ip_info_t* ip_info);
+
+/**
+ * @brief  Number of subnets which can still be allocated.
+ *
+ * @param[in]  pool pool instance
+ *
+ * @return number of free subnets
+ */
+uint32_t esp_gateway_subnet_pool_free_count(esp_gateway_subnet_pool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "esp_gateway_napt_table.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS  (4)
+#define ESP_GATEWAY_WAN_POLICY_MAX_WEIGHT   (16)
+
+/**
+ * @brief WAN policy configuration
+ *
+ */
+typedef struct {
+    uint8_t fall_count;     /*!< Consecutive lost probes to mark an uplink unhealthy */
+    uint8_t rise_count;     /*!< Consecutive answered probes to mark an unhealthy uplink healthy again */
+    uint32_t hash_seed;     /*!< Seed of the flow hash, use a random value */
+} esp_gateway_wan_policy_config_t;
+
+/**
+ * @brief State and statistics of an uplink
+ *
+ */
+typedef struct {
+    void* netif;                /*!< Netif of the uplink, NULL for a free slot */
+    uint8_t weight;             /*!< Share of the new flows, from 1 to ESP_GATEWAY_WAN_POLICY_MAX_WEIGHT */
+    bool link_up;               /*!< Netif up with an IP address */
+    bool healthy;               /*!< Probes answered */
+    uint32_t rtt_ms;            /*!< Smoothed round trip time of the probes */
+    uint32_t flows;             /*!< New flows assigned to the uplink */
+    uint32_t probes;            /*!< Probes reported */
+    uint32_t probes_lost;       /*!< Probes not answered */
+    uint32_t failovers;         /*!< Times the uplink became unusable */
+    uint32_t last_change_ms;    /*!< Time the uplink last became usable or unusable */
+} esp_gateway_wan_uplink_t;
+
+typedef struct esp_gateway_wan_policy esp_gateway_wan_policy_t;
+
+/**
+ * @brief  Create a WAN policy.
+ *
+ * @note The policy is not locked, it is meant to be used from the TCP/IP task.
+ *
+ * @param[in]  config policy configuration
+ *
+ * @return
+ *     - instance: create policy successfully
+ *     - NULL: invalid configuration or out of memory
+ */
+esp_gateway_wan_policy_t* esp_gateway_wan_policy_create(const esp_gateway_wan_policy_config_t* config);
+
+/**
+ * @brief  Delete a WAN policy.
+ *
+ * @param[in]  policy policy instance
+ */
+void esp_gateway_wan_policy_delete(esp_gateway_wan_policy_t* policy);
+
+/**
+ * @brief  Add an uplink, healthy until its probes are lost. Its link is down until esp_gateway_wan_policy_set_link().
+ *
+ * @param[in]   policy policy instance
+ * @param[in]   netif netif of the uplink
+ * @param[in]   weight share of the new flows
+ * @param[out]  index index of the uplink
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: invalid weight
+ *     - ESP_ERR_INVALID_STATE: the netif is already an uplink
+ *     - ESP_ERR_NO_MEM: too many uplinks
+ */
+esp_err_t esp_gateway_wan_policy_add(esp_gateway_wan_policy_t* policy, void* netif, uint8_t weight, uint8_t* index);
+
+/**
+ * @brief  Remove an uplink, its index may be reused by the next uplink added.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  index index of the uplink
+ */
+void esp_gateway_wan_policy_remove(esp_gateway_wan_policy_t* policy, uint8_t index);
+
+/**
+ * @brief  Find the uplink of a netif.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  netif netif
+ *
+ * @return
+ *     - index of the uplink
+ *     - ESP_GATEWAY_NAPT_UPLINK_NONE: the netif is not an uplink
+ */
+uint8_t esp_gateway_wan_policy_find(esp_gateway_wan_policy_t* policy, const void* netif);
+
+/**
+ * @brief  Change the share of the new flows of an uplink, the flows already assigned stay on it.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  index index of the uplink
+ * @param[in]  weight share of the new flows
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG: invalid index or weight
+ */
+esp_err_t esp_gateway_wan_policy_set_weight(esp_gateway_wan_policy_t* policy, uint8_t index, uint8_t weight);
+
+/**
+ * @brief  Update the link state of an uplink.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  index index of the uplink
+ * @param[in]  up whether the netif is up with an IP address
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - true: the uplink became usable or unusable
+ *     - false: no change
+ */
+bool esp_gateway_wan_policy_set_link(esp_gateway_wan_policy_t* policy, uint8_t index, bool up, uint32_t now);
+
+/**
+ * @brief  Report the result of a health probe of an uplink.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  index index of the uplink
+ * @param[in]  answered whether the probe was answered in time
+ * @param[in]  rtt_ms round trip time of an answered probe
+ * @param[in]  now current time in milliseconds
+ *
+ * @return
+ *     - true: the uplink became usable or unusable
+ *     - false: no change
+ */
+bool esp_gateway_wan_policy_report_probe(esp_gateway_wan_policy_t* policy, uint8_t index, bool answered, uint32_t rtt_ms, uint32_t now);
+
+/**
+ * @brief  Whether an uplink can carry flows, namely its link is up and it is healthy.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  index index of the uplink
+ *
+ * @return
+ *     - true: usable
+ *     - false: unusable or invalid index
+ */
+bool esp_gateway_wan_policy_usable(esp_gateway_wan_policy_t* policy, uint8_t index);
+
+/**
+ * @brief  Whether any uplink can carry flows.
+ *
+ * @param[in]  policy policy instance
+ *
+ * @return
+ *     - true: at least one uplink is usable
+ *     - false: none
+ */
+bool esp_gateway_wan_policy_any_usable(esp_gateway_wan_policy_t* policy);
+
+/**
+ * @brief  Select the uplink of a new flow, by a weighted rendezvous hash of its tuple over the usable uplinks.
+ *         When an uplink becomes unusable, only its own flows move to the other ones.
+ *
+ * @param[in]  policy policy instance
+ * @param[in]  tuple inside tuple of the flow
+ *
+ * @return
+ *     - index of the uplink
+ *     - ESP_GATEWAY_NAPT_UPLINK_NONE: no usable uplink
+ */
+uint8_t esp_gateway_wan_policy_select(esp_gateway_wan_policy_t* policy, const esp_gateway_napt_tuple_t* tuple);
+
+/**
+ * @brief  Get the state and statistics of an uplink.
+ *
+ * @param[in]   policy policy instance
+ * @param[in]   index index of the uplink
+ * @param[out]  uplink state and statistics, netif is NULL for a free slot
+ */
+void esp_gateway_wan_policy_get_uplink(esp_gateway_wan_policy_t* policy, uint8_t index, esp_gateway_wan_uplink_t* uplink);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,54 +22,338 @@
 #include <sys/select.h>
 
 #include "esp_log.h"
+#include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 #include "lwip/ip_addr.h"
+#include "lwip/lwip_napt.h"
 #include "dhcpserver/dhcpserver.h"
 
 #include "esp_gateway.h"
 #include "esp_gateway_internal.h"
 #include "esp_gateway_litemesh.h"
+#include "esp_gateway_netif_registry.h"
+#include "esp_gateway_subnet_pool.h"
+#include "esp_gateway_subnet_planner.h"
+#include "esp_gateway_mac_alloc.h"
+#include "esp_gateway_dns_proxy.h"
 
 // DHCP_Server has to be enabled for this netif
 #define DHCPS_NETIF_ID(netif) (ESP_NETIF_DHCP_SERVER & esp_netif_get_flags(netif))
 
-typedef struct gateway_netif {
-    esp_netif_t* netif;
-    struct gateway_netif* next;
-} gateway_netif_t;
+#define GATEWAY_NETIF_ROLE(netif) (DHCPS_NETIF_ID(netif) ? ESP_GATEWAY_NETIF_ROLE_DHCPS : ESP_GATEWAY_NETIF_ROLE_EXTERNAL)
 
 static const char* TAG = "gateway_common";
-static gateway_netif_t* gateway_link = NULL;
+static esp_gateway_netif_registry_t* gateway_registry = NULL;
+static esp_gateway_subnet_pool_t* gateway_subnet_pool = NULL;
+static esp_gateway_subnet_pool_config_t gateway_subnet_pool_config;
+static esp_gateway_mac_allocator_t* gateway_mac_allocator = NULL;
+static uint32_t gateway_generic_mac_index = 0;
+#if CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS
+/* The debounced plans run in the event loop task, like the IP events which schedule them */
+static ESP_EVENT_DEFINE_BASE(GATEWAY_REPLAN_EVENT);
+static esp_timer_handle_t gateway_replan_timer = NULL;
+#endif
+#if CONFIG_LITEMESH_ENABLE
+static uint32_t litemesh_segment_map[256 / 32];
+#endif
 
-esp_err_t esp_gateway_netif_list_add(esp_netif_t* netif)
+static inline bool esp_gateway_mac_is_zero(const uint8_t mac[6])
 {
-    gateway_netif_t* new = gateway_link;
-    gateway_netif_t* tail = NULL;
+    static const uint8_t zero_mac[6] = { 0 };
+    return !memcmp(mac, zero_mac, sizeof(zero_mac));
+}
+
+/* A full registry is too large to copy on the stack of the event loop task, the snapshots are taken on the heap */
+static esp_gateway_netif_entry_t* esp_gateway_netif_snapshot(uint32_t role_mask, uint32_t* count)
+{
+    esp_gateway_netif_entry_t* entries = malloc(CONFIG_GATEWAY_NETIF_REGISTRY_SIZE * sizeof(esp_gateway_netif_entry_t));
+
+    *count = 0;
+    if (entries) {
+        *count = esp_gateway_netif_registry_snapshot(gateway_registry, role_mask, entries, CONFIG_GATEWAY_NETIF_REGISTRY_SIZE);
+    }
+
+    return entries;
+}
+
+/* Refresh the cached IP of the netif and move its subnet reference accordingly */
+static void esp_gateway_netif_cache_ip_info(esp_netif_t* netif, const esp_netif_ip_info_t* ip_info)
+{
+    esp_gateway_netif_entry_t previous;
+
+    if (esp_gateway_netif_registry_update(gateway_registry, netif, ip_info, NULL, &previous) != ESP_OK) {
+        return;
+    }
 
-    while (new) {
-        if (new->netif == netif) {
-            return ESP_ERR_DUPLICATE_ADDITION;
+    if (previous.ip_info.ip.addr != ip_info->ip.addr) {
+#if CONFIG_GATEWAY_FAST_PATH
+        /* The routes and translations learned with the old address are wrong now */
+        esp_gateway_fast_path_flush();
+#endif
+        if (previous.ip_info.ip.addr) {
+            esp_gateway_subnet_pool_unref(gateway_subnet_pool, previous.ip_info.ip);
+        }
+        if (ip_info->ip.addr) {
+            esp_gateway_subnet_pool_ref(gateway_subnet_pool, ip_info->ip);
         }
-        tail = new;
-        new = new->next;
     }
+}
 
-    // not found, create a new
-    new = (gateway_netif_t*)malloc(sizeof(gateway_netif_t));
-    if (new == NULL) {
-        ESP_LOGE(TAG, "add fail");
-        return ESP_ERR_NO_MEM;
+static void esp_gateway_netif_dhcps_apply(esp_netif_t* netif, const esp_netif_ip_info_t* ip_info)
+{
+    ESP_ERROR_CHECK(esp_netif_dhcps_stop(netif));
+    esp_netif_set_ip_info(netif, ip_info);
+    esp_gateway_netif_cache_ip_info(netif, ip_info);
+    ESP_LOGI(TAG, "ip reallocate new:" IPSTR, IP2STR(&ip_info->ip));
+
+    esp_gateway_netif_dhcps_offer_dns(netif);
+    esp_netif_dhcps_start(netif);
+}
+
+/* Plan the subnets of all the data-forwarding netifs at once, then restart only the DHCP servers that move */
+static void esp_gateway_netif_network_segment_replan(void)
+{
+    esp_gateway_netif_entry_t* entries = NULL;
+    esp_gateway_subnet_plan_item_t* items = NULL;
+    esp_netif_ip_info_t* occupied = NULL;
+    uint32_t occupied_num = 0;
+    uint32_t litemesh_num = 0;
+    uint32_t item_num = 0;
+    uint32_t count = 0;
+    bool moved = false;
+
+#if CONFIG_LITEMESH_ENABLE
+    for (uint32_t word = 0; word < sizeof(litemesh_segment_map) / sizeof(litemesh_segment_map[0]); word++) {
+        litemesh_num += __builtin_popcount(litemesh_segment_map[word]);
     }
-    new->netif = netif;
-    new->next = NULL;
+#endif
 
-    if (tail == NULL) { // the first one
-        gateway_link = new;
+    occupied = calloc(CONFIG_GATEWAY_NETIF_REGISTRY_SIZE + litemesh_num, sizeof(esp_netif_ip_info_t));
+    items = calloc(CONFIG_GATEWAY_NETIF_REGISTRY_SIZE, sizeof(esp_gateway_subnet_plan_item_t));
+    entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_EXTERNAL), &count);
+    if ((occupied == NULL) || (items == NULL) || (entries == NULL)) {
+        ESP_LOGE(TAG, "replan fail, no mem");
+        free(occupied);
+        free(items);
+        free(entries);
+        return;
+    }
+
+    for (uint32_t loop = 0; loop < count; loop++) {
+        if (entries[loop].ip_info.ip.addr) {
+            occupied[occupied_num++] = entries[loop].ip_info;
+        }
+    }
+
+#if CONFIG_LITEMESH_ENABLE
+    /* The planner checks the /24 of each LiteMesh segment against subnets of any size */
+    for (uint32_t word = 0; word < sizeof(litemesh_segment_map) / sizeof(litemesh_segment_map[0]); word++) {
+        uint32_t map = litemesh_segment_map[word];
+        while (map) {
+            uint32_t segment = word * 32 + __builtin_ctz(map);
+            occupied[occupied_num].ip = esp_gateway_network_segment_to_addr(segment);
+            occupied[occupied_num].netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+            occupied_num++;
+            map &= map - 1;
+        }
+    }
+#endif
+
+    count = esp_gateway_netif_registry_snapshot(gateway_registry, ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_DHCPS),
+                                                entries, CONFIG_GATEWAY_NETIF_REGISTRY_SIZE);
+    for (uint32_t loop = 0; loop < count; loop++) {
+        items[item_num].netif = entries[loop].netif;
+        items[item_num].current = entries[loop].ip_info;
+        item_num++;
+    }
+
+    if (esp_gateway_subnet_plan(&gateway_subnet_pool_config, occupied, occupied_num, items, item_num) != ESP_OK) {
+        ESP_LOGE(TAG, "No conflict-free network segment plan, keep the current one");
     } else {
-        tail->next = new;
+        for (uint32_t loop = 0; loop < item_num; loop++) {
+            if (items[loop].changed) {
+                esp_gateway_netif_dhcps_apply(items[loop].netif, &items[loop].planned);
+                moved = true;
+            }
+        }
     }
+
+    free(occupied);
+    free(items);
+    free(entries);
+
+#if CONFIG_LITEMESH_ROUTED
+    /* The segments this node routes to are announced to the parent */
+    if (moved) {
+        esp_litemesh_route_refresh();
+    }
+#endif
+#if CONFIG_LITEMESH_MULTI_ROOT
+    /* And to the nodes of the other trees */
+    if (moved) {
+        esp_litemesh_tree_refresh();
+    }
+#endif
+    (void)moved;
+}
+
+#if CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS
+/* The plan restarts DHCP servers and may block, it is handed over to the event loop task */
+static void esp_gateway_netif_replan_timer_cb(void* arg)
+{
+    if (esp_event_post(GATEWAY_REPLAN_EVENT, 0, NULL, 0, 0) != ESP_OK) {
+        /* The event queue is full, try again later */
+        esp_timer_start_once(gateway_replan_timer, CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS * 1000);
+    }
+}
+
+static void esp_gateway_netif_replan_event_handler(void* arg, esp_event_base_t event_base,
+                                                   int32_t event_id, void* event_data)
+{
+    esp_gateway_netif_network_segment_replan();
+}
+#endif
+
+/* Bursts of IP events are coalesced into a single plan */
+static void esp_gateway_netif_network_segment_replan_schedule(void)
+{
+#if CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS
+    if (gateway_replan_timer) {
+        esp_timer_stop(gateway_replan_timer);
+        esp_timer_start_once(gateway_replan_timer, CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS * 1000);
+        return;
+    }
+#endif
+    esp_gateway_netif_network_segment_replan();
+}
+
+/* Keep the cached IP information up to date, the netif list is never walked through esp_netif on the hot paths */
+static void esp_gateway_netif_ip_event_handler(void* arg, esp_event_base_t event_base,
+                                               int32_t event_id, void* event_data)
+{
+    esp_netif_ip_info_t netif_ip = { 0 };
+
+    switch (event_id) {
+    case IP_EVENT_STA_GOT_IP:
+    case IP_EVENT_ETH_GOT_IP:
+    case IP_EVENT_PPP_GOT_IP: {
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
+        esp_gateway_netif_cache_ip_info(event->esp_netif, &event->ip_info);
+        esp_gateway_netif_network_segment_replan_schedule();
+        break;
+    }
+
+    case IP_EVENT_STA_LOST_IP:
+    case IP_EVENT_ETH_LOST_IP:
+    case IP_EVENT_PPP_LOST_IP: {
+        /* The lost IP event does not tell which netif it is, refresh all the external netifs */
+        uint32_t count = 0;
+        esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_EXTERNAL), &count);
+        for (uint32_t loop = 0; loop < count; loop++) {
+            esp_netif_get_ip_info(entries[loop].netif, &netif_ip);
+            esp_gateway_netif_cache_ip_info(entries[loop].netif, &netif_ip);
+        }
+        free(entries);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static esp_err_t esp_gateway_netif_registry_init(void)
+{
+    if (gateway_registry) {
+        return ESP_OK;
+    }
+
+    gateway_subnet_pool_config.base.addr = esp_ip4addr_aton(CONFIG_GATEWAY_SUBNET_POOL_BASE);
+    gateway_subnet_pool_config.prefix_len = CONFIG_GATEWAY_SUBNET_POOL_PREFIX_LEN;
+    gateway_subnet_pool_config.subnet_prefix_len = CONFIG_GATEWAY_SUBNET_PREFIX_LEN;
+    gateway_subnet_pool_config.first_index = CONFIG_GATEWAY_SUBNET_POOL_FIRST_INDEX;
+    gateway_subnet_pool = esp_gateway_subnet_pool_create(&gateway_subnet_pool_config);
+    if (gateway_subnet_pool == NULL) {
+        ESP_LOGE(TAG, "subnet pool create fail, check the address pool configuration");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* The derived MACs of data-forwarding netifs must not collide with the factory ones */
+    const esp_mac_type_t factory_mac_type[] = { ESP_MAC_WIFI_STA, ESP_MAC_WIFI_SOFTAP, ESP_MAC_BT, ESP_MAC_ETH };
+    uint8_t mac[6] = { 0 };
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    gateway_mac_allocator = esp_gateway_mac_allocator_create(mac, CONFIG_GATEWAY_NETIF_REGISTRY_SIZE + sizeof(factory_mac_type) / sizeof(factory_mac_type[0]));
+    gateway_registry = esp_gateway_netif_registry_create(CONFIG_GATEWAY_NETIF_REGISTRY_SIZE);
+    if ((gateway_registry == NULL) || (gateway_mac_allocator == NULL)) {
+        ESP_LOGE(TAG, "registry create fail");
+        esp_gateway_netif_registry_delete(gateway_registry);
+        esp_gateway_mac_allocator_delete(gateway_mac_allocator);
+        esp_gateway_subnet_pool_delete(gateway_subnet_pool);
+        gateway_registry = NULL;
+        gateway_mac_allocator = NULL;
+        gateway_subnet_pool = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t loop = 0; loop < sizeof(factory_mac_type) / sizeof(factory_mac_type[0]); loop++) {
+        if (esp_read_mac(mac, factory_mac_type[loop]) == ESP_OK) {
+            esp_gateway_mac_allocator_reserve(gateway_mac_allocator, mac);
+        }
+    }
+
+#if CONFIG_GATEWAY_SUBNET_REPLAN_DEBOUNCE_MS
+    esp_timer_create_args_t replan_timer_args = {
+        .callback = &esp_gateway_netif_replan_timer_cb,
+        .name = "gateway_replan",
+    };
+    if ((esp_event_handler_instance_register(GATEWAY_REPLAN_EVENT, ESP_EVENT_ANY_ID, &esp_gateway_netif_replan_event_handler, NULL, NULL) != ESP_OK)
+        || (esp_timer_create(&replan_timer_args, &gateway_replan_timer) != ESP_OK)) {
+        ESP_LOGW(TAG, "replan timer create fail, network segments will be planned without debounce");
+    }
+#endif
+
+    if (esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &esp_gateway_netif_ip_event_handler, NULL, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "IP event handler register fail, cached IP of external netif will not be refreshed");
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_netif_list_add(esp_netif_t* netif)
+{
+    esp_gateway_netif_entry_t entry = { 0 };
+    esp_err_t ret = esp_gateway_netif_registry_init();
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    entry.netif = netif;
+    entry.role = GATEWAY_NETIF_ROLE(netif);
+    esp_netif_get_ip_info(netif, &entry.ip_info);
+    esp_netif_get_mac(netif, entry.mac);
+
+    ret = esp_gateway_netif_registry_add(gateway_registry, &entry);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return ESP_ERR_DUPLICATE_ADDITION;
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "add fail");
+        return ret;
+    }
+    if (entry.ip_info.ip.addr) {
+        esp_gateway_subnet_pool_ref(gateway_subnet_pool, entry.ip_info.ip);
+    }
+    if (!esp_gateway_mac_is_zero(entry.mac)) {
+        esp_gateway_mac_allocator_reserve(gateway_mac_allocator, entry.mac);
+    }
+#if CONFIG_GATEWAY_MULTI_WAN
+    if (entry.role == ESP_GATEWAY_NETIF_ROLE_EXTERNAL) {
+        esp_gateway_multi_wan_add_uplink(netif);
+    }
+#endif
     ESP_LOGI(TAG, "add success");
 
     return ESP_OK;
@@ -77,168 +361,321 @@ esp_err_t esp_gateway_netif_list_add(esp_netif_t* netif)
 
 esp_err_t esp_gateway_netif_list_remove(esp_netif_t* netif)
 {
-    gateway_netif_t* current = gateway_link;
-    gateway_netif_t* prev = NULL;
-
-    while (current) {
-        if (current->netif == netif) {
-            if (prev == NULL) {
-                gateway_link = gateway_link->next;
-            } else {
-                prev->next = current->next;
-            }
-            free(current);
-            break;
-        }
+    esp_gateway_netif_entry_t entry;
+
+    if (esp_gateway_netif_registry_remove(gateway_registry, netif, &entry) != ESP_OK) {
+        return ESP_OK;
+    }
+
+#if CONFIG_GATEWAY_MULTI_WAN
+    if (entry.role == ESP_GATEWAY_NETIF_ROLE_EXTERNAL) {
+        esp_gateway_multi_wan_remove_uplink(netif);
+    }
+#endif
+#if CONFIG_GATEWAY_FAST_PATH
+    esp_gateway_fast_path_flush();
+#endif
 
-        prev = current;
-        current = current->next;
+    if (entry.ip_info.ip.addr) {
+        esp_gateway_subnet_pool_unref(gateway_subnet_pool, entry.ip_info.ip);
+    }
+    if (!esp_gateway_mac_is_zero(entry.mac)) {
+        esp_gateway_mac_allocator_release(gateway_mac_allocator, entry.mac);
     }
 
     return ESP_OK;
 }
 
+/*
+ * A network segment is the index of a /24 in the address pool, so that it fits in the byte LiteMesh carries.
+ * With the default 192.168.0.0/16 pool, it is the third octet of the address.
+ */
+bool esp_gateway_network_segment_from_addr(esp_ip4_addr_t ip, uint8_t* net_segment)
+{
+    uint32_t base = esp_netif_htonl(gateway_subnet_pool_config.base.addr);
+    uint32_t offset = esp_netif_htonl(ip.addr) - base;
+
+    if ((base == 0) || (offset >> (32 - gateway_subnet_pool_config.prefix_len)) || (offset >= (256UL << 8))) {
+        return false;
+    }
+
+    *net_segment = offset >> 8;
+    return true;
+}
+
+esp_ip4_addr_t esp_gateway_network_segment_to_addr(uint8_t net_segment)
+{
+    esp_ip4_addr_t ip = {
+        .addr = esp_netif_htonl(esp_netif_htonl(gateway_subnet_pool_config.base.addr) + ((uint32_t)net_segment << 8))
+    };
+
+    return ip;
+}
+
 esp_err_t esp_gateway_get_external_netif_network_segment(uint8_t* net_segment, uint32_t* max_num)
 {
-    gateway_netif_t* p = gateway_link;
-    esp_netif_ip_info_t netif_ip;
     uint32_t count = 0;
-    while (p && (count < *max_num)) {
-        if (!DHCPS_NETIF_ID(p->netif)) {
-            esp_netif_get_ip_info(p->netif, &netif_ip);
-            if ((esp_ip4_addr1_16(&netif_ip.ip) == 192)
-                && (esp_ip4_addr2_16(&netif_ip.ip) == 168)) {
-                net_segment[count++] = esp_ip4_addr3_16(&netif_ip.ip);
-            }
+    uint32_t num = 0;
+    esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_EXTERNAL), &num);
+
+    if (entries == NULL) {
+        *max_num = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t loop = 0; (loop < num) && (count < *max_num); loop++) {
+        if (esp_gateway_network_segment_from_addr(entries[loop].ip_info.ip, &net_segment[count])) {
+            count++;
         }
-        p = p->next;
     }
+    free(entries);
 
     *max_num = count;
     return ESP_OK;
 }
 
-static bool esp_gateway_netif_network_segment_is_used(uint32_t ip)
+esp_err_t esp_gateway_get_data_forwarding_netif_network_segment(uint8_t* net_segment, uint32_t* max_num)
 {
-    gateway_netif_t* p = gateway_link;
-    esp_netif_ip_info_t netif_ip = { 0 };
-    while (p) {
-        esp_netif_get_ip_info(p->netif, &netif_ip);
-        if (esp_ip4_addr3_16((esp_ip4_addr_t*)&ip) == esp_ip4_addr3_16(&netif_ip.ip)) {
-            return true;
+    uint32_t count = 0;
+    uint32_t num = 0;
+    esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_DHCPS), &num);
+
+    if (entries == NULL) {
+        *max_num = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t loop = 0; (loop < num) && (count < *max_num); loop++) {
+        if (esp_gateway_network_segment_from_addr(entries[loop].ip_info.ip, &net_segment[count])) {
+            count++;
         }
+    }
+    free(entries);
+
+    *max_num = count;
+    return ESP_OK;
+}
 
-        p = p->next;
+esp_err_t esp_gateway_data_forwarding_netif_napt_enable(bool enable)
+{
+    uint32_t num = 0;
+    esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_DHCPS), &num);
+
+    if (entries == NULL) {
+        return ESP_ERR_NO_MEM;
     }
 
-    return false;
+    for (uint32_t loop = 0; loop < num; loop++) {
+        if (entries[loop].ip_info.ip.addr) {
+            ip_napt_enable(entries[loop].ip_info.ip.addr, enable);
+        }
+    }
+    free(entries);
+
+    return ESP_OK;
 }
 
-esp_err_t esp_gateway_netif_request_ip(esp_netif_ip_info_t* ip_info)
+esp_err_t esp_gateway_get_external_netif_dns(uint32_t* servers, uint32_t* max_num)
 {
-    bool ip_segment_is_used = true;
+    esp_netif_dns_type_t types[] = { ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP };
+    uint32_t count = 0;
+    uint32_t num = 0;
+    esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_EXTERNAL), &num);
 
-    for (uint8_t gateway_ip = 4; gateway_ip < 255; gateway_ip++) {
-        ip_segment_is_used = esp_gateway_netif_network_segment_is_used(ESP_IP4TOADDR(192, 168, gateway_ip, 1));
-#if CONFIG_LITEMESH_ENABLE
-        ip_segment_is_used |= esp_litemesh_network_segment_is_used(ESP_IP4TOADDR(192, 168, gateway_ip, 1));
-#endif
-        if (!ip_segment_is_used) {
-            ip_info->ip.addr = ESP_IP4TOADDR(192, 168, gateway_ip, 1);
-            ip_info->gw.addr = ESP_IP4TOADDR(192, 168, gateway_ip, 1);
-            ip_info->netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
-            ESP_LOGI("ip select", "IP Address:" IPSTR, IP2STR(&ip_info->ip));
-            ESP_LOGI("ip select", "GW Address:" IPSTR, IP2STR(&ip_info->gw));
-            ESP_LOGI("ip select", "NM Address:" IPSTR, IP2STR(&ip_info->netmask));
-
-            return ESP_OK;
+    if (entries == NULL) {
+        *max_num = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t loop = 0; loop < num; loop++) {
+        for (uint32_t type = 0; (type < sizeof(types) / sizeof(types[0])) && (count < *max_num); type++) {
+            esp_netif_dns_info_t dns = { 0 };
+            uint32_t index = 0;
+
+            if ((esp_netif_get_dns_info(entries[loop].netif, types[type], &dns) != ESP_OK)
+                || (dns.ip.type != IPADDR_TYPE_V4) || (dns.ip.u_addr.ip4.addr == 0)) {
+                continue;
+            }
+
+            /* The external netifs may share the DNS servers of the stack */
+            for (index = 0; (index < count) && (servers[index] != dns.ip.u_addr.ip4.addr); index++) {
+            }
+            if (index == count) {
+                servers[count++] = dns.ip.u_addr.ip4.addr;
+            }
         }
     }
+    free(entries);
 
-    return ESP_FAIL;
+    *max_num = count;
+    return ESP_OK;
 }
 
-static bool esp_gateway_netif_mac_is_used(uint8_t mac[6])
+bool esp_gateway_is_data_forwarding_addr(uint32_t addr)
 {
-    gateway_netif_t* p = gateway_link;
-    uint8_t netif_mac[6] = { 0 };
+    bool found = false;
+    uint32_t num = 0;
+    esp_gateway_netif_entry_t* entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_DHCPS), &num);
+
+    for (uint32_t loop = 0; (loop < num) && !found; loop++) {
+        found = entries[loop].ip_info.ip.addr
+                && ((addr & entries[loop].ip_info.netmask.addr) == (entries[loop].ip_info.ip.addr & entries[loop].ip_info.netmask.addr));
+    }
+    free(entries);
 
-    while (p) {
-        esp_netif_get_mac(p->netif, netif_mac);
-        if (!memcmp(netif_mac, mac, sizeof(netif_mac))) {
-            return true;
+    return found;
+}
+
+esp_err_t esp_gateway_netif_dhcps_offer_dns(esp_netif_t* netif)
+{
+    esp_netif_dns_info_t dns = { 0 };
+    dhcps_offer_t dhcps_dns_value = OFFER_DNS;
+    esp_err_t ret = ESP_OK;
+
+    dns.ip.u_addr.ip4.addr = esp_ip4addr_aton(CONFIG_GATEWAY_DNS_FALLBACK_SERVER);
+    dns.ip.type = IPADDR_TYPE_V4;
+#if CONFIG_GATEWAY_DNS_PROXY
+    esp_netif_ip_info_t ip_info;
+
+    if (!esp_gateway_dns_proxy_is_started()) {
+        ret = esp_gateway_dns_proxy_start(NULL);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "DNS proxy start fail(0x%x), offer " CONFIG_GATEWAY_DNS_FALLBACK_SERVER, ret);
         }
-        
-        p = p->next;
     }
 
-    return false;
+    if (esp_gateway_dns_proxy_is_started() && (esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) && ip_info.ip.addr) {
+        dns.ip.u_addr.ip4.addr = ip_info.ip.addr;
+    }
+#endif
+
+    ret = esp_netif_dhcps_option(netif, ESP_NETIF_OP_SET, ESP_NETIF_DOMAIN_NAME_SERVER, &dhcps_dns_value, sizeof(dhcps_dns_value));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    return esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
 }
 
-esp_err_t esp_gateway_netif_request_mac(uint8_t* mac)
+#if CONFIG_LITEMESH_ENABLE
+/* Reference every subnet of the pool the /24 of a LiteMesh segment overlaps, there are several below /24 */
+static void esp_gateway_netif_litemesh_segment_ref(uint8_t net_segment, bool ref)
 {
-    uint8_t netif_mac[6] = { 0 };
-    esp_read_mac(netif_mac, ESP_MAC_WIFI_STA);
-    while (1) {
-        if (!esp_gateway_netif_mac_is_used(netif_mac)){
-            break;
+    uint32_t addr = esp_netif_htonl(esp_gateway_network_segment_to_addr(net_segment).addr);
+    uint32_t step = (gateway_subnet_pool_config.subnet_prefix_len > 24) ? (1UL << (32 - gateway_subnet_pool_config.subnet_prefix_len)) : 256;
+
+    for (uint32_t offset = 0; offset < 256; offset += step) {
+        esp_ip4_addr_t ip = { .addr = esp_netif_htonl(addr + offset) };
+
+        if (ref) {
+            esp_gateway_subnet_pool_ref(gateway_subnet_pool, ip);
+        } else {
+            esp_gateway_subnet_pool_unref(gateway_subnet_pool, ip);
         }
+    }
+}
 
-        if (netif_mac[5] != 0xff) {
-            if (netif_mac[4] != 0xff) {
-                netif_mac[3] += 1;
-            }
-            netif_mac[4] += 1;
-        } 
-        netif_mac[5] += 1;
+esp_err_t esp_gateway_netif_litemesh_network_segment_update(const uint8_t* net_segment, uint32_t num)
+{
+    uint32_t segment_map[sizeof(litemesh_segment_map) / sizeof(litemesh_segment_map[0])] = { 0 };
+    esp_err_t ret = esp_gateway_netif_registry_init();
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (uint32_t loop = 0; loop < num; loop++) {
+        segment_map[net_segment[loop] / 32] |= 1UL << (net_segment[loop] % 32);
+    }
+
+    /* Only the segments which appear or disappear touch the pool */
+    bool update = false;
+    for (uint32_t word = 0; word < sizeof(segment_map) / sizeof(segment_map[0]); word++) {
+        uint32_t changed = segment_map[word] ^ litemesh_segment_map[word];
+        update |= (changed != 0);
+        while (changed) {
+            uint32_t bit = __builtin_ctz(changed);
+
+            esp_gateway_netif_litemesh_segment_ref(word * 32 + bit, segment_map[word] & (1UL << bit));
+            changed &= changed - 1;
+        }
+        litemesh_segment_map[word] = segment_map[word];
+    }
+
+    if (update) {
+        esp_gateway_netif_network_segment_replan_schedule();
     }
 
-    memcpy(mac, netif_mac, sizeof(netif_mac));
-    ESP_LOGI("mac select", "MAC "MACSTR"", MAC2STR(mac));
     return ESP_OK;
 }
+#endif /* CONFIG_LITEMESH_ENABLE */
 
-esp_err_t esp_gateway_netif_network_segment_conflict_update(esp_netif_t* esp_netif)
+esp_err_t esp_gateway_netif_request_ip(esp_netif_ip_info_t* ip_info)
 {
-    gateway_netif_t* p = gateway_link;
-    esp_netif_ip_info_t netif_ip;
-    esp_netif_ip_info_t allocate_ip_info;
-    esp_ip4_addr_t netmask = {.addr = ESP_IP4TOADDR(255, 255, 255, 0)};
-    bool ip_segment_is_used = false;
+    if ((esp_gateway_netif_registry_init() != ESP_OK)
+        || (esp_gateway_subnet_pool_alloc(gateway_subnet_pool, ip_info) != ESP_OK)) {
+        ESP_LOGE("ip select", "No free network segment");
+        return ESP_FAIL;
+    }
 
-    while (p) {
-        if ((esp_netif != p->netif) && DHCPS_NETIF_ID(p->netif)) { // DHCP_Server has to be enabled for this netif
-            esp_netif_get_ip_info(esp_netif, &allocate_ip_info);
-            esp_netif_get_ip_info(p->netif, &netif_ip);
+    ESP_LOGI("ip select", "IP Address:" IPSTR, IP2STR(&ip_info->ip));
+    ESP_LOGI("ip select", "GW Address:" IPSTR, IP2STR(&ip_info->gw));
+    ESP_LOGI("ip select", "NM Address:" IPSTR, IP2STR(&ip_info->netmask));
 
-#if CONFIG_LITEMESH_ENABLE
-            ip_segment_is_used = esp_litemesh_network_segment_is_used(netif_ip.ip.addr);
-#endif
-            /* The checked network segment does not conflict with the external netif */
-            /* And the same ip net segment is not be used by other external netifs */
-            if ((!ip4_addr_netcmp(&netif_ip.ip, &allocate_ip_info.ip, &netmask)) && !ip_segment_is_used) {
-                p = p->next;
-                continue;
-            }
+    return ESP_OK;
+}
 
-            esp_gateway_netif_request_ip(&allocate_ip_info);
+esp_err_t esp_gateway_netif_request_role_mac(esp_gateway_mac_role_t role, uint32_t index, uint8_t* mac)
+{
+    esp_gateway_netif_entry_t* entries = NULL;
+    uint8_t netif_mac[6] = { 0 };
+    uint32_t count = 0;
+    esp_err_t ret = esp_gateway_netif_registry_init();
 
-            ESP_ERROR_CHECK(esp_netif_dhcps_stop(p->netif));
-            esp_netif_set_ip_info(p->netif, &allocate_ip_info);
-            ESP_LOGI(TAG, "ip reallocate new:" IPSTR, IP2STR(&allocate_ip_info.ip));
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-            esp_netif_dhcps_start(p->netif);
-            esp_netif_dns_info_t dns;
-            dns.ip.u_addr.ip4.addr = ESP_IP4TOADDR(114, 114, 114, 114);
-            dns.ip.type = IPADDR_TYPE_V4;
-            dhcps_offer_t dhcps_dns_value = OFFER_DNS;
-            esp_netif_dhcps_option(p->netif, ESP_NETIF_OP_SET, ESP_NETIF_DOMAIN_NAME_SERVER, &dhcps_dns_value, sizeof(dhcps_dns_value));
-            esp_netif_set_dns_info(p->netif, ESP_NETIF_DNS_MAIN, &dns);
+    /* Wi-Fi netifs only report their MAC once the mode is set, refresh the cache before the allocation */
+    entries = esp_gateway_netif_snapshot(ESP_GATEWAY_NETIF_ROLE_ALL, &count);
+    for (uint32_t loop = 0; loop < count; loop++) {
+        if ((esp_netif_get_mac(entries[loop].netif, netif_mac) != ESP_OK)
+            || !memcmp(netif_mac, entries[loop].mac, sizeof(netif_mac))) {
+            continue;
+        }
 
-            break;
+        if (!esp_gateway_mac_is_zero(entries[loop].mac)) {
+            esp_gateway_mac_allocator_release(gateway_mac_allocator, entries[loop].mac);
         }
-        p = p->next;
+        esp_gateway_mac_allocator_reserve(gateway_mac_allocator, netif_mac);
+        esp_gateway_netif_registry_update(gateway_registry, entries[loop].netif, NULL, netif_mac, NULL);
+    }
+    free(entries);
+
+    ret = esp_gateway_mac_allocator_derive(gateway_mac_allocator, role, index, mac);
+    if (ret != ESP_OK) {
+        ESP_LOGE("mac select", "No free MAC for role %d index %d", role, (int)index);
+        return ret;
     }
+
+    ESP_LOGI("mac select", "MAC "MACSTR"", MAC2STR(mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_netif_request_mac(uint8_t* mac)
+{
+    return esp_gateway_netif_request_role_mac(ESP_GATEWAY_MAC_ROLE_GENERIC, gateway_generic_mac_index++, mac);
+}
+
+esp_err_t esp_gateway_netif_network_segment_conflict_update(esp_netif_t* esp_netif)
+{
+    esp_netif_ip_info_t netif_ip;
+
+    /* The IP event handlers may run in any order, make sure the cached IP of this netif is the latest */
+    esp_netif_get_ip_info(esp_netif, &netif_ip);
+    esp_gateway_netif_cache_ip_info(esp_netif, &netif_ip);
+    esp_gateway_netif_network_segment_replan_schedule();
+
     return ESP_OK;
 }
 
@@ -272,12 +709,7 @@ esp_netif_t* esp_gateway_create_netif(esp_netif_config_t* config, esp_netif_ip_i
     esp_netif_up(netif);
 
     if (enable_dhcps) {
-        esp_netif_dns_info_t dns;
-        dns.ip.u_addr.ip4.addr = ESP_IP4TOADDR(114, 114, 114, 114);
-        dns.ip.type = IPADDR_TYPE_V4;
-        dhcps_offer_t dhcps_dns_value = OFFER_DNS;
-        ESP_ERROR_CHECK(esp_netif_dhcps_option(netif, ESP_NETIF_OP_SET, ESP_NETIF_DOMAIN_NAME_SERVER, &dhcps_dns_value, sizeof(dhcps_dns_value)));
-        ESP_ERROR_CHECK(esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns));
+        ESP_ERROR_CHECK(esp_gateway_netif_dhcps_offer_dns(netif));
         ESP_ERROR_CHECK(esp_netif_dhcps_start(netif));
     }
 
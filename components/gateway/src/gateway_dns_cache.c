@@ -0,0 +1,532 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_dns_cache.h"
+
+#define DNS_FLAG_QR             (0x8000)
+#define DNS_FLAG_TC             (0x0200)
+#define DNS_FLAG_RD             (0x0100)
+#define DNS_FLAG_RA             (0x0080)
+#define DNS_OPCODE_MASK         (0x7800)
+#define DNS_RCODE_MASK          (0x000F)
+
+#define DNS_TYPE_SOA            (6)
+#define DNS_TYPE_OPT            (41)
+#define DNS_LABEL_POINTER       (0xC0)
+#define DNS_RR_FIXED_LEN        (10)    /* type, class, TTL and data length */
+#define DNS_SOA_FIXED_LEN       (20)
+
+typedef struct {
+    uint8_t* response;          /* NULL for a free entry */
+    uint16_t len;
+    uint16_t qtype;
+    uint16_t qclass;
+    uint8_t name_len;
+    bool negative;
+    uint32_t hash;
+    uint32_t stored_ms;
+    uint32_t ttl_ms;
+    uint32_t last_used;
+    uint8_t name[ESP_GATEWAY_DNS_MAX_NAME_LEN];
+} dns_cache_entry_t;
+
+/*
+ * The cache is small, a few dozens of answers, and only used by the proxy task:
+ * the entries are scanned comparing a hash of the question first.
+ */
+struct esp_gateway_dns_cache {
+    esp_gateway_dns_cache_config_t config;
+    dns_cache_entry_t* entries;
+    esp_gateway_dns_pending_t* pending;
+    bool* pending_used;
+    uint32_t id_state;
+    esp_gateway_dns_cache_stats_t stats;
+};
+
+static inline uint16_t dns_read16(const uint8_t* data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static inline uint32_t dns_read32(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static inline void dns_write16(uint8_t* data, uint16_t value)
+{
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+static inline void dns_write32(uint8_t* data, uint32_t value)
+{
+    dns_write16(data, value >> 16);
+    dns_write16(data + 2, value & 0xFFFF);
+}
+
+static uint32_t dns_question_hash(const esp_gateway_dns_question_t* question)
+{
+    uint32_t hash = 2166136261UL;
+
+    for (uint32_t loop = 0; loop < question->name_len; loop++) {
+        hash = (hash ^ question->name[loop]) * 16777619UL;
+    }
+
+    return (hash ^ ((uint32_t)question->qtype << 16) ^ question->qclass) * 16777619UL;
+}
+
+static bool dns_question_equal(const esp_gateway_dns_question_t* question, uint16_t qtype, uint16_t qclass,
+                               const uint8_t* name, uint8_t name_len)
+{
+    return (question->qtype == qtype) && (question->qclass == qclass) && (question->name_len == name_len)
+           && !memcmp(question->name, name, name_len);
+}
+
+/* Skip a possibly compressed name, return the offset after it or 0 if it is malformed */
+static uint32_t dns_skip_name(const uint8_t* msg, uint32_t len, uint32_t offset)
+{
+    while (offset < len) {
+        uint8_t label_len = msg[offset];
+        if (label_len == 0) {
+            return offset + 1;
+        }
+        if ((label_len & DNS_LABEL_POINTER) == DNS_LABEL_POINTER) {
+            return (offset + 2 <= len) ? offset + 2 : 0;
+        }
+        if (label_len & DNS_LABEL_POINTER) {
+            return 0;
+        }
+        offset += label_len + 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Walk the records after the question, returning the smallest TTL.
+ * With adjust, the TTLs are decreased by elapsed_s instead.
+ */
+static esp_err_t dns_walk_records(uint8_t* msg, uint32_t len, uint32_t offset, uint32_t* min_ttl, uint32_t* soa_minimum,
+                                  bool adjust, uint32_t elapsed_s)
+{
+    uint32_t record_num = dns_read16(msg + 6) + dns_read16(msg + 8) + dns_read16(msg + 10);
+
+    *min_ttl = UINT32_MAX;
+    *soa_minimum = UINT32_MAX;
+    for (uint32_t loop = 0; loop < record_num; loop++) {
+        offset = dns_skip_name(msg, len, offset);
+        if ((offset == 0) || (offset + DNS_RR_FIXED_LEN > len)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        uint16_t type = dns_read16(msg + offset);
+        uint32_t ttl = dns_read32(msg + offset + 4);
+        uint16_t data_len = dns_read16(msg + offset + 8);
+        uint32_t data = offset + DNS_RR_FIXED_LEN;
+        if (data + data_len > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        /* The TTL of an OPT pseudo-record holds EDNS flags */
+        if (type != DNS_TYPE_OPT) {
+            if (adjust) {
+                dns_write32(msg + offset + 4, (ttl > elapsed_s) ? ttl - elapsed_s : 0);
+            } else if (ttl < *min_ttl) {
+                *min_ttl = ttl;
+            }
+        }
+
+        if ((type == DNS_TYPE_SOA) && !adjust) {
+            uint32_t soa = dns_skip_name(msg, data + data_len, data);
+            soa = soa ? dns_skip_name(msg, data + data_len, soa) : 0;
+            if (soa && (soa + DNS_SOA_FIXED_LEN <= data + data_len)) {
+                uint32_t minimum = dns_read32(msg + soa + 16);
+                *soa_minimum = (minimum < ttl) ? minimum : ttl;
+            }
+        }
+
+        offset = data + data_len;
+    }
+
+    return ESP_OK;
+}
+
+static uint16_t dns_next_id(esp_gateway_dns_cache_t* cache)
+{
+    /* xorshift32 */
+    uint32_t state = cache->id_state;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    cache->id_state = state;
+
+    return (uint16_t)(state >> 8);
+}
+
+static void dns_cache_entry_free(dns_cache_entry_t* entry)
+{
+    free(entry->response);
+    entry->response = NULL;
+}
+
+esp_gateway_dns_cache_t* esp_gateway_dns_cache_create(const esp_gateway_dns_cache_config_t* config)
+{
+    esp_gateway_dns_cache_t* cache = NULL;
+
+    if ((config == NULL) || (config->capacity == 0) || (config->pending_capacity == 0) || (config->min_ttl_s > config->max_ttl_s)) {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(esp_gateway_dns_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->entries = calloc(config->capacity, sizeof(dns_cache_entry_t));
+    cache->pending = calloc(config->pending_capacity, sizeof(esp_gateway_dns_pending_t));
+    cache->pending_used = calloc(config->pending_capacity, sizeof(bool));
+    if ((cache->entries == NULL) || (cache->pending == NULL) || (cache->pending_used == NULL)) {
+        esp_gateway_dns_cache_delete(cache);
+        return NULL;
+    }
+
+    cache->config = *config;
+    cache->id_state = config->seed ? config->seed : 0x2545F491UL;
+
+    return cache;
+}
+
+void esp_gateway_dns_cache_delete(esp_gateway_dns_cache_t* cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->entries) {
+        for (uint32_t loop = 0; loop < cache->config.capacity; loop++) {
+            dns_cache_entry_free(&cache->entries[loop]);
+        }
+    }
+    free(cache->entries);
+    free(cache->pending);
+    free(cache->pending_used);
+    free(cache);
+}
+
+esp_err_t esp_gateway_dns_question_parse(const uint8_t* msg, uint32_t len, bool response, esp_gateway_dns_question_t* question)
+{
+    uint32_t offset = ESP_GATEWAY_DNS_HEADER_LEN;
+    uint16_t flags = 0;
+
+    if (len < ESP_GATEWAY_DNS_HEADER_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    flags = dns_read16(msg + 2);
+    if ((((flags & DNS_FLAG_QR) != 0) != response) || (flags & DNS_OPCODE_MASK) || (dns_read16(msg + 4) != 1)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /* The question comes first, so its name is never compressed */
+    question->name_len = 0;
+    while (1) {
+        if (offset >= len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        uint8_t label_len = msg[offset];
+        if (label_len & DNS_LABEL_POINTER) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if ((offset + label_len + 1 > len) || (question->name_len + label_len + 1 > ESP_GATEWAY_DNS_MAX_NAME_LEN)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        question->name[question->name_len++] = label_len;
+        for (uint32_t loop = 1; loop <= label_len; loop++) {
+            uint8_t c = msg[offset + loop];
+            question->name[question->name_len++] = ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+        }
+        offset += label_len + 1;
+
+        if (label_len == 0) {
+            break;
+        }
+    }
+
+    if (offset + 4 > len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    question->id = dns_read16(msg);
+    question->qtype = dns_read16(msg + offset);
+    question->qclass = dns_read16(msg + offset + 2);
+    question->end = offset + 4;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_dns_cache_lookup(esp_gateway_dns_cache_t* cache, const uint8_t* query, const esp_gateway_dns_question_t* question,
+                                       uint32_t now, uint8_t* response, uint32_t size, uint32_t* len)
+{
+    uint32_t hash = dns_question_hash(question);
+    uint32_t min_ttl = 0;
+    uint32_t soa_minimum = 0;
+
+    cache->stats.lookups++;
+    for (uint32_t loop = 0; loop < cache->config.capacity; loop++) {
+        dns_cache_entry_t* entry = &cache->entries[loop];
+        if ((entry->response == NULL) || (entry->hash != hash)
+            || !dns_question_equal(question, entry->qtype, entry->qclass, entry->name, entry->name_len)) {
+            continue;
+        }
+
+        uint32_t elapsed = now - entry->stored_ms;
+        if ((elapsed >= entry->ttl_ms) || (entry->len > size)) {
+            dns_cache_entry_free(entry);
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        /* Same question section as the query, so the case of the name is the client's one */
+        memcpy(response, entry->response, entry->len);
+        memcpy(response + ESP_GATEWAY_DNS_HEADER_LEN, query + ESP_GATEWAY_DNS_HEADER_LEN, question->end - ESP_GATEWAY_DNS_HEADER_LEN);
+        dns_write16(response, question->id);
+        dns_write16(response + 2, (dns_read16(response + 2) & ~DNS_FLAG_RD) | (dns_read16(query + 2) & DNS_FLAG_RD));
+        dns_walk_records(response, entry->len, question->end, &min_ttl, &soa_minimum, true, elapsed / 1000);
+
+        entry->last_used = now;
+        if (entry->negative) {
+            cache->stats.negative_hits++;
+        } else {
+            cache->stats.hits++;
+        }
+        *len = entry->len;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_gateway_dns_cache_insert(esp_gateway_dns_cache_t* cache, const esp_gateway_dns_question_t* question,
+                                       const uint8_t* response, uint32_t len, uint32_t now)
+{
+    uint16_t flags = dns_read16(response + 2);
+    uint8_t rcode = flags & DNS_RCODE_MASK;
+    uint32_t min_ttl = 0;
+    uint32_t soa_minimum = 0;
+    uint32_t ttl_s = 0;
+    bool negative = false;
+    dns_cache_entry_t* entry = NULL;
+    uint32_t hash = dns_question_hash(question);
+
+    if ((flags & DNS_FLAG_TC) || ((rcode != ESP_GATEWAY_DNS_RCODE_NOERROR) && (rcode != ESP_GATEWAY_DNS_RCODE_NXDOMAIN))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if ((len > ESP_GATEWAY_DNS_MAX_MSG_LEN) || (question->end > len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* The records are only read here */
+    if (dns_walk_records((uint8_t*)response, len, question->end, &min_ttl, &soa_minimum, false, 0) != ESP_OK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    negative = (rcode == ESP_GATEWAY_DNS_RCODE_NXDOMAIN) || (dns_read16(response + 6) == 0);
+    if (negative) {
+        ttl_s = (soa_minimum < cache->config.negative_ttl_s) ? soa_minimum : cache->config.negative_ttl_s;
+    } else {
+        ttl_s = (min_ttl < cache->config.min_ttl_s) ? cache->config.min_ttl_s : min_ttl;
+        ttl_s = (ttl_s > cache->config.max_ttl_s) ? cache->config.max_ttl_s : ttl_s;
+    }
+    if (ttl_s == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /* Replace the same question, else take a free entry, else an expired one, else the least recently used one */
+    for (uint32_t loop = 0; loop < cache->config.capacity; loop++) {
+        dns_cache_entry_t* candidate = &cache->entries[loop];
+        if (candidate->response == NULL) {
+            if ((entry == NULL) || entry->response) {
+                entry = candidate;
+            }
+            continue;
+        }
+        if ((candidate->hash == hash) && dns_question_equal(question, candidate->qtype, candidate->qclass, candidate->name, candidate->name_len)) {
+            entry = candidate;
+            break;
+        }
+        if ((now - candidate->stored_ms) >= candidate->ttl_ms) {
+            dns_cache_entry_free(candidate);
+            if ((entry == NULL) || entry->response) {
+                entry = candidate;
+            }
+            continue;
+        }
+        if ((entry == NULL) || (entry->response && ((now - candidate->last_used) > (now - entry->last_used)))) {
+            entry = candidate;
+        }
+    }
+
+    uint8_t* copy = malloc(len);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, response, len);
+
+    if (entry->response) {
+        if (!dns_question_equal(question, entry->qtype, entry->qclass, entry->name, entry->name_len)) {
+            cache->stats.evictions++;
+        }
+        dns_cache_entry_free(entry);
+    }
+
+    entry->response = copy;
+    entry->len = len;
+    entry->qtype = question->qtype;
+    entry->qclass = question->qclass;
+    entry->name_len = question->name_len;
+    memcpy(entry->name, question->name, question->name_len);
+    entry->negative = negative;
+    entry->hash = hash;
+    entry->stored_ms = now;
+    entry->last_used = now;
+    entry->ttl_ms = ttl_s * 1000;
+    cache->stats.inserts++;
+
+    return ESP_OK;
+}
+
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_get(esp_gateway_dns_cache_t* cache, const esp_gateway_dns_question_t* question,
+                                                             const esp_gateway_dns_client_t* client, uint32_t now, bool* created)
+{
+    esp_gateway_dns_pending_t* pending = NULL;
+
+    *created = false;
+    for (uint32_t loop = 0; loop < cache->config.pending_capacity; loop++) {
+        if (!cache->pending_used[loop]) {
+            pending = pending ? pending : &cache->pending[loop];
+            continue;
+        }
+
+        esp_gateway_dns_pending_t* candidate = &cache->pending[loop];
+        if (dns_question_equal(question, candidate->question.qtype, candidate->question.qclass,
+                               candidate->question.name, candidate->question.name_len)) {
+            /* A retransmission of a client already waiting */
+            for (uint32_t index = 0; index < candidate->client_num; index++) {
+                if (!memcmp(&candidate->clients[index], client, sizeof(esp_gateway_dns_client_t))) {
+                    return candidate;
+                }
+            }
+            if (candidate->client_num >= ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS) {
+                return NULL;
+            }
+            candidate->clients[candidate->client_num++] = *client;
+            cache->stats.coalesced++;
+            return candidate;
+        }
+    }
+
+    if (pending == NULL) {
+        return NULL;
+    }
+
+    memset(pending, 0, sizeof(esp_gateway_dns_pending_t));
+    pending->question = *question;
+    pending->clients[0] = *client;
+    pending->client_num = 1;
+    pending->start_ms = now;
+    pending->sent_ms = now;
+    pending->attempts = 1;
+
+    /* The upstream ID must not be used by another pending question */
+    do {
+        pending->upstream_id = dns_next_id(cache);
+    } while (esp_gateway_dns_cache_pending_find(cache, pending->upstream_id));
+
+    cache->pending_used[pending - cache->pending] = true;
+    *created = true;
+
+    return pending;
+}
+
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_find(esp_gateway_dns_cache_t* cache, uint16_t upstream_id)
+{
+    for (uint32_t loop = 0; loop < cache->config.pending_capacity; loop++) {
+        if (cache->pending_used[loop] && (cache->pending[loop].upstream_id == upstream_id)) {
+            return &cache->pending[loop];
+        }
+    }
+
+    return NULL;
+}
+
+esp_gateway_dns_pending_t* esp_gateway_dns_cache_pending_timeout(esp_gateway_dns_cache_t* cache, uint32_t now, uint32_t timeout_ms, uint32_t* next_ms)
+{
+    for (uint32_t loop = 0; loop < cache->config.pending_capacity; loop++) {
+        if (!cache->pending_used[loop]) {
+            continue;
+        }
+
+        uint32_t elapsed = now - cache->pending[loop].sent_ms;
+        if (elapsed >= timeout_ms) {
+            return &cache->pending[loop];
+        }
+        if (timeout_ms - elapsed < *next_ms) {
+            *next_ms = timeout_ms - elapsed;
+        }
+    }
+
+    return NULL;
+}
+
+void esp_gateway_dns_cache_pending_retry(esp_gateway_dns_cache_t* cache, esp_gateway_dns_pending_t* pending, uint32_t now)
+{
+    uint16_t upstream_id = 0;
+
+    /* A late answer to the previous query is ignored */
+    do {
+        upstream_id = dns_next_id(cache);
+    } while (esp_gateway_dns_cache_pending_find(cache, upstream_id));
+
+    pending->upstream_id = upstream_id;
+    pending->sent_ms = now;
+    pending->attempts++;
+}
+
+void esp_gateway_dns_cache_pending_remove(esp_gateway_dns_cache_t* cache, esp_gateway_dns_pending_t* pending)
+{
+    cache->pending_used[pending - cache->pending] = false;
+}
+
+uint32_t esp_gateway_dns_build_error(const uint8_t* query, const esp_gateway_dns_question_t* question, uint8_t rcode, uint8_t* response)
+{
+    memmove(response, query, question->end);
+    dns_write16(response + 2, (dns_read16(query + 2) & DNS_FLAG_RD) | DNS_FLAG_QR | DNS_FLAG_RA | (rcode & DNS_RCODE_MASK));
+    dns_write16(response + 6, 0);
+    dns_write16(response + 8, 0);
+    dns_write16(response + 10, 0);
+
+    return question->end;
+}
+
+void esp_gateway_dns_cache_get_stats(esp_gateway_dns_cache_t* cache, esp_gateway_dns_cache_stats_t* stats)
+{
+    *stats = cache->stats;
+}
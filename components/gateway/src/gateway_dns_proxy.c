@@ -0,0 +1,423 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/sockets.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_dns_cache.h"
+#include "esp_gateway_dns_proxy.h"
+
+/*
+ * The data-forwarding netifs offer their own IP as DNS server. The queries are answered
+ * from the cache, or sent once to the DNS servers learned by the external netifs, all the
+ * clients asking the same question meanwhile waiting for the same upstream answer.
+ */
+
+#define DNS_PROXY_PORT              (53)
+#define DNS_PROXY_MAX_SERVERS       (4)
+#define DNS_PROXY_POLL_MS           (100)   /* Upper bound of the time to notice a stop request */
+#define DNS_PROXY_TASK_STACK_SIZE   (4096)
+#define DNS_PROXY_TASK_PRIORITY     (5)
+
+static const char *TAG = "gateway_dns_proxy";
+
+static esp_gateway_dns_proxy_config_t s_dns_proxy_config;
+static esp_gateway_dns_cache_t* s_dns_cache = NULL;
+static TaskHandle_t s_dns_proxy_task = NULL;
+static volatile bool s_dns_proxy_running = false;
+static int s_listen_fd = -1;
+static int s_upstream_fd = -1;
+static uint8_t* s_query = NULL;
+static uint8_t* s_response = NULL;
+
+static uint32_t s_upstream_queries = 0;
+static uint32_t s_upstream_answers = 0;
+static uint32_t s_upstream_timeouts = 0;
+static uint32_t s_failures = 0;
+static uint64_t s_latency_sum_ms = 0;
+static uint32_t s_latency_max_ms = 0;
+
+static inline uint32_t esp_gateway_dns_proxy_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void esp_gateway_dns_proxy_sendto(const uint8_t* msg, uint32_t len, uint32_t addr, uint16_t port)
+{
+    struct sockaddr_in to = { 0 };
+
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = addr;
+    to.sin_port = port;
+    if (sendto(s_listen_fd, msg, len, 0, (struct sockaddr*)&to, sizeof(to)) < 0) {
+        ESP_LOGD(TAG, "send answer fail, errno %d", errno);
+    }
+}
+
+/* Upstream query of a pending question, without the EDNS options of the clients */
+static uint32_t esp_gateway_dns_proxy_build_query(const esp_gateway_dns_pending_t* pending, uint16_t id, uint8_t* query)
+{
+    const esp_gateway_dns_question_t* question = &pending->question;
+
+    memset(query, 0, ESP_GATEWAY_DNS_HEADER_LEN);
+    query[0] = id >> 8;
+    query[1] = id & 0xFF;
+    query[2] = 0x01;        /* RD */
+    query[5] = 1;           /* QDCOUNT */
+    memcpy(query + ESP_GATEWAY_DNS_HEADER_LEN, question->name, question->name_len);
+    query[ESP_GATEWAY_DNS_HEADER_LEN + question->name_len] = question->qtype >> 8;
+    query[ESP_GATEWAY_DNS_HEADER_LEN + question->name_len + 1] = question->qtype & 0xFF;
+    query[ESP_GATEWAY_DNS_HEADER_LEN + question->name_len + 2] = question->qclass >> 8;
+    query[ESP_GATEWAY_DNS_HEADER_LEN + question->name_len + 3] = question->qclass & 0xFF;
+
+    return ESP_GATEWAY_DNS_HEADER_LEN + question->name_len + 4;
+}
+
+static uint32_t esp_gateway_dns_proxy_get_servers(uint32_t* servers)
+{
+    uint32_t num = DNS_PROXY_MAX_SERVERS;
+
+    if (s_dns_proxy_config.upstream_addr) {
+        servers[0] = s_dns_proxy_config.upstream_addr;
+        return 1;
+    }
+
+    if ((esp_gateway_get_external_netif_dns(servers, &num) != ESP_OK) || (num == 0)) {
+        servers[0] = inet_addr(CONFIG_GATEWAY_DNS_FALLBACK_SERVER);
+        num = 1;
+    }
+
+    return num;
+}
+
+/* Send the question to the next server, the attempts go round the servers */
+static bool esp_gateway_dns_proxy_send_upstream(esp_gateway_dns_pending_t* pending)
+{
+    uint32_t servers[DNS_PROXY_MAX_SERVERS];
+    uint32_t num = esp_gateway_dns_proxy_get_servers(servers);
+    struct sockaddr_in to = { 0 };
+    uint32_t len = esp_gateway_dns_proxy_build_query(pending, pending->upstream_id, s_query);
+
+    pending->server = servers[(pending->attempts - 1) % num];
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = pending->server;
+    to.sin_port = s_dns_proxy_config.upstream_port;
+    if (sendto(s_upstream_fd, s_query, len, 0, (struct sockaddr*)&to, sizeof(to)) < 0) {
+        ESP_LOGD(TAG, "send query to " IPSTR " fail, errno %d", IP2STR((esp_ip4_addr_t*)&pending->server), errno);
+        return false;
+    }
+
+    s_upstream_queries++;
+    return true;
+}
+
+static void esp_gateway_dns_proxy_fail(esp_gateway_dns_pending_t* pending)
+{
+    for (uint32_t loop = 0; loop < pending->client_num; loop++) {
+        esp_gateway_dns_client_t* client = &pending->clients[loop];
+        uint32_t len = 0;
+
+        esp_gateway_dns_proxy_build_query(pending, client->id, s_response);
+        len = esp_gateway_dns_build_error(s_response, &pending->question, ESP_GATEWAY_DNS_RCODE_SERVFAIL, s_response);
+        esp_gateway_dns_proxy_sendto(s_response, len, client->addr, client->port);
+        s_failures++;
+    }
+
+    esp_gateway_dns_cache_pending_remove(s_dns_cache, pending);
+}
+
+static void esp_gateway_dns_proxy_handle_query(void)
+{
+    struct sockaddr_in from = { 0 };
+    socklen_t from_len = sizeof(from);
+    esp_gateway_dns_question_t question;
+    esp_gateway_dns_pending_t* pending = NULL;
+    esp_gateway_dns_client_t client;
+    uint32_t now = esp_gateway_dns_proxy_now();
+    uint32_t len = 0;
+    bool created = false;
+    int ret = recvfrom(s_listen_fd, s_query, ESP_GATEWAY_DNS_MAX_MSG_LEN, 0, (struct sockaddr*)&from, &from_len);
+
+    if ((ret <= 0) || (esp_gateway_dns_question_parse(s_query, ret, false, &question) != ESP_OK)) {
+        return;
+    }
+
+    /* Not an open resolver on the external netifs */
+    if (!s_dns_proxy_config.any_client && !esp_gateway_is_data_forwarding_addr(from.sin_addr.s_addr)) {
+        return;
+    }
+
+    if (esp_gateway_dns_cache_lookup(s_dns_cache, s_query, &question, now, s_response, ESP_GATEWAY_DNS_MAX_MSG_LEN, &len) == ESP_OK) {
+        esp_gateway_dns_proxy_sendto(s_response, len, from.sin_addr.s_addr, from.sin_port);
+        return;
+    }
+
+    client.addr = from.sin_addr.s_addr;
+    client.port = from.sin_port;
+    client.id = question.id;
+    pending = esp_gateway_dns_cache_pending_get(s_dns_cache, &question, &client, now, &created);
+    if (pending == NULL) {
+        len = esp_gateway_dns_build_error(s_query, &question, ESP_GATEWAY_DNS_RCODE_SERVFAIL, s_response);
+        esp_gateway_dns_proxy_sendto(s_response, len, client.addr, client.port);
+        s_failures++;
+        return;
+    }
+
+    if (created && !esp_gateway_dns_proxy_send_upstream(pending)) {
+        esp_gateway_dns_proxy_fail(pending);
+    }
+}
+
+static void esp_gateway_dns_proxy_handle_answer(void)
+{
+    struct sockaddr_in from = { 0 };
+    socklen_t from_len = sizeof(from);
+    esp_gateway_dns_question_t question;
+    esp_gateway_dns_pending_t* pending = NULL;
+    uint32_t now = esp_gateway_dns_proxy_now();
+    uint32_t latency = 0;
+    int ret = recvfrom(s_upstream_fd, s_response, ESP_GATEWAY_DNS_MAX_MSG_LEN, 0, (struct sockaddr*)&from, &from_len);
+
+    if ((ret <= 0) || (esp_gateway_dns_question_parse(s_response, ret, true, &question) != ESP_OK)) {
+        return;
+    }
+
+    /* Only the answer of the server asked last, to the same question */
+    pending = esp_gateway_dns_cache_pending_find(s_dns_cache, question.id);
+    if ((pending == NULL) || (from.sin_addr.s_addr != pending->server) || (from.sin_port != s_dns_proxy_config.upstream_port)
+        || (question.qtype != pending->question.qtype) || (question.qclass != pending->question.qclass)
+        || (question.name_len != pending->question.name_len) || memcmp(question.name, pending->question.name, question.name_len)) {
+        return;
+    }
+
+    latency = now - pending->start_ms;
+    s_upstream_answers++;
+    s_latency_sum_ms += latency;
+    s_latency_max_ms = (latency > s_latency_max_ms) ? latency : s_latency_max_ms;
+
+    esp_gateway_dns_cache_insert(s_dns_cache, &question, s_response, ret, now);
+
+    for (uint32_t loop = 0; loop < pending->client_num; loop++) {
+        s_response[0] = pending->clients[loop].id >> 8;
+        s_response[1] = pending->clients[loop].id & 0xFF;
+        esp_gateway_dns_proxy_sendto(s_response, ret, pending->clients[loop].addr, pending->clients[loop].port);
+    }
+
+    esp_gateway_dns_cache_pending_remove(s_dns_cache, pending);
+}
+
+/* Send the questions again which were not answered in time, return the time until the next timeout */
+static uint32_t esp_gateway_dns_proxy_handle_timeout(void)
+{
+    esp_gateway_dns_pending_t* pending = NULL;
+    uint32_t next_ms = DNS_PROXY_POLL_MS;
+    uint32_t now = esp_gateway_dns_proxy_now();
+
+    while ((pending = esp_gateway_dns_cache_pending_timeout(s_dns_cache, now, CONFIG_GATEWAY_DNS_PROXY_UPSTREAM_TIMEOUT_MS, &next_ms))) {
+        if (pending->attempts >= CONFIG_GATEWAY_DNS_PROXY_UPSTREAM_ATTEMPTS) {
+            s_upstream_timeouts++;
+            esp_gateway_dns_proxy_fail(pending);
+            continue;
+        }
+
+        esp_gateway_dns_cache_pending_retry(s_dns_cache, pending, now);
+        if (!esp_gateway_dns_proxy_send_upstream(pending)) {
+            esp_gateway_dns_proxy_fail(pending);
+        }
+    }
+
+    return next_ms;
+}
+
+static void esp_gateway_dns_proxy_task(void* arg)
+{
+    int max_fd = (s_listen_fd > s_upstream_fd) ? s_listen_fd : s_upstream_fd;
+
+    while (s_dns_proxy_running) {
+        uint32_t next_ms = esp_gateway_dns_proxy_handle_timeout();
+        struct timeval tv = {
+            .tv_sec = next_ms / 1000,
+            .tv_usec = (next_ms % 1000) * 1000,
+        };
+        fd_set rset;
+
+        FD_ZERO(&rset);
+        FD_SET(s_listen_fd, &rset);
+        FD_SET(s_upstream_fd, &rset);
+        if (select(max_fd + 1, &rset, NULL, NULL, &tv) <= 0) {
+            continue;
+        }
+
+        if (FD_ISSET(s_upstream_fd, &rset)) {
+            esp_gateway_dns_proxy_handle_answer();
+        }
+
+        if (FD_ISSET(s_listen_fd, &rset)) {
+            esp_gateway_dns_proxy_handle_query();
+        }
+    }
+
+    s_dns_proxy_task = NULL;
+    vTaskDelete(NULL);
+}
+
+static void esp_gateway_dns_proxy_release(void)
+{
+    if (s_listen_fd >= 0) {
+        close(s_listen_fd);
+        s_listen_fd = -1;
+    }
+
+    if (s_upstream_fd >= 0) {
+        close(s_upstream_fd);
+        s_upstream_fd = -1;
+    }
+
+    esp_gateway_dns_cache_delete(s_dns_cache);
+    s_dns_cache = NULL;
+    free(s_query);
+    s_query = NULL;
+    free(s_response);
+    s_response = NULL;
+}
+
+void esp_gateway_dns_proxy_default_config(esp_gateway_dns_proxy_config_t* config)
+{
+    memset(config, 0, sizeof(esp_gateway_dns_proxy_config_t));
+    config->listen_addr = htonl(INADDR_ANY);
+    config->listen_port = htons(DNS_PROXY_PORT);
+    config->upstream_port = htons(DNS_PROXY_PORT);
+}
+
+esp_err_t esp_gateway_dns_proxy_start(const esp_gateway_dns_proxy_config_t* config)
+{
+    esp_gateway_dns_cache_config_t cache_config = {
+        .capacity = CONFIG_GATEWAY_DNS_PROXY_CACHE_SIZE,
+        .pending_capacity = CONFIG_GATEWAY_DNS_PROXY_PENDING_SIZE,
+        .min_ttl_s = CONFIG_GATEWAY_DNS_PROXY_MIN_TTL_S,
+        .max_ttl_s = CONFIG_GATEWAY_DNS_PROXY_MAX_TTL_S,
+        .negative_ttl_s = CONFIG_GATEWAY_DNS_PROXY_NEGATIVE_TTL_S,
+        .seed = esp_random(),
+    };
+    struct sockaddr_in listen_addr = { 0 };
+
+    if (s_dns_proxy_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (config) {
+        s_dns_proxy_config = *config;
+    } else {
+        esp_gateway_dns_proxy_default_config(&s_dns_proxy_config);
+    }
+
+    s_dns_cache = esp_gateway_dns_cache_create(&cache_config);
+    s_query = malloc(ESP_GATEWAY_DNS_MAX_MSG_LEN);
+    s_response = malloc(ESP_GATEWAY_DNS_MAX_MSG_LEN);
+    if ((s_dns_cache == NULL) || (s_query == NULL) || (s_response == NULL)) {
+        ESP_LOGE(TAG, "create cache of %d answers fail", CONFIG_GATEWAY_DNS_PROXY_CACHE_SIZE);
+        esp_gateway_dns_proxy_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_listen_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    s_upstream_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_addr.s_addr = s_dns_proxy_config.listen_addr;
+    listen_addr.sin_port = s_dns_proxy_config.listen_port;
+    if ((s_listen_fd < 0) || (s_upstream_fd < 0)
+        || (bind(s_listen_fd, (struct sockaddr*)&listen_addr, sizeof(listen_addr)) < 0)) {
+        ESP_LOGE(TAG, "listen on port %d fail, errno %d", ntohs(s_dns_proxy_config.listen_port), errno);
+        esp_gateway_dns_proxy_release();
+        return ESP_FAIL;
+    }
+
+    s_upstream_queries = 0;
+    s_upstream_answers = 0;
+    s_upstream_timeouts = 0;
+    s_failures = 0;
+    s_latency_sum_ms = 0;
+    s_latency_max_ms = 0;
+
+    s_dns_proxy_running = true;
+    if (xTaskCreate(esp_gateway_dns_proxy_task, "dns_proxy", DNS_PROXY_TASK_STACK_SIZE, NULL,
+                    DNS_PROXY_TASK_PRIORITY, &s_dns_proxy_task) != pdPASS) {
+        s_dns_proxy_running = false;
+        s_dns_proxy_task = NULL;
+        esp_gateway_dns_proxy_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "DNS proxy started on port %d", ntohs(s_dns_proxy_config.listen_port));
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_dns_proxy_stop(void)
+{
+    if (s_dns_proxy_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_dns_proxy_running = false;
+    while (s_dns_proxy_task) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    esp_gateway_dns_proxy_release();
+    return ESP_OK;
+}
+
+bool esp_gateway_dns_proxy_is_started(void)
+{
+    return s_dns_proxy_task != NULL;
+}
+
+esp_err_t esp_gateway_dns_proxy_get_stats(esp_gateway_dns_proxy_stats_t* stats)
+{
+    esp_gateway_dns_cache_stats_t cache_stats;
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_dns_cache == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_gateway_dns_cache_get_stats(s_dns_cache, &cache_stats);
+    stats->queries = cache_stats.lookups;
+    stats->hits = cache_stats.hits;
+    stats->negative_hits = cache_stats.negative_hits;
+    stats->coalesced = cache_stats.coalesced;
+    stats->evictions = cache_stats.evictions;
+    stats->upstream_queries = s_upstream_queries;
+    stats->upstream_answers = s_upstream_answers;
+    stats->upstream_timeouts = s_upstream_timeouts;
+    stats->failures = s_failures;
+    stats->latency_avg_ms = s_upstream_answers ? (uint32_t)(s_latency_sum_ms / s_upstream_answers) : 0;
+    stats->latency_max_ms = s_latency_max_ms;
+
+    return ESP_OK;
+}
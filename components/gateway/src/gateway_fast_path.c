@@ -0,0 +1,173 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/sys.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ip4.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_flow_cache.h"
+
+/*
+ * ip4_input() is redirected here with "-Wl,--wrap" (see CMakeLists.txt).
+ * The first packets of a flow go through the stack, and the NAPT hook tells the decision
+ * of ip4_forward() back with esp_gateway_fast_path_learn(). The next packets of the flow
+ * are translated in place and sent on the egress netif straight away.
+ */
+
+static const char *TAG = "gateway_fast_path";
+
+static esp_gateway_flow_cache_t* s_flow_cache = NULL;
+static uint32_t s_fast_packets = 0;
+static uint32_t s_slow_packets = 0;
+
+/* Flow of the packet going through the stack, learned if it is forwarded */
+static struct pbuf* s_pending_pbuf = NULL;
+static esp_gateway_flow_key_t s_pending_key;
+
+err_t __real_ip4_input(struct pbuf* p, struct netif* inp);
+
+static bool esp_gateway_fast_path_forward(struct pbuf* p, struct ip_hdr* iphdr, const esp_gateway_flow_entry_t* entry)
+{
+    struct netif* outp = (struct netif*)entry->outp;
+    u16_t iplen = lwip_ntohs(IPH_LEN(iphdr));
+    ip4_addr_t dest;
+
+    if (!netif_is_up(outp) || !netif_is_link_up(outp) || (outp->mtu && (iplen > outp->mtu))) {
+        return false;
+    }
+
+    if (entry->mapping && !esp_gateway_napt_mapping_refresh(entry->mapping, entry->mapping_generation)) {
+        return false;
+    }
+
+    /* Drop the Ethernet padding as ip4_input() does */
+    if (p->tot_len > iplen) {
+        pbuf_realloc(p, iplen);
+    }
+
+    esp_gateway_flow_cache_rewrite(entry, (uint8_t*)iphdr);
+    ip4_addr_copy(dest, iphdr->dest);
+    outp->output(outp, p, &dest);
+    pbuf_free(p);
+
+    return true;
+}
+
+/* Give the packet to the stack */
+static err_t fast_path_input_slow(struct pbuf* p, struct netif* inp, bool learn)
+{
+    err_t ret = ERR_OK;
+
+    if (learn) {
+        s_pending_pbuf = p;
+    }
+    ret = __real_ip4_input(p, inp);
+
+    /* The packet may have been dropped on the way, and the pbuf given to another one since */
+    s_pending_pbuf = NULL;
+    esp_gateway_napt_recv_done();
+
+    return ret;
+}
+
+err_t __wrap_ip4_input(struct pbuf* p, struct netif* inp)
+{
+    esp_gateway_flow_key_t key;
+    esp_gateway_flow_entry_t* entry = NULL;
+    bool slow_path = false;
+
+    if ((s_flow_cache == NULL)
+        || (esp_gateway_flow_key_parse((const uint8_t*)p->payload, p->len, inp, &key, &slow_path) != ESP_OK)
+        || (p->tot_len < lwip_ntohs(IPH_LEN((struct ip_hdr*)p->payload)))) {
+        return fast_path_input_slow(p, inp, false);
+    }
+
+    if (!slow_path) {
+        entry = esp_gateway_flow_cache_lookup(s_flow_cache, &key);
+        if (entry && esp_gateway_fast_path_forward(p, (struct ip_hdr*)p->payload, entry)) {
+            s_fast_packets++;
+            return ERR_OK;
+        }
+    }
+
+    s_slow_packets++;
+    s_pending_key = key;
+
+    return fast_path_input_slow(p, inp, true);
+}
+
+void esp_gateway_fast_path_learn(struct pbuf* p, struct netif* outp, esp_gateway_napt_mapping_t* mapping)
+{
+    if ((s_flow_cache == NULL) || (p != s_pending_pbuf)) {
+        return;
+    }
+
+    esp_gateway_flow_cache_learn(s_flow_cache, &s_pending_key, (const uint8_t*)p->payload, p->len, outp, mapping);
+    s_pending_pbuf = NULL;
+}
+
+void esp_gateway_fast_path_flush(void)
+{
+    if (s_flow_cache) {
+        esp_gateway_flow_cache_flush(s_flow_cache);
+    }
+}
+
+esp_err_t esp_gateway_fast_path_init(void)
+{
+    if (s_flow_cache) {
+        return ESP_OK;
+    }
+
+    s_flow_cache = esp_gateway_flow_cache_create(CONFIG_GATEWAY_FAST_PATH_CACHE_SIZE, esp_random());
+    if (s_flow_cache == NULL) {
+        ESP_LOGE(TAG, "create flow cache of %d flows fail", CONFIG_GATEWAY_FAST_PATH_CACHE_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_fast_path_get_stats(esp_gateway_fast_path_stats_t* stats)
+{
+    esp_gateway_flow_cache_stats_t cache_stats;
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_flow_cache == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_gateway_flow_cache_get_stats(s_flow_cache, &cache_stats);
+    stats->capacity = cache_stats.capacity;
+    stats->fast_packets = s_fast_packets;
+    stats->slow_packets = s_slow_packets;
+    stats->learns = cache_stats.learns;
+    stats->replacements = cache_stats.replacements;
+    stats->flushes = cache_stats.flushes;
+
+    return ESP_OK;
+}
@@ -0,0 +1,320 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_flow_cache.h"
+
+#define FLOW_IP_HLEN_MIN            (20)
+#define FLOW_IP_OFFSET_TTL          (8)
+#define FLOW_IP_OFFSET_PROTO        (9)
+#define FLOW_IP_OFFSET_CHKSUM       (10)
+#define FLOW_IP_OFFSET_SRC          (12)
+#define FLOW_IP_OFFSET_DEST         (16)
+#define FLOW_IP_FRAGMENT_MASK       (0x3FFF)    /* MF flag and fragment offset */
+
+#define FLOW_PROTO_TCP              (6)
+#define FLOW_PROTO_UDP              (17)
+#define FLOW_TCP_HLEN               (20)
+#define FLOW_TCP_OFFSET_FLAGS       (13)
+#define FLOW_TCP_OFFSET_CHKSUM      (16)
+#define FLOW_TCP_CONTROL_FLAGS      (0x07)      /* FIN, SYN and RST */
+#define FLOW_UDP_HLEN               (8)
+#define FLOW_UDP_OFFSET_CHKSUM      (6)
+
+/*
+ * Two-way set associative table: a flow lives in one of the two slots of its set.
+ * The flows learned before the last flush have an older generation and are ignored,
+ * so flushing is a single increment.
+ */
+struct esp_gateway_flow_cache {
+    uint32_t set_mask;
+    uint32_t hash_seed;
+    volatile uint32_t generation;
+    esp_gateway_flow_entry_t* entries;
+    esp_gateway_flow_cache_stats_t stats;
+};
+
+static inline uint16_t flow_read16(const uint8_t* data)
+{
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t flow_read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline void flow_write16(uint8_t* data, uint16_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+static inline void flow_write32(uint8_t* data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+/* One's complement arithmetic on the 16-bit words as they are stored in the packet (RFC 1624) */
+static inline uint32_t flow_csum_add16(uint32_t sum, uint16_t old_val, uint16_t new_val)
+{
+    return sum + (uint16_t)~old_val + new_val;
+}
+
+static inline uint32_t flow_csum_add32(uint32_t sum, uint32_t old_val, uint32_t new_val)
+{
+    sum = flow_csum_add16(sum, (uint16_t)(old_val >> 16), (uint16_t)(new_val >> 16));
+    return flow_csum_add16(sum, (uint16_t)old_val, (uint16_t)new_val);
+}
+
+static inline uint16_t flow_csum_fold(uint32_t sum)
+{
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+static inline void flow_csum_apply(uint8_t* chksum, uint16_t delta)
+{
+    flow_write16(chksum, (uint16_t)~flow_csum_fold((uint16_t)~flow_read16(chksum) + (uint32_t)delta));
+}
+
+static inline uint32_t flow_hash(const esp_gateway_flow_cache_t* cache, const esp_gateway_flow_key_t* key)
+{
+    uint32_t hash = cache->hash_seed ^ (uint32_t)(uintptr_t)key->inp;
+
+    hash = (hash ^ key->src_addr) * 0x9E3779B1UL;
+    hash = (hash ^ key->dest_addr) * 0x9E3779B1UL;
+    hash = (hash ^ (((uint32_t)key->src_port << 16) | key->dest_port)) * 0x9E3779B1UL;
+    hash = (hash ^ key->proto) * 0x9E3779B1UL;
+
+    /* The set is taken from the low bits, which the multiplications do not mix */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BUL;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35UL;
+    return hash ^ (hash >> 16);
+}
+
+static inline bool flow_key_equal(const esp_gateway_flow_key_t* a, const esp_gateway_flow_key_t* b)
+{
+    return (a->src_addr == b->src_addr) && (a->dest_addr == b->dest_addr) && (a->src_port == b->src_port)
+           && (a->dest_port == b->dest_port) && (a->proto == b->proto) && (a->inp == b->inp);
+}
+
+esp_gateway_flow_cache_t* esp_gateway_flow_cache_create(uint32_t capacity, uint32_t hash_seed)
+{
+    esp_gateway_flow_cache_t* cache = NULL;
+    uint32_t entry_num = 2;
+
+    if ((capacity == 0) || (capacity > ESP_GATEWAY_FLOW_CACHE_MAX_CAPACITY)) {
+        return NULL;
+    }
+
+    while (entry_num < capacity) {
+        entry_num <<= 1;
+    }
+
+    cache = calloc(1, sizeof(esp_gateway_flow_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->entries = calloc(entry_num, sizeof(esp_gateway_flow_entry_t));
+    if (cache->entries == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->set_mask = entry_num / 2 - 1;
+    cache->hash_seed = hash_seed;
+    cache->generation = 1;
+    cache->stats.capacity = entry_num;
+
+    return cache;
+}
+
+void esp_gateway_flow_cache_delete(esp_gateway_flow_cache_t* cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    free(cache->entries);
+    free(cache);
+}
+
+esp_err_t esp_gateway_flow_key_parse(const uint8_t* iphdr, uint32_t len, const void* inp, esp_gateway_flow_key_t* key, bool* slow_path)
+{
+    uint32_t iphdr_len = 0;
+    const uint8_t* l4hdr = NULL;
+
+    if ((len < FLOW_IP_HLEN_MIN) || ((iphdr[0] >> 4) != 4)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    iphdr_len = (iphdr[0] & 0x0F) * 4;
+    if ((iphdr_len < FLOW_IP_HLEN_MIN) || ((((iphdr[6] << 8) | iphdr[7]) & FLOW_IP_FRAGMENT_MASK) != 0)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    key->proto = iphdr[FLOW_IP_OFFSET_PROTO];
+    if (key->proto == FLOW_PROTO_TCP) {
+        if (len < iphdr_len + FLOW_TCP_HLEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *slow_path = (iphdr[iphdr_len + FLOW_TCP_OFFSET_FLAGS] & FLOW_TCP_CONTROL_FLAGS) != 0;
+    } else if (key->proto == FLOW_PROTO_UDP) {
+        if (len < iphdr_len + FLOW_UDP_HLEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *slow_path = false;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    l4hdr = iphdr + iphdr_len;
+    key->inp = inp;
+    key->src_addr = flow_read32(iphdr + FLOW_IP_OFFSET_SRC);
+    key->dest_addr = flow_read32(iphdr + FLOW_IP_OFFSET_DEST);
+    key->src_port = flow_read16(l4hdr);
+    key->dest_port = flow_read16(l4hdr + 2);
+
+    /* Let the stack answer with ICMP time exceeded */
+    if (iphdr[FLOW_IP_OFFSET_TTL] <= 1) {
+        *slow_path = true;
+    }
+
+    return ESP_OK;
+}
+
+esp_gateway_flow_entry_t* esp_gateway_flow_cache_lookup(esp_gateway_flow_cache_t* cache, const esp_gateway_flow_key_t* key)
+{
+    esp_gateway_flow_entry_t* set = &cache->entries[(flow_hash(cache, key) & cache->set_mask) * 2];
+    uint32_t generation = cache->generation;
+
+    for (uint32_t way = 0; way < 2; way++) {
+        if ((set[way].generation == generation) && flow_key_equal(&set[way].key, key)) {
+            cache->stats.hits++;
+            return &set[way];
+        }
+    }
+
+    cache->stats.misses++;
+    return NULL;
+}
+
+esp_gateway_flow_entry_t* esp_gateway_flow_cache_learn(esp_gateway_flow_cache_t* cache, const esp_gateway_flow_key_t* key,
+                                                       const uint8_t* iphdr, uint32_t len, void* outp,
+                                                       esp_gateway_napt_mapping_t* mapping)
+{
+    esp_gateway_flow_key_t sent;
+    esp_gateway_flow_entry_t* entry = NULL;
+    uint32_t hash = flow_hash(cache, key);
+    esp_gateway_flow_entry_t* set = &cache->entries[(hash & cache->set_mask) * 2];
+    uint32_t generation = cache->generation;
+    bool slow_path = false;
+    uint32_t sum = 0;
+
+    if ((esp_gateway_flow_key_parse(iphdr, len, outp, &sent, &slow_path) != ESP_OK) || (sent.proto != key->proto)) {
+        return NULL;
+    }
+
+    /* Same flow, a free slot, a stale slot, then a slot chosen by the hash */
+    for (uint32_t way = 0; way < 2; way++) {
+        if ((set[way].generation == generation) && flow_key_equal(&set[way].key, key)) {
+            entry = &set[way];
+            break;
+        }
+    }
+    for (uint32_t way = 0; (entry == NULL) && (way < 2); way++) {
+        if (set[way].generation != generation) {
+            entry = &set[way];
+        }
+    }
+    if (entry == NULL) {
+        entry = &set[(hash >> 31) & 1];
+        cache->stats.replacements++;
+    }
+
+    entry->key = *key;
+    entry->outp = outp;
+    entry->src_addr = sent.src_addr;
+    entry->dest_addr = sent.dest_addr;
+    entry->src_port = sent.src_port;
+    entry->dest_port = sent.dest_port;
+    entry->mapping = mapping;
+    entry->mapping_generation = mapping ? mapping->generation : 0;
+
+    sum = flow_csum_add32(0, key->src_addr, sent.src_addr);
+    sum = flow_csum_add32(sum, key->dest_addr, sent.dest_addr);
+    entry->ip_delta = flow_csum_fold(sum);
+    sum = flow_csum_add16(sum, key->src_port, sent.src_port);
+    sum = flow_csum_add16(sum, key->dest_port, sent.dest_port);
+    entry->l4_delta = flow_csum_fold(sum);
+
+    entry->generation = generation;
+    cache->stats.learns++;
+
+    return entry;
+}
+
+void esp_gateway_flow_cache_rewrite(const esp_gateway_flow_entry_t* entry, uint8_t* iphdr)
+{
+    uint8_t* l4hdr = iphdr + (iphdr[0] & 0x0F) * 4;
+    uint16_t ttl_proto = flow_read16(iphdr + FLOW_IP_OFFSET_TTL);
+    uint8_t* l4_chksum = NULL;
+
+    iphdr[FLOW_IP_OFFSET_TTL]--;
+    flow_csum_apply(iphdr + FLOW_IP_OFFSET_CHKSUM, flow_csum_fold(flow_csum_add16(entry->ip_delta, ttl_proto,
+                                                                                   flow_read16(iphdr + FLOW_IP_OFFSET_TTL))));
+    flow_write32(iphdr + FLOW_IP_OFFSET_SRC, entry->src_addr);
+    flow_write32(iphdr + FLOW_IP_OFFSET_DEST, entry->dest_addr);
+
+    if (entry->key.proto == FLOW_PROTO_TCP) {
+        l4_chksum = l4hdr + FLOW_TCP_OFFSET_CHKSUM;
+        flow_csum_apply(l4_chksum, entry->l4_delta);
+    } else {
+        /* A zero UDP checksum means no checksum */
+        l4_chksum = l4hdr + FLOW_UDP_OFFSET_CHKSUM;
+        if (flow_read16(l4_chksum) != 0) {
+            flow_csum_apply(l4_chksum, entry->l4_delta);
+            if (flow_read16(l4_chksum) == 0) {
+                flow_write16(l4_chksum, 0xFFFF);
+            }
+        }
+    }
+
+    flow_write16(l4hdr, entry->src_port);
+    flow_write16(l4hdr + 2, entry->dest_port);
+}
+
+void esp_gateway_flow_cache_flush(esp_gateway_flow_cache_t* cache)
+{
+    uint32_t generation = cache->generation + 1;
+
+    /* Generation 0 is the one of the never used slots */
+    cache->generation = generation ? generation : 1;
+    cache->stats.flushes++;
+}
+
+void esp_gateway_flow_cache_get_stats(esp_gateway_flow_cache_t* cache, esp_gateway_flow_cache_stats_t* stats)
+{
+    *stats = cache->stats;
+}
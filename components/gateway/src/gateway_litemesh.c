@@ -14,39 +14,121 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_event.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "nvs.h"
 
+#include "esp_netif.h"
 #include "esp_netif_ip_addr.h"
 
 #include "esp_wifi_types.h"
 
+#include "esp_gateway.h"
 #include "esp_gateway_config.h"
 #include "esp_gateway_internal.h"
 #include "esp_gateway_litemesh.h"
+#include "esp_gateway_litemesh_ie.h"
+#include "esp_gateway_litemesh_parent.h"
+#include "esp_gateway_litemesh_route_table.h"
+#include "esp_gateway_litemesh_bcast_filter.h"
+#include "esp_gateway_litemesh_path.h"
 
 #define VENDOR_OUI_0                                    CONFIG_VENDOR_OUI_0
 #define VENDOR_OUI_1                                    CONFIG_VENDOR_OUI_1
 #define VENDOR_OUI_2                                    CONFIG_VENDOR_OUI_2
 
-#define SINGLE_CHANNEL_SCAN_TIMES                       (1)
-
-#define VENDOR_IE_DATA_LENGTH_MINIMUM                   (4)
-#define VENDOR_IE_DATA_LENGTH                           (VENDOR_IE_DATA_LENGTH_MINIMUM + VENDOR_IE_MAX)
+#if CONFIG_LITEMESH_SCAN_CHANNEL_PIN
+#define LITEMESH_SCAN_CHANNEL_PIN                       (true)
+#else
+#define LITEMESH_SCAN_CHANNEL_PIN                       (false)
+#endif
+#if CONFIG_LITEMESH_SCAN_PASSIVE
+#define LITEMESH_SCAN_PASSIVE                           (true)
+#else
+#define LITEMESH_SCAN_PASSIVE                           (false)
+#endif
+#define LITEMESH_SCAN_CHANNEL_DWELL_MS                  CONFIG_LITEMESH_SCAN_CHANNEL_DWELL_MS
+#define LITEMESH_SCAN_MAX_CHANNEL                       (14)
 
-#define LITEMESH_VERSION                                (1)
+#if CONFIG_LITEMESH_IE_COMPACT
+#define LITEMESH_IE_COMPACT                             (1)
+#define LITEMESH_IE_V1_HOLD_MS                          CONFIG_LITEMESH_IE_V1_HOLD_MS
+#else
+#define LITEMESH_IE_COMPACT                             (0)
+#endif
 #define LITEMESH_MAX_LEVEL                              (10)
 #define LITEMESH_MAX_CONNECT_NUMBER                     CONFIG_LITEMESH_MAX_CONNECT_NUMBER
 #define LITEMESH_MAX_ROUTER_NUMBER                      CONFIG_LITEMESH_MAX_ROUTER_NUMBER
 #define LITEMESH_MAX_INHERITED_NETIF_NUMBER             CONFIG_LITEMESH_MAX_INHERITED_NETIF_NUMBER
-
-#define VENDOR_IE_BASE_INFO_OFFSET                      (3)
-#define LITEMESH_ROUTER_SSID_MAX_LEN                    (ESP_GATEWAY_SSID_MAX_LEN)
-#define LITEMESH_ROUTER_SSID_LEN_OFFSET                 (VENDOR_IE_BASE_INFO_OFFSET)
-#define LITEMESH_ROUTER_NUMBER_OFFSET                   (LITEMESH_ROUTER_SSID_LEN_OFFSET + 1)
-#define LITEMESH_ROUTER_SSID_OFFSET                     (LITEMESH_ROUTER_NUMBER_OFFSET + 1)
-#define LITEMESH_ROUTER_IP_SEGMENT_OFFSET               (LITEMESH_ROUTER_SSID_OFFSET + LITEMESH_ROUTER_SSID_MAX_LEN)
-#define LITEMESH_EXTERNAL_NETIF_IP_SEGMENT_OFFSET       (LITEMESH_ROUTER_IP_SEGMENT_OFFSET + LITEMESH_MAX_ROUTER_NUMBER)
+#define LITEMESH_IE_UPDATE_COALESCE_MS                  CONFIG_LITEMESH_IE_UPDATE_COALESCE_MS
+#define LITEMESH_IE_BUFFER_LEN                          (sizeof(vendor_ie_data_t) + ESP_LITEMESH_IE_MAX_PAYLOAD_LEN)
+#define LITEMESH_PARENT_SWITCH_HYSTERESIS               CONFIG_LITEMESH_PARENT_SWITCH_HYSTERESIS
+#define LITEMESH_PARENT_MIN_DWELL_MS                    CONFIG_LITEMESH_PARENT_MIN_DWELL_MS
+#define LITEMESH_PARENT_RSSI_SMOOTHING                  (2)         /* A new beacon weighs 2/8 in the smoothed RSSI */
+#define LITEMESH_PARENT_MAX_AGE_MS                      (10000)
+#if CONFIG_LITEMESH_PARENT_FAILOVER
+#define LITEMESH_PARENT_FAILOVER                        (1)
+#define LITEMESH_PARENT_FAILOVER_MAX_AGE_MS             CONFIG_LITEMESH_PARENT_FAILOVER_MAX_AGE_MS
+#define LITEMESH_PARENT_FAILOVER_MAX_ATTEMPTS           (2)         /* Candidates tried before scanning */
+#else
+#define LITEMESH_PARENT_FAILOVER                        (0)
+#endif
+#if CONFIG_LITEMESH_ROUTED
+#define LITEMESH_ROUTED                                 (1)
+#define LITEMESH_ROUTE_MAX_AGE_MS                       CONFIG_LITEMESH_ROUTE_MAX_AGE_MS
+#define LITEMESH_ROUTE_MAX_NEXT_HOPS                    ((LITEMESH_MAX_CONNECT_NUMBER < ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS) ? \
+                                                         LITEMESH_MAX_CONNECT_NUMBER : ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS)
+#define LITEMESH_ROUTE_CONFLICT_MS                      (1000)      /* A conflict lasting less is a subtree moving */
+#define LITEMESH_ROUTE_SYNC_SEGMENT_NUMBER              ESP_LITEMESH_MAX_ROUTE_NUMBER
+#else
+#define LITEMESH_ROUTED                                 (0)
+#define LITEMESH_ROUTE_SYNC_SEGMENT_NUMBER              (0)
+#endif
+#if CONFIG_LITEMESH_MULTI_ROOT
+#define LITEMESH_MULTI_ROOT                             (1)
+#define LITEMESH_ROOT_CAPACITY                          CONFIG_LITEMESH_ROOT_CAPACITY
+#define LITEMESH_ROOT_SPLIT_LOAD                        CONFIG_LITEMESH_ROOT_SPLIT_LOAD
+#define LITEMESH_ROOT_MIN_RSSI                          CONFIG_LITEMESH_ROOT_MIN_RSSI
+#define LITEMESH_TREE_MAX_CHILDREN                      LITEMESH_MAX_CONNECT_NUMBER
+#define LITEMESH_TREE_MAX_FOREIGN_SEGMENTS              (16)
+#define LITEMESH_TREE_MAX_AGE_MS                        LITEMESH_PARENT_MAX_AGE_MS
+#define LITEMESH_TREE_SYNC_SEGMENT_NUMBER               LITEMESH_TREE_MAX_FOREIGN_SEGMENTS
+#else
+#define LITEMESH_MULTI_ROOT                             (0)
+#define LITEMESH_TREE_SYNC_SEGMENT_NUMBER               (0)
+#endif
+#if CONFIG_LITEMESH_BCAST_FILTER
+#define LITEMESH_BCAST_FILTER                           (1)
+#define LITEMESH_PROXY_ARP_SIZE                         CONFIG_LITEMESH_PROXY_ARP_SIZE
+#define LITEMESH_PROXY_ARP_MAX_AGE_MS                   (300000)    /* The lwIP ARP entries live 5 minutes */
+#define LITEMESH_BCAST_DUP_WINDOW_MS                    CONFIG_LITEMESH_BCAST_DUP_WINDOW_MS
+#define LITEMESH_BCAST_RATE_LIMIT                       CONFIG_LITEMESH_BCAST_RATE_LIMIT
+#define LITEMESH_BCAST_BASIC_RATE_KBPS                  (1000)      /* The SoftAP sends the broadcasts at 1 Mbps */
+#else
+#define LITEMESH_BCAST_FILTER                           (0)
+#endif
+#if CONFIG_LITEMESH_PATH_METRICS
+#define LITEMESH_PATH_METRICS                           (1)
+#define LITEMESH_PATH_PROBE_INTERVAL_MS                 CONFIG_LITEMESH_PATH_PROBE_INTERVAL_MS
+#define LITEMESH_PATH_PROBE_SMALL_LEN                   (32)
+#define LITEMESH_PATH_PROBE_LARGE_LEN                   (1024)      /* The echo request and reply fit in a frame */
+#define LITEMESH_PATH_PROBE_LEN(seq)                    (((seq) & 1) ? LITEMESH_PATH_PROBE_LARGE_LEN : LITEMESH_PATH_PROBE_SMALL_LEN)
+#define LITEMESH_PATH_WINDOW                            (8)         /* Probes of each size the minimum RTT is taken over */
+#else
+#define LITEMESH_PATH_METRICS                           (0)
+#endif
+#define LITEMESH_PATH_RTT_UNIT_US                       (100)       /* Of the path TLV */
+#define LITEMESH_PATH_RATE_UNIT_KBPS                    (100)
+#define LITEMESH_SEGMENT_MAP_WORDS                      (256 / 32)
+#define LITEMESH_SEGMENT_MAP_TEST(map, segment)         ((map)[(segment) / 32] & (1UL << ((segment) % 32)))
+#define LITEMESH_SEGMENT_MAP_SET(map, segment)          ((map)[(segment) / 32] |= (1UL << ((segment) % 32)))
+#define LITEMESH_LINK_QUALITY_STEP                      (10)
+#define LITEMESH_LINK_QUALITY_HYSTERESIS                (4)         /* 2 dB */
 
 typedef enum {
     WIFI_ROUTER_LEVEL_0 = 0,
@@ -59,155 +141,1130 @@ typedef enum {
 } esp_gateway_wifi_router_level_t;
 
 typedef enum {
-    VERSION = 0                        ,
-    CONNECT_NUMBER_INFORMATION         ,/* 4bit(Max connect number) + 4bit(Connected station number) */
-    NODE_INFORMATION                   ,/* 1bit(Connect router status) + 3bit(Reserved) + 4bit(Level) */
-    ROUTER_SSID_LEN                    ,
-    TRACE_ROUTER_NUMBER                ,
-    ROUTER_SSID                        ,
-    TRACE_ROUTER_LIST                  ,
-    TRACE_EXTERNAL_NETIF_ROUTER_LIST   ,
-    VENDOR_IE_MAX = LITEMESH_EXTERNAL_NETIF_IP_SEGMENT_OFFSET + LITEMESH_MAX_INHERITED_NETIF_NUMBER + ESP_GATEWAY_EXTERNAL_NETIF_MAX,
-} esp_gateway_vendor_ie_t;
+    LITEMESH_EVENT_BEACON,              /* litemesh_beacon_event_t, from the Wi-Fi task */
+    LITEMESH_EVENT_IE_PUBLISH,          /* From the coalescing timer */
+    LITEMESH_EVENT_PATH_UPDATE,         /* From the path timer */
+    LITEMESH_EVENT_ROUTE_REFRESH,
+    LITEMESH_EVENT_TREE_REFRESH,
+} litemesh_event_id_t;
 
 typedef struct {
-    uint8_t version;
-    uint8_t max_connection:4;
-    uint8_t connected_station_number:4;
-    uint8_t connect_router_status:1;
-    uint8_t reserved1:3;
-    uint8_t level:4;
-    uint8_t router_mac[ESP_GATEWAY_MAC_MAX_LEN];
-    uint8_t router_ssid_len;
-    uint8_t router_number:4;
-    uint8_t inherited_netif_number:4;
-    uint8_t router_ssid[LITEMESH_ROUTER_SSID_MAX_LEN];
-    uint8_t router_net_segment[LITEMESH_MAX_ROUTER_NUMBER];
-    uint8_t inherited_net_segment[LITEMESH_MAX_INHERITED_NETIF_NUMBER];
-    uint8_t self_net_segment_num:4;
-    uint8_t reserved2:4;
-    uint8_t self_net_segment[ESP_GATEWAY_EXTERNAL_NETIF_MAX];
-} esp_gateway_litemesh_info_t;
-
-typedef struct{
-    bool valid;
-    int8_t rssi;
-    uint8_t level;
-    uint8_t channel;
-    uint8_t bssid[8];
-} ap_info_t;
+    uint8_t sa[6];
+    int rssi;
+    uint8_t ie[2 + UINT8_MAX];          /* vendor_ie_data_t, only its length is posted */
+} litemesh_beacon_event_t;
 
 static const char *TAG = "vendor_ie";
 
-static vendor_ie_data_t *esp_gateway_vendor_ie = NULL;
+/*
+ * broadcast_info is only updated in the event loop task, like in the Wi-Fi and IP event handlers: the beacons,
+ * the timers and the other tasks post LITEMESH_EVENT instead of updating it where they run.
+ */
+static ESP_EVENT_DEFINE_BASE(LITEMESH_EVENT);
+
+static vendor_ie_data_t *esp_gateway_vendor_ie = NULL;         /* IE on the air */
+static vendor_ie_data_t *litemesh_pending_ie = NULL;            /* IE waiting for the coalescing timer */
+static bool litemesh_ie_pending = false;
+static esp_timer_handle_t litemesh_ie_timer = NULL;
+static esp_litemesh_ie_stats_t litemesh_ie_stats;
+static portMUX_TYPE litemesh_ie_lock = portMUX_INITIALIZER_UNLOCKED;
+#if LITEMESH_IE_COMPACT
+static bool litemesh_ie_compact_heard = false;          /* A neighbour parsing version 2 was heard */
+static bool litemesh_ie_v1_heard = false;               /* A neighbour only parsing version 1 was heard */
+static uint32_t litemesh_ie_v1_heard_ms = 0;            /* Last time it was */
+#endif
 static esp_gateway_litemesh_info_t *broadcast_info = NULL;
-static ap_info_t best_ap_info;
+static esp_litemesh_parent_selector_t *parent_selector = NULL;
+static uint8_t litemesh_link_quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;    /* Of the link to the parent */
+#if LITEMESH_PARENT_FAILOVER
+static uint32_t litemesh_failover_attempts = 0;                                 /* Since the last parent joined */
+#endif
+static portMUX_TYPE litemesh_parent_lock = portMUX_INITIALIZER_UNLOCKED;
+#if LITEMESH_ROUTED
+static esp_litemesh_route_table_t *litemesh_route_table = NULL;
+static uint32_t litemesh_route_self_map[LITEMESH_SEGMENT_MAP_WORDS];     /* Segments of the data-forwarding netifs */
+static uint32_t litemesh_route_taken_map[LITEMESH_SEGMENT_MAP_WORDS];    /* Segments the parent routes elsewhere */
+static uint32_t litemesh_route_conflict_since = 0;      /* A segment of this node is routed elsewhere since */
+static uint32_t litemesh_route_stale_since = 0;         /* The station is out of the segments of the parent since */
+static uint32_t litemesh_route_renumbers = 0;
+static uint8_t litemesh_route_bssid[3];                 /* Of the SoftAP, as heard in the route TLV of the children */
+static bool litemesh_route_root = false;
+static portMUX_TYPE litemesh_route_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#if LITEMESH_MULTI_ROOT
+typedef struct {
+    uint8_t sa[6];
+    uint8_t nodes;                                      /* Of the subtree of the child, 0 for a free entry */
+    uint32_t last_seen;
+} litemesh_tree_child_t;
+
+typedef struct {
+    bool used;
+    uint8_t net_segment;
+    uint32_t last_seen;
+} litemesh_tree_segment_t;
+
+static litemesh_tree_child_t litemesh_tree_children[LITEMESH_TREE_MAX_CHILDREN];
+static litemesh_tree_segment_t litemesh_tree_foreign[LITEMESH_TREE_MAX_FOREIGN_SEGMENTS];    /* Of the roots of the other trees */
+static uint8_t litemesh_tree_bssid[3];                  /* Of the SoftAP, as heard in the tree TLV of the children */
+static uint8_t litemesh_uplink_load = 0;                /* Set by the application */
+static uint32_t litemesh_tree_splits = 0;
+static bool litemesh_tree_root = false;
+static bool litemesh_tree_joined = false;               /* The root of the tree is known */
+static portMUX_TYPE litemesh_tree_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#if LITEMESH_BCAST_FILTER
+static esp_litemesh_bcast_filter_t *litemesh_bcast_filter = NULL;
+static portMUX_TYPE litemesh_bcast_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#if LITEMESH_PATH_METRICS
+static esp_litemesh_path_estimator_t *litemesh_path_estimator = NULL;
+static esp_timer_handle_t litemesh_path_timer = NULL;
+static esp_litemesh_path_metric_t litemesh_path_parent;         /* As advertised by the parent */
+static esp_litemesh_path_metric_t litemesh_path_advertised;     /* Of this node, as published */
+static uint32_t litemesh_path_gateway = 0;                      /* Probed, 0 while not connected */
+static uint16_t litemesh_path_seq = 0;
+static bool litemesh_path_pending = false;                      /* Probe litemesh_path_seq is not answered yet */
+static bool litemesh_path_root = false;
+static bool litemesh_path_repost = false;                       /* The last path update was not posted */
+static portMUX_TYPE litemesh_path_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
 
 static bool connected_ap = false;
 static bool connected_eth = false;
 static volatile bool litemesh_scan_status = false;
+
+typedef enum {
+    LITEMESH_SCAN_PINNED,       /* The channel of the last association */
+    LITEMESH_SCAN_FULL,         /* All the channels */
+    LITEMESH_SCAN_CHANNEL,      /* The channel of the best candidate after a full scan, or all of them again */
+} litemesh_scan_phase_t;
+
+static litemesh_scan_phase_t litemesh_scan_phase = LITEMESH_SCAN_FULL;
+static esp_litemesh_scan_config_t litemesh_scan_config = {
+    .channel_pin = LITEMESH_SCAN_CHANNEL_PIN,
+    .passive = LITEMESH_SCAN_PASSIVE,
+    .channel_dwell_ms = LITEMESH_SCAN_CHANNEL_DWELL_MS,
+    .full_dwell_ms = 0,
+};
+static esp_litemesh_scan_stats_t litemesh_scan_stats;
+static uint32_t litemesh_scan_start_ms = 0;
+static uint32_t litemesh_start_ms = 0;
+static uint32_t litemesh_uplink_lost_ms = 0;    /* 0 while the uplink is up and before the first IP */
+static bool litemesh_joined = false;
+static portMUX_TYPE litemesh_scan_lock = portMUX_INITIALIZER_UNLOCKED;
 #if defined(CONFIG_GATEWAY_EXTERNAL_NETIF_ETHERNET)
 static uint8_t eth_net_segment;
+static bool eth_net_segment_valid = false;      /* The Ethernet address is in the address pool */
 #endif
 
 extern wifi_sta_config_t router_config;
 
-static bool esp_litemesh_info_inherit(esp_gateway_litemesh_info_t* in, esp_gateway_litemesh_info_t* out)
+static bool esp_litemesh_info_inherit(const esp_litemesh_ie_view_t* in, esp_gateway_litemesh_info_t* out)
 {
     bool update = false;
+    uint8_t router_number = (in->router_number > LITEMESH_MAX_ROUTER_NUMBER) ? LITEMESH_MAX_ROUTER_NUMBER : in->router_number;
+    uint8_t inherited_netif_number = (in->inherited_netif_number > LITEMESH_MAX_INHERITED_NETIF_NUMBER) ? LITEMESH_MAX_INHERITED_NETIF_NUMBER : in->inherited_netif_number;
+
+    if (out->connect_router_status != in->connect_router_status) {
+        out->connect_router_status = in->connect_router_status;
+        update = true;
+    }
+
+    if (out->level != (in->level) + 1) {
+        out->level = in->level + 1;
+        update = true;
+    }
+
+    /* The view has no segment list when the number is 0 */
+    if (out->router_number != router_number) {
+        out->router_number = router_number;
+        if (router_number) {
+            memcpy(out->router_net_segment, in->router_net_segment, router_number);
+        }
+        update = true;
+    } else if (router_number && memcmp(out->router_net_segment, in->router_net_segment, router_number)) {
+        memcpy(out->router_net_segment, in->router_net_segment, router_number);
+        update = true;
+    }
+
+    if (out->inherited_netif_number != inherited_netif_number) {
+        out->inherited_netif_number = inherited_netif_number;
+        if (inherited_netif_number) {
+            memcpy(out->inherited_net_segment, in->inherited_net_segment, inherited_netif_number);
+        }
+        update = true;
+    } else if (inherited_netif_number && memcmp(out->inherited_net_segment, in->inherited_net_segment, inherited_netif_number)) {
+        memcpy(out->inherited_net_segment, in->inherited_net_segment, inherited_netif_number);
+        update = true;
+    }
+
+    return update;
+}
+
+static uint32_t esp_litemesh_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/*
+ * From 10 to 100 in steps of 10, so that the jitter of the RSSI does not change the IE. The step of current
+ * is only left when the RSSI is LITEMESH_LINK_QUALITY_HYSTERESIS / 2 dB past its bounds, a smoothed RSSI
+ * sitting on a bound would flip the step at every beacon otherwise.
+ */
+static uint8_t esp_litemesh_link_quality(int8_t rssi, uint8_t current)
+{
+    int32_t quality = (rssi + 90) * 2;
+
+    if (quality > ESP_LITEMESH_UPLINK_QUALITY_MAX) {
+        quality = ESP_LITEMESH_UPLINK_QUALITY_MAX;
+    } else if (quality < 1) {
+        quality = 1;
+    }
+
+    if ((current != ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN)
+        && (quality > current - LITEMESH_LINK_QUALITY_STEP - LITEMESH_LINK_QUALITY_HYSTERESIS)
+        && (quality <= current + LITEMESH_LINK_QUALITY_HYSTERESIS)) {
+        return current;
+    }
+
+    return ((quality + LITEMESH_LINK_QUALITY_STEP - 1) / LITEMESH_LINK_QUALITY_STEP) * LITEMESH_LINK_QUALITY_STEP;
+}
+
+/* The path of the node is as good as its link to the parent or the path of the parent, whichever is worse */
+static bool esp_litemesh_uplink_quality_inherit(const esp_litemesh_ie_view_t* in, int8_t rssi, esp_gateway_litemesh_info_t* out)
+{
+    uint8_t quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;
+
+    if (in->connect_router_status) {
+        litemesh_link_quality = esp_litemesh_link_quality(rssi, litemesh_link_quality);
+        quality = litemesh_link_quality;
+        if ((in->uplink_quality != ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN) && (in->uplink_quality < quality)) {
+            quality = in->uplink_quality;
+        }
+    }
+
+    if (out->uplink_quality == quality) {
+        return false;
+    }
+
+    out->uplink_quality = quality;
+    return true;
+}
+
+static void esp_litemesh_network_segment_sync(void)
+{
+    uint8_t net_segment[LITEMESH_MAX_ROUTER_NUMBER + LITEMESH_MAX_INHERITED_NETIF_NUMBER + ESP_GATEWAY_EXTERNAL_NETIF_MAX
+                        + LITEMESH_ROUTE_SYNC_SEGMENT_NUMBER + LITEMESH_TREE_SYNC_SEGMENT_NUMBER];
+    uint32_t num = 0;
+
+    memcpy(net_segment + num, broadcast_info->router_net_segment, broadcast_info->router_number);
+    num += broadcast_info->router_number;
+    memcpy(net_segment + num, broadcast_info->inherited_net_segment, broadcast_info->inherited_netif_number);
+    num += broadcast_info->inherited_netif_number;
+    memcpy(net_segment + num, broadcast_info->self_net_segment, broadcast_info->self_net_segment_num);
+    num += broadcast_info->self_net_segment_num;
+#if LITEMESH_ROUTED
+    /* The segments of the subtree and of the rest of the mesh, the ones of this node excepted */
+    for (uint8_t loop = 0; loop < broadcast_info->route_num; loop++) {
+        if (broadcast_info->route[loop].next_hop != ESP_LITEMESH_IE_ROUTE_SELF) {
+            net_segment[num++] = broadcast_info->route[loop].net_segment;
+        }
+    }
+#endif
+#if LITEMESH_MULTI_ROOT
+    /* The segments of the roots of the other trees heard, at a root */
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_FOREIGN_SEGMENTS; loop++) {
+        if (litemesh_tree_foreign[loop].used) {
+            net_segment[num++] = litemesh_tree_foreign[loop].net_segment;
+        }
+    }
+    portEXIT_CRITICAL(&litemesh_tree_lock);
+#endif
+
+    esp_gateway_netif_litemesh_network_segment_update(net_segment, num);
+}
+
+static bool esp_litemesh_ie_equal(const vendor_ie_data_t* a, const vendor_ie_data_t* b)
+{
+    return (a->length == b->length) && !memcmp(a->payload, b->payload, a->length - ESP_LITEMESH_IE_OUI_LEN);
+}
+
+/* Hand the pending IE to the Wi-Fi driver */
+static void esp_litemesh_ie_publish(void)
+{
+    uint8_t buffer[LITEMESH_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    int64_t start = esp_timer_get_time();
+
+    /* The IE on the air changes as soon as the lock is released, the driver is given a copy */
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    if (!litemesh_ie_pending) {
+        portEXIT_CRITICAL(&litemesh_ie_lock);
+        return;
+    }
+    memcpy(esp_gateway_vendor_ie, litemesh_pending_ie, 2 + litemesh_pending_ie->length);
+    memcpy(ie, litemesh_pending_ie, 2 + litemesh_pending_ie->length);
+    litemesh_ie_pending = false;
+    portEXIT_CRITICAL(&litemesh_ie_lock);
+
+    ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, ie));
+    ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, ie));
+
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    litemesh_ie_stats.rebuilds++;
+    litemesh_ie_stats.publish_time_us += esp_timer_get_time() - start;
+    portEXIT_CRITICAL(&litemesh_ie_lock);
+}
+
+#if LITEMESH_IE_UPDATE_COALESCE_MS
+static void esp_litemesh_ie_timer_cb(void* arg)
+{
+    if (esp_event_post(LITEMESH_EVENT, LITEMESH_EVENT_IE_PUBLISH, NULL, 0, 0) != ESP_OK) {
+        /* The event queue is full, try again later */
+        esp_timer_start_once(litemesh_ie_timer, LITEMESH_IE_UPDATE_COALESCE_MS * 1000);
+    }
+}
+#endif
+
+/*
+ * The new IE is compared with the one on the air, or the one already waiting, so that an update which
+ * changes nothing never reaches the Wi-Fi driver. Changes are published after LITEMESH_IE_UPDATE_COALESCE_MS,
+ * the ones arriving meanwhile are merged, and a change reverted meanwhile, e.g. a station joining and
+ * leaving, is not published at all.
+ */
+static void esp_litemesh_info_update(esp_gateway_litemesh_info_t *current_node_info)
+{
+    uint8_t buffer[LITEMESH_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    int64_t start = esp_timer_get_time();
+    bool changed = false;
+    bool cancel = false;
+    bool schedule = false;
+
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    memcpy(ie, esp_gateway_vendor_ie, sizeof(vendor_ie_data_t));
+    portEXIT_CRITICAL(&litemesh_ie_lock);
+    if (esp_litemesh_ie_encode(current_node_info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN) != ESP_OK) {
+        ESP_LOGE(TAG, "Vendor IE encode fail");
+        return;
+    }
+
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    litemesh_ie_stats.requests++;
+    if (esp_litemesh_ie_equal(ie, litemesh_ie_pending ? litemesh_pending_ie : esp_gateway_vendor_ie)) {
+        litemesh_ie_stats.skipped++;
+    } else if (esp_litemesh_ie_equal(ie, esp_gateway_vendor_ie)) {
+        /* Back to the IE on the air before the pending one was published */
+        litemesh_ie_pending = false;
+        litemesh_ie_stats.coalesced++;
+        changed = true;
+        cancel = true;
+    } else {
+        memcpy(litemesh_pending_ie, ie, 2 + ie->length);
+        if (litemesh_ie_pending) {
+            litemesh_ie_stats.coalesced++;
+        } else {
+            litemesh_ie_pending = true;
+            schedule = true;
+        }
+        changed = true;
+    }
+    litemesh_ie_stats.update_time_us += esp_timer_get_time() - start;
+    portEXIT_CRITICAL(&litemesh_ie_lock);
+
+    if (changed) {
+        esp_litemesh_network_segment_sync();
+    }
+
+    if (cancel && litemesh_ie_timer) {
+        esp_timer_stop(litemesh_ie_timer);
+    }
+
+    if (schedule) {
+        if ((litemesh_ie_timer == NULL) || (esp_timer_start_once(litemesh_ie_timer, LITEMESH_IE_UPDATE_COALESCE_MS * 1000) != ESP_OK)) {
+            esp_litemesh_ie_publish();
+        }
+    }
+}
+
+#if LITEMESH_IE_COMPACT
+/*
+ * Version 1 is published, with the compact bit set, until a neighbour which parses version 2 is heard. Version 2
+ * is published as long as no neighbour which only parses version 1 was heard for LITEMESH_IE_V1_HOLD_MS, the nodes
+ * of the previous firmware keep hearing this node meanwhile. The TLVs of version 2 are left out in version 1.
+ */
+static bool esp_litemesh_ie_version_update(const esp_litemesh_ie_view_t* view, uint32_t now)
+{
+    uint8_t version = ESP_LITEMESH_IE_VERSION_2;
+
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    if (view->compact) {
+        litemesh_ie_compact_heard = true;
+    } else {
+        litemesh_ie_v1_heard = true;
+        litemesh_ie_v1_heard_ms = now;
+    }
+    if (!litemesh_ie_compact_heard || (litemesh_ie_v1_heard && (now - litemesh_ie_v1_heard_ms < LITEMESH_IE_V1_HOLD_MS))) {
+        version = ESP_LITEMESH_IE_VERSION_1;
+    }
+    portEXIT_CRITICAL(&litemesh_ie_lock);
+
+    if (broadcast_info->version == version) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Publish the vendor IE version %d", version);
+    broadcast_info->version = version;
+    return true;
+}
+#endif
+
+#if LITEMESH_ROUTED
+/*
+ * The routes of the IE: the segments of this node, the segments of the subtree with the fourth byte of the
+ * station of the child they go through, and the segments the parent routes elsewhere, in ascending order.
+ */
+static bool esp_litemesh_route_info_build(esp_gateway_litemesh_info_t* info)
+{
+    esp_litemesh_route_t routes[ESP_LITEMESH_MAX_ROUTE_NUMBER];
+    esp_litemesh_ie_route_t entries[ESP_LITEMESH_MAX_ROUTE_NUMBER];
+    uint32_t route_num = 0;
+    uint32_t index = 0;
+    uint8_t num = 0;
+
+    portENTER_CRITICAL(&litemesh_route_lock);
+    route_num = esp_litemesh_route_table_get_routes(litemesh_route_table, routes, ESP_LITEMESH_MAX_ROUTE_NUMBER);
+    portEXIT_CRITICAL(&litemesh_route_lock);
+
+    for (uint32_t segment = 0; (segment < 256) && (num < ESP_LITEMESH_MAX_ROUTE_NUMBER); segment++) {
+        while ((index < route_num) && (routes[index].net_segment < segment)) {
+            index++;
+        }
+
+        if (LITEMESH_SEGMENT_MAP_TEST(litemesh_route_taken_map, segment)) {
+            entries[num].next_hop = ESP_LITEMESH_IE_ROUTE_TAKEN;
+        } else if (LITEMESH_SEGMENT_MAP_TEST(litemesh_route_self_map, segment)) {
+            entries[num].next_hop = ESP_LITEMESH_IE_ROUTE_SELF;
+        } else if ((index < route_num) && (routes[index].net_segment == segment)) {
+            esp_ip4_addr_t next_hop = { .addr = routes[index].next_hop };
+            entries[num].next_hop = esp_ip4_addr4_16(&next_hop);
+        } else {
+            continue;
+        }
+        entries[num++].net_segment = segment;
+    }
+
+    if ((info->route_num == num) && !memcmp(info->route, entries, num * sizeof(entries[0]))) {
+        return false;
+    }
+
+    info->route_num = num;
+    memcpy(info->route, entries, num * sizeof(entries[0]));
+    return true;
+}
+
+/* The segments of the data-forwarding netifs and the BSSID the children name, and NAPT at the root only */
+static void esp_litemesh_route_self_update(void)
+{
+    uint8_t net_segment[CONFIG_GATEWAY_NETIF_REGISTRY_SIZE];
+    uint32_t self_map[LITEMESH_SEGMENT_MAP_WORDS] = { 0 };
+    uint32_t num = sizeof(net_segment) / sizeof(net_segment[0]);
+    uint8_t softap_mac[6];
+
+    if (esp_wifi_get_mac(WIFI_IF_AP, softap_mac) == ESP_OK) {
+        memcpy(litemesh_route_bssid, softap_mac + 3, sizeof(litemesh_route_bssid));
+    }
+
+    esp_gateway_get_data_forwarding_netif_network_segment(net_segment, &num);
+    for (uint32_t loop = 0; loop < num; loop++) {
+        LITEMESH_SEGMENT_MAP_SET(self_map, net_segment[loop]);
+    }
+    memcpy(litemesh_route_self_map, self_map, sizeof(litemesh_route_self_map));
+
+    if (connected_ap) {
+        esp_gateway_data_forwarding_netif_napt_enable(litemesh_route_root);
+    }
+}
+
+static void esp_litemesh_route_info_refresh(void)
+{
+    esp_litemesh_route_self_update();
+    if (esp_litemesh_route_info_build(broadcast_info)) {
+        esp_litemesh_info_update(broadcast_info);
+    }
+}
+
+void esp_litemesh_route_refresh(void)
+{
+    if (broadcast_info == NULL) {
+        return;
+    }
+
+    if (esp_event_post(LITEMESH_EVENT, LITEMESH_EVENT_ROUTE_REFRESH, NULL, 0, portMAX_DELAY) != ESP_OK) {
+        ESP_LOGW(TAG, "Route refresh post fail");
+    }
+}
+
+/* A beacon of a child announces its routes, the beacon of a node which is not a child any more withdraws them */
+static bool esp_litemesh_route_child_beacon(const esp_litemesh_ie_view_t* view, const uint8_t sa[6], uint32_t now)
+{
+    uint8_t segments[ESP_LITEMESH_MAX_ROUTE_NUMBER];
+    uint8_t route_num = (view->route_num > ESP_LITEMESH_MAX_ROUTE_NUMBER) ? ESP_LITEMESH_MAX_ROUTE_NUMBER : view->route_num;
+    bool is_child = view->uplink_addr && !memcmp(view->uplink_bssid, litemesh_route_bssid, sizeof(litemesh_route_bssid))
+                    && LITEMESH_SEGMENT_MAP_TEST(litemesh_route_self_map, view->uplink_addr[0]);
+    esp_err_t ret = ESP_OK;
+    bool changed = false;
+    uint32_t num = 0;
+
+    if (is_child) {
+        /* The segments the child serves or routes, not the ones it heard from this node */
+        for (uint8_t loop = 0; loop < route_num; loop++) {
+            uint8_t segment = view->route[loop].net_segment;
+            if ((view->route[loop].next_hop != ESP_LITEMESH_IE_ROUTE_TAKEN) && !LITEMESH_SEGMENT_MAP_TEST(litemesh_route_self_map, segment)) {
+                segments[num++] = segment;
+            }
+        }
+    }
+
+    portENTER_CRITICAL(&litemesh_route_lock);
+    if (is_child) {
+        uint32_t uplink_addr = esp_netif_htonl(esp_netif_htonl(esp_gateway_network_segment_to_addr(view->uplink_addr[0]).addr) | view->uplink_addr[1]);
+
+        ret = esp_litemesh_route_table_update(litemesh_route_table, sa, uplink_addr, segments, num, now, &changed);
+    } else {
+        changed = esp_litemesh_route_table_remove(litemesh_route_table, sa);
+    }
+    changed |= esp_litemesh_route_table_expire(litemesh_route_table, now);
+    portEXIT_CRITICAL(&litemesh_route_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No room for the routes of "MACSTR, MAC2STR(sa));
+    }
+
+    return changed;
+}
+
+/*
+ * Everything the parent announces but does not route to this node is used elsewhere in the mesh. A segment of
+ * this node among them only counts after LITEMESH_ROUTE_CONFLICT_MS: a subtree which moves keeps its segments,
+ * and the old routes to them take a few beacons to be withdrawn up to the common ancestor.
+ * Returns false when the station address left the segments of the parent, i.e. the parent moved its SoftAP.
+ */
+static bool esp_litemesh_route_parent_beacon(const esp_litemesh_ie_view_t* view, uint32_t now, bool* changed)
+{
+    uint32_t taken_map[LITEMESH_SEGMENT_MAP_WORDS] = { 0 };
+    uint8_t route_num = (view->route_num > ESP_LITEMESH_MAX_ROUTE_NUMBER) ? ESP_LITEMESH_MAX_ROUTE_NUMBER : view->route_num;
+    bool conflict = false;
+    bool uplink_valid = false;
+
+    *changed = false;
+    if ((view->uplink_addr == NULL) || (broadcast_info->uplink_addr[0] == 0)) {
+        return true;
+    }
+
+    for (uint8_t loop = 0; loop < route_num; loop++) {
+        uint8_t segment = view->route[loop].net_segment;
+
+        if (view->route[loop].next_hop == broadcast_info->uplink_addr[1]) {
+            continue;
+        }
+        if ((view->route[loop].next_hop == ESP_LITEMESH_IE_ROUTE_SELF) && (segment == broadcast_info->uplink_addr[0])) {
+            uplink_valid = true;
+        }
+        LITEMESH_SEGMENT_MAP_SET(taken_map, segment);
+        conflict |= (LITEMESH_SEGMENT_MAP_TEST(litemesh_route_self_map, segment) != 0);
+    }
+
+    if (!conflict) {
+        litemesh_route_conflict_since = 0;
+    } else if (litemesh_route_conflict_since == 0) {
+        litemesh_route_conflict_since = now | 1;
+    }
+
+    if (conflict && ((uint32_t)(now - litemesh_route_conflict_since) < LITEMESH_ROUTE_CONFLICT_MS)) {
+        for (uint32_t word = 0; word < LITEMESH_SEGMENT_MAP_WORDS; word++) {
+            taken_map[word] &= ~litemesh_route_self_map[word];
+        }
+    } else if (conflict) {
+        bool known = false;
+        for (uint32_t word = 0; word < LITEMESH_SEGMENT_MAP_WORDS; word++) {
+            known |= ((litemesh_route_taken_map[word] & litemesh_route_self_map[word]) != 0);
+        }
+        if (!known) {
+            ESP_LOGI(TAG, "A segment of this node is used elsewhere in the mesh, move it");
+            litemesh_route_renumbers++;
+        }
+    }
+
+    if (memcmp(taken_map, litemesh_route_taken_map, sizeof(taken_map))) {
+        memcpy(litemesh_route_taken_map, taken_map, sizeof(taken_map));
+        *changed = true;
+    }
+
+    if (uplink_valid) {
+        litemesh_route_stale_since = 0;
+    } else if (litemesh_route_stale_since == 0) {
+        litemesh_route_stale_since = now | 1;
+    }
+
+    return uplink_valid || ((uint32_t)(now - litemesh_route_stale_since) < LITEMESH_ROUTE_CONFLICT_MS);
+}
+
+bool esp_litemesh_route_lookup(uint32_t addr, uint32_t* next_hop)
+{
+    esp_ip4_addr_t ip4_addr = { .addr = addr };
+    uint8_t net_segment = 0;
+    bool found = false;
+
+    if ((litemesh_route_table == NULL) || !esp_gateway_network_segment_from_addr(ip4_addr, &net_segment)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&litemesh_route_lock);
+    found = esp_litemesh_route_table_lookup(litemesh_route_table, net_segment, next_hop);
+    portEXIT_CRITICAL(&litemesh_route_lock);
+
+    return found;
+}
+
+esp_err_t esp_litemesh_get_route_stats(esp_litemesh_route_stats_t* stats)
+{
+    esp_litemesh_route_table_stats_t table_stats;
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (litemesh_route_table == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&litemesh_route_lock);
+    esp_litemesh_route_table_get_stats(litemesh_route_table, &table_stats);
+    portEXIT_CRITICAL(&litemesh_route_lock);
+
+    stats->children = table_stats.next_hops;
+    stats->routes = table_stats.routes;
+    stats->lookups = table_stats.lookups;
+    stats->hits = table_stats.hits;
+    stats->conflicts = table_stats.conflicts;
+    stats->expirations = table_stats.expirations;
+    stats->renumbers = litemesh_route_renumbers;
+    stats->root = connected_ap && litemesh_route_root;
+
+    return ESP_OK;
+}
+#endif /* LITEMESH_ROUTED */
+
+#if LITEMESH_BCAST_FILTER
+esp_litemesh_bcast_action_t esp_litemesh_bcast_input(const uint8_t* frame, uint32_t len, const uint8_t self_mac[6], uint8_t* reply)
+{
+    esp_litemesh_bcast_action_t action = ESP_LITEMESH_BCAST_PASS;
+
+    if (litemesh_bcast_filter == NULL) {
+        return action;
+    }
+
+    portENTER_CRITICAL(&litemesh_bcast_lock);
+    action = esp_litemesh_bcast_filter_input(litemesh_bcast_filter, frame, len, self_mac, esp_litemesh_now(), reply);
+    portEXIT_CRITICAL(&litemesh_bcast_lock);
+
+    return action;
+}
+
+esp_err_t esp_litemesh_get_bcast_stats(esp_litemesh_bcast_stats_t* stats)
+{
+    esp_litemesh_bcast_filter_stats_t filter_stats;
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (litemesh_bcast_filter == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&litemesh_bcast_lock);
+    esp_litemesh_bcast_filter_get_stats(litemesh_bcast_filter, &filter_stats);
+    portEXIT_CRITICAL(&litemesh_bcast_lock);
+
+    stats->neighbours = filter_stats.neighbours;
+    stats->arp_requests = filter_stats.arp_requests;
+    stats->arp_answered = filter_stats.arp_answered;
+    stats->duplicates = filter_stats.duplicates;
+    stats->rate_limited = filter_stats.rate_limited;
+    stats->suppressed_bytes = filter_stats.suppressed_bytes;
+    stats->airtime_saved_us = filter_stats.airtime_saved_us;
+
+    return ESP_OK;
+}
+#endif /* LITEMESH_BCAST_FILTER */
+
+#if LITEMESH_PATH_METRICS
+/*
+ * The path of a root is its link to the router. Below a parent, the link is added to the path the parent
+ * advertises, and the path is unknown while the parent advertises none. Called with litemesh_path_lock held.
+ */
+static bool esp_litemesh_path_estimate(void)
+{
+    esp_litemesh_path_metric_t link;
+    esp_litemesh_path_metric_t path = { 0 };
+
+    if (esp_litemesh_path_estimator_get(litemesh_path_estimator, &link) && (litemesh_path_root || litemesh_path_parent.kbps)) {
+        esp_litemesh_path_combine(litemesh_path_root ? NULL : &litemesh_path_parent, &link, &path);
+    }
+
+    if (!esp_litemesh_path_changed(&litemesh_path_advertised, &path)) {
+        return false;
+    }
+
+    litemesh_path_advertised = path;
+    return true;
+}
+
+static bool esp_litemesh_path_info_build(esp_gateway_litemesh_info_t* info)
+{
+    uint32_t rtt = 0;
+    uint32_t rate = 0;
+
+    portENTER_CRITICAL(&litemesh_path_lock);
+    rtt = litemesh_path_advertised.rtt_us / LITEMESH_PATH_RTT_UNIT_US;
+    rate = (litemesh_path_advertised.kbps + LITEMESH_PATH_RATE_UNIT_KBPS - 1) / LITEMESH_PATH_RATE_UNIT_KBPS;
+    portEXIT_CRITICAL(&litemesh_path_lock);
+
+    rtt = (rtt > UINT16_MAX) ? UINT16_MAX : rtt;
+    rate = (rate > UINT16_MAX) ? UINT16_MAX : rate;
+    if ((info->path_rtt == rtt) && (info->path_rate == rate)) {
+        return false;
+    }
+
+    info->path_rtt = rtt;
+    info->path_rate = rate;
+    return true;
+}
+
+/* Probe gateway from now on, 0 to stop, the samples of the previous link are dropped */
+static void esp_litemesh_path_set_gateway(uint32_t gateway, bool root)
+{
+    portENTER_CRITICAL(&litemesh_path_lock);
+    esp_litemesh_path_estimator_reset(litemesh_path_estimator);
+    memset(&litemesh_path_parent, 0, sizeof(litemesh_path_parent));
+    memset(&litemesh_path_advertised, 0, sizeof(litemesh_path_advertised));
+    litemesh_path_gateway = gateway;
+    litemesh_path_root = root;
+    litemesh_path_pending = false;
+    portEXIT_CRITICAL(&litemesh_path_lock);
+
+    esp_litemesh_path_info_build(broadcast_info);
+}
+
+static bool esp_litemesh_path_parent_beacon(const esp_litemesh_ie_view_t* view, esp_gateway_litemesh_info_t* info)
+{
+    bool changed = false;
+
+    portENTER_CRITICAL(&litemesh_path_lock);
+    litemesh_path_parent.rtt_us = view->path_rtt * LITEMESH_PATH_RTT_UNIT_US;
+    litemesh_path_parent.kbps = view->path_rate * LITEMESH_PATH_RATE_UNIT_KBPS;
+    changed = esp_litemesh_path_estimate();
+    portEXIT_CRITICAL(&litemesh_path_lock);
+
+    return changed && esp_litemesh_path_info_build(info);
+}
+
+/*
+ * A small and a large probe in turn, one per interval. A probe not answered by the next tick is lost,
+ * the samples received meanwhile are taken into the path at the tick.
+ */
+static void esp_litemesh_path_timer_cb(void* arg)
+{
+    bool changed = false;
+    uint32_t dest = 0;
+    uint16_t seq = 0;
+
+    portENTER_CRITICAL(&litemesh_path_lock);
+    if (litemesh_path_pending) {
+        esp_litemesh_path_estimator_loss(litemesh_path_estimator);
+        litemesh_path_pending = false;
+    }
+    changed = esp_litemesh_path_estimate();
+    dest = litemesh_path_gateway;
+    if (dest) {
+        seq = ++litemesh_path_seq;
+        litemesh_path_pending = true;
+    }
+    portEXIT_CRITICAL(&litemesh_path_lock);
+
+    /* The IE is built in the event loop task, the next tick posts again if the event queue is full */
+    if (changed || litemesh_path_repost) {
+        litemesh_path_repost = (esp_event_post(LITEMESH_EVENT, LITEMESH_EVENT_PATH_UPDATE, NULL, 0, 0) != ESP_OK);
+    }
+
+    /* Not under the lock, the answer may be reported before the send returns */
+    if (dest && (esp_litemesh_probe_send(dest, LITEMESH_PATH_PROBE_LEN(seq), seq) != ESP_OK)) {
+        ESP_LOGD(TAG, "Path probe %u not sent", seq);
+    }
+}
+
+void esp_litemesh_path_probe_done(uint16_t seq, uint32_t rtt_us)
+{
+    portENTER_CRITICAL(&litemesh_path_lock);
+    /* A late answer to a probe counted lost, or to a probe of the previous link, is dropped */
+    if (litemesh_path_pending && (seq == litemesh_path_seq)) {
+        esp_litemesh_path_estimator_sample(litemesh_path_estimator, LITEMESH_PATH_PROBE_LEN(seq), rtt_us);
+        litemesh_path_pending = false;
+    }
+    portEXIT_CRITICAL(&litemesh_path_lock);
+}
+
+esp_err_t esp_litemesh_get_path_stats(esp_litemesh_path_stats_t* stats)
+{
+    esp_litemesh_path_estimator_stats_t estimator_stats;
+    esp_litemesh_path_metric_t link = { 0 };
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (litemesh_path_estimator == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    portENTER_CRITICAL(&litemesh_path_lock);
+    esp_litemesh_path_estimator_get(litemesh_path_estimator, &link);
+    esp_litemesh_path_estimator_get_stats(litemesh_path_estimator, &estimator_stats);
+    stats->path_rtt_us = litemesh_path_advertised.rtt_us;
+    stats->path_kbps = litemesh_path_advertised.kbps;
+    portEXIT_CRITICAL(&litemesh_path_lock);
+
+    stats->link_rtt_us = link.rtt_us;
+    stats->link_kbps = link.kbps;
+    stats->probes = estimator_stats.samples;
+    stats->losses = estimator_stats.losses;
+    stats->valid = (stats->path_kbps != 0);
+
+    return ESP_OK;
+}
+#endif /* LITEMESH_PATH_METRICS */
+
+#if LITEMESH_MULTI_ROOT
+/* The share of its capacity the tree of a root takes, or the load the application set, whichever is higher */
+static uint8_t esp_litemesh_tree_root_load(uint32_t subtree_nodes)
+{
+    uint32_t load = (subtree_nodes - 1) * ESP_LITEMESH_ROOT_LOAD_MAX / LITEMESH_ROOT_CAPACITY;
+
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    if (litemesh_uplink_load > load) {
+        load = litemesh_uplink_load;
+    }
+    portEXIT_CRITICAL(&litemesh_tree_lock);
+
+    return (load > ESP_LITEMESH_ROOT_LOAD_MAX) ? ESP_LITEMESH_ROOT_LOAD_MAX : load;
+}
+
+/*
+ * The tree TLV of the IE: the subtree is this node and the subtrees of the children heard lately, a root
+ * names itself and publishes its load and its segments, the other nodes repeat the ones of their parent.
+ * The TLV is left out until the root is known.
+ */
+static bool esp_litemesh_tree_info_build(esp_gateway_litemesh_info_t* info)
+{
+    uint8_t net_segment[CONFIG_GATEWAY_NETIF_REGISTRY_SIZE];
+    uint32_t num = sizeof(net_segment) / sizeof(net_segment[0]);
+    uint32_t subtree_nodes = 1;
+    uint8_t tree_nodes = 0;
+    uint8_t root_load = info->root_load;
+    bool update = false;
+
+    if (!litemesh_tree_root) {
+        num = info->tree_segment_num;
+        memcpy(net_segment, info->tree_segment, num);
+    }
+
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_CHILDREN; loop++) {
+        subtree_nodes += litemesh_tree_children[loop].nodes;
+    }
+    portEXIT_CRITICAL(&litemesh_tree_lock);
+
+    if (litemesh_tree_joined) {
+        tree_nodes = (subtree_nodes > UINT8_MAX) ? UINT8_MAX : subtree_nodes;
+    }
+
+    if (litemesh_tree_root) {
+        root_load = esp_litemesh_tree_root_load(subtree_nodes);
+        if (memcmp(info->root_id, litemesh_tree_bssid, sizeof(info->root_id))) {
+            memcpy(info->root_id, litemesh_tree_bssid, sizeof(info->root_id));
+            update = true;
+        }
+        esp_gateway_get_data_forwarding_netif_network_segment(net_segment, &num);
+    }
+
+    if (num > ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER) {
+        num = ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER;
+    }
+
+    if ((info->tree_nodes != tree_nodes) || (info->root_load != root_load) || (info->tree_segment_num != num)
+        || memcmp(info->tree_segment, net_segment, num)) {
+        info->tree_nodes = tree_nodes;
+        info->root_load = root_load;
+        info->tree_segment_num = num;
+        memcpy(info->tree_segment, net_segment, num);
+        update = true;
+    }
+
+    return update;
+}
+
+/* The BSSID the children name, and whether this node is a root, from the uplink it got its address on */
+static void esp_litemesh_tree_self_update(const wifi_ap_record_t* ap_info, bool root)
+{
+    uint8_t softap_mac[6];
+
+    if (esp_wifi_get_mac(WIFI_IF_AP, softap_mac) == ESP_OK) {
+        memcpy(litemesh_tree_bssid, softap_mac + 3, sizeof(litemesh_tree_bssid));
+    }
+
+    if (ap_info) {
+        memcpy(broadcast_info->uplink_bssid, ap_info->bssid + 3, sizeof(broadcast_info->uplink_bssid));
+    }
+    litemesh_tree_root = root;
+    litemesh_tree_joined = root;
+}
+
+static void esp_litemesh_tree_leave(void)
+{
+    memset(broadcast_info->uplink_bssid, 0, sizeof(broadcast_info->uplink_bssid));
+    litemesh_tree_root = false;
+    litemesh_tree_joined = false;
+
+    /* The other trees may be the next one of the node */
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    memset(litemesh_tree_foreign, 0, sizeof(litemesh_tree_foreign));
+    portEXIT_CRITICAL(&litemesh_tree_lock);
+}
+
+static void esp_litemesh_tree_info_refresh(void)
+{
+    if (esp_litemesh_tree_info_build(broadcast_info)) {
+        esp_litemesh_info_update(broadcast_info);
+    }
+}
+
+void esp_litemesh_tree_refresh(void)
+{
+    if (broadcast_info == NULL) {
+        return;
+    }
+
+    if (esp_event_post(LITEMESH_EVENT, LITEMESH_EVENT_TREE_REFRESH, NULL, 0, portMAX_DELAY) != ESP_OK) {
+        ESP_LOGW(TAG, "Tree refresh post fail");
+    }
+}
+
+/* The root of the tree, its load and its segments come down from the parent */
+static bool esp_litemesh_tree_parent_beacon(const esp_litemesh_ie_view_t* view, esp_gateway_litemesh_info_t* info)
+{
+    uint8_t tree_segment_num = 0;
+    bool update = false;
+
+    if ((view->root_id == NULL) || litemesh_tree_root) {
+        return false;
+    }
+
+    if (!litemesh_tree_joined || memcmp(info->root_id, view->root_id, sizeof(info->root_id))) {
+        memcpy(info->root_id, view->root_id, sizeof(info->root_id));
+        litemesh_tree_joined = true;
+        update = true;
+
+        portENTER_CRITICAL(&litemesh_tree_lock);
+        memset(litemesh_tree_foreign, 0, sizeof(litemesh_tree_foreign));
+        portEXIT_CRITICAL(&litemesh_tree_lock);
+    }
+
+    if (info->root_load != view->root_load) {
+        info->root_load = view->root_load;
+        update = true;
+    }
+
+    tree_segment_num = (view->tree_segment_num > ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER) ? ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER : view->tree_segment_num;
+    if ((info->tree_segment_num != tree_segment_num) || memcmp(info->tree_segment, view->tree_segment, tree_segment_num)) {
+        info->tree_segment_num = tree_segment_num;
+        memcpy(info->tree_segment, view->tree_segment, tree_segment_num);
+        update = true;
+    }
+
+    return update | esp_litemesh_tree_info_build(info);
+}
+
+static bool esp_litemesh_tree_segment_record(uint8_t net_segment, uint32_t now)
+{
+    litemesh_tree_segment_t* entry = NULL;
+
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_FOREIGN_SEGMENTS; loop++) {
+        litemesh_tree_segment_t* slot = &litemesh_tree_foreign[loop];
+
+        if (slot->used && (slot->net_segment == net_segment)) {
+            slot->last_seen = now;
+            return false;
+        }
+        if ((entry == NULL) || (entry->used && (!slot->used || ((uint32_t)(now - slot->last_seen) > (uint32_t)(now - entry->last_seen))))) {
+            entry = slot;
+        }
+    }
+
+    entry->used = true;
+    entry->net_segment = net_segment;
+    entry->last_seen = now;
+    return true;
+}
+
+/*
+ * A beacon of a child gives the size of its subtree. A beacon of another tree gives the segments of its root:
+ * of two roots, the one with the higher ID keeps away from the segments of the other, so that the two do not
+ * move away from each other at the same time. The other nodes leave their segments to the routes and to the
+ * segments of their parent, a root moving renumbers its tree already.
+ * Returns true when the subtree of this node changed.
+ */
+static bool esp_litemesh_tree_beacon(const esp_litemesh_ie_view_t* view, const uint8_t sa[6], uint32_t now)
+{
+    bool is_child = view->tree_nodes && !memcmp(view->uplink_bssid, litemesh_tree_bssid, sizeof(litemesh_tree_bssid));
+    bool foreign = view->tree_nodes && litemesh_tree_root
+                   && (memcmp(broadcast_info->root_id, view->root_id, sizeof(broadcast_info->root_id)) > 0);
+    litemesh_tree_child_t* entry = NULL;
+    bool subtree_changed = false;
+    bool foreign_changed = false;
+
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_CHILDREN; loop++) {
+        litemesh_tree_child_t* slot = &litemesh_tree_children[loop];
+
+        if (slot->nodes && !memcmp(slot->sa, sa, sizeof(slot->sa))) {
+            entry = slot;
+        } else if (slot->nodes && ((uint32_t)(now - slot->last_seen) > LITEMESH_TREE_MAX_AGE_MS)) {
+            slot->nodes = 0;
+            subtree_changed = true;
+        }
+    }
 
-    if (out->connect_router_status != in->connect_router_status) {
-        out->connect_router_status = in->connect_router_status;
-        update = true;
+    if (is_child && (entry == NULL)) {
+        for (uint32_t loop = 0; (loop < LITEMESH_TREE_MAX_CHILDREN) && (entry == NULL); loop++) {
+            if (litemesh_tree_children[loop].nodes == 0) {
+                entry = &litemesh_tree_children[loop];
+                memcpy(entry->sa, sa, sizeof(entry->sa));
+            }
+        }
     }
 
-    if (out->level != (in->level) + 1) {
-        out->level = in->level + 1;
-        update = true;
+    if (entry) {
+        uint8_t nodes = is_child ? view->tree_nodes : 0;
+
+        subtree_changed |= (entry->nodes != nodes);
+        entry->nodes = nodes;
+        entry->last_seen = now;
     }
 
-    if (out->router_number != in->router_number) {
-        out->router_number = in->router_number;
-        memcpy(out->router_net_segment, in->router_net_segment, in->router_number);
-        update = true;
-    } else {
-        if (!memcmp(out->router_net_segment, in->router_net_segment, in->router_number)) {
-            memcpy(out->router_net_segment, in->router_net_segment, in->router_number);
-            update = true;
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_FOREIGN_SEGMENTS; loop++) {
+        litemesh_tree_segment_t* slot = &litemesh_tree_foreign[loop];
+
+        if (slot->used && ((uint32_t)(now - slot->last_seen) > LITEMESH_TREE_MAX_AGE_MS)) {
+            slot->used = false;
+            foreign_changed = true;
         }
     }
 
-    if (out->inherited_netif_number != in->inherited_netif_number) {
-        out->inherited_netif_number = in->inherited_netif_number;
-        memcpy(out->inherited_net_segment, in->inherited_net_segment, in->inherited_netif_number);
-        update = true;
-    } else {
-        if (!memcmp(out->inherited_net_segment, in->inherited_net_segment, in->inherited_netif_number)) {
-            memcpy(out->inherited_net_segment, in->inherited_net_segment, in->inherited_netif_number);
-            update = true;
+    if (foreign) {
+        for (uint8_t loop = 0; loop < view->tree_segment_num; loop++) {
+            foreign_changed |= esp_litemesh_tree_segment_record(view->tree_segment[loop], now);
         }
     }
+    portEXIT_CRITICAL(&litemesh_tree_lock);
 
-    return update;
+    if (foreign_changed) {
+        esp_litemesh_network_segment_sync();
+    }
+
+    return subtree_changed;
 }
 
-static esp_err_t esp_litemesh_info_unpack(vendor_ie_data_t *vendor_ie, esp_gateway_litemesh_info_t* out)
+esp_err_t esp_litemesh_set_uplink_load(uint8_t percent)
 {
-    uint8_t offset = LITEMESH_ROUTER_SSID_OFFSET;
-    uint8_t router_ssid_length = vendor_ie->payload[ROUTER_SSID_LEN];
-    uint8_t router_number = vendor_ie->payload[TRACE_ROUTER_NUMBER] >> 4;
-    uint8_t inherited_netif_number = vendor_ie->payload[TRACE_ROUTER_NUMBER] & 0x0F;
+    if (percent > ESP_LITEMESH_ROOT_LOAD_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    out->version = vendor_ie->payload[VERSION];
-    out->max_connection = vendor_ie->payload[CONNECT_NUMBER_INFORMATION] >> 4;
-    out->connected_station_number = vendor_ie->payload[CONNECT_NUMBER_INFORMATION] & 0x0F;
-    out->connect_router_status = vendor_ie->payload[NODE_INFORMATION] >> 7;
-    out->level = vendor_ie->payload[NODE_INFORMATION] & 0x0F;
-    out->router_ssid_len = router_ssid_length;
-    memcpy(out->router_ssid, vendor_ie->payload + offset, router_ssid_length);
-    offset += router_ssid_length;
+    if (broadcast_info == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    out->router_number = router_number;
-    memcpy(out->router_net_segment, vendor_ie->payload + offset, router_number);
-    offset += router_number;
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    litemesh_uplink_load = percent;
+    portEXIT_CRITICAL(&litemesh_tree_lock);
 
-    out->inherited_netif_number = inherited_netif_number;
-    memcpy(out->inherited_net_segment, vendor_ie->payload + offset, inherited_netif_number);
+    esp_litemesh_tree_refresh();
 
     return ESP_OK;
 }
 
-static void esp_litemesh_info_update(esp_gateway_litemesh_info_t *current_node_info)
+esp_err_t esp_litemesh_get_tree_stats(esp_litemesh_tree_stats_t* stats)
 {
-    ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    uint8_t offset = LITEMESH_ROUTER_SSID_OFFSET;
-    uint8_t router_ssid_length = current_node_info->router_ssid_len;
-    uint8_t router_number = current_node_info->router_number;
+    if (broadcast_info == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->subtree_nodes = 1;
+    portENTER_CRITICAL(&litemesh_tree_lock);
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_CHILDREN; loop++) {
+        stats->subtree_nodes += litemesh_tree_children[loop].nodes;
+        stats->children += litemesh_tree_children[loop].nodes ? 1 : 0;
+    }
+    for (uint32_t loop = 0; loop < LITEMESH_TREE_MAX_FOREIGN_SEGMENTS; loop++) {
+        stats->foreign_segments += litemesh_tree_foreign[loop].used ? 1 : 0;
+    }
+    stats->splits = litemesh_tree_splits;
+    portEXIT_CRITICAL(&litemesh_tree_lock);
+    stats->root_load = broadcast_info->tree_nodes ? broadcast_info->root_load : ESP_LITEMESH_ROOT_LOAD_UNKNOWN;
+    stats->root = connected_ap && litemesh_tree_root;
+
+    return ESP_OK;
+}
+#endif /* LITEMESH_MULTI_ROOT */
 
-    esp_gateway_vendor_ie->payload[VERSION] = current_node_info->version;
-    esp_gateway_vendor_ie->payload[CONNECT_NUMBER_INFORMATION] = ((current_node_info->max_connection << 4) | 0x0F) & (current_node_info->connected_station_number | 0xF0);
-    esp_gateway_vendor_ie->payload[NODE_INFORMATION] = ((current_node_info->connect_router_status << 7) | 0x0F) & (current_node_info->level | 0x80); 
-    esp_gateway_vendor_ie->payload[ROUTER_SSID_LEN] = router_ssid_length;
-    esp_gateway_vendor_ie->payload[TRACE_ROUTER_NUMBER] = ((current_node_info->router_number << 4) | 0x0F) & ((current_node_info->inherited_netif_number + current_node_info->self_net_segment_num) | 0xF0);
+esp_err_t esp_litemesh_get_ie_stats(esp_litemesh_ie_stats_t* stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    if (router_ssid_length) {
-        memcpy(esp_gateway_vendor_ie->payload + offset, current_node_info->router_ssid, router_ssid_length);
-        offset += router_ssid_length;
+    if (esp_gateway_vendor_ie == NULL) {
+        return ESP_ERR_INVALID_STATE;
     }
 
-    memcpy(esp_gateway_vendor_ie->payload + offset, current_node_info->router_net_segment, router_number);
-    offset += router_number;
+    portENTER_CRITICAL(&litemesh_ie_lock);
+    *stats = litemesh_ie_stats;
+    portEXIT_CRITICAL(&litemesh_ie_lock);
 
-    memcpy(esp_gateway_vendor_ie->payload + offset, current_node_info->inherited_net_segment, current_node_info->inherited_netif_number);
-    offset += current_node_info->inherited_netif_number;
+    return ESP_OK;
+}
 
-    memcpy(esp_gateway_vendor_ie->payload + offset, current_node_info->self_net_segment, current_node_info->self_net_segment_num);
-    offset += current_node_info->self_net_segment_num;
+esp_err_t esp_litemesh_set_parent_score(esp_litemesh_parent_score_t score, void* arg)
+{
+    if (parent_selector == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    esp_gateway_vendor_ie->length = VENDOR_IE_DATA_LENGTH_MINIMUM + offset;
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    esp_litemesh_parent_selector_set_score(parent_selector, score, arg);
+    portEXIT_CRITICAL(&litemesh_parent_lock);
 
-    ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+    return ESP_OK;
 }
 
 static uint8_t esp_litemesh_get_level(void)
@@ -218,9 +1275,9 @@ static uint8_t esp_litemesh_get_level(void)
 bool esp_litemesh_network_segment_is_used(uint32_t ip)
 {
     esp_ip4_addr_t ip4_addr = {.addr = ip};
-    uint8_t addr3 = esp_ip4_addr3_16(&ip4_addr);
+    uint8_t addr3 = 0;
 
-    if (broadcast_info == NULL) {
+    if ((broadcast_info == NULL) || !esp_gateway_network_segment_from_addr(ip4_addr, &addr3)) {
         return false;
     }
 
@@ -260,62 +1317,368 @@ static void esp_litemesh_set_level(uint8_t level)
     broadcast_info->level = level;
 }
 
-static void esp_gateway_vendor_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6], const vendor_ie_data_t *vnd_ie, int rssi)
+/* Keep the candidate table in step with a beacon, the nodes which cannot take this node are left out */
+static bool esp_litemesh_parent_candidate_update(const esp_litemesh_ie_view_t* view, const uint8_t sa[6], int rssi, bool is_parent, uint32_t now)
 {
-    if (type == WIFI_VND_IE_TYPE_BEACON) {
-        vendor_ie_data_t *vendor_ie = (vendor_ie_data_t *)vnd_ie;
-        if (vendor_ie->vendor_oui[0] == VENDOR_OUI_0 
-            && vendor_ie->vendor_oui[1] == VENDOR_OUI_1 
-            && vendor_ie->vendor_oui[2] == VENDOR_OUI_2) {
-
-            esp_gateway_litemesh_info_t temp;
-            memset(&temp, 0x0, sizeof(esp_gateway_litemesh_info_t));
-            esp_litemesh_info_unpack((vendor_ie_data_t *)vendor_ie, &temp);
-
-            if (connected_ap) { /* update parent info */
-                wifi_ap_record_t ap_info;
-                esp_wifi_sta_get_ap_info(&ap_info);
-                if (!memcmp(ap_info.bssid , sa, sizeof(ap_info.bssid))) {
-                    if (broadcast_info->router_ssid_len != 0) { /* No need to compare ssid without network configuration */
-                        if ((temp.router_ssid_len != broadcast_info->router_ssid_len) /* Compare ssid to distinguish different mesh networks */
-                            || strncmp((char*)temp.router_ssid, (char*)broadcast_info->router_ssid, temp.router_ssid_len)) {
-                            esp_wifi_disconnect();
-                            return;
-                        }
-                    }
-                    if (esp_litemesh_info_inherit(&temp, broadcast_info)) {
-                        esp_litemesh_info_update(broadcast_info);
-                    }
-                }
-            } else {
-                /* should choose the best one */
-                if ((temp.max_connection > temp.connected_station_number) 
-                    && (temp.connect_router_status == 1)){
-                    /* No network configuration || Judge whether it is the same mesh network in the distribution network state */
-                    if ((strlen((char*)router_config.ssid) == 0) || ((temp.router_ssid_len == ((strlen((char*)router_config.ssid)) > sizeof(router_config.ssid)?sizeof(router_config.ssid):strlen((char*)router_config.ssid)))
-                        && !strncmp((char*)temp.router_ssid, (char*)router_config.ssid, temp.router_ssid_len))) {
-                        /* The conditions that need to be met to select the optimal node */
-                        if (((rssi > best_ap_info.rssi ) && (temp.level < best_ap_info.level))
-                            || ((rssi < best_ap_info.rssi) && (rssi > best_ap_info.rssi - 15) && (temp.level < best_ap_info.level))
-                            || ((rssi > best_ap_info.rssi + 15) && (temp.level > best_ap_info.level))) {
-                            best_ap_info.rssi = rssi;
-                            best_ap_info.valid = true;
-
-                            uint8_t primary;
-                            wifi_second_chan_t second;
-                            if (esp_wifi_get_channel(&primary, &second) == ESP_OK) {
-                                best_ap_info.channel = primary;
-                            }
-
-                            memcpy(best_ap_info.bssid, sa, sizeof(best_ap_info.bssid));
-                            esp_litemesh_info_inherit(&temp, broadcast_info);
-                        }
-                    }
+    uint8_t router_ssid_len = strnlen((char*)router_config.ssid, sizeof(router_config.ssid));
+    esp_litemesh_parent_t beacon;
+    uint8_t primary;
+    wifi_second_chan_t second;
+
+    /* No network configuration || Judge whether it is the same mesh network in the distribution network state */
+    if (((view->max_connection <= view->connected_station_number) && !is_parent)
+        || (view->connect_router_status != 1) || (view->level >= LITEMESH_MAX_LEVEL)
+        || ((router_ssid_len != 0) && !esp_litemesh_ie_ssid_match(view, router_config.ssid, router_ssid_len))) {
+        portENTER_CRITICAL(&litemesh_parent_lock);
+        esp_litemesh_parent_selector_remove(parent_selector, sa);
+        portEXIT_CRITICAL(&litemesh_parent_lock);
+        return false;
+    }
+
+    memset(&beacon, 0, sizeof(beacon));
+    memcpy(beacon.bssid, sa, sizeof(beacon.bssid));
+    if (esp_wifi_get_channel(&primary, &second) == ESP_OK) {
+        beacon.channel = primary;
+    }
+    beacon.level = view->level;
+    beacon.rssi = (rssi < INT8_MIN) ? INT8_MIN : ((rssi > INT8_MAX) ? INT8_MAX : rssi);
+    beacon.connected_station_number = view->connected_station_number;
+    beacon.max_connection = view->max_connection;
+    beacon.uplink_quality = view->uplink_quality;
+    beacon.root_load = view->root_id ? view->root_load : ESP_LITEMESH_ROOT_LOAD_UNKNOWN;
+    beacon.path_rtt_us = view->path_rtt * LITEMESH_PATH_RTT_UNIT_US;
+    beacon.path_kbps = view->path_rate * LITEMESH_PATH_RATE_UNIT_KBPS;
+
+    /* The format read by the beacon trace replay of the host test */
+    ESP_LOGD(TAG, "beacon %" PRIu32 " " MACSTR " %u %u/%u %u %d", now, MAC2STR(sa), beacon.level,
+             beacon.connected_station_number, beacon.max_connection, beacon.uplink_quality, beacon.rssi);
+
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    esp_litemesh_parent_selector_update(parent_selector, &beacon, now);
+    portEXIT_CRITICAL(&litemesh_parent_lock);
+
+    return true;
+}
+
+static void esp_litemesh_parent_switch_check(uint32_t now)
+{
+    esp_litemesh_parent_t better;
+    bool switch_parent = false;
+
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    switch_parent = esp_litemesh_parent_selector_should_switch(parent_selector, now, broadcast_info->level, &better);
+    if (switch_parent) {
+        /* Decided once, the disconnection and the scan which follow pick the candidate again */
+        esp_litemesh_parent_selector_set_parent(parent_selector, NULL, now);
+    }
+    portEXIT_CRITICAL(&litemesh_parent_lock);
+
+    if (switch_parent) {
+        ESP_LOGI(TAG, "Switch to the better parent "MACSTR" level %d rssi %d", MAC2STR(better.bssid), better.level, better.rssi);
+        esp_wifi_disconnect();
+    }
+}
+
+static void esp_litemesh_beacon_handle(const vendor_ie_data_t *vendor_ie, const uint8_t sa[6], int rssi)
+{
+    esp_litemesh_ie_view_t temp;
+    if (esp_litemesh_ie_parse(vendor_ie, &temp) != ESP_OK) {
+        return;
+    }
+
+    uint32_t now = esp_litemesh_now();
+#if LITEMESH_IE_COMPACT
+    if (esp_litemesh_ie_version_update(&temp, now)) {
+        esp_litemesh_info_update(broadcast_info);
+    }
+#endif
+#if LITEMESH_ROUTED
+    if (esp_litemesh_route_child_beacon(&temp, sa, now) && esp_litemesh_route_info_build(broadcast_info)) {
+        esp_litemesh_info_update(broadcast_info);
+    }
+#endif
+#if LITEMESH_MULTI_ROOT
+    if (esp_litemesh_tree_beacon(&temp, sa, now) && esp_litemesh_tree_info_build(broadcast_info)) {
+        esp_litemesh_info_update(broadcast_info);
+    }
+#endif
+    if (connected_ap) { /* update parent info */
+        wifi_ap_record_t ap_info;
+        bool is_parent = (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) && !memcmp(ap_info.bssid , sa, sizeof(ap_info.bssid));
+        if (is_parent) {
+            if (broadcast_info->router_ssid_len != 0) { /* No need to compare ssid without network configuration */
+                /* Compare ssid to distinguish different mesh networks */
+                if (!esp_litemesh_ie_ssid_match(&temp, broadcast_info->router_ssid, broadcast_info->router_ssid_len)) {
+                    esp_wifi_disconnect();
+                    return;
                 }
             }
         }
+
+        esp_litemesh_parent_candidate_update(&temp, sa, rssi, is_parent, now);
+        if (is_parent) {
+            esp_litemesh_parent_t parent;
+            bool update = esp_litemesh_info_inherit(&temp, broadcast_info);
+#if LITEMESH_ROUTED
+            bool route_update = false;
+
+            if (!esp_litemesh_route_parent_beacon(&temp, now, &route_update)) {
+                /* The lease is from a subnet the parent left, join again for one of the new subnet */
+                ESP_LOGI(TAG, "The parent moved its subnet, reconnect");
+                esp_wifi_disconnect();
+                return;
+            }
+            if (route_update) {
+                update |= esp_litemesh_route_info_build(broadcast_info);
+            }
+#endif
+#if LITEMESH_MULTI_ROOT
+            update |= esp_litemesh_tree_parent_beacon(&temp, broadcast_info);
+#endif
+#if LITEMESH_PATH_METRICS
+            update |= esp_litemesh_path_parent_beacon(&temp, broadcast_info);
+#endif
+
+            portENTER_CRITICAL(&litemesh_parent_lock);
+            if (esp_litemesh_parent_selector_get(parent_selector, sa, &parent) != ESP_OK) {
+                parent.rssi = rssi;
+            }
+            portEXIT_CRITICAL(&litemesh_parent_lock);
+            update |= esp_litemesh_uplink_quality_inherit(&temp, parent.rssi, broadcast_info);
+            if (update) {
+                esp_litemesh_info_update(broadcast_info);
+            }
+        }
+
+        esp_litemesh_parent_switch_check(now);
+    } else if (esp_litemesh_parent_candidate_update(&temp, sa, rssi, false, now)) {
+        /* should choose the best one */
+        esp_litemesh_parent_t best;
+
+        portENTER_CRITICAL(&litemesh_parent_lock);
+        esp_err_t ret = esp_litemesh_parent_selector_best(parent_selector, now, &best);
+        portEXIT_CRITICAL(&litemesh_parent_lock);
+        if ((ret == ESP_OK) && !memcmp(best.bssid, sa, sizeof(best.bssid))) {
+            if (esp_litemesh_info_inherit(&temp, broadcast_info)) {
+                esp_litemesh_network_segment_sync();
+            }
+        }
+    }
+}
+
+static void esp_gateway_vendor_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6], const vendor_ie_data_t *vnd_ie, int rssi)
+{
+    litemesh_beacon_event_t event;
+
+    if ((type != WIFI_VND_IE_TYPE_BEACON) || (vnd_ie->vendor_oui[0] != VENDOR_OUI_0)
+        || (vnd_ie->vendor_oui[1] != VENDOR_OUI_1) || (vnd_ie->vendor_oui[2] != VENDOR_OUI_2)) {
+        return;
+    }
+
+    memcpy(event.sa, sa, sizeof(event.sa));
+    event.rssi = rssi;
+    memcpy(event.ie, vnd_ie, 2 + vnd_ie->length);
+
+    /* A beacon dropped is heard again at the next beacon interval */
+    if (esp_event_post(LITEMESH_EVENT, LITEMESH_EVENT_BEACON, &event, offsetof(litemesh_beacon_event_t, ie) + 2 + vnd_ie->length, 0) != ESP_OK) {
+        ESP_LOGD(TAG, "Beacon of "MACSTR" dropped", MAC2STR(sa));
+    }
+}
+
+static void esp_litemesh_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    switch (event_id) {
+    case LITEMESH_EVENT_BEACON: {
+        litemesh_beacon_event_t* event = (litemesh_beacon_event_t*)event_data;
+        esp_litemesh_beacon_handle((const vendor_ie_data_t*)event->ie, event->sa, event->rssi);
+        break;
+    }
+
+    case LITEMESH_EVENT_IE_PUBLISH:
+        esp_litemesh_ie_publish();
+        break;
+
+#if LITEMESH_PATH_METRICS
+    case LITEMESH_EVENT_PATH_UPDATE:
+        if (esp_litemesh_path_info_build(broadcast_info)) {
+            esp_litemesh_info_update(broadcast_info);
+        }
+        break;
+#endif
+
+#if LITEMESH_ROUTED
+    case LITEMESH_EVENT_ROUTE_REFRESH:
+        esp_litemesh_route_info_refresh();
+        break;
+#endif
+
+#if LITEMESH_MULTI_ROOT
+    case LITEMESH_EVENT_TREE_REFRESH:
+        esp_litemesh_tree_info_refresh();
+        break;
+#endif
+
+    default:
+        break;
+    }
+}
+
+/* Set the station for a candidate, which the beacons of the other nodes do not replace in the table meanwhile */
+static void esp_litemesh_parent_config_set(const esp_litemesh_parent_t* parent, uint32_t now)
+{
+    wifi_config_t wifi_cfg;
+
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    esp_litemesh_parent_selector_set_parent(parent_selector, parent->bssid, now);
+    portEXIT_CRITICAL(&litemesh_parent_lock);
+
+    memset(&wifi_cfg, 0x0, sizeof(wifi_cfg));
+#if CONFIG_ESP_GATEWAY_SOFTAP_SSID_END_WITH_THE_MAC
+    snprintf((char*)wifi_cfg.sta.ssid, sizeof(wifi_cfg.sta.ssid), "%s_%02x%02x%02x", ESP_GATEWAY_SOFTAP_SSID, parent->bssid[3], parent->bssid[4], parent->bssid[5]);
+#else
+    snprintf((char*)wifi_cfg.sta.ssid, sizeof(wifi_cfg.sta.ssid), "%s\r\n", ESP_GATEWAY_SOFTAP_SSID);
+    memcpy(wifi_cfg.sta.bssid, parent->bssid, sizeof(wifi_cfg.sta.bssid));
+    wifi_cfg.sta.bssid_set = 1;
+#endif
+    strlcpy((char *)wifi_cfg.sta.password, ESP_GATEWAY_SOFTAP_PASSWORD, sizeof(wifi_cfg.sta.password));
+    wifi_cfg.sta.channel = parent->channel;
+    esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, &wifi_cfg);
+}
+
+static uint8_t esp_litemesh_channel_load(void)
+{
+    nvs_handle_t handle;
+    uint8_t channel = 0;
+
+    if (nvs_open(ESP_LITEMESH_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return 0;
+    }
+
+    if ((nvs_get_u8(handle, ESP_LITEMESH_NVS_KEY_CHANNEL, &channel) != ESP_OK) || (channel > LITEMESH_SCAN_MAX_CHANNEL)) {
+        channel = 0;
+    }
+    nvs_close(handle);
+
+    return channel;
+}
+
+/* Keep the channel of the association for the next scans, the flash is only written when it changes */
+static void esp_litemesh_channel_store(uint8_t channel)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = ESP_OK;
+
+    if ((channel == 0) || (channel > LITEMESH_SCAN_MAX_CHANNEL) || (channel == litemesh_scan_stats.stored_channel)) {
+        return;
+    }
+
+    ret = nvs_open(ESP_LITEMESH_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_u8(handle, ESP_LITEMESH_NVS_KEY_CHANNEL, channel);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Store channel %d fail, 0x%x", channel, ret);
+        return;
+    }
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    litemesh_scan_stats.stored_channel = channel;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+}
+
+/* A single channel scan when channel is not 0, a scan of all the channels otherwise */
+static esp_err_t esp_litemesh_scan_start(litemesh_scan_phase_t phase, uint8_t channel)
+{
+    wifi_scan_config_t scanconf;
+    esp_litemesh_scan_config_t config;
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    config = litemesh_scan_config;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+
+    memset(&scanconf, 0x0, sizeof(scanconf));
+    scanconf.channel = channel;
+    if (channel == 0) {
+        scanconf.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+        scanconf.scan_time.active.min = config.full_dwell_ms / 2;
+        scanconf.scan_time.active.max = config.full_dwell_ms;
+    } else if (config.passive) {
+        scanconf.scan_type = WIFI_SCAN_TYPE_PASSIVE;
+        scanconf.scan_time.passive = config.channel_dwell_ms;
+    } else {
+        scanconf.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+        scanconf.scan_time.active.min = config.channel_dwell_ms / 2;
+        scanconf.scan_time.active.max = config.channel_dwell_ms;
+    }
+
+    litemesh_scan_phase = phase;
+    litemesh_scan_start_ms = esp_litemesh_now();
+    ret = esp_wifi_scan_start(((channel == 0) && (config.full_dwell_ms == 0)) ? NULL : &scanconf, false);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    litemesh_scan_status = true;
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    if (phase == LITEMESH_SCAN_PINNED) {
+        litemesh_scan_stats.pinned_scans++;
+    } else if (channel == 0) {
+        litemesh_scan_stats.full_scans++;
+    } else {
+        litemesh_scan_stats.channel_scans++;
+    }
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_set_scan_config(const esp_litemesh_scan_config_t* config)
+{
+    if ((config == NULL) || (config->channel_dwell_ms == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    litemesh_scan_config = *config;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_get_scan_config(esp_litemesh_scan_config_t* config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    *config = litemesh_scan_config;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_get_scan_stats(esp_litemesh_scan_stats_t* stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (broadcast_info == NULL) {
+        return ESP_ERR_INVALID_STATE;
     }
-    return;
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    *stats = litemesh_scan_stats;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+
+    return ESP_OK;
 }
 
 /* Event handler for catching system events */
@@ -323,18 +1686,71 @@ static void esp_litemesh_event_sta_disconnected_handler(void *arg, esp_event_bas
                                                         int32_t event_id, void *event_data)
 {
     uint32_t max_num = sizeof(broadcast_info->self_net_segment)/sizeof(broadcast_info->self_net_segment[0]);
+    uint32_t now = esp_litemesh_now();
+    esp_litemesh_parent_t parent;
+#if LITEMESH_PARENT_FAILOVER
+    bool failover = false;
+#endif
+    if (connected_ap) {
+        litemesh_uplink_lost_ms = now;
+    }
     connected_ap = false;
 
+    /* The parent lost, or which refused the node, is forgotten until heard again */
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    if (esp_litemesh_parent_selector_get_parent(parent_selector, &parent) == ESP_OK) {
+        esp_litemesh_parent_selector_set_parent(parent_selector, NULL, now);
+        esp_litemesh_parent_selector_remove(parent_selector, parent.bssid);
+    }
+#if LITEMESH_PARENT_FAILOVER
+    /* The descendants of the node are below its level, the old parent is out of the table */
+    if (litemesh_failover_attempts < LITEMESH_PARENT_FAILOVER_MAX_ATTEMPTS) {
+        failover = (esp_litemesh_parent_selector_failover(parent_selector, now, broadcast_info->level,
+                                                          LITEMESH_PARENT_FAILOVER_MAX_AGE_MS, &parent) == ESP_OK);
+    }
+#endif
+    portEXIT_CRITICAL(&litemesh_parent_lock);
+    litemesh_link_quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;
+
     esp_gateway_get_external_netif_network_segment(broadcast_info->self_net_segment, &max_num);
     broadcast_info->self_net_segment_num = max_num;
 
+#if LITEMESH_ROUTED
+    /* The routes to the children stay, they are still below this node */
+    memset(broadcast_info->uplink_addr, 0, sizeof(broadcast_info->uplink_addr));
+    memset(broadcast_info->uplink_bssid, 0, sizeof(broadcast_info->uplink_bssid));
+    memset(litemesh_route_taken_map, 0, sizeof(litemesh_route_taken_map));
+    litemesh_route_conflict_since = 0;
+    litemesh_route_stale_since = 0;
+    esp_litemesh_route_info_build(broadcast_info);
+#endif
+#if LITEMESH_MULTI_ROOT
+    esp_litemesh_tree_leave();
+    esp_litemesh_tree_info_build(broadcast_info);
+#endif
+#if LITEMESH_PATH_METRICS
+    esp_litemesh_path_set_gateway(0, false);
+#endif
+
     if (!connected_eth) {
         esp_litemesh_set_connect_status(0);
+        broadcast_info->uplink_quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;
     }
     esp_litemesh_info_update(broadcast_info);
 
     esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, (wifi_config_t*)&router_config);
 
+#if LITEMESH_PARENT_FAILOVER
+    if (failover) {
+        litemesh_failover_attempts++;
+        ESP_LOGI(TAG, "Fail over to "MACSTR" level %d rssi %d", MAC2STR(parent.bssid), parent.level, parent.rssi);
+        esp_litemesh_parent_config_set(&parent, now);
+        esp_wifi_connect();
+        return;
+    }
+    litemesh_failover_attempts = 0;
+#endif
+
     esp_litemesh_connect();
 }
 
@@ -346,9 +1762,19 @@ static void esp_litemesh_event_scan_done_handler(void* arg, esp_event_base_t eve
     }
     litemesh_scan_status = false;
     ESP_LOGI(TAG, "LiteMesh Scan done\r\n");
+    esp_litemesh_parent_t best_ap_info;
+    uint32_t now = esp_litemesh_now();
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    bool best_valid = (esp_litemesh_parent_selector_best(parent_selector, now, &best_ap_info) == ESP_OK);
+    portEXIT_CRITICAL(&litemesh_parent_lock);
     uint16_t count = 0;
     static uint16_t ap_channel = 0;
-    static uint32_t scan_times = 0;
+#if LITEMESH_MULTI_ROOT
+    static int8_t ap_rssi = 0;
+#endif
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    litemesh_scan_stats.scan_time_ms += now - litemesh_scan_start_ms;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&count));
     wifi_ap_record_t *ap_list = (wifi_ap_record_t *)malloc(sizeof(wifi_ap_record_t) * count);
     if (ap_list) {
@@ -356,6 +1782,9 @@ static void esp_litemesh_event_scan_done_handler(void* arg, esp_event_base_t eve
         for (int i = 0; i < count; ++i) {
             if (!strncmp((char*)router_config.ssid, (const char *)ap_list[i].ssid, sizeof(router_config.ssid))) {
                 ap_channel = ap_list[i].primary;
+#if LITEMESH_MULTI_ROOT
+                ap_rssi = ap_list[i].rssi;
+#endif
                 ESP_LOGI(TAG, "============ Find %s ============", ESP_GATEWAY_SOFTAP_SSID);
                 break;
             }
@@ -363,58 +1792,54 @@ static void esp_litemesh_event_scan_done_handler(void* arg, esp_event_base_t eve
         free(ap_list);
     }
 
-    if (scan_times < SINGLE_CHANNEL_SCAN_TIMES) {
-        esp_wifi_disconnect();
-        if (best_ap_info.valid) {
-            wifi_scan_config_t scanconf = {
-                .channel = best_ap_info.channel,
-                .scan_type = WIFI_SCAN_TYPE_ACTIVE,
-                .scan_time.active.max = 1000,
-                .scan_time.active.min = 500,
-            };
-            ESP_ERROR_CHECK(esp_wifi_scan_start(&scanconf, false));
-            litemesh_scan_status = true;
+    if (litemesh_scan_phase == LITEMESH_SCAN_PINNED) {
+        /* A single channel scan already, the candidates heard on it are joined without a second pass */
+        if (best_valid || (ap_channel != 0)) {
+            portENTER_CRITICAL(&litemesh_scan_lock);
+            litemesh_scan_stats.pinned_hits++;
+            portEXIT_CRITICAL(&litemesh_scan_lock);
         } else {
-            ESP_ERROR_CHECK(esp_wifi_scan_start(NULL, false));
-            litemesh_scan_status = true;
+            ESP_LOGI(TAG, "Nothing on channel %d, scan all the channels", litemesh_scan_stats.stored_channel);
+            ESP_ERROR_CHECK(esp_litemesh_scan_start(LITEMESH_SCAN_FULL, 0));
+            return;
         }
-        scan_times++;
-    } else {
-        if (best_ap_info.valid) {
-            wifi_config_t wifi_cfg;
+    } else if (litemesh_scan_phase == LITEMESH_SCAN_FULL) {
+        esp_wifi_disconnect();
+        ESP_ERROR_CHECK(esp_litemesh_scan_start(LITEMESH_SCAN_CHANNEL, best_valid ? best_ap_info.channel : 0));
+        return;
+    }
 
-            memset(&wifi_cfg, 0x0, sizeof(wifi_cfg));
-#if CONFIG_ESP_GATEWAY_SOFTAP_SSID_END_WITH_THE_MAC
-            snprintf((char*)wifi_cfg.sta.ssid, sizeof(wifi_cfg.sta.ssid), "%s_%02x%02x%02x", ESP_GATEWAY_SOFTAP_SSID, best_ap_info.bssid[3], best_ap_info.bssid[4], best_ap_info.bssid[5]);
-#else
-            snprintf((char*)wifi_cfg.sta.ssid, sizeof(wifi_cfg.sta.ssid), "%s\r\n", ESP_GATEWAY_SOFTAP_SSID);
-            memcpy(wifi_cfg.sta.bssid, best_ap_info.bssid, sizeof(wifi_cfg.sta.bssid));
-            wifi_cfg.sta.bssid_set = 1;
-#endif
-            strlcpy((char *)wifi_cfg.sta.password, ESP_GATEWAY_SOFTAP_PASSWORD, sizeof(wifi_cfg.sta.password));
-            wifi_cfg.sta.channel = best_ap_info.channel;
-            best_ap_info.rssi = -127;
-            best_ap_info.level = LITEMESH_MAX_LEVEL;
-            esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, &wifi_cfg);
-        } else if (ap_channel != 0) {
-            router_config.channel = ap_channel;
-            esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, (wifi_config_t*)&router_config);
-        }
-        best_ap_info.valid = false;
-        best_ap_info.channel = 0;
-        scan_times = 0;
-        ap_channel = 0;
+#if LITEMESH_MULTI_ROOT
+    /* The loaded trees are left to the nodes which do not hear the router well */
+    if (best_valid && (ap_channel != 0) && (ap_rssi >= LITEMESH_ROOT_MIN_RSSI)
+        && (best_ap_info.root_load != ESP_LITEMESH_ROOT_LOAD_UNKNOWN) && (best_ap_info.root_load >= LITEMESH_ROOT_SPLIT_LOAD)) {
+        ESP_LOGI(TAG, "The root of "MACSTR" is %d%% loaded, join the router", MAC2STR(best_ap_info.bssid), best_ap_info.root_load);
+        best_valid = false;
+        portENTER_CRITICAL(&litemesh_tree_lock);
+        litemesh_tree_splits++;
+        portEXIT_CRITICAL(&litemesh_tree_lock);
+    }
+#endif
 
-        if (strlen((const char*)router_config.ssid) > sizeof(router_config.ssid)) {
-            broadcast_info->router_ssid_len = sizeof(router_config.ssid);
-        } else {
-            broadcast_info->router_ssid_len = strlen((const char*)router_config.ssid);
-        }
-        memcpy(broadcast_info->router_ssid, router_config.ssid, broadcast_info->router_ssid_len);
-        esp_litemesh_info_update(broadcast_info);
+    if (best_valid) {
+        /* The format read by the beacon trace replay of the host test */
+        ESP_LOGD(TAG, "join %" PRIu32 " " MACSTR, now, MAC2STR(best_ap_info.bssid));
+        esp_litemesh_parent_config_set(&best_ap_info, now);
+    } else if (ap_channel != 0) {
+        router_config.channel = ap_channel;
+        esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, (wifi_config_t*)&router_config);
+    }
+    ap_channel = 0;
 
-        esp_wifi_connect();
+    if (strlen((const char*)router_config.ssid) > sizeof(router_config.ssid)) {
+        broadcast_info->router_ssid_len = sizeof(router_config.ssid);
+    } else {
+        broadcast_info->router_ssid_len = strlen((const char*)router_config.ssid);
     }
+    memcpy(broadcast_info->router_ssid, router_config.ssid, broadcast_info->router_ssid_len);
+    esp_litemesh_info_update(broadcast_info);
+
+    esp_wifi_connect();
 }
 
 #if defined(CONFIG_GATEWAY_EXTERNAL_NETIF_ETHERNET)
@@ -424,10 +1849,13 @@ static void esp_litemesh_event_eth_got_ip_handler(void *arg, esp_event_base_t ev
     ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
     connected_eth = true;
 
-    eth_net_segment = esp_ip4_addr3_16(&event->ip_info.ip);
-    broadcast_info->router_net_segment[broadcast_info->router_number++] = eth_net_segment;
+    eth_net_segment_valid = esp_gateway_network_segment_from_addr(event->ip_info.ip, &eth_net_segment);
+    if (eth_net_segment_valid) {
+        broadcast_info->router_net_segment[broadcast_info->router_number++] = eth_net_segment;
+    }
 
     esp_litemesh_set_connect_status(1);
+    broadcast_info->uplink_quality = ESP_LITEMESH_UPLINK_QUALITY_MAX;
     esp_litemesh_info_update(broadcast_info);
 }
 
@@ -438,18 +1866,22 @@ static void esp_litemesh_event_eth_disconnected_handler(void *arg, esp_event_bas
         /* Remove ETH IP net segment */
         uint8_t i = 0;
         for (; i < broadcast_info->router_number; i++) {
-            if (broadcast_info->router_net_segment[i] == eth_net_segment) {
+            if (eth_net_segment_valid && (broadcast_info->router_net_segment[i] == eth_net_segment)) {
                 break;
             }
         }
 
-        for (; i < (broadcast_info->router_number - 1); i++) {
-            broadcast_info->router_net_segment[i] = broadcast_info->router_net_segment[i + 1];
+        if (i < broadcast_info->router_number) {
+            for (; i < (broadcast_info->router_number - 1); i++) {
+                broadcast_info->router_net_segment[i] = broadcast_info->router_net_segment[i + 1];
+            }
+            broadcast_info->router_number--;
         }
-        broadcast_info->router_number--;
+        eth_net_segment_valid = false;
 
         if (!connected_ap) {
             esp_litemesh_set_connect_status(0);
+            broadcast_info->uplink_quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;
         }
         esp_litemesh_info_update(broadcast_info);
         connected_eth = false;
@@ -461,18 +1893,83 @@ static void esp_litemesh_event_sta_got_ip_handler(void *arg, esp_event_base_t ev
                                                   int32_t event_id, void *event_data)
 {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+    wifi_ap_record_t ap_info;
+    esp_litemesh_parent_t parent;
+    bool ap_info_valid = (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK);
+    bool parent_valid = false;
 
     connected_ap = true;
+#if LITEMESH_PARENT_FAILOVER
+    litemesh_failover_attempts = 0;
+#endif
+
+    portENTER_CRITICAL(&litemesh_scan_lock);
+    if (!litemesh_joined) {
+        litemesh_scan_stats.connect_time_ms = esp_litemesh_now() - litemesh_start_ms;
+        litemesh_joined = true;
+    } else if (litemesh_uplink_lost_ms) {
+        litemesh_scan_stats.rejoin_time_ms = esp_litemesh_now() - litemesh_uplink_lost_ms;
+    }
+    litemesh_uplink_lost_ms = 0;
+    portEXIT_CRITICAL(&litemesh_scan_lock);
+    if (ap_info_valid) {
+        esp_litemesh_channel_store(ap_info.primary);
+    }
 
-    if (broadcast_info->level == WIFI_ROUTER_LEVEL_0) {
-        broadcast_info->router_net_segment[broadcast_info->router_number++] = esp_ip4_addr3_16(&event->ip_info.ip);
+    /* The uplink quality of a node below a parent follows the beacons of the parent */
+    portENTER_CRITICAL(&litemesh_parent_lock);
+    esp_litemesh_parent_selector_set_parent(parent_selector, ap_info_valid ? ap_info.bssid : NULL, esp_litemesh_now());
+    parent_valid = ap_info_valid && (esp_litemesh_parent_selector_get(parent_selector, ap_info.bssid, &parent) == ESP_OK);
+    portEXIT_CRITICAL(&litemesh_parent_lock);
+
+    /*
+     * The info inherited from the candidates heard while looking for a parent is left when the node joins
+     * the router after all, the level alone does not tell a root.
+     */
+    if (!parent_valid) {
+        broadcast_info->router_number = 0;
+#if defined(CONFIG_GATEWAY_EXTERNAL_NETIF_ETHERNET)
+        if (connected_eth && eth_net_segment_valid) {
+            broadcast_info->router_net_segment[broadcast_info->router_number++] = eth_net_segment;
+        }
+#endif
+        /* A router out of the address pool takes no segment from the mesh */
+        if (esp_gateway_network_segment_from_addr(event->ip_info.ip, &broadcast_info->router_net_segment[broadcast_info->router_number])) {
+            broadcast_info->router_number++;
+        }
+        broadcast_info->inherited_netif_number = 0;
         broadcast_info->level = WIFI_ROUTER_LEVEL_1;
+        if (ap_info_valid && !connected_eth) {
+            broadcast_info->uplink_quality = esp_litemesh_link_quality(ap_info.rssi, ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN);
+        }
     } else {
         uint32_t max_num = sizeof(broadcast_info->self_net_segment)/sizeof(broadcast_info->self_net_segment[0]);
         esp_gateway_get_external_netif_network_segment(broadcast_info->self_net_segment, &max_num);
         broadcast_info->self_net_segment_num = max_num;
-        esp_litemesh_set_level(esp_litemesh_get_level() + 1);
+        esp_litemesh_set_level(parent.level + 1);
+    }
+
+#if LITEMESH_ROUTED
+    if (esp_gateway_network_segment_from_addr(event->ip_info.ip, &broadcast_info->uplink_addr[0])) {
+        broadcast_info->uplink_addr[1] = esp_ip4_addr4_16(&event->ip_info.ip);
+    } else {
+        memset(broadcast_info->uplink_addr, 0, sizeof(broadcast_info->uplink_addr));
     }
+    if (ap_info_valid) {
+        memcpy(broadcast_info->uplink_bssid, ap_info.bssid + 3, sizeof(broadcast_info->uplink_bssid));
+    }
+    litemesh_route_root = !parent_valid;
+    esp_litemesh_route_self_update();
+    esp_litemesh_route_info_build(broadcast_info);
+#endif
+#if LITEMESH_MULTI_ROOT
+    esp_litemesh_tree_self_update(ap_info_valid ? &ap_info : NULL, !parent_valid);
+    esp_litemesh_tree_info_build(broadcast_info);
+#endif
+#if LITEMESH_PATH_METRICS
+    /* The gateway of a node below a parent is the SoftAP of the parent */
+    esp_litemesh_path_set_gateway(event->ip_info.gw.addr, !parent_valid);
+#endif
 
     esp_litemesh_set_connect_status(1);
 
@@ -483,12 +1980,23 @@ static void esp_litemesh_event_ap_staconnected_handler(void *arg, esp_event_base
                                                        int32_t event_id, void *event_data)
 {
     esp_litemesh_set_connected_station_number(broadcast_info->connected_station_number + 1);
+#if LITEMESH_ROUTED
+    esp_litemesh_route_self_update();
+    esp_litemesh_route_info_build(broadcast_info);
+#endif
     esp_litemesh_info_update(broadcast_info);
 }
 
 static void esp_litemesh_event_ap_stadisconnected_handler(void *arg, esp_event_base_t event_base,
                                                           int32_t event_id, void *event_data)
 {
+#if LITEMESH_BCAST_FILTER
+    wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*)event_data;
+
+    portENTER_CRITICAL(&litemesh_bcast_lock);
+    esp_litemesh_bcast_filter_forget(litemesh_bcast_filter, event->mac);
+    portEXIT_CRITICAL(&litemesh_bcast_lock);
+#endif
     esp_litemesh_set_connected_station_number(broadcast_info->connected_station_number - 1);
     esp_litemesh_info_update(broadcast_info);
 }
@@ -498,20 +2006,65 @@ void esp_litemesh_connect(void)
     if (connected_ap) {
         esp_wifi_disconnect();
     } else {
-        esp_wifi_scan_start(NULL, false);
-        litemesh_scan_status = true;
+        uint8_t channel = litemesh_scan_config.channel_pin ? litemesh_scan_stats.stored_channel : 0;
+
+        esp_litemesh_scan_start(channel ? LITEMESH_SCAN_PINNED : LITEMESH_SCAN_FULL, channel);
     }
 }
 
 esp_err_t esp_litemesh_init(void)
 {
-    best_ap_info.rssi = -127;
-    best_ap_info.level = LITEMESH_MAX_LEVEL;
+    esp_litemesh_parent_selector_config_t parent_config = {
+        .rssi_smoothing = LITEMESH_PARENT_RSSI_SMOOTHING,
+        .hysteresis = LITEMESH_PARENT_SWITCH_HYSTERESIS,
+        .min_dwell_ms = LITEMESH_PARENT_MIN_DWELL_MS,
+        .max_age_ms = LITEMESH_PARENT_MAX_AGE_MS,
+    };
+    parent_selector = esp_litemesh_parent_selector_create(&parent_config);
+    if (parent_selector == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    litemesh_start_ms = esp_litemesh_now();
+    litemesh_scan_stats.stored_channel = esp_litemesh_channel_load();
+
+#if LITEMESH_ROUTED
+    litemesh_route_table = esp_litemesh_route_table_create(LITEMESH_ROUTE_MAX_NEXT_HOPS, LITEMESH_ROUTE_MAX_AGE_MS);
+    if (litemesh_route_table == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+#if LITEMESH_BCAST_FILTER
+    esp_litemesh_bcast_filter_config_t bcast_config = {
+        .proxy_arp_size = LITEMESH_PROXY_ARP_SIZE,
+        .proxy_arp_max_age_ms = LITEMESH_PROXY_ARP_MAX_AGE_MS,
+        .dup_window_ms = LITEMESH_BCAST_DUP_WINDOW_MS,
+        .rate_limit = LITEMESH_BCAST_RATE_LIMIT,
+        .basic_rate_kbps = LITEMESH_BCAST_BASIC_RATE_KBPS,
+    };
+    litemesh_bcast_filter = esp_litemesh_bcast_filter_create(&bcast_config);
+    if (litemesh_bcast_filter == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+#if LITEMESH_PATH_METRICS
+    esp_litemesh_path_config_t path_config = {
+        .small_len = LITEMESH_PATH_PROBE_SMALL_LEN,
+        .large_len = LITEMESH_PATH_PROBE_LARGE_LEN,
+        .window = LITEMESH_PATH_WINDOW,
+    };
+    litemesh_path_estimator = esp_litemesh_path_estimator_create(&path_config);
+    if (litemesh_path_estimator == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
 
-    esp_gateway_vendor_ie = malloc(sizeof(vendor_ie_data_t) + (VENDOR_IE_DATA_LENGTH * sizeof(uint8_t)));
+    esp_gateway_vendor_ie = malloc(LITEMESH_IE_BUFFER_LEN);
+    litemesh_pending_ie = malloc(LITEMESH_IE_BUFFER_LEN);
     broadcast_info = (esp_gateway_litemesh_info_t*)malloc(sizeof(esp_gateway_litemesh_info_t));
     memset(broadcast_info, 0, sizeof(*broadcast_info));
-    broadcast_info->version = LITEMESH_VERSION;
+    broadcast_info->version = ESP_LITEMESH_IE_VERSION_1;
+    broadcast_info->compact = LITEMESH_IE_COMPACT;
     broadcast_info->max_connection = LITEMESH_MAX_CONNECT_NUMBER;
     if (strlen((const char*)router_config.ssid) > sizeof(router_config.ssid)) {
         broadcast_info->router_ssid_len = sizeof(router_config.ssid);
@@ -523,12 +2076,44 @@ esp_err_t esp_litemesh_init(void)
 
     memset(esp_gateway_vendor_ie, 0, sizeof(*esp_gateway_vendor_ie));
     esp_gateway_vendor_ie->element_id = WIFI_VENDOR_IE_ELEMENT_ID;
-    esp_gateway_vendor_ie->length = VENDOR_IE_DATA_LENGTH;
     esp_gateway_vendor_ie->vendor_oui[0] = VENDOR_OUI_0;
     esp_gateway_vendor_ie->vendor_oui[1] = VENDOR_OUI_1;
     esp_gateway_vendor_ie->vendor_oui[2] = VENDOR_OUI_2;
+    ESP_ERROR_CHECK(esp_litemesh_ie_encode(broadcast_info, esp_gateway_vendor_ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(LITEMESH_EVENT, ESP_EVENT_ANY_ID, &esp_litemesh_event_handler, NULL, NULL));
+
+#if LITEMESH_IE_UPDATE_COALESCE_MS
+    esp_timer_create_args_t ie_timer_args = {
+        .callback = &esp_litemesh_ie_timer_cb,
+        .name = "litemesh_ie",
+    };
+    if (esp_timer_create(&ie_timer_args, &litemesh_ie_timer) != ESP_OK) {
+        ESP_LOGW(TAG, "IE timer create fail, the IE will be updated without coalescing");
+    }
+#endif
+#if LITEMESH_PATH_METRICS
+    esp_timer_create_args_t path_timer_args = {
+        .callback = &esp_litemesh_path_timer_cb,
+        .name = "litemesh_path",
+    };
+    if ((esp_timer_create(&path_timer_args, &litemesh_path_timer) != ESP_OK)
+        || (esp_timer_start_periodic(litemesh_path_timer, LITEMESH_PATH_PROBE_INTERVAL_MS * 1000) != ESP_OK)) {
+        ESP_LOGW(TAG, "Path timer start fail, the path will not be advertised");
+    }
+#endif
 
     ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+
+    /* Before the beacons and the events, which update the info in the event loop task from now on */
+#if LITEMESH_ROUTED
+    esp_litemesh_route_self_update();
+    esp_litemesh_route_info_build(broadcast_info);
+#endif
+#if LITEMESH_MULTI_ROOT
+    esp_litemesh_tree_self_update(NULL, false);
+#endif
+    esp_litemesh_info_update(broadcast_info);
+
     ESP_ERROR_CHECK(esp_wifi_set_vendor_ie_cb((esp_vendor_ie_cb_t)esp_gateway_vendor_ie_cb, NULL));
 
     /* Register our event handler for Wi-Fi, IP and Provisioning related events */
@@ -554,11 +2139,14 @@ esp_err_t esp_litemesh_init(void)
     if (strlen((const char*)router_config.ssid)) {
         ESP_LOGI(TAG, "Found ssid %s",     (const char*) router_config.ssid);
         ESP_LOGI(TAG, "Found password %s", (const char*) router_config.password);
+        /* The driver scans the channel of the configuration first */
+        if (litemesh_scan_config.channel_pin && (router_config.channel == 0) && litemesh_scan_stats.stored_channel) {
+            router_config.channel = litemesh_scan_stats.stored_channel;
+            esp_gateway_wifi_set_config_into_ram(ESP_IF_WIFI_STA, (wifi_config_t*)&router_config);
+        }
         esp_wifi_connect();
     }
 #endif /* CONFIG_JOIN_MESH_WITHOUT_CONFIGURED_WIFI_INFO */
 
-    esp_litemesh_info_update(broadcast_info);
-
     return ESP_OK;
 }
@@ -0,0 +1,82 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "netif/ethernet.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_litemesh.h"
+
+/*
+ * The frames of the stations of the SoftAP reach the stack through tcpip_input(), which hands them to
+ * ethernet_input() in the TCP/IP task, so ethernet_input() is wrapped at link time. A broadcast ARP request
+ * for a station the node knows is answered here and dropped, the repeated broadcast and multicast frames are
+ * dropped before the stack answers or forwards them. The frames of the other netifs are not looked at.
+ */
+
+static struct netif* s_softap_netif = NULL;
+
+err_t __real_ethernet_input(struct pbuf* p, struct netif* netif);
+
+static bool litemesh_bcast_netif_is_softap(struct netif* netif)
+{
+    esp_netif_t* esp_netif = NULL;
+
+    if (s_softap_netif == NULL) {
+        esp_netif = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+        if (esp_netif) {
+            s_softap_netif = esp_netif_get_netif_impl(esp_netif);
+        }
+    }
+
+    return (s_softap_netif != NULL) && (netif == s_softap_netif);
+}
+
+err_t __wrap_ethernet_input(struct pbuf* p, struct netif* netif)
+{
+    uint8_t reply[ESP_LITEMESH_BCAST_FILTER_REPLY_LEN];
+    esp_litemesh_bcast_action_t action = ESP_LITEMESH_BCAST_PASS;
+    struct pbuf* q = NULL;
+
+    if ((p == NULL) || !litemesh_bcast_netif_is_softap(netif)) {
+        return __real_ethernet_input(p, netif);
+    }
+
+    action = esp_litemesh_bcast_input((const uint8_t*)p->payload, p->len, netif->hwaddr, reply);
+    if (action == ESP_LITEMESH_BCAST_PASS) {
+        return __real_ethernet_input(p, netif);
+    }
+
+    if (action == ESP_LITEMESH_BCAST_REPLY) {
+        /* Without the reply, the request goes on as if it was not answered */
+        q = pbuf_alloc(PBUF_RAW, sizeof(reply), PBUF_RAM);
+        if (q == NULL) {
+            return __real_ethernet_input(p, netif);
+        }
+        memcpy(q->payload, reply, sizeof(reply));
+        netif->linkoutput(netif, q);
+        pbuf_free(q);
+    }
+
+    pbuf_free(p);
+    return ERR_OK;
+}
@@ -0,0 +1,368 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_litemesh_bcast_filter.h"
+
+#define BCAST_ETH_HDR_LEN           (14)
+#define BCAST_ETH_TYPE_IP           (0x0800)
+#define BCAST_ETH_TYPE_ARP          (0x0806)
+#define BCAST_ARP_LEN               (28)
+#define BCAST_ARP_OP_REQUEST        (1)
+#define BCAST_ARP_OP_REPLY          (2)
+#define BCAST_IP_PROTO_UDP          (17)
+#define BCAST_DHCP_SERVER_PORT      (67)
+#define BCAST_DHCP_CLIENT_PORT      (68)
+#define BCAST_DUP_SLOTS             (16)
+#define BCAST_TOKEN                 (1000)  /* A frame, in thousandths so that a millisecond adds rate_limit */
+/* The 802.11 frame replaces the Ethernet header with the MAC header, the LLC/SNAP header and the FCS */
+#define BCAST_WLAN_OVERHEAD_LEN     (24 + 8 + 4 - BCAST_ETH_HDR_LEN)
+/* Long DSSS preamble and DIFS below 6 Mbps, OFDM preamble and DIFS above */
+#define BCAST_DSSS_OVERHEAD_US      (192 + 50)
+#define BCAST_OFDM_OVERHEAD_US      (20 + 34)
+
+typedef struct {
+    bool used;
+    uint32_t ip;
+    uint8_t mac[6];
+    uint32_t updated;
+} bcast_neighbour_t;
+
+typedef struct {
+    bool used;
+    uint32_t hash;
+    uint32_t seen;
+} bcast_dup_t;
+
+struct esp_litemesh_bcast_filter {
+    esp_litemesh_bcast_filter_config_t config;
+    bcast_neighbour_t* neighbours;
+    bcast_dup_t dups[BCAST_DUP_SLOTS];
+    uint32_t dup_next;                  /* Slot replaced by the next frame */
+    uint32_t tokens;
+    uint32_t refilled;
+    esp_litemesh_bcast_filter_stats_t stats;
+};
+
+static inline uint16_t bcast_get16(const uint8_t* data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline void bcast_put16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)value;
+}
+
+/* FNV-1a */
+static uint32_t bcast_hash(const uint8_t* data, uint32_t len)
+{
+    uint32_t hash = 2166136261UL;
+
+    for (uint32_t loop = 0; loop < len; loop++) {
+        hash = (hash ^ data[loop]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+static uint32_t bcast_airtime_us(const esp_litemesh_bcast_filter_t* filter, uint32_t len)
+{
+    uint32_t rate = filter->config.basic_rate_kbps;
+    uint32_t overhead = (rate < 6000) ? BCAST_DSSS_OVERHEAD_US : BCAST_OFDM_OVERHEAD_US;
+
+    return overhead + (uint32_t)(((uint64_t)(len + BCAST_WLAN_OVERHEAD_LEN) * 8 * 1000) / rate);
+}
+
+static void bcast_suppressed(esp_litemesh_bcast_filter_t* filter, uint32_t len)
+{
+    filter->stats.suppressed_bytes += len;
+    filter->stats.airtime_saved_us += bcast_airtime_us(filter, len);
+}
+
+static bcast_neighbour_t* bcast_neighbour_find(esp_litemesh_bcast_filter_t* filter, uint32_t ip)
+{
+    for (uint32_t loop = 0; loop < filter->config.proxy_arp_size; loop++) {
+        if (filter->neighbours[loop].used && (filter->neighbours[loop].ip == ip)) {
+            return &filter->neighbours[loop];
+        }
+    }
+
+    return NULL;
+}
+
+/* ARP and DHCP get a station its address and its neighbours, they are never dropped */
+static bool bcast_frame_exempt(const uint8_t* frame, uint32_t len)
+{
+    uint16_t type = bcast_get16(frame + 12);
+    const uint8_t* ip = frame + BCAST_ETH_HDR_LEN;
+    uint32_t ip_hdr_len = 0;
+    uint16_t port = 0;
+
+    if (type == BCAST_ETH_TYPE_ARP) {
+        return true;
+    }
+
+    if ((type != BCAST_ETH_TYPE_IP) || (len < BCAST_ETH_HDR_LEN + 20) || (ip[9] != BCAST_IP_PROTO_UDP)) {
+        return false;
+    }
+
+    ip_hdr_len = (ip[0] & 0x0F) * 4;
+    if (len < BCAST_ETH_HDR_LEN + ip_hdr_len + 4) {
+        return false;
+    }
+
+    port = bcast_get16(ip + ip_hdr_len + 2);
+    return (port == BCAST_DHCP_SERVER_PORT) || (port == BCAST_DHCP_CLIENT_PORT);
+}
+
+/* Learn the sender of an ARP frame and answer a broadcast request for a known neighbour */
+static esp_litemesh_bcast_action_t bcast_arp_input(esp_litemesh_bcast_filter_t* filter, const uint8_t* frame, uint32_t len,
+                                                   const uint8_t self_mac[6], uint32_t now, uint8_t* reply)
+{
+    const uint8_t* arp = frame + BCAST_ETH_HDR_LEN;
+    uint8_t target_mac[6];
+    uint32_t sender_ip = 0;
+    uint32_t target_ip = 0;
+    uint16_t op = 0;
+
+    if ((len < BCAST_ETH_HDR_LEN + BCAST_ARP_LEN) || (bcast_get16(arp) != 1) || (bcast_get16(arp + 2) != BCAST_ETH_TYPE_IP)
+        || (arp[4] != 6) || (arp[5] != 4)) {
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    op = bcast_get16(arp + 6);
+    memcpy(&sender_ip, arp + 14, sizeof(sender_ip));
+    memcpy(&target_ip, arp + 24, sizeof(target_ip));
+
+    /* A probe has no sender address yet, an announcement asks for its own */
+    if ((sender_ip == 0) || (sender_ip == target_ip)) {
+        if (sender_ip) {
+            esp_litemesh_bcast_filter_learn(filter, sender_ip, arp + 8, now);
+        }
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    esp_litemesh_bcast_filter_learn(filter, sender_ip, arp + 8, now);
+    if ((op != BCAST_ARP_OP_REQUEST) || !(frame[0] & 0x01)) {
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    filter->stats.arp_requests++;
+    if (!esp_litemesh_bcast_filter_lookup(filter, target_ip, target_mac, now) || !memcmp(target_mac, arp + 8, sizeof(target_mac))) {
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    memcpy(reply, arp + 8, 6);
+    memcpy(reply + 6, self_mac, 6);
+    bcast_put16(reply + 12, BCAST_ETH_TYPE_ARP);
+    memcpy(reply + BCAST_ETH_HDR_LEN, arp, 6);
+    bcast_put16(reply + BCAST_ETH_HDR_LEN + 6, BCAST_ARP_OP_REPLY);
+    memcpy(reply + BCAST_ETH_HDR_LEN + 8, target_mac, 6);
+    memcpy(reply + BCAST_ETH_HDR_LEN + 14, &target_ip, 4);
+    memcpy(reply + BCAST_ETH_HDR_LEN + 18, arp + 8, 6);
+    memcpy(reply + BCAST_ETH_HDR_LEN + 24, &sender_ip, 4);
+
+    filter->stats.arp_answered++;
+    bcast_suppressed(filter, len);
+    return ESP_LITEMESH_BCAST_REPLY;
+}
+
+/* The same frame from the same source within the window, only the first one is kept */
+static bool bcast_frame_repeated(esp_litemesh_bcast_filter_t* filter, const uint8_t* frame, uint32_t len, uint32_t now)
+{
+    uint32_t hash = bcast_hash(frame, len);
+
+    for (uint32_t loop = 0; loop < BCAST_DUP_SLOTS; loop++) {
+        bcast_dup_t* dup = &filter->dups[loop];
+        if (dup->used && (dup->hash == hash) && ((uint32_t)(now - dup->seen) < filter->config.dup_window_ms)) {
+            return true;
+        }
+    }
+
+    filter->dups[filter->dup_next].used = true;
+    filter->dups[filter->dup_next].hash = hash;
+    filter->dups[filter->dup_next].seen = now;
+    filter->dup_next = (filter->dup_next + 1) % BCAST_DUP_SLOTS;
+    return false;
+}
+
+/* Token bucket holding one second of frames */
+static bool bcast_rate_exceeded(esp_litemesh_bcast_filter_t* filter, uint32_t now)
+{
+    uint32_t burst = filter->config.rate_limit * BCAST_TOKEN;
+    uint32_t elapsed = now - filter->refilled;
+
+    if (elapsed >= 1000) {
+        filter->tokens = burst;
+    } else {
+        filter->tokens += elapsed * filter->config.rate_limit;
+        if (filter->tokens > burst) {
+            filter->tokens = burst;
+        }
+    }
+    filter->refilled = now;
+
+    if (filter->tokens < BCAST_TOKEN) {
+        return true;
+    }
+
+    filter->tokens -= BCAST_TOKEN;
+    return false;
+}
+
+esp_litemesh_bcast_filter_t* esp_litemesh_bcast_filter_create(const esp_litemesh_bcast_filter_config_t* config)
+{
+    esp_litemesh_bcast_filter_t* filter = NULL;
+
+    if ((config == NULL) || (config->basic_rate_kbps == 0) || (config->rate_limit > 1000000)
+        || (config->proxy_arp_size && (config->proxy_arp_max_age_ms == 0))) {
+        return NULL;
+    }
+
+    filter = calloc(1, sizeof(esp_litemesh_bcast_filter_t));
+    if (filter == NULL) {
+        return NULL;
+    }
+
+    if (config->proxy_arp_size) {
+        filter->neighbours = calloc(config->proxy_arp_size, sizeof(bcast_neighbour_t));
+        if (filter->neighbours == NULL) {
+            free(filter);
+            return NULL;
+        }
+    }
+
+    filter->config = *config;
+    filter->tokens = config->rate_limit * BCAST_TOKEN;
+    return filter;
+}
+
+void esp_litemesh_bcast_filter_delete(esp_litemesh_bcast_filter_t* filter)
+{
+    if (filter) {
+        free(filter->neighbours);
+        free(filter);
+    }
+}
+
+void esp_litemesh_bcast_filter_learn(esp_litemesh_bcast_filter_t* filter, uint32_t ip, const uint8_t mac[6], uint32_t now)
+{
+    bcast_neighbour_t* neighbour = NULL;
+
+    if ((filter == NULL) || (mac == NULL) || (ip == 0) || (filter->config.proxy_arp_size == 0)) {
+        return;
+    }
+
+    neighbour = bcast_neighbour_find(filter, ip);
+    if (neighbour == NULL) {
+        neighbour = &filter->neighbours[0];
+        for (uint32_t loop = 0; loop < filter->config.proxy_arp_size; loop++) {
+            if (!filter->neighbours[loop].used) {
+                neighbour = &filter->neighbours[loop];
+                break;
+            }
+            if ((uint32_t)(now - filter->neighbours[loop].updated) > (uint32_t)(now - neighbour->updated)) {
+                neighbour = &filter->neighbours[loop];
+            }
+        }
+        if (!neighbour->used) {
+            neighbour->used = true;
+            filter->stats.neighbours++;
+        }
+        neighbour->ip = ip;
+    }
+
+    memcpy(neighbour->mac, mac, sizeof(neighbour->mac));
+    neighbour->updated = now;
+}
+
+bool esp_litemesh_bcast_filter_forget(esp_litemesh_bcast_filter_t* filter, const uint8_t mac[6])
+{
+    bool found = false;
+
+    if ((filter == NULL) || (mac == NULL)) {
+        return false;
+    }
+
+    for (uint32_t loop = 0; loop < filter->config.proxy_arp_size; loop++) {
+        if (filter->neighbours[loop].used && !memcmp(filter->neighbours[loop].mac, mac, sizeof(filter->neighbours[loop].mac))) {
+            filter->neighbours[loop].used = false;
+            filter->stats.neighbours--;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+bool esp_litemesh_bcast_filter_lookup(esp_litemesh_bcast_filter_t* filter, uint32_t ip, uint8_t mac[6], uint32_t now)
+{
+    bcast_neighbour_t* neighbour = NULL;
+
+    if ((filter == NULL) || (mac == NULL)) {
+        return false;
+    }
+
+    neighbour = bcast_neighbour_find(filter, ip);
+    if ((neighbour == NULL) || ((uint32_t)(now - neighbour->updated) > filter->config.proxy_arp_max_age_ms)) {
+        return false;
+    }
+
+    memcpy(mac, neighbour->mac, sizeof(neighbour->mac));
+    return true;
+}
+
+esp_litemesh_bcast_action_t esp_litemesh_bcast_filter_input(esp_litemesh_bcast_filter_t* filter, const uint8_t* frame, uint32_t len,
+                                                            const uint8_t self_mac[6], uint32_t now, uint8_t* reply)
+{
+    if ((filter == NULL) || (frame == NULL) || (len < BCAST_ETH_HDR_LEN)) {
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    if (bcast_get16(frame + 12) == BCAST_ETH_TYPE_ARP) {
+        if ((self_mac == NULL) || (reply == NULL)) {
+            return ESP_LITEMESH_BCAST_PASS;
+        }
+        return bcast_arp_input(filter, frame, len, self_mac, now, reply);
+    }
+
+    if (!(frame[0] & 0x01) || bcast_frame_exempt(frame, len)) {
+        return ESP_LITEMESH_BCAST_PASS;
+    }
+
+    if (filter->config.dup_window_ms && bcast_frame_repeated(filter, frame, len, now)) {
+        filter->stats.duplicates++;
+        bcast_suppressed(filter, len);
+        return ESP_LITEMESH_BCAST_DROP;
+    }
+
+    if (filter->config.rate_limit && bcast_rate_exceeded(filter, now)) {
+        filter->stats.rate_limited++;
+        bcast_suppressed(filter, len);
+        return ESP_LITEMESH_BCAST_DROP;
+    }
+
+    return ESP_LITEMESH_BCAST_PASS;
+}
+
+void esp_litemesh_bcast_filter_get_stats(esp_litemesh_bcast_filter_t* filter, esp_litemesh_bcast_filter_stats_t* stats)
+{
+    if (filter && stats) {
+        *stats = filter->stats;
+    }
+}
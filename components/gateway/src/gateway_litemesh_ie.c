@@ -0,0 +1,363 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_gateway_litemesh_ie.h"
+
+#define IE_VERSION                      (0)
+#define IE_CONNECT_NUMBER_INFORMATION   (1)     /* 4bit(Max connect number) + 4bit(Connected station number) */
+#define IE_NODE_INFORMATION             (2)     /* 1bit(Connect router status) + 1bit(Compact) + 2bit(Reserved) + 4bit(Level) */
+#define IE_HEADER_LEN                   (3)
+
+/* Version 1 */
+#define IE_V1_ROUTER_SSID_LEN           (3)
+#define IE_V1_TRACE_ROUTER_NUMBER       (4)     /* 4bit(Router segment number) + 4bit(Inherited segment number) */
+#define IE_V1_ROUTER_SSID               (5)
+
+/* Version 2 */
+#define IE_V2_TLV_HEADER_LEN            (2)
+#define IE_V2_ROUTER_SSID_LEN           (5)
+#define IE_V2_UPLINK_QUALITY_LEN        (1)
+#define IE_V2_UPLINK_QUALITY_MAX        (100)
+#define IE_V2_ROUTE_UPLINK_LEN          (5)     /* Station address and parent BSSID bytes */
+#define IE_V2_TREE_LEN                  (8)     /* Root, root load, subtree nodes and parent BSSID bytes */
+#define IE_V2_PATH_LEN                  (4)
+
+#define FNV_OFFSET_BASIS                (2166136261UL)
+#define FNV_PRIME                       (16777619UL)
+
+uint32_t esp_litemesh_ie_ssid_digest(const uint8_t* ssid, uint8_t len)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    for (uint8_t loop = 0; loop < len; loop++) {
+        hash ^= ssid[loop];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static void esp_litemesh_ie_encode_header(const esp_gateway_litemesh_info_t* info, uint8_t* payload)
+{
+    payload[IE_VERSION] = info->version;
+    payload[IE_CONNECT_NUMBER_INFORMATION] = (info->max_connection << 4) | info->connected_station_number;
+    payload[IE_NODE_INFORMATION] = (info->connect_router_status << 7) | (info->compact << 6) | info->level;
+}
+
+static uint32_t esp_litemesh_ie_encode_v1(const esp_gateway_litemesh_info_t* info, uint8_t* payload, uint32_t max_payload_len)
+{
+    uint32_t offset = IE_V1_ROUTER_SSID;
+    uint8_t inherited_num = info->inherited_netif_number;
+    uint8_t self_num = info->self_net_segment_num;
+
+    /* Both lists share a 4 bit number */
+    if (inherited_num + self_num > 0x0F) {
+        self_num = 0x0F - inherited_num;
+    }
+
+    if (IE_V1_ROUTER_SSID + info->router_ssid_len + info->router_number + inherited_num + self_num > max_payload_len) {
+        return 0;
+    }
+
+    esp_litemesh_ie_encode_header(info, payload);
+    payload[IE_V1_ROUTER_SSID_LEN] = info->router_ssid_len;
+    payload[IE_V1_TRACE_ROUTER_NUMBER] = (info->router_number << 4) | (inherited_num + self_num);
+
+    memcpy(payload + offset, info->router_ssid, info->router_ssid_len);
+    offset += info->router_ssid_len;
+    memcpy(payload + offset, info->router_net_segment, info->router_number);
+    offset += info->router_number;
+    memcpy(payload + offset, info->inherited_net_segment, inherited_num);
+    offset += inherited_num;
+    memcpy(payload + offset, info->self_net_segment, self_num);
+    offset += self_num;
+
+    return offset;
+}
+
+static uint32_t esp_litemesh_ie_encode_v2(const esp_gateway_litemesh_info_t* info, uint8_t* payload, uint32_t max_payload_len)
+{
+    uint32_t offset = IE_HEADER_LEN;
+    uint32_t len = IE_HEADER_LEN;
+    uint8_t inherited_num = info->inherited_netif_number + info->self_net_segment_num;
+
+    len += info->router_ssid_len ? (IE_V2_TLV_HEADER_LEN + IE_V2_ROUTER_SSID_LEN) : 0;
+    len += info->router_number ? (IE_V2_TLV_HEADER_LEN + info->router_number) : 0;
+    len += inherited_num ? (IE_V2_TLV_HEADER_LEN + inherited_num) : 0;
+    len += info->uplink_quality ? (IE_V2_TLV_HEADER_LEN + IE_V2_UPLINK_QUALITY_LEN) : 0;
+    len += info->route_num ? (IE_V2_TLV_HEADER_LEN + IE_V2_ROUTE_UPLINK_LEN + info->route_num * sizeof(esp_litemesh_ie_route_t)) : 0;
+    len += info->tree_nodes ? (IE_V2_TLV_HEADER_LEN + IE_V2_TREE_LEN + info->tree_segment_num) : 0;
+    len += info->path_rate ? (IE_V2_TLV_HEADER_LEN + IE_V2_PATH_LEN) : 0;
+    if ((info->route_num > ESP_LITEMESH_MAX_ROUTE_NUMBER) || (info->tree_segment_num > ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER)
+        || (len > max_payload_len)) {
+        return 0;
+    }
+
+    esp_litemesh_ie_encode_header(info, payload);
+
+    if (info->router_ssid_len) {
+        uint32_t digest = esp_litemesh_ie_ssid_digest(info->router_ssid, info->router_ssid_len);
+
+        payload[offset++] = ESP_LITEMESH_IE_TLV_ROUTER_SSID;
+        payload[offset++] = IE_V2_ROUTER_SSID_LEN;
+        payload[offset++] = info->router_ssid_len;
+        payload[offset++] = digest >> 24;
+        payload[offset++] = (digest >> 16) & 0xFF;
+        payload[offset++] = (digest >> 8) & 0xFF;
+        payload[offset++] = digest & 0xFF;
+    }
+
+    if (info->router_number) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_ROUTER_SEGMENT;
+        payload[offset++] = info->router_number;
+        memcpy(payload + offset, info->router_net_segment, info->router_number);
+        offset += info->router_number;
+    }
+
+    if (inherited_num) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_INHERITED_SEGMENT;
+        payload[offset++] = inherited_num;
+        memcpy(payload + offset, info->inherited_net_segment, info->inherited_netif_number);
+        offset += info->inherited_netif_number;
+        memcpy(payload + offset, info->self_net_segment, info->self_net_segment_num);
+        offset += info->self_net_segment_num;
+    }
+
+    if (info->uplink_quality) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_UPLINK_QUALITY;
+        payload[offset++] = IE_V2_UPLINK_QUALITY_LEN;
+        payload[offset++] = (info->uplink_quality > IE_V2_UPLINK_QUALITY_MAX) ? IE_V2_UPLINK_QUALITY_MAX : info->uplink_quality;
+    }
+
+    if (info->route_num) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_ROUTE;
+        payload[offset++] = IE_V2_ROUTE_UPLINK_LEN + info->route_num * sizeof(esp_litemesh_ie_route_t);
+        memcpy(payload + offset, info->uplink_addr, sizeof(info->uplink_addr));
+        offset += sizeof(info->uplink_addr);
+        memcpy(payload + offset, info->uplink_bssid, sizeof(info->uplink_bssid));
+        offset += sizeof(info->uplink_bssid);
+        memcpy(payload + offset, info->route, info->route_num * sizeof(esp_litemesh_ie_route_t));
+        offset += info->route_num * sizeof(esp_litemesh_ie_route_t);
+    }
+
+    if (info->tree_nodes) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_TREE;
+        payload[offset++] = IE_V2_TREE_LEN + info->tree_segment_num;
+        memcpy(payload + offset, info->root_id, sizeof(info->root_id));
+        offset += sizeof(info->root_id);
+        payload[offset++] = (info->root_load > ESP_LITEMESH_IE_ROOT_LOAD_MAX) ? ESP_LITEMESH_IE_ROOT_LOAD_MAX : info->root_load;
+        payload[offset++] = info->tree_nodes;
+        memcpy(payload + offset, info->uplink_bssid, sizeof(info->uplink_bssid));
+        offset += sizeof(info->uplink_bssid);
+        memcpy(payload + offset, info->tree_segment, info->tree_segment_num);
+        offset += info->tree_segment_num;
+    }
+
+    if (info->path_rate) {
+        payload[offset++] = ESP_LITEMESH_IE_TLV_PATH;
+        payload[offset++] = IE_V2_PATH_LEN;
+        payload[offset++] = info->path_rtt >> 8;
+        payload[offset++] = info->path_rtt & 0xFF;
+        payload[offset++] = info->path_rate >> 8;
+        payload[offset++] = info->path_rate & 0xFF;
+    }
+
+    return offset;
+}
+
+esp_err_t esp_litemesh_ie_encode(const esp_gateway_litemesh_info_t* info, vendor_ie_data_t* ie, uint32_t max_payload_len)
+{
+    uint32_t len = 0;
+
+    if ((info == NULL) || (ie == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (max_payload_len > ESP_LITEMESH_IE_MAX_PAYLOAD_LEN) {
+        max_payload_len = ESP_LITEMESH_IE_MAX_PAYLOAD_LEN;
+    }
+
+    switch (info->version) {
+    case ESP_LITEMESH_IE_VERSION_1:
+        len = esp_litemesh_ie_encode_v1(info, ie->payload, max_payload_len);
+        break;
+    case ESP_LITEMESH_IE_VERSION_2:
+        len = esp_litemesh_ie_encode_v2(info, ie->payload, max_payload_len);
+        break;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (len == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ie->length = ESP_LITEMESH_IE_OUI_LEN + len;
+    return ESP_OK;
+}
+
+static esp_err_t esp_litemesh_ie_parse_v1(const uint8_t* payload, uint32_t len, esp_litemesh_ie_view_t* view)
+{
+    uint32_t offset = IE_V1_ROUTER_SSID;
+
+    if (len < IE_V1_ROUTER_SSID) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    view->router_ssid_len = payload[IE_V1_ROUTER_SSID_LEN];
+    view->router_number = payload[IE_V1_TRACE_ROUTER_NUMBER] >> 4;
+    view->inherited_netif_number = payload[IE_V1_TRACE_ROUTER_NUMBER] & 0x0F;
+    if ((view->router_ssid_len > ESP_GATEWAY_SSID_MAX_LEN)
+        || (offset + view->router_ssid_len + view->router_number + view->inherited_netif_number > len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    view->router_ssid = payload + offset;
+    offset += view->router_ssid_len;
+    view->router_net_segment = payload + offset;
+    offset += view->router_number;
+    view->inherited_net_segment = payload + offset;
+
+    return ESP_OK;
+}
+
+static esp_err_t esp_litemesh_ie_parse_v2(const uint8_t* payload, uint32_t len, esp_litemesh_ie_view_t* view)
+{
+    uint32_t offset = IE_HEADER_LEN;
+
+    while (offset < len) {
+        uint8_t type = 0;
+        uint8_t value_len = 0;
+        const uint8_t* value = NULL;
+
+        if (offset + IE_V2_TLV_HEADER_LEN > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        type = payload[offset];
+        value_len = payload[offset + 1];
+        value = payload + offset + IE_V2_TLV_HEADER_LEN;
+        offset += IE_V2_TLV_HEADER_LEN + value_len;
+        if (offset > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        switch (type) {
+        case ESP_LITEMESH_IE_TLV_ROUTER_SSID:
+            if ((value_len < IE_V2_ROUTER_SSID_LEN) || (value[0] == 0) || (value[0] > ESP_GATEWAY_SSID_MAX_LEN)) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            view->router_ssid_len = value[0];
+            view->router_ssid_digest = ((uint32_t)value[1] << 24) | ((uint32_t)value[2] << 16) | ((uint32_t)value[3] << 8) | value[4];
+            break;
+        case ESP_LITEMESH_IE_TLV_ROUTER_SEGMENT:
+            view->router_number = value_len;
+            view->router_net_segment = value;
+            break;
+        case ESP_LITEMESH_IE_TLV_INHERITED_SEGMENT:
+            view->inherited_netif_number = value_len;
+            view->inherited_net_segment = value;
+            break;
+        case ESP_LITEMESH_IE_TLV_UPLINK_QUALITY:
+            if (value_len < IE_V2_UPLINK_QUALITY_LEN) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            view->uplink_quality = (value[0] > IE_V2_UPLINK_QUALITY_MAX) ? IE_V2_UPLINK_QUALITY_MAX : value[0];
+            break;
+        case ESP_LITEMESH_IE_TLV_ROUTE:
+            if ((value_len < IE_V2_ROUTE_UPLINK_LEN) || ((value_len - IE_V2_ROUTE_UPLINK_LEN) % sizeof(esp_litemesh_ie_route_t))) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            view->uplink_addr = value;
+            view->uplink_bssid = value + 2;
+            view->route_num = (value_len - IE_V2_ROUTE_UPLINK_LEN) / sizeof(esp_litemesh_ie_route_t);
+            view->route = (const esp_litemesh_ie_route_t*)(value + IE_V2_ROUTE_UPLINK_LEN);
+            break;
+        case ESP_LITEMESH_IE_TLV_TREE:
+            if ((value_len < IE_V2_TREE_LEN) || (value[4] == 0)) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            view->root_id = value;
+            view->root_load = (value[3] > ESP_LITEMESH_IE_ROOT_LOAD_MAX) ? ESP_LITEMESH_IE_ROOT_LOAD_MAX : value[3];
+            view->tree_nodes = value[4];
+            view->uplink_bssid = value + 5;
+            view->tree_segment_num = value_len - IE_V2_TREE_LEN;
+            view->tree_segment = value + IE_V2_TREE_LEN;
+            break;
+        case ESP_LITEMESH_IE_TLV_PATH:
+            if ((value_len < IE_V2_PATH_LEN) || ((value[2] == 0) && (value[3] == 0))) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            view->path_rtt = ((uint16_t)value[0] << 8) | value[1];
+            view->path_rate = ((uint16_t)value[2] << 8) | value[3];
+            break;
+        default:
+            /* Added by a later version */
+            break;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_ie_parse(const vendor_ie_data_t* ie, esp_litemesh_ie_view_t* view)
+{
+    uint32_t len = 0;
+    const uint8_t* payload = NULL;
+
+    if ((ie == NULL) || (view == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(view, 0, sizeof(*view));
+    if (ie->length < ESP_LITEMESH_IE_OUI_LEN + IE_HEADER_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    len = ie->length - ESP_LITEMESH_IE_OUI_LEN;
+    payload = ie->payload;
+    view->version = payload[IE_VERSION];
+    view->max_connection = payload[IE_CONNECT_NUMBER_INFORMATION] >> 4;
+    view->connected_station_number = payload[IE_CONNECT_NUMBER_INFORMATION] & 0x0F;
+    view->connect_router_status = payload[IE_NODE_INFORMATION] >> 7;
+    view->compact = (view->version >= ESP_LITEMESH_IE_VERSION_2) || ((payload[IE_NODE_INFORMATION] >> 6) & 0x01);
+    view->level = payload[IE_NODE_INFORMATION] & 0x0F;
+
+    if (view->version == ESP_LITEMESH_IE_VERSION_1) {
+        return esp_litemesh_ie_parse_v1(payload, len, view);
+    } else if (view->version >= ESP_LITEMESH_IE_VERSION_2) {
+        /* The TLVs of later versions are a superset of version 2 */
+        return esp_litemesh_ie_parse_v2(payload, len, view);
+    }
+
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool esp_litemesh_ie_ssid_match(const esp_litemesh_ie_view_t* view, const uint8_t* ssid, uint8_t len)
+{
+    if (view->router_ssid_len != len) {
+        return false;
+    }
+
+    if (len == 0) {
+        return true;
+    }
+
+    if (view->router_ssid) {
+        return !memcmp(view->router_ssid, ssid, len);
+    }
+
+    return view->router_ssid_digest == esp_litemesh_ie_ssid_digest(ssid, len);
+}
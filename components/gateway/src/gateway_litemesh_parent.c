@@ -0,0 +1,306 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+#include "esp_gateway_litemesh_parent.h"
+
+#define PARENT_RSSI_SCALE                   (16)    /* The smoothed RSSI is kept in 1/16 dBm */
+#define PARENT_RSSI_MIN                     (-90)   /* RSSI term 0 */
+#define PARENT_RSSI_MAX                     (-40)   /* RSSI term 100 */
+#define PARENT_UPLINK_QUALITY_DEFAULT       (50)
+#define PARENT_ROOT_LOAD_DEFAULT            (50)
+#define PARENT_PATH_DEFAULT                 (50)
+#define PARENT_PATH_RTT_US_PER_POINT        (200000 / 100)  /* 0 at 200 ms */
+#define PARENT_PATH_KBPS_PER_POINT          (200)           /* 100 at 20 Mbit/s */
+
+typedef struct {
+    bool used;
+    esp_litemesh_parent_t info;
+    int32_t rssi_scaled;
+    uint32_t last_seen;
+} parent_candidate_t;
+
+struct esp_litemesh_parent_selector {
+    esp_litemesh_parent_selector_config_t config;
+    parent_candidate_t candidates[ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES];
+    parent_candidate_t* parent;
+    uint32_t parent_since;
+};
+
+static const esp_litemesh_parent_weights_t default_weights = {
+    .level = CONFIG_LITEMESH_PARENT_LEVEL_WEIGHT,
+    .rssi = CONFIG_LITEMESH_PARENT_RSSI_WEIGHT,
+    .load = CONFIG_LITEMESH_PARENT_LOAD_WEIGHT,
+    .uplink = CONFIG_LITEMESH_PARENT_UPLINK_WEIGHT,
+    .root_load = CONFIG_LITEMESH_PARENT_ROOT_LOAD_WEIGHT,
+    .path = CONFIG_LITEMESH_PARENT_PATH_WEIGHT,
+};
+
+/* As fast as it is short, a path is worth the mean of its RTT and throughput terms */
+static int32_t parent_path_term(const esp_litemesh_parent_t* parent)
+{
+    int32_t rtt = 0;
+    int32_t rate = 0;
+
+    if (parent->path_kbps == 0) {
+        return PARENT_PATH_DEFAULT;
+    }
+
+    if (parent->path_rtt_us < 100 * PARENT_PATH_RTT_US_PER_POINT) {
+        rtt = 100 - (int32_t)(parent->path_rtt_us / PARENT_PATH_RTT_US_PER_POINT);
+    }
+    rate = (parent->path_kbps >= 100 * PARENT_PATH_KBPS_PER_POINT) ? 100 : (int32_t)(parent->path_kbps / PARENT_PATH_KBPS_PER_POINT);
+
+    return (rtt + rate) / 2;
+}
+
+int32_t esp_litemesh_parent_default_score(const esp_litemesh_parent_t* parent, void* arg)
+{
+    const esp_litemesh_parent_weights_t* weights = arg ? (const esp_litemesh_parent_weights_t*)arg : &default_weights;
+    int32_t level = (parent->level > 1) ? (100 / parent->level) : 100;
+    int32_t rssi = 0;
+    int32_t load = 0;
+    int32_t uplink = parent->uplink_quality;
+    int32_t root_load = parent->root_load;
+
+    if (parent->rssi >= PARENT_RSSI_MAX) {
+        rssi = 100;
+    } else if (parent->rssi > PARENT_RSSI_MIN) {
+        rssi = (parent->rssi - PARENT_RSSI_MIN) * 100 / (PARENT_RSSI_MAX - PARENT_RSSI_MIN);
+    }
+
+    if (parent->max_connection > parent->connected_station_number) {
+        load = (parent->max_connection - parent->connected_station_number) * 100 / parent->max_connection;
+    }
+
+    if (uplink == ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN) {
+        uplink = PARENT_UPLINK_QUALITY_DEFAULT;
+    } else if (uplink > ESP_LITEMESH_UPLINK_QUALITY_MAX) {
+        uplink = ESP_LITEMESH_UPLINK_QUALITY_MAX;
+    }
+
+    if (root_load == ESP_LITEMESH_ROOT_LOAD_UNKNOWN) {
+        root_load = PARENT_ROOT_LOAD_DEFAULT;
+    } else if (root_load > ESP_LITEMESH_ROOT_LOAD_MAX) {
+        root_load = ESP_LITEMESH_ROOT_LOAD_MAX;
+    }
+
+    return weights->level * level + weights->rssi * rssi + weights->load * load + weights->uplink * uplink
+           + weights->root_load * (ESP_LITEMESH_ROOT_LOAD_MAX - root_load) + weights->path * parent_path_term(parent);
+}
+
+static inline bool parent_candidate_heard(const parent_candidate_t* candidate, uint32_t now, uint32_t max_age_ms)
+{
+    return candidate->used && ((uint32_t)(now - candidate->last_seen) <= max_age_ms);
+}
+
+static inline bool parent_candidate_alive(const esp_litemesh_parent_selector_t* selector, const parent_candidate_t* candidate, uint32_t now)
+{
+    return parent_candidate_heard(candidate, now, selector->config.max_age_ms);
+}
+
+static parent_candidate_t* parent_candidate_find(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6])
+{
+    for (uint32_t loop = 0; loop < ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES; loop++) {
+        parent_candidate_t* candidate = &selector->candidates[loop];
+
+        if (candidate->used && !memcmp(candidate->info.bssid, bssid, sizeof(candidate->info.bssid))) {
+            return candidate;
+        }
+    }
+
+    return NULL;
+}
+
+/* The parent beacons count this node among their stations, the other candidates would have it as one more */
+static int32_t parent_candidate_score(const esp_litemesh_parent_selector_t* selector, const parent_candidate_t* candidate)
+{
+    esp_litemesh_parent_t info = candidate->info;
+
+    if ((candidate == selector->parent) && (info.connected_station_number > 0)) {
+        info.connected_station_number--;
+    }
+
+    return selector->config.score(&info, selector->config.score_arg);
+}
+
+esp_litemesh_parent_selector_t* esp_litemesh_parent_selector_create(const esp_litemesh_parent_selector_config_t* config)
+{
+    esp_litemesh_parent_selector_t* selector = NULL;
+
+    if ((config == NULL) || (config->rssi_smoothing == 0) || (config->rssi_smoothing > 8) || (config->hysteresis < 0)) {
+        return NULL;
+    }
+
+    selector = calloc(1, sizeof(esp_litemesh_parent_selector_t));
+    if (selector == NULL) {
+        return NULL;
+    }
+
+    selector->config = *config;
+    esp_litemesh_parent_selector_set_score(selector, config->score, config->score_arg);
+
+    return selector;
+}
+
+void esp_litemesh_parent_selector_delete(esp_litemesh_parent_selector_t* selector)
+{
+    free(selector);
+}
+
+void esp_litemesh_parent_selector_set_score(esp_litemesh_parent_selector_t* selector, esp_litemesh_parent_score_t score, void* arg)
+{
+    selector->config.score = score ? score : esp_litemesh_parent_default_score;
+    selector->config.score_arg = score ? arg : NULL;
+}
+
+void esp_litemesh_parent_selector_update(esp_litemesh_parent_selector_t* selector, const esp_litemesh_parent_t* beacon, uint32_t now)
+{
+    parent_candidate_t* candidate = parent_candidate_find(selector, beacon->bssid);
+
+    if (candidate == NULL) {
+        for (uint32_t loop = 0; loop < ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES; loop++) {
+            parent_candidate_t* slot = &selector->candidates[loop];
+
+            if (!slot->used) {
+                candidate = slot;
+                break;
+            }
+            if ((slot != selector->parent)
+                && ((candidate == NULL) || ((uint32_t)(now - slot->last_seen) > (uint32_t)(now - candidate->last_seen)))) {
+                candidate = slot;
+            }
+        }
+        candidate->used = true;
+        candidate->rssi_scaled = beacon->rssi * PARENT_RSSI_SCALE;
+    } else {
+        candidate->rssi_scaled += (beacon->rssi * PARENT_RSSI_SCALE - candidate->rssi_scaled) * selector->config.rssi_smoothing / 8;
+    }
+
+    candidate->info = *beacon;
+    candidate->info.rssi = (candidate->rssi_scaled - PARENT_RSSI_SCALE / 2) / PARENT_RSSI_SCALE;
+    candidate->last_seen = now;
+}
+
+void esp_litemesh_parent_selector_remove(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6])
+{
+    parent_candidate_t* candidate = parent_candidate_find(selector, bssid);
+
+    if (candidate && (candidate != selector->parent)) {
+        candidate->used = false;
+    }
+}
+
+esp_err_t esp_litemesh_parent_selector_get(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6], esp_litemesh_parent_t* candidate)
+{
+    parent_candidate_t* found = parent_candidate_find(selector, bssid);
+
+    if (found == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *candidate = found->info;
+    return ESP_OK;
+}
+
+/* Ties go to the first candidate of the table, which only depends on the order of the beacons */
+static parent_candidate_t* parent_candidate_best(esp_litemesh_parent_selector_t* selector, uint32_t now, uint8_t max_level,
+                                                 uint32_t max_age_ms, int32_t* score)
+{
+    parent_candidate_t* best = NULL;
+
+    for (uint32_t loop = 0; loop < ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES; loop++) {
+        parent_candidate_t* candidate = &selector->candidates[loop];
+        int32_t candidate_score = 0;
+
+        if (!parent_candidate_heard(candidate, now, max_age_ms) || (candidate->info.level >= max_level)) {
+            continue;
+        }
+
+        candidate_score = parent_candidate_score(selector, candidate);
+        if ((best == NULL) || (candidate_score > *score)) {
+            best = candidate;
+            *score = candidate_score;
+        }
+    }
+
+    return best;
+}
+
+esp_err_t esp_litemesh_parent_selector_best(esp_litemesh_parent_selector_t* selector, uint32_t now, esp_litemesh_parent_t* best)
+{
+    int32_t score = 0;
+    parent_candidate_t* candidate = parent_candidate_best(selector, now, UINT8_MAX, selector->config.max_age_ms, &score);
+
+    if (candidate == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *best = candidate->info;
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_parent_selector_failover(esp_litemesh_parent_selector_t* selector, uint32_t now, uint8_t max_level,
+                                                uint32_t max_age_ms, esp_litemesh_parent_t* best)
+{
+    int32_t score = 0;
+    parent_candidate_t* candidate = parent_candidate_best(selector, now, max_level, max_age_ms, &score);
+
+    if (candidate == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *best = candidate->info;
+    return ESP_OK;
+}
+
+esp_err_t esp_litemesh_parent_selector_get_parent(esp_litemesh_parent_selector_t* selector, esp_litemesh_parent_t* parent)
+{
+    if (selector->parent == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *parent = selector->parent->info;
+    return ESP_OK;
+}
+
+void esp_litemesh_parent_selector_set_parent(esp_litemesh_parent_selector_t* selector, const uint8_t bssid[6], uint32_t now)
+{
+    selector->parent = bssid ? parent_candidate_find(selector, bssid) : NULL;
+    selector->parent_since = now;
+}
+
+bool esp_litemesh_parent_selector_should_switch(esp_litemesh_parent_selector_t* selector, uint32_t now, uint8_t max_level, esp_litemesh_parent_t* better)
+{
+    parent_candidate_t* parent = selector->parent;
+    parent_candidate_t* best = NULL;
+    int32_t score = 0;
+
+    /* A parent not heard any more is left to the disconnection */
+    if ((parent == NULL) || !parent_candidate_alive(selector, parent, now)
+        || ((uint32_t)(now - selector->parent_since) < selector->config.min_dwell_ms)) {
+        return false;
+    }
+
+    best = parent_candidate_best(selector, now, max_level, selector->config.max_age_ms, &score);
+    if ((best == NULL) || (best == parent) || (score <= parent_candidate_score(selector, parent) + selector->config.hysteresis)) {
+        return false;
+    }
+
+    *better = best->info;
+    return true;
+}
@@ -0,0 +1,181 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_litemesh_path.h"
+
+#define PATH_SRTT_SHIFT             (3)     /* A new sample weighs 1/8 in the smoothed RTT, as in TCP */
+#define PATH_CHANGE_SHIFT           (3)     /* A change of more than 1/8 is advertised */
+
+typedef struct {
+    uint32_t rtt[ESP_LITEMESH_PATH_MAX_WINDOW];
+    uint32_t num;
+    uint32_t next;
+} path_window_t;
+
+struct esp_litemesh_path_estimator {
+    esp_litemesh_path_config_t config;
+    path_window_t small;
+    path_window_t large;
+    uint32_t srtt_us;
+    esp_litemesh_path_estimator_stats_t stats;
+};
+
+static void path_window_add(path_window_t* window, uint32_t size, uint32_t rtt_us)
+{
+    window->rtt[window->next] = rtt_us;
+    window->next = (window->next + 1) % size;
+    if (window->num < size) {
+        window->num++;
+    }
+}
+
+static uint32_t path_window_min(const path_window_t* window)
+{
+    uint32_t min = UINT32_MAX;
+
+    for (uint32_t loop = 0; loop < window->num; loop++) {
+        if (window->rtt[loop] < min) {
+            min = window->rtt[loop];
+        }
+    }
+
+    return min;
+}
+
+static bool path_moved(uint32_t advertised, uint32_t current)
+{
+    uint32_t diff = (current > advertised) ? (current - advertised) : (advertised - current);
+
+    return diff > (advertised >> PATH_CHANGE_SHIFT);
+}
+
+esp_litemesh_path_estimator_t* esp_litemesh_path_estimator_create(const esp_litemesh_path_config_t* config)
+{
+    esp_litemesh_path_estimator_t* estimator = NULL;
+
+    if ((config == NULL) || (config->large_len <= config->small_len) || (config->window == 0)
+        || (config->window > ESP_LITEMESH_PATH_MAX_WINDOW)) {
+        return NULL;
+    }
+
+    estimator = calloc(1, sizeof(esp_litemesh_path_estimator_t));
+    if (estimator == NULL) {
+        return NULL;
+    }
+
+    estimator->config = *config;
+    return estimator;
+}
+
+void esp_litemesh_path_estimator_delete(esp_litemesh_path_estimator_t* estimator)
+{
+    free(estimator);
+}
+
+void esp_litemesh_path_estimator_reset(esp_litemesh_path_estimator_t* estimator)
+{
+    if (estimator) {
+        memset(&estimator->small, 0, sizeof(estimator->small));
+        memset(&estimator->large, 0, sizeof(estimator->large));
+        estimator->srtt_us = 0;
+    }
+}
+
+esp_err_t esp_litemesh_path_estimator_sample(esp_litemesh_path_estimator_t* estimator, uint32_t len, uint32_t rtt_us)
+{
+    if (estimator == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (len == estimator->config.small_len) {
+        if (estimator->small.num == 0) {
+            estimator->srtt_us = rtt_us;
+        } else {
+            estimator->srtt_us += ((int32_t)(rtt_us - estimator->srtt_us)) >> PATH_SRTT_SHIFT;
+        }
+        path_window_add(&estimator->small, estimator->config.window, rtt_us);
+    } else if (len == estimator->config.large_len) {
+        path_window_add(&estimator->large, estimator->config.window, rtt_us);
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    estimator->stats.samples++;
+    return ESP_OK;
+}
+
+void esp_litemesh_path_estimator_loss(esp_litemesh_path_estimator_t* estimator)
+{
+    if (estimator) {
+        estimator->stats.losses++;
+    }
+}
+
+bool esp_litemesh_path_estimator_get(esp_litemesh_path_estimator_t* estimator, esp_litemesh_path_metric_t* link)
+{
+    uint64_t bits = 0;
+    uint32_t small_min = 0;
+    uint32_t large_min = 0;
+    uint64_t kbps = ESP_LITEMESH_PATH_MAX_KBPS;
+
+    if ((estimator == NULL) || (link == NULL) || (estimator->small.num == 0) || (estimator->large.num == 0)) {
+        return false;
+    }
+
+    small_min = path_window_min(&estimator->small);
+    large_min = path_window_min(&estimator->large);
+    bits = (uint64_t)(estimator->config.large_len - estimator->config.small_len) * 8 * 2;
+    if (large_min > small_min) {
+        /* Bits per microsecond are Mbit/s */
+        kbps = bits * 1000 / (large_min - small_min);
+    }
+
+    link->rtt_us = estimator->srtt_us;
+    link->kbps = (kbps > ESP_LITEMESH_PATH_MAX_KBPS) ? ESP_LITEMESH_PATH_MAX_KBPS : (kbps ? (uint32_t)kbps : 1);
+    return true;
+}
+
+void esp_litemesh_path_estimator_get_stats(esp_litemesh_path_estimator_t* estimator, esp_litemesh_path_estimator_stats_t* stats)
+{
+    if (estimator && stats) {
+        *stats = estimator->stats;
+    }
+}
+
+void esp_litemesh_path_combine(const esp_litemesh_path_metric_t* parent, const esp_litemesh_path_metric_t* link,
+                               esp_litemesh_path_metric_t* path)
+{
+    esp_litemesh_path_metric_t result = *link;
+
+    if (parent && parent->kbps) {
+        result.rtt_us = (parent->rtt_us > UINT32_MAX - link->rtt_us) ? UINT32_MAX : (parent->rtt_us + link->rtt_us);
+        if (parent->kbps < result.kbps) {
+            result.kbps = parent->kbps;
+        }
+    }
+
+    *path = result;
+}
+
+bool esp_litemesh_path_changed(const esp_litemesh_path_metric_t* advertised, const esp_litemesh_path_metric_t* current)
+{
+    if ((advertised->kbps == 0) || (current->kbps == 0)) {
+        return advertised->kbps != current->kbps;
+    }
+
+    return path_moved(advertised->rtt_us, current->rtt_us) || path_moved(advertised->kbps, current->kbps);
+}
@@ -0,0 +1,133 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/pbuf.h"
+#include "lwip/raw.h"
+#include "lwip/icmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_litemesh.h"
+
+/*
+ * The path probes are ICMP echo requests of their own identifier, sent and received on a raw pcb in the
+ * TCP/IP task. The echo data starts with the esp_timer time of the send, which the reply brings back, so
+ * the RTT is measured in microseconds: esp_ping only reports milliseconds, too coarse for the time a
+ * kilobyte takes on a Wi-Fi link. The replies of the other echo requests are left to the stack.
+ */
+
+#define LITEMESH_PROBE_ID               (0x4C4D)    /* "LM" */
+
+/* The pcb is only used from the TCP/IP task, the probes are sent through tcpip_api_call() */
+typedef struct {
+    struct tcpip_api_call_data call;
+    uint32_t dest;
+    uint32_t len;
+    uint16_t seq;
+    esp_err_t ret;
+} litemesh_probe_msg_t;
+
+static struct raw_pcb* s_probe_pcb = NULL;
+
+static u8_t litemesh_probe_recv(void* arg, struct raw_pcb* pcb, struct pbuf* p, const ip_addr_t* addr)
+{
+    struct icmp_echo_hdr echo;
+    int64_t sent_us = 0;
+    uint8_t ip_vhl = 0;
+    uint16_t ip_hlen = 0;
+
+    /* The pbuf starts with the IP header */
+    if (pbuf_copy_partial(p, &ip_vhl, sizeof(ip_vhl), 0) != sizeof(ip_vhl)) {
+        return 0;
+    }
+    ip_hlen = (ip_vhl & 0x0F) * 4;
+    if ((pbuf_copy_partial(p, &echo, sizeof(echo), ip_hlen) != sizeof(echo))
+        || (echo.type != ICMP_ER) || (echo.id != PP_HTONS(LITEMESH_PROBE_ID))
+        || (pbuf_copy_partial(p, &sent_us, sizeof(sent_us), ip_hlen + sizeof(echo)) != sizeof(sent_us))) {
+        return 0;
+    }
+
+    esp_litemesh_path_probe_done(lwip_ntohs(echo.seqno), (uint32_t)(esp_timer_get_time() - sent_us));
+    pbuf_free(p);
+    return 1;
+}
+
+static err_t litemesh_probe_do_send(struct tcpip_api_call_data* call)
+{
+    litemesh_probe_msg_t* msg = (litemesh_probe_msg_t*)call;
+    struct icmp_echo_hdr* echo = NULL;
+    struct pbuf* p = NULL;
+    ip_addr_t addr;
+    int64_t now = 0;
+
+    ip_addr_set_ip4_u32_val(addr, msg->dest);
+
+    if (s_probe_pcb == NULL) {
+        s_probe_pcb = raw_new(IP_PROTO_ICMP);
+        if (s_probe_pcb == NULL) {
+            msg->ret = ESP_ERR_NO_MEM;
+            return ERR_OK;
+        }
+        raw_recv(s_probe_pcb, litemesh_probe_recv, NULL);
+        raw_bind(s_probe_pcb, IP_ADDR_ANY);
+    }
+
+    p = pbuf_alloc(PBUF_IP, sizeof(struct icmp_echo_hdr) + msg->len, PBUF_RAM);
+    if (p == NULL) {
+        msg->ret = ESP_ERR_NO_MEM;
+        return ERR_OK;
+    }
+
+    echo = (struct icmp_echo_hdr*)p->payload;
+    ICMPH_TYPE_SET(echo, ICMP_ECHO);
+    ICMPH_CODE_SET(echo, 0);
+    echo->id = PP_HTONS(LITEMESH_PROBE_ID);
+    echo->seqno = lwip_htons(msg->seq);
+    memset((uint8_t*)(echo + 1) + sizeof(now), 0xA5, msg->len - sizeof(now));
+
+    now = esp_timer_get_time();
+    memcpy(echo + 1, &now, sizeof(now));
+    echo->chksum = 0;
+    echo->chksum = inet_chksum(echo, p->len);
+
+    msg->ret = (raw_sendto(s_probe_pcb, p, &addr) == ERR_OK) ? ESP_OK : ESP_FAIL;
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+esp_err_t esp_litemesh_probe_send(uint32_t dest, uint32_t len, uint16_t seq)
+{
+    litemesh_probe_msg_t msg = {
+        .dest = dest,
+        .len = len,
+        .seq = seq,
+    };
+
+    if (len < sizeof(int64_t)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    tcpip_api_call(litemesh_probe_do_send, &msg.call);
+    return msg.ret;
+}
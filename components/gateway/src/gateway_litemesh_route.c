@@ -0,0 +1,69 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/etharp.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_litemesh.h"
+
+/*
+ * The subnets of the subtree of a LiteMesh node are behind the stations of its children. ip4_route() only
+ * knows the subnets of the netifs and the default route, the route hook picks the netif of the child and the
+ * ARP output resolves the station of the child instead of the destination, which is not on the link.
+ * ESP-IDF defines LWIP_HOOK_IP4_ROUTE_SRC as ip4_route_src_hook(), and the netifs call etharp_output() through
+ * netif->output, so both are wrapped at link time.
+ */
+
+struct netif* __real_ip4_route_src_hook(const ip4_addr_t* src, const ip4_addr_t* dest);
+err_t __real_etharp_output(struct netif* netif, struct pbuf* q, const ip4_addr_t* ipaddr);
+
+struct netif* __wrap_ip4_route_src_hook(const ip4_addr_t* src, const ip4_addr_t* dest)
+{
+    struct netif* netif = NULL;
+    ip4_addr_t next_hop;
+    uint32_t route = 0;
+
+    if ((dest != NULL) && esp_litemesh_route_lookup(ip4_addr_get_u32(dest), &route)) {
+        ip4_addr_set_u32(&next_hop, route);
+        NETIF_FOREACH(netif) {
+            if (netif_is_up(netif) && netif_is_link_up(netif)
+                && ip4_addr_netcmp(&next_hop, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+                return netif;
+            }
+        }
+    }
+
+    return __real_ip4_route_src_hook(src, dest);
+}
+
+err_t __wrap_etharp_output(struct netif* netif, struct pbuf* q, const ip4_addr_t* ipaddr)
+{
+    ip4_addr_t next_hop;
+    uint32_t route = 0;
+
+    if (!ip4_addr_netcmp(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif))
+        && esp_litemesh_route_lookup(ip4_addr_get_u32(ipaddr), &route)) {
+        ip4_addr_set_u32(&next_hop, route);
+        if (ip4_addr_netcmp(&next_hop, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+            return __real_etharp_output(netif, q, &next_hop);
+        }
+    }
+
+    return __real_etharp_output(netif, q, ipaddr);
+}
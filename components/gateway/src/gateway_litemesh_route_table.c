@@ -0,0 +1,249 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_litemesh_route_table.h"
+
+#define ROUTE_SEGMENT_NUM           (256)
+#define ROUTE_NO_NEXT_HOP           (0)
+
+typedef struct {
+    bool used;
+    uint8_t id[6];
+    uint32_t addr;
+    uint32_t updated;
+    uint32_t routes;
+} route_next_hop_t;
+
+/*
+ * A segment is a byte, so the table is indexed by it: the lookup on the forwarding path is a single
+ * read. Each segment holds the index + 1 of its next hop, ROUTE_NO_NEXT_HOP when it is not routed.
+ */
+struct esp_litemesh_route_table {
+    uint32_t max_next_hops;
+    uint32_t max_age_ms;
+    uint8_t segment_next_hop[ROUTE_SEGMENT_NUM];
+    route_next_hop_t* next_hops;
+    esp_litemesh_route_table_stats_t stats;
+};
+
+static route_next_hop_t* route_next_hop_find(esp_litemesh_route_table_t* table, const uint8_t id[6])
+{
+    for (uint32_t loop = 0; loop < table->max_next_hops; loop++) {
+        if (table->next_hops[loop].used && !memcmp(table->next_hops[loop].id, id, sizeof(table->next_hops[loop].id))) {
+            return &table->next_hops[loop];
+        }
+    }
+
+    return NULL;
+}
+
+static uint8_t route_next_hop_index(esp_litemesh_route_table_t* table, const route_next_hop_t* next_hop)
+{
+    return (uint8_t)(next_hop - table->next_hops) + 1;
+}
+
+/* Remove the routes of a next hop and free it */
+static bool route_next_hop_release(esp_litemesh_route_table_t* table, route_next_hop_t* next_hop)
+{
+    uint8_t index = route_next_hop_index(table, next_hop);
+    bool changed = (next_hop->routes != 0);
+
+    for (uint32_t segment = 0; (segment < ROUTE_SEGMENT_NUM) && next_hop->routes; segment++) {
+        if (table->segment_next_hop[segment] == index) {
+            table->segment_next_hop[segment] = ROUTE_NO_NEXT_HOP;
+            next_hop->routes--;
+            table->stats.routes--;
+        }
+    }
+
+    next_hop->used = false;
+    table->stats.next_hops--;
+    return changed;
+}
+
+esp_litemesh_route_table_t* esp_litemesh_route_table_create(uint32_t max_next_hops, uint32_t max_age_ms)
+{
+    esp_litemesh_route_table_t* table = NULL;
+
+    if ((max_next_hops == 0) || (max_next_hops > ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS) || (max_age_ms == 0)) {
+        return NULL;
+    }
+
+    table = calloc(1, sizeof(esp_litemesh_route_table_t));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    table->next_hops = calloc(max_next_hops, sizeof(route_next_hop_t));
+    if (table->next_hops == NULL) {
+        free(table);
+        return NULL;
+    }
+
+    table->max_next_hops = max_next_hops;
+    table->max_age_ms = max_age_ms;
+    return table;
+}
+
+void esp_litemesh_route_table_delete(esp_litemesh_route_table_t* table)
+{
+    if (table) {
+        free(table->next_hops);
+        free(table);
+    }
+}
+
+esp_err_t esp_litemesh_route_table_update(esp_litemesh_route_table_t* table, const uint8_t id[6], uint32_t next_hop,
+                                          const uint8_t* segments, uint32_t num, uint32_t now, bool* changed)
+{
+    uint8_t announced[ROUTE_SEGMENT_NUM / 8] = { 0 };
+    route_next_hop_t* hop = NULL;
+    uint8_t index = 0;
+    bool update = false;
+
+    if ((table == NULL) || (id == NULL) || (next_hop == 0) || ((segments == NULL) && num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hop = route_next_hop_find(table, id);
+    if (hop == NULL) {
+        for (uint32_t loop = 0; (loop < table->max_next_hops) && (hop == NULL); loop++) {
+            if (!table->next_hops[loop].used) {
+                hop = &table->next_hops[loop];
+            }
+        }
+        if (hop == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memset(hop, 0, sizeof(*hop));
+        hop->used = true;
+        memcpy(hop->id, id, sizeof(hop->id));
+        table->stats.next_hops++;
+    }
+
+    index = route_next_hop_index(table, hop);
+    hop->updated = now;
+
+    /* The child got another address: all its routes move with it */
+    if (hop->addr != next_hop) {
+        hop->addr = next_hop;
+        update = (hop->routes != 0);
+    }
+
+    for (uint32_t loop = 0; loop < num; loop++) {
+        uint8_t segment = segments[loop];
+        uint8_t current = table->segment_next_hop[segment];
+
+        announced[segment / 8] |= 1 << (segment % 8);
+        if (current == index) {
+            continue;
+        }
+
+        if (current != ROUTE_NO_NEXT_HOP) {
+            table->stats.conflicts++;
+            continue;
+        }
+
+        table->segment_next_hop[segment] = index;
+        hop->routes++;
+        table->stats.routes++;
+        update = true;
+    }
+
+    /* The segments the child stopped announcing */
+    for (uint32_t segment = 0; (segment < ROUTE_SEGMENT_NUM) && (hop->routes > 0); segment++) {
+        if ((table->segment_next_hop[segment] == index) && !(announced[segment / 8] & (1 << (segment % 8)))) {
+            table->segment_next_hop[segment] = ROUTE_NO_NEXT_HOP;
+            hop->routes--;
+            table->stats.routes--;
+            update = true;
+        }
+    }
+
+    if (changed) {
+        *changed = update;
+    }
+
+    return ESP_OK;
+}
+
+bool esp_litemesh_route_table_remove(esp_litemesh_route_table_t* table, const uint8_t id[6])
+{
+    route_next_hop_t* hop = route_next_hop_find(table, id);
+
+    return hop ? route_next_hop_release(table, hop) : false;
+}
+
+bool esp_litemesh_route_table_expire(esp_litemesh_route_table_t* table, uint32_t now)
+{
+    bool changed = false;
+
+    for (uint32_t loop = 0; loop < table->max_next_hops; loop++) {
+        route_next_hop_t* hop = &table->next_hops[loop];
+
+        if (hop->used && ((uint32_t)(now - hop->updated) > table->max_age_ms)) {
+            changed |= route_next_hop_release(table, hop);
+            table->stats.expirations++;
+        }
+    }
+
+    return changed;
+}
+
+bool esp_litemesh_route_table_lookup(esp_litemesh_route_table_t* table, uint8_t net_segment, uint32_t* next_hop)
+{
+    uint8_t index = table->segment_next_hop[net_segment];
+
+    table->stats.lookups++;
+    if (index == ROUTE_NO_NEXT_HOP) {
+        return false;
+    }
+
+    table->stats.hits++;
+    *next_hop = table->next_hops[index - 1].addr;
+    return true;
+}
+
+uint32_t esp_litemesh_route_table_get_routes(esp_litemesh_route_table_t* table, esp_litemesh_route_t* routes, uint32_t max_num)
+{
+    uint32_t num = 0;
+
+    for (uint32_t segment = 0; (segment < ROUTE_SEGMENT_NUM) && (num < max_num); segment++) {
+        uint8_t index = table->segment_next_hop[segment];
+
+        if (index != ROUTE_NO_NEXT_HOP) {
+            routes[num].net_segment = segment;
+            routes[num].next_hop = table->next_hops[index - 1].addr;
+            num++;
+        }
+    }
+
+    return num;
+}
+
+void esp_litemesh_route_table_flush(esp_litemesh_route_table_t* table)
+{
+    memset(table->segment_next_hop, ROUTE_NO_NEXT_HOP, sizeof(table->segment_next_hop));
+    memset(table->next_hops, 0, table->max_next_hops * sizeof(route_next_hop_t));
+    table->stats.next_hops = 0;
+    table->stats.routes = 0;
+}
+
+void esp_litemesh_route_table_get_stats(esp_litemesh_route_table_t* table, esp_litemesh_route_table_stats_t* stats)
+{
+    *stats = table->stats;
+}
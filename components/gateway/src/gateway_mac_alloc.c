@@ -0,0 +1,239 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_gateway_mac_alloc.h"
+
+#define MAC_SET_EMPTY               (0)
+#define MAC_LOCALLY_ADMINISTERED    (0x02)
+#define MAC_MULTICAST               (0x01)
+
+typedef struct {
+    uint64_t key;               /* 48-bit MAC, MAC_SET_EMPTY for a free bucket */
+    uint32_t refcnt;
+} mac_set_bucket_t;
+
+struct esp_gateway_mac_allocator {
+    portMUX_TYPE lock;
+    uint8_t base_mac[6];
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t bucket_mask;
+    uint8_t bucket_bits;
+    mac_set_bucket_t* buckets;
+};
+
+static inline uint64_t mac_to_key(const uint8_t mac[6])
+{
+    uint64_t key = 0;
+
+    for (uint32_t loop = 0; loop < 6; loop++) {
+        key = (key << 8) | mac[loop];
+    }
+
+    return key;
+}
+
+static inline uint32_t mac_set_hash(const esp_gateway_mac_allocator_t* allocator, uint64_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - allocator->bucket_bits));
+}
+
+/* Return the bucket of the key, or the free bucket where it should be inserted */
+static uint32_t mac_set_probe(const esp_gateway_mac_allocator_t* allocator, uint64_t key, bool* found)
+{
+    uint32_t pos = mac_set_hash(allocator, key);
+
+    while (allocator->buckets[pos].key != MAC_SET_EMPTY) {
+        if (allocator->buckets[pos].key == key) {
+            *found = true;
+            return pos;
+        }
+        pos = (pos + 1) & allocator->bucket_mask;
+    }
+
+    *found = false;
+    return pos;
+}
+
+/* Backward shift deletion keeps the probe sequences intact without tombstones */
+static void mac_set_delete(esp_gateway_mac_allocator_t* allocator, uint32_t pos)
+{
+    uint32_t next = pos;
+
+    allocator->buckets[pos].key = MAC_SET_EMPTY;
+    while (1) {
+        next = (next + 1) & allocator->bucket_mask;
+        if (allocator->buckets[next].key == MAC_SET_EMPTY) {
+            break;
+        }
+
+        uint32_t home = mac_set_hash(allocator, allocator->buckets[next].key);
+        if (((next - home) & allocator->bucket_mask) >= ((next - pos) & allocator->bucket_mask)) {
+            allocator->buckets[pos] = allocator->buckets[next];
+            allocator->buckets[next].key = MAC_SET_EMPTY;
+            pos = next;
+        }
+    }
+}
+
+esp_gateway_mac_allocator_t* esp_gateway_mac_allocator_create(const uint8_t base_mac[6], uint32_t capacity)
+{
+    esp_gateway_mac_allocator_t* allocator = NULL;
+    uint8_t bucket_bits = 2;
+
+    if ((base_mac == NULL) || (capacity == 0) || (capacity > 0x10000)) {
+        return NULL;
+    }
+
+    /* Keep the load factor below 50% */
+    while ((1UL << bucket_bits) < capacity * 2) {
+        bucket_bits++;
+    }
+
+    allocator = calloc(1, sizeof(esp_gateway_mac_allocator_t));
+    if (allocator == NULL) {
+        return NULL;
+    }
+
+    allocator->buckets = calloc(1UL << bucket_bits, sizeof(mac_set_bucket_t));
+    if (allocator->buckets == NULL) {
+        free(allocator);
+        return NULL;
+    }
+
+    portMUX_INITIALIZE(&allocator->lock);
+    memcpy(allocator->base_mac, base_mac, sizeof(allocator->base_mac));
+    allocator->capacity = capacity;
+    allocator->bucket_bits = bucket_bits;
+    allocator->bucket_mask = (1UL << bucket_bits) - 1;
+
+    return allocator;
+}
+
+void esp_gateway_mac_allocator_delete(esp_gateway_mac_allocator_t* allocator)
+{
+    if (allocator == NULL) {
+        return;
+    }
+
+    free(allocator->buckets);
+    free(allocator);
+}
+
+esp_err_t esp_gateway_mac_allocator_reserve(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6])
+{
+    esp_err_t ret = ESP_OK;
+    uint64_t key = 0;
+    bool found = false;
+
+    if ((allocator == NULL) || (mac == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    key = mac_to_key(mac);
+    if (key == MAC_SET_EMPTY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&allocator->lock);
+    uint32_t pos = mac_set_probe(allocator, key, &found);
+    if (found) {
+        allocator->buckets[pos].refcnt++;
+    } else if (allocator->count >= allocator->capacity) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        allocator->buckets[pos].key = key;
+        allocator->buckets[pos].refcnt = 1;
+        allocator->count++;
+    }
+    portEXIT_CRITICAL(&allocator->lock);
+
+    return ret;
+}
+
+esp_err_t esp_gateway_mac_allocator_release(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6])
+{
+    esp_err_t ret = ESP_OK;
+    bool found = false;
+
+    if ((allocator == NULL) || (mac == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&allocator->lock);
+    uint32_t pos = mac_set_probe(allocator, mac_to_key(mac), &found);
+    if (!found) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (--allocator->buckets[pos].refcnt == 0) {
+        mac_set_delete(allocator, pos);
+        allocator->count--;
+    }
+    portEXIT_CRITICAL(&allocator->lock);
+
+    return ret;
+}
+
+bool esp_gateway_mac_allocator_is_used(esp_gateway_mac_allocator_t* allocator, const uint8_t mac[6])
+{
+    bool found = false;
+
+    if ((allocator == NULL) || (mac == NULL)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&allocator->lock);
+    mac_set_probe(allocator, mac_to_key(mac), &found);
+    portEXIT_CRITICAL(&allocator->lock);
+
+    return found;
+}
+
+esp_err_t esp_gateway_mac_allocator_derive(esp_gateway_mac_allocator_t* allocator, esp_gateway_mac_role_t role, uint32_t index, uint8_t mac[6])
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    uint8_t candidate[6];
+    bool found = false;
+
+    if ((allocator == NULL) || (mac == NULL) || (role >= ESP_GATEWAY_MAC_ROLE_MAX) || (index > ESP_GATEWAY_MAC_ALLOC_MAX_INDEX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(candidate, allocator->base_mac, sizeof(candidate));
+    candidate[0] = (candidate[0] | MAC_LOCALLY_ADMINISTERED) & ~MAC_MULTICAST;
+
+    portENTER_CRITICAL(&allocator->lock);
+    for (uint32_t attempt = 0; attempt < ESP_GATEWAY_MAC_ALLOC_MAX_ATTEMPTS; attempt++) {
+        /* Different (role, index, attempt) always give different addresses */
+        uint32_t mix = (role << 20) | (attempt << 16) | index;
+
+        memcpy(mac, candidate, sizeof(candidate));
+        mac[3] ^= (mix >> 16) & 0xFF;
+        mac[4] ^= (mix >> 8) & 0xFF;
+        mac[5] ^= mix & 0xFF;
+
+        mac_set_probe(allocator, mac_to_key(mac), &found);
+        if (!found) {
+            ret = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&allocator->lock);
+
+    return ret;
+}
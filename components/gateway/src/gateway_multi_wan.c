@@ -0,0 +1,385 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/sys.h"
+#include "lwip/netif.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "ping/ping_sock.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_wan_policy.h"
+
+/*
+ * Each external netif is an uplink. The NAPT hook binds each new flow to an uplink chosen
+ * by esp_gateway_wan_policy_select(), and the flow stays on it while it is usable, whatever
+ * happens to the other uplinks. A ping session per uplink, bound to its netif, tells whether
+ * it reaches CONFIG_GATEWAY_MULTI_WAN_PROBE_HOST.
+ */
+
+static const char *TAG = "gateway_multi_wan";
+
+typedef struct {
+    esp_netif_t* esp_netif;
+    esp_ping_handle_t ping;
+    uint32_t too_big;
+} multi_wan_uplink_t;
+
+/* The policy is used by the NAPT hook, the other tasks go through tcpip_api_call() */
+typedef struct {
+    struct tcpip_api_call_data call;
+    esp_netif_t* esp_netif;
+    esp_ping_handle_t ping;
+    esp_gateway_multi_wan_uplink_stats_t* stats;
+    uint32_t num;
+    uint32_t rtt_ms;
+    uint8_t index;
+    uint8_t weight;
+    bool answered;
+    esp_err_t ret;
+} multi_wan_msg_t;
+
+static esp_gateway_wan_policy_t* s_wan_policy = NULL;
+static multi_wan_uplink_t s_uplinks[ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS];
+
+static inline bool multi_wan_link_up(struct netif* netif)
+{
+    return netif_is_up(netif) && netif_is_link_up(netif) && !ip4_addr_isany_val(*netif_ip4_addr(netif));
+}
+
+/* The flows of the fast path keep the uplink they were learned with */
+static void multi_wan_changed(uint8_t index, bool usable)
+{
+    ESP_LOGI(TAG, "uplink %d %s", index, usable ? "usable" : "unusable");
+#if CONFIG_GATEWAY_FAST_PATH
+    esp_gateway_fast_path_flush();
+#endif
+}
+
+static err_t multi_wan_update_probe(struct tcpip_api_call_data* call)
+{
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+    uint8_t index = msg->index;
+    bool changed = false;
+
+    if (s_wan_policy && (s_uplinks[index].ping == msg->ping)) {
+        struct netif* netif = esp_netif_get_netif_impl(s_uplinks[index].esp_netif);
+        uint32_t now = sys_now();
+        changed = esp_gateway_wan_policy_set_link(s_wan_policy, index, multi_wan_link_up(netif), now);
+        changed |= esp_gateway_wan_policy_report_probe(s_wan_policy, index, msg->answered, msg->rtt_ms, now);
+        if (changed) {
+            multi_wan_changed(index, esp_gateway_wan_policy_usable(s_wan_policy, index));
+        }
+    }
+
+    return ERR_OK;
+}
+
+static void multi_wan_report_probe(esp_ping_handle_t hdl, void* args, bool answered)
+{
+    multi_wan_msg_t msg = {
+        .ping = hdl,
+        .index = (uint8_t)(uintptr_t)args,
+        .answered = answered,
+    };
+
+    if (answered) {
+        esp_ping_get_profile(hdl, ESP_PING_PROF_TIMEGAP, &msg.rtt_ms, sizeof(msg.rtt_ms));
+    }
+
+    tcpip_api_call(multi_wan_update_probe, &msg.call);
+}
+
+static void multi_wan_on_ping_success(esp_ping_handle_t hdl, void* args)
+{
+    multi_wan_report_probe(hdl, args, true);
+}
+
+static void multi_wan_on_ping_timeout(esp_ping_handle_t hdl, void* args)
+{
+    multi_wan_report_probe(hdl, args, false);
+}
+
+static err_t multi_wan_add(struct tcpip_api_call_data* call)
+{
+    esp_gateway_wan_policy_config_t config = {
+        .fall_count = CONFIG_GATEWAY_MULTI_WAN_FALL_COUNT,
+        .rise_count = CONFIG_GATEWAY_MULTI_WAN_RISE_COUNT,
+        .hash_seed = esp_random(),
+    };
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+    struct netif* netif = esp_netif_get_netif_impl(msg->esp_netif);
+
+    if (s_wan_policy == NULL) {
+        s_wan_policy = esp_gateway_wan_policy_create(&config);
+    }
+
+    if (s_wan_policy == NULL) {
+        msg->ret = ESP_ERR_NO_MEM;
+        return ERR_OK;
+    }
+
+    msg->ret = esp_gateway_wan_policy_add(s_wan_policy, netif, CONFIG_GATEWAY_MULTI_WAN_DEFAULT_WEIGHT, &msg->index);
+    if (msg->ret == ESP_OK) {
+        memset(&s_uplinks[msg->index], 0, sizeof(multi_wan_uplink_t));
+        s_uplinks[msg->index].esp_netif = msg->esp_netif;
+        esp_gateway_wan_policy_set_link(s_wan_policy, msg->index, multi_wan_link_up(netif), sys_now());
+    }
+
+    return ERR_OK;
+}
+
+/* The probe session is created out of the TCP/IP task, then bound to the uplink if it was not removed meanwhile */
+static err_t multi_wan_bind_probe(struct tcpip_api_call_data* call)
+{
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+
+    msg->ret = ESP_ERR_NOT_FOUND;
+    if (s_uplinks[msg->index].esp_netif == msg->esp_netif) {
+        s_uplinks[msg->index].ping = msg->ping;
+        msg->ret = ESP_OK;
+    }
+
+    return ERR_OK;
+}
+
+static esp_err_t multi_wan_start_probe(esp_netif_t* esp_netif, uint8_t index)
+{
+    esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+    esp_ping_callbacks_t cbs = {
+        .on_ping_success = multi_wan_on_ping_success,
+        .on_ping_timeout = multi_wan_on_ping_timeout,
+        .on_ping_end = NULL,
+        .cb_args = (void*)(uintptr_t)index,
+    };
+    multi_wan_msg_t msg = {
+        .esp_netif = esp_netif,
+        .index = index,
+    };
+    esp_err_t ret = ESP_OK;
+
+    if (!ipaddr_aton(CONFIG_GATEWAY_MULTI_WAN_PROBE_HOST, &config.target_addr)) {
+        ESP_LOGE(TAG, "invalid probe host %s", CONFIG_GATEWAY_MULTI_WAN_PROBE_HOST);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    config.count = ESP_PING_COUNT_INFINITE;
+    config.interval_ms = CONFIG_GATEWAY_MULTI_WAN_PROBE_INTERVAL_MS;
+    config.timeout_ms = CONFIG_GATEWAY_MULTI_WAN_PROBE_TIMEOUT_MS;
+    config.interface = esp_netif_get_netif_impl_index(esp_netif);
+
+    ret = esp_ping_new_session(&config, &cbs, &msg.ping);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    tcpip_api_call(multi_wan_bind_probe, &msg.call);
+    if (msg.ret != ESP_OK) {
+        esp_ping_delete_session(msg.ping);
+        return msg.ret;
+    }
+
+    return esp_ping_start(msg.ping);
+}
+
+esp_err_t esp_gateway_multi_wan_add_uplink(esp_netif_t* esp_netif)
+{
+    multi_wan_msg_t msg = {
+        .esp_netif = esp_netif,
+        .index = ESP_GATEWAY_NAPT_UPLINK_NONE,
+    };
+
+    if (esp_netif_get_netif_impl(esp_netif) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    tcpip_api_call(multi_wan_add, &msg.call);
+    if (msg.ret != ESP_OK) {
+        ESP_LOGE(TAG, "add uplink fail(0x%x)", msg.ret);
+        return msg.ret;
+    }
+
+    /* Without probes, the uplink is only given up when its link goes down */
+    if (multi_wan_start_probe(esp_netif, msg.index) != ESP_OK) {
+        ESP_LOGW(TAG, "uplink %d probe start fail", msg.index);
+    }
+
+    ESP_LOGI(TAG, "uplink %d: %s", msg.index, esp_netif_get_desc(esp_netif));
+    return ESP_OK;
+}
+
+static err_t multi_wan_remove(struct tcpip_api_call_data* call)
+{
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        if (s_wan_policy && (s_uplinks[loop].esp_netif == msg->esp_netif)) {
+            msg->ping = s_uplinks[loop].ping;
+            memset(&s_uplinks[loop], 0, sizeof(multi_wan_uplink_t));
+            esp_gateway_wan_policy_remove(s_wan_policy, loop);
+            multi_wan_changed(loop, false);
+            break;
+        }
+    }
+
+    return ERR_OK;
+}
+
+esp_err_t esp_gateway_multi_wan_remove_uplink(esp_netif_t* esp_netif)
+{
+    multi_wan_msg_t msg = {
+        .esp_netif = esp_netif,
+    };
+
+    tcpip_api_call(multi_wan_remove, &msg.call);
+
+    if (msg.ping) {
+        esp_ping_stop(msg.ping);
+        esp_ping_delete_session(msg.ping);
+    }
+
+    return ESP_OK;
+}
+
+struct netif* esp_gateway_multi_wan_egress(esp_gateway_napt_mapping_t* mapping, struct netif* outp)
+{
+    esp_gateway_wan_uplink_t uplink;
+    struct netif* netif = NULL;
+    uint8_t index = ESP_GATEWAY_NAPT_UPLINK_NONE;
+
+    /* Only the flows routed to an uplink are balanced */
+    if ((s_wan_policy == NULL) || (esp_gateway_wan_policy_find(s_wan_policy, outp) == ESP_GATEWAY_NAPT_UPLINK_NONE)) {
+        return outp;
+    }
+
+    if (mapping->uplink == ESP_GATEWAY_NAPT_UPLINK_NONE) {
+        mapping->uplink = esp_gateway_wan_policy_select(s_wan_policy, &mapping->tuple);
+        if (mapping->uplink == ESP_GATEWAY_NAPT_UPLINK_NONE) {
+            /* No usable uplink, keep the choice of lwIP */
+            mapping->uplink = esp_gateway_wan_policy_find(s_wan_policy, outp);
+        }
+    }
+
+    index = mapping->uplink;
+    esp_gateway_wan_policy_get_uplink(s_wan_policy, index, &uplink);
+    netif = uplink.netif;
+    if ((netif == NULL) || !multi_wan_link_up(netif)) {
+        if (netif && esp_gateway_wan_policy_set_link(s_wan_policy, index, false, sys_now())) {
+            multi_wan_changed(index, false);
+        }
+        netif = NULL;
+    }
+
+    if (!esp_gateway_wan_policy_usable(s_wan_policy, index) && esp_gateway_wan_policy_any_usable(s_wan_policy)) {
+        return NULL;
+    }
+
+    return netif ? netif : outp;
+}
+
+void esp_gateway_multi_wan_too_big(esp_gateway_napt_mapping_t* mapping)
+{
+    if (mapping->uplink < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) {
+        s_uplinks[mapping->uplink].too_big++;
+    }
+}
+
+static err_t multi_wan_set_weight(struct tcpip_api_call_data* call)
+{
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+
+    msg->ret = ESP_ERR_NOT_FOUND;
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        if (s_wan_policy && msg->esp_netif && (s_uplinks[loop].esp_netif == msg->esp_netif)) {
+            msg->ret = esp_gateway_wan_policy_set_weight(s_wan_policy, loop, msg->weight);
+            break;
+        }
+    }
+
+    return ERR_OK;
+}
+
+esp_err_t esp_gateway_multi_wan_set_weight(esp_netif_t* esp_netif, uint8_t weight)
+{
+    multi_wan_msg_t msg = {
+        .esp_netif = esp_netif,
+        .weight = weight,
+    };
+
+    tcpip_api_call(multi_wan_set_weight, &msg.call);
+    return msg.ret;
+}
+
+static err_t multi_wan_read_stats(struct tcpip_api_call_data* call)
+{
+    multi_wan_msg_t* msg = (multi_wan_msg_t*)call;
+    esp_gateway_multi_wan_uplink_stats_t* stats = msg->stats;
+    uint32_t count = 0;
+
+    if (s_wan_policy == NULL) {
+        msg->ret = ESP_ERR_INVALID_STATE;
+        return ERR_OK;
+    }
+
+    for (uint8_t loop = 0; (loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) && (count < msg->num); loop++) {
+        esp_gateway_wan_uplink_t uplink;
+        esp_gateway_wan_policy_get_uplink(s_wan_policy, loop, &uplink);
+        if (uplink.netif == NULL) {
+            continue;
+        }
+
+        stats[count].netif = s_uplinks[loop].esp_netif;
+        stats[count].weight = uplink.weight;
+        stats[count].usable = esp_gateway_wan_policy_usable(s_wan_policy, loop);
+        stats[count].rtt_ms = uplink.rtt_ms;
+        stats[count].flows = uplink.flows;
+        stats[count].probes = uplink.probes;
+        stats[count].probes_lost = uplink.probes_lost;
+        stats[count].failovers = uplink.failovers;
+        stats[count].too_big = s_uplinks[loop].too_big;
+        count++;
+    }
+
+    msg->num = count;
+    msg->ret = ESP_OK;
+    return ERR_OK;
+}
+
+esp_err_t esp_gateway_multi_wan_get_stats(esp_gateway_multi_wan_uplink_stats_t* stats, uint32_t* num)
+{
+    multi_wan_msg_t msg = { 0 };
+
+    if ((stats == NULL) || (num == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    msg.stats = stats;
+    msg.num = *num;
+    tcpip_api_call(multi_wan_read_stats, &msg.call);
+    if (msg.ret == ESP_OK) {
+        *num = msg.num;
+    }
+
+    return msg.ret;
+}
@@ -0,0 +1,609 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_netif.h"
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+#include "lwip/icmp.h"
+#include "lwip/ip4_frag.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "lwip/prot/ip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/prot/udp.h"
+#include "lwip/prot/icmp.h"
+
+#include "esp_gateway.h"
+#include "esp_gateway_internal.h"
+#include "esp_gateway_napt_table.h"
+
+/*
+ * The lwIP NAPT hooks are redirected here with "-Wl,--wrap" (see CMakeLists.txt):
+ * ip4_forward() calls ip_napt_forward() for each packet routed out of a NAPT netif,
+ * and ip4_input() calls ip_napt_recv() for each packet sent to the address of a non-NAPT netif.
+ * The packets this engine can not translate are passed to the original lwIP functions, so are
+ * the port mappings of ip_portmap_add(), whose replies must keep the mapped outside port.
+ */
+
+#define GATEWAY_NAPT_EXPIRE_INTERVAL_MS     (1000)
+#define GATEWAY_NAPT_EXPIRE_MAX_SCAN        (32)
+
+static const char *TAG = "gateway_napt";
+
+static esp_gateway_napt_table_t* s_napt_table = NULL;
+static uint32_t s_napt_last_expire = 0;
+#if CONFIG_GATEWAY_FAST_PATH
+/* Mapping of the incoming packet going through ip4_input(), learned by the fast path if it is forwarded */
+static struct pbuf* s_recv_pbuf = NULL;
+static esp_gateway_napt_mapping_t* s_recv_mapping = NULL;
+#endif
+
+err_t __real_ip_napt_forward(struct pbuf* p, struct ip_hdr* iphdr, struct netif* inp, struct netif* outp);
+void __real_ip_napt_recv(struct pbuf* p, struct ip_hdr* iphdr);
+u8_t __real_ip_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport);
+u8_t __real_ip_portmap_remove(u8_t proto, u16_t mport);
+
+/* The table is only used from the TCP/IP task, the other tasks go through tcpip_api_call() */
+typedef struct {
+    struct tcpip_api_call_data call;
+    u8_t proto;
+    u8_t ret;
+    bool add;
+    u16_t mport;
+    u16_t dport;
+    u32_t maddr;
+    u32_t daddr;
+} napt_portmap_msg_t;
+
+typedef struct {
+    struct tcpip_api_call_data call;
+    esp_gateway_napt_table_t* table;
+    esp_gateway_napt_table_stats_t stats;
+} napt_table_msg_t;
+
+/* Incremental checksum update of RFC 1624, on 16-bit words as they are stored in the packet */
+static inline void napt_chksum_adjust16(u16_t* chksum, u16_t old_val, u16_t new_val)
+{
+    u32_t sum = (u16_t)~*chksum;
+
+    sum += (u16_t)~old_val;
+    sum += new_val;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *chksum = (u16_t)~sum;
+}
+
+static inline void napt_chksum_adjust32(u16_t* chksum, u32_t old_val, u32_t new_val)
+{
+    napt_chksum_adjust16(chksum, (u16_t)(old_val >> 16), (u16_t)(new_val >> 16));
+    napt_chksum_adjust16(chksum, (u16_t)old_val, (u16_t)new_val);
+}
+
+static inline void napt_udp_chksum_adjust(struct udp_hdr* udphdr, u32_t old_addr, u32_t new_addr, u16_t old_port, u16_t new_port)
+{
+    /* A zero UDP checksum means no checksum */
+    if (udphdr->chksum == 0) {
+        return;
+    }
+
+    napt_chksum_adjust32(&udphdr->chksum, old_addr, new_addr);
+    napt_chksum_adjust16(&udphdr->chksum, old_port, new_port);
+    if (udphdr->chksum == 0) {
+        udphdr->chksum = 0xFFFF;
+    }
+}
+
+/* Get the transport header of an unfragmented packet, it must be in the first pbuf */
+static void* napt_transport_header(struct pbuf* p, struct ip_hdr* iphdr, u16_t header_len)
+{
+    u16_t iphdr_len = IPH_HL_BYTES(iphdr);
+
+    if ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0) {
+        return NULL;
+    }
+
+    if (((u8_t*)iphdr + iphdr_len + header_len) > ((u8_t*)p->payload + p->len)) {
+        return NULL;
+    }
+
+    return (u8_t*)iphdr + iphdr_len;
+}
+
+static inline bool napt_tcp_closing(const struct tcp_hdr* tcphdr)
+{
+    return (TCPH_FLAGS(tcphdr) & (TCP_FIN | TCP_RST)) != 0;
+}
+
+static void napt_expire(uint32_t now)
+{
+    if ((uint32_t)(now - s_napt_last_expire) >= GATEWAY_NAPT_EXPIRE_INTERVAL_MS) {
+        s_napt_last_expire = now;
+        esp_gateway_napt_table_expire(s_napt_table, now, GATEWAY_NAPT_EXPIRE_MAX_SCAN);
+    }
+}
+
+/*
+ * Find or create the mapping of a packet going out, only TCP SYN open new TCP flows.
+ * egress is the netif routed by lwIP, and on return the netif the flow goes out of.
+ */
+static esp_gateway_napt_mapping_t* napt_outgoing_mapping(const esp_gateway_napt_tuple_t* tuple, bool create, uint32_t now, struct netif** egress)
+{
+    esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_lookup_inside(s_napt_table, tuple, now);
+
+#if CONFIG_GATEWAY_MULTI_WAN
+    if (mapping) {
+        struct netif* netif = esp_gateway_multi_wan_egress(mapping, *egress);
+        if (netif) {
+            *egress = netif;
+            return mapping;
+        }
+
+        /* The uplink of the flow failed, the flow starts again on another one */
+        esp_gateway_napt_table_remove(s_napt_table, mapping);
+        mapping = NULL;
+    }
+#endif
+
+    /* The replies of a port mapping keep the mapped port, lwIP translates them */
+    if ((mapping == NULL) && create && !esp_gateway_napt_table_portmap_match(s_napt_table, tuple)) {
+        mapping = esp_gateway_napt_table_insert(s_napt_table, tuple, now);
+        if (mapping == NULL) {
+            ESP_LOGD(TAG, "no port left for "IPSTR":%d", IP2STR((esp_ip4_addr_t*)&tuple->dest_addr), lwip_ntohs(tuple->dest_port));
+            return NULL;
+        }
+#if CONFIG_GATEWAY_MULTI_WAN
+        *egress = esp_gateway_multi_wan_egress(mapping, *egress);
+#endif
+    }
+
+    return mapping;
+}
+
+#if CONFIG_GATEWAY_MULTI_WAN
+/*
+ * ip4_forward() only checks the MTU of the netif it routed to. A packet balanced to another uplink
+ * with DF set is answered here, before its headers are translated, so that the sender finds its own
+ * addresses and ports in the ICMP error.
+ */
+static bool napt_egress_dont_fragment(struct pbuf* p, struct ip_hdr* iphdr, esp_gateway_napt_mapping_t* mapping,
+                                      struct netif* egress, struct netif* outp)
+{
+    if ((egress == outp) || !egress->mtu || (p->tot_len <= egress->mtu) || !(IPH_OFFSET(iphdr) & PP_HTONS(IP_DF))) {
+        return false;
+    }
+
+#if LWIP_ICMP
+    icmp_dest_unreach(p, ICMP_DUR_FRAG);
+#endif
+    esp_gateway_multi_wan_too_big(mapping);
+    return true;
+}
+#endif
+
+err_t __wrap_ip_napt_forward(struct pbuf* p, struct ip_hdr* iphdr, struct netif* inp, struct netif* outp)
+{
+    esp_gateway_napt_tuple_t tuple = { 0 };
+    esp_gateway_napt_mapping_t* mapping = NULL;
+    struct netif* egress = outp;
+    u32_t now = 0;
+    u32_t outside_addr = 0;
+    bool translate = (s_napt_table != NULL) && inp->napt;
+
+#if CONFIG_LITEMESH_ROUTED
+    /* The packets which stay in the mesh keep their addresses, the root only translates towards the router */
+    translate = translate && !outp->napt;
+#endif
+
+    if (!translate) {
+#if CONFIG_GATEWAY_FAST_PATH
+        /* Replies translated by ip_napt_recv(), or packets routed without translation */
+        if (__real_ip_napt_forward(p, iphdr, inp, outp) != ERR_OK) {
+            return ERR_RTE;
+        }
+        esp_gateway_fast_path_learn(p, outp, (s_recv_pbuf == p) ? s_recv_mapping : NULL);
+        s_recv_pbuf = NULL;
+        return ERR_OK;
+#else
+        return __real_ip_napt_forward(p, iphdr, inp, outp);
+#endif
+    }
+
+    now = sys_now();
+    napt_expire(now);
+    tuple.src_addr = iphdr->src.addr;
+    tuple.dest_addr = iphdr->dest.addr;
+
+    switch (IPH_PROTO(iphdr)) {
+    case IP_PROTO_TCP: {
+        struct tcp_hdr* tcphdr = napt_transport_header(p, iphdr, TCP_HLEN);
+        if (tcphdr == NULL) {
+            break;
+        }
+
+        tuple.proto = ESP_GATEWAY_NAPT_PROTO_TCP;
+        tuple.src_port = tcphdr->src;
+        tuple.dest_port = tcphdr->dest;
+        mapping = napt_outgoing_mapping(&tuple, (TCPH_FLAGS(tcphdr) & (TCP_SYN | TCP_ACK)) == TCP_SYN, now, &egress);
+        if (mapping == NULL) {
+            if (esp_gateway_napt_table_portmap_match(s_napt_table, &tuple)) {
+                break;
+            }
+            /* Without a flow, the remote host would only answer with a RST */
+            return ERR_RTE;
+        }
+#if CONFIG_GATEWAY_MULTI_WAN
+        if (napt_egress_dont_fragment(p, iphdr, mapping, egress, outp)) {
+            return ERR_RTE;
+        }
+#endif
+        outside_addr = netif_ip4_addr(egress)->addr;
+
+        if (napt_tcp_closing(tcphdr)) {
+            mapping->tcp_closing = true;
+        }
+        napt_chksum_adjust32(&tcphdr->chksum, iphdr->src.addr, outside_addr);
+        napt_chksum_adjust16(&tcphdr->chksum, tcphdr->src, mapping->mport);
+        tcphdr->src = mapping->mport;
+        goto translate_ip;
+    }
+
+    case IP_PROTO_UDP: {
+        struct udp_hdr* udphdr = napt_transport_header(p, iphdr, UDP_HLEN);
+        if (udphdr == NULL) {
+            break;
+        }
+
+        tuple.proto = ESP_GATEWAY_NAPT_PROTO_UDP;
+        tuple.src_port = udphdr->src;
+        tuple.dest_port = udphdr->dest;
+        mapping = napt_outgoing_mapping(&tuple, true, now, &egress);
+        if (mapping == NULL) {
+            if (esp_gateway_napt_table_portmap_match(s_napt_table, &tuple)) {
+                break;
+            }
+            return ERR_RTE;
+        }
+#if CONFIG_GATEWAY_MULTI_WAN
+        if (napt_egress_dont_fragment(p, iphdr, mapping, egress, outp)) {
+            return ERR_RTE;
+        }
+#endif
+        outside_addr = netif_ip4_addr(egress)->addr;
+
+        napt_udp_chksum_adjust(udphdr, iphdr->src.addr, outside_addr, udphdr->src, mapping->mport);
+        udphdr->src = mapping->mport;
+        goto translate_ip;
+    }
+
+    case IP_PROTO_ICMP: {
+        struct icmp_echo_hdr* icmphdr = napt_transport_header(p, iphdr, sizeof(struct icmp_echo_hdr));
+        if ((icmphdr == NULL) || (ICMPH_TYPE(icmphdr) != ICMP_ECHO)) {
+            break;
+        }
+
+        tuple.proto = ESP_GATEWAY_NAPT_PROTO_ICMP;
+        tuple.src_port = icmphdr->id;
+        mapping = napt_outgoing_mapping(&tuple, true, now, &egress);
+        if (mapping == NULL) {
+            return ERR_RTE;
+        }
+#if CONFIG_GATEWAY_MULTI_WAN
+        if (napt_egress_dont_fragment(p, iphdr, mapping, egress, outp)) {
+            return ERR_RTE;
+        }
+#endif
+        outside_addr = netif_ip4_addr(egress)->addr;
+
+        /* The ICMP checksum does not cover the IP header */
+        napt_chksum_adjust16(&icmphdr->chksum, icmphdr->id, mapping->mport);
+        icmphdr->id = mapping->mport;
+        goto translate_ip;
+    }
+
+    default:
+        break;
+    }
+
+    return __real_ip_napt_forward(p, iphdr, inp, outp);
+
+translate_ip:
+    napt_chksum_adjust32(&IPH_CHKSUM(iphdr), iphdr->src.addr, outside_addr);
+    iphdr->src.addr = outside_addr;
+#if CONFIG_GATEWAY_FAST_PATH
+    esp_gateway_fast_path_learn(p, egress, mapping);
+#endif
+
+#if CONFIG_GATEWAY_MULTI_WAN
+    if (egress != outp) {
+        /* ip4_forward() sends on the routed netif only, so send it here and have ip4_forward() stop */
+        ip4_addr_t dest;
+        ip4_addr_copy(dest, iphdr->dest);
+        if (!egress->mtu || (p->tot_len <= egress->mtu)) {
+            egress->output(egress, p, &dest);
+            return ERR_INPROGRESS;
+        }
+
+#if IP_FRAG
+        if (ip4_frag(p, egress, &dest) == ERR_OK) {
+            return ERR_INPROGRESS;
+        }
+#endif
+        esp_gateway_multi_wan_too_big(mapping);
+        return ERR_INPROGRESS;
+    }
+#endif
+
+    return ERR_OK;
+}
+
+void __wrap_ip_napt_recv(struct pbuf* p, struct ip_hdr* iphdr)
+{
+    esp_gateway_napt_mapping_t* mapping = NULL;
+    u32_t now = 0;
+
+    if (s_napt_table == NULL) {
+        __real_ip_napt_recv(p, iphdr);
+        return;
+    }
+
+    now = sys_now();
+
+    switch (IPH_PROTO(iphdr)) {
+    case IP_PROTO_TCP: {
+        struct tcp_hdr* tcphdr = napt_transport_header(p, iphdr, TCP_HLEN);
+        if (tcphdr == NULL) {
+            break;
+        }
+
+        mapping = esp_gateway_napt_table_lookup_outside(s_napt_table, ESP_GATEWAY_NAPT_PROTO_TCP, tcphdr->dest,
+                                                        iphdr->src.addr, tcphdr->src, now);
+        if (mapping == NULL) {
+            break;
+        }
+
+        if (napt_tcp_closing(tcphdr)) {
+            mapping->tcp_closing = true;
+        }
+        napt_chksum_adjust32(&tcphdr->chksum, iphdr->dest.addr, mapping->tuple.src_addr);
+        napt_chksum_adjust16(&tcphdr->chksum, tcphdr->dest, mapping->tuple.src_port);
+        tcphdr->dest = mapping->tuple.src_port;
+        goto translate_ip;
+    }
+
+    case IP_PROTO_UDP: {
+        struct udp_hdr* udphdr = napt_transport_header(p, iphdr, UDP_HLEN);
+        if (udphdr == NULL) {
+            break;
+        }
+
+        mapping = esp_gateway_napt_table_lookup_outside(s_napt_table, ESP_GATEWAY_NAPT_PROTO_UDP, udphdr->dest,
+                                                        iphdr->src.addr, udphdr->src, now);
+        if (mapping == NULL) {
+            break;
+        }
+
+        napt_udp_chksum_adjust(udphdr, iphdr->dest.addr, mapping->tuple.src_addr, udphdr->dest, mapping->tuple.src_port);
+        udphdr->dest = mapping->tuple.src_port;
+        goto translate_ip;
+    }
+
+    case IP_PROTO_ICMP: {
+        struct icmp_echo_hdr* icmphdr = napt_transport_header(p, iphdr, sizeof(struct icmp_echo_hdr));
+        if ((icmphdr == NULL) || (ICMPH_TYPE(icmphdr) != ICMP_ER)) {
+            break;
+        }
+
+        mapping = esp_gateway_napt_table_lookup_outside(s_napt_table, ESP_GATEWAY_NAPT_PROTO_ICMP, icmphdr->id,
+                                                        iphdr->src.addr, 0, now);
+        if (mapping == NULL) {
+            break;
+        }
+
+        napt_chksum_adjust16(&icmphdr->chksum, icmphdr->id, mapping->tuple.src_port);
+        icmphdr->id = mapping->tuple.src_port;
+        goto translate_ip;
+    }
+
+    default:
+        break;
+    }
+
+    /* Port mappings and fragments */
+    __real_ip_napt_recv(p, iphdr);
+    return;
+
+translate_ip:
+    napt_chksum_adjust32(&IPH_CHKSUM(iphdr), iphdr->dest.addr, mapping->tuple.src_addr);
+    iphdr->dest.addr = mapping->tuple.src_addr;
+#if CONFIG_GATEWAY_FAST_PATH
+    s_recv_pbuf = p;
+    s_recv_mapping = mapping;
+#endif
+}
+
+static err_t napt_portmap_update(struct tcpip_api_call_data* call)
+{
+    napt_portmap_msg_t* msg = (napt_portmap_msg_t*)call;
+    uint8_t proto = (msg->proto == IP_PROTO_TCP) ? ESP_GATEWAY_NAPT_PROTO_TCP : ESP_GATEWAY_NAPT_PROTO_UDP;
+
+    if (!msg->add) {
+        msg->ret = __real_ip_portmap_remove(msg->proto, msg->mport);
+        if (s_napt_table) {
+            esp_gateway_napt_table_portmap_remove(s_napt_table, proto, lwip_htons(msg->mport));
+        }
+#if CONFIG_GATEWAY_FAST_PATH
+        /* The fast path forwards the learned flows of the port mapping without asking lwIP again */
+        esp_gateway_fast_path_flush();
+#endif
+        return ERR_OK;
+    }
+
+    msg->ret = __real_ip_portmap_add(msg->proto, msg->maddr, msg->mport, msg->daddr, msg->dport);
+    if (msg->ret && s_napt_table
+        && (esp_gateway_napt_table_portmap_add(s_napt_table, proto, lwip_htons(msg->mport), msg->daddr, lwip_htons(msg->dport)) != ESP_OK)) {
+        /* The replies would get a mapping of their own */
+        ESP_LOGE(TAG, "no room for the port mapping of port %d", msg->mport);
+        __real_ip_portmap_remove(msg->proto, msg->mport);
+        msg->ret = 0;
+    }
+
+    return ERR_OK;
+}
+
+/* Ports are in host byte order, like the lwIP functions */
+u8_t __wrap_ip_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport)
+{
+    napt_portmap_msg_t msg = {
+        .proto = proto,
+        .add = true,
+        .mport = mport,
+        .dport = dport,
+        .maddr = maddr,
+        .daddr = daddr,
+    };
+
+    if ((proto != IP_PROTO_TCP) && (proto != IP_PROTO_UDP)) {
+        return __real_ip_portmap_add(proto, maddr, mport, daddr, dport);
+    }
+
+    tcpip_api_call(napt_portmap_update, &msg.call);
+    return msg.ret;
+}
+
+u8_t __wrap_ip_portmap_remove(u8_t proto, u16_t mport)
+{
+    napt_portmap_msg_t msg = {
+        .proto = proto,
+        .add = false,
+        .mport = mport,
+    };
+
+    if ((proto != IP_PROTO_TCP) && (proto != IP_PROTO_UDP)) {
+        return __real_ip_portmap_remove(proto, mport);
+    }
+
+    tcpip_api_call(napt_portmap_update, &msg.call);
+    return msg.ret;
+}
+
+#if CONFIG_GATEWAY_FAST_PATH
+void esp_gateway_napt_recv_done(void)
+{
+    s_recv_pbuf = NULL;
+    s_recv_mapping = NULL;
+}
+#endif
+
+bool esp_gateway_napt_mapping_refresh(esp_gateway_napt_mapping_t* mapping, uint32_t generation)
+{
+    u32_t now = sys_now();
+
+    if (s_napt_table == NULL) {
+        return false;
+    }
+
+    napt_expire(now);
+    return esp_gateway_napt_table_touch(s_napt_table, mapping, generation, now);
+}
+
+static err_t napt_table_publish(struct tcpip_api_call_data* call)
+{
+    s_napt_table = ((napt_table_msg_t*)call)->table;
+    return ERR_OK;
+}
+
+static err_t napt_table_read_stats(struct tcpip_api_call_data* call)
+{
+    napt_table_msg_t* msg = (napt_table_msg_t*)call;
+
+    esp_gateway_napt_table_get_stats(s_napt_table, &msg->stats);
+    return ERR_OK;
+}
+
+esp_err_t esp_gateway_napt_init(void)
+{
+    esp_gateway_napt_table_config_t config = {
+        .capacity = CONFIG_GATEWAY_NAPT_TABLE_SIZE,
+        .port_min = CONFIG_GATEWAY_NAPT_PORT_MIN,
+        .port_max = CONFIG_GATEWAY_NAPT_PORT_MAX,
+        .timeout_ms = {
+            [ESP_GATEWAY_NAPT_PROTO_TCP] = CONFIG_GATEWAY_NAPT_TCP_TIMEOUT_S * 1000UL,
+            [ESP_GATEWAY_NAPT_PROTO_UDP] = CONFIG_GATEWAY_NAPT_UDP_TIMEOUT_S * 1000UL,
+            [ESP_GATEWAY_NAPT_PROTO_ICMP] = CONFIG_GATEWAY_NAPT_ICMP_TIMEOUT_S * 1000UL,
+        },
+        .tcp_closing_timeout_ms = CONFIG_GATEWAY_NAPT_TCP_CLOSING_TIMEOUT_S * 1000UL,
+        .hash_seed = esp_random(),
+    };
+    esp_gateway_napt_table_t* table = NULL;
+    napt_table_msg_t msg = { 0 };
+
+    if (s_napt_table) {
+        return ESP_OK;
+    }
+
+    table = esp_gateway_napt_table_create(&config);
+    if (table == NULL) {
+        ESP_LOGE(TAG, "create NAPT table of %d flows fail", CONFIG_GATEWAY_NAPT_TABLE_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The hooks run in the TCP/IP task */
+    msg.table = table;
+    tcpip_api_call(napt_table_publish, &msg.call);
+
+    ESP_LOGI(TAG, "NAPT table of %d flows, outside ports %d-%d", CONFIG_GATEWAY_NAPT_TABLE_SIZE,
+             CONFIG_GATEWAY_NAPT_PORT_MIN, CONFIG_GATEWAY_NAPT_PORT_MAX);
+
+#if CONFIG_GATEWAY_FAST_PATH
+    return esp_gateway_fast_path_init();
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t esp_gateway_napt_get_stats(esp_gateway_napt_stats_t* stats)
+{
+    napt_table_msg_t msg = { 0 };
+
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_napt_table == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    tcpip_api_call(napt_table_read_stats, &msg.call);
+
+    stats->capacity = msg.stats.capacity;
+    stats->active = msg.stats.active;
+    stats->lookups = msg.stats.lookups;
+    stats->hits = msg.stats.hits;
+    stats->inserts = msg.stats.inserts;
+    stats->insert_failures = msg.stats.insert_failures;
+    stats->evictions = msg.stats.evictions;
+    stats->expirations = msg.stats.expirations;
+
+    return ESP_OK;
+}
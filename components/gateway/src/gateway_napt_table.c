@@ -0,0 +1,481 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_napt_table.h"
+
+#define NAPT_INVALID_INDEX          (0xFFFF)
+#define NAPT_PORT_MAX_ATTEMPTS      (64)
+
+#define napt_htons(x)               ((uint16_t)((((x) & 0xFF) << 8) | (((x) >> 8) & 0xFF)))
+
+typedef struct {
+    esp_gateway_napt_mapping_t mapping;     /* must be the first member */
+    uint16_t inside_next;
+    uint16_t outside_next;
+    uint16_t lru_prev;
+    uint16_t lru_next;
+} napt_entry_t;
+
+typedef struct {
+    uint32_t inside_addr;
+    uint16_t inside_port;
+    uint16_t mport;         /* 0 when the slot is free */
+    uint8_t proto;
+} napt_portmap_t;
+
+/*
+ * Every mapping is chained in two hash tables, indexed by the inside tuple and by the outside
+ * (port, remote endpoint), and in a LRU list whose head is the most recently used one.
+ * Free entries are chained through lru_next.
+ */
+struct esp_gateway_napt_table {
+    esp_gateway_napt_table_config_t config;
+    uint32_t bucket_mask;
+    uint16_t* inside_buckets;
+    uint16_t* outside_buckets;
+    napt_entry_t* entries;
+    uint16_t lru_head;
+    uint16_t lru_tail;
+    uint16_t free_head;
+    uint32_t generation;
+    uint32_t portmap_num;
+    napt_portmap_t portmaps[ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS];
+    esp_gateway_napt_table_stats_t stats;
+};
+
+static inline uint32_t napt_mix(uint32_t hash, uint32_t value)
+{
+    hash ^= value * 0xCC9E2D51UL;
+    hash = (hash << 13) | (hash >> 19);
+    return hash * 5 + 0xE6546B64UL;
+}
+
+static inline uint32_t napt_finalize(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BUL;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35UL;
+    return hash ^ (hash >> 16);
+}
+
+static inline uint32_t napt_inside_hash(const esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple)
+{
+    uint32_t hash = table->config.hash_seed;
+
+    hash = napt_mix(hash, tuple->src_addr);
+    hash = napt_mix(hash, tuple->dest_addr);
+    hash = napt_mix(hash, ((uint32_t)tuple->src_port << 16) | tuple->dest_port);
+    hash = napt_mix(hash, tuple->proto);
+
+    return napt_finalize(hash);
+}
+
+static inline uint32_t napt_outside_hash(const esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                         uint32_t remote_addr, uint16_t remote_port)
+{
+    uint32_t hash = ~table->config.hash_seed;
+
+    hash = napt_mix(hash, remote_addr);
+    hash = napt_mix(hash, ((uint32_t)mport << 16) | remote_port);
+    hash = napt_mix(hash, proto);
+
+    return napt_finalize(hash);
+}
+
+static inline bool napt_tuple_equal(const esp_gateway_napt_tuple_t* a, const esp_gateway_napt_tuple_t* b)
+{
+    return (a->src_addr == b->src_addr) && (a->dest_addr == b->dest_addr) && (a->src_port == b->src_port)
+           && (a->dest_port == b->dest_port) && (a->proto == b->proto);
+}
+
+static inline bool napt_expired(const esp_gateway_napt_table_t* table, const esp_gateway_napt_mapping_t* mapping, uint32_t now)
+{
+    uint32_t timeout = table->config.timeout_ms[mapping->tuple.proto];
+
+    if (mapping->tcp_closing && (mapping->tuple.proto == ESP_GATEWAY_NAPT_PROTO_TCP)) {
+        timeout = table->config.tcp_closing_timeout_ms;
+    }
+
+    return (uint32_t)(now - mapping->last_used) > timeout;
+}
+
+static void napt_lru_unlink(esp_gateway_napt_table_t* table, uint16_t index)
+{
+    napt_entry_t* entry = &table->entries[index];
+
+    if (entry->lru_prev != NAPT_INVALID_INDEX) {
+        table->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        table->lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next != NAPT_INVALID_INDEX) {
+        table->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        table->lru_tail = entry->lru_prev;
+    }
+}
+
+static void napt_lru_push_head(esp_gateway_napt_table_t* table, uint16_t index)
+{
+    napt_entry_t* entry = &table->entries[index];
+
+    entry->lru_prev = NAPT_INVALID_INDEX;
+    entry->lru_next = table->lru_head;
+    if (table->lru_head != NAPT_INVALID_INDEX) {
+        table->entries[table->lru_head].lru_prev = index;
+    } else {
+        table->lru_tail = index;
+    }
+    table->lru_head = index;
+}
+
+static void napt_chain_unlink(uint16_t* bucket, napt_entry_t* entries, uint16_t index, bool inside)
+{
+    uint16_t* link = bucket;
+
+    while (*link != NAPT_INVALID_INDEX) {
+        if (*link == index) {
+            *link = inside ? entries[index].inside_next : entries[index].outside_next;
+            return;
+        }
+        link = inside ? &entries[*link].inside_next : &entries[*link].outside_next;
+    }
+}
+
+static void napt_entry_free(esp_gateway_napt_table_t* table, uint16_t index)
+{
+    napt_entry_t* entry = &table->entries[index];
+    esp_gateway_napt_mapping_t* mapping = &entry->mapping;
+    uint32_t inside = napt_inside_hash(table, &mapping->tuple) & table->bucket_mask;
+    uint32_t outside = napt_outside_hash(table, mapping->tuple.proto, mapping->mport,
+                                         mapping->tuple.dest_addr, mapping->tuple.dest_port) & table->bucket_mask;
+
+    napt_chain_unlink(&table->inside_buckets[inside], table->entries, index, true);
+    napt_chain_unlink(&table->outside_buckets[outside], table->entries, index, false);
+    napt_lru_unlink(table, index);
+
+    mapping->generation = 0;
+    entry->lru_next = table->free_head;
+    table->free_head = index;
+    table->stats.active--;
+}
+
+static napt_entry_t* napt_find_outside(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                       uint32_t remote_addr, uint16_t remote_port)
+{
+    uint32_t bucket = napt_outside_hash(table, proto, mport, remote_addr, remote_port) & table->bucket_mask;
+
+    for (uint16_t index = table->outside_buckets[bucket]; index != NAPT_INVALID_INDEX; index = table->entries[index].outside_next) {
+        esp_gateway_napt_mapping_t* mapping = &table->entries[index].mapping;
+        if ((mapping->mport == mport) && (mapping->tuple.dest_addr == remote_addr)
+            && (mapping->tuple.dest_port == remote_port) && (mapping->tuple.proto == proto)) {
+            return &table->entries[index];
+        }
+    }
+
+    return NULL;
+}
+
+static napt_portmap_t* napt_find_portmap(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport)
+{
+    for (uint32_t loop = 0; loop < ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS; loop++) {
+        if ((table->portmaps[loop].mport == mport) && (table->portmaps[loop].proto == proto)) {
+            return &table->portmaps[loop];
+        }
+    }
+
+    return NULL;
+}
+
+/* Refresh a mapping found by a lookup, or drop it if it expired */
+static esp_gateway_napt_mapping_t* napt_lookup_result(esp_gateway_napt_table_t* table, napt_entry_t* entry, uint32_t now)
+{
+    uint16_t index = 0;
+
+    table->stats.lookups++;
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    index = entry - table->entries;
+    if (napt_expired(table, &entry->mapping, now)) {
+        napt_entry_free(table, index);
+        table->stats.expirations++;
+        return NULL;
+    }
+
+    entry->mapping.last_used = now;
+    if (table->lru_head != index) {
+        napt_lru_unlink(table, index);
+        napt_lru_push_head(table, index);
+    }
+    table->stats.hits++;
+
+    return &entry->mapping;
+}
+
+esp_gateway_napt_table_t* esp_gateway_napt_table_create(const esp_gateway_napt_table_config_t* config)
+{
+    esp_gateway_napt_table_t* table = NULL;
+    uint32_t bucket_num = 4;
+
+    if ((config == NULL) || (config->capacity == 0) || (config->capacity > ESP_GATEWAY_NAPT_TABLE_MAX_CAPACITY)
+        || (config->port_min == 0) || (config->port_min > config->port_max)) {
+        return NULL;
+    }
+
+    while (bucket_num < config->capacity) {
+        bucket_num <<= 1;
+    }
+
+    table = calloc(1, sizeof(esp_gateway_napt_table_t));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    table->inside_buckets = malloc(bucket_num * sizeof(uint16_t));
+    table->outside_buckets = malloc(bucket_num * sizeof(uint16_t));
+    table->entries = calloc(config->capacity, sizeof(napt_entry_t));
+    if ((table->inside_buckets == NULL) || (table->outside_buckets == NULL) || (table->entries == NULL)) {
+        esp_gateway_napt_table_delete(table);
+        return NULL;
+    }
+
+    table->config = *config;
+    table->bucket_mask = bucket_num - 1;
+    table->stats.capacity = config->capacity;
+    esp_gateway_napt_table_flush(table);
+
+    return table;
+}
+
+void esp_gateway_napt_table_delete(esp_gateway_napt_table_t* table)
+{
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->inside_buckets);
+    free(table->outside_buckets);
+    free(table->entries);
+    free(table);
+}
+
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_lookup_inside(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple, uint32_t now)
+{
+    uint32_t bucket = napt_inside_hash(table, tuple) & table->bucket_mask;
+    napt_entry_t* found = NULL;
+
+    for (uint16_t index = table->inside_buckets[bucket]; index != NAPT_INVALID_INDEX; index = table->entries[index].inside_next) {
+        if (napt_tuple_equal(&table->entries[index].mapping.tuple, tuple)) {
+            found = &table->entries[index];
+            break;
+        }
+    }
+
+    return napt_lookup_result(table, found, now);
+}
+
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_lookup_outside(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                                                  uint32_t remote_addr, uint16_t remote_port, uint32_t now)
+{
+    return napt_lookup_result(table, napt_find_outside(table, proto, mport, remote_addr, remote_port), now);
+}
+
+esp_gateway_napt_mapping_t* esp_gateway_napt_table_insert(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple, uint32_t now)
+{
+    uint32_t port_range = (uint32_t)table->config.port_max - table->config.port_min + 1;
+    uint32_t port_offset = napt_inside_hash(table, tuple) % port_range;
+    uint16_t mport = 0;
+    bool port_found = false;
+
+    /* Keep the inside port when possible, then probe from a hash of the tuple */
+    uint16_t src_port = napt_htons(tuple->src_port);
+    if ((src_port >= table->config.port_min) && (src_port <= table->config.port_max)) {
+        port_offset = src_port - table->config.port_min;
+    }
+
+    for (uint32_t attempt = 0; (attempt < NAPT_PORT_MAX_ATTEMPTS) && (attempt < port_range); attempt++) {
+        mport = napt_htons(table->config.port_min + (port_offset + attempt) % port_range);
+        if (table->portmap_num && napt_find_portmap(table, tuple->proto, mport)) {
+            continue;
+        }
+        napt_entry_t* entry = napt_find_outside(table, tuple->proto, mport, tuple->dest_addr, tuple->dest_port);
+        if ((entry == NULL) || napt_expired(table, &entry->mapping, now)) {
+            if (entry) {
+                napt_entry_free(table, entry - table->entries);
+                table->stats.expirations++;
+            }
+            port_found = true;
+            break;
+        }
+    }
+
+    if (!port_found) {
+        table->stats.insert_failures++;
+        return NULL;
+    }
+
+    if (table->free_head == NAPT_INVALID_INDEX) {
+        uint16_t victim = table->lru_tail;
+        if (napt_expired(table, &table->entries[victim].mapping, now)) {
+            table->stats.expirations++;
+        } else {
+            table->stats.evictions++;
+        }
+        napt_entry_free(table, victim);
+    }
+
+    uint16_t index = table->free_head;
+    napt_entry_t* entry = &table->entries[index];
+    uint32_t inside = napt_inside_hash(table, tuple) & table->bucket_mask;
+    uint32_t outside = napt_outside_hash(table, tuple->proto, mport, tuple->dest_addr, tuple->dest_port) & table->bucket_mask;
+
+    table->free_head = entry->lru_next;
+    memset(&entry->mapping, 0, sizeof(entry->mapping));
+    entry->mapping.tuple = *tuple;
+    entry->mapping.mport = mport;
+    entry->mapping.uplink = ESP_GATEWAY_NAPT_UPLINK_NONE;
+    entry->mapping.last_used = now;
+    if (++table->generation == 0) {
+        table->generation = 1;
+    }
+    entry->mapping.generation = table->generation;
+
+    entry->inside_next = table->inside_buckets[inside];
+    table->inside_buckets[inside] = index;
+    entry->outside_next = table->outside_buckets[outside];
+    table->outside_buckets[outside] = index;
+    napt_lru_push_head(table, index);
+
+    table->stats.active++;
+    table->stats.inserts++;
+
+    return &entry->mapping;
+}
+
+bool esp_gateway_napt_table_touch(esp_gateway_napt_table_t* table, esp_gateway_napt_mapping_t* mapping, uint32_t generation, uint32_t now)
+{
+    uint16_t index = (napt_entry_t*)mapping - table->entries;
+
+    if ((generation == 0) || (mapping->generation != generation)) {
+        return false;
+    }
+
+    mapping->last_used = now;
+    if (table->lru_head != index) {
+        napt_lru_unlink(table, index);
+        napt_lru_push_head(table, index);
+    }
+
+    return true;
+}
+
+void esp_gateway_napt_table_remove(esp_gateway_napt_table_t* table, esp_gateway_napt_mapping_t* mapping)
+{
+    napt_entry_free(table, (napt_entry_t*)mapping - table->entries);
+}
+
+uint32_t esp_gateway_napt_table_expire(esp_gateway_napt_table_t* table, uint32_t now, uint32_t max_scan)
+{
+    uint16_t index = table->lru_tail;
+    uint32_t expired = 0;
+
+    for (uint32_t loop = 0; (loop < max_scan) && (index != NAPT_INVALID_INDEX); loop++) {
+        uint16_t prev = table->entries[index].lru_prev;
+        if (napt_expired(table, &table->entries[index].mapping, now)) {
+            napt_entry_free(table, index);
+            expired++;
+        }
+        index = prev;
+    }
+    table->stats.expirations += expired;
+
+    return expired;
+}
+
+void esp_gateway_napt_table_flush(esp_gateway_napt_table_t* table)
+{
+    memset(table->inside_buckets, 0xFF, (table->bucket_mask + 1) * sizeof(uint16_t));
+    memset(table->outside_buckets, 0xFF, (table->bucket_mask + 1) * sizeof(uint16_t));
+
+    for (uint32_t index = 0; index < table->config.capacity; index++) {
+        table->entries[index].lru_next = (index + 1 < table->config.capacity) ? index + 1 : NAPT_INVALID_INDEX;
+        table->entries[index].mapping.generation = 0;
+    }
+    table->free_head = 0;
+    table->lru_head = NAPT_INVALID_INDEX;
+    table->lru_tail = NAPT_INVALID_INDEX;
+    table->stats.active = 0;
+}
+
+esp_err_t esp_gateway_napt_table_portmap_add(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport,
+                                             uint32_t inside_addr, uint16_t inside_port)
+{
+    napt_portmap_t* portmap = NULL;
+
+    if (((proto != ESP_GATEWAY_NAPT_PROTO_TCP) && (proto != ESP_GATEWAY_NAPT_PROTO_UDP)) || (mport == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portmap = napt_find_portmap(table, proto, mport);
+    if (portmap == NULL) {
+        /* A free slot has a zero outside port */
+        portmap = napt_find_portmap(table, 0, 0);
+        if (portmap == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        table->portmap_num++;
+    }
+
+    portmap->proto = proto;
+    portmap->mport = mport;
+    portmap->inside_addr = inside_addr;
+    portmap->inside_port = inside_port;
+
+    return ESP_OK;
+}
+
+void esp_gateway_napt_table_portmap_remove(esp_gateway_napt_table_t* table, uint8_t proto, uint16_t mport)
+{
+    napt_portmap_t* portmap = (mport != 0) ? napt_find_portmap(table, proto, mport) : NULL;
+
+    if (portmap) {
+        memset(portmap, 0, sizeof(napt_portmap_t));
+        table->portmap_num--;
+    }
+}
+
+bool esp_gateway_napt_table_portmap_match(esp_gateway_napt_table_t* table, const esp_gateway_napt_tuple_t* tuple)
+{
+    for (uint32_t loop = 0; (loop < ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS) && table->portmap_num; loop++) {
+        const napt_portmap_t* portmap = &table->portmaps[loop];
+        if (portmap->mport && (portmap->proto == tuple->proto)
+            && (portmap->inside_addr == tuple->src_addr) && (portmap->inside_port == tuple->src_port)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void esp_gateway_napt_table_get_stats(esp_gateway_napt_table_t* table, esp_gateway_napt_table_stats_t* stats)
+{
+    *stats = table->stats;
+}
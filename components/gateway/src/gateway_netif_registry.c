@@ -0,0 +1,328 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_gateway_netif_registry.h"
+
+#define REGISTRY_INDEX_EMPTY    (-1)
+
+/*
+ * Readers never take the lock: they copy what they need and retry when the sequence
+ * number was odd (a writer is in progress) or has changed meanwhile.
+ */
+struct esp_gateway_netif_registry {
+    portMUX_TYPE lock;
+    volatile uint32_t seq;
+    uint32_t capacity;
+    uint32_t index_mask;
+    uint32_t add_order;
+    uint64_t used_mask;
+    uint64_t role_mask[ESP_GATEWAY_NETIF_ROLE_MAX];
+    uint32_t* order;                    /* add order of each slot, to iterate like the former list */
+    int8_t* index;                      /* open addressing table, netif handle -> slot */
+    esp_gateway_netif_entry_t* entries;
+};
+
+static inline uint32_t registry_hash(esp_netif_t* netif)
+{
+    uint32_t key = (uint32_t)((uintptr_t)netif >> 2);
+    return key * 2654435761UL;
+}
+
+static inline uint32_t registry_read_begin(const esp_gateway_netif_registry_t* registry)
+{
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&registry->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+
+    return seq;
+}
+
+static inline bool registry_read_retry(const esp_gateway_netif_registry_t* registry, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&registry->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void registry_write_begin(esp_gateway_netif_registry_t* registry)
+{
+    portENTER_CRITICAL(&registry->lock);
+    __atomic_store_n(&registry->seq, registry->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void registry_write_end(esp_gateway_netif_registry_t* registry)
+{
+    __atomic_store_n(&registry->seq, registry->seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&registry->lock);
+}
+
+/* Return the index position of the netif, or of the empty position where it should be inserted */
+static uint32_t registry_index_probe(const esp_gateway_netif_registry_t* registry, esp_netif_t* netif, bool* found)
+{
+    uint32_t pos = registry_hash(netif) & registry->index_mask;
+
+    for (uint32_t loop = 0; loop <= registry->index_mask; loop++) {
+        int8_t slot = registry->index[pos];
+        if (slot == REGISTRY_INDEX_EMPTY) {
+            break;
+        }
+        /* The slot may be torn while a writer is running, the caller will retry */
+        if ((uint32_t)slot < registry->capacity && registry->entries[(uint8_t)slot].netif == netif) {
+            *found = true;
+            return pos;
+        }
+        pos = (pos + 1) & registry->index_mask;
+    }
+
+    *found = false;
+    return pos;
+}
+
+/* Backward shift deletion keeps the probe sequences intact without tombstones */
+static void registry_index_delete(esp_gateway_netif_registry_t* registry, uint32_t pos)
+{
+    uint32_t next = pos;
+
+    registry->index[pos] = REGISTRY_INDEX_EMPTY;
+    while (1) {
+        next = (next + 1) & registry->index_mask;
+        int8_t slot = registry->index[next];
+        if (slot == REGISTRY_INDEX_EMPTY) {
+            break;
+        }
+
+        uint32_t home = registry_hash(registry->entries[(uint8_t)slot].netif) & registry->index_mask;
+        /* Move the entry back if its home position is not cyclically in (pos, next] */
+        if (((next - home) & registry->index_mask) >= ((next - pos) & registry->index_mask)) {
+            registry->index[pos] = slot;
+            registry->index[next] = REGISTRY_INDEX_EMPTY;
+            pos = next;
+        }
+    }
+}
+
+esp_gateway_netif_registry_t* esp_gateway_netif_registry_create(uint32_t capacity)
+{
+    esp_gateway_netif_registry_t* registry = NULL;
+    uint32_t index_size = 4;
+
+    if ((capacity == 0) || (capacity > ESP_GATEWAY_NETIF_REGISTRY_MAX_CAPACITY)) {
+        return NULL;
+    }
+
+    /* Keep the load factor of the index below 50% */
+    while (index_size < capacity * 2) {
+        index_size <<= 1;
+    }
+
+    registry = calloc(1, sizeof(esp_gateway_netif_registry_t));
+    if (registry == NULL) {
+        return NULL;
+    }
+
+    registry->entries = calloc(capacity, sizeof(esp_gateway_netif_entry_t));
+    registry->order = calloc(capacity, sizeof(uint32_t));
+    registry->index = malloc(index_size);
+    if ((registry->entries == NULL) || (registry->order == NULL) || (registry->index == NULL)) {
+        esp_gateway_netif_registry_delete(registry);
+        return NULL;
+    }
+
+    memset(registry->index, REGISTRY_INDEX_EMPTY, index_size);
+    registry->capacity = capacity;
+    registry->index_mask = index_size - 1;
+    portMUX_INITIALIZE(&registry->lock);
+
+    return registry;
+}
+
+void esp_gateway_netif_registry_delete(esp_gateway_netif_registry_t* registry)
+{
+    if (registry == NULL) {
+        return;
+    }
+
+    free(registry->entries);
+    free(registry->order);
+    free(registry->index);
+    free(registry);
+}
+
+esp_err_t esp_gateway_netif_registry_add(esp_gateway_netif_registry_t* registry, const esp_gateway_netif_entry_t* entry)
+{
+    esp_err_t ret = ESP_OK;
+    bool found = false;
+
+    if ((registry == NULL) || (entry == NULL) || (entry->netif == NULL) || (entry->role >= ESP_GATEWAY_NETIF_ROLE_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    registry_write_begin(registry);
+    uint32_t pos = registry_index_probe(registry, entry->netif, &found);
+    if (found) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (registry->used_mask == ((registry->capacity == 64) ? UINT64_MAX : ((1ULL << registry->capacity) - 1))) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        uint8_t slot = __builtin_ctzll(~registry->used_mask);
+        registry->entries[slot] = *entry;
+        registry->order[slot] = registry->add_order++;
+        registry->index[pos] = slot;
+        registry->used_mask |= 1ULL << slot;
+        registry->role_mask[entry->role] |= 1ULL << slot;
+    }
+    registry_write_end(registry);
+
+    return ret;
+}
+
+esp_err_t esp_gateway_netif_registry_remove(esp_gateway_netif_registry_t* registry, esp_netif_t* netif, esp_gateway_netif_entry_t* removed)
+{
+    esp_err_t ret = ESP_OK;
+    bool found = false;
+
+    if (registry == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    registry_write_begin(registry);
+    uint32_t pos = registry_index_probe(registry, netif, &found);
+    if (!found) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        uint8_t slot = registry->index[pos];
+        esp_gateway_netif_entry_t* entry = &registry->entries[slot];
+
+        if (removed) {
+            *removed = *entry;
+        }
+        registry->role_mask[entry->role] &= ~(1ULL << slot);
+        registry->used_mask &= ~(1ULL << slot);
+        registry_index_delete(registry, pos);
+        memset(entry, 0, sizeof(*entry));
+    }
+    registry_write_end(registry);
+
+    return ret;
+}
+
+esp_err_t esp_gateway_netif_registry_update(esp_gateway_netif_registry_t* registry, esp_netif_t* netif,
+                                            const esp_netif_ip_info_t* ip_info, const uint8_t mac[6],
+                                            esp_gateway_netif_entry_t* previous)
+{
+    esp_err_t ret = ESP_OK;
+    bool found = false;
+
+    if (registry == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    registry_write_begin(registry);
+    uint32_t pos = registry_index_probe(registry, netif, &found);
+    if (!found) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        esp_gateway_netif_entry_t* entry = &registry->entries[(uint8_t)registry->index[pos]];
+
+        if (previous) {
+            *previous = *entry;
+        }
+        if (ip_info) {
+                entry->ip_info = *ip_info;
+            }
+        if (mac) {
+            memcpy(entry->mac, mac, sizeof(entry->mac));
+        }
+    }
+    registry_write_end(registry);
+
+    return ret;
+}
+
+bool esp_gateway_netif_registry_find(esp_gateway_netif_registry_t* registry, esp_netif_t* netif, esp_gateway_netif_entry_t* entry)
+{
+    esp_gateway_netif_entry_t copy;
+    uint32_t seq;
+    bool found;
+
+    if ((registry == NULL) || (netif == NULL)) {
+        return false;
+    }
+
+    do {
+        seq = registry_read_begin(registry);
+        uint32_t pos = registry_index_probe(registry, netif, &found);
+        if (found) {
+            copy = registry->entries[(uint8_t)registry->index[pos]];
+        }
+    } while (registry_read_retry(registry, seq));
+
+    if (found && entry) {
+        *entry = copy;
+    }
+
+    return found;
+}
+
+uint32_t esp_gateway_netif_registry_snapshot(esp_gateway_netif_registry_t* registry, uint32_t role_mask,
+                                             esp_gateway_netif_entry_t* entries, uint32_t max_num)
+{
+    uint8_t slots[ESP_GATEWAY_NETIF_REGISTRY_MAX_CAPACITY];
+    uint32_t count;
+    uint32_t seq;
+
+    if ((registry == NULL) || (entries == NULL) || (max_num == 0)) {
+        return 0;
+    }
+
+    do {
+        uint64_t mask = 0;
+        seq = registry_read_begin(registry);
+
+        for (uint32_t role = 0; role < ESP_GATEWAY_NETIF_ROLE_MAX; role++) {
+            if (role_mask & ESP_GATEWAY_NETIF_ROLE_BIT(role)) {
+                mask |= registry->role_mask[role];
+            }
+        }
+
+        /* Insertion sort by add order, the registry holds at most 64 netifs */
+        count = 0;
+        while (mask) {
+            uint8_t slot = __builtin_ctzll(mask);
+            uint32_t pos = count++;
+            mask &= mask - 1;
+
+            while ((pos > 0) && (registry->order[slots[pos - 1]] > registry->order[slot])) {
+                slots[pos] = slots[pos - 1];
+                pos--;
+            }
+            slots[pos] = slot;
+        }
+
+        if (count > max_num) {
+            count = max_num;
+        }
+        for (uint32_t loop = 0; loop < count; loop++) {
+            entries[loop] = registry->entries[slots[loop]];
+        }
+    } while (registry_read_retry(registry, seq));
+
+    return count;
+}
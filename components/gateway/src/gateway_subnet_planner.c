@@ -0,0 +1,101 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "esp_gateway_subnet_planner.h"
+
+/* Two networks overlap when they are equal under the shorter of the two masks */
+static bool subnet_plan_overlap(const esp_netif_ip_info_t* a, const esp_netif_ip_info_t* b)
+{
+    uint32_t mask = a->netmask.addr & b->netmask.addr;
+    return ((a->ip.addr ^ b->ip.addr) & mask) == 0;
+}
+
+esp_err_t esp_gateway_subnet_plan(const esp_gateway_subnet_pool_config_t* config,
+                                  const esp_netif_ip_info_t* occupied, uint32_t occupied_num,
+                                  esp_gateway_subnet_plan_item_t* items, uint32_t item_num)
+{
+    esp_err_t ret = ESP_OK;
+    esp_gateway_subnet_pool_t* pool = NULL;
+
+    if ((config == NULL) || ((occupied == NULL) && occupied_num) || ((items == NULL) && item_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pool = esp_gateway_subnet_pool_create(config);
+    if (pool == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t loop = 0; loop < occupied_num; loop++) {
+        esp_gateway_subnet_pool_ref(pool, occupied[loop].ip);
+    }
+
+    /* First pass, keep every subnet which does not conflict, earlier netifs win */
+    for (uint32_t loop = 0; loop < item_num; loop++) {
+        esp_gateway_subnet_plan_item_t* item = &items[loop];
+        bool conflict = (item->current.ip.addr == 0);
+
+        for (uint32_t index = 0; !conflict && (index < occupied_num); index++) {
+            conflict = subnet_plan_overlap(&item->current, &occupied[index]);
+        }
+        for (uint32_t index = 0; !conflict && (index < loop); index++) {
+            conflict = !items[index].changed && subnet_plan_overlap(&item->current, &items[index].current);
+        }
+
+        item->planned = item->current;
+        item->changed = conflict;
+        if (!conflict) {
+            esp_gateway_subnet_pool_ref(pool, item->current.ip);
+        }
+    }
+
+    /* Second pass, move the conflicting ones to the lowest free subnets */
+    for (uint32_t loop = 0; loop < item_num; loop++) {
+        esp_gateway_subnet_plan_item_t* item = &items[loop];
+
+        if (!item->changed) {
+            continue;
+        }
+
+        while ((ret = esp_gateway_subnet_pool_alloc(pool, &item->planned)) == ESP_OK) {
+            bool conflict = false;
+
+            /* An occupied network may be wider than a subnet of the pool */
+            for (uint32_t index = 0; !conflict && (index < occupied_num); index++) {
+                conflict = subnet_plan_overlap(&item->planned, &occupied[index]);
+            }
+            esp_gateway_subnet_pool_ref(pool, item->planned.ip);
+            if (!conflict) {
+                break;
+            }
+        }
+
+        if (ret != ESP_OK) {
+            break;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        for (uint32_t loop = 0; loop < item_num; loop++) {
+            items[loop].planned = items[loop].current;
+            items[loop].changed = false;
+        }
+    }
+
+    esp_gateway_subnet_pool_delete(pool);
+
+    return ret;
+}
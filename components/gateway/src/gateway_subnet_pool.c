@@ -0,0 +1,222 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_gateway_subnet_pool.h"
+
+#define SUBNET_POOL_WORD_BITS       (32)
+#define SUBNET_POOL_WORD_FULL       (0xFFFFFFFFUL)
+#define SUBNET_POOL_SUMMARY_WORDS   (ESP_GATEWAY_SUBNET_POOL_MAX_SUBNETS / SUBNET_POOL_WORD_BITS / SUBNET_POOL_WORD_BITS)
+
+/*
+ * A bit is set in the bitmap when the subnet is referenced or reserved,
+ * and a bit is set in the summary when all the 32 subnets of a bitmap word are set,
+ * so the lowest free subnet is found with two count-trailing-zeros.
+ */
+struct esp_gateway_subnet_pool {
+    portMUX_TYPE lock;
+    uint32_t base;              /* host byte order */
+    uint32_t mask;              /* host byte order */
+    uint32_t subnet_mask;       /* host byte order */
+    uint8_t shift;
+    uint16_t first_index;
+    uint32_t subnet_num;
+    uint32_t free_num;
+    uint32_t summary[SUBNET_POOL_SUMMARY_WORDS];
+    uint32_t* bitmap;
+    uint8_t* refcnt;
+};
+
+static inline uint32_t prefix_to_mask(uint8_t prefix_len)
+{
+    return prefix_len ? (SUBNET_POOL_WORD_FULL << (32 - prefix_len)) : 0;
+}
+
+static bool subnet_pool_index(const esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip, uint32_t* index)
+{
+    uint32_t addr = esp_netif_htonl(ip.addr);
+
+    if ((addr & pool->mask) != pool->base) {
+        return false;
+    }
+
+    *index = (addr - pool->base) >> pool->shift;
+    return true;
+}
+
+static void subnet_pool_set_bit(esp_gateway_subnet_pool_t* pool, uint32_t index)
+{
+    uint32_t word = index / SUBNET_POOL_WORD_BITS;
+
+    pool->bitmap[word] |= 1UL << (index % SUBNET_POOL_WORD_BITS);
+    if (pool->bitmap[word] == SUBNET_POOL_WORD_FULL) {
+        pool->summary[word / SUBNET_POOL_WORD_BITS] |= 1UL << (word % SUBNET_POOL_WORD_BITS);
+    }
+}
+
+static void subnet_pool_clear_bit(esp_gateway_subnet_pool_t* pool, uint32_t index)
+{
+    uint32_t word = index / SUBNET_POOL_WORD_BITS;
+
+    pool->bitmap[word] &= ~(1UL << (index % SUBNET_POOL_WORD_BITS));
+    pool->summary[word / SUBNET_POOL_WORD_BITS] &= ~(1UL << (word % SUBNET_POOL_WORD_BITS));
+}
+
+esp_gateway_subnet_pool_t* esp_gateway_subnet_pool_create(const esp_gateway_subnet_pool_config_t* config)
+{
+    esp_gateway_subnet_pool_t* pool = NULL;
+
+    if ((config == NULL) || (config->subnet_prefix_len > 30) || (config->prefix_len >= config->subnet_prefix_len)
+        || ((1UL << (config->subnet_prefix_len - config->prefix_len)) > ESP_GATEWAY_SUBNET_POOL_MAX_SUBNETS)) {
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(esp_gateway_subnet_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->subnet_num = 1UL << (config->subnet_prefix_len - config->prefix_len);
+    pool->bitmap = calloc((pool->subnet_num + SUBNET_POOL_WORD_BITS - 1) / SUBNET_POOL_WORD_BITS, sizeof(uint32_t));
+    pool->refcnt = calloc(pool->subnet_num, sizeof(uint8_t));
+    if ((pool->bitmap == NULL) || (pool->refcnt == NULL)) {
+        esp_gateway_subnet_pool_delete(pool);
+        return NULL;
+    }
+
+    portMUX_INITIALIZE(&pool->lock);
+    pool->mask = prefix_to_mask(config->prefix_len);
+    pool->subnet_mask = prefix_to_mask(config->subnet_prefix_len);
+    pool->base = esp_netif_htonl(config->base.addr) & pool->mask;
+    pool->shift = 32 - config->subnet_prefix_len;
+    pool->first_index = config->first_index;
+    pool->free_num = pool->subnet_num;
+
+    /* Bits past the end of the pool look used, so the search never returns them */
+    uint32_t bit_num = ((pool->subnet_num + SUBNET_POOL_WORD_BITS - 1) / SUBNET_POOL_WORD_BITS) * SUBNET_POOL_WORD_BITS;
+    memset(pool->summary, 0xFF, sizeof(pool->summary));
+    for (uint32_t word = 0; word < bit_num / SUBNET_POOL_WORD_BITS; word++) {
+        pool->summary[word / SUBNET_POOL_WORD_BITS] &= ~(1UL << (word % SUBNET_POOL_WORD_BITS));
+    }
+    for (uint32_t index = pool->subnet_num; index < bit_num; index++) {
+        subnet_pool_set_bit(pool, index);
+    }
+
+    for (uint32_t index = 0; (index < pool->first_index) && (index < pool->subnet_num); index++) {
+        subnet_pool_set_bit(pool, index);
+        pool->free_num--;
+    }
+
+    return pool;
+}
+
+void esp_gateway_subnet_pool_delete(esp_gateway_subnet_pool_t* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    free(pool->bitmap);
+    free(pool->refcnt);
+    free(pool);
+}
+
+bool esp_gateway_subnet_pool_ref(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip)
+{
+    uint32_t index = 0;
+
+    if ((pool == NULL) || !subnet_pool_index(pool, ip, &index)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&pool->lock);
+    if (pool->refcnt[index] != UINT8_MAX) {
+        if ((pool->refcnt[index]++ == 0) && (index >= pool->first_index)) {
+            subnet_pool_set_bit(pool, index);
+            pool->free_num--;
+        }
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    return true;
+}
+
+bool esp_gateway_subnet_pool_unref(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip)
+{
+    uint32_t index = 0;
+
+    if ((pool == NULL) || !subnet_pool_index(pool, ip, &index)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&pool->lock);
+    if (pool->refcnt[index]) {
+        if ((--pool->refcnt[index] == 0) && (index >= pool->first_index)) {
+            subnet_pool_clear_bit(pool, index);
+            pool->free_num++;
+        }
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    return true;
+}
+
+bool esp_gateway_subnet_pool_is_used(esp_gateway_subnet_pool_t* pool, esp_ip4_addr_t ip)
+{
+    uint32_t index = 0;
+
+    if ((pool == NULL) || !subnet_pool_index(pool, ip, &index)) {
+        return false;
+    }
+
+    return (pool->bitmap[index / SUBNET_POOL_WORD_BITS] >> (index % SUBNET_POOL_WORD_BITS)) & 1;
+}
+
+esp_err_t esp_gateway_subnet_pool_alloc(esp_gateway_subnet_pool_t* pool, esp_netif_ip_info_t* ip_info)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    if ((pool == NULL) || (ip_info == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&pool->lock);
+    for (uint32_t loop = 0; loop < SUBNET_POOL_SUMMARY_WORDS; loop++) {
+        if (pool->summary[loop] == SUBNET_POOL_WORD_FULL) {
+            continue;
+        }
+
+        uint32_t word = loop * SUBNET_POOL_WORD_BITS + __builtin_ctz(~pool->summary[loop]);
+        uint32_t index = word * SUBNET_POOL_WORD_BITS + __builtin_ctz(~pool->bitmap[word]);
+        uint32_t addr = pool->base + (index << pool->shift);
+
+        ip_info->ip.addr = esp_netif_htonl(addr + 1);
+        ip_info->gw.addr = ip_info->ip.addr;
+        ip_info->netmask.addr = esp_netif_htonl(pool->subnet_mask);
+        ret = ESP_OK;
+        break;
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    return ret;
+}
+
+uint32_t esp_gateway_subnet_pool_free_count(esp_gateway_subnet_pool_t* pool)
+{
+    return pool ? pool->free_num : 0;
+}
@@ -0,0 +1,271 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_gateway_wan_policy.h"
+
+typedef struct {
+    esp_gateway_wan_uplink_t info;
+    uint8_t fail_streak;
+    uint8_t success_streak;
+} wan_uplink_t;
+
+struct esp_gateway_wan_policy {
+    esp_gateway_wan_policy_config_t config;
+    wan_uplink_t uplinks[ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS];
+};
+
+static inline uint32_t wan_hash_mix(uint32_t hash)
+{
+    /* Finalizer of MurmurHash3 */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BUL;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35UL;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static uint32_t wan_flow_hash(const esp_gateway_wan_policy_t* policy, const esp_gateway_napt_tuple_t* tuple)
+{
+    uint32_t hash = policy->config.hash_seed;
+
+    hash = wan_hash_mix(hash ^ tuple->src_addr);
+    hash = wan_hash_mix(hash ^ tuple->dest_addr);
+    hash = wan_hash_mix(hash ^ (((uint32_t)tuple->src_port << 16) | tuple->dest_port));
+
+    return wan_hash_mix(hash ^ tuple->proto);
+}
+
+static inline bool wan_uplink_usable(const wan_uplink_t* uplink)
+{
+    return uplink->info.netif && uplink->info.link_up && uplink->info.healthy;
+}
+
+/* Update the counters when the uplink became usable or unusable */
+static bool wan_uplink_changed(wan_uplink_t* uplink, bool was_usable, uint32_t now)
+{
+    bool usable = wan_uplink_usable(uplink);
+
+    if (usable == was_usable) {
+        return false;
+    }
+
+    if (!usable) {
+        uplink->info.failovers++;
+    }
+    uplink->info.last_change_ms = now;
+
+    return true;
+}
+
+esp_gateway_wan_policy_t* esp_gateway_wan_policy_create(const esp_gateway_wan_policy_config_t* config)
+{
+    esp_gateway_wan_policy_t* policy = NULL;
+
+    if ((config == NULL) || (config->fall_count == 0) || (config->rise_count == 0)) {
+        return NULL;
+    }
+
+    policy = calloc(1, sizeof(esp_gateway_wan_policy_t));
+    if (policy == NULL) {
+        return NULL;
+    }
+
+    policy->config = *config;
+
+    return policy;
+}
+
+void esp_gateway_wan_policy_delete(esp_gateway_wan_policy_t* policy)
+{
+    free(policy);
+}
+
+esp_err_t esp_gateway_wan_policy_add(esp_gateway_wan_policy_t* policy, void* netif, uint8_t weight, uint8_t* index)
+{
+    wan_uplink_t* uplink = NULL;
+
+    if ((netif == NULL) || (weight == 0) || (weight > ESP_GATEWAY_WAN_POLICY_MAX_WEIGHT)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (esp_gateway_wan_policy_find(policy, netif) != ESP_GATEWAY_NAPT_UPLINK_NONE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        if (policy->uplinks[loop].info.netif == NULL) {
+            uplink = &policy->uplinks[loop];
+            *index = loop;
+            break;
+        }
+    }
+
+    if (uplink == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(uplink, 0, sizeof(wan_uplink_t));
+    uplink->info.netif = netif;
+    uplink->info.weight = weight;
+    uplink->info.healthy = true;
+
+    return ESP_OK;
+}
+
+void esp_gateway_wan_policy_remove(esp_gateway_wan_policy_t* policy, uint8_t index)
+{
+    if (index < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) {
+        memset(&policy->uplinks[index], 0, sizeof(wan_uplink_t));
+    }
+}
+
+uint8_t esp_gateway_wan_policy_find(esp_gateway_wan_policy_t* policy, const void* netif)
+{
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        if (netif && (policy->uplinks[loop].info.netif == netif)) {
+            return loop;
+        }
+    }
+
+    return ESP_GATEWAY_NAPT_UPLINK_NONE;
+}
+
+esp_err_t esp_gateway_wan_policy_set_weight(esp_gateway_wan_policy_t* policy, uint8_t index, uint8_t weight)
+{
+    if ((index >= ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) || (policy->uplinks[index].info.netif == NULL)
+        || (weight == 0) || (weight > ESP_GATEWAY_WAN_POLICY_MAX_WEIGHT)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    policy->uplinks[index].info.weight = weight;
+
+    return ESP_OK;
+}
+
+bool esp_gateway_wan_policy_set_link(esp_gateway_wan_policy_t* policy, uint8_t index, bool up, uint32_t now)
+{
+    wan_uplink_t* uplink = NULL;
+    bool was_usable = false;
+
+    if ((index >= ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) || (policy->uplinks[index].info.netif == NULL)) {
+        return false;
+    }
+
+    uplink = &policy->uplinks[index];
+    if (uplink->info.link_up == up) {
+        return false;
+    }
+
+    /* A link coming up again is given the benefit of the doubt until its probes are lost */
+    was_usable = wan_uplink_usable(uplink);
+    uplink->info.link_up = up;
+    uplink->info.healthy = true;
+    uplink->fail_streak = 0;
+    uplink->success_streak = 0;
+
+    return wan_uplink_changed(uplink, was_usable, now);
+}
+
+bool esp_gateway_wan_policy_report_probe(esp_gateway_wan_policy_t* policy, uint8_t index, bool answered, uint32_t rtt_ms, uint32_t now)
+{
+    wan_uplink_t* uplink = NULL;
+    bool was_usable = false;
+
+    if ((index >= ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) || (policy->uplinks[index].info.netif == NULL)) {
+        return false;
+    }
+
+    uplink = &policy->uplinks[index];
+    was_usable = wan_uplink_usable(uplink);
+    uplink->info.probes++;
+
+    if (answered) {
+        uplink->info.rtt_ms = uplink->info.rtt_ms ? (uplink->info.rtt_ms * 7 + rtt_ms) / 8 : rtt_ms;
+        uplink->fail_streak = 0;
+        if ((uplink->success_streak < UINT8_MAX) && (++uplink->success_streak >= policy->config.rise_count)) {
+            uplink->info.healthy = true;
+        }
+    } else {
+        uplink->info.probes_lost++;
+        uplink->success_streak = 0;
+        if ((uplink->fail_streak < UINT8_MAX) && (++uplink->fail_streak >= policy->config.fall_count)) {
+            uplink->info.healthy = false;
+        }
+    }
+
+    return wan_uplink_changed(uplink, was_usable, now);
+}
+
+bool esp_gateway_wan_policy_usable(esp_gateway_wan_policy_t* policy, uint8_t index)
+{
+    return (index < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) && wan_uplink_usable(&policy->uplinks[index]);
+}
+
+bool esp_gateway_wan_policy_any_usable(esp_gateway_wan_policy_t* policy)
+{
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        if (wan_uplink_usable(&policy->uplinks[loop])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint8_t esp_gateway_wan_policy_select(esp_gateway_wan_policy_t* policy, const esp_gateway_napt_tuple_t* tuple)
+{
+    uint32_t hash = wan_flow_hash(policy, tuple);
+    uint32_t best_score = 0;
+    uint8_t best = ESP_GATEWAY_NAPT_UPLINK_NONE;
+
+    /*
+     * Rendezvous hashing with one point per unit of weight: each uplink wins with the
+     * probability of its share of the weights, and the score of an uplink does not depend
+     * on the other ones, so the flows of the other uplinks stay put when one goes away.
+     */
+    for (uint8_t loop = 0; loop < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS; loop++) {
+        wan_uplink_t* uplink = &policy->uplinks[loop];
+        if (!wan_uplink_usable(uplink)) {
+            continue;
+        }
+
+        for (uint32_t point = 0; point < uplink->info.weight; point++) {
+            uint32_t score = wan_hash_mix(hash ^ (((uint32_t)loop << 8 | point) * 0x9E3779B9UL));
+            if ((best == ESP_GATEWAY_NAPT_UPLINK_NONE) || (score > best_score)) {
+                best_score = score;
+                best = loop;
+            }
+        }
+    }
+
+    if (best != ESP_GATEWAY_NAPT_UPLINK_NONE) {
+        policy->uplinks[best].info.flows++;
+    }
+
+    return best;
+}
+
+void esp_gateway_wan_policy_get_uplink(esp_gateway_wan_policy_t* policy, uint8_t index, esp_gateway_wan_uplink_t* uplink)
+{
+    if (index < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS) {
+        *uplink = policy->uplinks[index].info;
+    } else {
+        memset(uplink, 0, sizeof(esp_gateway_wan_uplink_t));
+    }
+}
@@ -118,7 +118,6 @@ static void ip_event_sta_got_ip_handler(void *arg, esp_event_base_t event_base,
     ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
     ESP_LOGI(TAG, "Connected with IP Address:" IPSTR, IP2STR(&event->ip_info.ip));
 
-    esp_gateway_netif_network_segment_conflict_update(event->esp_netif);
     xEventGroupSetBits(s_wifi_event_group, GATEWAY_EVENT_STA_CONNECTED);
 }
 
@@ -225,13 +224,8 @@ esp_netif_t* esp_gateway_create_softap_netif(esp_netif_ip_info_t* ip_info, uint8
     esp_gateway_netif_list_add(wifi_netif);
 
     if (enable_dhcps) {
+        esp_gateway_netif_dhcps_offer_dns(wifi_netif);
         esp_netif_dhcps_start(wifi_netif);
-        esp_netif_dns_info_t dns;
-        dns.ip.u_addr.ip4.addr = ESP_IP4TOADDR(114, 114, 114, 114);
-        dns.ip.type = IPADDR_TYPE_V4;
-        dhcps_offer_t dhcps_dns_value = OFFER_DNS;
-        esp_netif_dhcps_option(wifi_netif, ESP_NETIF_OP_SET, ESP_NETIF_DOMAIN_NAME_SERVER, &dhcps_dns_value, sizeof(dhcps_dns_value));
-        esp_netif_set_dns_info(wifi_netif, ESP_NETIF_DNS_MAIN, &dns);
     }
 
     /* Register our event handler for Wi-Fi, IP and Provisioning related events */
@@ -250,6 +244,9 @@ esp_netif_t* esp_gateway_create_softap_netif(esp_netif_ip_info_t* ip_info, uint8
     snprintf(softap_ssid, sizeof(softap_ssid), "%s", ESP_GATEWAY_SOFTAP_SSID);
 #endif
     esp_gateway_wifi_set(WIFI_MODE_AP, softap_ssid, ESP_GATEWAY_SOFTAP_PASSWORD, NULL);
+#if CONFIG_GATEWAY_NAPT_ENGINE
+    ESP_ERROR_CHECK(esp_gateway_napt_init());
+#endif
     ip_napt_enable(netif_ip.ip.addr, 1);
 
     return wifi_netif;
@@ -0,0 +1,279 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_dns_cache.h"
+
+#define TEST_TYPE_A         (1)
+#define TEST_TYPE_SOA       (6)
+#define TEST_CLASS_IN       (1)
+
+static uint32_t test_put16(uint8_t* msg, uint32_t offset, uint16_t value)
+{
+    msg[offset] = value >> 8;
+    msg[offset + 1] = value & 0xFF;
+    return offset + 2;
+}
+
+static uint32_t test_put32(uint8_t* msg, uint32_t offset, uint32_t value)
+{
+    offset = test_put16(msg, offset, value >> 16);
+    return test_put16(msg, offset, value & 0xFFFF);
+}
+
+static uint32_t test_get32(const uint8_t* msg, uint32_t offset)
+{
+    return ((uint32_t)msg[offset] << 24) | ((uint32_t)msg[offset + 1] << 16) | ((uint32_t)msg[offset + 2] << 8) | msg[offset + 3];
+}
+
+/* Header and question for "name", e.g. "\7example\3com" */
+static uint32_t test_build_question(uint8_t* msg, uint16_t id, uint16_t flags, const char* name, uint16_t an_num, uint16_t ns_num)
+{
+    uint32_t offset = 0;
+
+    offset = test_put16(msg, offset, id);
+    offset = test_put16(msg, offset, flags);
+    offset = test_put16(msg, offset, 1);
+    offset = test_put16(msg, offset, an_num);
+    offset = test_put16(msg, offset, ns_num);
+    offset = test_put16(msg, offset, 0);
+    memcpy(msg + offset, name, strlen(name) + 1);
+    offset += strlen(name) + 1;
+    offset = test_put16(msg, offset, TEST_TYPE_A);
+
+    return test_put16(msg, offset, TEST_CLASS_IN);
+}
+
+static uint32_t test_build_query(uint8_t* msg, uint16_t id, const char* name)
+{
+    return test_build_question(msg, id, 0x0100, name, 0, 0);
+}
+
+/* Two A records, pointing to the question name, with the TTLs ttl and ttl + 100 */
+static uint32_t test_build_answer(uint8_t* msg, uint16_t id, const char* name, uint32_t ttl)
+{
+    uint32_t offset = test_build_question(msg, id, 0x8180, name, 2, 0);
+
+    for (uint32_t loop = 0; loop < 2; loop++) {
+        offset = test_put16(msg, offset, 0xC00C);
+        offset = test_put16(msg, offset, TEST_TYPE_A);
+        offset = test_put16(msg, offset, TEST_CLASS_IN);
+        offset = test_put32(msg, offset, ttl + loop * 100);
+        offset = test_put16(msg, offset, 4);
+        offset = test_put32(msg, offset, 0x5DB8D822 + loop);
+    }
+
+    return offset;
+}
+
+/* Name error with the SOA of the zone in the authority section */
+static uint32_t test_build_nxdomain(uint8_t* msg, uint16_t id, const char* name, uint32_t ttl, uint32_t minimum)
+{
+    uint32_t offset = test_build_question(msg, id, 0x8183, name, 0, 1);
+    uint32_t data_len = 0;
+
+    offset = test_put16(msg, offset, 0xC00C);
+    offset = test_put16(msg, offset, TEST_TYPE_SOA);
+    offset = test_put16(msg, offset, TEST_CLASS_IN);
+    offset = test_put32(msg, offset, ttl);
+    data_len = offset;
+    offset = test_put16(msg, offset, 0);
+    memcpy(msg + offset, "\2ns\300\014\4root\300\014", 12);
+    offset += 12;
+    for (uint32_t loop = 0; loop < 4; loop++) {
+        offset = test_put32(msg, offset, 3600);
+    }
+    offset = test_put32(msg, offset, minimum);
+    test_put16(msg, data_len, offset - data_len - 2);
+
+    return offset;
+}
+
+static esp_gateway_dns_cache_t* test_create_cache(uint32_t capacity)
+{
+    esp_gateway_dns_cache_config_t config = {
+        .capacity = capacity,
+        .pending_capacity = 4,
+        .min_ttl_s = 0,
+        .max_ttl_s = 3600,
+        .negative_ttl_s = 60,
+        .seed = 0x1234,
+    };
+
+    return esp_gateway_dns_cache_create(&config);
+}
+
+TEST_CASE("dns cache answers with the remaining TTL", "[gateway]")
+{
+    uint8_t query[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t answer[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t response[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    esp_gateway_dns_question_t question;
+    esp_gateway_dns_question_t answer_question;
+    uint32_t len = 0;
+    uint32_t query_len = test_build_query(query, 0x1111, "\7example\3com");
+    uint32_t answer_len = test_build_answer(answer, 0x2222, "\7example\3com", 300);
+    esp_gateway_dns_cache_t* cache = test_create_cache(8);
+
+    TEST_ASSERT_NOT_NULL(cache);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(query, query_len, false, &question));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_gateway_dns_question_parse(query, query_len, true, &question));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_gateway_dns_question_parse(query, query_len - 3, false, &question));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(query, query_len, false, &question));
+    TEST_ASSERT_EQUAL(query_len, question.end);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_dns_cache_lookup(cache, query, &question, 1000, response, sizeof(response), &len));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(answer, answer_len, true, &answer_question));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_insert(cache, &answer_question, answer, answer_len, 1000));
+
+    /* Another client, asking with another case, 100 s later */
+    query_len = test_build_query(query, 0x3333, "\7ExAmPlE\3COM");
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(query, query_len, false, &question));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_lookup(cache, query, &question, 101000, response, sizeof(response), &len));
+    TEST_ASSERT_EQUAL(answer_len, len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(query, response, 2);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(query + ESP_GATEWAY_DNS_HEADER_LEN, response + ESP_GATEWAY_DNS_HEADER_LEN, question.end - ESP_GATEWAY_DNS_HEADER_LEN);
+    TEST_ASSERT_EQUAL(200, test_get32(response, query_len + 6));
+    TEST_ASSERT_EQUAL(300, test_get32(response, query_len + 16 + 6));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(answer + query_len, response + query_len, 6);
+
+    /* Expired with the smallest TTL */
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_dns_cache_lookup(cache, query, &question, 301000, response, sizeof(response), &len));
+
+    esp_gateway_dns_cache_stats_t stats;
+    esp_gateway_dns_cache_get_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(3, stats.lookups);
+    TEST_ASSERT_EQUAL(1, stats.hits);
+    TEST_ASSERT_EQUAL(1, stats.inserts);
+    esp_gateway_dns_cache_delete(cache);
+}
+
+TEST_CASE("dns cache keeps name errors for the SOA minimum TTL", "[gateway]")
+{
+    uint8_t query[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t answer[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t response[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    esp_gateway_dns_question_t question;
+    uint32_t len = 0;
+    uint32_t query_len = test_build_query(query, 0x1111, "\4nope\7example\3com");
+    uint32_t answer_len = test_build_nxdomain(answer, 0x1111, "\4nope\7example\3com", 900, 30);
+    esp_gateway_dns_cache_t* cache = test_create_cache(8);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(query, query_len, false, &question));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_insert(cache, &question, answer, answer_len, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_lookup(cache, query, &question, 29000, response, sizeof(response), &len));
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_DNS_RCODE_NXDOMAIN, response[3] & 0x0F);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_dns_cache_lookup(cache, query, &question, 30000, response, sizeof(response), &len));
+
+    /* Bounded by negative_ttl_s */
+    answer_len = test_build_nxdomain(answer, 0x1111, "\4nope\7example\3com", 900, 600);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_insert(cache, &question, answer, answer_len, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_lookup(cache, query, &question, 59000, response, sizeof(response), &len));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_dns_cache_lookup(cache, query, &question, 60000, response, sizeof(response), &len));
+
+    /* Server failures are not cached */
+    answer[3] = (answer[3] & 0xF0) | ESP_GATEWAY_DNS_RCODE_SERVFAIL;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_gateway_dns_cache_insert(cache, &question, answer, answer_len, 0));
+
+    esp_gateway_dns_cache_stats_t stats;
+    esp_gateway_dns_cache_get_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(2, stats.negative_hits);
+    TEST_ASSERT_EQUAL(0, stats.hits);
+    esp_gateway_dns_cache_delete(cache);
+}
+
+TEST_CASE("dns cache evicts the least recently used answer", "[gateway]")
+{
+    uint8_t query[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t answer[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint8_t response[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    const char* names[] = { "\1a\3com", "\1b\3com", "\1c\3com" };
+    esp_gateway_dns_question_t question[3];
+    uint32_t len = 0;
+    esp_gateway_dns_cache_t* cache = test_create_cache(2);
+
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        uint32_t answer_len = test_build_answer(answer, loop, names[loop], 300);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(answer, answer_len, true, &question[loop]));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_insert(cache, &question[loop], answer, answer_len, loop * 1000));
+        if (loop == 1) {
+            /* "a" is used again, so "b" is dropped for "c" */
+            test_build_query(query, 0, names[0]);
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_lookup(cache, query, &question[0], 1500, response, sizeof(response), &len));
+        }
+    }
+
+    test_build_query(query, 0, names[1]);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_dns_cache_lookup(cache, query, &question[1], 3000, response, sizeof(response), &len));
+    test_build_query(query, 0, names[2]);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_cache_lookup(cache, query, &question[2], 3000, response, sizeof(response), &len));
+
+    esp_gateway_dns_cache_stats_t stats;
+    esp_gateway_dns_cache_get_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(1, stats.evictions);
+    esp_gateway_dns_cache_delete(cache);
+}
+
+TEST_CASE("dns cache shares one upstream query between identical questions", "[gateway]")
+{
+    uint8_t query[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    esp_gateway_dns_question_t question;
+    esp_gateway_dns_pending_t* pending = NULL;
+    esp_gateway_dns_client_t client = { .addr = 0x0204A8C0, .port = 0x3930, .id = 0x1111 };
+    uint32_t next_ms = UINT32_MAX;
+    uint16_t upstream_id = 0;
+    bool created = false;
+    uint32_t query_len = test_build_query(query, 0x1111, "\7example\3com");
+    esp_gateway_dns_cache_t* cache = test_create_cache(8);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_question_parse(query, query_len, false, &question));
+    pending = esp_gateway_dns_cache_pending_get(cache, &question, &client, 0, &created);
+    TEST_ASSERT_NOT_NULL(pending);
+    TEST_ASSERT_TRUE(created);
+    upstream_id = pending->upstream_id;
+
+    /* A retransmission of the same client, then other clients */
+    TEST_ASSERT_EQUAL_PTR(pending, esp_gateway_dns_cache_pending_get(cache, &question, &client, 10, &created));
+    TEST_ASSERT_FALSE(created);
+    for (uint32_t loop = 1; loop < ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS; loop++) {
+        client.port++;
+        TEST_ASSERT_EQUAL_PTR(pending, esp_gateway_dns_cache_pending_get(cache, &question, &client, 20, &created));
+        TEST_ASSERT_FALSE(created);
+    }
+    client.port++;
+    TEST_ASSERT_NULL(esp_gateway_dns_cache_pending_get(cache, &question, &client, 30, &created));
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS, pending->client_num);
+    TEST_ASSERT_EQUAL_PTR(pending, esp_gateway_dns_cache_pending_find(cache, upstream_id));
+
+    /* Sent again with a new ID after the timeout */
+    TEST_ASSERT_NULL(esp_gateway_dns_cache_pending_timeout(cache, 500, 1000, &next_ms));
+    TEST_ASSERT_EQUAL(500, next_ms);
+    TEST_ASSERT_EQUAL_PTR(pending, esp_gateway_dns_cache_pending_timeout(cache, 1000, 1000, &next_ms));
+    esp_gateway_dns_cache_pending_retry(cache, pending, 1000);
+    TEST_ASSERT_EQUAL(2, pending->attempts);
+    TEST_ASSERT_NULL(esp_gateway_dns_cache_pending_find(cache, upstream_id));
+    TEST_ASSERT_EQUAL_PTR(pending, esp_gateway_dns_cache_pending_find(cache, pending->upstream_id));
+
+    esp_gateway_dns_cache_pending_remove(cache, pending);
+    TEST_ASSERT_NULL(esp_gateway_dns_cache_pending_timeout(cache, 5000, 1000, &next_ms));
+
+    esp_gateway_dns_cache_stats_t stats;
+    esp_gateway_dns_cache_get_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_DNS_PENDING_MAX_CLIENTS - 1, stats.coalesced);
+    esp_gateway_dns_cache_delete(cache);
+}
@@ -0,0 +1,210 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_GATEWAY_DNS_PROXY
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#include "esp_err.h"
+#include "esp_gateway.h"
+#include "esp_gateway_dns_cache.h"
+#include "esp_gateway_dns_proxy.h"
+
+#define TEST_PROXY_PORT     (5353)
+
+/* Query of an A record of "\7example\3com" or "\4mesh\7example\3com" */
+static uint32_t test_build_query(uint8_t* msg, uint16_t id, const char* name)
+{
+    uint32_t name_len = strlen(name) + 1;
+
+    memset(msg, 0, ESP_GATEWAY_DNS_HEADER_LEN);
+    msg[0] = id >> 8;
+    msg[1] = id & 0xFF;
+    msg[2] = 0x01;
+    msg[5] = 1;
+    memcpy(msg + ESP_GATEWAY_DNS_HEADER_LEN, name, name_len);
+    memcpy(msg + ESP_GATEWAY_DNS_HEADER_LEN + name_len, "\0\1\0\1", 4);
+
+    return ESP_GATEWAY_DNS_HEADER_LEN + name_len + 4;
+}
+
+/* Answer a query with one A record */
+static uint32_t test_build_answer(uint8_t* msg, uint32_t len)
+{
+    static const uint8_t record[] = { 0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4, 93, 184, 216, 34 };
+
+    msg[2] = 0x81;
+    msg[3] = 0x80;
+    msg[7] = 1;
+    memcpy(msg + len, record, sizeof(record));
+
+    return len + sizeof(record);
+}
+
+static int test_udp_socket(uint16_t port, uint16_t* bound_port)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)));
+    if (bound_port) {
+        getsockname(fd, (struct sockaddr*)&addr, &addr_len);
+        *bound_port = addr.sin_port;
+    }
+
+    return fd;
+}
+
+static void test_send_query(int fd, uint16_t id, const char* name)
+{
+    uint8_t msg[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    struct sockaddr_in to = { 0 };
+    uint32_t len = test_build_query(msg, id, name);
+
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(TEST_PROXY_PORT);
+    TEST_ASSERT_EQUAL(len, sendto(fd, msg, len, 0, (struct sockaddr*)&to, sizeof(to)));
+}
+
+static void test_recv_answer(int fd, uint16_t id)
+{
+    uint8_t msg[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    int len = recv(fd, msg, sizeof(msg), 0);
+
+    TEST_ASSERT_GREATER_THAN(ESP_GATEWAY_DNS_HEADER_LEN, len);
+    TEST_ASSERT_EQUAL_HEX16(id, (msg[0] << 8) | msg[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x81, msg[2]);
+    TEST_ASSERT_EQUAL(1, msg[7]);
+}
+
+/* The stand-in upstream server answers one query, returns false when none comes */
+static bool test_upstream_answer(int fd)
+{
+    uint8_t msg[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    struct sockaddr_in from = { 0 };
+    socklen_t from_len = sizeof(from);
+    int len = recvfrom(fd, msg, sizeof(msg), 0, (struct sockaddr*)&from, &from_len);
+
+    if (len <= 0) {
+        return false;
+    }
+
+    len = test_build_answer(msg, len);
+    TEST_ASSERT_EQUAL(len, sendto(fd, msg, len, 0, (struct sockaddr*)&from, from_len));
+    return true;
+}
+
+TEST_CASE("dns proxy caches and coalesces the queries of a local upstream server", "[gateway]")
+{
+    esp_gateway_dns_proxy_config_t config;
+    esp_gateway_dns_proxy_stats_t stats;
+    uint16_t upstream_port = 0;
+    int upstream_fd = test_udp_socket(0, &upstream_port);
+    int client_fd = test_udp_socket(0, NULL);
+    int other_client_fd = test_udp_socket(0, NULL);
+
+    esp_gateway_dns_proxy_default_config(&config);
+    config.listen_addr = htonl(INADDR_LOOPBACK);
+    config.listen_port = htons(TEST_PROXY_PORT);
+    config.upstream_addr = htonl(INADDR_LOOPBACK);
+    config.upstream_port = upstream_port;
+    config.any_client = true;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_start(&config));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_gateway_dns_proxy_start(&config));
+
+    /* Miss, then hit without the upstream server */
+    test_send_query(client_fd, 0x0101, "\7example\3com");
+    TEST_ASSERT_TRUE(test_upstream_answer(upstream_fd));
+    test_recv_answer(client_fd, 0x0101);
+    test_send_query(client_fd, 0x0202, "\7EXAMPLE\3com");
+    test_recv_answer(client_fd, 0x0202);
+    TEST_ASSERT_FALSE(test_upstream_answer(upstream_fd));
+
+    /* Two clients asking the same question get the answer of one upstream query */
+    test_send_query(client_fd, 0x0303, "\4mesh\7example\3com");
+    test_send_query(other_client_fd, 0x0404, "\4mesh\7example\3com");
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_TRUE(test_upstream_answer(upstream_fd));
+    test_recv_answer(client_fd, 0x0303);
+    test_recv_answer(other_client_fd, 0x0404);
+    TEST_ASSERT_FALSE(test_upstream_answer(upstream_fd));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_get_stats(&stats));
+    printf("dns proxy: %u queries, %u hits, upstream latency avg %u ms, max %u ms\n",
+           (unsigned)stats.queries, (unsigned)stats.hits, (unsigned)stats.latency_avg_ms, (unsigned)stats.latency_max_ms);
+    TEST_ASSERT_EQUAL(4, stats.queries);
+    TEST_ASSERT_EQUAL(1, stats.hits);
+    TEST_ASSERT_EQUAL(1, stats.coalesced);
+    TEST_ASSERT_EQUAL(2, stats.upstream_queries);
+    TEST_ASSERT_EQUAL(2, stats.upstream_answers);
+    TEST_ASSERT_EQUAL(0, stats.failures);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_stop());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_gateway_dns_proxy_get_stats(&stats));
+    close(upstream_fd);
+    close(client_fd);
+    close(other_client_fd);
+}
+
+TEST_CASE("dns proxy answers a server failure when the upstream server is silent", "[gateway]")
+{
+    esp_gateway_dns_proxy_config_t config;
+    esp_gateway_dns_proxy_stats_t stats;
+    uint8_t msg[ESP_GATEWAY_DNS_MAX_MSG_LEN];
+    uint16_t upstream_port = 0;
+    int upstream_fd = test_udp_socket(0, &upstream_port);
+    int client_fd = test_udp_socket(0, NULL);
+    struct timeval tv = { .tv_sec = (CONFIG_GATEWAY_DNS_PROXY_UPSTREAM_TIMEOUT_MS * CONFIG_GATEWAY_DNS_PROXY_UPSTREAM_ATTEMPTS) / 1000 + 1 };
+    int len = 0;
+
+    esp_gateway_dns_proxy_default_config(&config);
+    config.listen_addr = htonl(INADDR_LOOPBACK);
+    config.listen_port = htons(TEST_PROXY_PORT);
+    config.upstream_addr = htonl(INADDR_LOOPBACK);
+    config.upstream_port = upstream_port;
+    config.any_client = true;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_start(&config));
+
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    test_send_query(client_fd, 0x0505, "\7example\3com");
+    len = recv(client_fd, msg, sizeof(msg), 0);
+    TEST_ASSERT_GREATER_THAN(ESP_GATEWAY_DNS_HEADER_LEN, len);
+    TEST_ASSERT_EQUAL_HEX16(0x0505, (msg[0] << 8) | msg[1]);
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_DNS_RCODE_SERVFAIL, msg[3] & 0x0F);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_get_stats(&stats));
+    TEST_ASSERT_EQUAL(CONFIG_GATEWAY_DNS_PROXY_UPSTREAM_ATTEMPTS, stats.upstream_queries);
+    TEST_ASSERT_EQUAL(1, stats.upstream_timeouts);
+    TEST_ASSERT_EQUAL(1, stats.failures);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_dns_proxy_stop());
+    close(upstream_fd);
+    close(client_fd);
+}
+#endif
@@ -0,0 +1,275 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "esp_timer.h"
+
+#include "esp_gateway_flow_cache.h"
+
+#define TEST_PROTO_TCP      (6)
+#define TEST_PROTO_UDP      (17)
+#define TEST_PAYLOAD_LEN    (64)
+
+static int s_inside_netif;
+static int s_outside_netif;
+
+static uint16_t test_checksum(const uint8_t* data, uint32_t len, uint32_t sum)
+{
+    for (uint32_t loop = 0; loop + 1 < len; loop += 2) {
+        sum += (data[loop] << 8) | data[loop + 1];
+    }
+    if (len & 1) {
+        sum += data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
+static uint16_t test_l4_checksum(const uint8_t* packet)
+{
+    uint32_t iphdr_len = (packet[0] & 0x0F) * 4;
+    uint32_t l4_len = ((packet[2] << 8) | packet[3]) - iphdr_len;
+    uint32_t sum = packet[9] + l4_len;
+
+    for (uint32_t loop = 12; loop < 20; loop += 2) {
+        sum += (packet[loop] << 8) | packet[loop + 1];
+    }
+
+    return test_checksum(packet + iphdr_len, l4_len, sum);
+}
+
+static void test_set16(uint8_t* data, uint16_t value)
+{
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+/* Build a valid IPv4 TCP or UDP packet */
+static uint32_t test_packet(uint8_t* packet, uint8_t proto, const uint8_t src[4], const uint8_t dest[4],
+                            uint16_t src_port, uint16_t dest_port, uint8_t tcp_flags)
+{
+    uint32_t l4_len = ((proto == TEST_PROTO_TCP) ? 20 : 8) + TEST_PAYLOAD_LEN;
+    uint8_t* l4hdr = packet + 20;
+
+    memset(packet, 0, 20 + l4_len);
+    packet[0] = 0x45;
+    test_set16(packet + 2, 20 + l4_len);
+    packet[8] = 64;
+    packet[9] = proto;
+    memcpy(packet + 12, src, 4);
+    memcpy(packet + 16, dest, 4);
+    test_set16(packet + 10, test_checksum(packet, 20, 0));
+
+    test_set16(l4hdr, src_port);
+    test_set16(l4hdr + 2, dest_port);
+    if (proto == TEST_PROTO_TCP) {
+        l4hdr[12] = 0x50;
+        l4hdr[13] = tcp_flags;
+    } else {
+        test_set16(l4hdr + 4, l4_len);
+    }
+    for (uint32_t loop = 0; loop < TEST_PAYLOAD_LEN; loop++) {
+        l4hdr[l4_len - TEST_PAYLOAD_LEN + loop] = loop * 7;
+    }
+    test_set16(l4hdr + ((proto == TEST_PROTO_TCP) ? 16 : 6), test_l4_checksum(packet));
+
+    return 20 + l4_len;
+}
+
+static void test_learn_and_rewrite(uint8_t proto)
+{
+    static const uint8_t host[4] = { 192, 168, 4, 2 };
+    static const uint8_t remote[4] = { 93, 184, 216, 34 };
+    static const uint8_t outside[4] = { 10, 0, 0, 5 };
+    uint8_t first[128], next[128], expected[128];
+    esp_gateway_flow_key_t key;
+    bool slow_path = false;
+
+    esp_gateway_flow_cache_t* cache = esp_gateway_flow_cache_create(64, 0x1234);
+    TEST_ASSERT_NOT_NULL(cache);
+
+    /* The first packet is translated by the stack */
+    uint32_t len = test_packet(first, proto, host, remote, 50000, 443, 0x02);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(first, len, &s_inside_netif, &key, &slow_path));
+    TEST_ASSERT_EQUAL(proto == TEST_PROTO_TCP, slow_path);
+    TEST_ASSERT_NULL(esp_gateway_flow_cache_lookup(cache, &key));
+    test_packet(first, proto, outside, remote, 40001, 443, 0x02);
+    TEST_ASSERT_NOT_NULL(esp_gateway_flow_cache_learn(cache, &key, first, len, &s_outside_netif, NULL));
+
+    /* The next ones are translated by the cache exactly as the stack would do */
+    for (uint32_t loop = 0; loop < 4; loop++) {
+        len = test_packet(next, proto, host, remote, 50000, 443, 0x10);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(next, len, &s_inside_netif, &key, &slow_path));
+        TEST_ASSERT_FALSE(slow_path);
+        esp_gateway_flow_entry_t* entry = esp_gateway_flow_cache_lookup(cache, &key);
+        TEST_ASSERT_NOT_NULL(entry);
+        TEST_ASSERT_EQUAL_PTR(&s_outside_netif, entry->outp);
+
+        esp_gateway_flow_cache_rewrite(entry, next);
+        test_packet(expected, proto, outside, remote, 40001, 443, 0x10);
+        expected[8]--;
+        test_set16(expected + 10, 0);
+        test_set16(expected + 10, test_checksum(expected, 20, 0));
+        TEST_ASSERT_EQUAL_MEMORY(expected, next, len);
+        TEST_ASSERT_EQUAL(0, test_checksum(next, 20, 0));
+    }
+
+    /* The same flow from another netif is unknown */
+    key.inp = &s_outside_netif;
+    TEST_ASSERT_NULL(esp_gateway_flow_cache_lookup(cache, &key));
+    key.inp = &s_inside_netif;
+
+    esp_gateway_flow_cache_flush(cache);
+    TEST_ASSERT_NULL(esp_gateway_flow_cache_lookup(cache, &key));
+
+    esp_gateway_flow_cache_delete(cache);
+}
+
+TEST_CASE("flow cache rewrites TCP packets like the stack", "[gateway]")
+{
+    test_learn_and_rewrite(TEST_PROTO_TCP);
+}
+
+TEST_CASE("flow cache rewrites UDP packets like the stack", "[gateway]")
+{
+    test_learn_and_rewrite(TEST_PROTO_UDP);
+}
+
+TEST_CASE("flow cache leaves control packets to the stack", "[gateway]")
+{
+    static const uint8_t host[4] = { 192, 168, 4, 2 };
+    static const uint8_t remote[4] = { 93, 184, 216, 34 };
+    uint8_t packet[128];
+    esp_gateway_flow_key_t key;
+    bool slow_path = false;
+
+    static const uint8_t control_flags[] = { 0x01, 0x02, 0x04, 0x12, 0x11 };
+    for (uint32_t loop = 0; loop < sizeof(control_flags); loop++) {
+        uint32_t len = test_packet(packet, TEST_PROTO_TCP, host, remote, 50000, 80, control_flags[loop]);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(packet, len, &s_inside_netif, &key, &slow_path));
+        TEST_ASSERT_TRUE(slow_path);
+    }
+
+    /* TTL about to expire */
+    uint32_t len = test_packet(packet, TEST_PROTO_UDP, host, remote, 50000, 53, 0);
+    packet[8] = 1;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(packet, len, &s_inside_netif, &key, &slow_path));
+    TEST_ASSERT_TRUE(slow_path);
+
+    /* Fragments, other protocols and truncated headers */
+    test_packet(packet, TEST_PROTO_UDP, host, remote, 50000, 53, 0);
+    packet[6] = 0x20;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_gateway_flow_key_parse(packet, len, &s_inside_netif, &key, &slow_path));
+    test_packet(packet, TEST_PROTO_UDP, host, remote, 50000, 53, 0);
+    packet[9] = 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_gateway_flow_key_parse(packet, len, &s_inside_netif, &key, &slow_path));
+    len = test_packet(packet, TEST_PROTO_TCP, host, remote, 50000, 80, 0x10);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_gateway_flow_key_parse(packet, 30, &s_inside_netif, &key, &slow_path));
+}
+
+TEST_CASE("flow cache keeps two flows per set", "[gateway]")
+{
+    uint8_t packet[128];
+    esp_gateway_flow_key_t keys[3];
+    esp_gateway_flow_cache_stats_t stats;
+    bool slow_path = false;
+
+    /* A single set, so the third flow replaces one of the first two */
+    esp_gateway_flow_cache_t* cache = esp_gateway_flow_cache_create(2, 0);
+    TEST_ASSERT_NOT_NULL(cache);
+
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        uint8_t host[4] = { 192, 168, 4, 2 + loop };
+        uint32_t len = test_packet(packet, TEST_PROTO_UDP, host, (uint8_t[4]) { 8, 8, 8, 8 }, 1000, 53, 0);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(packet, len, &s_inside_netif, &keys[loop], &slow_path));
+        TEST_ASSERT_NOT_NULL(esp_gateway_flow_cache_learn(cache, &keys[loop], packet, len, &s_outside_netif, NULL));
+    }
+
+    uint32_t found = 0;
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        found += esp_gateway_flow_cache_lookup(cache, &keys[loop]) ? 1 : 0;
+    }
+    TEST_ASSERT_EQUAL(2, found);
+    TEST_ASSERT_NOT_NULL(esp_gateway_flow_cache_lookup(cache, &keys[2]));
+
+    esp_gateway_flow_cache_get_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(2, stats.capacity);
+    TEST_ASSERT_EQUAL(3, stats.learns);
+    TEST_ASSERT_EQUAL(1, stats.replacements);
+
+    esp_gateway_flow_cache_delete(cache);
+}
+
+TEST_CASE("flow cache performance", "[gateway]")
+{
+    static const uint32_t flow_nums[] = { 64, 256, 1024 };
+    static uint8_t packets[1024][128];
+    static const uint8_t remote[4] = { 93, 184, 216, 34 };
+    static const uint8_t outside[4] = { 10, 0, 0, 5 };
+    const uint32_t rounds = 16;
+    esp_gateway_flow_key_t key;
+    bool slow_path = false;
+
+    for (uint32_t loop = 0; loop < sizeof(flow_nums) / sizeof(flow_nums[0]); loop++) {
+        uint32_t flow_num = flow_nums[loop];
+        uint32_t len = 0;
+        esp_gateway_flow_cache_t* cache = esp_gateway_flow_cache_create(flow_num * 2, 0x1234);
+        TEST_ASSERT_NOT_NULL(cache);
+
+        for (uint32_t n = 0; n < flow_num; n++) {
+            uint8_t host[4] = { 192, 168, 4 + n / 250, 2 + n % 250 };
+            len = test_packet(packets[n], TEST_PROTO_TCP, host, remote, 50000, 443, 0x10);
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_flow_key_parse(packets[n], len, &s_inside_netif, &key, &slow_path));
+            uint8_t sent[128];
+            test_packet(sent, TEST_PROTO_TCP, outside, remote, 32768 + n, 443, 0x10);
+            TEST_ASSERT_NOT_NULL(esp_gateway_flow_cache_learn(cache, &key, sent, len, &s_outside_netif, NULL));
+        }
+
+        /* Parse, look up and rewrite, as done for each packet on the fast path */
+        uint32_t forwarded = 0;
+        int64_t start = esp_timer_get_time();
+        for (uint32_t round = 0; round < rounds; round++) {
+            for (uint32_t n = 0; n < flow_num; n++) {
+                packets[n][8] = 64;
+                if (esp_gateway_flow_key_parse(packets[n], len, &s_inside_netif, &key, &slow_path) != ESP_OK) {
+                    continue;
+                }
+                esp_gateway_flow_entry_t* entry = esp_gateway_flow_cache_lookup(cache, &key);
+                if (entry) {
+                    esp_gateway_flow_cache_rewrite(entry, packets[n]);
+                    /* Translate back so that the next round finds the flow again */
+                    memcpy(packets[n] + 12, &key.src_addr, 4);
+                    memcpy(packets[n] + 20, &key.src_port, 2);
+                    forwarded++;
+                }
+            }
+        }
+        int64_t elapsed_us = esp_timer_get_time() - start;
+
+        /* Flows hashed to a full set stay on the slow path */
+        TEST_ASSERT_TRUE(forwarded * 4 >= flow_num * rounds * 3);
+        printf("%5u flows: %3u%% cached, %9llu packets/s, %5llu ns per packet\n", (unsigned)flow_num,
+               (unsigned)(forwarded * 100 / (flow_num * rounds)),
+               (unsigned long long)(forwarded * 1000000ULL / (elapsed_us ? elapsed_us : 1)),
+               (unsigned long long)(elapsed_us * 1000ULL / (flow_num * rounds)));
+
+        esp_gateway_flow_cache_delete(cache);
+    }
+}
@@ -0,0 +1,154 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LITEMESH_BCAST_FILTER
+#include "esp_netif_ip_addr.h"
+#include "esp_gateway_litemesh_bcast_filter.h"
+
+static const uint8_t test_softap[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+static const uint8_t test_station_a[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0a };
+static const uint8_t test_station_b[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0b };
+
+static const esp_litemesh_bcast_filter_config_t test_config = {
+    .proxy_arp_size = 4,
+    .proxy_arp_max_age_ms = 60000,
+    .dup_window_ms = 1000,
+    .rate_limit = 10,
+    .basic_rate_kbps = 1000,
+};
+
+static uint32_t test_arp_request(uint8_t* frame, const uint8_t sender_mac[6], uint32_t sender_ip, uint32_t target_ip)
+{
+    static const uint8_t arp_hdr[8] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x01 };
+
+    memset(frame, 0xff, 6);
+    memcpy(frame + 6, sender_mac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    memcpy(frame + 14, arp_hdr, sizeof(arp_hdr));
+    memcpy(frame + 22, sender_mac, 6);
+    memcpy(frame + 28, &sender_ip, 4);
+    memset(frame + 32, 0, 6);
+    memcpy(frame + 38, &target_ip, 4);
+    return 42;
+}
+
+/* mDNS query to 224.0.0.251:5353 */
+static uint32_t test_mdns_query(uint8_t* frame, const uint8_t sender_mac[6], uint8_t id)
+{
+    static const uint8_t mdns_mac[6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb };
+
+    memset(frame, 0, 80);
+    memcpy(frame, mdns_mac, 6);
+    memcpy(frame + 6, sender_mac, 6);
+    frame[12] = 0x08;
+    frame[14] = 0x45;
+    frame[23] = 17;
+    frame[36] = 0x14;
+    frame[37] = 0xe9;
+    frame[42] = id;
+    return 80;
+}
+
+TEST_CASE("litemesh bcast filter: ARP requests for known stations are answered", "[gateway]")
+{
+    esp_litemesh_bcast_filter_t* filter = esp_litemesh_bcast_filter_create(&test_config);
+    esp_litemesh_bcast_filter_stats_t stats;
+    uint8_t reply[ESP_LITEMESH_BCAST_FILTER_REPLY_LEN];
+    uint8_t frame[64];
+    uint32_t ip_a = ESP_IP4TOADDR(192, 168, 4, 2);
+    uint32_t ip_b = ESP_IP4TOADDR(192, 168, 4, 3);
+    uint32_t len = 0;
+
+    TEST_ASSERT_NOT_NULL(filter);
+
+    /* Station B is not known yet, its request teaches A */
+    len = test_arp_request(frame, test_station_a, ip_a, ip_b);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 0, reply));
+    len = test_arp_request(frame, test_station_b, ip_b, ip_a);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_REPLY, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 10, reply));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(test_station_b, reply, 6);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(test_softap, reply + 6, 6);
+    TEST_ASSERT_EQUAL_HEX8(0x02, reply[21]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(test_station_a, reply + 22, 6);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(&ip_a, reply + 28, 4);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(test_station_b, reply + 32, 6);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(&ip_b, reply + 38, 4);
+
+    /* Probes and announcements go to the stack */
+    len = test_arp_request(frame, test_station_b, 0, ip_a);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 20, reply));
+
+    /* A station which left is not answered for */
+    TEST_ASSERT_TRUE(esp_litemesh_bcast_filter_forget(filter, test_station_a));
+    len = test_arp_request(frame, test_station_b, ip_b, ip_a);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 30, reply));
+
+    esp_litemesh_bcast_filter_get_stats(filter, &stats);
+    TEST_ASSERT_EQUAL(1, stats.neighbours);
+    TEST_ASSERT_EQUAL(3, stats.arp_requests);
+    TEST_ASSERT_EQUAL(1, stats.arp_answered);
+    TEST_ASSERT_EQUAL(42, stats.suppressed_bytes);
+    /* 64 bytes at 1 Mbps after the long preamble and DIFS */
+    TEST_ASSERT_EQUAL(242 + 512, (uint32_t)stats.airtime_saved_us);
+    esp_litemesh_bcast_filter_delete(filter);
+}
+
+TEST_CASE("litemesh bcast filter: repeated and excess multicast is dropped", "[gateway]")
+{
+    esp_litemesh_bcast_filter_t* filter = esp_litemesh_bcast_filter_create(&test_config);
+    esp_litemesh_bcast_filter_stats_t stats;
+    uint8_t frame[80];
+    uint32_t len = 0;
+    uint32_t passed = 0;
+
+    TEST_ASSERT_NOT_NULL(filter);
+
+    len = test_mdns_query(frame, test_station_a, 1);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 0, NULL));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_DROP, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 500, NULL));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1000, NULL));
+
+    /* The same query from another station is not a repeat */
+    len = test_mdns_query(frame, test_station_b, 1);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1000, NULL));
+
+    /* 10 frames per second with a burst of one second, 2 of them already taken */
+    for (uint32_t loop = 0; loop < 20; loop++) {
+        len = test_mdns_query(frame, test_station_a, (uint8_t)(10 + loop));
+        if (esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1000, NULL) == ESP_LITEMESH_BCAST_PASS) {
+            passed++;
+        }
+    }
+    TEST_ASSERT_EQUAL(8, passed);
+    len = test_mdns_query(frame, test_station_a, 100);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1100, NULL));
+
+    /* Unicast frames are never dropped */
+    memcpy(frame, test_softap, 6);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1100, NULL));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_BCAST_PASS, esp_litemesh_bcast_filter_input(filter, frame, len, test_softap, 1100, NULL));
+
+    esp_litemesh_bcast_filter_get_stats(filter, &stats);
+    TEST_ASSERT_EQUAL(1, stats.duplicates);
+    TEST_ASSERT_EQUAL(12, stats.rate_limited);
+    TEST_ASSERT_EQUAL(13 * 80, stats.suppressed_bytes);
+    esp_litemesh_bcast_filter_delete(filter);
+}
+#endif
@@ -0,0 +1,267 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LITEMESH_ENABLE
+#include "esp_gateway_litemesh_ie.h"
+
+#define TEST_IE_BUFFER_LEN      (2 + 255)
+
+static void test_litemesh_info(esp_gateway_litemesh_info_t* info, uint8_t version)
+{
+    memset(info, 0, sizeof(*info));
+    info->version = version;
+    info->max_connection = 8;
+    info->connected_station_number = 3;
+    info->connect_router_status = 1;
+    info->level = 2;
+    info->router_ssid_len = strlen("Espressif_Router_2G");
+    memcpy(info->router_ssid, "Espressif_Router_2G", info->router_ssid_len);
+    info->router_number = 1;
+    info->router_net_segment[0] = 1;
+    info->inherited_netif_number = 2;
+    info->inherited_net_segment[0] = 4;
+    info->inherited_net_segment[1] = 5;
+    info->self_net_segment_num = 1;
+    info->self_net_segment[0] = 9;
+    info->uplink_quality = 70;
+}
+
+static void test_litemesh_check_view(const esp_litemesh_ie_view_t* view, uint8_t version)
+{
+    const uint8_t inherited[] = { 4, 5, 9 };
+
+    TEST_ASSERT_EQUAL(version, view->version);
+    TEST_ASSERT_EQUAL(8, view->max_connection);
+    TEST_ASSERT_EQUAL(3, view->connected_station_number);
+    TEST_ASSERT_EQUAL(1, view->connect_router_status);
+    TEST_ASSERT_EQUAL(2, view->level);
+    TEST_ASSERT_TRUE(esp_litemesh_ie_ssid_match(view, (const uint8_t*)"Espressif_Router_2G", strlen("Espressif_Router_2G")));
+    TEST_ASSERT_FALSE(esp_litemesh_ie_ssid_match(view, (const uint8_t*)"Espressif_Router_2g", strlen("Espressif_Router_2g")));
+    TEST_ASSERT_FALSE(esp_litemesh_ie_ssid_match(view, (const uint8_t*)"Espressif_Router_5G1", strlen("Espressif_Router_5G1")));
+    TEST_ASSERT_EQUAL(1, view->router_number);
+    TEST_ASSERT_EQUAL(1, view->router_net_segment[0]);
+    TEST_ASSERT_EQUAL(3, view->inherited_netif_number);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(inherited, view->inherited_net_segment, 3);
+    /* Not carried by version 1 */
+    TEST_ASSERT_EQUAL((version == ESP_LITEMESH_IE_VERSION_1) ? 0 : 70, view->uplink_quality);
+}
+
+TEST_CASE("litemesh IE: version 1 and version 2 round trip", "[gateway]")
+{
+    uint8_t buffer[TEST_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    uint8_t v1_len = 0;
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_1);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    v1_len = ie->length;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_1);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY("Espressif_Router_2G", view.router_ssid, view.router_ssid_len);
+    TEST_ASSERT_FALSE(view.compact);
+
+    /* A node parsing version 2 which publishes version 1 */
+    info.compact = 1;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(v1_len, ie->length);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_1);
+    TEST_ASSERT_TRUE(view.compact);
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_LESS_THAN(v1_len, ie->length);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_NULL(view.router_ssid);
+    TEST_ASSERT_TRUE(view.compact);
+
+    /* A node without router nor subnet publishes the fixed header only */
+    memset(&info, 0, sizeof(info));
+    info.version = ESP_LITEMESH_IE_VERSION_2;
+    info.max_connection = 8;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_OUI_LEN + 3, ie->length);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    TEST_ASSERT_EQUAL(0, view.router_ssid_len);
+    TEST_ASSERT_EQUAL(0, view.router_number);
+    TEST_ASSERT_EQUAL(0, view.inherited_netif_number);
+    TEST_ASSERT_TRUE(esp_litemesh_ie_ssid_match(&view, NULL, 0));
+}
+
+TEST_CASE("litemesh IE: version 1 layout of the previous firmware is understood", "[gateway]")
+{
+    /* Level 1 root connected to "AP", with the router segment 1 and the inherited segments 4 and 5 */
+    const uint8_t data[] = { 0xDD, 4 + 10, 71, 87, 77, 0, 1, 0x82, 0x81, 2, 0x12, 'A', 'P', 1, 4, 5 };
+    esp_litemesh_ie_view_t view;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse((const vendor_ie_data_t*)data, &view));
+    TEST_ASSERT_EQUAL(1, view.version);
+    TEST_ASSERT_FALSE(view.compact);
+    TEST_ASSERT_EQUAL(8, view.max_connection);
+    TEST_ASSERT_EQUAL(2, view.connected_station_number);
+    TEST_ASSERT_EQUAL(1, view.connect_router_status);
+    TEST_ASSERT_EQUAL(1, view.level);
+    TEST_ASSERT_TRUE(esp_litemesh_ie_ssid_match(&view, (const uint8_t*)"AP", 2));
+    TEST_ASSERT_EQUAL(1, view.router_number);
+    TEST_ASSERT_EQUAL(1, view.router_net_segment[0]);
+    TEST_ASSERT_EQUAL(2, view.inherited_netif_number);
+    TEST_ASSERT_EQUAL(5, view.inherited_net_segment[1]);
+}
+
+TEST_CASE("litemesh IE: truncated IE is refused and unknown TLV is skipped", "[gateway]")
+{
+    uint8_t buffer[TEST_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    uint8_t len = 0;
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_1);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    ie->length--;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_parse(ie, &view));
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    len = ie->length;
+    ie->length--;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_parse(ie, &view));
+
+    /* A later version appends a TLV */
+    ie->length = len + 4;
+    ie->payload[0] = ESP_LITEMESH_IE_VERSION_2 + 1;
+    ie->payload[len - ESP_LITEMESH_IE_OUI_LEN] = 0x7F;
+    ie->payload[len - ESP_LITEMESH_IE_OUI_LEN + 1] = 2;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_2 + 1);
+
+    ie->payload[0] = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_litemesh_ie_parse(ie, &view));
+
+    info.version = ESP_LITEMESH_IE_VERSION_2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_encode(&info, ie, 8));
+}
+
+TEST_CASE("litemesh IE: route TLV round trip", "[gateway]")
+{
+    uint8_t buffer[TEST_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    const esp_litemesh_ie_route_t routes[] = {
+        { 4, ESP_LITEMESH_IE_ROUTE_TAKEN }, { 6, ESP_LITEMESH_IE_ROUTE_SELF }, { 7, 3 }, { 8, 3 },
+    };
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    TEST_ASSERT_NULL(view.uplink_addr);
+    TEST_ASSERT_EQUAL(0, view.route_num);
+
+    info.uplink_addr[0] = 5;
+    info.uplink_addr[1] = 2;
+    info.uplink_bssid[0] = 0xc4;
+    info.uplink_bssid[2] = 0x11;
+    info.route_num = sizeof(routes) / sizeof(routes[0]);
+    memcpy(info.route, routes, sizeof(routes));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_NOT_NULL(view.uplink_addr);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(info.uplink_addr, view.uplink_addr, 2);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(info.uplink_bssid, view.uplink_bssid, 3);
+    TEST_ASSERT_EQUAL(info.route_num, view.route_num);
+    TEST_ASSERT_EQUAL_MEMORY(routes, view.route, sizeof(routes));
+
+    /* Half a route */
+    ie->payload[ie->length - ESP_LITEMESH_IE_OUI_LEN - 2 * 4 - 6]--;
+    ie->length--;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_parse(ie, &view));
+
+    info.route_num = ESP_LITEMESH_MAX_ROUTE_NUMBER + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+}
+
+TEST_CASE("litemesh IE: tree TLV round trip", "[gateway]")
+{
+    uint8_t buffer[TEST_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    const uint8_t root_id[3] = { 0x00, 0x01, 0x05 };
+    const uint8_t parent[3] = { 0x00, 0x02, 0x09 };
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_2);
+    memcpy(info.root_id, root_id, sizeof(root_id));
+    memcpy(info.uplink_bssid, parent, sizeof(parent));
+    info.root_load = 150;
+    info.tree_nodes = 7;
+    info.tree_segment_num = 2;
+    info.tree_segment[0] = 12;
+    info.tree_segment[1] = 13;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(root_id, view.root_id, 3);
+    TEST_ASSERT_EQUAL(ESP_LITEMESH_IE_ROOT_LOAD_MAX, view.root_load);
+    TEST_ASSERT_EQUAL(7, view.tree_nodes);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(parent, view.uplink_bssid, 3);
+    TEST_ASSERT_EQUAL(2, view.tree_segment_num);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(info.tree_segment, view.tree_segment, 2);
+
+    /* The node itself is always in its subtree */
+    ie->payload[ie->length - ESP_LITEMESH_IE_OUI_LEN - 2 - 3 - 1] = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_parse(ie, &view));
+
+    info.tree_segment_num = ESP_LITEMESH_MAX_TREE_SEGMENT_NUMBER + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+}
+
+TEST_CASE("litemesh IE: path TLV round trip", "[gateway]")
+{
+    uint8_t buffer[TEST_IE_BUFFER_LEN];
+    vendor_ie_data_t* ie = (vendor_ie_data_t*)buffer;
+    esp_gateway_litemesh_info_t info;
+    esp_litemesh_ie_view_t view;
+    uint8_t length = 0;
+
+    test_litemesh_info(&info, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    length = ie->length;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    TEST_ASSERT_EQUAL(0, view.path_rate);
+
+    info.path_rtt = 0x1234;
+    info.path_rate = 0x0203;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_encode(&info, ie, ESP_LITEMESH_IE_MAX_PAYLOAD_LEN));
+    TEST_ASSERT_EQUAL(length + 6, ie->length);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_ie_parse(ie, &view));
+    test_litemesh_check_view(&view, ESP_LITEMESH_IE_VERSION_2);
+    TEST_ASSERT_EQUAL_HEX16(0x1234, view.path_rtt);
+    TEST_ASSERT_EQUAL_HEX16(0x0203, view.path_rate);
+
+    /* A path without throughput is not a path */
+    ie->payload[ie->length - ESP_LITEMESH_IE_OUI_LEN - 2] = 0;
+    ie->payload[ie->length - ESP_LITEMESH_IE_OUI_LEN - 1] = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_litemesh_ie_parse(ie, &view));
+}
+#endif
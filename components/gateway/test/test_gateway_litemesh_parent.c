@@ -0,0 +1,241 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LITEMESH_ENABLE
+#include "esp_gateway_litemesh_parent.h"
+
+static const esp_litemesh_parent_weights_t test_weights = { .level = 3, .rssi = 4, .load = 2, .uplink = 1 };
+
+static void test_parent(esp_litemesh_parent_t* parent, uint8_t id, uint8_t level, int8_t rssi, uint8_t stations)
+{
+    memset(parent, 0, sizeof(*parent));
+    parent->bssid[0] = 0x24;
+    parent->bssid[5] = id;
+    parent->channel = 6;
+    parent->level = level;
+    parent->rssi = rssi;
+    parent->connected_station_number = stations;
+    parent->max_connection = 8;
+}
+
+static esp_litemesh_parent_selector_t* test_selector_create(uint8_t rssi_smoothing, int32_t hysteresis, uint32_t min_dwell_ms)
+{
+    esp_litemesh_parent_selector_config_t config = {
+        .score = esp_litemesh_parent_default_score,
+        .score_arg = (void*)&test_weights,
+        .rssi_smoothing = rssi_smoothing,
+        .hysteresis = hysteresis,
+        .min_dwell_ms = min_dwell_ms,
+        .max_age_ms = 10000,
+    };
+
+    return esp_litemesh_parent_selector_create(&config);
+}
+
+TEST_CASE("litemesh parent: default score weighs level, signal, load and uplink", "[gateway]")
+{
+    esp_litemesh_parent_t near;
+    esp_litemesh_parent_t deep;
+
+    /* One more hop is not made up by 10 dB, it is by 20 dB */
+    test_parent(&near, 1, 1, -60, 0);
+    test_parent(&deep, 2, 2, -50, 0);
+    TEST_ASSERT_GREATER_THAN(esp_litemesh_parent_default_score(&deep, (void*)&test_weights),
+                             esp_litemesh_parent_default_score(&near, (void*)&test_weights));
+    deep.rssi = -40;
+    TEST_ASSERT_GREATER_THAN(esp_litemesh_parent_default_score(&near, (void*)&test_weights),
+                             esp_litemesh_parent_default_score(&deep, (void*)&test_weights));
+
+    /* Loaded node, advertised uplink, and the bounds of the terms */
+    test_parent(&deep, 2, 1, -60, 6);
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&near, (void*)&test_weights) - 2 * 75,
+                      esp_litemesh_parent_default_score(&deep, (void*)&test_weights));
+    near.uplink_quality = 80;
+    TEST_ASSERT_EQUAL(3 * 100 + 4 * 60 + 2 * 100 + 1 * 80, esp_litemesh_parent_default_score(&near, (void*)&test_weights));
+    near.uplink_quality = ESP_LITEMESH_UPLINK_QUALITY_UNKNOWN;
+    near.rssi = -20;
+    TEST_ASSERT_EQUAL(3 * 100 + 4 * 100 + 2 * 100 + 1 * 50, esp_litemesh_parent_default_score(&near, (void*)&test_weights));
+    near.rssi = -100;
+    near.connected_station_number = 8;
+    TEST_ASSERT_EQUAL(3 * 100 + 1 * 50, esp_litemesh_parent_default_score(&near, (void*)&test_weights));
+}
+
+TEST_CASE("litemesh parent: default score prefers the less loaded root", "[gateway]")
+{
+    const esp_litemesh_parent_weights_t weights = { .level = 3, .rssi = 4, .load = 2, .uplink = 1, .root_load = 2 };
+    esp_litemesh_parent_t idle;
+    esp_litemesh_parent_t busy;
+
+    test_parent(&idle, 1, 2, -60, 2);
+    test_parent(&busy, 2, 2, -60, 2);
+    idle.root_load = 20;
+    busy.root_load = 80;
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&idle, (void*)&weights) - 2 * 60,
+                      esp_litemesh_parent_default_score(&busy, (void*)&weights));
+
+    /* An unknown load counts as half loaded, a load over the maximum as the maximum */
+    busy.root_load = ESP_LITEMESH_ROOT_LOAD_UNKNOWN;
+    idle.root_load = 50;
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&idle, (void*)&weights), esp_litemesh_parent_default_score(&busy, (void*)&weights));
+    busy.root_load = 150;
+    idle.root_load = ESP_LITEMESH_ROOT_LOAD_MAX;
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&idle, (void*)&weights), esp_litemesh_parent_default_score(&busy, (void*)&weights));
+
+    /* Without its weight, the load of the root changes nothing */
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&idle, (void*)&test_weights),
+                      esp_litemesh_parent_default_score(&busy, (void*)&test_weights));
+}
+
+TEST_CASE("litemesh parent: default score prefers the faster path", "[gateway]")
+{
+    const esp_litemesh_parent_weights_t weights = { .level = 3, .rssi = 4, .load = 2, .uplink = 1, .path = 2 };
+    esp_litemesh_parent_t fast;
+    esp_litemesh_parent_t slow;
+
+    /* The shallow node behind a slow hop loses to the deeper node with a fast path */
+    test_parent(&slow, 1, 2, -60, 2);
+    test_parent(&fast, 2, 3, -60, 2);
+    slow.path_rtt_us = 60000;
+    slow.path_kbps = 1000;
+    fast.path_rtt_us = 8000;
+    fast.path_kbps = 20000;
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&slow, (void*)&weights) - 3 * 50 + 3 * 33 + 2 * (98 - 37),
+                      esp_litemesh_parent_default_score(&fast, (void*)&weights));
+    TEST_ASSERT_GREATER_THAN(esp_litemesh_parent_default_score(&slow, (void*)&weights),
+                             esp_litemesh_parent_default_score(&fast, (void*)&weights));
+
+    /* An unknown path counts as an average one, a path over 200 ms as the slowest */
+    slow.path_kbps = 0;
+    fast.path_rtt_us = 500000;
+    fast.path_kbps = 20000;
+    fast.level = 2;
+    TEST_ASSERT_EQUAL(esp_litemesh_parent_default_score(&slow, (void*)&weights),
+                      esp_litemesh_parent_default_score(&fast, (void*)&weights));
+}
+
+TEST_CASE("litemesh parent: the parent is kept for the dwell time and within the hysteresis", "[gateway]")
+{
+    esp_litemesh_parent_selector_t* selector = test_selector_create(8, 100, 30000);
+    esp_litemesh_parent_t a;
+    esp_litemesh_parent_t b;
+    esp_litemesh_parent_t result;
+
+    TEST_ASSERT_NOT_NULL(selector);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_best(selector, 0, &result));
+
+    test_parent(&a, 1, 1, -60, 1);
+    test_parent(&b, 2, 1, -50, 0);
+    esp_litemesh_parent_selector_update(selector, &a, 0);
+    esp_litemesh_parent_selector_update(selector, &b, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_best(selector, 0, &result));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(b.bssid, result.bssid, 6);
+
+    /* Joined a, b scores 4 * 20 more: within the hysteresis */
+    esp_litemesh_parent_selector_set_parent(selector, a.bssid, 0);
+    esp_litemesh_parent_selector_update(selector, &a, 40000);
+    esp_litemesh_parent_selector_update(selector, &b, 40000);
+    TEST_ASSERT_FALSE(esp_litemesh_parent_selector_should_switch(selector, 40000, 2, &result));
+
+    /* b 15 dB stronger, but the dwell time is not over */
+    esp_litemesh_parent_selector_set_parent(selector, a.bssid, 40000);
+    b.rssi = -45;
+    esp_litemesh_parent_selector_update(selector, &b, 41000);
+    TEST_ASSERT_FALSE(esp_litemesh_parent_selector_should_switch(selector, 41000, 2, &result));
+    esp_litemesh_parent_selector_update(selector, &a, 70000);
+    esp_litemesh_parent_selector_update(selector, &b, 70000);
+    TEST_ASSERT_TRUE(esp_litemesh_parent_selector_should_switch(selector, 70000, 2, &result));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(b.bssid, result.bssid, 6);
+
+    /* Never a candidate as deep as the node, it may be one of its children */
+    TEST_ASSERT_FALSE(esp_litemesh_parent_selector_should_switch(selector, 70000, 1, &result));
+
+    esp_litemesh_parent_selector_set_parent(selector, NULL, 70000);
+    TEST_ASSERT_FALSE(esp_litemesh_parent_selector_should_switch(selector, 70000, 2, &result));
+    esp_litemesh_parent_selector_delete(selector);
+}
+
+TEST_CASE("litemesh parent: RSSI is smoothed and silent candidates are forgotten", "[gateway]")
+{
+    esp_litemesh_parent_selector_t* selector = test_selector_create(2, 0, 0);
+    esp_litemesh_parent_t a;
+    esp_litemesh_parent_t result;
+
+    TEST_ASSERT_NOT_NULL(selector);
+    test_parent(&a, 1, 1, -60, 0);
+    esp_litemesh_parent_selector_update(selector, &a, 0);
+    a.rssi = -40;
+    esp_litemesh_parent_selector_update(selector, &a, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_get(selector, a.bssid, &result));
+    TEST_ASSERT_EQUAL(-55, result.rssi);
+
+    /* The other fields are the ones of the last beacon */
+    a.connected_station_number = 3;
+    esp_litemesh_parent_selector_update(selector, &a, 200);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_get(selector, a.bssid, &result));
+    TEST_ASSERT_EQUAL(3, result.connected_station_number);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_best(selector, 10200, &result));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_best(selector, 10201, &result));
+
+    /* A full table replaces the candidate heard the longest time ago */
+    for (uint8_t id = 2; id <= ESP_LITEMESH_PARENT_SELECTOR_MAX_CANDIDATES + 1; id++) {
+        test_parent(&result, id, 2, -70, 0);
+        esp_litemesh_parent_selector_update(selector, &result, 300 + id);
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_get(selector, a.bssid, &result));
+
+    esp_litemesh_parent_selector_remove(selector, result.bssid);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_get(selector, result.bssid, &result));
+    esp_litemesh_parent_selector_delete(selector);
+}
+
+TEST_CASE("litemesh parent: failover picks a fresh candidate above the node", "[gateway]")
+{
+    esp_litemesh_parent_selector_t* selector = test_selector_create(2, 0, 0);
+    esp_litemesh_parent_t a;
+    esp_litemesh_parent_t b;
+    esp_litemesh_parent_t c;
+    esp_litemesh_parent_t result;
+
+    TEST_ASSERT_NOT_NULL(selector);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_get_parent(selector, &result));
+
+    test_parent(&a, 1, 1, -50, 0);
+    test_parent(&b, 2, 1, -70, 0);
+    test_parent(&c, 3, 2, -40, 0);
+    esp_litemesh_parent_selector_update(selector, &a, 0);
+    esp_litemesh_parent_selector_update(selector, &b, 0);
+    esp_litemesh_parent_selector_update(selector, &c, 2000);
+    esp_litemesh_parent_selector_set_parent(selector, a.bssid, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_get_parent(selector, &result));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(a.bssid, result.bssid, 6);
+
+    /* a is lost, c is at the level of the node */
+    esp_litemesh_parent_selector_set_parent(selector, NULL, 2500);
+    esp_litemesh_parent_selector_remove(selector, a.bssid);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_failover(selector, 2500, 2, 3000, &result));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(b.bssid, result.bssid, 6);
+
+    /* b not heard for too long, c would only do for a node of level 3 */
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_litemesh_parent_selector_failover(selector, 3001, 2, 3000, &result));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_parent_selector_failover(selector, 3001, 3, 3000, &result));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(c.bssid, result.bssid, 6);
+    esp_litemesh_parent_selector_delete(selector);
+}
+#endif
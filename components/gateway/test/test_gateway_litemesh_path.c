@@ -0,0 +1,91 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LITEMESH_PATH_METRICS
+#include "esp_gateway_litemesh_path.h"
+
+static const esp_litemesh_path_config_t test_config = {
+    .small_len = 32,
+    .large_len = 1032,
+    .window = 4,
+};
+
+TEST_CASE("litemesh path: link estimated from two probe sizes", "[gateway]")
+{
+    esp_litemesh_path_estimator_t* estimator = esp_litemesh_path_estimator_create(&test_config);
+    esp_litemesh_path_metric_t link;
+    esp_litemesh_path_estimator_stats_t stats;
+
+    TEST_ASSERT_NOT_NULL(estimator);
+    TEST_ASSERT_NULL(esp_litemesh_path_estimator_create(&(esp_litemesh_path_config_t) { 32, 32, 4 }));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_path_estimator_sample(estimator, 32, 2000));
+    TEST_ASSERT_FALSE(esp_litemesh_path_estimator_get(estimator, &link));
+
+    /* 16000 bits in 1.6 ms are 10 Mbit/s, the queued probe does not count */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_path_estimator_sample(estimator, 1032, 9000));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_path_estimator_sample(estimator, 1032, 3600));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_litemesh_path_estimator_sample(estimator, 100, 3600));
+    TEST_ASSERT_TRUE(esp_litemesh_path_estimator_get(estimator, &link));
+    TEST_ASSERT_EQUAL(2000, link.rtt_us);
+    TEST_ASSERT_EQUAL(10000, link.kbps);
+
+    /* The RTT is smoothed */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_path_estimator_sample(estimator, 32, 10000));
+    TEST_ASSERT_TRUE(esp_litemesh_path_estimator_get(estimator, &link));
+    TEST_ASSERT_EQUAL(3000, link.rtt_us);
+    TEST_ASSERT_EQUAL(10000, link.kbps);
+
+    esp_litemesh_path_estimator_loss(estimator);
+    esp_litemesh_path_estimator_get_stats(estimator, &stats);
+    TEST_ASSERT_EQUAL(4, stats.samples);
+    TEST_ASSERT_EQUAL(1, stats.losses);
+
+    esp_litemesh_path_estimator_reset(estimator);
+    TEST_ASSERT_FALSE(esp_litemesh_path_estimator_get(estimator, &link));
+    esp_litemesh_path_estimator_delete(estimator);
+}
+
+TEST_CASE("litemesh path: path extended link by link", "[gateway]")
+{
+    esp_litemesh_path_metric_t parent = { .rtt_us = 4000, .kbps = 8000 };
+    esp_litemesh_path_metric_t link = { .rtt_us = 1500, .kbps = 20000 };
+    esp_litemesh_path_metric_t unknown = { 0 };
+    esp_litemesh_path_metric_t path;
+
+    esp_litemesh_path_combine(&parent, &link, &path);
+    TEST_ASSERT_EQUAL(5500, path.rtt_us);
+    TEST_ASSERT_EQUAL(8000, path.kbps);
+
+    /* A root, or a parent which does not tell its path */
+    esp_litemesh_path_combine(NULL, &link, &path);
+    TEST_ASSERT_EQUAL(1500, path.rtt_us);
+    esp_litemesh_path_combine(&unknown, &link, &path);
+    TEST_ASSERT_EQUAL(20000, path.kbps);
+
+    path = parent;
+    path.rtt_us += 500;
+    TEST_ASSERT_FALSE(esp_litemesh_path_changed(&parent, &path));
+    path.rtt_us += 1;
+    TEST_ASSERT_TRUE(esp_litemesh_path_changed(&parent, &path));
+    path = parent;
+    path.kbps = 6900;
+    TEST_ASSERT_TRUE(esp_litemesh_path_changed(&parent, &path));
+    TEST_ASSERT_TRUE(esp_litemesh_path_changed(&unknown, &parent));
+}
+#endif
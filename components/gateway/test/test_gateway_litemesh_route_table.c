@@ -0,0 +1,102 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LITEMESH_ENABLE
+#include "esp_netif_ip_addr.h"
+#include "esp_gateway_litemesh_route_table.h"
+
+static const uint8_t test_child_a[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0a };
+static const uint8_t test_child_b[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x0b };
+
+TEST_CASE("litemesh route table: children announce their subtrees", "[gateway]")
+{
+    esp_litemesh_route_table_t* table = esp_litemesh_route_table_create(2, 5000);
+    esp_litemesh_route_table_stats_t stats;
+    esp_litemesh_route_t routes[4];
+    const uint8_t subtree_a[] = { 5, 7, 8 };
+    const uint8_t subtree_b[] = { 6, 7 };
+    uint32_t next_hop = 0;
+    bool changed = false;
+
+    TEST_ASSERT_NOT_NULL(table);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_a, ESP_IP4TOADDR(192, 168, 4, 2), subtree_a, 3, 0, &changed));
+    TEST_ASSERT_TRUE(changed);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_a, ESP_IP4TOADDR(192, 168, 4, 2), subtree_a, 3, 100, &changed));
+    TEST_ASSERT_FALSE(changed);
+
+    /* The first child announcing a segment keeps it */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_b, ESP_IP4TOADDR(192, 168, 4, 3), subtree_b, 2, 100, &changed));
+    TEST_ASSERT_TRUE(changed);
+    TEST_ASSERT_TRUE(esp_litemesh_route_table_lookup(table, 7, &next_hop));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 2), next_hop);
+    TEST_ASSERT_TRUE(esp_litemesh_route_table_lookup(table, 6, &next_hop));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 3), next_hop);
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_lookup(table, 9, &next_hop));
+
+    /* The child stops announcing 7 and gets another address */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_a, ESP_IP4TOADDR(192, 168, 4, 4), subtree_a + 2, 1, 200, &changed));
+    TEST_ASSERT_TRUE(changed);
+    TEST_ASSERT_TRUE(esp_litemesh_route_table_lookup(table, 8, &next_hop));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 4), next_hop);
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_lookup(table, 5, &next_hop));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_b, ESP_IP4TOADDR(192, 168, 4, 3), subtree_b, 2, 200, &changed));
+    TEST_ASSERT_TRUE(changed);
+
+    TEST_ASSERT_EQUAL(3, esp_litemesh_route_table_get_routes(table, routes, 4));
+    TEST_ASSERT_EQUAL(6, routes[0].net_segment);
+    TEST_ASSERT_EQUAL(7, routes[1].net_segment);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 3), routes[1].next_hop);
+    TEST_ASSERT_EQUAL(8, routes[2].net_segment);
+
+    esp_litemesh_route_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(2, stats.next_hops);
+    TEST_ASSERT_EQUAL(3, stats.routes);
+    TEST_ASSERT_EQUAL(1, stats.conflicts);
+    esp_litemesh_route_table_delete(table);
+}
+
+TEST_CASE("litemesh route table: silent and departed children lose their routes", "[gateway]")
+{
+    esp_litemesh_route_table_t* table = esp_litemesh_route_table_create(1, 5000);
+    esp_litemesh_route_table_stats_t stats;
+    const uint8_t subtree[] = { 5, 6 };
+    uint32_t next_hop = 0;
+
+    TEST_ASSERT_NULL(esp_litemesh_route_table_create(ESP_LITEMESH_ROUTE_TABLE_MAX_NEXT_HOPS + 1, 5000));
+    TEST_ASSERT_NOT_NULL(table);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_a, ESP_IP4TOADDR(192, 168, 4, 2), subtree, 2, 1000, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_litemesh_route_table_update(table, test_child_b, ESP_IP4TOADDR(192, 168, 4, 3), subtree, 1, 1000, NULL));
+
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_expire(table, 6000));
+    TEST_ASSERT_TRUE(esp_litemesh_route_table_expire(table, 6001));
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_lookup(table, 5, &next_hop));
+
+    /* The freed next hop takes the other child */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_litemesh_route_table_update(table, test_child_b, ESP_IP4TOADDR(192, 168, 4, 3), subtree, 1, 7000, NULL));
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_remove(table, test_child_a));
+    TEST_ASSERT_TRUE(esp_litemesh_route_table_remove(table, test_child_b));
+    TEST_ASSERT_FALSE(esp_litemesh_route_table_lookup(table, 5, &next_hop));
+
+    esp_litemesh_route_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(0, stats.next_hops);
+    TEST_ASSERT_EQUAL(0, stats.routes);
+    TEST_ASSERT_EQUAL(1, stats.expirations);
+    esp_litemesh_route_table_delete(table);
+}
+#endif
@@ -0,0 +1,100 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_mac_alloc.h"
+
+#define TEST_INTERFACE_PER_ROLE     (100)
+
+static const uint8_t s_base_mac[6] = { 0x7c, 0xdf, 0xa1, 0x00, 0x12, 0x34 };
+
+static const esp_gateway_mac_role_t s_roles[] = {
+    ESP_GATEWAY_MAC_ROLE_USB,
+    ESP_GATEWAY_MAC_ROLE_SPI,
+    ESP_GATEWAY_MAC_ROLE_SDIO,
+    ESP_GATEWAY_MAC_ROLE_SOFTAP,
+    ESP_GATEWAY_MAC_ROLE_ETH,
+};
+
+#define TEST_ROLE_NUM   (sizeof(s_roles) / sizeof(s_roles[0]))
+
+static uint8_t s_macs[TEST_ROLE_NUM][TEST_INTERFACE_PER_ROLE][6];
+
+TEST_CASE("mac allocator derives unique and stable addresses", "[gateway]")
+{
+    esp_gateway_mac_allocator_t* allocator = esp_gateway_mac_allocator_create(s_base_mac, TEST_ROLE_NUM * TEST_INTERFACE_PER_ROLE + 1);
+    uint8_t mac[6];
+    TEST_ASSERT_NOT_NULL(allocator);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_reserve(allocator, s_base_mac));
+
+    for (uint32_t role = 0; role < TEST_ROLE_NUM; role++) {
+        for (uint32_t index = 0; index < TEST_INTERFACE_PER_ROLE; index++) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, s_roles[role], index, mac));
+            TEST_ASSERT_FALSE(esp_gateway_mac_allocator_is_used(allocator, mac));
+            /* Locally administered unicast */
+            TEST_ASSERT_EQUAL(0x02, mac[0] & 0x03);
+            TEST_ASSERT_EQUAL_MEMORY(s_base_mac + 1, mac + 1, 2);
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_reserve(allocator, mac));
+            memcpy(s_macs[role][index], mac, sizeof(mac));
+        }
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_gateway_mac_allocator_reserve(allocator, (uint8_t[6]) { 0x02, 1, 2, 3, 4, 5 }));
+    esp_gateway_mac_allocator_delete(allocator);
+
+    /* After a "reboot", the interfaces get the same addresses whatever the creation order */
+    allocator = esp_gateway_mac_allocator_create(s_base_mac, TEST_ROLE_NUM * TEST_INTERFACE_PER_ROLE);
+    TEST_ASSERT_NOT_NULL(allocator);
+    for (int32_t role = TEST_ROLE_NUM - 1; role >= 0; role--) {
+        for (int32_t index = TEST_INTERFACE_PER_ROLE - 1; index >= 0; index--) {
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, s_roles[role], index, mac));
+            TEST_ASSERT_EQUAL_MEMORY(s_macs[role][index], mac, sizeof(mac));
+            TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_reserve(allocator, mac));
+        }
+    }
+
+    /* Releasing brings the address back */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_release(allocator, s_macs[0][0]));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_mac_allocator_release(allocator, s_macs[0][0]));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, s_roles[0], 0, mac));
+    TEST_ASSERT_EQUAL_MEMORY(s_macs[0][0], mac, sizeof(mac));
+    esp_gateway_mac_allocator_delete(allocator);
+}
+
+TEST_CASE("mac allocator skips addresses in use within bounded attempts", "[gateway]")
+{
+    esp_gateway_mac_allocator_t* allocator = esp_gateway_mac_allocator_create(s_base_mac, ESP_GATEWAY_MAC_ALLOC_MAX_ATTEMPTS + 1);
+    uint8_t first[6];
+    uint8_t mac[6];
+    TEST_ASSERT_NOT_NULL(allocator);
+
+    /* A custom MAC set by the user takes the address the USB netif would get */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_USB, 0, first));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_reserve(allocator, first));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_USB, 0, mac));
+    TEST_ASSERT_NOT_EQUAL(0, memcmp(first, mac, sizeof(mac)));
+
+    for (uint32_t attempt = 1; attempt < ESP_GATEWAY_MAC_ALLOC_MAX_ATTEMPTS; attempt++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_USB, 0, mac));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_reserve(allocator, mac));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_USB, 0, mac));
+
+    /* Other interfaces are not affected */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_USB, 1, mac));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_gateway_mac_allocator_derive(allocator, ESP_GATEWAY_MAC_ROLE_MAX, 0, mac));
+    esp_gateway_mac_allocator_delete(allocator);
+}
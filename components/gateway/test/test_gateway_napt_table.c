@@ -0,0 +1,345 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "esp_timer.h"
+
+#include "esp_gateway_napt_table.h"
+
+#define TEST_PORT_MIN       (32768)
+#define TEST_PORT_MAX       (49151)
+#define TEST_REMOTE_ADDR    (0x0101A8C0)    /* 192.168.1.1 */
+
+#define test_htons(x)       ((uint16_t)((((x) & 0xFF) << 8) | (((x) >> 8) & 0xFF)))
+
+static esp_gateway_napt_table_config_t test_config(uint32_t capacity)
+{
+    esp_gateway_napt_table_config_t config = {
+        .capacity = capacity,
+        .port_min = TEST_PORT_MIN,
+        .port_max = TEST_PORT_MAX,
+        .timeout_ms = {
+            [ESP_GATEWAY_NAPT_PROTO_TCP] = 60000,
+            [ESP_GATEWAY_NAPT_PROTO_UDP] = 10000,
+            [ESP_GATEWAY_NAPT_PROTO_ICMP] = 1000,
+        },
+        .tcp_closing_timeout_ms = 2000,
+        .hash_seed = 0x5EED,
+    };
+
+    return config;
+}
+
+/* Flow n: inside host 192.168.4.(2 + n % 200), port 1024 + n, to a remote host port 443 */
+static esp_gateway_napt_tuple_t test_tuple(uint32_t n, uint8_t proto)
+{
+    esp_gateway_napt_tuple_t tuple = {
+        .src_addr = 0x0004A8C0 | ((2 + n % 200) << 24),
+        .dest_addr = 0x0A00000A + ((n / 200) << 24),
+        .src_port = test_htons(1024 + n),
+        .dest_port = (proto == ESP_GATEWAY_NAPT_PROTO_ICMP) ? 0 : test_htons(443),
+        .proto = proto,
+    };
+
+    return tuple;
+}
+
+TEST_CASE("napt table translates both directions", "[gateway]")
+{
+    esp_gateway_napt_table_config_t config = test_config(64);
+    esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+    TEST_ASSERT_NOT_NULL(table);
+
+    for (uint32_t n = 0; n < 48; n++) {
+        uint8_t proto = n % ESP_GATEWAY_NAPT_PROTO_MAX;
+        esp_gateway_napt_tuple_t tuple = test_tuple(n, proto);
+
+        TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &tuple, 0));
+        esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_insert(table, &tuple, 0);
+        TEST_ASSERT_NOT_NULL(mapping);
+        TEST_ASSERT_TRUE(test_htons(mapping->mport) >= TEST_PORT_MIN && test_htons(mapping->mport) <= TEST_PORT_MAX);
+        TEST_ASSERT_EQUAL_PTR(mapping, esp_gateway_napt_table_lookup_inside(table, &tuple, 10));
+        TEST_ASSERT_EQUAL_PTR(mapping, esp_gateway_napt_table_lookup_outside(table, proto, mapping->mport,
+                                                                             tuple.dest_addr, tuple.dest_port, 20));
+        /* Another remote endpoint or protocol does not match */
+        TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_outside(table, proto, mapping->mport, TEST_REMOTE_ADDR, tuple.dest_port, 20));
+        TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_outside(table, (proto + 1) % ESP_GATEWAY_NAPT_PROTO_MAX, mapping->mport,
+                                                               tuple.dest_addr, tuple.dest_port, 20));
+    }
+
+    /* Two inside hosts using the same port to the same remote endpoint get different outside ports */
+    esp_gateway_napt_tuple_t first = test_tuple(0, ESP_GATEWAY_NAPT_PROTO_UDP);
+    esp_gateway_napt_tuple_t second = first;
+    first.dest_addr = second.dest_addr = TEST_REMOTE_ADDR;
+    first.src_port = second.src_port = test_htons(40000);
+    second.src_addr ^= 0x01000000;
+    esp_gateway_napt_mapping_t* first_mapping = esp_gateway_napt_table_insert(table, &first, 30);
+    esp_gateway_napt_mapping_t* second_mapping = esp_gateway_napt_table_insert(table, &second, 30);
+    TEST_ASSERT_NOT_NULL(first_mapping);
+    TEST_ASSERT_NOT_NULL(second_mapping);
+    TEST_ASSERT_EQUAL(test_htons(40000), first_mapping->mport);
+    TEST_ASSERT_NOT_EQUAL(first_mapping->mport, second_mapping->mport);
+
+    uint32_t generation = first_mapping->generation;
+    TEST_ASSERT_NOT_EQUAL(0, generation);
+    TEST_ASSERT_NOT_EQUAL(generation, second_mapping->generation);
+    TEST_ASSERT_TRUE(esp_gateway_napt_table_touch(table, first_mapping, generation, 35));
+    esp_gateway_napt_table_remove(table, first_mapping);
+    TEST_ASSERT_FALSE(esp_gateway_napt_table_touch(table, first_mapping, generation, 36));
+    TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &first, 40));
+    TEST_ASSERT_EQUAL_PTR(second_mapping, esp_gateway_napt_table_lookup_inside(table, &second, 40));
+
+    esp_gateway_napt_table_flush(table);
+    TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &second, 50));
+
+    esp_gateway_napt_table_stats_t stats;
+    esp_gateway_napt_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(64, stats.capacity);
+    TEST_ASSERT_EQUAL(0, stats.active);
+    TEST_ASSERT_EQUAL(50, stats.inserts);
+
+    esp_gateway_napt_table_delete(table);
+}
+
+TEST_CASE("napt table evicts the least recently used flow", "[gateway]")
+{
+    esp_gateway_napt_table_config_t config = test_config(16);
+    esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+    esp_gateway_napt_tuple_t tuples[17];
+    esp_gateway_napt_table_stats_t stats;
+    TEST_ASSERT_NOT_NULL(table);
+
+    for (uint32_t n = 0; n < 16; n++) {
+        tuples[n] = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_TCP);
+        TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuples[n], n));
+    }
+
+    /* Flow 0 is used again, so flow 1 is the least recently used one */
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &tuples[0], 100));
+    tuples[16] = test_tuple(16, ESP_GATEWAY_NAPT_PROTO_TCP);
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuples[16], 101));
+
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &tuples[0], 102));
+    TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &tuples[1], 102));
+    for (uint32_t n = 2; n < 17; n++) {
+        TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &tuples[n], 103));
+    }
+
+    esp_gateway_napt_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(16, stats.active);
+    TEST_ASSERT_EQUAL(1, stats.evictions);
+    TEST_ASSERT_EQUAL(0, stats.expirations);
+    TEST_ASSERT_EQUAL(18, stats.lookups);
+    TEST_ASSERT_EQUAL(17, stats.hits);
+
+    esp_gateway_napt_table_delete(table);
+}
+
+TEST_CASE("napt table expires flows per protocol", "[gateway]")
+{
+    esp_gateway_napt_table_config_t config = test_config(16);
+    esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+    esp_gateway_napt_tuple_t tcp = test_tuple(0, ESP_GATEWAY_NAPT_PROTO_TCP);
+    esp_gateway_napt_tuple_t tcp_closing = test_tuple(1, ESP_GATEWAY_NAPT_PROTO_TCP);
+    esp_gateway_napt_tuple_t udp = test_tuple(2, ESP_GATEWAY_NAPT_PROTO_UDP);
+    esp_gateway_napt_tuple_t icmp = test_tuple(3, ESP_GATEWAY_NAPT_PROTO_ICMP);
+    esp_gateway_napt_table_stats_t stats;
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* Start close to the wrap around of the millisecond counter */
+    uint32_t start = 0xFFFFF000;
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tcp, start));
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tcp_closing, start));
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &udp, start));
+    esp_gateway_napt_mapping_t* icmp_mapping = esp_gateway_napt_table_insert(table, &icmp, start);
+    TEST_ASSERT_NOT_NULL(icmp_mapping);
+    esp_gateway_napt_table_lookup_inside(table, &tcp_closing, start)->tcp_closing = true;
+
+    TEST_ASSERT_EQUAL(0, esp_gateway_napt_table_expire(table, start + 1000, 16));
+    TEST_ASSERT_EQUAL(1, esp_gateway_napt_table_expire(table, start + 1001, 16));
+    TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &icmp, start + 1001));
+
+    /* A lookup of an expired flow drops it */
+    TEST_ASSERT_NULL(esp_gateway_napt_table_lookup_inside(table, &tcp_closing, start + 2001));
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &udp, start + 9000));
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &udp, start + 18000));
+    TEST_ASSERT_EQUAL(0, esp_gateway_napt_table_expire(table, start + 18000, 16));
+    TEST_ASSERT_EQUAL(1, esp_gateway_napt_table_expire(table, start + 28001, 16));
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_inside(table, &tcp, start + 59000));
+
+    esp_gateway_napt_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(1, stats.active);
+    TEST_ASSERT_EQUAL(3, stats.expirations);
+    TEST_ASSERT_EQUAL(0, stats.evictions);
+
+    esp_gateway_napt_table_delete(table);
+}
+
+TEST_CASE("napt table refuses flows when no outside port is free", "[gateway]")
+{
+    esp_gateway_napt_table_config_t config = test_config(32);
+    esp_gateway_napt_table_stats_t stats;
+    config.port_min = 40000;
+    config.port_max = 40003;
+    esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+    TEST_ASSERT_NOT_NULL(table);
+
+    for (uint32_t n = 0; n < 5; n++) {
+        esp_gateway_napt_tuple_t tuple = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_UDP);
+        tuple.dest_addr = TEST_REMOTE_ADDR;
+        esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_insert(table, &tuple, 0);
+        if (n < 4) {
+            TEST_ASSERT_NOT_NULL(mapping);
+        } else {
+            TEST_ASSERT_NULL(mapping);
+        }
+    }
+
+    /* The same ports are still free for another remote endpoint */
+    esp_gateway_napt_tuple_t tuple = test_tuple(5, ESP_GATEWAY_NAPT_PROTO_UDP);
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuple, 0));
+
+    esp_gateway_napt_table_get_stats(table, &stats);
+    TEST_ASSERT_EQUAL(5, stats.active);
+    TEST_ASSERT_EQUAL(1, stats.insert_failures);
+
+    esp_gateway_napt_table_delete(table);
+}
+
+TEST_CASE("napt table leaves the replies of a port mapping to lwIP", "[gateway]")
+{
+    esp_gateway_napt_table_config_t config = test_config(32);
+    config.port_min = 40000;
+    config.port_max = 40001;
+    esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* The web server of the inside host 192.168.4.2 is reached at port 40000 of the uplink */
+    esp_gateway_napt_tuple_t reply = test_tuple(0, ESP_GATEWAY_NAPT_PROTO_TCP);
+    reply.src_port = test_htons(80);
+    reply.dest_addr = TEST_REMOTE_ADDR;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_napt_table_portmap_add(table, ESP_GATEWAY_NAPT_PROTO_TCP, test_htons(40000),
+                                                                 reply.src_addr, reply.src_port));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_gateway_napt_table_portmap_add(table, ESP_GATEWAY_NAPT_PROTO_ICMP, test_htons(40000),
+                                                                              reply.src_addr, reply.src_port));
+
+    /* The SYN-ACK of the server is translated by the port mapping, not by a mapping of its own */
+    TEST_ASSERT_TRUE(esp_gateway_napt_table_portmap_match(table, &reply));
+    reply.proto = ESP_GATEWAY_NAPT_PROTO_UDP;
+    TEST_ASSERT_FALSE(esp_gateway_napt_table_portmap_match(table, &reply));
+    reply.proto = ESP_GATEWAY_NAPT_PROTO_TCP;
+    reply.src_port = test_htons(81);
+    TEST_ASSERT_FALSE(esp_gateway_napt_table_portmap_match(table, &reply));
+
+    /* The mapped outside port is never given to a connection of the same protocol */
+    for (uint32_t n = 1; n < 3; n++) {
+        esp_gateway_napt_tuple_t tuple = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_TCP);
+        tuple.src_port = test_htons(40000);
+        tuple.dest_addr = TEST_REMOTE_ADDR;
+        esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_insert(table, &tuple, 0);
+        if (n == 1) {
+            TEST_ASSERT_NOT_NULL(mapping);
+            TEST_ASSERT_EQUAL(test_htons(40001), mapping->mport);
+        } else {
+            TEST_ASSERT_NULL(mapping);
+        }
+    }
+    esp_gateway_napt_tuple_t udp = test_tuple(3, ESP_GATEWAY_NAPT_PROTO_UDP);
+    udp.src_port = test_htons(40000);
+    esp_gateway_napt_mapping_t* udp_mapping = esp_gateway_napt_table_insert(table, &udp, 0);
+    TEST_ASSERT_NOT_NULL(udp_mapping);
+    TEST_ASSERT_EQUAL(test_htons(40000), udp_mapping->mport);
+
+    /* Once removed, the port is free again */
+    reply.src_port = test_htons(80);
+    esp_gateway_napt_table_portmap_remove(table, ESP_GATEWAY_NAPT_PROTO_TCP, test_htons(40000));
+    TEST_ASSERT_FALSE(esp_gateway_napt_table_portmap_match(table, &reply));
+    esp_gateway_napt_tuple_t tuple = test_tuple(2, ESP_GATEWAY_NAPT_PROTO_TCP);
+    tuple.src_port = test_htons(40000);
+    tuple.dest_addr = TEST_REMOTE_ADDR;
+    TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuple, 0));
+
+    /* At most ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS port mappings, replacing one does not take a slot */
+    for (uint32_t n = 0; n < ESP_GATEWAY_NAPT_TABLE_MAX_PORTMAPS; n++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_napt_table_portmap_add(table, ESP_GATEWAY_NAPT_PROTO_UDP, test_htons(1000 + n),
+                                                                     reply.src_addr, test_htons(2000 + n)));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_napt_table_portmap_add(table, ESP_GATEWAY_NAPT_PROTO_UDP, test_htons(1000),
+                                                                 reply.src_addr, test_htons(3000)));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_gateway_napt_table_portmap_add(table, ESP_GATEWAY_NAPT_PROTO_TCP, test_htons(1000),
+                                                                         reply.src_addr, test_htons(3000)));
+    reply.proto = ESP_GATEWAY_NAPT_PROTO_UDP;
+    reply.src_port = test_htons(3000);
+    TEST_ASSERT_TRUE(esp_gateway_napt_table_portmap_match(table, &reply));
+    reply.src_port = test_htons(2000);
+    TEST_ASSERT_FALSE(esp_gateway_napt_table_portmap_match(table, &reply));
+
+    esp_gateway_napt_table_delete(table);
+}
+
+TEST_CASE("napt table performance with 1k to 8k flows", "[gateway]")
+{
+    static const uint32_t flow_nums[] = { 1024, 2048, 4096, 8192 };
+    const uint32_t lookup_rounds = 4;
+
+    for (uint32_t loop = 0; loop < sizeof(flow_nums) / sizeof(flow_nums[0]); loop++) {
+        uint32_t flow_num = flow_nums[loop];
+        esp_gateway_napt_table_config_t config = test_config(flow_num);
+        esp_gateway_napt_table_t* table = esp_gateway_napt_table_create(&config);
+        esp_gateway_napt_table_stats_t stats;
+        TEST_ASSERT_NOT_NULL(table);
+
+        int64_t start = esp_timer_get_time();
+        for (uint32_t n = 0; n < flow_num; n++) {
+            esp_gateway_napt_tuple_t tuple = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_TCP);
+            TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuple, 0));
+        }
+        int64_t insert_us = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        for (uint32_t round = 0; round < lookup_rounds; round++) {
+            for (uint32_t n = 0; n < flow_num; n++) {
+                esp_gateway_napt_tuple_t tuple = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_TCP);
+                esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_lookup_inside(table, &tuple, 1);
+                TEST_ASSERT_NOT_NULL(mapping);
+                TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_lookup_outside(table, ESP_GATEWAY_NAPT_PROTO_TCP, mapping->mport,
+                                                                           tuple.dest_addr, tuple.dest_port, 1));
+            }
+        }
+        int64_t lookup_us = esp_timer_get_time() - start;
+
+        /* Churn: each new connection evicts the least recently used one */
+        start = esp_timer_get_time();
+        for (uint32_t n = flow_num; n < flow_num * 2; n++) {
+            esp_gateway_napt_tuple_t tuple = test_tuple(n, ESP_GATEWAY_NAPT_PROTO_TCP);
+            TEST_ASSERT_NOT_NULL(esp_gateway_napt_table_insert(table, &tuple, 2));
+        }
+        int64_t churn_us = esp_timer_get_time() - start;
+
+        esp_gateway_napt_table_get_stats(table, &stats);
+        TEST_ASSERT_EQUAL(flow_num, stats.active);
+        TEST_ASSERT_EQUAL(flow_num, stats.evictions);
+        TEST_ASSERT_EQUAL(stats.lookups, stats.hits);
+
+        printf("%5u flows: %8llu new conn/s, %8llu conn/s with eviction, %5llu ns per lookup\n", (unsigned)flow_num,
+               (unsigned long long)(flow_num * 1000000ULL / (insert_us ? insert_us : 1)),
+               (unsigned long long)(flow_num * 1000000ULL / (churn_us ? churn_us : 1)),
+               (unsigned long long)(lookup_us * 1000ULL / (flow_num * lookup_rounds * 2)));
+
+        esp_gateway_napt_table_delete(table);
+    }
+}
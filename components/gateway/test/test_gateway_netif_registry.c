@@ -0,0 +1,122 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "esp_gateway_netif_registry.h"
+
+#define TAG "test_registry"
+
+#define BENCHMARK_LOOP_TIMES    (200)
+
+/* The registry only uses the handle as a key, fake handles are enough */
+static uint32_t s_fake_netif[ESP_GATEWAY_NETIF_REGISTRY_MAX_CAPACITY];
+
+#define FAKE_NETIF(i) ((esp_netif_t*)&s_fake_netif[i])
+
+static void fill_entry(esp_gateway_netif_entry_t* entry, uint32_t i)
+{
+    memset(entry, 0, sizeof(esp_gateway_netif_entry_t));
+    entry->netif = FAKE_NETIF(i);
+    entry->role = (i == 0) ? ESP_GATEWAY_NETIF_ROLE_EXTERNAL : ESP_GATEWAY_NETIF_ROLE_DHCPS;
+    entry->ip_info.ip.addr = ESP_IP4TOADDR(192, 168, 4 + i, 1);
+    entry->mac[0] = 0x02;
+    entry->mac[5] = i;
+}
+
+TEST_CASE("netif registry add, update and remove", "[gateway]")
+{
+    esp_gateway_netif_registry_t* registry = esp_gateway_netif_registry_create(4);
+    esp_gateway_netif_entry_t entry;
+    esp_gateway_netif_entry_t entries[4];
+    esp_netif_ip_info_t ip_info = { 0 };
+    TEST_ASSERT_NOT_NULL(registry);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        fill_entry(&entry, i);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_netif_registry_add(registry, &entry));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_gateway_netif_registry_add(registry, &entry));
+    fill_entry(&entry, 4);
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_gateway_netif_registry_add(registry, &entry));
+
+    TEST_ASSERT_EQUAL(1, esp_gateway_netif_registry_snapshot(registry, ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_EXTERNAL), entries, 4));
+    TEST_ASSERT_EQUAL(3, esp_gateway_netif_registry_snapshot(registry, ESP_GATEWAY_NETIF_ROLE_BIT(ESP_GATEWAY_NETIF_ROLE_DHCPS), entries, 4));
+
+    /* Move the second netif to 192.168.8.1 */
+    ip_info.ip.addr = ESP_IP4TOADDR(192, 168, 8, 1);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_netif_registry_update(registry, FAKE_NETIF(1), &ip_info, NULL, NULL));
+    TEST_ASSERT_TRUE(esp_gateway_netif_registry_find(registry, FAKE_NETIF(1), &entry));
+    TEST_ASSERT_EQUAL_HEX32(ip_info.ip.addr, entry.ip_info.ip.addr);
+
+    /* Removing keeps the add order of the others */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_netif_registry_remove(registry, FAKE_NETIF(0), NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_netif_registry_remove(registry, FAKE_NETIF(0), NULL));
+    TEST_ASSERT_FALSE(esp_gateway_netif_registry_find(registry, FAKE_NETIF(0), NULL));
+    fill_entry(&entry, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_netif_registry_add(registry, &entry));
+    TEST_ASSERT_EQUAL(4, esp_gateway_netif_registry_snapshot(registry, ESP_GATEWAY_NETIF_ROLE_ALL, entries, 4));
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_PTR(FAKE_NETIF((i + 1) % 4), entries[i].netif);
+    }
+
+    esp_gateway_netif_registry_delete(registry);
+}
+
+TEST_CASE("netif registry performance", "[gateway][timeout=60]")
+{
+    const uint32_t netif_num[] = { 8, 16, 32, 64 };
+    esp_gateway_netif_entry_t entry;
+
+    for (uint32_t n = 0; n < sizeof(netif_num) / sizeof(netif_num[0]); n++) {
+        uint32_t num = netif_num[n];
+        int64_t add_time = 0;
+        int64_t remove_time = 0;
+        int64_t lookup_time = 0;
+        esp_gateway_netif_registry_t* registry = esp_gateway_netif_registry_create(num);
+        TEST_ASSERT_NOT_NULL(registry);
+
+        for (uint32_t loop = 0; loop < BENCHMARK_LOOP_TIMES; loop++) {
+            int64_t start = esp_timer_get_time();
+            for (uint32_t i = 0; i < num; i++) {
+                fill_entry(&entry, i);
+                esp_gateway_netif_registry_add(registry, &entry);
+            }
+            add_time += esp_timer_get_time() - start;
+
+            start = esp_timer_get_time();
+            for (uint32_t i = 0; i < num; i++) {
+                esp_gateway_netif_registry_find(registry, FAKE_NETIF(i), &entry);
+            }
+            lookup_time += esp_timer_get_time() - start;
+
+            start = esp_timer_get_time();
+            for (uint32_t i = 0; i < num; i++) {
+                esp_gateway_netif_registry_remove(registry, FAKE_NETIF(i), NULL);
+            }
+            remove_time += esp_timer_get_time() - start;
+        }
+
+        TEST_ASSERT_FALSE(esp_gateway_netif_registry_find(registry, FAKE_NETIF(0), NULL));
+        ESP_LOGI(TAG, "%d netifs: add %d ns, lookup %d ns, remove %d ns", num,
+                 (int)(add_time * 1000 / (BENCHMARK_LOOP_TIMES * num)),
+                 (int)(lookup_time * 1000 / (BENCHMARK_LOOP_TIMES * num)),
+                 (int)(remove_time * 1000 / (BENCHMARK_LOOP_TIMES * num)));
+        esp_gateway_netif_registry_delete(registry);
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_subnet_planner.h"
+
+static const esp_gateway_subnet_pool_config_t s_pool_config = {
+    .base.addr = ESP_IP4TOADDR(192, 168, 0, 0),
+    .prefix_len = 16,
+    .subnet_prefix_len = 24,
+    .first_index = 4,
+};
+
+static void set_ip_info(esp_netif_ip_info_t* ip_info, uint32_t ip, uint32_t netmask)
+{
+    ip_info->ip.addr = ip;
+    ip_info->gw.addr = ip;
+    ip_info->netmask.addr = netmask;
+}
+
+TEST_CASE("subnet planner moves all the conflicting netifs in one pass", "[gateway]")
+{
+    esp_gateway_subnet_plan_item_t items[4];
+    esp_netif_ip_info_t occupied[2];
+    memset(items, 0, sizeof(items));
+
+    /* SoftAP, USB, SPI and SDIO on 192.168.4-7 */
+    for (uint32_t i = 0; i < 4; i++) {
+        set_ip_info(&items[i].current, ESP_IP4TOADDR(192, 168, 4 + i, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    }
+
+    /* The station gets 192.168.4.x from the router, and the LiteMesh network uses 192.168.6.0/24 */
+    set_ip_info(&occupied[0], ESP_IP4TOADDR(192, 168, 4, 100), ESP_IP4TOADDR(255, 255, 255, 0));
+    set_ip_info(&occupied[1], ESP_IP4TOADDR(192, 168, 6, 0), ESP_IP4TOADDR(255, 255, 255, 0));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_plan(&s_pool_config, occupied, 2, items, 4));
+    TEST_ASSERT_TRUE(items[0].changed);
+    TEST_ASSERT_FALSE(items[1].changed);
+    TEST_ASSERT_TRUE(items[2].changed);
+    TEST_ASSERT_FALSE(items[3].changed);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 8, 1), items[0].planned.ip.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 9, 1), items[2].planned.ip.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 5, 1), items[1].planned.ip.addr);
+
+    /* Planning again on the result changes nothing */
+    for (uint32_t i = 0; i < 4; i++) {
+        items[i].current = items[i].planned;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_plan(&s_pool_config, occupied, 2, items, 4));
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_FALSE(items[i].changed);
+    }
+}
+
+TEST_CASE("subnet planner handles duplicated, unset and custom subnets", "[gateway]")
+{
+    esp_gateway_subnet_plan_item_t items[3];
+    memset(items, 0, sizeof(items));
+
+    /* Two netifs share 192.168.4.0/24, the third one has no IP, the custom 192.168.1.0/24 is kept */
+    set_ip_info(&items[0].current, ESP_IP4TOADDR(192, 168, 4, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    set_ip_info(&items[1].current, ESP_IP4TOADDR(192, 168, 4, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_plan(&s_pool_config, NULL, 0, items, 3));
+    TEST_ASSERT_FALSE(items[0].changed);
+    TEST_ASSERT_TRUE(items[1].changed);
+    TEST_ASSERT_TRUE(items[2].changed);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 5, 1), items[1].planned.ip.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 6, 1), items[2].planned.ip.addr);
+
+    set_ip_info(&items[0].current, ESP_IP4TOADDR(192, 168, 1, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_plan(&s_pool_config, NULL, 0, items, 1));
+    TEST_ASSERT_FALSE(items[0].changed);
+}
+
+TEST_CASE("subnet planner leaves everything unchanged when the pool is exhausted", "[gateway]")
+{
+    esp_gateway_subnet_pool_config_t config = s_pool_config;
+    esp_gateway_subnet_plan_item_t items[2];
+    esp_netif_ip_info_t occupied;
+    memset(items, 0, sizeof(items));
+
+    /* The router hands out a whole /16 which covers the pool */
+    set_ip_info(&occupied, ESP_IP4TOADDR(192, 168, 4, 100), ESP_IP4TOADDR(255, 255, 0, 0));
+    set_ip_info(&items[0].current, ESP_IP4TOADDR(192, 168, 4, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    set_ip_info(&items[1].current, ESP_IP4TOADDR(10, 0, 0, 1), ESP_IP4TOADDR(255, 255, 255, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_subnet_plan(&config, &occupied, 1, items, 2));
+    TEST_ASSERT_FALSE(items[0].changed);
+    TEST_ASSERT_FALSE(items[1].changed);
+    TEST_ASSERT_EQUAL_HEX32(items[0].current.ip.addr, items[0].planned.ip.addr);
+
+    /* With a 10.0.0.0/16 pool the first netif moves next to the second one */
+    config.base.addr = ESP_IP4TOADDR(10, 0, 0, 0);
+    config.first_index = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_plan(&config, &occupied, 1, items, 2));
+    TEST_ASSERT_TRUE(items[0].changed);
+    TEST_ASSERT_FALSE(items[1].changed);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(10, 0, 1, 1), items[0].planned.ip.addr);
+}
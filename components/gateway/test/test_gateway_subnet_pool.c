@@ -0,0 +1,103 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_subnet_pool.h"
+
+TEST_CASE("subnet pool allocates the lowest free 192.168.x.0/24", "[gateway]")
+{
+    esp_gateway_subnet_pool_config_t config = {
+        .base.addr = ESP_IP4TOADDR(192, 168, 0, 0),
+        .prefix_len = 16,
+        .subnet_prefix_len = 24,
+        .first_index = 4,
+    };
+    esp_gateway_subnet_pool_t* pool = esp_gateway_subnet_pool_create(&config);
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t ip;
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_EQUAL(252, esp_gateway_subnet_pool_free_count(pool));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 1), ip_info.ip.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 1), ip_info.gw.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(255, 255, 255, 0), ip_info.netmask.addr);
+
+    /* The router gives 192.168.4.x to the station, twice referenced by the station and a mesh node */
+    ip.addr = ESP_IP4TOADDR(192, 168, 4, 100);
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_ref(pool, ip));
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_ref(pool, ip));
+    ip.addr = ESP_IP4TOADDR(192, 168, 5, 1);
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_ref(pool, ip));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 6, 1), ip_info.ip.addr);
+
+    ip.addr = ESP_IP4TOADDR(192, 168, 4, 100);
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_unref(pool, ip));
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_is_used(pool, ip));
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_unref(pool, ip));
+    TEST_ASSERT_FALSE(esp_gateway_subnet_pool_is_used(pool, ip));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(192, 168, 4, 1), ip_info.ip.addr);
+
+    /* Reserved and foreign addresses */
+    ip.addr = ESP_IP4TOADDR(192, 168, 1, 1);
+    TEST_ASSERT_TRUE(esp_gateway_subnet_pool_is_used(pool, ip));
+    ip.addr = ESP_IP4TOADDR(10, 0, 4, 1);
+    TEST_ASSERT_FALSE(esp_gateway_subnet_pool_ref(pool, ip));
+
+    esp_gateway_subnet_pool_delete(pool);
+}
+
+TEST_CASE("subnet pool supports other pools and netmasks", "[gateway]")
+{
+    esp_gateway_subnet_pool_config_t config = {
+        .base.addr = ESP_IP4TOADDR(10, 0, 0, 0),
+        .prefix_len = 16,
+        .subnet_prefix_len = 26,
+        .first_index = 0,
+    };
+    esp_gateway_subnet_pool_t* pool = esp_gateway_subnet_pool_create(&config);
+    esp_netif_ip_info_t ip_info;
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_EQUAL(1024, esp_gateway_subnet_pool_free_count(pool));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(10, 0, 0, 1), ip_info.ip.addr);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(255, 255, 255, 192), ip_info.netmask.addr);
+    esp_gateway_subnet_pool_ref(pool, ip_info.ip);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(10, 0, 0, 65), ip_info.ip.addr);
+    esp_gateway_subnet_pool_delete(pool);
+
+    /* 172.16.0.0/12 split into 4096 /24, allocate all of them */
+    config.base.addr = ESP_IP4TOADDR(172, 16, 0, 0);
+    config.prefix_len = 12;
+    config.subnet_prefix_len = 24;
+    pool = esp_gateway_subnet_pool_create(&config);
+    TEST_ASSERT_NOT_NULL(pool);
+    for (uint32_t i = 0; i < ESP_GATEWAY_SUBNET_POOL_MAX_SUBNETS; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+        TEST_ASSERT_EQUAL_HEX32(ESP_IP4TOADDR(172, 16 + (i >> 8), i & 0xFF, 1), ip_info.ip.addr);
+        esp_gateway_subnet_pool_ref(pool, ip_info.ip);
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_gateway_subnet_pool_alloc(pool, &ip_info));
+    esp_gateway_subnet_pool_delete(pool);
+
+    /* Too many subnets */
+    config.subnet_prefix_len = 25;
+    TEST_ASSERT_NULL(esp_gateway_subnet_pool_create(&config));
+}
@@ -0,0 +1,288 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+
+#include "esp_gateway_napt_table.h"
+#include "esp_gateway_wan_policy.h"
+
+#define TEST_FLOW_NUM       (10000)
+#define TEST_SIM_FLOW_NUM   (60)
+#define TEST_SIM_TICK_MS    (100)
+#define TEST_PROBE_MS       (500)
+#define TEST_FALL_COUNT     (3)
+#define TEST_RISE_COUNT     (2)
+
+static int s_uplink_a;
+static int s_uplink_b;
+static int s_uplink_c;
+
+static esp_gateway_wan_policy_t* test_policy_create(void)
+{
+    esp_gateway_wan_policy_config_t config = {
+        .fall_count = TEST_FALL_COUNT,
+        .rise_count = TEST_RISE_COUNT,
+        .hash_seed = 0x5EED1234,
+    };
+
+    esp_gateway_wan_policy_t* policy = esp_gateway_wan_policy_create(&config);
+    TEST_ASSERT_NOT_NULL(policy);
+
+    return policy;
+}
+
+static void test_tuple(esp_gateway_napt_tuple_t* tuple, uint32_t flow)
+{
+    memset(tuple, 0, sizeof(esp_gateway_napt_tuple_t));
+    tuple->src_addr = 0x0104A8C0 + ((flow % 200) << 24);
+    tuple->dest_addr = 0x08080808 + flow * 7919;
+    tuple->src_port = 1024 + flow;
+    tuple->dest_port = 443;
+    tuple->proto = ESP_GATEWAY_NAPT_PROTO_TCP;
+}
+
+TEST_CASE("wan policy spreads the flows by weight", "[gateway]")
+{
+    esp_gateway_wan_policy_t* policy = test_policy_create();
+    esp_gateway_napt_tuple_t tuple;
+    uint32_t count[ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS] = { 0 };
+    uint8_t a, b;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(policy, &s_uplink_a, 3, &a));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(policy, &s_uplink_b, 1, &b));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_gateway_wan_policy_add(policy, &s_uplink_a, 1, &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_gateway_wan_policy_add(policy, &s_uplink_c, 0, &a));
+
+    /* Links down, nothing to choose from */
+    test_tuple(&tuple, 0);
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_NAPT_UPLINK_NONE, esp_gateway_wan_policy_select(policy, &tuple));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_set_link(policy, a, true, 0));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_set_link(policy, b, true, 0));
+
+    for (uint32_t flow = 0; flow < TEST_FLOW_NUM; flow++) {
+        test_tuple(&tuple, flow);
+        uint8_t index = esp_gateway_wan_policy_select(policy, &tuple);
+        TEST_ASSERT_TRUE(index < ESP_GATEWAY_WAN_POLICY_MAX_UPLINKS);
+        count[index]++;
+        /* The same flow always maps to the same uplink */
+        TEST_ASSERT_EQUAL(index, esp_gateway_wan_policy_select(policy, &tuple));
+    }
+
+    printf("weights 3:1, flows %u:%u\n", (unsigned)count[a], (unsigned)count[b]);
+    TEST_ASSERT_UINT32_WITHIN(TEST_FLOW_NUM * 3 / 100, TEST_FLOW_NUM * 3 / 4, count[a]);
+    TEST_ASSERT_EQUAL(TEST_FLOW_NUM, count[a] + count[b]);
+
+    esp_gateway_wan_policy_delete(policy);
+}
+
+TEST_CASE("wan policy only moves the flows of a failed uplink", "[gateway]")
+{
+    esp_gateway_wan_policy_t* policy = test_policy_create();
+    esp_gateway_napt_tuple_t tuple;
+    static uint8_t before[TEST_FLOW_NUM];
+    uint32_t moved = 0;
+    uint8_t a, b, c;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(policy, &s_uplink_a, 1, &a));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(policy, &s_uplink_b, 2, &b));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(policy, &s_uplink_c, 1, &c));
+    esp_gateway_wan_policy_set_link(policy, a, true, 0);
+    esp_gateway_wan_policy_set_link(policy, b, true, 0);
+    esp_gateway_wan_policy_set_link(policy, c, true, 0);
+
+    for (uint32_t flow = 0; flow < TEST_FLOW_NUM; flow++) {
+        test_tuple(&tuple, flow);
+        before[flow] = esp_gateway_wan_policy_select(policy, &tuple);
+    }
+
+    /* Lost probes fail b after exactly fall_count of them */
+    for (uint32_t loop = 0; loop < TEST_FALL_COUNT - 1; loop++) {
+        TEST_ASSERT_FALSE(esp_gateway_wan_policy_report_probe(policy, b, false, 0, 1000));
+        TEST_ASSERT_TRUE(esp_gateway_wan_policy_usable(policy, b));
+    }
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_report_probe(policy, b, false, 0, 1000));
+    TEST_ASSERT_FALSE(esp_gateway_wan_policy_usable(policy, b));
+
+    for (uint32_t flow = 0; flow < TEST_FLOW_NUM; flow++) {
+        test_tuple(&tuple, flow);
+        uint8_t index = esp_gateway_wan_policy_select(policy, &tuple);
+        TEST_ASSERT_NOT_EQUAL(b, index);
+        if (before[flow] != b) {
+            TEST_ASSERT_EQUAL(before[flow], index);
+        } else {
+            moved++;
+        }
+    }
+    printf("flows moved off the failed uplink: %u/%u\n", (unsigned)moved, TEST_FLOW_NUM);
+    TEST_ASSERT_UINT32_WITHIN(TEST_FLOW_NUM * 3 / 100, TEST_FLOW_NUM / 2, moved);
+
+    /* It comes back after rise_count answered probes, one answer is not enough */
+    TEST_ASSERT_FALSE(esp_gateway_wan_policy_report_probe(policy, b, true, 20, 2000));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_report_probe(policy, b, true, 30, 2000));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_usable(policy, b));
+
+    /* A link going down fails the uplink immediately, and a link coming up starts healthy */
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_set_link(policy, a, false, 3000));
+    TEST_ASSERT_FALSE(esp_gateway_wan_policy_usable(policy, a));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_set_link(policy, a, true, 4000));
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_usable(policy, a));
+
+    esp_gateway_wan_uplink_t uplink;
+    esp_gateway_wan_policy_get_uplink(policy, b, &uplink);
+    TEST_ASSERT_EQUAL(1, uplink.failovers);
+    TEST_ASSERT_EQUAL(TEST_FALL_COUNT + 2, uplink.probes);
+    TEST_ASSERT_EQUAL(TEST_FALL_COUNT, uplink.probes_lost);
+    TEST_ASSERT_EQUAL(21, uplink.rtt_ms);
+
+    esp_gateway_wan_policy_remove(policy, b);
+    TEST_ASSERT_EQUAL(ESP_GATEWAY_NAPT_UPLINK_NONE, esp_gateway_wan_policy_find(policy, &s_uplink_b));
+
+    esp_gateway_wan_policy_delete(policy);
+}
+
+/*
+ * Two emulated uplinks, a at 20 Mbps and b at 10 Mbps with weights 2:1, carry long-lived
+ * flows which each take a fair share of their uplink. The upstream of a dies at fail_ms while
+ * its link stays up, so only the probes tell. The flows are bound to their uplink through the
+ * NAPT mappings, the same way as esp_gateway_multi_wan_egress().
+ */
+typedef struct {
+    esp_gateway_wan_policy_t* policy;
+    esp_gateway_napt_table_t* table;
+    uint32_t capacity_kbps[2];
+    bool alive[2];
+} test_wan_sim_t;
+
+static uint8_t test_sim_egress(test_wan_sim_t* sim, const esp_gateway_napt_tuple_t* tuple, uint32_t now)
+{
+    esp_gateway_napt_mapping_t* mapping = esp_gateway_napt_table_lookup_inside(sim->table, tuple, now);
+
+    if (mapping && !esp_gateway_wan_policy_usable(sim->policy, mapping->uplink)
+        && esp_gateway_wan_policy_any_usable(sim->policy)) {
+        /* The flow starts again on another uplink */
+        esp_gateway_napt_table_remove(sim->table, mapping);
+        mapping = NULL;
+    }
+
+    if (mapping == NULL) {
+        mapping = esp_gateway_napt_table_insert(sim->table, tuple, now);
+        TEST_ASSERT_NOT_NULL(mapping);
+        mapping->uplink = esp_gateway_wan_policy_select(sim->policy, tuple);
+    }
+
+    return mapping->uplink;
+}
+
+/* Aggregate throughput delivered in a tick, in kbps */
+static uint32_t test_sim_tick(test_wan_sim_t* sim, uint32_t now)
+{
+    esp_gateway_napt_tuple_t tuple;
+    uint32_t flows[2] = { 0 };
+    uint32_t kbps = 0;
+
+    for (uint32_t flow = 0; flow < TEST_SIM_FLOW_NUM; flow++) {
+        test_tuple(&tuple, flow);
+        flows[test_sim_egress(sim, &tuple, now)]++;
+    }
+
+    for (uint8_t loop = 0; loop < 2; loop++) {
+        if (sim->alive[loop] && flows[loop]) {
+            kbps += sim->capacity_kbps[loop];
+        }
+    }
+
+    return kbps;
+}
+
+TEST_CASE("wan policy fails over the flows of a dead uplink", "[gateway]")
+{
+    esp_gateway_napt_table_config_t table_config = {
+        .capacity = 256,
+        .port_min = 49152,
+        .port_max = 65535,
+        .timeout_ms = { 60000, 60000, 60000 },
+        .tcp_closing_timeout_ms = 10000,
+        .hash_seed = 1,
+    };
+    test_wan_sim_t sim = {
+        .policy = test_policy_create(),
+        .table = esp_gateway_napt_table_create(&table_config),
+        .capacity_kbps = { 20000, 10000 },
+        .alive = { true, true },
+    };
+    const uint32_t fail_ms = 10000;
+    const uint32_t recover_ms = 20000;
+    const uint32_t end_ms = 30000;
+    uint64_t before_kbps = 0, after_kbps = 0;
+    uint32_t before_ticks = 0, after_ticks = 0;
+    uint32_t restored_ms = 0;
+    uint8_t a, b;
+
+    TEST_ASSERT_NOT_NULL(sim.table);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(sim.policy, &s_uplink_a, 2, &a));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_gateway_wan_policy_add(sim.policy, &s_uplink_b, 1, &b));
+    TEST_ASSERT_EQUAL(0, a);
+    TEST_ASSERT_EQUAL(1, b);
+    esp_gateway_wan_policy_set_link(sim.policy, a, true, 0);
+    esp_gateway_wan_policy_set_link(sim.policy, b, true, 0);
+
+    for (uint32_t now = 0; now < end_ms; now += TEST_SIM_TICK_MS) {
+        sim.alive[a] = (now < fail_ms) || (now >= recover_ms);
+
+        if ((now % TEST_PROBE_MS) == 0) {
+            esp_gateway_wan_policy_report_probe(sim.policy, a, sim.alive[a], 30, now);
+            esp_gateway_wan_policy_report_probe(sim.policy, b, sim.alive[b], 50, now);
+        }
+
+        uint32_t kbps = test_sim_tick(&sim, now);
+        if (now < fail_ms) {
+            before_kbps += kbps;
+            before_ticks++;
+        } else if (now < recover_ms) {
+            if ((restored_ms == 0) && (kbps > 0) && !esp_gateway_wan_policy_usable(sim.policy, a)) {
+                restored_ms = now;
+            }
+            if (restored_ms) {
+                after_kbps += kbps;
+                after_ticks++;
+            }
+        }
+    }
+
+    esp_gateway_wan_uplink_t uplink;
+    esp_gateway_wan_policy_get_uplink(sim.policy, a, &uplink);
+    printf("failover %u ms, aggregate %u kbps before, %u kbps after\n", (unsigned)(restored_ms - fail_ms),
+           (unsigned)(before_kbps / before_ticks), (unsigned)(after_kbps / after_ticks));
+
+    /* Both uplinks carry flows before, all the flows are on b within (fall_count + 1) probes after */
+    TEST_ASSERT_EQUAL(30000, before_kbps / before_ticks);
+    TEST_ASSERT_NOT_EQUAL(0, restored_ms);
+    TEST_ASSERT_TRUE(restored_ms - fail_ms <= TEST_PROBE_MS * (TEST_FALL_COUNT + 1));
+    TEST_ASSERT_EQUAL(10000, after_kbps / after_ticks);
+    TEST_ASSERT_EQUAL(1, uplink.failovers);
+
+    /* a is usable again, but the flows moved to b stay there */
+    TEST_ASSERT_TRUE(esp_gateway_wan_policy_usable(sim.policy, a));
+    esp_gateway_napt_tuple_t tuple;
+    for (uint32_t flow = 0; flow < TEST_SIM_FLOW_NUM; flow++) {
+        test_tuple(&tuple, flow);
+        TEST_ASSERT_EQUAL(b, test_sim_egress(&sim, &tuple, end_ms));
+    }
+
+    esp_gateway_napt_table_delete(sim.table);
+    esp_gateway_wan_policy_delete(sim.policy);
+}
@@ -0,0 +1,284 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <endian.h>
+
+#include "wifi_dongle_adapter.h"
+#include "tx_aggr.h"
+
+/*
+ * Emulated buses from the slave to the host, on a virtual clock in microseconds, with frames always
+ * waiting on the slave. The buffers go through tx_aggr.c and are taken apart as the Linux host driver
+ * does, every frame checked against its checksum and its content.
+ *   - spi: every transaction clocks SPI_BUFFER_SIZE bytes at spi_mhz, plus spi_overhead_us for the
+ *     handshake, the host work and the next transaction of the slave. The slave packs the frames of its
+ *     SPI_TX_QUEUE_SIZE queue behind the first one, as spi_tx_aggregate() does.
+ *   - sdio: the host reads packet after packet, as sdio_tx_bench does: the length register in reg_us, the
+ *     packet in CMD53 of 512 byte blocks and a remainder, each BENCH_CMD53_US and the time of its bytes. The
+ *     slave packs the frames up to half a buffer while send_task has more, as sdio_aggr_write() does.
+ * max_frames 1 is the previous transports, one frame per transaction or packet.
+ */
+
+#define BENCH_HEADER_LEN        (sizeof(struct esp_payload_header))
+#define BENCH_SPI_BUFFER_SIZE   (1600)
+#define BENCH_SPI_QUEUE_SIZE    (10)
+#define BENCH_BLOCK_SIZE        (512)
+#define BENCH_CMD53_US          (10)
+
+#define BENCH_DATA_LEN          (1514)
+#define BENCH_CTRL_LEN          (66)
+#define BENCH_BT_LEN            (259)
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t spi_mhz;
+	uint32_t spi_overhead_us;
+	uint32_t sdio_mbps;
+	uint32_t reg_us;
+} bench_config_t;
+
+typedef struct {
+	uint64_t buffers;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t errors;
+} bench_result_t;
+
+/* A frame waiting on the slave, header and payload in its own buffer */
+typedef struct {
+	uint8_t buf[BENCH_SPI_BUFFER_SIZE];
+	uint16_t len;
+} bench_frame_t;
+
+static const uint16_t s_mix[] = { BENCH_CTRL_LEN, BENCH_CTRL_LEN, BENCH_BT_LEN, BENCH_DATA_LEN };
+
+static uint16_t bench_frame_len(uint16_t len, uint64_t index)
+{
+	return len ? len : s_mix[index % (sizeof(s_mix) / sizeof(s_mix[0]))];
+}
+
+/* The frame of sequence number seq, as the transports build it */
+static void bench_frame_make(bench_frame_t *frame, uint16_t len, uint64_t seq)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) frame->buf;
+
+	memset(header, 0, BENCH_HEADER_LEN);
+	header->if_type = (len == BENCH_BT_LEN) ? ESP_HCI_IF : ESP_STA_IF;
+	header->len = htole16(len);
+	header->offset = htole16(BENCH_HEADER_LEN);
+	header->seq_num = htole16((uint16_t) seq);
+	memset(frame->buf + BENCH_HEADER_LEN, (uint8_t) seq, len);
+	header->checksum = htole16(compute_checksum(frame->buf, BENCH_HEADER_LEN + len));
+	frame->len = len;
+}
+
+/* The host: process_rx_buf() and process_rx_aggregate() of the Linux driver */
+static void bench_host_rx(uint8_t *buf, uint32_t size, uint64_t *seq, bench_result_t *result)
+{
+	uint32_t pos = 0;
+
+	for (;;) {
+		struct esp_payload_header *header = (struct esp_payload_header *) (buf + pos);
+		uint16_t len = le16toh(header->len);
+		uint16_t rx_checksum = le16toh(header->checksum);
+		bool more = header->flags & MORE_FRAMES;
+		uint8_t *payload = buf + pos + BENCH_HEADER_LEN;
+
+		if (pos + BENCH_HEADER_LEN > size || le16toh(header->offset) != BENCH_HEADER_LEN ||
+		    pos + BENCH_HEADER_LEN + len > size) {
+			result->errors++;
+			return;
+		}
+
+		header->checksum = 0;
+		if (compute_checksum(buf + pos, BENCH_HEADER_LEN + len) != rx_checksum ||
+		    le16toh(header->seq_num) != (uint16_t) *seq || payload[0] != (uint8_t) *seq ||
+		    payload[len - 1] != (uint8_t) *seq) {
+			result->errors++;
+		}
+		(*seq)++;
+		result->frames++;
+		result->bytes += len;
+
+		if (!more) {
+			return;
+		}
+		pos += ESP_AGGR_FRAME_LEN(len);
+	}
+}
+
+static double bench_sdio_us(const bench_config_t *config, uint32_t total)
+{
+	uint32_t blocks = total / BENCH_BLOCK_SIZE;
+	uint32_t rest = total % BENCH_BLOCK_SIZE;
+	uint32_t bytes = blocks * BENCH_BLOCK_SIZE + ((rest + 3) & ~3);
+
+	return config->reg_us + ((blocks ? 1 : 0) + (rest ? 1 : 0)) * BENCH_CMD53_US + bytes * 8.0 / config->sdio_mbps;
+}
+
+static void bench_run(const bench_config_t *config, bool spi, uint8_t max_frames, uint16_t len,
+                      bench_result_t *result)
+{
+	static bench_frame_t queue[BENCH_SPI_QUEUE_SIZE];
+	static uint8_t bus[BENCH_SPI_BUFFER_SIZE];
+	double end = config->seconds * 1e6;
+	double now = 0;
+	uint64_t next = 0;	/* Sequence number of the next frame made */
+	uint64_t sent = 0;	/* and of the next frame sent */
+	uint64_t expected = 0;
+
+	memset(result, 0, sizeof(*result));
+	for (uint32_t loop = 0; loop < BENCH_SPI_QUEUE_SIZE; loop++, next++) {
+		bench_frame_make(&queue[loop], bench_frame_len(len, next), next);
+	}
+
+	while (now < end) {
+		bench_frame_t *frame = &queue[sent % BENCH_SPI_QUEUE_SIZE];
+		uint16_t frame_len = BENCH_HEADER_LEN + frame->len;
+		uint32_t bus_len = frame_len;
+		tx_aggr_t aggr;
+		uint8_t *pos = NULL;
+		uint32_t taken = 0;
+
+		/* The first frame, then the ones waiting behind it, at most a queue of them for SPI */
+		tx_aggr_init(&aggr, bus, BENCH_SPI_BUFFER_SIZE, max_frames);
+		if (spi || (max_frames > 1 && ESP_AGGR_FRAME_LEN(frame->len) * 2 <= ESP_AGGR_MAX_LEN)) {
+			while (sent < next && (!spi || taken <= BENCH_SPI_QUEUE_SIZE)) {
+				frame = &queue[sent % BENCH_SPI_QUEUE_SIZE];
+				pos = tx_aggr_add(&aggr, frame->len);
+				if (!pos) {
+					break;
+				}
+				memcpy(pos, frame->buf, BENCH_HEADER_LEN + frame->len);
+				sent++;
+				taken++;
+				/* send_task always has more for the SDIO slave */
+				bench_frame_make(frame, bench_frame_len(len, next), next);
+				next++;
+			}
+			bus_len = aggr.len;
+		} else {
+			memcpy(bus, frame->buf, frame_len);
+			sent++;
+			bench_frame_make(frame, bench_frame_len(len, next), next);
+			next++;
+		}
+
+		if (spi) {
+			memset(bus + aggr.len, 0, BENCH_SPI_BUFFER_SIZE - aggr.len);
+			bus_len = BENCH_SPI_BUFFER_SIZE;
+			now += config->spi_overhead_us + BENCH_SPI_BUFFER_SIZE * 8.0 / config->spi_mhz;
+		} else {
+			now += bench_sdio_us(config, bus_len);
+		}
+
+		bench_host_rx(bus, bus_len, &expected, result);
+		result->buffers++;
+	}
+}
+
+static void bench_report(const bench_config_t *config, bool spi, uint8_t max_frames, uint16_t len,
+                         const char *mix)
+{
+	bench_result_t result;
+
+	bench_run(config, spi, max_frames, len, &result);
+	printf("%-5s %-6s %6u %10.0f %10.2f %10.0f %8.1f %7llu\n", spi ? "spi" : "sdio", mix, max_frames,
+	       result.buffers / (double)config->seconds, result.frames / (double)result.buffers,
+	       result.frames / (double)config->seconds, result.bytes * 8.0 / 1e6 / config->seconds,
+	       (unsigned long long)result.errors);
+	if (result.errors) {
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void bench_usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -t, --time N              simulated seconds of each run (default 2)\n"
+	       "  -m, --spi-mhz N           SPI clock (default 30)\n"
+	       "  -o, --spi-overhead-us N   time between two SPI transactions (default 40)\n"
+	       "  -b, --sdio-mbps N         SDIO data rate, 4 bits at 40 MHz (default 160)\n"
+	       "  -r, --reg-us N            host register access over SDIO (default 20)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "time", required_argument, NULL, 't' },
+		{ "spi-mhz", required_argument, NULL, 'm' },
+		{ "spi-overhead-us", required_argument, NULL, 'o' },
+		{ "sdio-mbps", required_argument, NULL, 'b' },
+		{ "reg-us", required_argument, NULL, 'r' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	static const uint8_t max_frames[] = { 1, 8, 16 };
+	static const uint16_t lens[] = { BENCH_CTRL_LEN, BENCH_BT_LEN, 0 };
+	static const char *const mixes[] = { "ack", "hci", "mix" };
+	bench_config_t config = {
+		.seconds = 2,
+		.spi_mhz = 30,
+		.spi_overhead_us = 40,
+		.sdio_mbps = 160,
+		.reg_us = 20,
+	};
+	int option = 0;
+
+	while ((option = getopt_long(argc, argv, "t:m:o:b:r:h", options, NULL)) != -1) {
+		switch (option) {
+		case 't':
+			config.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			config.spi_mhz = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			config.spi_overhead_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.sdio_mbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			config.reg_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (!config.seconds || !config.spi_mhz || !config.sdio_mbps) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-5s %-6s %6s %10s %10s %10s %8s %7s\n", "bus", "frames", "aggr", "buffers/s", "frames/buf",
+	       "frames/s", "Mbit/s", "errors");
+	for (int spi = 1; spi >= 0; spi--) {
+		for (uint32_t mix = 0; mix < sizeof(lens) / sizeof(lens[0]); mix++) {
+			for (uint32_t aggr = 0; aggr < sizeof(max_frames) / sizeof(max_frames[0]); aggr++) {
+				bench_report(&config, spi, max_frames[aggr], lens[mix], mixes[mix]);
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
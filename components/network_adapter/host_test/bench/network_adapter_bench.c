@@ -0,0 +1,586 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "tx_sched.h"
+#include "buf_pool.h"
+
+/*
+ * Loopback model of the path to the host, on a virtual clock in microseconds:
+ *   - three sources feed send_task: TCP ACK sized control frames, HCI ACL packets and Wi-Fi data frames,
+ *     the data either greedy (busy: its queue is always full) or at a share of the bus (light)
+ *   - every queue holds TO_HOST_QUEUE_SIZE frames, a source whose queue is full waits, as xQueueSend() does
+ *   - the bus sends one frame at a time, in BENCH_BUS_OVERHEAD_US and the time of its bytes and header
+ *   - poll is the previous send_task: the control frames share the data queue, the data goes first, and
+ *     the task sleeps one tick when both queues are empty
+ *   - sched is the current send_task: one queue per class of tx_sched.h, woken by the frames queued
+ * The latency of a frame is the time from its arrival at the queue until it goes on the bus.
+ *
+ * The buffer rows time, on this machine, the work on a frame of the stack between lwIP and the bus, with
+ * BENCH_TX_WINDOW frames waiting for the host at any time:
+ *   - heap: the previous path, pkt_netif2driver() copies the frame into a malloc() buffer and sdio_write()
+ *     copies it again into a second one, after the header
+ *   - pool: the frame is copied once into a block of buf_pool.c, the header is written in its headroom
+ */
+
+#define BENCH_QUEUE_SIZE        (20)
+#define BENCH_HEADER_LEN        (12)
+#define BENCH_BUS_OVERHEAD_US   (20)
+#define BENCH_WAKE_US           (5)
+#define BENCH_QUANTUM_UNIT      (1600)
+
+#define BENCH_DATA_LEN          (1514)
+#define BENCH_CTRL_LEN          (66)
+#define BENCH_BT_LEN            (259)
+#define BENCH_CTRL_MEAN_US      (1000)
+#define BENCH_BT_MEAN_US        (2500)
+#define BENCH_LIGHT_LOAD        (0.3)
+
+#define BENCH_TX_WINDOW         (20)
+#define BENCH_POOL_SMALL_SIZE   (320)
+#define BENCH_POOL_SMALL_NUM    (32)
+#define BENCH_POOL_LARGE_SIZE   (1600)
+#define BENCH_POOL_LARGE_NUM    (24)
+
+#define BENCH_HIST_STEP_US      (10)
+#define BENCH_HIST_BINS         (20000)
+
+typedef enum {
+	BENCH_POLL,
+	BENCH_SCHED,
+} bench_policy_t;
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t bus_kbps;
+	uint32_t tick_hz;
+	uint32_t seed;
+	uint32_t weight[TX_CLASS_MAX];
+	uint32_t frames;
+} bench_config_t;
+
+/* Arrival times of the frames of a source, waiting for their queue */
+typedef struct {
+	double *time;
+	uint32_t head;
+	uint32_t tail;
+	uint32_t size;
+	double next;		/* Next arrival, Poisson */
+	double mean_us;		/* 0 for a greedy source */
+} bench_source_t;
+
+typedef struct {
+	double time[BENCH_QUEUE_SIZE];
+	uint16_t len[BENCH_QUEUE_SIZE];
+	uint8_t class[BENCH_QUEUE_SIZE];
+	uint32_t head;
+	uint32_t num;
+} bench_queue_t;
+
+typedef struct {
+	uint32_t bins[BENCH_HIST_BINS + 1];
+	uint64_t frames;
+	uint64_t bytes;
+	double sum_us;
+	double max_us;
+} bench_hist_t;
+
+static const uint16_t s_len[TX_CLASS_MAX] = { BENCH_CTRL_LEN, BENCH_DATA_LEN, BENCH_BT_LEN };
+static const char *const s_class_name[TX_CLASS_MAX] = { "ctrl", "data", "bt" };
+static const uint32_t s_hist_edges_us[] = { 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+#define BENCH_EDGES	(sizeof(s_hist_edges_us) / sizeof(s_hist_edges_us[0]))
+
+static uint32_t s_random_state = 1;
+static bench_source_t s_sources[TX_CLASS_MAX];
+static bench_queue_t s_queues[TX_CLASS_MAX];
+static bench_hist_t s_hist[TX_CLASS_MAX];
+
+static double bench_random_exp(double mean)
+{
+	/* xorshift32 */
+	s_random_state ^= s_random_state << 13;
+	s_random_state ^= s_random_state >> 17;
+	s_random_state ^= s_random_state << 5;
+	return -mean * log((s_random_state + 1.0) / 4294967297.0);
+}
+
+static double bench_bus_us(const bench_config_t *config, uint16_t len)
+{
+	return BENCH_BUS_OVERHEAD_US + (len + BENCH_HEADER_LEN) * 8.0 * 1000.0 / config->bus_kbps;
+}
+
+static void bench_source_push(bench_source_t *source, double time)
+{
+	if (source->tail - source->head == source->size) {
+		uint32_t size = source->size ? source->size * 2 : 64;
+		double *grown = malloc(size * sizeof(double));
+
+		if (!grown) {
+			exit(EXIT_FAILURE);
+		}
+		for (uint32_t loop = 0; loop < source->size; loop++) {
+			grown[loop] = source->time[(source->head + loop) % source->size];
+		}
+		free(source->time);
+		source->time = grown;
+		source->tail -= source->head;
+		source->head = 0;
+		source->size = size;
+	}
+
+	source->time[source->tail++ % source->size] = time;
+}
+
+/* The queue of each class: the previous send_task queued the control frames with the data */
+static bench_queue_t *bench_queue_of(bench_policy_t policy, int class)
+{
+	if (policy == BENCH_POLL && class == TX_CLASS_CTRL) {
+		return &s_queues[TX_CLASS_DATA];
+	}
+
+	return &s_queues[class];
+}
+
+static void bench_queue_push(bench_queue_t *queue, double time, int class)
+{
+	uint32_t slot = (queue->head + queue->num++) % BENCH_QUEUE_SIZE;
+
+	queue->time[slot] = time;
+	queue->len[slot] = s_len[class];
+	queue->class[slot] = class;
+}
+
+/* Move the frames arrived by now into their queues, the earliest first, then top up a greedy source */
+static void bench_admit(bench_policy_t policy, double now)
+{
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		bench_source_t *source = &s_sources[class];
+
+		while (source->mean_us && source->next <= now) {
+			bench_source_push(source, source->next);
+			source->next += bench_random_exp(source->mean_us);
+		}
+	}
+
+	for (;;) {
+		int first = -1;
+
+		for (int class = 0; class < TX_CLASS_MAX; class++) {
+			bench_source_t *source = &s_sources[class];
+
+			if (source->head != source->tail && bench_queue_of(policy, class)->num < BENCH_QUEUE_SIZE
+			    && (first < 0 || source->time[source->head % source->size]
+			        < s_sources[first].time[s_sources[first].head % s_sources[first].size])) {
+				first = class;
+			}
+		}
+		if (first < 0) {
+			break;
+		}
+		bench_queue_push(bench_queue_of(policy, first), s_sources[first].time[s_sources[first].head % s_sources[first].size], first);
+		s_sources[first].head++;
+	}
+
+	if (!s_sources[TX_CLASS_DATA].mean_us) {
+		while (bench_queue_of(policy, TX_CLASS_DATA)->num < BENCH_QUEUE_SIZE) {
+			bench_queue_push(bench_queue_of(policy, TX_CLASS_DATA), now, TX_CLASS_DATA);
+		}
+	}
+}
+
+static double bench_next_arrival(void)
+{
+	double next = INFINITY;
+
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		if (s_sources[class].mean_us && s_sources[class].next < next) {
+			next = s_sources[class].next;
+		}
+	}
+
+	return next;
+}
+
+/* The queue send_task takes its next frame from, NULL when it finds them all empty */
+static bench_queue_t *bench_pick(bench_policy_t policy, tx_sched_t *sched)
+{
+	uint16_t head_len[TX_CLASS_MAX] = { 0 };
+	int class = 0;
+
+	if (policy == BENCH_POLL) {
+		if (s_queues[TX_CLASS_DATA].num) {
+			return &s_queues[TX_CLASS_DATA];
+		}
+		return s_queues[TX_CLASS_BT].num ? &s_queues[TX_CLASS_BT] : NULL;
+	}
+
+	for (class = 0; class < TX_CLASS_MAX; class++) {
+		if (s_queues[class].num) {
+			head_len[class] = s_queues[class].len[s_queues[class].head];
+		}
+	}
+	class = tx_sched_next(sched, head_len);
+	return (class < 0) ? NULL : &s_queues[class];
+}
+
+static void bench_reset(const bench_config_t *config, bool busy)
+{
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		free(s_sources[class].time);
+	}
+	memset(s_sources, 0, sizeof(s_sources));
+	memset(s_queues, 0, sizeof(s_queues));
+	memset(s_hist, 0, sizeof(s_hist));
+	s_random_state = config->seed ? config->seed : 1;
+
+	s_sources[TX_CLASS_CTRL].mean_us = BENCH_CTRL_MEAN_US;
+	s_sources[TX_CLASS_BT].mean_us = BENCH_BT_MEAN_US;
+	s_sources[TX_CLASS_DATA].mean_us = busy ? 0 : bench_bus_us(config, BENCH_DATA_LEN) / BENCH_LIGHT_LOAD;
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		if (s_sources[class].mean_us) {
+			s_sources[class].next = bench_random_exp(s_sources[class].mean_us);
+		}
+	}
+}
+
+static void bench_run(const bench_config_t *config, bench_policy_t policy, bool busy)
+{
+	tx_sched_config_t sched_config;
+	tx_sched_t sched;
+	double end = config->seconds * 1e6;
+	double tick = 1e6 / config->tick_hz;
+	double now = 0;
+
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		sched_config.quantum[class] = config->weight[class] * BENCH_QUANTUM_UNIT;
+	}
+	tx_sched_init(&sched, &sched_config);
+	bench_reset(config, busy);
+
+	while (now < end) {
+		bench_queue_t *queue = NULL;
+		bench_hist_t *hist = NULL;
+		double latency = 0;
+		uint32_t bin = 0;
+		uint8_t class = 0;
+		uint16_t len = 0;
+
+		bench_admit(policy, now);
+		queue = bench_pick(policy, &sched);
+		if (!queue) {
+			if (policy == BENCH_POLL) {
+				/* vTaskDelay(1) */
+				now = (floor(now / tick) + 1) * tick;
+			} else {
+				now = fmax(now, bench_next_arrival()) + BENCH_WAKE_US;
+			}
+			continue;
+		}
+
+		class = queue->class[queue->head];
+		len = queue->len[queue->head];
+		latency = now - queue->time[queue->head];
+		queue->head = (queue->head + 1) % BENCH_QUEUE_SIZE;
+		queue->num--;
+
+		hist = &s_hist[class];
+		bin = (uint32_t)(latency / BENCH_HIST_STEP_US);
+		hist->bins[(bin < BENCH_HIST_BINS) ? bin : BENCH_HIST_BINS]++;
+		hist->frames++;
+		hist->bytes += len;
+		hist->sum_us += latency;
+		hist->max_us = fmax(hist->max_us, latency);
+
+		now += bench_bus_us(config, len);
+	}
+}
+
+static double bench_percentile_ms(const bench_hist_t *hist, double fraction)
+{
+	uint64_t target = (uint64_t)ceil(hist->frames * fraction);
+	uint64_t seen = 0;
+
+	for (uint32_t bin = 0; bin <= BENCH_HIST_BINS; bin++) {
+		seen += hist->bins[bin];
+		if (seen >= target) {
+			return (bin + 1) * BENCH_HIST_STEP_US / 1e3;
+		}
+	}
+
+	return hist->max_us / 1e3;
+}
+
+static void bench_report(const bench_config_t *config, const char *load, const char *policy)
+{
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		const bench_hist_t *hist = &s_hist[class];
+		uint32_t edge = 0;
+		uint64_t count = 0;
+
+		printf("%-6s %-6s %-5s %8llu %8.0f", load, policy, s_class_name[class], (unsigned long long)hist->frames,
+		       hist->bytes * 8.0 / 1e3 / config->seconds);
+		if (!hist->frames) {
+			printf(" %8s %8s %8s %8s\n", "-", "-", "-", "-");
+			continue;
+		}
+		printf(" %8.2f %8.2f %8.2f %8.2f", hist->sum_us / hist->frames / 1e3, bench_percentile_ms(hist, 0.5),
+		       bench_percentile_ms(hist, 0.99), hist->max_us / 1e3);
+
+		/* The fine bins, summed between the edges of the report */
+		for (uint32_t bin = 0; bin <= BENCH_HIST_BINS; bin++) {
+			while (edge < BENCH_EDGES && bin * BENCH_HIST_STEP_US >= s_hist_edges_us[edge]) {
+				printf(" %6llu", (unsigned long long)count);
+				count = 0;
+				edge++;
+			}
+			count += hist->bins[bin];
+		}
+		printf(" %6llu\n", (unsigned long long)count);
+	}
+}
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Frame lengths of a mix: ACKs, HCI packets and full frames, or a single length */
+static uint16_t bench_frame_len(uint16_t len, uint32_t index)
+{
+	static const uint16_t mix[] = { BENCH_CTRL_LEN, BENCH_DATA_LEN, BENCH_BT_LEN, BENCH_DATA_LEN };
+
+	return len ? len : mix[index % (sizeof(mix) / sizeof(mix[0]))];
+}
+
+/* The work on one frame, from the buffer of the stack to the buffer handed to the bus */
+static void *bench_tx_heap(const uint8_t *frame, uint16_t len, void **second)
+{
+	uint8_t *netif_buf = malloc(len);
+	uint8_t *sendbuf = NULL;
+
+	memcpy(netif_buf, frame, len);
+	sendbuf = malloc(len + BENCH_HEADER_LEN);
+	memset(sendbuf, 0, BENCH_HEADER_LEN);
+	memcpy(sendbuf + BENCH_HEADER_LEN, netif_buf, len);
+	*second = sendbuf;
+	return netif_buf;
+}
+
+static void *bench_tx_pool(buf_pool_t *pool, const uint8_t *frame, uint16_t len)
+{
+	uint8_t *block = buf_pool_alloc(pool, len);
+
+	if (!block) {
+		return NULL;
+	}
+	memcpy(block + buf_pool_headroom(pool), frame, len);
+	memset(block, 0, BENCH_HEADER_LEN);
+	return block;
+}
+
+static void bench_tx_buffers(const bench_config_t *config, bool use_pool, uint16_t len, const char *mix)
+{
+	buf_pool_config_t pool_config = {
+		.headroom = BENCH_HEADER_LEN,
+		.num_classes = 2,
+		.classes = {
+			{ .size = BENCH_POOL_SMALL_SIZE, .count = BENCH_POOL_SMALL_NUM },
+			{ .size = BENCH_POOL_LARGE_SIZE, .count = BENCH_POOL_LARGE_NUM },
+		},
+	};
+	buf_pool_class_stats_t stats[2];
+	buf_pool_t *pool = use_pool ? buf_pool_create(&pool_config) : NULL;
+	void *window[BENCH_TX_WINDOW][2] = { { NULL } };
+	uint32_t *times = malloc(config->frames * sizeof(uint32_t));
+	uint8_t frame[BENCH_DATA_LEN];
+	uint64_t total = 0;
+	uint32_t failures = 0;
+
+	if (!times || (use_pool && !pool)) {
+		exit(EXIT_FAILURE);
+	}
+	memset(frame, 0x5a, sizeof(frame));
+
+	for (uint32_t loop = 0; loop < config->frames; loop++) {
+		void **slot = window[loop % BENCH_TX_WINDOW];
+		uint16_t frame_len = bench_frame_len(len, loop);
+		uint64_t start = 0;
+
+		/* The oldest frame went on the bus */
+		if (use_pool) {
+			buf_pool_free(pool, slot[0]);
+		} else {
+			free(slot[0]);
+			free(slot[1]);
+		}
+		slot[0] = slot[1] = NULL;
+
+		start = bench_now_ns();
+		if (use_pool) {
+			slot[0] = bench_tx_pool(pool, frame, frame_len);
+			failures += slot[0] ? 0 : 1;
+		} else {
+			slot[0] = bench_tx_heap(frame, frame_len, &slot[1]);
+			/* The first copy is freed once the bus has the second one */
+			free(slot[0]);
+			slot[0] = NULL;
+		}
+		times[loop] = (uint32_t)(bench_now_ns() - start);
+		total += times[loop];
+	}
+
+	qsort(times, config->frames, sizeof(uint32_t), bench_compare_u32);
+	printf("%-6s %-6s %8u %8.1f %8u %8u %6u %6u", mix, use_pool ? "pool" : "heap", config->frames,
+	       (double)total / config->frames, times[config->frames / 2], times[(uint32_t)(config->frames * 0.99)],
+	       use_pool ? 1 : 2, use_pool ? 0 : 2);
+	if (use_pool) {
+		buf_pool_get_stats(pool, stats, 2);
+		printf("   %u/%u %u/%u %u\n", stats[0].high_watermark, stats[0].count, stats[1].high_watermark,
+		       stats[1].count, failures);
+	} else {
+		printf("   %s\n", "-");
+	}
+
+	for (uint32_t loop = 0; loop < BENCH_TX_WINDOW; loop++) {
+		if (use_pool) {
+			buf_pool_free(pool, window[loop][0]);
+		} else {
+			free(window[loop][1]);
+		}
+	}
+	buf_pool_delete(pool);
+	free(times);
+}
+
+static void bench_usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -t, --time S          simulated seconds of each run (default 10)\n"
+	       "  -b, --bus-kbps N      bus throughput (default 10000)\n"
+	       "  -H, --tick-hz N       FreeRTOS tick of the poll loop (default 100)\n"
+	       "  -c, --ctrl-weight N   control class weight (default 1)\n"
+	       "  -d, --data-weight N   data class weight (default 4)\n"
+	       "  -B, --bt-weight N     BT class weight (default 1)\n"
+	       "  -s, --seed N          seed of the arrivals (default 1)\n"
+	       "  -k, --frames N        frames of each buffer run (default 1000000)\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "time", required_argument, NULL, 't' },
+		{ "bus-kbps", required_argument, NULL, 'b' },
+		{ "tick-hz", required_argument, NULL, 'H' },
+		{ "ctrl-weight", required_argument, NULL, 'c' },
+		{ "data-weight", required_argument, NULL, 'd' },
+		{ "bt-weight", required_argument, NULL, 'B' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "frames", required_argument, NULL, 'k' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	bench_config_t config = {
+		.seconds = 10,
+		.bus_kbps = 10000,
+		.tick_hz = 100,
+		.seed = 1,
+		.weight = { [TX_CLASS_CTRL] = 1, [TX_CLASS_DATA] = 4, [TX_CLASS_BT] = 1 },
+		.frames = 1000000,
+	};
+	int opt = 0;
+
+	while ((opt = getopt_long(argc, argv, "t:b:H:c:d:B:s:k:h", options, NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			config.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.bus_kbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			config.tick_hz = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			config.weight[TX_CLASS_CTRL] = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			config.weight[TX_CLASS_DATA] = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			config.weight[TX_CLASS_BT] = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			config.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			config.frames = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (!config.seconds || !config.bus_kbps || !config.tick_hz || !config.frames) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-6s %-6s %-5s %8s %8s %8s %8s %8s %8s", "load", "policy", "class", "frames", "kbit/s",
+	       "mean ms", "p50 ms", "p99 ms", "max ms");
+	for (uint32_t edge = 0; edge < BENCH_EDGES; edge++) {
+		printf(" <%5.1f", s_hist_edges_us[edge] / 1e3);
+	}
+	printf(" %6s\n", "more");
+
+	for (int busy = 1; busy >= 0; busy--) {
+		bench_run(&config, BENCH_POLL, busy);
+		bench_report(&config, busy ? "busy" : "light", "poll");
+		bench_run(&config, BENCH_SCHED, busy);
+		bench_report(&config, busy ? "busy" : "light", "sched");
+	}
+
+	printf("\n%-6s %-6s %8s %8s %8s %8s %6s %6s   %s\n", "frames", "buffer", "count", "mean ns", "p50 ns",
+	       "p99 ns", "copies", "mallocs", "high watermark small/large, failures");
+	bench_tx_buffers(&config, false, BENCH_CTRL_LEN, "ack");
+	bench_tx_buffers(&config, true, BENCH_CTRL_LEN, "ack");
+	bench_tx_buffers(&config, false, BENCH_DATA_LEN, "full");
+	bench_tx_buffers(&config, true, BENCH_DATA_LEN, "full");
+	bench_tx_buffers(&config, false, 0, "mix");
+	bench_tx_buffers(&config, true, 0, "mix");
+
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		free(s_sources[class].time);
+	}
+	return EXIT_SUCCESS;
+}
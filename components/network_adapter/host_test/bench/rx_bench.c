@@ -0,0 +1,333 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+
+/*
+ * recv_task against emulated buses from the host, on a virtual clock in microseconds.
+ *   - spi: every frame takes a transaction of BENCH_SPI_BUFFER_SIZE bytes at spi_mhz plus spi_overhead_us,
+ *     into a receive queue of BENCH_SPI_RX_QUEUE frames
+ *   - sdio: every frame takes a register access of reg_us and its bytes in CMD53 of 512 byte blocks and a
+ *     remainder, each BENCH_CMD53_US, into BENCH_SDIO_RX_BUFFERS receive buffers
+ * The host stops when the slave has no free receive buffer, a buffer is free again once recv_task is done
+ * with its frame. recv_task spends call_us per read and, per frame, take_us to take it from the driver
+ * and frame_us plus frame_ns per byte in lwIP.
+ *   - before: the previous recv_task. The SPI read polls its queues and waits a tick of tick_hz when they
+ *     are empty, the SDIO read already sleeps in sdio_slave_recv(). One frame per read.
+ *   - batch N: the read sleeps until the first frame, wake_us after it came, then takes up to N frames
+ *     already received, released together once all are handed to lwIP.
+ * Three loads:
+ *   - idle: single frames after idle gaps of mean gap_ms, the latency from the frame received to recv_task
+ *   - rr: request and response, the host sends a frame once it has the answer to the previous one, which
+ *     takes the bus back and host_us on the host
+ *   - stream: the host sends frames of 66 and 1514 bytes as fast as the bus and the slave allow
+ */
+
+#define BENCH_SPI_BUFFER_SIZE   (1600)
+#define BENCH_SPI_RX_QUEUE      (10)
+#define BENCH_SDIO_RX_BUFFERS   (20)
+#define BENCH_BLOCK_SIZE        (512)
+#define BENCH_CMD53_US          (10)
+#define BENCH_HEADER_LEN        (12)
+#define BENCH_MAX_BUFFERS       (32)
+#define BENCH_IDLE_FRAMES       (20000)
+
+#define BENCH_DATA_LEN          (1514)
+#define BENCH_CTRL_LEN          (66)
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t spi_mhz;
+	uint32_t spi_overhead_us;
+	uint32_t sdio_mbps;
+	uint32_t reg_us;
+	uint32_t tick_hz;
+	uint32_t wake_us;
+	uint32_t call_us;
+	uint32_t take_us;
+	uint32_t frame_us;
+	uint32_t frame_ns;
+	uint32_t gap_ms;
+	uint32_t host_us;
+} bench_config_t;
+
+typedef struct {
+	bool spi;
+	uint8_t batch;		/* 0 for the previous recv_task */
+} bench_loop_t;
+
+static uint32_t s_random_state = 1;
+
+static double bench_random_exp(double mean)
+{
+	s_random_state ^= s_random_state << 13;
+	s_random_state ^= s_random_state >> 17;
+	s_random_state ^= s_random_state << 5;
+	return -mean * log((s_random_state + 1.0) / 4294967297.0);
+}
+
+static double bench_bus_us(const bench_config_t *config, bool spi, uint16_t len)
+{
+	uint32_t total = BENCH_HEADER_LEN + len;
+	uint32_t blocks = total / BENCH_BLOCK_SIZE;
+	uint32_t rest = total % BENCH_BLOCK_SIZE;
+
+	if (spi) {
+		return config->spi_overhead_us + BENCH_SPI_BUFFER_SIZE * 8.0 / config->spi_mhz;
+	}
+
+	return config->reg_us + ((blocks ? 1 : 0) + (rest ? 1 : 0)) * BENCH_CMD53_US +
+		(blocks * BENCH_BLOCK_SIZE + ((rest + 3) & ~3)) * 8.0 / config->sdio_mbps;
+}
+
+static double bench_frame_us(const bench_config_t *config, uint16_t len)
+{
+	return config->take_us + config->frame_us + len * config->frame_ns / 1e3;
+}
+
+/* When recv_task, idle since before, starts on a frame received at arrive */
+static double bench_wake(const bench_config_t *config, const bench_loop_t *loop, double arrive)
+{
+	double tick_us = 1e6 / config->tick_hz;
+
+	if (loop->spi && !loop->batch) {
+		/* vTaskDelay(1) returns on the next tick */
+		return (floor(arrive / tick_us) + 1) * tick_us + config->wake_us;
+	}
+
+	return arrive + config->wake_us;
+}
+
+/* Latency of single frames after idle gaps, mean and max */
+static void bench_idle(const bench_config_t *config, const bench_loop_t *loop, double *mean, double *max)
+{
+	double now = 0, total = 0, latency = 0;
+
+	s_random_state = 1;
+	*max = 0;
+	for (uint32_t frame = 0; frame < BENCH_IDLE_FRAMES; frame++) {
+		now += bench_random_exp(config->gap_ms * 1e3);
+		latency = bench_wake(config, loop, now) + config->call_us - now;
+		total += latency;
+		*max = (latency > *max) ? latency : *max;
+	}
+	*mean = total / BENCH_IDLE_FRAMES;
+}
+
+/* Requests answered per second, each request waiting for the answer to the previous one */
+static double bench_rr(const bench_config_t *config, const bench_loop_t *loop)
+{
+	double end = config->seconds * 1e6;
+	double bus_us = bench_bus_us(config, loop->spi, BENCH_CTRL_LEN);
+	double now = 0;
+	uint64_t exchanges = 0;
+
+	while (now < end) {
+		now += bus_us;
+		now = bench_wake(config, loop, now) + config->call_us + bench_frame_us(config, BENCH_CTRL_LEN);
+		now += bus_us + config->host_us;
+		exchanges++;
+	}
+
+	return exchanges / (double)config->seconds;
+}
+
+/* Frames per second of a host sending as fast as it can */
+static double bench_stream(const bench_config_t *config, const bench_loop_t *loop, uint16_t len)
+{
+	static double arrive[BENCH_MAX_BUFFERS];	/* Of frame i in arrive[i % buffers] */
+	static double done[BENCH_MAX_BUFFERS];		/* and when its buffer is free again */
+	uint32_t buffers = loop->spi ? BENCH_SPI_RX_QUEUE : BENCH_SDIO_RX_BUFFERS;
+	double end = config->seconds * 1e6;
+	double bus_us = bench_bus_us(config, loop->spi, len);
+	double tick_us = 1e6 / config->tick_hz;
+	double now = 0, last = 0;
+	uint64_t next = 0;	/* Next frame to come from the host */
+	uint64_t read = 0;	/* Next frame for recv_task */
+
+	memset(done, 0, sizeof(done));
+	while (now < end) {
+		uint8_t batch = loop->batch ? loop->batch : 1;
+		uint8_t frames = 0;
+
+		/* The host sends as long as a buffer is free, the previous frames of a buffer are done */
+		while (next < read + buffers) {
+			last = fmax(last, done[next % buffers]) + bus_us;
+			arrive[next % buffers] = last;
+			next++;
+		}
+
+		if (arrive[read % buffers] > now) {
+			if (loop->spi && !loop->batch) {
+				now = (floor(now / tick_us) + 1) * tick_us + config->wake_us;
+				continue;
+			}
+			now = arrive[read % buffers] + config->wake_us;
+		}
+
+		now += config->call_us;
+		while (frames < batch && read + frames < next && arrive[(read + frames) % buffers] <= now) {
+			now += bench_frame_us(config, len);
+			frames++;
+		}
+		for (uint8_t frame = 0; frame < frames; frame++, read++) {
+			done[read % buffers] = now;
+		}
+	}
+
+	return read / (double)config->seconds;
+}
+
+static void bench_report(const bench_config_t *config, const bench_loop_t *loop)
+{
+	char name[16];
+	double mean = 0, max = 0;
+	double ack = bench_stream(config, loop, BENCH_CTRL_LEN);
+	double full = bench_stream(config, loop, BENCH_DATA_LEN);
+
+	bench_idle(config, loop, &mean, &max);
+	if (loop->batch) {
+		snprintf(name, sizeof(name), "batch %u", loop->batch);
+	} else {
+		snprintf(name, sizeof(name), "before");
+	}
+	printf("%-5s %-9s %9.1f %9.1f %9.0f %10.0f %10.0f %8.1f\n", loop->spi ? "spi" : "sdio", name, mean, max,
+	       bench_rr(config, loop), ack, full, full * BENCH_DATA_LEN * 8 / 1e6);
+}
+
+static void bench_usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -t, --time N              simulated seconds of each run (default 2)\n"
+	       "  -m, --spi-mhz N           SPI clock (default 30)\n"
+	       "  -o, --spi-overhead-us N   time between two SPI transactions (default 40)\n"
+	       "  -b, --sdio-mbps N         SDIO data rate, 4 bits at 40 MHz (default 160)\n"
+	       "  -r, --reg-us N            host register access over SDIO (default 20)\n"
+	       "  -z, --tick-hz N           FreeRTOS tick rate (default 100)\n"
+	       "  -w, --wake-us N           wake-up of recv_task (default 15)\n"
+	       "  -c, --call-us N           time of a read (default 2)\n"
+	       "  -k, --take-us N           time to take a frame from the driver (default 3)\n"
+	       "  -f, --frame-us N          lwIP time of a frame (default 20)\n"
+	       "  -n, --frame-ns N          lwIP time of a byte (default 10)\n"
+	       "  -g, --gap-ms N            mean idle gap of the idle load (default 20)\n"
+	       "  -s, --host-us N           host time from an answer to the next request (default 50)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "time", required_argument, NULL, 't' },
+		{ "spi-mhz", required_argument, NULL, 'm' },
+		{ "spi-overhead-us", required_argument, NULL, 'o' },
+		{ "sdio-mbps", required_argument, NULL, 'b' },
+		{ "reg-us", required_argument, NULL, 'r' },
+		{ "tick-hz", required_argument, NULL, 'z' },
+		{ "wake-us", required_argument, NULL, 'w' },
+		{ "call-us", required_argument, NULL, 'c' },
+		{ "take-us", required_argument, NULL, 'k' },
+		{ "frame-us", required_argument, NULL, 'f' },
+		{ "frame-ns", required_argument, NULL, 'n' },
+		{ "gap-ms", required_argument, NULL, 'g' },
+		{ "host-us", required_argument, NULL, 's' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	static const uint8_t batches[] = { 0, 1, 8 };
+	bench_config_t config = {
+		.seconds = 2,
+		.spi_mhz = 30,
+		.spi_overhead_us = 40,
+		.sdio_mbps = 160,
+		.reg_us = 20,
+		.tick_hz = 100,
+		.wake_us = 15,
+		.call_us = 2,
+		.take_us = 3,
+		.frame_us = 20,
+		.frame_ns = 10,
+		.gap_ms = 20,
+		.host_us = 50,
+	};
+	int option = 0;
+
+	while ((option = getopt_long(argc, argv, "t:m:o:b:r:z:w:c:k:f:n:g:s:h", options, NULL)) != -1) {
+		switch (option) {
+		case 't':
+			config.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			config.spi_mhz = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			config.spi_overhead_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.sdio_mbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			config.reg_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			config.tick_hz = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			config.wake_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			config.call_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			config.take_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			config.frame_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			config.frame_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			config.gap_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			config.host_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (!config.seconds || !config.spi_mhz || !config.sdio_mbps || !config.tick_hz) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-5s %-9s %9s %9s %9s %10s %10s %8s\n", "bus", "read", "idle us", "idle max", "rr/s",
+	       "ack/s", "full/s", "Mbit/s");
+	for (int spi = 1; spi >= 0; spi--) {
+		for (uint32_t loop = 0; loop < sizeof(batches) / sizeof(batches[0]); loop++) {
+			bench_loop_t bench_loop = { .spi = spi, .batch = batches[loop] };
+
+			bench_report(&config, &bench_loop);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,343 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "buf_pool.h"
+
+/*
+ * Mock SDIO bus between sdio_write() and the read loop of the Linux host driver, on a virtual clock in
+ * microseconds. send_task always has TO_HOST_QUEUE_SIZE frames waiting, each in a block of the pool.
+ *   - the slave spends slave_us and checksum_ns per byte on a frame (dequeue, header, checksum), plus
+ *     an exponential time of mean jitter_us for the Wi-Fi and lwIP tasks which preempt send_task, then
+ *     queues it, and needs BENCH_SLAVE_WAKE_US to run again once the frame it waits for is read
+ *   - transmit is the previous sdio_write(): sdio_slave_transmit() returns once the host read the frame
+ *   - queue N is the current one: up to N frames in sdio_slave_send_queue(), the finished ones released
+ *     by the next write, and the slave waits only when the N are all in flight
+ *   - the host takes the new packet interrupt in irq_us, reads and clears the interrupt status, wakes its
+ *     rx work in BENCH_HOST_WAKE_US, then reads the length and the packet, each register access reg_us,
+ *     and the packet in CMD53 of 512 byte blocks and a remainder, each BENCH_CMD53_US and the time of its
+ *     bytes. The work reads packets for as long as the slave has one, the next interrupt is only taken
+ *     once it found none.
+ * The blocks of the pool are taken and released as on the slave, the last column tells whether the pool
+ * sized by the Kconfig defaults covers the frames in flight or sends them to the heap.
+ */
+
+#define BENCH_HEADER_LEN        (12)
+#define BENCH_TO_HOST_QUEUE     (20)
+#define BENCH_BLOCK_SIZE        (512)
+#define BENCH_CMD53_US          (10)
+#define BENCH_HOST_WAKE_US      (15)
+#define BENCH_SLAVE_WAKE_US     (8)
+#define BENCH_MAX_DEPTH         (64)
+
+#define BENCH_DATA_LEN          (1514)
+#define BENCH_CTRL_LEN          (66)
+#define BENCH_BT_LEN            (259)
+
+#define BENCH_POOL_SMALL_SIZE   (320)
+#define BENCH_POOL_SMALL_NUM    (32)
+#define BENCH_POOL_LARGE_SIZE   (1600)
+#define BENCH_POOL_LARGE_NUM    (24)
+
+typedef struct {
+	uint32_t seconds;
+	uint32_t bus_mbps;
+	uint32_t irq_us;
+	uint32_t reg_us;
+	uint32_t slave_us;
+	uint32_t checksum_ns;
+	uint32_t jitter_us;
+} bench_config_t;
+
+typedef struct {
+	uint8_t *block;
+	bool heap;
+	uint16_t len;
+} bench_frame_t;
+
+/* The frames given to the driver, until the host read them and the slave released them */
+typedef struct {
+	bench_frame_t frame[BENCH_MAX_DEPTH];
+	double done[BENCH_MAX_DEPTH];
+	uint32_t head;
+	uint32_t num;
+} bench_ring_t;
+
+typedef struct {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t interrupts;
+	uint64_t heap;
+	double in_flight_us;
+} bench_result_t;
+
+static uint32_t s_random_state = 1;
+
+static const uint16_t s_mix[] = { BENCH_CTRL_LEN, BENCH_DATA_LEN, BENCH_BT_LEN, BENCH_DATA_LEN };
+
+static uint16_t bench_frame_len(uint16_t len, uint64_t index)
+{
+	return len ? len : s_mix[index % (sizeof(s_mix) / sizeof(s_mix[0]))];
+}
+
+static double bench_random_exp(double mean)
+{
+	/* xorshift32 */
+	s_random_state ^= s_random_state << 13;
+	s_random_state ^= s_random_state >> 17;
+	s_random_state ^= s_random_state << 5;
+	return -mean * log((s_random_state + 1.0) / 4294967297.0);
+}
+
+/* pkt_netif2driver(): a block of the pool, the heap when the pool has none */
+static bench_frame_t bench_frame_alloc(buf_pool_t *pool, uint16_t len, bench_result_t *result)
+{
+	bench_frame_t frame = { .block = buf_pool_alloc(pool, len), .len = len };
+
+	if (!frame.block) {
+		frame.block = malloc(len + BENCH_HEADER_LEN);
+		frame.heap = true;
+		result->heap++;
+		if (!frame.block) {
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return frame;
+}
+
+static void bench_frame_free(buf_pool_t *pool, bench_frame_t *frame)
+{
+	if (frame->heap) {
+		free(frame->block);
+	} else {
+		buf_pool_free(pool, frame->block);
+	}
+}
+
+/* The bus time of a packet: CMD53 of whole blocks, then one of the remainder, 4 byte aligned */
+static double bench_data_us(const bench_config_t *config, uint16_t len)
+{
+	uint32_t total = len + BENCH_HEADER_LEN;
+	uint32_t blocks = total / BENCH_BLOCK_SIZE;
+	uint32_t rest = total % BENCH_BLOCK_SIZE;
+	uint32_t bytes = blocks * BENCH_BLOCK_SIZE + ((rest + 3) & ~3);
+
+	return ((blocks ? 1 : 0) + (rest ? 1 : 0)) * BENCH_CMD53_US + bytes * 8.0 / config->bus_mbps;
+}
+
+/* Release the frames the host read by now, as sdio_slave_send_get_finished() returns them */
+static void bench_reap(buf_pool_t *pool, bench_ring_t *ring, double now)
+{
+	while (ring->num && ring->done[ring->head] <= now) {
+		bench_frame_free(pool, &ring->frame[ring->head]);
+		ring->head = (ring->head + 1) % BENCH_MAX_DEPTH;
+		ring->num--;
+	}
+}
+
+/* depth 0 is sdio_slave_transmit() */
+static void bench_run(const bench_config_t *config, uint32_t depth, uint16_t len, buf_pool_t *pool,
+                      bench_result_t *result)
+{
+	bench_frame_t queue[BENCH_TO_HOST_QUEUE];
+	bench_ring_t ring = { .head = 0 };
+	double end = config->seconds * 1e6;
+	double slave = 0;
+	double host_done = -INFINITY;	/* The host read its last packet */
+	double host_idle = -INFINITY;	/* and found no other */
+	uint64_t index = 0;
+
+	memset(result, 0, sizeof(*result));
+	s_random_state = 1;
+	for (uint32_t loop = 0; loop < BENCH_TO_HOST_QUEUE; loop++) {
+		queue[loop] = bench_frame_alloc(pool, bench_frame_len(len, index++), result);
+	}
+
+	while (slave < end) {
+		uint32_t slot = result->frames % BENCH_TO_HOST_QUEUE;
+		bench_frame_t frame = queue[slot];
+		double ready = 0;
+		double start = 0;
+
+		/* The source keeps the queue full */
+		queue[slot] = bench_frame_alloc(pool, bench_frame_len(len, index++), result);
+
+		bench_reap(pool, &ring, slave);
+		slave += config->slave_us + frame.len * config->checksum_ns / 1e3 + bench_random_exp(config->jitter_us);
+		/* The header, in the headroom of the block */
+		memset(frame.block, 0, BENCH_HEADER_LEN);
+
+		if (depth && ring.num == depth) {
+			/* sdio_slave_send_get_finished(portMAX_DELAY) */
+			slave = fmax(slave, ring.done[ring.head] + BENCH_SLAVE_WAKE_US);
+			bench_reap(pool, &ring, slave);
+		}
+		ready = slave;
+
+		/* The host work goes on reading, or sleeps and takes the interrupt of this packet */
+		if (ready <= host_done) {
+			start = host_done;
+		} else {
+			start = fmax(ready, host_idle) + config->irq_us + 2 * config->reg_us + BENCH_HOST_WAKE_US;
+			result->interrupts++;
+		}
+		host_done = start + config->reg_us + bench_data_us(config, frame.len);
+		host_idle = host_done + config->reg_us;
+		result->in_flight_us += host_done - ready;
+
+		ring.frame[(ring.head + ring.num) % BENCH_MAX_DEPTH] = frame;
+		ring.done[(ring.head + ring.num) % BENCH_MAX_DEPTH] = host_done;
+		ring.num++;
+
+		if (!depth) {
+			slave = host_done + BENCH_SLAVE_WAKE_US;
+			bench_reap(pool, &ring, slave);
+		}
+
+		result->frames++;
+		result->bytes += frame.len;
+	}
+
+	bench_reap(pool, &ring, INFINITY);
+	for (uint32_t loop = 0; loop < BENCH_TO_HOST_QUEUE; loop++) {
+		bench_frame_free(pool, &queue[loop]);
+	}
+}
+
+static void bench_report(const bench_config_t *config, uint32_t depth, uint16_t len, const char *mix)
+{
+	buf_pool_config_t pool_config = {
+		.headroom = BENCH_HEADER_LEN,
+		.num_classes = 2,
+		.classes = {
+			{ .size = BENCH_POOL_SMALL_SIZE, .count = BENCH_POOL_SMALL_NUM },
+			{ .size = BENCH_POOL_LARGE_SIZE, .count = BENCH_POOL_LARGE_NUM },
+		},
+	};
+	buf_pool_class_stats_t stats[2];
+	buf_pool_t *pool = buf_pool_create(&pool_config);
+	bench_result_t result;
+	char name[24];
+
+	if (!pool) {
+		exit(EXIT_FAILURE);
+	}
+
+	bench_run(config, depth, len, pool, &result);
+	buf_pool_get_stats(pool, stats, 2);
+	if (depth) {
+		snprintf(name, sizeof(name), "queue %u", depth);
+	} else {
+		snprintf(name, sizeof(name), "transmit");
+	}
+
+	printf("%-6s %-9s %9.0f %8.1f %9.3f %8.2f %5u/%-3u %5u/%-3u %8.2f\n", mix, name,
+	       result.frames / (double)config->seconds, result.bytes * 8.0 / 1e6 / config->seconds,
+	       result.interrupts / (double)result.frames, result.in_flight_us / result.frames,
+	       stats[0].high_watermark, stats[0].count, stats[1].high_watermark, stats[1].count,
+	       result.heap * 100.0 / result.frames);
+
+	buf_pool_delete(pool);
+}
+
+static void bench_usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -t, --time N          simulated seconds of each run (default 2)\n"
+	       "  -b, --bus-mbps N      SDIO data rate, 4 bits at 40 MHz (default 160)\n"
+	       "  -i, --irq-us N        host interrupt latency (default 40)\n"
+	       "  -r, --reg-us N        host register access (default 20)\n"
+	       "  -s, --slave-us N      slave time of a frame (default 12)\n"
+	       "  -c, --checksum-ns N   slave time of a byte (default 15)\n"
+	       "  -j, --jitter-us N     mean time the slave is preempted for, per frame (default 20)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "time", required_argument, NULL, 't' },
+		{ "bus-mbps", required_argument, NULL, 'b' },
+		{ "irq-us", required_argument, NULL, 'i' },
+		{ "reg-us", required_argument, NULL, 'r' },
+		{ "slave-us", required_argument, NULL, 's' },
+		{ "checksum-ns", required_argument, NULL, 'c' },
+		{ "jitter-us", required_argument, NULL, 'j' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	static const uint32_t depths[] = { 0, 2, 4, 8, 20 };
+	static const uint16_t lens[] = { BENCH_CTRL_LEN, BENCH_DATA_LEN, 0 };
+	static const char *const mixes[] = { "ack", "full", "mix" };
+	bench_config_t config = {
+		.seconds = 2,
+		.bus_mbps = 160,
+		.irq_us = 40,
+		.reg_us = 20,
+		.slave_us = 12,
+		.checksum_ns = 15,
+		.jitter_us = 20,
+	};
+	int option = 0;
+
+	while ((option = getopt_long(argc, argv, "t:b:i:r:s:c:j:h", options, NULL)) != -1) {
+		switch (option) {
+		case 't':
+			config.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.bus_mbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			config.irq_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			config.reg_us = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			config.slave_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			config.checksum_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			config.jitter_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (!config.seconds || !config.bus_mbps) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-6s %-9s %9s %8s %9s %8s %9s %9s %8s\n", "frames", "write", "frames/s", "Mbit/s", "irq/frame",
+	       "wait us", "small", "large", "heap %");
+	for (uint32_t mix = 0; mix < sizeof(lens) / sizeof(lens[0]); mix++) {
+		for (uint32_t depth = 0; depth < sizeof(depths) / sizeof(depths[0]); depth++) {
+			bench_report(&config, depths[depth], lens[mix], mixes[mix]);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
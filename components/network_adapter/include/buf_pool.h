@@ -0,0 +1,74 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __BUF_POOL_H
+#define __BUF_POOL_H
+
+#include <stdint.h>
+
+#define BUF_POOL_MAX_CLASSES	4
+#define BUF_POOL_ALIGN		4	/* Of the blocks, as the SPI and SDIO DMA need */
+
+typedef struct {
+	uint16_t size;		/* Bytes of a block, headroom included, a multiple of BUF_POOL_ALIGN */
+	uint16_t count;
+} buf_pool_class_config_t;
+
+typedef struct {
+	uint16_t headroom;	/* Bytes at the start of every block kept for the header of the transport */
+	uint8_t num_classes;
+	buf_pool_class_config_t classes[BUF_POOL_MAX_CLASSES];	/* From the smallest blocks up */
+} buf_pool_config_t;
+
+typedef struct {
+	uint16_t size;
+	uint16_t count;
+	uint16_t free;
+	uint16_t high_watermark;	/* Most blocks in use at once */
+	uint32_t allocs;
+	uint32_t borrowed;		/* Blocks given for a smaller class which was empty */
+	uint32_t failures;		/* Requests of this class left without a block */
+} buf_pool_class_stats_t;
+
+typedef struct buf_pool buf_pool_t;
+
+/*
+ * Create a pool of fixed size blocks, DMA capable on the chip. Each class gets one allocation at creation,
+ * its free blocks are chained through their first bytes, so the pool does not use the heap afterwards.
+ * Returns NULL on an invalid configuration or out of memory.
+ */
+buf_pool_t *buf_pool_create(const buf_pool_config_t *config);
+
+void buf_pool_delete(buf_pool_t *pool);
+
+/*
+ * Get a block for a payload of len bytes after the headroom, from the smallest class it fits in, or from a
+ * larger one when that class is empty. Returns the start of the block, the payload goes at
+ * buf_pool_headroom() bytes from it, or NULL when no class has a free block large enough.
+ */
+uint8_t *buf_pool_alloc(buf_pool_t *pool, uint16_t len);
+
+/* Give back a block of buf_pool_alloc() */
+void buf_pool_free(buf_pool_t *pool, void *block);
+
+/* The size of a block of the pool, or 0 when block is not the start of one of its blocks */
+uint16_t buf_pool_block_size(const buf_pool_t *pool, const void *block);
+
+uint16_t buf_pool_headroom(const buf_pool_t *pool);
+
+/* Fill stats with the classes of the pool, up to num of them. Returns the number of classes */
+uint8_t buf_pool_get_stats(buf_pool_t *pool, buf_pool_class_stats_t *stats, uint8_t num);
+
+#endif
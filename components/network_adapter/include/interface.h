@@ -79,7 +79,11 @@ typedef struct {
 typedef struct {
 	interface_handle_t * (*init)(void);
 	int32_t (*write)(interface_handle_t *handle, interface_buffer_handle_t *buf_handle);
-	int (*read)(interface_handle_t *handle, interface_buffer_handle_t *buf_handle);
+	/*
+	 * Frames from the host into buf_handles, up to max_frames: waits for the first one, then takes the ones
+	 * already received without waiting. Returns the number of frames, negative on error.
+	 */
+	int (*read)(interface_handle_t *handle, interface_buffer_handle_t *buf_handles, uint8_t max_frames);
 	esp_err_t (*reset)(interface_handle_t *handle);
 	void (*deinit)(interface_handle_t *handle);
 } if_ops_t;
@@ -16,13 +16,57 @@
 #ifndef __NETWORK_ADAPTER_PRIV__H
 #define __NETWORK_ADAPTER_PRIV__H
 
+#include <stdbool.h>
 #include "wifi_dongle_adapter.h"
 #include "interface.h"
+#include "tx_sched.h"
+#include "buf_pool.h"
 
 typedef struct {
 	interface_context_t *context;
 } adapter;
 
+typedef struct {
+	uint32_t class_frames[TX_CLASS_MAX];	/* Frames sent to the host, per class of tx_sched.h */
+} network_adapter_tx_stats_t;
+
 void network_adapter_driver_init(void);
 
+/*
+ * Queue a frame to the host and wake send_task. queue_type is PRIO_Q_BT or PRIO_Q_OTHERS, the control frames
+ * of the stations interface up to CONFIG_ESP_TX_CTRL_MAX_LEN bytes of the latter go to the control class.
+ */
+esp_err_t send_to_host_queue(interface_buffer_handle_t *buf_handle, uint8_t queue_type);
+
+/* Send a frame of the stack to the host, after copying it */
+esp_err_t pkt_netif2driver(void *buffer, uint16_t len);
+
+void network_adapter_get_tx_stats(network_adapter_tx_stats_t *stats);
+
+/*
+ * The pool of DMA capable buffers shared with the transports, NULL when it could not be created. Its blocks
+ * keep sizeof(struct esp_payload_header) bytes in front of the payload, so that a transport can send a frame
+ * of the pool with its header in place, see buf_pool.h.
+ */
+buf_pool_t *network_adapter_get_buf_pool(void);
+
+/* free_buf_handle of the buffer handles whose priv_buffer_handle is a block of the pool */
+void network_adapter_free_pool_buf(void *block);
+
+/*
+ * Get a buffer for a frame of len bytes to the host: a block of the pool, with the payload after its
+ * headroom, or the heap when the pool is out of blocks. Fills the payload, priv_buffer_handle and
+ * free_buf_handle of buf_handle. Returns the payload, NULL when out of memory.
+ */
+uint8_t *network_adapter_alloc_tx_buf(uint16_t len, interface_buffer_handle_t *buf_handle);
+
+/*
+ * Frames the transport may pack into one buffer to the host, see tx_aggr.h: the number the host accepted in
+ * answer to the ESP_PRIV_AGGREGATION TLV of the startup event, up to CONFIG_ESP_AGGR_MAX_FRAMES. 1 until then.
+ */
+uint8_t network_adapter_get_aggr_frames(void);
+
+/* Whether more frames to the host wait for send_task, so that a transport may hold an aggregate for them */
+bool network_adapter_tx_pending(void);
+
 #endif
@@ -0,0 +1,49 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __TX_AGGR_H
+#define __TX_AGGR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Several frames to the host in one transport buffer, in the format of wifi_dongle_adapter.h: each
+ * frame with its header at ESP_AGGR_FRAME_LEN() of the previous one, all headers but the last flagged
+ * MORE_FRAMES.
+ */
+typedef struct {
+	uint8_t *buf;
+	uint16_t size;		/* Bytes of buf */
+	uint16_t len;		/* Bytes of the frames added, padding included */
+	uint8_t frames;
+	uint8_t max_frames;
+	uint8_t *last;		/* Header of the last frame added */
+} tx_aggr_t;
+
+/* Start an empty aggregate in buf */
+void tx_aggr_init(tx_aggr_t *aggr, uint8_t *buf, uint16_t size, uint8_t max_frames);
+
+/* Whether a frame of payload_len bytes fits after the ones added */
+bool tx_aggr_fits(const tx_aggr_t *aggr, uint16_t payload_len);
+
+/*
+ * Room for a frame of payload_len bytes and its header, NULL when it does not fit. The caller writes
+ * the header, its checksum included, and the payload. The header of the previous frame is flagged
+ * MORE_FRAMES, its checksum updated.
+ */
+uint8_t *tx_aggr_add(tx_aggr_t *aggr, uint16_t payload_len);
+
+#endif
@@ -0,0 +1,63 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __TX_SCHED_H
+#define __TX_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Classes of the frames to the host, in the order of their queues */
+typedef enum {
+	TX_CLASS_CTRL,		/* Control frames of the stations interface, see tx_sched_is_ctrl_frame() */
+	TX_CLASS_DATA,		/* The other frames of the network interfaces */
+	TX_CLASS_BT,		/* HCI packets */
+	TX_CLASS_MAX,
+} tx_class_t;
+
+typedef struct {
+	/*
+	 * Bytes each class may send per round. The data and BT classes share the bus in proportion of their
+	 * quantum, with deficit round-robin. The control class goes ahead of them within its own quantum, which
+	 * is given back at every round, so a flood of small frames cannot starve the others. The frames of the
+	 * control class are not longer than its quantum.
+	 */
+	uint32_t quantum[TX_CLASS_MAX];
+} tx_sched_config_t;
+
+typedef struct {
+	tx_sched_config_t config;
+	uint32_t deficit[TX_CLASS_MAX];
+	uint8_t current;	/* TX_CLASS_DATA or TX_CLASS_BT, the class whose turn it is */
+	uint8_t turn_started;	/* The quantum of the current class was added for this turn */
+} tx_sched_t;
+
+/* Start the scheduler, every quantum is at least 1 */
+void tx_sched_init(tx_sched_t *sched, const tx_sched_config_t *config);
+
+/*
+ * Pick the class of the next frame to the host and charge it. head_len holds the length of the first
+ * frame of each class, 0 when its queue is empty. Returns the class, or -1 when all the queues are empty.
+ */
+int tx_sched_next(tx_sched_t *sched, const uint16_t head_len[TX_CLASS_MAX]);
+
+/*
+ * Whether an Ethernet frame is control traffic, which may go ahead of the data queued before it without
+ * reordering a flow: ARP, TCP segments without payload, FIN and RST excepted, DNS, DHCP and IPv6 neighbour
+ * discovery.
+ */
+bool tx_sched_is_ctrl_frame(const uint8_t *frame, uint16_t len);
+
+#endif
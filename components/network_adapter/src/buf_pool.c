@@ -0,0 +1,227 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "buf_pool.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+
+#define BUF_POOL_MEM_ALLOC(size)	heap_caps_malloc(size, MALLOC_CAP_DMA)
+#define BUF_POOL_MEM_FREE(ptr)		heap_caps_free(ptr)
+#define BUF_POOL_LOCK(pool)		portENTER_CRITICAL_SAFE(&(pool)->lock)
+#define BUF_POOL_UNLOCK(pool)		portEXIT_CRITICAL_SAFE(&(pool)->lock)
+#else
+/* The host build is single threaded */
+#define BUF_POOL_MEM_ALLOC(size)	malloc(size)
+#define BUF_POOL_MEM_FREE(ptr)		free(ptr)
+#define BUF_POOL_LOCK(pool)
+#define BUF_POOL_UNLOCK(pool)
+#endif
+
+typedef struct buf_pool_block {
+	struct buf_pool_block *next;
+} buf_pool_block_t;
+
+typedef struct {
+	uint8_t *base;
+	buf_pool_block_t *free_list;
+	buf_pool_class_stats_t stats;
+} buf_pool_class_t;
+
+struct buf_pool {
+	uint16_t headroom;
+	uint8_t num_classes;
+	buf_pool_class_t classes[BUF_POOL_MAX_CLASSES];
+#ifdef ESP_PLATFORM
+	portMUX_TYPE lock;
+#endif
+};
+
+static int buf_pool_class_of(const buf_pool_t *pool, const void *block)
+{
+	for (int index = 0; index < pool->num_classes; index++) {
+		const buf_pool_class_t *class = &pool->classes[index];
+		uintptr_t offset = (uintptr_t) block - (uintptr_t) class->base;
+
+		if ((uintptr_t) block >= (uintptr_t) class->base &&
+		    offset < (uintptr_t) class->stats.size * class->stats.count &&
+		    offset % class->stats.size == 0) {
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+buf_pool_t *buf_pool_create(const buf_pool_config_t *config)
+{
+	buf_pool_t *pool = NULL;
+
+	if (!config || !config->num_classes || config->num_classes > BUF_POOL_MAX_CLASSES) {
+		return NULL;
+	}
+
+	for (int index = 0; index < config->num_classes; index++) {
+		const buf_pool_class_config_t *class = &config->classes[index];
+
+		if (!class->count || class->size % BUF_POOL_ALIGN ||
+		    class->size <= config->headroom || class->size < sizeof(buf_pool_block_t) ||
+		    (index && class->size <= config->classes[index - 1].size)) {
+			return NULL;
+		}
+	}
+
+	pool = calloc(1, sizeof(buf_pool_t));
+	if (!pool) {
+		return NULL;
+	}
+
+	pool->headroom = config->headroom;
+	pool->num_classes = config->num_classes;
+#ifdef ESP_PLATFORM
+	portMUX_INITIALIZE(&pool->lock);
+#endif
+
+	for (int index = 0; index < config->num_classes; index++) {
+		buf_pool_class_t *class = &pool->classes[index];
+
+		class->stats.size = config->classes[index].size;
+		class->stats.count = config->classes[index].count;
+		class->base = BUF_POOL_MEM_ALLOC((size_t) class->stats.size * class->stats.count);
+		if (!class->base) {
+			buf_pool_delete(pool);
+			return NULL;
+		}
+
+		/* Chained from the last block down, so the first allocations take the first blocks */
+		for (int block = class->stats.count - 1; block >= 0; block--) {
+			buf_pool_block_t *free_block = (buf_pool_block_t *) (class->base + block * class->stats.size);
+
+			free_block->next = class->free_list;
+			class->free_list = free_block;
+		}
+		class->stats.free = class->stats.count;
+	}
+
+	return pool;
+}
+
+void buf_pool_delete(buf_pool_t *pool)
+{
+	if (!pool) {
+		return;
+	}
+
+	for (int index = 0; index < pool->num_classes; index++) {
+		BUF_POOL_MEM_FREE(pool->classes[index].base);
+	}
+	free(pool);
+}
+
+uint8_t *buf_pool_alloc(buf_pool_t *pool, uint16_t len)
+{
+	buf_pool_block_t *block = NULL;
+	uint32_t need = (uint32_t) len + pool->headroom;
+	int fit = -1;
+
+	BUF_POOL_LOCK(pool);
+	for (int index = 0; index < pool->num_classes; index++) {
+		buf_pool_class_t *class = &pool->classes[index];
+		uint16_t in_use = 0;
+
+		if (class->stats.size < need) {
+			continue;
+		}
+		if (fit < 0) {
+			fit = index;
+		}
+		if (!class->free_list) {
+			continue;
+		}
+
+		block = class->free_list;
+		class->free_list = block->next;
+		class->stats.free--;
+		class->stats.allocs++;
+		if (index != fit) {
+			class->stats.borrowed++;
+		}
+		in_use = class->stats.count - class->stats.free;
+		if (in_use > class->stats.high_watermark) {
+			class->stats.high_watermark = in_use;
+		}
+		break;
+	}
+	if (!block && fit >= 0) {
+		pool->classes[fit].stats.failures++;
+	}
+	BUF_POOL_UNLOCK(pool);
+
+	return (uint8_t *) block;
+}
+
+void buf_pool_free(buf_pool_t *pool, void *block)
+{
+	buf_pool_block_t *free_block = block;
+	int index = 0;
+
+	if (!block) {
+		return;
+	}
+
+	index = buf_pool_class_of(pool, block);
+	if (index < 0) {
+		return;
+	}
+
+	BUF_POOL_LOCK(pool);
+	free_block->next = pool->classes[index].free_list;
+	pool->classes[index].free_list = free_block;
+	pool->classes[index].stats.free++;
+	BUF_POOL_UNLOCK(pool);
+}
+
+uint16_t buf_pool_block_size(const buf_pool_t *pool, const void *block)
+{
+	int index = 0;
+
+	if (!pool || !block) {
+		return 0;
+	}
+
+	index = buf_pool_class_of(pool, block);
+	return (index < 0) ? 0 : pool->classes[index].stats.size;
+}
+
+uint16_t buf_pool_headroom(const buf_pool_t *pool)
+{
+	return pool->headroom;
+}
+
+uint8_t buf_pool_get_stats(buf_pool_t *pool, buf_pool_class_stats_t *stats, uint8_t num)
+{
+	uint8_t count = (num < pool->num_classes) ? num : pool->num_classes;
+
+	BUF_POOL_LOCK(pool);
+	for (int index = 0; index < count; index++) {
+		stats[index] = pool->classes[index].stats;
+	}
+	BUF_POOL_UNLOCK(pool);
+
+	return pool->num_classes;
+}
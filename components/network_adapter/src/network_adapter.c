@@ -28,6 +28,8 @@
 #include "esp_private/wifi.h"
 #include "interface.h"
 #include "network_adapter.h"
+#include "tx_sched.h"
+#include "buf_pool.h"
 
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -71,10 +73,24 @@ uint32_t to_host_count = 0;
 uint32_t to_host_sent_count = 0;
 #endif
 
+static portMUX_TYPE tx_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static network_adapter_tx_stats_t tx_stats = {0};
+
 interface_context_t *if_context = NULL;
 interface_handle_t *if_handle = NULL;
 
-QueueHandle_t to_host_queue[MAX_PRIORITY_QUEUES] = {NULL};
+/* One queue per class of tx_sched.h, send_task is notified of every frame queued */
+static QueueHandle_t to_host_queue[TX_CLASS_MAX] = {NULL};
+static TaskHandle_t send_task_handle = NULL;
+/* Waits in the read of the transport, notified when the data path opens */
+static TaskHandle_t recv_task_handle = NULL;
+static tx_sched_t tx_sched;
+
+/* DMA capable blocks of the frames to and from the host, with room for esp_payload_header in front */
+static buf_pool_t *buf_pool = NULL;
+
+/* Frames per buffer to the host, as accepted by the host */
+static volatile uint8_t to_host_aggr_frames = 1;
 
 #if CONFIG_ESP_SPI_HOST_INTERFACE
 #ifdef CONFIG_IDF_TARGET_ESP32S2
@@ -86,6 +102,16 @@ QueueHandle_t to_host_queue[MAX_PRIORITY_QUEUES] = {NULL};
 #define TO_HOST_QUEUE_SIZE      100
 #endif
 
+/* recv_task waits this long before it reads again when the transport fails */
+#define RX_RETRY_TIME_MS        10
+
+/* A quantum of weight 1, the longest frame, so that every class sends at least one frame per turn */
+#define TX_SCHED_QUANTUM_UNIT   1600
+
+#define BUF_POOL_SMALL_SIZE     ((CONFIG_ESP_BUF_POOL_SMALL_SIZE + BUF_POOL_ALIGN - 1) & ~(BUF_POOL_ALIGN - 1))
+/* The SPI transactions and the longest frames with their header */
+#define BUF_POOL_LARGE_SIZE     1600
+
 #define MAC_LEN      6
 #define BSSID_LENGTH 19
 
@@ -119,43 +145,113 @@ static uint8_t get_capabilities()
 	return cap;
 }
 
+esp_err_t send_to_host_queue(interface_buffer_handle_t *buf_handle, uint8_t queue_type)
+{
+	uint8_t class = TX_CLASS_DATA;
+
+	if (queue_type == PRIO_Q_BT) {
+		class = TX_CLASS_BT;
+	} else if (buf_handle->if_type == ESP_STA_IF && buf_handle->payload_len <= CONFIG_ESP_TX_CTRL_MAX_LEN &&
+		   tx_sched_is_ctrl_frame(buf_handle->payload, buf_handle->payload_len)) {
+		class = TX_CLASS_CTRL;
+	}
+
+	if (!to_host_queue[class] ||
+	    xQueueSend(to_host_queue[class], buf_handle, portMAX_DELAY) != pdTRUE) {
+		return ESP_FAIL;
+	}
+
+	if (send_task_handle) {
+		xTaskNotifyGive(send_task_handle);
+	}
+
+	return ESP_OK;
+}
+
+bool network_adapter_tx_pending(void)
+{
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		if (to_host_queue[class] && uxQueueMessagesWaiting(to_host_queue[class])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint8_t network_adapter_get_aggr_frames(void)
+{
+	return to_host_aggr_frames;
+}
+
+buf_pool_t *network_adapter_get_buf_pool(void)
+{
+	return buf_pool;
+}
+
+void network_adapter_free_pool_buf(void *block)
+{
+	buf_pool_free(buf_pool, block);
+}
+
+/* A copy of a frame to the host, in a block of the pool when one is free, in the heap otherwise */
+uint8_t *network_adapter_alloc_tx_buf(uint16_t len, interface_buffer_handle_t *buf_handle)
+{
+	uint8_t *block = buf_pool ? buf_pool_alloc(buf_pool, len) : NULL;
+
+	if (block) {
+		buf_handle->payload = block + buf_pool_headroom(buf_pool);
+		buf_handle->priv_buffer_handle = block;
+		buf_handle->free_buf_handle = network_adapter_free_pool_buf;
+		return buf_handle->payload;
+	}
+
+	buf_handle->payload = (uint8_t *) malloc(len);
+	buf_handle->priv_buffer_handle = buf_handle->payload;
+	buf_handle->free_buf_handle = free;
+	return buf_handle->payload;
+}
+
 esp_err_t pkt_netif2driver(void *buffer, uint16_t len)
 {
 	if (flag) return ESP_FAIL;
 	esp_err_t ret = ESP_OK;
 	interface_buffer_handle_t buf_handle = {0};
-	uint8_t *netif_buf = NULL;
 
 	if (!buffer || !datapath) {
 		return ESP_OK;
 	}
 
-	netif_buf = (uint8_t *) malloc(len);
-
-	if (!netif_buf) {
+	if (!network_adapter_alloc_tx_buf(len, &buf_handle)) {
 		ESP_LOGE(TAG, "Netif Send packet: memory allocation failed");
 		return ESP_FAIL;
 	}
 
-	memcpy(netif_buf, buffer, len);
+	/* The only copy of the frame, the transport writes its header in front of it */
+	memcpy(buf_handle.payload, buffer, len);
 
 	buf_handle.if_type = ESP_STA_IF;
 	buf_handle.if_num = 0;
 	buf_handle.payload_len = len;
-	buf_handle.payload = netif_buf;
-	buf_handle.priv_buffer_handle = netif_buf;
-	buf_handle.free_buf_handle = free;
 
-	ret = xQueueSend(to_host_queue[PRIO_Q_OTHERS], &buf_handle, portMAX_DELAY);
+	ret = send_to_host_queue(&buf_handle, PRIO_Q_OTHERS);
 
-	if (ret != pdTRUE) {
+	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "Slave -> Host: Failed to send buffer\n");
+		buf_handle.free_buf_handle(buf_handle.priv_buffer_handle);
 		return ESP_FAIL;
 	}
 
 	return ESP_OK;
 }
 
+void network_adapter_get_tx_stats(network_adapter_tx_stats_t *stats)
+{
+	portENTER_CRITICAL(&tx_stats_lock);
+	*stats = tx_stats;
+	portEXIT_CRITICAL(&tx_stats_lock);
+}
+
 void process_tx_pkt(interface_buffer_handle_t *buf_handle)
 {
 	/* Check if data path is not yet open */
@@ -181,91 +277,153 @@ void process_tx_pkt(interface_buffer_handle_t *buf_handle)
 	}
 }
 
-/* Send data to host */
+/* Send data to host, in the order of tx_sched_next() while frames are waiting */
 void send_task(void* pvParameters)
 {
-#ifdef ESP_DEBUG_STATS
-	int t1, t2, t_total = 0;
-	int d_total = 0;
-#endif
 	interface_buffer_handle_t buf_handle = {0};
-	uint16_t bt_pkts_waiting = 0;
-	uint16_t other_pkts_waiting = 0;
+	uint16_t head_len[TX_CLASS_MAX] = {0};
+	int class = 0;
 
 	while (1) {
-		other_pkts_waiting = uxQueueMessagesWaiting(to_host_queue[PRIO_Q_OTHERS]);
-		bt_pkts_waiting = uxQueueMessagesWaiting(to_host_queue[PRIO_Q_BT]);
+		/* Every frame queued notifies, the frames queued while sending are picked up below */
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		while (1) {
+			for (class = 0; class < TX_CLASS_MAX; class++) {
+				head_len[class] = 0;
+				if (xQueuePeek(to_host_queue[class], &buf_handle, 0) == pdTRUE) {
+					head_len[class] = buf_handle.payload_len ? buf_handle.payload_len : 1;
+				}
+			}
 
-		if (other_pkts_waiting) {
-			if (xQueueReceive(to_host_queue[PRIO_Q_OTHERS], &buf_handle, portMAX_DELAY))
-				process_tx_pkt(&buf_handle);
-		} else if (bt_pkts_waiting) {
-			if (xQueueReceive(to_host_queue[PRIO_Q_BT], &buf_handle, portMAX_DELAY))
+			class = tx_sched_next(&tx_sched, head_len);
+			if (class < 0) {
+				break;
+			}
+
+			if (xQueueReceive(to_host_queue[class], &buf_handle, 0) == pdTRUE) {
+				portENTER_CRITICAL(&tx_stats_lock);
+				tx_stats.class_frames[class]++;
+				portEXIT_CRITICAL(&tx_stats_lock);
 				process_tx_pkt(&buf_handle);
-		} else {
-			vTaskDelay(1);
+			}
 		}
 	}
 }
 
-void process_rx_pkt(interface_buffer_handle_t *buf_handle)
+/* The host answers the TLVs of the startup event it supports with its own */
+static void process_priv_pkt(struct esp_payload_header *header, uint8_t *payload, uint16_t len)
 {
+	struct esp_priv_event *event = (struct esp_priv_event *) payload;
+	uint8_t *pos = NULL;
+	uint8_t len_left = 0;
+
+	if (header->priv_pkt_type != ESP_PACKET_TYPE_EVENT || len < sizeof(struct esp_priv_event) ||
+	    event->event_type != ESP_PRIV_EVENT_INIT || event->event_len > len - sizeof(struct esp_priv_event)) {
+		return;
+	}
+
+	pos = event->event_data;
+	len_left = event->event_len;
+
+	while (len_left >= 2 && pos[1] + 2 <= len_left) {
+		if (pos[0] == ESP_PRIV_AGGREGATION && pos[1] == LENGTH_1_BYTE) {
+			uint8_t frames = (pos[2] < CONFIG_ESP_AGGR_MAX_FRAMES) ? pos[2] : CONFIG_ESP_AGGR_MAX_FRAMES;
+
+			to_host_aggr_frames = frames ? frames : 1;
+			ESP_LOGI(TAG, "Up to %u frames per buffer to the host", to_host_aggr_frames);
+		}
+		len_left -= pos[1] + 2;
+		pos += pos[1] + 2;
+	}
+}
+
+/* Hand a batch of frames from the host to lwIP, the Wi-Fi driver and BT back to back, then release them */
+void process_rx_pkt(interface_buffer_handle_t *buf_handles, uint8_t frames)
+{
+	interface_buffer_handle_t *buf_handle = NULL;
 	struct esp_payload_header *header = NULL;
 	uint8_t *payload = NULL;
 	uint16_t payload_len = 0;
 
-	header = (struct esp_payload_header *) buf_handle->payload;
-	payload = buf_handle->payload + le16toh(header->offset);
-	payload_len = le16toh(header->len);
+	for (buf_handle = buf_handles; buf_handle < buf_handles + frames; buf_handle++) {
+		header = (struct esp_payload_header *) buf_handle->payload;
+		payload = buf_handle->payload + le16toh(header->offset);
+		payload_len = le16toh(header->len);
 
 #if CONFIG_ESP_WLAN_DEBUG
-	ESP_LOG_BUFFER_HEXDUMP(TAG_RX, payload, 8, ESP_LOG_INFO);
+		ESP_LOG_BUFFER_HEXDUMP(TAG_RX, payload, 8, ESP_LOG_INFO);
 #endif
 
-	if (buf_handle->if_type == ESP_STA_IF) {
-		/* Forward data to lwip */
-		esp_netif_receive(network_adapter_netif, payload, payload_len, NULL);
-		// ESP_LOG_BUFFER_HEXDUMP("host -> slave", payload, payload_len, ESP_LOG_INFO);
-	} else if (buf_handle->if_type == ESP_AP_IF && softap_started) {
-		/* Forward data to wlan driver */
-		esp_wifi_internal_tx(ESP_IF_WIFI_AP, payload, payload_len);
-    }
+		if (buf_handle->if_type == ESP_STA_IF) {
+			/* Forward data to lwip */
+			esp_netif_receive(network_adapter_netif, payload, payload_len, NULL);
+			// ESP_LOG_BUFFER_HEXDUMP("host -> slave", payload, payload_len, ESP_LOG_INFO);
+		} else if (buf_handle->if_type == ESP_AP_IF && softap_started) {
+			/* Forward data to wlan driver */
+			esp_wifi_internal_tx(ESP_IF_WIFI_AP, payload, payload_len);
+		}
 #if defined(CONFIG_ESP_GATEWAY_BT_ENABLED) && BLUETOOTH_HCI
-    else if (buf_handle->if_type == ESP_HCI_IF) {
-        process_hci_rx_pkt(payload, payload_len);
-    }
+		else if (buf_handle->if_type == ESP_HCI_IF) {
+			process_hci_rx_pkt(payload, payload_len);
+		}
 #endif
+		else if (buf_handle->if_type == ESP_PRIV_IF) {
+			process_priv_pkt(header, payload, payload_len);
+		}
+	}
 
-	/* Free buffer handle */
-	if (buf_handle->free_buf_handle && buf_handle->priv_buffer_handle) {
-		buf_handle->free_buf_handle(buf_handle->priv_buffer_handle);
-		buf_handle->priv_buffer_handle = NULL;
+	/* Free buffer handles */
+	for (buf_handle = buf_handles; buf_handle < buf_handles + frames; buf_handle++) {
+		if (buf_handle->free_buf_handle && buf_handle->priv_buffer_handle) {
+			buf_handle->free_buf_handle(buf_handle->priv_buffer_handle);
+			buf_handle->priv_buffer_handle = NULL;
+		}
+	}
+}
+
+/* Wake recv_task once the data path opens, event_handler() runs in the ISR of the SDIO slave */
+static void recv_task_notify(void)
+{
+	BaseType_t woken = pdFALSE;
+
+	if (!recv_task_handle) {
+		return;
+	}
+
+	if (xPortInIsrContext()) {
+		vTaskNotifyGiveFromISR(recv_task_handle, &woken);
+		if (woken) {
+			portYIELD_FROM_ISR();
+		}
+	} else {
+		xTaskNotifyGive(recv_task_handle);
 	}
 }
 
 /* Get data from host */
 void recv_task(void* pvParameters)
 {
-	interface_buffer_handle_t buf_handle;
+	interface_buffer_handle_t buf_handles[CONFIG_ESP_RX_BATCH_SIZE];
+	int frames = 0;
 
 	for (;;) {
 
-		if (!datapath) {
-			/* Datapath is not enabled by host yet*/
-			usleep(100*1000);
+		if (!datapath || !if_context || !if_context->if_ops || !if_context->if_ops->read) {
+			/* Datapath is not enabled by host yet */
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 			continue;
 		}
 
-		// receive data from transport layer
-		if (if_context && if_context->if_ops && if_context->if_ops->read) {
-			int len = if_context->if_ops->read(if_handle, &buf_handle);
-			if (len <= 0) {
-				usleep(10*1000);
-				continue;
-			}
+		// receive data from transport layer, waits for the first frame
+		frames = if_context->if_ops->read(if_handle, buf_handles, CONFIG_ESP_RX_BATCH_SIZE);
+		if (frames <= 0) {
+			/* The data path closed meanwhile, or a transport error */
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RX_RETRY_TIME_MS));
+			continue;
 		}
 
-		process_rx_pkt(&buf_handle);
+		process_rx_pkt(buf_handles, frames);
 	}
 }
 
@@ -280,10 +438,13 @@ int event_handler(uint8_t val)
 			} else {
 				ESP_EARLY_LOGI(TAG, "Failed to Start Data Path");
 			}
+			recv_task_notify();
 			break;
 
 		case ESP_CLOSE_DATA_PATH:
 			datapath = 0;
+			/* The next host negotiates again */
+			to_host_aggr_frames = 1;
 			if (if_handle) {
 				ESP_EARLY_LOGI(TAG, "Stop Data Path");
 				if_handle->state = DEACTIVE;
@@ -402,11 +563,32 @@ void task_runtime_stats_task(void* pvParameters)
 void network_adapter_driver_init(void)
 {
 	uint8_t capa = 0;
-	uint8_t prio_q_idx = 0;
+	uint8_t class = 0;
+	tx_sched_config_t sched_config = {
+		.quantum = {
+			[TX_CLASS_CTRL] = CONFIG_ESP_TX_SCHED_CTRL_WEIGHT * TX_SCHED_QUANTUM_UNIT,
+			[TX_CLASS_DATA] = CONFIG_ESP_TX_SCHED_DATA_WEIGHT * TX_SCHED_QUANTUM_UNIT,
+			[TX_CLASS_BT] = CONFIG_ESP_TX_SCHED_BT_WEIGHT * TX_SCHED_QUANTUM_UNIT,
+		},
+	};
+	buf_pool_config_t pool_config = {
+		.headroom = sizeof(struct esp_payload_header),
+		.num_classes = 2,
+		.classes = {
+			{ .size = BUF_POOL_SMALL_SIZE, .count = CONFIG_ESP_BUF_POOL_SMALL_NUM },
+			{ .size = BUF_POOL_LARGE_SIZE, .count = CONFIG_ESP_BUF_POOL_LARGE_NUM },
+		},
+	};
 	print_firmware_version();
 
 	capa = get_capabilities();
 
+	/* Before the BT driver and the transport, which take their buffers from it */
+	buf_pool = buf_pool_create(&pool_config);
+	if (!buf_pool) {
+		ESP_LOGW(TAG, "Failed to create buffer pool, the frames will be allocated from the heap");
+	}
+
 #ifdef CONFIG_ESP_GATEWAY_BT_ENABLED
 	esp_err_t ret;
 	uint8_t mac[MAC_LEN] = {0};
@@ -423,7 +605,10 @@ void network_adapter_driver_init(void)
 #endif
 
 	if_context = interface_insert_driver(event_handler);
+#if CONFIG_ESP_SPI_HOST_INTERFACE
+	/* The SPI host opens no data path, the SDIO one does with ESP_OPEN_DATA_PATH */
 	datapath = 1;
+#endif
 
 	if (!if_context || !if_context->if_ops) {
 		ESP_LOGE(TAG, "Failed to insert driver\n");
@@ -442,13 +627,14 @@ void network_adapter_driver_init(void)
 	/* send capabilities to host */
 	generate_startup_event(capa);
 
-	for (prio_q_idx=0; prio_q_idx<MAX_PRIORITY_QUEUES; prio_q_idx++) {
-		to_host_queue[prio_q_idx] = xQueueCreate(TO_HOST_QUEUE_SIZE, sizeof(interface_buffer_handle_t));
-		assert(to_host_queue[prio_q_idx] != NULL);
+	tx_sched_init(&tx_sched, &sched_config);
+	for (class = 0; class < TX_CLASS_MAX; class++) {
+		to_host_queue[class] = xQueueCreate(TO_HOST_QUEUE_SIZE, sizeof(interface_buffer_handle_t));
+		assert(to_host_queue[class] != NULL);
 	}
 
-	assert(xTaskCreate(recv_task , "recv_task" , 4096 , NULL , 22 , NULL) == pdTRUE);
-	assert(xTaskCreate(send_task , "send_task" , 4096 , NULL , 22 , NULL) == pdTRUE);
+	assert(xTaskCreate(recv_task , "recv_task" , 4096 , NULL , 22 , &recv_task_handle) == pdTRUE);
+	assert(xTaskCreate(send_task , "send_task" , 4096 , NULL , 22 , &send_task_handle) == pdTRUE);
 #ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
 	assert(xTaskCreate(task_runtime_stats_task, "task_runtime_stats_task",
 				4096, NULL, 1, NULL) == pdTRUE);
@@ -20,11 +20,13 @@
 #include "interface.h"
 #include "wifi_dongle_adapter.h"
 #include "sdio_slave_api.h"
+#include "network_adapter.h"
+#include "tx_aggr.h"
 #include "driver/sdio_slave.h"
 #include "soc/sdio_slave_periph.h"
 #include "endian.h"
 
-#define SDIO_SLAVE_QUEUE_SIZE 20
+#define SDIO_SLAVE_QUEUE_SIZE CONFIG_ESP_SDIO_TX_QUEUE_SIZE
 #define BUFFER_SIZE     2048
 #define BUFFER_NUM      20
 static uint8_t sdio_slave_rx_buffer[BUFFER_NUM][BUFFER_SIZE];
@@ -33,9 +35,15 @@ interface_context_t context;
 interface_handle_t if_handle_g;
 static const char TAG[] = "SDIO_SLAVE";
 
+/* Frames packed for the host while send_task has more of them, buf is NULL when none is open */
+static tx_aggr_t sdio_aggr;
+/* Counts the host events, an aggregate opened before the last one is not sent to the next host session */
+static volatile uint32_t sdio_session;
+static uint32_t sdio_aggr_session;
+
 static interface_handle_t * sdio_init(void);
 static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t *buf_handle);
-static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handle);
+static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handles, uint8_t max_frames);
 static esp_err_t sdio_reset(interface_handle_t *handle);
 static void sdio_deinit(interface_handle_t *handle);
 
@@ -65,8 +73,140 @@ int interface_remove_driver()
 	return 0;
 }
 
+/* A frame queued by sdio_write(), once the host has read it */
+static void sdio_tx_release(void *sendbuf)
+{
+	if (buf_pool_block_size(network_adapter_get_buf_pool(), sendbuf)) {
+		network_adapter_free_pool_buf(sendbuf);
+	} else {
+		free(sendbuf);
+	}
+}
+
+/* Release the frames the host has read, waiting up to wait for the first of them */
+static void sdio_tx_reap(TickType_t wait)
+{
+	void *sendbuf = NULL;
+
+	while (sdio_slave_send_get_finished(&sendbuf, wait) == ESP_OK) {
+		sdio_tx_release(sendbuf);
+		wait = 0;
+	}
+}
+
+/* Hand a buffer to the driver, which holds it until the host has read it */
+static esp_err_t sdio_tx_queue(uint8_t *sendbuf, uint32_t len)
+{
+	esp_err_t ret = ESP_OK;
+
+	/* The next writes go on meanwhile */
+	sdio_tx_reap(0);
+	while ((ret = sdio_slave_send_queue(sendbuf, len, sendbuf, 0)) == ESP_ERR_TIMEOUT) {
+		/* SDIO_SLAVE_QUEUE_SIZE frames in flight */
+		sdio_tx_reap(portMAX_DELAY);
+	}
+
+	return ret;
+}
+
+/* The header of a frame whose payload is in place after it */
+static void sdio_fill_header(uint8_t *sendbuf, interface_buffer_handle_t *buf_handle)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) sendbuf;
+	uint16_t offset = sizeof(struct esp_payload_header);
+
+	memset (header, 0, sizeof(struct esp_payload_header));
+
+	/* Initialize header */
+	header->if_type = buf_handle->if_type;
+	header->if_num = buf_handle->if_num;
+	header->len = htole16(buf_handle->payload_len);
+	header->offset = htole16(offset);
+
+	header->checksum = htole16(compute_checksum(sendbuf,
+				offset+buf_handle->payload_len));
+}
+
+static esp_err_t sdio_aggr_flush(void)
+{
+	esp_err_t ret = ESP_OK;
+
+	if (!sdio_aggr.buf) {
+		return ESP_OK;
+	}
+
+	ret = sdio_tx_queue(sdio_aggr.buf, sdio_aggr.len);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG , "sdio slave transmit error, ret : 0x%x\r\n", ret);
+		sdio_tx_release(sdio_aggr.buf);
+	}
+	sdio_aggr.buf = NULL;
+
+	return ret;
+}
+
+/* Drop the open aggregate, its frames were for a previous host session */
+static void sdio_aggr_discard(void)
+{
+	if (sdio_aggr.buf) {
+		ESP_LOGW(TAG, "Dropped %u frames to the previous host session", sdio_aggr.frames);
+		sdio_tx_release(sdio_aggr.buf);
+		sdio_aggr.buf = NULL;
+	}
+}
+
+/*
+ * Pack a frame with the ones before it while more wait for send_task, the buffer goes to the host once
+ * full or when send_task has no other frame. Returns false when the frame is to be sent on its own.
+ */
+static bool sdio_aggr_write(interface_buffer_handle_t *buf_handle)
+{
+	buf_pool_t *pool = network_adapter_get_buf_pool();
+	uint8_t max_frames = network_adapter_get_aggr_frames();
+	uint8_t *frame = NULL;
+
+	if (sdio_aggr.buf && sdio_aggr_session != sdio_session) {
+		sdio_aggr_discard();
+	}
+
+	if (sdio_aggr.buf && !tx_aggr_fits(&sdio_aggr, buf_handle->payload_len)) {
+		sdio_aggr_flush();
+	}
+
+	/* Frames up to half a buffer, the longer ones are sent in place */
+	if (!sdio_aggr.buf && max_frames > 1 && network_adapter_tx_pending() &&
+	    ESP_AGGR_FRAME_LEN(buf_handle->payload_len) * 2 <= ESP_AGGR_MAX_LEN) {
+		uint8_t *buf = pool ? buf_pool_alloc(pool, ESP_AGGR_MAX_LEN - buf_pool_headroom(pool)) : NULL;
+
+		if (!buf) {
+			buf = heap_caps_malloc(ESP_AGGR_MAX_LEN, MALLOC_CAP_DMA);
+		}
+		if (buf) {
+			tx_aggr_init(&sdio_aggr, buf, ESP_AGGR_MAX_LEN, max_frames);
+			sdio_aggr_session = sdio_session;
+		}
+	}
+
+	if (!sdio_aggr.buf) {
+		return false;
+	}
+
+	frame = tx_aggr_add(&sdio_aggr, buf_handle->payload_len);
+	memcpy(frame + sizeof(struct esp_payload_header), buf_handle->payload, buf_handle->payload_len);
+	sdio_fill_header(frame, buf_handle);
+
+	if (sdio_aggr.frames == sdio_aggr.max_frames || !network_adapter_tx_pending()) {
+		sdio_aggr_flush();
+	}
+
+	return true;
+}
+
 IRAM_ATTR static void event_cb(uint8_t val)
 {
+	/* send_task drops the open aggregate at its next write, its buffer is not released in the ISR */
+	sdio_session++;
+
 	if (val == ESP_RESET) {
 		sdio_reset(&if_handle_g);
 		return;
@@ -114,6 +254,13 @@ void generate_startup_event(uint8_t cap)
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = cap;                         pos++;len++;
 
+#if CONFIG_ESP_AGGR_MAX_FRAMES > 1
+	/* TLV - Frames per buffer to the host, if the host accepts them */
+	*pos = ESP_PRIV_AGGREGATION;        pos++;len++;
+	*pos = LENGTH_1_BYTE;               pos++;len++;
+	*pos = CONFIG_ESP_AGGR_MAX_FRAMES;  pos++;len++;
+#endif
+
 	/* TLVs end */
 
 	event->event_len = len;
@@ -144,7 +291,8 @@ static interface_handle_t * sdio_init(void)
 {
 	esp_err_t ret = ESP_OK;
 	sdio_slave_config_t config = {
-		.sending_mode       = SDIO_SLAVE_SEND_STREAM,
+		/* One frame per read of the host, with several of them queued */
+		.sending_mode       = SDIO_SLAVE_SEND_PACKET,
 		.send_queue_size    = SDIO_SLAVE_QUEUE_SIZE,
 		.recv_buffer_size   = BUFFER_SIZE,
 		.event_cb           = event_cb,
@@ -202,7 +350,7 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 	int32_t total_len = 0;
 	uint8_t* sendbuf = NULL;
 	uint16_t offset = 0;
-	struct esp_payload_header *header = NULL;
+	bool in_place = false;
 
 	if (!handle || !buf_handle) {
 		ESP_LOGE(TAG , "Invalid arguments");
@@ -210,6 +358,7 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 	}
 
 	if (handle->state != ACTIVE) {
+		sdio_aggr_discard();
 		return ESP_FAIL;
 	}
 
@@ -218,60 +367,62 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 		return ESP_FAIL;
 	}
 
-	total_len = buf_handle->payload_len + sizeof (struct esp_payload_header);
-
-	sendbuf = heap_caps_malloc(total_len, MALLOC_CAP_DMA);
-	if (sendbuf == NULL) {
-		ESP_LOGE(TAG , "Malloc send buffer fail!");
-		return ESP_FAIL;
+	if (sdio_aggr_write(buf_handle)) {
+		return buf_handle->payload_len;
 	}
 
-	header = (struct esp_payload_header *) sendbuf;
-
-	memset (header, 0, sizeof(struct esp_payload_header));
-
-	/* Initialize header */
-	header->if_type = buf_handle->if_type;
-	header->if_num = buf_handle->if_num;
-	header->len = htole16(buf_handle->payload_len);
 	offset = sizeof(struct esp_payload_header);
-	header->offset = htole16(offset);
-
-	memcpy(sendbuf + offset, buf_handle->payload, buf_handle->payload_len);
+	total_len = buf_handle->payload_len + offset;
+
+	/* A frame of the buffer pool has room for the header in front of it, it is sent as is */
+	sendbuf = buf_handle->payload - offset;
+	in_place = (buf_handle->priv_buffer_handle == sendbuf) &&
+		(buf_pool_block_size(network_adapter_get_buf_pool(), sendbuf) >= total_len);
+	if (!in_place) {
+		sendbuf = network_adapter_get_buf_pool() ?
+			buf_pool_alloc(network_adapter_get_buf_pool(), buf_handle->payload_len) : NULL;
+		if (!sendbuf) {
+			sendbuf = heap_caps_malloc(total_len, MALLOC_CAP_DMA);
+		}
+		if (sendbuf == NULL) {
+			ESP_LOGE(TAG , "Malloc send buffer fail!");
+			return ESP_FAIL;
+		}
+		memcpy(sendbuf + offset, buf_handle->payload, buf_handle->payload_len);
+	}
 
-	header->checksum = htole16(compute_checksum(sendbuf,
-				offset+buf_handle->payload_len));
+	sdio_fill_header(sendbuf, buf_handle);
 
-	ret = sdio_slave_transmit(sendbuf, total_len);
+	ret = sdio_tx_queue(sendbuf, total_len);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG , "sdio slave transmit error, ret : 0x%x\r\n", ret);
-		free(sendbuf);
+		if (!in_place) {
+			sdio_tx_release(sendbuf);
+		}
 		return ESP_FAIL;
 	}
 
-	free(sendbuf);
+	if (in_place) {
+		/* Released by sdio_tx_reap(), not by the caller */
+		buf_handle->priv_buffer_handle = NULL;
+	}
 
 	return buf_handle->payload_len;
 }
 
-static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handle)
+/* A frame received from the host, ESP_ERR_TIMEOUT when none came within wait */
+static esp_err_t sdio_read_frame(interface_buffer_handle_t *buf_handle, TickType_t wait)
 {
 	struct esp_payload_header *header = NULL;
 	uint16_t rx_checksum = 0, checksum = 0, len = 0;
 	size_t sdio_read_len = 0;
+	esp_err_t ret = ESP_OK;
 
-
-	if (!if_handle) {
-		ESP_LOGE(TAG, "Invalid arguments to sdio_read");
-		return ESP_FAIL;
-	}
-
-	if (if_handle->state != ACTIVE) {
-		return ESP_FAIL;
+	ret = sdio_slave_recv(&(buf_handle->sdio_buf_handle), &(buf_handle->payload),
+			&(sdio_read_len), wait);
+	if (ret != ESP_OK) {
+		return ret;
 	}
-
-	sdio_slave_recv(&(buf_handle->sdio_buf_handle), &(buf_handle->payload),
-			&(sdio_read_len), portMAX_DELAY);
 	buf_handle->payload_len = sdio_read_len & 0xFFFF;
 
 	header = (struct esp_payload_header *) buf_handle->payload;
@@ -292,7 +443,34 @@ static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *b
 	buf_handle->if_num = header->if_num;
 	buf_handle->free_buf_handle = sdio_read_done;
 
-	return len;
+	return ESP_OK;
+}
+
+static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handles, uint8_t max_frames)
+{
+	uint8_t frames = 0;
+	esp_err_t ret = ESP_OK;
+
+	if (!if_handle || !buf_handles) {
+		ESP_LOGE(TAG, "Invalid arguments to sdio_read");
+		return ESP_FAIL;
+	}
+
+	if (if_handle->state != ACTIVE) {
+		return ESP_FAIL;
+	}
+
+	/* Wait for the first frame only, a frame with a wrong checksum is dropped */
+	while (frames < max_frames) {
+		ret = sdio_read_frame(&buf_handles[frames], frames ? 0 : portMAX_DELAY);
+		if (ret == ESP_OK) {
+			frames++;
+		} else if (ret == ESP_ERR_TIMEOUT) {
+			break;
+		}
+	}
+
+	return frames;
 }
 
 static esp_err_t sdio_reset(interface_handle_t *handle)
@@ -309,20 +487,7 @@ static esp_err_t sdio_reset(interface_handle_t *handle)
 	if (ret != ESP_OK)
 		return ret;
 
-	while(1) {
-		sdio_slave_buf_handle_t handle = NULL;
-
-		/* Return buffers to driver */
-		ret = sdio_slave_send_get_finished(&handle, 0);
-		if (ret != ESP_OK)
-			break;
-
-		if (handle) {
-			ret = sdio_slave_recv_load_buf(handle);
-			ESP_ERROR_CHECK(ret);
-		}
-	}
-
+	/* The reset returned the frames in flight as finished, the next write releases them */
 	return ESP_OK;
 }
 
@@ -330,4 +495,6 @@ static void sdio_deinit(interface_handle_t *handle)
 {
 	sdio_slave_stop();
 	sdio_slave_reset();
+	sdio_aggr_discard();
+	sdio_tx_reap(0);
 }
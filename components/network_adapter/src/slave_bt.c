@@ -23,6 +23,7 @@
 #include "esp_log.h"
 #include "slave_bt.h"
 #include "wifi_dongle_adapter.h"
+#include "network_adapter.h"
 
 #ifdef CONFIG_IDF_TARGET_ESP32C3
 #include "esp_private/gdma.h"
@@ -32,7 +33,6 @@
 #endif
 
 static const char BT_TAG[] = "ESP_BT";
-extern QueueHandle_t to_host_queue[MAX_PRIORITY_QUEUES];
 
 #if BLUETOOTH_HCI
 /* ***** HCI specific part ***** */
@@ -50,34 +50,28 @@ static int host_rcv_pkt(uint8_t *data, uint16_t len)
 {
 	esp_err_t ret = ESP_OK;
 	interface_buffer_handle_t buf_handle;
-	uint8_t *buf = NULL;
 
-	buf = (uint8_t *) malloc(len);
+	memset(&buf_handle, 0, sizeof(buf_handle));
 
-	if (!buf) {
+	if (!network_adapter_alloc_tx_buf(len, &buf_handle)) {
 		ESP_LOGE(BT_TAG, "HCI Send packet: memory allocation failed");
 		return ESP_FAIL;
 	}
 
-	memcpy(buf, data, len);
-
-	memset(&buf_handle, 0, sizeof(buf_handle));
+	memcpy(buf_handle.payload, data, len);
 
 	buf_handle.if_type = ESP_HCI_IF;
 	buf_handle.if_num = 0;
 	buf_handle.payload_len = len;
-	buf_handle.payload = buf;
-	buf_handle.wlan_buf_handle = buf;
-	buf_handle.free_buf_handle = free;
 
 #if CONFIG_ESP_BT_DEBUG
 	ESP_LOG_BUFFER_HEXDUMP("bt_tx", data, len, ESP_LOG_INFO);
 #endif
-	ret = xQueueSend(to_host_queue[PRIO_Q_BT], &buf_handle, portMAX_DELAY);
+	ret = send_to_host_queue(&buf_handle, PRIO_Q_BT);
 
-	if (ret != pdTRUE) {
+	if (ret != ESP_OK) {
 		ESP_LOGE(BT_TAG, "HCI send packet: Failed to send buffer\n");
-		free(buf);
+		buf_handle.free_buf_handle(buf_handle.priv_buffer_handle);
 		return ESP_FAIL;
 	}
 
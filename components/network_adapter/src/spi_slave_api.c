@@ -20,10 +20,14 @@
 #include "esp_log.h"
 #include "interface.h"
 #include "wifi_dongle_adapter.h"
+#include "network_adapter.h"
+#include "tx_aggr.h"
+#include "esp_attr.h"
 #include "driver/spi_slave.h"
 #include "driver/gpio.h"
 #include "endian.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 static const char TAG[] = "SPI_DRIVER";
 #define SPI_BITS_PER_WORD          8
@@ -116,17 +120,52 @@ static interface_handle_t if_handle_g;
 static uint8_t gpio_handshake = CONFIG_ESP_SPI_GPIO_HANDSHAKE;
 static uint8_t gpio_data_ready = CONFIG_ESP_SPI_GPIO_DATA_READY;
 static QueueHandle_t spi_rx_queue[MAX_PRIORITY_QUEUES] = {NULL};
-static QueueHandle_t spi_tx_queue[MAX_PRIORITY_QUEUES] = {NULL};
+/* A single queue, so that the transactions keep the order send_task picked the frames in with tx_sched */
+static QueueHandle_t spi_tx_queue = NULL;
+/* Frames waiting in spi_rx_queue, so that esp_spi_read() sleeps until one comes */
+static SemaphoreHandle_t spi_rx_sem = NULL;
+
+/* Sent when the host clocks a transaction and no frame is waiting, only read by the DMA */
+static DMA_ATTR uint8_t spi_dummy_tx_buffer[SPI_BUFFER_SIZE];
 
 static interface_handle_t * esp_spi_init(void);
 static int32_t esp_spi_write(interface_handle_t *handle,
 				interface_buffer_handle_t *buf_handle);
-static int esp_spi_read(interface_handle_t *if_handle, interface_buffer_handle_t * buf_handle);
+static int esp_spi_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handles, uint8_t max_frames);
 static esp_err_t esp_spi_reset(interface_handle_t *handle);
 static void esp_spi_deinit(interface_handle_t *handle);
 static void esp_spi_read_done(void *handle);
 static void queue_next_transaction(void);
 
+/* A buffer of a whole transaction, from the buffer pool when it has one free */
+static uint8_t *spi_buffer_alloc(void)
+{
+	buf_pool_t *pool = network_adapter_get_buf_pool();
+	uint8_t *buf = NULL;
+
+	if (pool) {
+		/* The DMA uses the whole block, header room included */
+		buf = buf_pool_alloc(pool, SPI_BUFFER_SIZE - buf_pool_headroom(pool));
+	}
+
+	return buf ? buf : heap_caps_malloc(SPI_BUFFER_SIZE, MALLOC_CAP_DMA);
+}
+
+static void spi_buffer_free(void *buf)
+{
+	buf_pool_t *pool = network_adapter_get_buf_pool();
+
+	if (!buf || buf == spi_dummy_tx_buffer) {
+		return;
+	}
+
+	if (buf_pool_block_size(pool, buf)) {
+		buf_pool_free(pool, buf);
+	} else {
+		free(buf);
+	}
+}
+
 
 
 if_ops_t if_ops = {
@@ -165,7 +204,7 @@ void generate_startup_event(uint8_t cap)
 
 	memset(&buf_handle, 0, sizeof(buf_handle));
 
-	buf_handle.payload = heap_caps_malloc(SPI_BUFFER_SIZE, MALLOC_CAP_DMA);
+	buf_handle.payload = spi_buffer_alloc();
 	assert(buf_handle.payload);
 	memset(buf_handle.payload, 0, SPI_BUFFER_SIZE);
 
@@ -207,6 +246,13 @@ void generate_startup_event(uint8_t cap)
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = cap;                         pos++;len++;
 
+#if CONFIG_ESP_AGGR_MAX_FRAMES > 1
+	/* TLV - Frames per buffer to the host, if the host accepts them */
+	*pos = ESP_PRIV_AGGREGATION;        pos++;len++;
+	*pos = LENGTH_1_BYTE;               pos++;len++;
+	*pos = CONFIG_ESP_AGGR_MAX_FRAMES;  pos++;len++;
+#endif
+
 	/* TLVs end */
 
 	event->event_len = len;
@@ -218,7 +264,7 @@ void generate_startup_event(uint8_t cap)
 	buf_handle.payload_len = len + sizeof(struct esp_payload_header);
 	header->checksum = htole16(compute_checksum(buf_handle.payload, buf_handle.payload_len));
 
-	xQueueSend(spi_tx_queue[PRIO_Q_OTHERS], &buf_handle, portMAX_DELAY);
+	xQueueSend(spi_tx_queue, &buf_handle, portMAX_DELAY);
 
 	/* indicate waiting data on ready pin */
 	WRITE_PERI_REG(GPIO_OUT_W1TS_REG, (1 << gpio_data_ready));
@@ -241,26 +287,58 @@ static void IRAM_ATTR spi_post_trans_cb(spi_slave_transaction_t *trans)
 	WRITE_PERI_REG(GPIO_OUT_W1TC_REG, (1 << gpio_handshake));
 }
 
+/* Pack the frames waiting behind the first one into its transaction, as many as fit and the host accepts */
+static void spi_tx_aggregate(interface_buffer_handle_t *buf_handle)
+{
+	interface_buffer_handle_t next = {0};
+	struct esp_payload_header *header = (struct esp_payload_header *) buf_handle->payload;
+	uint8_t max_frames = network_adapter_get_aggr_frames();
+	uint8_t *frame = NULL;
+	tx_aggr_t aggr;
+
+	if (max_frames < 2 || header->if_type == ESP_PRIV_IF) {
+		return;
+	}
+
+	/* Every tx buffer is a whole transaction, the first frame is already in place */
+	tx_aggr_init(&aggr, buf_handle->payload, SPI_BUFFER_SIZE, max_frames);
+	tx_aggr_add(&aggr, le16toh(header->len));
+
+	/* In the order of the queue, a frame which does not fit leads the next transaction */
+	for (;;) {
+		if (xQueuePeek(spi_tx_queue, &next, 0) != pdTRUE) {
+			break;
+		}
+
+		header = (struct esp_payload_header *) next.payload;
+		frame = tx_aggr_add(&aggr, le16toh(header->len));
+		if (!frame) {
+			break;
+		}
+
+		xQueueReceive(spi_tx_queue, &next, 0);
+		memcpy(frame, next.payload, sizeof(struct esp_payload_header) + le16toh(header->len));
+		spi_buffer_free(next.payload);
+	}
+
+	buf_handle->payload_len = aggr.len;
+}
+
 static uint8_t * get_next_tx_buffer(uint32_t *len)
 {
 	interface_buffer_handle_t buf_handle = {0};
 	esp_err_t ret = ESP_OK;
-	uint8_t *sendbuf = NULL;
-	struct esp_payload_header *header = NULL;
 
 	/* Get or create new tx_buffer
 	 *	1. Check if SPI TX queue has pending buffers. Return if valid buffer is obtained.
-	 *	2. Create a new empty tx buffer and return */
+	 *	2. Return the dummy tx buffer */
 
 	/* Get buffer from SPI Tx queue */
-	if(uxQueueMessagesWaiting(spi_tx_queue[PRIO_Q_OTHERS]))
-		ret = xQueueReceive(spi_tx_queue[PRIO_Q_OTHERS], &buf_handle, portMAX_DELAY);
-	else if(uxQueueMessagesWaiting(spi_tx_queue[PRIO_Q_BT]))
-		ret = xQueueReceive(spi_tx_queue[PRIO_Q_BT], &buf_handle, portMAX_DELAY);
-	else
-		ret = pdFALSE;
+	ret = xQueueReceive(spi_tx_queue, &buf_handle, 0);
 
 	if (ret == pdTRUE && buf_handle.payload) {
+		spi_tx_aggregate(&buf_handle);
+
 		if (len)
 			*len = buf_handle.payload_len;
 		/* Return real data buffer from queue */
@@ -270,29 +348,10 @@ static uint8_t * get_next_tx_buffer(uint32_t *len)
 	/* No real data pending, clear ready line and indicate host an idle state */
 	WRITE_PERI_REG(GPIO_OUT_W1TC_REG, (1 << gpio_data_ready));
 
-	/* Create empty dummy buffer */
-	sendbuf = heap_caps_malloc(SPI_BUFFER_SIZE, MALLOC_CAP_DMA);
-	if (!sendbuf) {
-		ESP_LOGE(TAG, "Failed to allocate memory for dummy transaction");
-		if (len)
-			*len = 0;
-		return NULL;
-	}
-
-	memset(sendbuf, 0, SPI_BUFFER_SIZE);
-
-	/* Initialize header */
-	header = (struct esp_payload_header *) sendbuf;
-
-	/* Populate header to indicate it as a dummy buffer */
-	header->if_type = 0xF;
-	header->if_num = 0xF;
-	header->len = 0;
-
 	if (len)
 		*len = 0;
 
-	return sendbuf;
+	return spi_dummy_tx_buffer;
 }
 
 static int process_spi_rx(interface_buffer_handle_t *buf_handle)
@@ -342,6 +401,8 @@ static int process_spi_rx(interface_buffer_handle_t *buf_handle)
 	if (ret != pdTRUE)
 		return -1;
 
+	xSemaphoreGive(spi_rx_sem);
+
 	return 0;
 }
 
@@ -365,7 +426,7 @@ static void queue_next_transaction(void)
 	memset(spi_trans, 0, sizeof(spi_slave_transaction_t));
 
 	/* Attach Rx Buffer */
-	spi_trans->rx_buffer = heap_caps_malloc(SPI_BUFFER_SIZE, MALLOC_CAP_DMA);
+	spi_trans->rx_buffer = spi_buffer_alloc();
 	assert(spi_trans->rx_buffer);
 	memset(spi_trans->rx_buffer, 0, SPI_BUFFER_SIZE);
 
@@ -379,9 +440,9 @@ static void queue_next_transaction(void)
 
 	if (ret != ESP_OK) {
 		ESP_LOGI(TAG, "Failed to queue next SPI transfer\n");
-		free(spi_trans->rx_buffer);
+		spi_buffer_free(spi_trans->rx_buffer);
 		spi_trans->rx_buffer = NULL;
-		free((void *)spi_trans->tx_buffer);
+		spi_buffer_free((void *)spi_trans->tx_buffer);
 		spi_trans->tx_buffer = NULL;
 		free(spi_trans);
 		spi_trans = NULL;
@@ -419,7 +480,7 @@ static void spi_transaction_post_process_task(void* pvParameters)
 
 		/* Free any tx buffer, data is not relevant anymore */
 		if (spi_trans->tx_buffer) {
-			free((void *)spi_trans->tx_buffer);
+			spi_buffer_free((void *)spi_trans->tx_buffer);
 			spi_trans->tx_buffer = NULL;
 		}
 
@@ -432,7 +493,7 @@ static void spi_transaction_post_process_task(void* pvParameters)
 			/* free rx_buffer if process_spi_rx returns an error
 			 * In success case it will be freed later */
 			if (ret != ESP_OK) {
-				free((void *)spi_trans->rx_buffer);
+				spi_buffer_free((void *)spi_trans->rx_buffer);
 				spi_trans->rx_buffer = NULL;
 			}
 		}
@@ -447,6 +508,7 @@ static interface_handle_t * esp_spi_init(void)
 {
 	esp_err_t ret = ESP_OK;
 	uint8_t prio_q_idx = 0;
+	struct esp_payload_header *header = NULL;
 
 	/* Configuration for the SPI bus */
 	spi_bus_config_t buscfg={
@@ -506,17 +568,28 @@ static interface_handle_t * esp_spi_init(void)
 	ret=spi_slave_initialize(ESP_SPI_CONTROLLER, &buscfg, &slvcfg, DMA_CHAN);
 	assert(ret==ESP_OK);
 
+	/* Header of the dummy transactions */
+	header = (struct esp_payload_header *) spi_dummy_tx_buffer;
+	memset(spi_dummy_tx_buffer, 0, SPI_BUFFER_SIZE);
+	header->if_type = 0xF;
+	header->if_num = 0xF;
+	header->len = 0;
+
 	memset(&if_handle_g, 0, sizeof(if_handle_g));
 	if_handle_g.state = INIT;
 
+	spi_rx_sem = xSemaphoreCreateCounting(SPI_RX_QUEUE_SIZE * MAX_PRIORITY_QUEUES, 0);
+	assert(spi_rx_sem != NULL);
+
 	for (prio_q_idx=0; prio_q_idx<MAX_PRIORITY_QUEUES;prio_q_idx++) {
 		spi_rx_queue[prio_q_idx] = xQueueCreate(SPI_RX_QUEUE_SIZE, sizeof(interface_buffer_handle_t));
 		assert(spi_rx_queue[prio_q_idx] != NULL);
-
-		spi_tx_queue[prio_q_idx] = xQueueCreate(SPI_TX_QUEUE_SIZE, sizeof(interface_buffer_handle_t));
-		assert(spi_tx_queue[prio_q_idx] != NULL);
 	}
 
+	/* Room for the frames of both priorities */
+	spi_tx_queue = xQueueCreate(SPI_TX_QUEUE_SIZE * MAX_PRIORITY_QUEUES, sizeof(interface_buffer_handle_t));
+	assert(spi_tx_queue != NULL);
+
 	assert(xTaskCreate(spi_transaction_post_process_task , "spi_post_process_task" ,
 			4096 , NULL , 22 , NULL) == pdTRUE);
 
@@ -530,6 +603,7 @@ static int32_t esp_spi_write(interface_handle_t *handle, interface_buffer_handle
 	esp_err_t ret = ESP_OK;
 	int32_t total_len = 0;
 	uint16_t offset = 0;
+	bool in_place = false;
 	struct esp_payload_header *header = NULL;
 	interface_buffer_handle_t tx_buf_handle = {0};
 
@@ -561,8 +635,18 @@ static int32_t esp_spi_write(interface_handle_t *handle, interface_buffer_handle
 	tx_buf_handle.if_num = buf_handle->if_num;
 	tx_buf_handle.payload_len = total_len;
 
-	tx_buf_handle.payload = heap_caps_malloc(total_len, MALLOC_CAP_DMA);
-	assert(tx_buf_handle.payload);
+	/*
+	 * A frame in a whole block of the buffer pool has room for the header in front of it: the
+	 * transaction takes the block, the caller must not free it. The others are copied.
+	 */
+	tx_buf_handle.payload = buf_handle->payload - sizeof(struct esp_payload_header);
+	in_place = buf_pool_block_size(network_adapter_get_buf_pool(), tx_buf_handle.payload) >= SPI_BUFFER_SIZE;
+	if (in_place) {
+		buf_handle->priv_buffer_handle = NULL;
+	} else {
+		tx_buf_handle.payload = spi_buffer_alloc();
+		assert(tx_buf_handle.payload);
+	}
 
 	header = (struct esp_payload_header *) tx_buf_handle.payload;
 
@@ -578,18 +662,20 @@ static int32_t esp_spi_write(interface_handle_t *handle, interface_buffer_handle
 	header->flags = buf_handle->flag;
 
 	/* copy the data from caller */
-	memcpy(tx_buf_handle.payload + offset, buf_handle->payload, buf_handle->payload_len);
+	if (!in_place) {
+		memcpy(tx_buf_handle.payload + offset, buf_handle->payload, buf_handle->payload_len);
+	}
 
 	header->checksum = htole16(compute_checksum(tx_buf_handle.payload,
 				offset+buf_handle->payload_len));
 
-	if (header->if_type == ESP_HCI_IF)
-		ret = xQueueSend(spi_tx_queue[PRIO_Q_BT], &tx_buf_handle, portMAX_DELAY);
-	else
-		ret = xQueueSend(spi_tx_queue[PRIO_Q_OTHERS], &tx_buf_handle, portMAX_DELAY);
+	/* send_task calls in the order of tx_sched, the BT frames are not put behind the data */
+	ret = xQueueSend(spi_tx_queue, &tx_buf_handle, portMAX_DELAY);
 
-	if (ret != pdTRUE)
+	if (ret != pdTRUE) {
+		spi_buffer_free(tx_buf_handle.payload);
 		return ESP_FAIL;
+	}
 
 	/* indicate waiting data on ready pin */
 	WRITE_PERI_REG(GPIO_OUT_W1TS_REG, (1 << gpio_data_ready));
@@ -597,39 +683,30 @@ static int32_t esp_spi_write(interface_handle_t *handle, interface_buffer_handle
 	return buf_handle->payload_len;
 }
 
-static void IRAM_ATTR esp_spi_read_done(void *handle)
+static void esp_spi_read_done(void *handle)
 {
-	if (handle) {
-		free(handle);
-		handle = NULL;
-	}
+	spi_buffer_free(handle);
 }
 
-static int esp_spi_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handle)
+static int esp_spi_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handles, uint8_t max_frames)
 {
-	esp_err_t ret = ESP_OK;
+	uint8_t frames = 0;
 
-	if (!if_handle) {
+	if (!if_handle || !buf_handles) {
 		ESP_LOGE(TAG, "Invalid arguments to esp_spi_read\n");
 		return ESP_FAIL;
 	}
 
-	while (1) {
-		if(uxQueueMessagesWaiting(spi_rx_queue[PRIO_Q_OTHERS])) {
-			ret = xQueueReceive(spi_rx_queue[PRIO_Q_OTHERS], buf_handle, portMAX_DELAY);
-			break;
-		} else if(uxQueueMessagesWaiting(spi_rx_queue[PRIO_Q_BT])) {
-			ret = xQueueReceive(spi_rx_queue[PRIO_Q_BT], buf_handle, portMAX_DELAY);
-			break;
-		} else {
-			vTaskDelay(1);
+	/* One count of spi_rx_sem per frame in the rx queues, waited for the first frame only */
+	while (frames < max_frames &&
+	       xSemaphoreTake(spi_rx_sem, frames ? 0 : portMAX_DELAY) == pdTRUE) {
+		if (xQueueReceive(spi_rx_queue[PRIO_Q_OTHERS], &buf_handles[frames], 0) == pdTRUE ||
+		    xQueueReceive(spi_rx_queue[PRIO_Q_BT], &buf_handles[frames], 0) == pdTRUE) {
+			frames++;
 		}
 	}
 
-	if (ret != pdTRUE) {
-		return ESP_FAIL;
-	}
-	return buf_handle->payload_len;
+	return frames;
 }
 
 static esp_err_t esp_spi_reset(interface_handle_t *handle)
@@ -0,0 +1,59 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include "endian.h"
+#include "wifi_dongle_adapter.h"
+#include "tx_aggr.h"
+
+void tx_aggr_init(tx_aggr_t *aggr, uint8_t *buf, uint16_t size, uint8_t max_frames)
+{
+	aggr->buf = buf;
+	aggr->size = size;
+	aggr->len = 0;
+	aggr->frames = 0;
+	aggr->max_frames = max_frames ? max_frames : 1;
+	aggr->last = NULL;
+}
+
+bool tx_aggr_fits(const tx_aggr_t *aggr, uint16_t payload_len)
+{
+	return aggr->frames < aggr->max_frames &&
+		(uint32_t) aggr->len + ESP_AGGR_FRAME_LEN((uint32_t) payload_len) <= aggr->size;
+}
+
+uint8_t *tx_aggr_add(tx_aggr_t *aggr, uint16_t payload_len)
+{
+	struct esp_payload_header *last = (struct esp_payload_header *) aggr->last;
+	uint8_t *frame = NULL;
+
+	if (!tx_aggr_fits(aggr, payload_len)) {
+		return NULL;
+	}
+
+	if (last && !(last->flags & MORE_FRAMES)) {
+		/* The checksum is the sum of the bytes, the flag adds its own value */
+		last->flags |= MORE_FRAMES;
+		last->checksum = htole16(le16toh(last->checksum) + MORE_FRAMES);
+	}
+
+	frame = aggr->buf + aggr->len;
+	aggr->last = frame;
+	aggr->len += ESP_AGGR_FRAME_LEN(payload_len);
+	aggr->frames++;
+
+	return frame;
+}
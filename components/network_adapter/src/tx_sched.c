@@ -0,0 +1,181 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string.h>
+#include "tx_sched.h"
+
+#define TX_ETH_HLEN             14
+#define TX_ETH_TYPE_IP          0x0800
+#define TX_ETH_TYPE_ARP         0x0806
+#define TX_ETH_TYPE_IPV6        0x86DD
+#define TX_IP6_HLEN             40
+#define TX_IP_PROTO_TCP         6
+#define TX_IP_PROTO_UDP         17
+#define TX_IP_PROTO_ICMP6       58
+#define TX_TCP_HLEN             20
+#define TX_TCP_FIN_RST          0x05
+#define TX_UDP_HLEN             8
+#define TX_ICMP6_RS             133
+#define TX_ICMP6_REDIRECT       137
+
+static void tx_sched_new_round(tx_sched_t *sched)
+{
+	/* Not accumulated: the control class only gets ahead by its quantum per round */
+	sched->deficit[TX_CLASS_CTRL] = sched->config.quantum[TX_CLASS_CTRL];
+}
+
+static void tx_sched_advance(tx_sched_t *sched)
+{
+	sched->turn_started = 0;
+	if (sched->current == TX_CLASS_DATA) {
+		sched->current = TX_CLASS_BT;
+	} else {
+		sched->current = TX_CLASS_DATA;
+		tx_sched_new_round(sched);
+	}
+}
+
+void tx_sched_init(tx_sched_t *sched, const tx_sched_config_t *config)
+{
+	memset(sched, 0, sizeof(*sched));
+	for (int class = 0; class < TX_CLASS_MAX; class++) {
+		sched->config.quantum[class] = config->quantum[class] ? config->quantum[class] : 1;
+	}
+	sched->current = TX_CLASS_DATA;
+	tx_sched_new_round(sched);
+}
+
+int tx_sched_next(tx_sched_t *sched, const uint16_t head_len[TX_CLASS_MAX])
+{
+	uint8_t class = 0;
+
+	if (head_len[TX_CLASS_CTRL] && sched->deficit[TX_CLASS_CTRL] >= head_len[TX_CLASS_CTRL]) {
+		sched->deficit[TX_CLASS_CTRL] -= head_len[TX_CLASS_CTRL];
+		return TX_CLASS_CTRL;
+	}
+
+	if (!head_len[TX_CLASS_DATA] && !head_len[TX_CLASS_BT]) {
+		sched->deficit[TX_CLASS_DATA] = 0;
+		sched->deficit[TX_CLASS_BT] = 0;
+		if (!head_len[TX_CLASS_CTRL]) {
+			return -1;
+		}
+
+		/* Nothing else to send, the control class does not wait for the next round */
+		tx_sched_new_round(sched);
+		if (sched->deficit[TX_CLASS_CTRL] >= head_len[TX_CLASS_CTRL]) {
+			sched->deficit[TX_CLASS_CTRL] -= head_len[TX_CLASS_CTRL];
+		} else {
+			sched->deficit[TX_CLASS_CTRL] = 0;
+		}
+		return TX_CLASS_CTRL;
+	}
+
+	/* Ends: every turn of a class with a frame adds a quantum of at least 1 byte */
+	for (;;) {
+		class = sched->current;
+
+		if (!head_len[class]) {
+			/* An idle class does not save credit for later */
+			sched->deficit[class] = 0;
+			tx_sched_advance(sched);
+			continue;
+		}
+
+		if (!sched->turn_started) {
+			sched->deficit[class] += sched->config.quantum[class];
+			sched->turn_started = 1;
+		}
+
+		if (sched->deficit[class] >= head_len[class]) {
+			sched->deficit[class] -= head_len[class];
+			return class;
+		}
+
+		tx_sched_advance(sched);
+	}
+}
+
+static uint16_t tx_get16(const uint8_t *pos)
+{
+	return (pos[0] << 8) | pos[1];
+}
+
+static bool tx_udp_ctrl_port(uint16_t port)
+{
+	/* DNS, DHCP and DHCPv6 */
+	return port == 53 || port == 67 || port == 68 || port == 546 || port == 547;
+}
+
+/* The transport header of an IPv4 or IPv6 packet of l4_len bytes */
+static bool tx_l4_is_ctrl(uint8_t proto, const uint8_t *l4, uint32_t l4_len)
+{
+	uint32_t doff = 0;
+
+	switch (proto) {
+	case TX_IP_PROTO_TCP:
+		if (l4_len < TX_TCP_HLEN) {
+			return false;
+		}
+		/* No payload, so that it cannot overtake the data of its flow: ACKs, SYNs */
+		doff = (l4[12] >> 4) * 4;
+		return doff >= TX_TCP_HLEN && doff == l4_len && !(l4[13] & TX_TCP_FIN_RST);
+	case TX_IP_PROTO_UDP:
+		return l4_len >= TX_UDP_HLEN && (tx_udp_ctrl_port(tx_get16(l4)) || tx_udp_ctrl_port(tx_get16(l4 + 2)));
+	case TX_IP_PROTO_ICMP6:
+		/* Neighbour discovery */
+		return l4_len >= 1 && l4[0] >= TX_ICMP6_RS && l4[0] <= TX_ICMP6_REDIRECT;
+	default:
+		return false;
+	}
+}
+
+bool tx_sched_is_ctrl_frame(const uint8_t *frame, uint16_t len)
+{
+	const uint8_t *ip = frame + TX_ETH_HLEN;
+	uint32_t ihl = 0, total = 0;
+
+	if (!frame || len < TX_ETH_HLEN) {
+		return false;
+	}
+
+	switch (tx_get16(frame + 12)) {
+	case TX_ETH_TYPE_ARP:
+		return true;
+	case TX_ETH_TYPE_IP:
+		if (len < TX_ETH_HLEN + 20 || (ip[0] >> 4) != 4) {
+			return false;
+		}
+		ihl = (ip[0] & 0x0F) * 4;
+		total = tx_get16(ip + 2);
+		/* Fragments are data, only the first one has the transport header */
+		if (ihl < 20 || total < ihl || total > len - TX_ETH_HLEN || (tx_get16(ip + 6) & 0x3FFF)) {
+			return false;
+		}
+		return tx_l4_is_ctrl(ip[9], ip + ihl, total - ihl);
+	case TX_ETH_TYPE_IPV6:
+		if (len < TX_ETH_HLEN + TX_IP6_HLEN || (ip[0] >> 4) != 6) {
+			return false;
+		}
+		total = tx_get16(ip + 4);
+		if (total > len - TX_ETH_HLEN - TX_IP6_HLEN) {
+			return false;
+		}
+		/* Extension headers are not walked, such packets are data */
+		return tx_l4_is_ctrl(ip[6], ip + TX_IP6_HLEN, total);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,198 @@
+// Copyright 2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "test_utils.h"
+
+#include "tx_sched.h"
+
+#define TEST_ETH_HLEN       (14)
+#define TEST_IP_HLEN        (20)
+#define TEST_IP6_HLEN       (40)
+#define TEST_TCP_HLEN       (20)
+#define TEST_UDP_HLEN       (8)
+
+#define TEST_TCP_FIN        (0x01)
+#define TEST_TCP_SYN        (0x02)
+#define TEST_TCP_ACK        (0x10)
+
+static void test_put16(uint8_t *pos, uint16_t value)
+{
+	pos[0] = value >> 8;
+	pos[1] = value & 0xFF;
+}
+
+/* An IPv4 frame of proto with l4_len bytes after the IP header, returns its length */
+static uint16_t test_ip_frame(uint8_t *frame, uint8_t proto, uint16_t l4_len)
+{
+	uint8_t *ip = frame + TEST_ETH_HLEN;
+
+	memset(frame, 0, TEST_ETH_HLEN + TEST_IP_HLEN + l4_len);
+	test_put16(frame + 12, 0x0800);
+	ip[0] = 0x45;
+	test_put16(ip + 2, TEST_IP_HLEN + l4_len);
+	ip[9] = proto;
+
+	return TEST_ETH_HLEN + TEST_IP_HLEN + l4_len;
+}
+
+static uint16_t test_tcp_frame(uint8_t *frame, uint8_t flags, uint16_t payload_len)
+{
+	uint16_t len = test_ip_frame(frame, 6, TEST_TCP_HLEN + payload_len);
+	uint8_t *tcp = frame + TEST_ETH_HLEN + TEST_IP_HLEN;
+
+	tcp[12] = (TEST_TCP_HLEN / 4) << 4;
+	tcp[13] = flags;
+
+	return len;
+}
+
+static uint16_t test_udp_frame(uint8_t *frame, uint16_t src_port, uint16_t dst_port, uint16_t payload_len)
+{
+	uint16_t len = test_ip_frame(frame, 17, TEST_UDP_HLEN + payload_len);
+	uint8_t *udp = frame + TEST_ETH_HLEN + TEST_IP_HLEN;
+
+	test_put16(udp, src_port);
+	test_put16(udp + 2, dst_port);
+
+	return len;
+}
+
+TEST_CASE("tx_sched control class takes ARP, pure TCP ACKs and SYNs", "[network_adapter]")
+{
+	uint8_t frame[128];
+	uint16_t len = 0;
+
+	memset(frame, 0, sizeof(frame));
+	test_put16(frame + 12, 0x0806);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, 42));
+
+	len = test_tcp_frame(frame, TEST_TCP_ACK, 0);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+	len = test_tcp_frame(frame, TEST_TCP_SYN, 0);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+	/* Ethernet padding of a short frame is not payload */
+	len = test_tcp_frame(frame, TEST_TCP_ACK, 0);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len + 6));
+}
+
+TEST_CASE("tx_sched control class keeps small data frames with their flow", "[network_adapter]")
+{
+	uint8_t frame[128];
+	uint16_t len = 0;
+
+	/* A small TCP segment with data, or a FIN, must not overtake the data of its flow */
+	len = test_tcp_frame(frame, TEST_TCP_ACK, 20);
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len));
+	len = test_tcp_frame(frame, TEST_TCP_ACK | TEST_TCP_FIN, 0);
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len));
+
+	/* Small UDP datagrams of an RTP flow */
+	len = test_udp_frame(frame, 5004, 5004, 40);
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len));
+
+	/* Later fragments do not have the transport header */
+	len = test_tcp_frame(frame, TEST_TCP_ACK, 0);
+	test_put16(frame + TEST_ETH_HLEN + 6, 10);
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len));
+
+	/* Truncated frames */
+	len = test_tcp_frame(frame, TEST_TCP_ACK, 0);
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len - 1));
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, 10));
+}
+
+TEST_CASE("tx_sched control class takes DNS, DHCP and IPv6 neighbour discovery", "[network_adapter]")
+{
+	uint8_t frame[128];
+	uint8_t *ip6 = frame + TEST_ETH_HLEN;
+	uint16_t len = 0;
+
+	len = test_udp_frame(frame, 49152, 53, 30);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+	len = test_udp_frame(frame, 53, 49152, 60);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+	len = test_udp_frame(frame, 68, 67, 60);
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+
+	/* An IPv6 neighbour solicitation, then an echo request */
+	memset(frame, 0, sizeof(frame));
+	test_put16(frame + 12, 0x86DD);
+	ip6[0] = 0x60;
+	test_put16(ip6 + 4, 32);
+	ip6[6] = 58;
+	ip6[TEST_IP6_HLEN] = 135;
+	len = TEST_ETH_HLEN + TEST_IP6_HLEN + 32;
+	TEST_ASSERT_TRUE(tx_sched_is_ctrl_frame(frame, len));
+	ip6[TEST_IP6_HLEN] = 128;
+	TEST_ASSERT_FALSE(tx_sched_is_ctrl_frame(frame, len));
+}
+
+/*
+ * send_task hands the frames to the transport in the order of tx_sched_next(), and the SPI transport sends them
+ * in that order through a single queue. With the data and the BT classes always backlogged, BT keeps the share
+ * of the bus its quantum gives it, whatever the depth of the transport queue.
+ */
+TEST_CASE("tx_sched keeps the BT share of the bus behind the transport queue", "[network_adapter]")
+{
+	const uint16_t frame_len[TX_CLASS_MAX] = {
+		[TX_CLASS_DATA] = 1500,
+		[TX_CLASS_BT] = 260,
+	};
+	tx_sched_config_t config = {
+		.quantum = {
+			[TX_CLASS_CTRL] = 1600,
+			[TX_CLASS_DATA] = 3 * 1600,
+			[TX_CLASS_BT] = 1600,
+		},
+	};
+	uint16_t head_len[TX_CLASS_MAX] = {0};
+	uint8_t fifo[20];
+	uint32_t fifo_head = 0;
+	uint32_t fifo_num = 0;
+	uint32_t bus_bytes[TX_CLASS_MAX] = {0};
+	uint32_t data_run = 0;
+	uint32_t max_data_run = 0;
+	tx_sched_t sched;
+
+	tx_sched_init(&sched, &config);
+	head_len[TX_CLASS_DATA] = frame_len[TX_CLASS_DATA];
+	head_len[TX_CLASS_BT] = frame_len[TX_CLASS_BT];
+
+	for (uint32_t slot = 0; slot < 20000; slot++) {
+		/* send_task fills the transport queue, then the bus takes one frame */
+		while (fifo_num < sizeof(fifo)) {
+			int class = tx_sched_next(&sched, head_len);
+
+			TEST_ASSERT_TRUE(class == TX_CLASS_DATA || class == TX_CLASS_BT);
+			fifo[(fifo_head + fifo_num++) % sizeof(fifo)] = class;
+		}
+
+		uint8_t class = fifo[fifo_head];
+		fifo_head = (fifo_head + 1) % sizeof(fifo);
+		fifo_num--;
+
+		bus_bytes[class] += frame_len[class];
+		data_run = (class == TX_CLASS_DATA) ? data_run + 1 : 0;
+		max_data_run = (data_run > max_data_run) ? data_run : max_data_run;
+	}
+
+	/* BT has a quarter of the quanta, within a frame of each class per round */
+	uint32_t total = bus_bytes[TX_CLASS_DATA] + bus_bytes[TX_CLASS_BT];
+	TEST_ASSERT_UINT32_WITHIN(total / 50, total / 4, bus_bytes[TX_CLASS_BT]);
+	/* A round never sends more data than its quantum */
+	TEST_ASSERT_LESS_OR_EQUAL(config.quantum[TX_CLASS_DATA] / frame_len[TX_CLASS_DATA] + 1, max_data_run);
+}
@@ -1441,6 +1441,32 @@ static esp_err_t ota_info_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+#if CONFIG_LITEMESH_PATH_METRICS
+static esp_err_t mesh_info_get_handler(httpd_req_t *req)
+{
+    esp_litemesh_path_stats_t path_stats;
+    int32_t json_len = 0;
+    char *temp_json_str = ((web_server_context_t*) (req->user_ctx))->scratch;
+
+    memset(temp_json_str, '\0', ESP_GATEWAY_WEB_SCRATCH_BUFSIZE * sizeof(char));
+    if (esp_litemesh_get_path_stats(&path_stats) != ESP_OK) {
+        esp_web_response_error(req, HTTPD_500);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    json_len += sprintf(temp_json_str + json_len, "{\"state\":0,\"path_valid\":%d,", path_stats.valid);
+    json_len += sprintf(temp_json_str + json_len, "\"path_rtt_us\":%u,\"path_kbps\":%u,", path_stats.path_rtt_us, path_stats.path_kbps);
+    json_len += sprintf(temp_json_str + json_len, "\"link_rtt_us\":%u,\"link_kbps\":%u,", path_stats.link_rtt_us, path_stats.link_kbps);
+    json_len += sprintf(temp_json_str + json_len, "\"probes\":%u,\"losses\":%u}", path_stats.probes, path_stats.losses);
+
+    ESP_LOGD(TAG, "now mesh info json str is %s\n", temp_json_str);
+    httpd_resp_send(req, temp_json_str, strlen(temp_json_str));
+
+    return ESP_OK;
+}
+#endif
+
 const esp_partition_t *esp_web_get_ota_update_partition(void)
 {
     const esp_partition_t *update_partition = NULL;
@@ -1591,6 +1617,9 @@ static esp_err_t start_web_server(const char *base_path, uint16_t server_port)
         {"/getaprecord", HTTP_GET, ap_record_get_handler, s_web_context},
         {"/getotainfo", HTTP_GET, ota_info_get_handler, s_web_context},
         {"/setotadata", HTTP_POST, ota_data_post_handler, s_web_context},
+#if CONFIG_LITEMESH_PATH_METRICS
+        {"/getmeshinfo", HTTP_GET, mesh_info_get_handler, s_web_context},
+#endif
         {"/", HTTP_GET, web_common_get_handler,s_web_context},
     };
 
@@ -10,6 +10,15 @@
 
 /* ESP Payload Header Flags */
 #define MORE_FRAGMENT			(1 << 0)
+/* Another frame follows this one in the same transport buffer */
+#define MORE_FRAMES			(1 << 1)
+
+/* Aggregates: frames back to back in one transport buffer, each with its own
+ * header and padded to 4 bytes, all headers but the last flagged MORE_FRAMES */
+#define ESP_AGGR_ALIGN			4
+#define ESP_AGGR_FRAME_LEN(len)		(((len) + sizeof(struct esp_payload_header) + \
+					 ESP_AGGR_ALIGN - 1) & ~(ESP_AGGR_ALIGN - 1))
+#define ESP_AGGR_MAX_LEN		1600
 
 struct esp_payload_header {
 	uint8_t          if_type:4;
@@ -68,6 +77,8 @@ typedef enum {
 	ESP_PRIV_CAPABILITY,
 	ESP_PRIV_SPI_CLK_MHZ,
 	ESP_PRIV_FIRMWARE_CHIP_ID,
+	/* Frames per aggregate: offered by the peripheral, accepted by the host */
+	ESP_PRIV_AGGREGATION,
 } ESP_PRIV_TAG_TYPE;
 
 struct esp_priv_event {
@@ -33,5 +33,6 @@ void esp_tx_pause(void);
 void esp_tx_resume(void);
 void process_init_event(u8 *evt_buf, u8 len);
 void process_capabilities(u8 cap);
+void process_aggregation(u8 max_frames);
 
 #endif
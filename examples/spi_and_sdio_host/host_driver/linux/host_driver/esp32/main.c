@@ -55,6 +55,8 @@ volatile u8 stop_data = 0;
 #endif
 
 #define ACTION_DROP 1
+/* Frames of an aggregate from the peripheral the driver accepts */
+#define ESP_AGGR_MAX_FRAMES 16
 /* Unless specified as part of argument, resetpin,
  * do not reset ESP32.
  */
@@ -318,6 +320,48 @@ static int process_tx_packet (struct sk_buff *skb)
 	return 0;
 }
 
+void process_aggregation(u8 max_frames)
+{
+	struct esp_adapter *adapter = esp_get_adapter();
+	struct esp_payload_header *header;
+	struct esp_priv_event *event;
+	struct sk_buff *skb;
+	u16 len = sizeof(struct esp_priv_event) + 3;
+	u8 *pos;
+
+	if (!max_frames)
+		return;
+
+	/* Answer with the frames accepted, the peripheral packs none before */
+	skb = esp_alloc_skb(sizeof(struct esp_payload_header) + len);
+	if (!skb) {
+		printk(KERN_ERR "%s: Failed to allocate SKB", __func__);
+		return;
+	}
+	header = (struct esp_payload_header *) skb_put(skb, sizeof(struct esp_payload_header) + len);
+	memset(header, 0, sizeof(struct esp_payload_header) + len);
+
+	header->if_type = ESP_PRIV_IF;
+	header->if_num = 0;
+	header->len = cpu_to_le16(len);
+	header->offset = cpu_to_le16(sizeof(struct esp_payload_header));
+	header->priv_pkt_type = ESP_PACKET_TYPE_EVENT;
+
+	event = (struct esp_priv_event *) (skb->data + sizeof(struct esp_payload_header));
+	event->event_type = ESP_PRIV_EVENT_INIT;
+	event->event_len = 3;
+	pos = event->event_data;
+	*pos++ = ESP_PRIV_AGGREGATION;
+	*pos++ = 1;
+	*pos++ = min_t(u8, max_frames, ESP_AGGR_MAX_FRAMES);
+
+	header->checksum = cpu_to_le16(compute_checksum(skb->data, skb->len));
+
+	printk(KERN_INFO "ESP peripheral aggregates up to %u frames\n", min_t(u8, max_frames, ESP_AGGR_MAX_FRAMES));
+	if (esp_send_packet(adapter, skb))
+		printk(KERN_ERR "%s: Failed to answer aggregation\n", __func__);
+}
+
 void process_capabilities(u8 cap)
 {
 	struct esp_adapter *adapter = esp_get_adapter();
@@ -515,9 +559,44 @@ struct sk_buff * esp_alloc_skb(u32 len)
 }
 
 
+/* Frames of an aggregate, see wifi_dongle_adapter.h, each copied but the last one, which keeps the skb */
+static void process_rx_aggregate(struct sk_buff *skb)
+{
+	struct esp_payload_header *header;
+	struct sk_buff *frame_skb;
+	u32 pos = 0, frame_len;
+
+	while (pos + sizeof(struct esp_payload_header) <= skb->len) {
+		header = (struct esp_payload_header *) (skb->data + pos);
+		frame_len = le16_to_cpu(header->offset) + le16_to_cpu(header->len);
+
+		if (le16_to_cpu(header->offset) != sizeof(struct esp_payload_header) ||
+		    pos + frame_len > skb->len)
+			break;
+
+		if (!(header->flags & MORE_FRAMES)) {
+			skb_pull(skb, pos);
+			skb_trim(skb, frame_len);
+			process_rx_packet(skb);
+			return;
+		}
+
+		frame_skb = esp_alloc_skb(frame_len);
+		if (frame_skb) {
+			memcpy(skb_put(frame_skb, frame_len), header, frame_len);
+			process_rx_packet(frame_skb);
+		}
+
+		pos += ESP_AGGR_FRAME_LEN(le16_to_cpu(header->len));
+	}
+
+	dev_kfree_skb_any(skb);
+}
+
 static int esp_get_packets(struct esp_adapter *adapter)
 {
 	struct sk_buff *skb = NULL;
+	struct esp_payload_header *header;
 
 	if (!adapter || !adapter->if_ops || !adapter->if_ops->read)
 		return -EINVAL;
@@ -527,7 +606,11 @@ static int esp_get_packets(struct esp_adapter *adapter)
 	if (!skb)
 		return -EFAULT;
 
-	process_rx_packet(skb);
+	header = (struct esp_payload_header *) skb->data;
+	if (skb->len >= sizeof(struct esp_payload_header) && (header->flags & MORE_FRAMES))
+		process_rx_aggregate(skb);
+	else
+		process_rx_packet(skb);
 
 	return 0;
 }
@@ -711,8 +794,9 @@ int esp_remove_card(struct esp_adapter *adapter)
 
 static void esp_if_rx_work (struct work_struct *work)
 {
-	/* read inbound packet and forward it to network/serial interface */
-	esp_get_packets(&adapter);
+	/* read inbound packets and forward them to network/serial interface,
+	 * the slave may have queued several behind one interrupt */
+	while (!esp_get_packets(&adapter));
 }
 
 static void deinit_adapter(void)
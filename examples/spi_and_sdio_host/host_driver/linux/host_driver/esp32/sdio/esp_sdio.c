@@ -796,6 +796,8 @@ void process_init_event(u8 *evt_buf, u8 len)
 		if (*pos == ESP_PRIV_CAPABILITY) {
 			process_capabilities(*(pos + 2));
 			print_capabilities(*(pos + 2));
+		} else if (*pos == ESP_PRIV_AGGREGATION) {
+			process_aggregation(*(pos + 2));
 		} else {
 			printk (KERN_WARNING "Unsupported tag in event");
 		}
@@ -177,6 +177,8 @@ void process_init_event(u8 *evt_buf, u8 len)
 			adjust_spi_clock(*(pos + 2));
 		} else if (*pos == ESP_PRIV_FIRMWARE_CHIP_ID){
 			hardware_type = *(pos+2);
+		} else if (*pos == ESP_PRIV_AGGREGATION){
+			process_aggregation(*(pos + 2));
 		} else {
 			printk (KERN_WARNING "Unsupported tag in event");
 		}
@@ -197,6 +199,7 @@ static int process_rx_buf(struct sk_buff *skb)
 	struct esp_payload_header *header;
 	u16 len = 0;
 	u16 offset = 0;
+	u16 pos = 0;
 
 	if (!skb)
 		return -EINVAL;
@@ -225,6 +228,20 @@ static int process_rx_buf(struct sk_buff *skb)
 		return -EINVAL;
 	}
 
+	/* An aggregate ends with the first frame not flagged MORE_FRAMES */
+	while (header->flags & MORE_FRAMES) {
+		pos += ESP_AGGR_FRAME_LEN(le16_to_cpu(header->len));
+		if (pos + sizeof(struct esp_payload_header) > SPI_BUF_SIZE)
+			return -EINVAL;
+
+		header = (struct esp_payload_header *) (skb->data + pos);
+		len = pos + le16_to_cpu(header->offset) + le16_to_cpu(header->len);
+		if (le16_to_cpu(header->offset) != sizeof(struct esp_payload_header) ||
+		    !header->len || len > SPI_BUF_SIZE)
+			return -EINVAL;
+	}
+	header = (struct esp_payload_header *) skb->data;
+
 	/* Trim SKB to actual size */
 	skb_trim(skb, len);
 
@@ -233,7 +250,7 @@ static int process_rx_buf(struct sk_buff *skb)
 		return -EPERM;
 
 	/* enqueue skb for read_packet to pick it */
-	if (header->if_type == ESP_HCI_IF)
+	if (header->if_type == ESP_HCI_IF && !(header->flags & MORE_FRAMES))
 		skb_queue_tail(&spi_context.rx_q[PRIO_Q_BT], skb);
 	else
 		skb_queue_tail(&spi_context.rx_q[PRIO_Q_OTHERS], skb);